@@ -117,6 +117,8 @@ A2dpHpDevice::Init
     //
     m_State                         = eA2dpHpStateInitializing;
     m_Adapter                       = Adapter;
+    m_ArrivalQpc                    = KeQueryPerformanceCounter(NULL);
+    m_FirstStreamTraced             = FALSE;
 
     // Static config.
     m_WdfIoTarget                   = NULL;
@@ -153,6 +155,16 @@ A2dpHpDevice::Init
 
     InitializeListHead(&m_ListEntry);
     KeInitializeSpinLock(&m_Lock);
+
+    // Packet transport.
+    m_SoftwareEncoder               = g_A2dpSoftwareEncoder ? TRUE : FALSE;
+    m_TransportTimer                = NULL;
+    m_TransportStage                = NULL;
+    m_TransportTime                 = 0;
+    m_LinkCredit                    = 0;
+    m_PacketsSent                   = 0;
+    m_BytesSent                     = 0;
+    KeInitializeSpinLock(&m_TransportLock);
     
     RtlZeroMemory(&m_SymbolicLinkName, sizeof(m_SymbolicLinkName));
     
@@ -163,6 +175,23 @@ A2dpHpDevice::Init
 
     RtlZeroMemory(&m_SpeakerTransportResources, sizeof(A2DPHPDEVICE_EP_TRANSPORT_RESOURCES));
     
+    //
+    // Without a sideband encoder, the timer of the packet transport.
+    //
+    if (m_SoftwareEncoder)
+    {
+        m_TransportTimer = ExAllocateTimer(EvtA2dpHpTransportTimer, this, EX_TIMER_HIGH_RESOLUTION);
+        if (m_TransportTimer == NULL)
+        {
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        IF_FAILED_ACTION_JUMP(
+            ntStatus,
+            DPF(D_ERROR, ("%!FUNC!: ExAllocateTimer failed, out of memory")),
+            Done);
+    }
+
     //
     // Allocate a notification WDF work-item.
     //
@@ -485,6 +514,13 @@ Return Value:
 
     ASSERT(m_State != eA2dpHpStateRunning);
     ASSERT(IsListEmpty(&m_ListEntry));
+    ASSERT(m_TransportStage == NULL);
+
+    if (m_TransportTimer != NULL)
+    {
+        ExDeleteTimer(m_TransportTimer, TRUE, TRUE, NULL);
+        m_TransportTimer = NULL;
+    }
     
     //
     // Release ref to remote stack.
@@ -1211,12 +1247,19 @@ A2dpHpDevice::StreamStart(_In_ eDeviceType deviceType)
     PAGED_CODE();
     DPF_ENTER(("[%!FUNC!]"));
 
+    NTSTATUS ntStatus = STATUS_INVALID_PARAMETER;
+
     if (deviceType == eA2dpHpSpeakerDevice)
     {
-        return SpeakerStreamStart();
+        ntStatus = SpeakerStreamStart();
     }
 
-    return STATUS_INVALID_PARAMETER;
+    if (NT_SUCCESS(ntStatus) && !InterlockedExchange(&m_FirstStreamTraced, TRUE))
+    {
+        DPF(D_VERBOSE, ("%!FUNC!: %wZ first stream started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+    }
+
+    return ntStatus;
 }
 
 //=============================================================================
@@ -1443,6 +1486,207 @@ A2dpHpDevice::GetNRECDisableStatus()
     return FALSE;
 }
 
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOL
+A2dpHpDevice::IsEncodingOffloaded(_In_ eDeviceType deviceType)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    DPF_ENTER(("[%!FUNC!]"));
+
+    // Unless the software encoder was asked for, the sideband controller encodes the A2DP stream.
+    return !m_SoftwareEncoder;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+A2dpHpDevice::SendPacket
+(
+    _In_        eDeviceType             deviceType,
+    _In_reads_bytes_(Length) const BYTE *Packet,
+    _In_        ULONG                   Length
+)
+{
+    UNREFERENCED_PARAMETER(Packet);
+
+    if (!m_SoftwareEncoder || deviceType != eA2dpHpSpeakerDevice || Length > A2DP_SBC_PACKET_BYTES)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    //
+    // This is where the media packet would go out on the ACL link; the
+    // sample counts it. The transport calls this under m_TransportLock.
+    //
+    m_PacketsSent++;
+    m_BytesSent += Length;
+
+    return STATUS_SUCCESS;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+A2dpHpDevice::ReceivePacket
+(
+    _In_        eDeviceType             deviceType,
+    _Out_writes_bytes_(Length) BYTE     *Packet,
+    _In_        ULONG                   Length
+)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(Packet);
+    UNREFERENCED_PARAMETER(Length);
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+//=============================================================================
+#pragma code_seg()
+NTSTATUS
+A2dpHpDevice::StartPacketTransport
+(
+    _In_        eDeviceType             deviceType,
+    _In_        A2DP_SBC_STAGE          *Stage
+)
+{
+    NTSTATUS    ntStatus = STATUS_SUCCESS;
+    KIRQL       oldIrql;
+
+    DPF_ENTER(("[%!FUNC!]"));
+
+    if (!m_SoftwareEncoder || deviceType != eA2dpHpSpeakerDevice)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    KeAcquireSpinLock(&m_TransportLock, &oldIrql);
+
+    // The link carries one stream.
+    if (m_TransportStage != NULL)
+    {
+        ntStatus = STATUS_DEVICE_BUSY;
+    }
+    else
+    {
+        m_TransportStage = Stage;
+        m_TransportTime = KeQueryInterruptTime();
+        m_LinkCredit = 0;
+        m_PacketsSent = 0;
+        m_BytesSent = 0;
+    }
+
+    KeReleaseSpinLock(&m_TransportLock, oldIrql);
+
+    if (NT_SUCCESS(ntStatus))
+    {
+        ExSetTimer(m_TransportTimer, -A2DPHP_TRANSPORT_PERIOD, A2DPHP_TRANSPORT_PERIOD, NULL);
+    }
+
+    return ntStatus;
+}
+
+//=============================================================================
+#pragma code_seg()
+VOID
+A2dpHpDevice::StopPacketTransport(_In_ eDeviceType deviceType)
+{
+    KIRQL       oldIrql;
+
+    DPF_ENTER(("[%!FUNC!]"));
+
+    if (!m_SoftwareEncoder || deviceType != eA2dpHpSpeakerDevice)
+    {
+        return;
+    }
+
+    ExCancelTimer(m_TransportTimer, NULL);
+
+    //
+    // A timer run already under way holds the lock until it is done with
+    // the stage; any later run finds no stage.
+    //
+    KeAcquireSpinLock(&m_TransportLock, &oldIrql);
+
+    if (m_TransportStage != NULL)
+    {
+        DPF(D_TERSE, ("A2DP transport: %u packets, %I64u bytes sent, link quality %d",
+                      m_PacketsSent, m_BytesSent, m_TransportStage->LinkQuality));
+        m_TransportStage = NULL;
+    }
+
+    KeReleaseSpinLock(&m_TransportLock, oldIrql);
+}
+
+//=============================================================================
+#pragma code_seg()
+_Use_decl_annotations_
+VOID
+A2dpHpDevice::EvtA2dpHpTransportTimer
+(
+    PEX_TIMER   Timer,
+    PVOID       Context
+)
+/*++
+
+Routine Description:
+
+  Sends the packets the stream encoded since the last run, as far as the
+  link's rate allows, and feeds the link quality back to the encoder.
+
+--*/
+{
+    A2dpHpDevice *  This = (A2dpHpDevice *)Context;
+    ULONGLONG       now = KeQueryInterruptTime();
+    ULONG           credit = MAXULONG;
+    ULONG           sent;
+    KIRQL           oldIrql;
+
+    UNREFERENCED_PARAMETER(Timer);
+
+    KeAcquireSpinLock(&This->m_TransportLock, &oldIrql);
+
+    if (This->m_TransportStage != NULL)
+    {
+        //
+        // kbps to bytes per 100 ns. Airtime the link did not use is not
+        // kept beyond two packets.
+        //
+        if (g_A2dpLinkRate != 0)
+        {
+            ULONGLONG earned = (now - This->m_TransportTime) * g_A2dpLinkRate / 80000;
+
+            credit = (ULONG)min(This->m_LinkCredit + earned, 2 * A2DP_SBC_PACKET_BYTES);
+        }
+
+        sent = A2dpSbcTransmit(This->m_TransportStage, credit, A2dpHpLinkSend, This);
+
+        This->m_LinkCredit = (g_A2dpLinkRate != 0) ? credit - sent : 0;
+        This->m_TransportTime = now;
+    }
+
+    KeReleaseSpinLock(&This->m_TransportLock, oldIrql);
+}
+
+//=============================================================================
+#pragma code_seg()
+BOOLEAN
+A2dpHpDevice::A2dpHpLinkSend
+(
+    _In_                        PVOID           Context,
+    _In_reads_bytes_(Length)    const BYTE      *Packet,
+    _In_                        ULONG           Length
+)
+{
+    A2dpHpDevice *  This = (A2dpHpDevice *)Context;
+
+    return NT_SUCCESS(This->SendPacket(eA2dpHpSpeakerDevice, Packet, Length)) ? TRUE : FALSE;
+}
+
 //
 // Helper functions.
 //
@@ -3670,6 +3914,8 @@ Routine Description:
         DPF(D_ERROR, ("%!FUNC!: SetSidebandClaimed TRUE: failed, 0x%x", ntStatus)),
         Done);
 
+    DPF(D_VERBOSE, ("%!FUNC!: %wZ started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+
     //
     // All done.
     //
@@ -4,6 +4,7 @@
 //
 #ifdef SYSVAD_A2DP_SIDEBAND
 
+#include "A2dpSbcEncoder.h"
 
 //=====================================================================
 //
@@ -24,6 +25,11 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME
     GetA2dpHpWorkItemContext
 )
 
+//
+// Period of the transport sending the SBC packets, in 100 ns units.
+//
+#define A2DPHP_TRANSPORT_PERIOD         (10 * 10000)
+
 // start/stop the device
 enum eA2dpHpTaskAction
 {
@@ -194,6 +200,9 @@ class A2dpHpDevice :
             
         IAdapterCommon        * m_Adapter;
         WDFIOTARGET             m_WdfIoTarget;
+
+        LARGE_INTEGER           m_ArrivalQpc;       // When the interface arrived.
+        LONG                    m_FirstStreamTraced;
         
         LIST_ENTRY              m_ListEntry;
         UNICODE_STRING          m_SymbolicLinkName;
@@ -255,6 +264,21 @@ class A2dpHpDevice :
         LONG                    m_nSpeakerStreams; // # of open streams.
         LONG                    m_nSpeakerStartedStreams;
 
+        //
+        // Without a sideband encoder the speaker stream encodes SBC, and
+        // this transport sends its packets. The sample has no ACL channel
+        // to put them on: the link takes them at g_A2dpLinkRate and counts
+        // them.
+        //
+        BOOL                    m_SoftwareEncoder;
+        KSPIN_LOCK              m_TransportLock;
+        PEX_TIMER               m_TransportTimer;
+        A2DP_SBC_STAGE *        m_TransportStage;
+        ULONGLONG               m_TransportTime;    // interrupt time of the last run
+        ULONG                   m_LinkCredit;       // bytes the link can take now
+        ULONG                   m_PacketsSent;
+        ULONGLONG               m_BytesSent;
+
         A2dpHpEventCallback     m_SpeakerVolumeCallback;
 
         A2dpHpEventCallback     m_SpeakerMuteCallback;
@@ -414,6 +438,33 @@ class A2dpHpDevice :
         
         STDMETHODIMP_(BOOL)                 GetNRECDisableStatus();
 
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(BOOL)                 IsEncodingOffloaded(_In_ eDeviceType deviceType);
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(NTSTATUS)             SendPacket
+        (
+            _In_        eDeviceType             deviceType,
+            _In_reads_bytes_(Length) const BYTE *Packet,
+            _In_        ULONG                   Length
+        );
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(NTSTATUS)             ReceivePacket
+        (
+            _In_        eDeviceType             deviceType,
+            _Out_writes_bytes_(Length) BYTE     *Packet,
+            _In_        ULONG                   Length
+        );
+
+        STDMETHODIMP_(NTSTATUS)             StartPacketTransport
+        (
+            _In_        eDeviceType             deviceType,
+            _In_        A2DP_SBC_STAGE          *Stage
+        );
+
+        STDMETHODIMP_(VOID)                 StopPacketTransport(_In_ eDeviceType deviceType);
+
     private:
         //=====================================================================
         //
@@ -626,4 +677,18 @@ class A2dpHpDevice :
         
         static
         EVT_WDF_WORKITEM                   EvtA2dpHpDeviceNotificationStatusWorkItem;
+
+        //
+        // Packet transport.
+        //
+        static
+        EXT_CALLBACK                       EvtA2dpHpTransportTimer;
+
+        static
+        BOOLEAN                            A2dpHpLinkSend
+        (
+            _In_                        PVOID           Context,
+            _In_reads_bytes_(Length)    const BYTE      *Packet,
+            _In_                        ULONG           Length
+        );
 };
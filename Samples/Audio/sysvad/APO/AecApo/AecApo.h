@@ -19,6 +19,9 @@
 
 #include <wil\com.h>
 
+#include "AecCanceller.h"
+#include "AecReferenceBuffer.h"
+
 _Analysis_mode_(_Analysis_code_type_user_driver_)
 
 #pragma AVRT_VTABLES_BEGIN
@@ -40,6 +43,8 @@ public:
     {
     }
 
+    virtual ~CAecApoMFX();    // destructor
+
 DECLARE_REGISTRY_RESOURCEID(IDR_AECAPOMFX)
 
 BEGIN_COM_MAP(CAecApoMFX)
@@ -121,6 +126,24 @@ public:
     float                                   m_loopbackEndpointMasterVolume = 0;
 
 private:
+    void FreeProcessingMemory();
+
+    // Echo canceller and its locked memory, set up in LockForProcess
+    CAecCanceller                           m_Canceller;
+    BYTE                                    *m_pbProcessingMemory = nullptr;
+    UINT32                                  m_u32MicChannels = 0;
+    UINT32                                  m_u32FramesPerSecond = 0;
+
+    // Format of the loopback (reference) auxiliary input
+    UINT32                                  m_u32ReferenceChannels = 0;
+    UINT32                                  m_u32ReferenceFramesPerSecond = 0;
+    UINT32                                  m_u32ReferenceMaxFrames = 0;
+
+    // Timestamped loopback history written by AcceptInput and read, aligned
+    // to each microphone period, by APOProcess
+    CAecReferenceBuffer                     m_Reference;
+    FLOAT32                                 *m_pf32ReferenceFrames = nullptr;   // one period, contiguous
+
     wil::com_ptr_nothrow<IAudioProcessingObjectLoggingService> m_apoLoggingService;
 };
 #pragma AVRT_VTABLES_END
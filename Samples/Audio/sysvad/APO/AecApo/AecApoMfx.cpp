@@ -23,7 +23,9 @@
 #include <devicetopology.h>
 #include <CustomPropKeys.h>
 
-#define SUPPORTED_AEC_SAMPLINGRATE (16000)
+// Rate proposed when the requested format is not supported. The echo
+// canceller itself runs at any rate accepted by CAecCanceller.
+#define PREFERRED_AEC_SAMPLINGRATE (16000)
 
 // Static declaration of the APO_REG_PROPERTIES structure
 // associated with this APO.  The number in <> brackets is the
@@ -114,14 +116,33 @@ STDMETHODIMP_(void) CAecApoMFX::APOProcess(
             ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
 
             //
-            // Provide microphone buffer and timestamps to AEC algorithm
+            // Provide microphone buffer and reference to the AEC algorithm.
+            // The reference is the loopback rendered at the same QPC time as
+            // this period was captured, so the echo path the canceller has to
+            // model is only the acoustic one.
             //
-            UNREFERENCED_PARAMETER(inConnection);
             UNREFERENCED_PARAMETER(outConnection);
 
+            const FLOAT32 *pf32Reference = NULL;
+            if (m_auxiliaryInputId != 0 && m_u32ReferenceFramesPerSecond == m_u32FramesPerSecond)
+            {
+                m_Reference.Read(m_pf32ReferenceFrames, ppInputConnections[0]->u32ValidFrameCount, inConnection->u64QPCTime);
+                pf32Reference = m_pf32ReferenceFrames;
+            }
+
+            // a silent input buffer is not guaranteed to hold zeros, so it is never read
+            m_Canceller.Process(
+                (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags) ? NULL : pf32InputFrames,
+                m_u32MicChannels,
+                pf32Reference,
+                pf32OutputFrames,
+                ppInputConnections[0]->u32ValidFrameCount);
+
             // Set the valid frame count.
             ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
-            ppOutputConnections[0]->u32BufferFlags = ppInputConnections[0]->u32BufferFlags;
+
+            // the canceller carries echo and overlap tails across periods
+            ppOutputConnections[0]->u32BufferFlags = BUFFER_VALID;
 
             break;
         }
@@ -152,7 +173,15 @@ STDMETHODIMP CAecApoMFX::GetLatency(HNSTIME* pTime)
   
     IF_TRUE_ACTION_JUMP(NULL == pTime, hr = E_POINTER, Exit);  
   
-    *pTime = 0;
+    // block assembly plus the residual echo suppressor overlap-add
+    if (m_bIsLocked && m_u32FramesPerSecond != 0)
+    {
+        *pTime = (HNSTIME)(HNS_PER_SECOND * m_Canceller.GetLatencyFrames() / m_u32FramesPerSecond);
+    }
+    else
+    {
+        *pTime = 0;
+    }
 
 Exit:  
     return hr;  
@@ -196,14 +225,91 @@ STDMETHODIMP CAecApoMFX::LockForProcess(UINT32 u32NumInputConnections,
 
     m_u32SamplesPerFrame = uncompAudioFormat.dwSamplesPerFrame;
 
+    hr = ppInputConnections[0]->pFormat->GetUncompressedAudioFormat(&uncompAudioFormat);
+    IF_FAILED_JUMP(hr, Exit);
+
+    m_u32MicChannels = uncompAudioFormat.dwSamplesPerFrame;
+    m_u32FramesPerSecond = (UINT32)uncompAudioFormat.fFramesPerSecond;
+    IF_TRUE_ACTION_JUMP(!CAecCanceller::IsSampleRateSupported(m_u32FramesPerSecond), hr = APOERR_INVALID_CONNECTION_FORMAT, Exit);
+
     hr = CBaseAudioProcessingObject::LockForProcess(u32NumInputConnections,
         ppInputConnections, u32NumOutputConnections, ppOutputConnections);
     IF_FAILED_JUMP(hr, Exit);
+
+    {
+        //
+        // Everything APOProcess touches is allocated here, in one block of
+        // locked memory: the canceller state, the reference history and a
+        // contiguous reference buffer for one period.
+        //
+        UINT32 u32MaxFrames = max(ppInputConnections[0]->u32MaxFrameCount, m_u32ReferenceMaxFrames);
+        UINT32 u32HistoryFrames = m_u32FramesPerSecond * AEC_REFERENCE_HISTORY_MS / 1000 + 2 * u32MaxFrames;
+        size_t cbCanceller = CAecCanceller::GetRequiredBytes(m_u32FramesPerSecond, AEC_DEFAULT_TAIL_MS);
+        size_t cbReference = CAecReferenceBuffer::GetRequiredBytes(u32HistoryFrames);
+        size_t cbFrames = sizeof(FLOAT32) * ppInputConnections[0]->u32MaxFrameCount;
+
+        cbCanceller = (cbCanceller + (APOFFT_ALIGNMENT - 1)) & ~(size_t)(APOFFT_ALIGNMENT - 1);
+        cbReference = (cbReference + (APOFFT_ALIGNMENT - 1)) & ~(size_t)(APOFFT_ALIGNMENT - 1);
+
+        FreeProcessingMemory();
+
+        hr = AERT_Allocate(cbCanceller + cbReference + cbFrames + APOFFT_ALIGNMENT, (void**)&m_pbProcessingMemory);
+        if (FAILED(hr))
+        {
+            m_pbProcessingMemory = nullptr;
+            CBaseAudioProcessingObject::UnlockForProcess();
+            goto Exit;
+        }
+
+        BYTE *pbAligned = (BYTE*)(((ULONG_PTR)m_pbProcessingMemory + (APOFFT_ALIGNMENT - 1)) & ~(ULONG_PTR)(APOFFT_ALIGNMENT - 1));
+
+        // both only fail for a format they cannot run on
+        if (!m_Canceller.Initialize(m_u32FramesPerSecond, AEC_DEFAULT_TAIL_MS, pbAligned) ||
+            !m_Reference.Initialize(m_u32FramesPerSecond, u32HistoryFrames, pbAligned + cbCanceller))
+        {
+            FreeProcessingMemory();
+            CBaseAudioProcessingObject::UnlockForProcess();
+            hr = APOERR_INVALID_CONNECTION_FORMAT;
+            goto Exit;
+        }
+        m_pf32ReferenceFrames = (FLOAT32*)(pbAligned + cbCanceller + cbReference);
+
+        // A loopback at a different rate cannot be used as a reference
+        if (m_u32ReferenceFramesPerSecond != m_u32FramesPerSecond && m_auxiliaryInputId != 0 && m_apoLoggingService != nullptr)
+        {
+            m_apoLoggingService->ApoLog(APO_LOG_LEVEL_ERROR, L"CAecApoMFX::LockForProcess loopback rate does not match the microphone rate.");
+        }
+    }
     
 Exit:
     return hr;
 }
 
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Releases the locked memory used by APOProcess.
+//
+void CAecApoMFX::FreeProcessingMemory()
+{
+    if (m_pbProcessingMemory != nullptr)
+    {
+        AERT_Free(m_pbProcessingMemory);
+        m_pbProcessingMemory = nullptr;
+    }
+    m_pf32ReferenceFrames = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Destructor.
+//
+CAecApoMFX::~CAecApoMFX(void)
+{
+    FreeProcessingMemory();
+} // ~CAecApoMFX
+
 // The method that this long comment refers to is "Initialize()"
 //-------------------------------------------------------------------------
 // Description:
@@ -421,7 +527,7 @@ HRESULT IsInputFormatSupportedForAec(IAudioMediaType* pMediaType, BOOL * pSuppor
 
     *pSupported = format.dwBytesPerSampleContainer == 4 &&
                   format.dwValidBitsPerSample == 32 &&
-                  format.fFramesPerSecond == SUPPORTED_AEC_SAMPLINGRATE && // We only support one sampling rate at the input
+                  CAecCanceller::IsSampleRateSupported((UINT32)format.fFramesPerSecond) &&
                   format.dwSamplesPerFrame <= 16 && // We only support <= 16 channels at the input
                   format.guidFormatType == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
 
@@ -442,7 +548,7 @@ HRESULT IsOutputFormatSupportedForAec(IAudioMediaType* pMediaType, BOOL * pSuppo
 
     *pSupported = format.dwBytesPerSampleContainer == 4 &&
                   format.dwValidBitsPerSample == 32 &&
-                  format.fFramesPerSecond == SUPPORTED_AEC_SAMPLINGRATE &&
+                  CAecCanceller::IsSampleRateSupported((UINT32)format.fFramesPerSecond) &&
                   format.dwSamplesPerFrame == 1 && // We only mono output
                   format.guidFormatType == KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
 
@@ -460,7 +566,7 @@ CreatePreferredInputMediaType(IAudioMediaType** ppMediaType, UINT32 requestedInp
     UNCOMPRESSEDAUDIOFORMAT format =
     {
         KSDATAFORMAT_SUBTYPE_IEEE_FLOAT,
-        1, 4, 32, SUPPORTED_AEC_SAMPLINGRATE, KSAUDIO_SPEAKER_DIRECTOUT
+        1, 4, 32, PREFERRED_AEC_SAMPLINGRATE, KSAUDIO_SPEAKER_DIRECTOUT
     };
 
     // Match the channel count of the input if it is less than 16
@@ -482,7 +588,7 @@ CreatePreferredOutputMediaType(IAudioMediaType** ppMediaType)
     UNCOMPRESSEDAUDIOFORMAT format =
     {
         KSDATAFORMAT_SUBTYPE_IEEE_FLOAT,
-        1, 4, 32, SUPPORTED_AEC_SAMPLINGRATE, KSAUDIO_SPEAKER_DIRECTOUT
+        1, 4, 32, PREFERRED_AEC_SAMPLINGRATE, KSAUDIO_SPEAKER_DIRECTOUT
     };
 
     return CreateAudioMediaTypeFromUncompressedAudioFormat(&format, ppMediaType);
@@ -517,9 +623,9 @@ STDMETHODIMP CAecApoMFX::IsInputFormatSupported(IAudioMediaType *pOutputFormat,
     // - The AEC APO can handle any mic format
     // - The AEC APO can support exactly 1 input format
     //
-    // For the purposes of this sample AEC APO, we pretend that the AEC APO supports exactly 1 format 
-    // - a sampling rate of SUPPORTED_AEC_SAMPLINGRATE. The APO can accept upto 16 channels at the input
-    //   and will output mono audio.
+    // This sample AEC APO supports 16, 32 and 48 kHz (the rates CAecCanceller runs at),
+    // proposing PREFERRED_AEC_SAMPLINGRATE otherwise. The APO can accept upto 16 channels
+    // at the input and will output mono audio.
     //
 
     if (pOutputFormat)
@@ -631,6 +737,16 @@ CAecApoMFX::AddAuxiliaryInput(
     // This APO can only handle 1 auxiliary input
     IF_TRUE_ACTION_JUMP(m_auxiliaryInputId != 0, hResult = APOERR_NUM_CONNECTIONS_INVALID, Exit);
 
+    {
+        UNCOMPRESSEDAUDIOFORMAT referenceFormat;
+        hResult = pInputConnection->pFormat->GetUncompressedAudioFormat(&referenceFormat);
+        IF_FAILED_JUMP(hResult, Exit);
+
+        m_u32ReferenceChannels = referenceFormat.dwSamplesPerFrame;
+        m_u32ReferenceFramesPerSecond = (UINT32)referenceFormat.fFramesPerSecond;
+        m_u32ReferenceMaxFrames = pInputConnection->u32MaxFrameCount;
+    }
+
     m_auxiliaryInputId = dwInputId;
 
     IF_TRUE_ACTION_JUMP( ((NULL == pbyData) && (0 != cbDataSize)), hResult = E_INVALIDARG, Exit);
@@ -683,6 +799,9 @@ CAecApoMFX::RemoveAuxiliaryInput(DWORD dwInputId)
     IF_TRUE_ACTION_JUMP(m_auxiliaryInputId != dwInputId, hResult = APOERR_INVALID_INPUTID, Exit);
 
     m_auxiliaryInputId = 0;
+    m_u32ReferenceChannels = 0;
+    m_u32ReferenceFramesPerSecond = 0;
+    m_u32ReferenceMaxFrames = 0;
 
     // Signal to AEC algorithm that there is no longer any reference audio stream
 
@@ -732,9 +851,18 @@ CAecApoMFX::AcceptInput(DWORD dwInputId,
 
     const APO_CONNECTION_PROPERTY_V2* connectionV2 = reinterpret_cast<const APO_CONNECTION_PROPERTY_V2*>(pInputConnection);
 
-    // Check connectionV2->property.u32BufferFlags to see whether loopback buffer is silent
-    // Provide loopback buffer and timestamp to AEC algorithm
-    UNREFERENCED_PARAMETER(connectionV2);
+    // A loopback at a different rate than the microphone is not a usable reference
+    if (m_u32ReferenceFramesPerSecond != m_u32FramesPerSecond)
+    {
+        return;
+    }
+
+    // Record the loopback buffer with its render time; a silent buffer is recorded as zeros
+    m_Reference.Write(
+        (BUFFER_SILENT == connectionV2->property.u32BufferFlags) ? NULL : reinterpret_cast<const FLOAT32*>(connectionV2->property.pBuffer),
+        m_u32ReferenceChannels,
+        connectionV2->property.u32ValidFrameCount,
+        connectionV2->u64QPCTime);
 }
 
 STDMETHODIMP CAecApoMFX::GetApoNotificationRegistrationInfo(_Out_writes_(*count) APO_NOTIFICATION_DESCRIPTOR** apoNotifications, _Out_ DWORD* count)
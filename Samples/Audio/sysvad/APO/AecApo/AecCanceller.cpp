@@ -0,0 +1,612 @@
+//
+// AecCanceller.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//  Implementation of CAecCanceller
+//
+
+#include <string.h>
+#include <math.h>
+
+#include "AecCanceller.h"
+
+// Normalized step size of the adaptive filter.
+#define AEC_STEP_SIZE               0.5f
+
+// Regularization of the per-bin step normalization, relative to full scale.
+#define AEC_REGULARIZATION          1e-6f
+
+// Reference energy per sample below which the far end is considered idle.
+#define AEC_FAR_END_FLOOR           1e-8f
+
+// Error to microphone energy ratio, relative to the converged ratio,
+// above which near-end speech is assumed present and the residual echo
+// suppressor backs off.
+#define AEC_DOUBLE_TALK_RATIO       4.0f
+
+// Long term ERLE needed before the double-talk detector is trusted.
+#define AEC_DOUBLE_TALK_MIN_ERLE    2.0f
+
+// How long the double-talk state holds after near-end speech ends.
+#define AEC_DOUBLE_TALK_HANGOVER_MS 60
+
+// Two-path control: the background filter replaces the foreground after
+// AEC_BACKGROUND_WIN_BLOCKS blocks with less than AEC_BACKGROUND_WIN_RATIO
+// of its error energy, and is reset from it when its error exceeds the
+// foreground's by AEC_BACKGROUND_RESET_RATIO and the microphone's.
+#define AEC_BACKGROUND_WIN_RATIO    0.5f
+#define AEC_BACKGROUND_WIN_BLOCKS   3
+#define AEC_BACKGROUND_RESET_RATIO  8.0f
+
+// Residual echo suppressor over-subtraction and gain floor (-20 dB).
+#define AEC_RES_OVERSUBTRACTION     2.0f
+#define AEC_RES_GAIN_FLOOR          0.1f
+
+CAecCanceller::CAecCanceller()
+:   m_u32BlockSize(0)
+,   m_u32FftSize(0)
+,   m_u32BinCount(0)
+,   m_u32PartitionCount(0)
+,   m_u32BlockPos(0)
+,   m_pf32MicBlock(NULL)
+,   m_pf32RefBlock(NULL)
+,   m_pf32OutBlock(NULL)
+,   m_pf32RefTime(NULL)
+,   m_pf32XRe(NULL)
+,   m_pf32XIm(NULL)
+,   m_u32XHead(0)
+,   m_pf32WRe(NULL)
+,   m_pf32WIm(NULL)
+,   m_pf32ForegroundWRe(NULL)
+,   m_pf32ForegroundWIm(NULL)
+,   m_pf32Pxx(NULL)
+,   m_u32ConstrainIndex(0)
+,   m_pf32Time(NULL)
+,   m_pf32SRe(NULL)
+,   m_pf32SIm(NULL)
+,   m_pf32Echo(NULL)
+,   m_pf32Error(NULL)
+,   m_pf32BackgroundError(NULL)
+,   m_pf32Window(NULL)
+,   m_pf32ErrorHistory(NULL)
+,   m_pf32EchoHistory(NULL)
+,   m_pf32EchoPower(NULL)
+,   m_pf32Gain(NULL)
+,   m_pf32OverlapTail(NULL)
+,   m_f32Leak(1.0f)
+,   m_f32MicEnergy(0.0f)
+,   m_f32ErrorEnergy(0.0f)
+,   m_f32ErleLong(1.0f)
+,   m_f32BackgroundEnergy(0.0f)
+,   m_u32BackgroundWins(0)
+,   m_u32DoubleTalkHangover(0)
+,   m_u32DoubleTalkHangoverBlocks(0)
+{
+}
+
+bool CAecCanceller::IsSampleRateSupported(uint32_t u32SampleRate)
+{
+    return (u32SampleRate == 16000) || (u32SampleRate == 32000) || (u32SampleRate == 48000);
+}
+
+//
+// Block size B: the largest power of two not exceeding 4 ms, which keeps the
+// FFT radix-2 for every supported rate (64 at 16 kHz, 128 at 32/48 kHz).
+//
+uint32_t CAecCanceller::GetBlockSize(uint32_t u32SampleRate)
+{
+    uint32_t u32Target = u32SampleRate / 250;
+    uint32_t u32Block = 32;
+
+    while (u32Block * 2 <= u32Target)
+    {
+        u32Block *= 2;
+    }
+    return u32Block;
+}
+
+size_t CAecCanceller::Layout(uint32_t u32SampleRate, uint32_t u32TailMs, uint8_t *pBase, CAecCanceller *pAec)
+{
+    uint32_t B = GetBlockSize(u32SampleRate);
+    uint32_t N = 2 * B;
+    uint32_t K = B + 1;
+    uint32_t P = (uint32_t)(((uint64_t)u32TailMs * u32SampleRate / 1000 + B - 1) / B);
+    size_t   cb = 0;
+    void   **ppv = NULL;
+
+    if (P == 0)
+    {
+        P = 1;
+    }
+
+    if (pAec != NULL)
+    {
+        pAec->m_u32BlockSize = B;
+        pAec->m_u32FftSize = N;
+        pAec->m_u32BinCount = K;
+        pAec->m_u32PartitionCount = P;
+    }
+
+#define AEC_CARVE(member, count) \
+    ppv = (pAec != NULL) ? (void**)&pAec->member : NULL; \
+    cb = CApoFft::Carve(pBase, cb, sizeof(*pAec->member) * (size_t)(count), ppv);
+
+    AEC_CARVE(m_pf32MicBlock, B);
+    AEC_CARVE(m_pf32RefBlock, B);
+    AEC_CARVE(m_pf32OutBlock, B);
+    AEC_CARVE(m_pf32RefTime, N);
+    AEC_CARVE(m_pf32XRe, (size_t)P * K);
+    AEC_CARVE(m_pf32XIm, (size_t)P * K);
+    AEC_CARVE(m_pf32WRe, (size_t)P * K);
+    AEC_CARVE(m_pf32WIm, (size_t)P * K);
+    AEC_CARVE(m_pf32ForegroundWRe, (size_t)P * K);
+    AEC_CARVE(m_pf32ForegroundWIm, (size_t)P * K);
+    AEC_CARVE(m_pf32Pxx, K);
+    AEC_CARVE(m_pf32Time, N);
+    AEC_CARVE(m_pf32SRe, K);
+    AEC_CARVE(m_pf32SIm, K);
+    AEC_CARVE(m_pf32Echo, B);
+    AEC_CARVE(m_pf32Error, B);
+    AEC_CARVE(m_pf32BackgroundError, B);
+    AEC_CARVE(m_pf32Window, N);
+    AEC_CARVE(m_pf32ErrorHistory, N);
+    AEC_CARVE(m_pf32EchoHistory, N);
+    AEC_CARVE(m_pf32EchoPower, K);
+    AEC_CARVE(m_pf32Gain, K);
+    AEC_CARVE(m_pf32OverlapTail, B);
+
+#undef AEC_CARVE
+
+    // FFT tables go last
+    void *pvFft = NULL;
+    cb = CApoFft::Carve(pBase, cb, CApoFft::GetRequiredBytes(N), &pvFft);
+    if (pAec != NULL)
+    {
+        pAec->m_Fft.Initialize(N, pvFft);
+    }
+
+    return cb;
+}
+
+size_t CAecCanceller::GetRequiredBytes(uint32_t u32SampleRate, uint32_t u32TailMs)
+{
+    if (!IsSampleRateSupported(u32SampleRate))
+    {
+        return 0;
+    }
+    return Layout(u32SampleRate, u32TailMs, NULL, NULL);
+}
+
+bool CAecCanceller::Initialize(uint32_t u32SampleRate, uint32_t u32TailMs, void *pMemory)
+{
+    if (!IsSampleRateSupported(u32SampleRate) || pMemory == NULL)
+    {
+        return false;
+    }
+
+    Layout(u32SampleRate, u32TailMs, (uint8_t*)pMemory, this);
+
+    // periodic sqrt-Hann: w[n]^2 + w[n + B]^2 == 1, so analysis and
+    // synthesis with the same window reconstruct exactly at 50% overlap
+    const double dPi = 3.14159265358979323846;
+    for (uint32_t n = 0; n < m_u32FftSize; n++)
+    {
+        m_pf32Window[n] = (float)sqrt(0.5 - 0.5 * cos(2.0 * dPi * n / m_u32FftSize));
+    }
+
+    m_u32DoubleTalkHangoverBlocks = (AEC_DOUBLE_TALK_HANGOVER_MS * u32SampleRate / 1000 + m_u32BlockSize - 1) / m_u32BlockSize;
+
+    Reset();
+    return true;
+}
+
+void CAecCanceller::Reset()
+{
+    uint32_t B = m_u32BlockSize;
+    uint32_t N = m_u32FftSize;
+    uint32_t K = m_u32BinCount;
+    size_t   cPK = (size_t)m_u32PartitionCount * K;
+
+    memset(m_pf32MicBlock, 0, sizeof(float) * B);
+    memset(m_pf32RefBlock, 0, sizeof(float) * B);
+    memset(m_pf32OutBlock, 0, sizeof(float) * B);
+    memset(m_pf32RefTime, 0, sizeof(float) * N);
+    memset(m_pf32XRe, 0, sizeof(float) * cPK);
+    memset(m_pf32XIm, 0, sizeof(float) * cPK);
+    memset(m_pf32WRe, 0, sizeof(float) * cPK);
+    memset(m_pf32WIm, 0, sizeof(float) * cPK);
+    memset(m_pf32ForegroundWRe, 0, sizeof(float) * cPK);
+    memset(m_pf32ForegroundWIm, 0, sizeof(float) * cPK);
+    memset(m_pf32Pxx, 0, sizeof(float) * K);
+    memset(m_pf32ErrorHistory, 0, sizeof(float) * N);
+    memset(m_pf32EchoHistory, 0, sizeof(float) * N);
+    memset(m_pf32OverlapTail, 0, sizeof(float) * B);
+
+    for (uint32_t k = 0; k < K; k++)
+    {
+        m_pf32Gain[k] = 1.0f;
+    }
+
+    m_u32BlockPos = 0;
+    m_u32XHead = 0;
+    m_u32ConstrainIndex = 0;
+    m_f32Leak = 1.0f;
+    m_f32MicEnergy = 0.0f;
+    m_f32ErrorEnergy = 0.0f;
+    m_f32ErleLong = 1.0f;
+    m_f32BackgroundEnergy = 0.0f;
+    m_u32BackgroundWins = 0;
+    m_u32DoubleTalkHangover = 0;
+}
+
+void CAecCanceller::Process(
+    const float *pf32Mic,
+    uint32_t u32MicStride,
+    const float *pf32Reference,
+    float *pf32Output,
+    uint32_t u32FrameCount)
+{
+    while (u32FrameCount > 0)
+    {
+        uint32_t u32Frames = m_u32BlockSize - m_u32BlockPos;
+        if (u32Frames > u32FrameCount)
+        {
+            u32Frames = u32FrameCount;
+        }
+
+        for (uint32_t n = 0; n < u32Frames; n++)
+        {
+            m_pf32MicBlock[m_u32BlockPos + n] = (pf32Mic != NULL) ? pf32Mic[(size_t)n * u32MicStride] : 0.0f;
+        }
+
+        if (pf32Reference != NULL)
+        {
+            memcpy(&m_pf32RefBlock[m_u32BlockPos], pf32Reference, sizeof(float) * u32Frames);
+            pf32Reference += u32Frames;
+        }
+        else
+        {
+            memset(&m_pf32RefBlock[m_u32BlockPos], 0, sizeof(float) * u32Frames);
+        }
+
+        memcpy(pf32Output, &m_pf32OutBlock[m_u32BlockPos], sizeof(float) * u32Frames);
+
+        if (pf32Mic != NULL)
+        {
+            pf32Mic += (size_t)u32Frames * u32MicStride;
+        }
+        pf32Output += u32Frames;
+        u32FrameCount -= u32Frames;
+
+        m_u32BlockPos += u32Frames;
+        if (m_u32BlockPos == m_u32BlockSize)
+        {
+            ProcessBlock();
+            m_u32BlockPos = 0;
+        }
+    }
+}
+
+void CAecCanceller::ProcessBlock()
+{
+    uint32_t B = m_u32BlockSize;
+    uint32_t K = m_u32BinCount;
+    uint32_t P = m_u32PartitionCount;
+
+    //
+    // Reference spectrum of the last two blocks (overlap-save) becomes the
+    // newest partition input.
+    //
+    memmove(m_pf32RefTime, &m_pf32RefTime[B], sizeof(float) * B);
+    memcpy(&m_pf32RefTime[B], m_pf32RefBlock, sizeof(float) * B);
+
+    m_u32XHead = (m_u32XHead + P - 1) % P;
+    float *pf32X0Re = &m_pf32XRe[(size_t)m_u32XHead * K];
+    float *pf32X0Im = &m_pf32XIm[(size_t)m_u32XHead * K];
+    m_Fft.Forward(m_pf32RefTime, pf32X0Re, pf32X0Im);
+
+    float f32RefEnergy = 0.0f;
+    for (uint32_t n = 0; n < B; n++)
+    {
+        f32RefEnergy += m_pf32RefBlock[n] * m_pf32RefBlock[n];
+    }
+    bool fFarEndActive = f32RefEnergy > AEC_FAR_END_FLOOR * B;
+
+    // smoothed reference power per bin, scaled to the whole filter length
+    float f32Alpha = 1.0f / (float)P;
+    for (uint32_t k = 0; k < K; k++)
+    {
+        float f32Power = pf32X0Re[k] * pf32X0Re[k] + pf32X0Im[k] * pf32X0Im[k];
+        m_pf32Pxx[k] += f32Alpha * (f32Power - m_pf32Pxx[k]);
+    }
+
+    //
+    // Two echo estimates: the foreground filter's produces the output, the
+    // background filter's drives adaptation.
+    //
+    EstimateEcho(m_pf32ForegroundWRe, m_pf32ForegroundWIm, m_pf32Echo);
+    float f32MicEnergy = 0.0f;
+    float f32ErrorEnergy = 0.0f;
+    for (uint32_t n = 0; n < B; n++)
+    {
+        m_pf32Error[n] = m_pf32MicBlock[n] - m_pf32Echo[n];
+        f32MicEnergy += m_pf32MicBlock[n] * m_pf32MicBlock[n];
+        f32ErrorEnergy += m_pf32Error[n] * m_pf32Error[n];
+    }
+
+    EstimateEcho(m_pf32WRe, m_pf32WIm, m_pf32BackgroundError);
+    float f32BackgroundEnergy = 0.0f;
+    for (uint32_t n = 0; n < B; n++)
+    {
+        m_pf32BackgroundError[n] = m_pf32MicBlock[n] - m_pf32BackgroundError[n];
+        f32BackgroundEnergy += m_pf32BackgroundError[n] * m_pf32BackgroundError[n];
+    }
+
+    //
+    // Double-talk detection. Once the filter has converged the error to
+    // microphone energy ratio settles around 1/ERLE; near-end speech makes it
+    // jump well above that. The detector does not gate adaptation, which the
+    // two-path control protects, only the residual echo suppressor: it backs
+    // off while near-end speech is present, plus a short hangover. The long
+    // term ERLE decays during double talk so that an echo path change is not
+    // mistaken for near-end speech for long.
+    //
+    m_f32MicEnergy += 0.3f * (f32MicEnergy - m_f32MicEnergy);
+    m_f32ErrorEnergy += 0.3f * (f32ErrorEnergy - m_f32ErrorEnergy);
+    m_f32BackgroundEnergy += 0.3f * (f32BackgroundEnergy - m_f32BackgroundEnergy);
+
+    bool fDoubleTalk = false;
+    if (fFarEndActive && m_f32ErleLong > AEC_DOUBLE_TALK_MIN_ERLE)
+    {
+        fDoubleTalk = m_f32ErrorEnergy * m_f32ErleLong > AEC_DOUBLE_TALK_RATIO * m_f32MicEnergy;
+    }
+
+    if (fDoubleTalk)
+    {
+        m_u32DoubleTalkHangover = m_u32DoubleTalkHangoverBlocks;
+        m_f32ErleLong = (m_f32ErleLong * 0.998f > 1.0f) ? m_f32ErleLong * 0.998f : 1.0f;
+    }
+    else if (m_u32DoubleTalkHangover > 0)
+    {
+        m_u32DoubleTalkHangover--;
+    }
+    else if (fFarEndActive)
+    {
+        float f32Erle = m_f32MicEnergy / (m_f32ErrorEnergy + AEC_REGULARIZATION);
+        if (f32Erle > 1000.0f)
+        {
+            f32Erle = 1000.0f;
+        }
+        m_f32ErleLong += 0.01f * (f32Erle - m_f32ErleLong);
+        if (m_f32ErleLong < 1.0f)
+        {
+            m_f32ErleLong = 1.0f;
+        }
+    }
+
+    if (fFarEndActive)
+    {
+        UpdateForeground();
+        Adapt(m_pf32BackgroundError);
+    }
+
+    SuppressResidualEcho(fFarEndActive);
+}
+
+//
+// Echo estimate of one filter: the last B samples of the inverse transform
+// of sum over partitions of W[p] * X[p].
+//
+void CAecCanceller::EstimateEcho(const float *pf32WRe, const float *pf32WIm, float *pf32Echo)
+{
+    uint32_t B = m_u32BlockSize;
+    uint32_t K = m_u32BinCount;
+    uint32_t P = m_u32PartitionCount;
+
+    memset(m_pf32SRe, 0, sizeof(float) * K);
+    memset(m_pf32SIm, 0, sizeof(float) * K);
+    for (uint32_t p = 0; p < P; p++)
+    {
+        size_t       iX = (size_t)((m_u32XHead + p) % P) * K;
+        size_t       iW = (size_t)p * K;
+        const float *pf32XRe = &m_pf32XRe[iX];
+        const float *pf32XIm = &m_pf32XIm[iX];
+        const float *pf32PartRe = &pf32WRe[iW];
+        const float *pf32PartIm = &pf32WIm[iW];
+
+        for (uint32_t k = 0; k < K; k++)
+        {
+            m_pf32SRe[k] += pf32PartRe[k] * pf32XRe[k] - pf32PartIm[k] * pf32XIm[k];
+            m_pf32SIm[k] += pf32PartRe[k] * pf32XIm[k] + pf32PartIm[k] * pf32XRe[k];
+        }
+    }
+    m_Fft.Inverse(m_pf32SRe, m_pf32SIm, m_pf32Time);
+
+    // only the last B samples of the circular convolution are valid
+    memcpy(pf32Echo, &m_pf32Time[B], sizeof(float) * B);
+}
+
+//
+// Two-path control. The background filter keeps adapting, double talk or
+// not; its taps are copied to the foreground once it has cancelled clearly
+// better for a few blocks in a row. Near-end speech raises both errors
+// alike, so a background that diverges during double talk is never
+// copied, and it is reset from the foreground when it falls far behind.
+//
+void CAecCanceller::UpdateForeground()
+{
+    size_t cbFilter = sizeof(float) * (size_t)m_u32PartitionCount * m_u32BinCount;
+
+    if (m_f32BackgroundEnergy < AEC_BACKGROUND_WIN_RATIO * m_f32ErrorEnergy &&
+        m_f32BackgroundEnergy < m_f32MicEnergy)
+    {
+        if (++m_u32BackgroundWins >= AEC_BACKGROUND_WIN_BLOCKS)
+        {
+            memcpy(m_pf32ForegroundWRe, m_pf32WRe, cbFilter);
+            memcpy(m_pf32ForegroundWIm, m_pf32WIm, cbFilter);
+            m_f32ErrorEnergy = m_f32BackgroundEnergy;
+            m_u32BackgroundWins = 0;
+        }
+    }
+    else
+    {
+        m_u32BackgroundWins = 0;
+
+        if (m_f32BackgroundEnergy > AEC_BACKGROUND_RESET_RATIO * m_f32ErrorEnergy &&
+            m_f32BackgroundEnergy > m_f32MicEnergy)
+        {
+            memcpy(m_pf32WRe, m_pf32ForegroundWRe, cbFilter);
+            memcpy(m_pf32WIm, m_pf32ForegroundWIm, cbFilter);
+            m_f32BackgroundEnergy = m_f32ErrorEnergy;
+        }
+    }
+}
+
+//
+// Normalized frequency-domain LMS update of every partition, followed by the
+// gradient constraint on one partition per block (round robin). Constraining
+// a single partition keeps the cost at two extra transforms per block while
+// still preventing circular wrap-around from accumulating in any partition.
+//
+void CAecCanceller::Adapt(const float *pf32Error)
+{
+    uint32_t B = m_u32BlockSize;
+    uint32_t K = m_u32BinCount;
+    uint32_t P = m_u32PartitionCount;
+
+    // E = FFT([0 ... 0, e])
+    memset(m_pf32Time, 0, sizeof(float) * B);
+    memcpy(&m_pf32Time[B], pf32Error, sizeof(float) * B);
+    m_Fft.Forward(m_pf32Time, m_pf32SRe, m_pf32SIm);
+
+    // fold the per-bin step size into E
+    float f32Regularization = AEC_REGULARIZATION * (float)m_u32FftSize * (float)P;
+    for (uint32_t k = 0; k < K; k++)
+    {
+        float f32Mu = AEC_STEP_SIZE / ((float)P * m_pf32Pxx[k] + f32Regularization);
+        m_pf32SRe[k] *= f32Mu;
+        m_pf32SIm[k] *= f32Mu;
+    }
+
+    // W[p] += conj(X[p]) * mu * E
+    for (uint32_t p = 0; p < P; p++)
+    {
+        size_t       iX = (size_t)((m_u32XHead + p) % P) * K;
+        size_t       iW = (size_t)p * K;
+        const float *pf32XRe = &m_pf32XRe[iX];
+        const float *pf32XIm = &m_pf32XIm[iX];
+        float       *pf32WRe = &m_pf32WRe[iW];
+        float       *pf32WIm = &m_pf32WIm[iW];
+
+        for (uint32_t k = 0; k < K; k++)
+        {
+            pf32WRe[k] += pf32XRe[k] * m_pf32SRe[k] + pf32XIm[k] * m_pf32SIm[k];
+            pf32WIm[k] += pf32XRe[k] * m_pf32SIm[k] - pf32XIm[k] * m_pf32SRe[k];
+        }
+    }
+
+    // constrain one partition to B taps
+    size_t iC = (size_t)m_u32ConstrainIndex * K;
+    m_Fft.Inverse(&m_pf32WRe[iC], &m_pf32WIm[iC], m_pf32Time);
+    memset(&m_pf32Time[B], 0, sizeof(float) * B);
+    m_Fft.Forward(m_pf32Time, &m_pf32WRe[iC], &m_pf32WIm[iC]);
+
+    m_u32ConstrainIndex = (m_u32ConstrainIndex + 1) % P;
+}
+
+//
+// Spectral residual echo suppression on the linear filter output. The
+// residual echo power in each bin is modelled as a leakage factor times the
+// echo estimate power; the leakage is learned while only the far end talks.
+// Output is delayed by one block by the overlap-add.
+//
+void CAecCanceller::SuppressResidualEcho(bool fFarEndActive)
+{
+    uint32_t B = m_u32BlockSize;
+    uint32_t N = m_u32FftSize;
+    uint32_t K = m_u32BinCount;
+
+    memmove(m_pf32ErrorHistory, &m_pf32ErrorHistory[B], sizeof(float) * B);
+    memcpy(&m_pf32ErrorHistory[B], m_pf32Error, sizeof(float) * B);
+    memmove(m_pf32EchoHistory, &m_pf32EchoHistory[B], sizeof(float) * B);
+    memcpy(&m_pf32EchoHistory[B], m_pf32Echo, sizeof(float) * B);
+
+    // echo estimate power spectrum
+    for (uint32_t n = 0; n < N; n++)
+    {
+        m_pf32Time[n] = m_pf32EchoHistory[n] * m_pf32Window[n];
+    }
+    m_Fft.Forward(m_pf32Time, m_pf32SRe, m_pf32SIm);
+
+    float f32EchoTotal = 0.0f;
+    for (uint32_t k = 0; k < K; k++)
+    {
+        m_pf32EchoPower[k] = m_pf32SRe[k] * m_pf32SRe[k] + m_pf32SIm[k] * m_pf32SIm[k];
+        f32EchoTotal += m_pf32EchoPower[k];
+    }
+
+    // error spectrum
+    for (uint32_t n = 0; n < N; n++)
+    {
+        m_pf32Time[n] = m_pf32ErrorHistory[n] * m_pf32Window[n];
+    }
+    m_Fft.Forward(m_pf32Time, m_pf32SRe, m_pf32SIm);
+
+    float f32ErrorTotal = 0.0f;
+    for (uint32_t k = 0; k < K; k++)
+    {
+        f32ErrorTotal += m_pf32SRe[k] * m_pf32SRe[k] + m_pf32SIm[k] * m_pf32SIm[k];
+    }
+
+    bool fDoubleTalk = (m_u32DoubleTalkHangover != 0);
+
+    if (fFarEndActive && !fDoubleTalk && f32EchoTotal > 0.0f)
+    {
+        float f32Leak = f32ErrorTotal / f32EchoTotal;
+        if (f32Leak > 1.0f)
+        {
+            f32Leak = 1.0f;
+        }
+        m_f32Leak += 0.05f * (f32Leak - m_f32Leak);
+        if (m_f32Leak < 0.001f)
+        {
+            m_f32Leak = 0.001f;
+        }
+    }
+
+    // be gentler while the near end talks
+    float f32Factor = fFarEndActive ? m_f32Leak * (fDoubleTalk ? 1.0f : AEC_RES_OVERSUBTRACTION) : 0.0f;
+
+    for (uint32_t k = 0; k < K; k++)
+    {
+        float f32ErrorPower = m_pf32SRe[k] * m_pf32SRe[k] + m_pf32SIm[k] * m_pf32SIm[k];
+        float f32Gain = 1.0f - f32Factor * m_pf32EchoPower[k] / (f32ErrorPower + AEC_REGULARIZATION);
+
+        if (f32Gain < AEC_RES_GAIN_FLOOR)
+        {
+            f32Gain = AEC_RES_GAIN_FLOOR;
+        }
+
+        // fast attack, slower release
+        if (f32Gain < m_pf32Gain[k])
+        {
+            m_pf32Gain[k] = f32Gain;
+        }
+        else
+        {
+            m_pf32Gain[k] += 0.3f * (f32Gain - m_pf32Gain[k]);
+        }
+
+        m_pf32SRe[k] *= m_pf32Gain[k];
+        m_pf32SIm[k] *= m_pf32Gain[k];
+    }
+
+    m_Fft.Inverse(m_pf32SRe, m_pf32SIm, m_pf32Time);
+
+    for (uint32_t n = 0; n < B; n++)
+    {
+        m_pf32OutBlock[n] = m_pf32OverlapTail[n] + m_pf32Time[n] * m_pf32Window[n];
+        m_pf32OverlapTail[n] = m_pf32Time[B + n] * m_pf32Window[B + n];
+    }
+}
@@ -0,0 +1,144 @@
+//
+// AecCanceller.h -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Declaration of CAecCanceller, the echo cancellation engine used by
+//   CAecApoMFX.
+//
+//   The engine is a partitioned-block frequency-domain adaptive filter
+//   (overlap-save, block size B, FFT size 2B, P partitions covering the
+//   echo tail) in a two-path arrangement: a background filter adapts
+//   continuously and a foreground filter, which produces the output, takes
+//   its taps when it cancels better. A double-talk detector and a spectral
+//   residual echo suppressor (sqrt-Hann weighted overlap-add, hop B) follow.
+//
+//   It only depends on the C runtime. All state lives in a single block of
+//   memory provided by the caller to Initialize, so Process never
+//   allocates and can run on the realtime thread.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ApoFft.h>
+
+// Default echo tail covered by the adaptive filter. The APO aligns the
+// reference to the microphone by timestamp (CAecReferenceBuffer), so the
+// filter only spans the acoustic path, not the render/capture buffering.
+#define AEC_DEFAULT_TAIL_MS         64
+
+class CAecCanceller
+{
+public:
+    CAecCanceller();
+
+    //
+    // Returns TRUE if the engine can run at u32SampleRate.
+    //
+    static bool IsSampleRateSupported(uint32_t u32SampleRate);
+
+    //
+    // Bytes of memory Initialize needs, or 0 if the rate is not supported.
+    //
+    static size_t GetRequiredBytes(uint32_t u32SampleRate, uint32_t u32TailMs);
+
+    //
+    // Non-realtime. pMemory must hold GetRequiredBytes() bytes aligned to
+    // APOFFT_ALIGNMENT and outlive the object.
+    //
+    bool Initialize(uint32_t u32SampleRate, uint32_t u32TailMs, void *pMemory);
+
+    //
+    // Clears the filter and all signal history.
+    //
+    void Reset();
+
+    //
+    // Frames of delay between Process input and output.
+    //
+    uint32_t GetLatencyFrames() const { return 2 * m_u32BlockSize; }
+
+    //
+    // Cancels echo of the reference from the microphone signal.
+    //
+    //  pf32Mic       - u32FrameCount frames of u32MicStride channels; the
+    //                  first channel is processed. NULL for silence.
+    //  pf32Reference - u32FrameCount mono reference frames. NULL for
+    //                  silence.
+    //  pf32Output    - u32FrameCount mono output frames.
+    //
+    void Process(
+        const float *pf32Mic,
+        uint32_t u32MicStride,
+        const float *pf32Reference,
+        float *pf32Output,
+        uint32_t u32FrameCount);
+
+    bool IsDoubleTalk() const { return m_u32DoubleTalkHangover != 0; }
+    float GetLongTermErle() const { return m_f32ErleLong; }
+
+private:
+    static uint32_t GetBlockSize(uint32_t u32SampleRate);
+    static size_t Layout(uint32_t u32SampleRate, uint32_t u32TailMs, uint8_t *pBase, CAecCanceller *pAec);
+
+    void ProcessBlock();
+    void EstimateEcho(const float *pf32WRe, const float *pf32WIm, float *pf32Echo);
+    void UpdateForeground();
+    void Adapt(const float *pf32Error);
+    void SuppressResidualEcho(bool fFarEndActive);
+
+private:
+    CApoFft     m_Fft;
+
+    uint32_t    m_u32BlockSize;         // B
+    uint32_t    m_u32FftSize;           // N = 2B
+    uint32_t    m_u32BinCount;          // K = B + 1
+    uint32_t    m_u32PartitionCount;    // P
+
+    // block assembly
+    uint32_t    m_u32BlockPos;
+    float      *m_pf32MicBlock;         // [B]
+    float      *m_pf32RefBlock;         // [B]
+    float      *m_pf32OutBlock;         // [B]
+
+    // adaptive filter
+    float      *m_pf32RefTime;          // [N] previous and current reference block
+    float      *m_pf32XRe;              // [P * K] reference spectra, newest at m_u32XHead
+    float      *m_pf32XIm;
+    uint32_t    m_u32XHead;
+    float      *m_pf32WRe;              // [P * K] background filter partitions, always adapting
+    float      *m_pf32WIm;
+    float      *m_pf32ForegroundWRe;    // [P * K] foreground filter partitions, produce the output
+    float      *m_pf32ForegroundWIm;
+    float      *m_pf32Pxx;              // [K] smoothed reference power per bin
+    uint32_t    m_u32ConstrainIndex;    // partition whose gradient constraint is applied next
+
+    // per block signals
+    float      *m_pf32Time;             // [N] scratch
+    float      *m_pf32SRe;              // [K] scratch spectrum
+    float      *m_pf32SIm;
+    float      *m_pf32Echo;             // [B] echo estimate
+    float      *m_pf32Error;            // [B] linear filter output
+    float      *m_pf32BackgroundError;  // [B] background filter error
+
+    // residual echo suppressor
+    float      *m_pf32Window;           // [N] sqrt-Hann
+    float      *m_pf32ErrorHistory;     // [N] previous and current error block
+    float      *m_pf32EchoHistory;      // [N] previous and current echo estimate block
+    float      *m_pf32EchoPower;        // [K]
+    float      *m_pf32Gain;             // [K] smoothed suppression gain
+    float      *m_pf32OverlapTail;      // [B]
+    float       m_f32Leak;              // residual echo / echo estimate power ratio
+
+    // double-talk detection
+    float       m_f32MicEnergy;
+    float       m_f32ErrorEnergy;
+    float       m_f32ErleLong;
+    float       m_f32BackgroundEnergy;
+    uint32_t    m_u32BackgroundWins;
+    uint32_t    m_u32DoubleTalkHangover;
+    uint32_t    m_u32DoubleTalkHangoverBlocks;
+};
@@ -0,0 +1,259 @@
+//
+// AecReferenceBuffer.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//  Implementation of CAecReferenceBuffer and CAecClockTracker
+//
+
+#include <ApoFft.h>
+#include "AecReferenceBuffer.h"
+
+// Clock tracker loop gains, per timestamp. With 10 ms buffers the loop
+// settles in about 3 s and keeps the alignment error of 200 us timestamp
+// jitter under 2 samples at 48 kHz.
+#define AEC_CLOCK_PHASE_GAIN        0.01
+#define AEC_CLOCK_RATE_GAIN         0.0001
+
+// Largest error followed by the loop; 20 ms
+#define AEC_CLOCK_RESYNC_HNS        200000
+
+// Largest drift accepted, in parts per million
+#define AEC_CLOCK_MAX_DRIFT_PPM     1000
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Adds the observation that the stream was at u64Position at QPC time
+//  u64Time. Timestamps that do not move forward are ignored.
+//
+void CAecClockTracker::Update(uint64_t u64Position, uint64_t u64Time)
+{
+    if (m_fValid)
+    {
+        int64_t i64Elapsed = (int64_t)(u64Time - m_u64Time);
+        if (i64Elapsed <= 0)
+        {
+            return;
+        }
+
+        double dPredicted = GetPosition(u64Time);
+        double dError = (double)u64Position - dPredicted;
+
+        if (fabs(dError) <= m_dNominal * AEC_CLOCK_RESYNC_HNS)
+        {
+            double dMaxDeviation = m_dNominal * AEC_CLOCK_MAX_DRIFT_PPM * 1e-6;
+
+            m_dPosition = dPredicted + AEC_CLOCK_PHASE_GAIN * dError;
+            m_u64Time = u64Time;
+            m_dRate += AEC_CLOCK_RATE_GAIN * dError / (double)i64Elapsed;
+
+            if (m_dRate > m_dNominal + dMaxDeviation)
+            {
+                m_dRate = m_dNominal + dMaxDeviation;
+            }
+            else if (m_dRate < m_dNominal - dMaxDeviation)
+            {
+                m_dRate = m_dNominal - dMaxDeviation;
+            }
+            return;
+        }
+    }
+
+    m_fValid = true;
+    m_u64Time = u64Time;
+    m_dPosition = (double)u64Position;
+    m_dRate = m_dNominal;
+}
+
+CAecReferenceBuffer::CAecReferenceBuffer()
+:   m_pf32Ring(NULL)
+,   m_pTimestamps(NULL)
+,   m_u32Capacity(0)
+,   m_u64FramesWritten(0)
+,   m_u64BuffersWritten(0)
+,   m_u64BuffersConsumed(0)
+,   m_u64FramesRead(0)
+{
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Ring size for at least u32MinFrames usable frames. A quarter of the
+//  ring is never read, so the producer can write into it while the
+//  consumer is interpolating.
+//
+uint32_t CAecReferenceBuffer::GetCapacity(uint32_t u32MinFrames)
+{
+    uint32_t u32Capacity = 1;
+    while (u32Capacity - u32Capacity / 4 < u32MinFrames)
+    {
+        u32Capacity <<= 1;
+    }
+    return u32Capacity;
+}
+
+size_t CAecReferenceBuffer::GetRequiredBytes(uint32_t u32MinFrames)
+{
+    size_t cb = 0;
+
+    cb = CApoFft::Carve(NULL, cb, sizeof(float) * GetCapacity(u32MinFrames), NULL);
+    cb = CApoFft::Carve(NULL, cb, sizeof(TIMESTAMP) * AEC_REFERENCE_TIMESTAMPS, NULL);
+
+    return cb;
+}
+
+bool CAecReferenceBuffer::Initialize(uint32_t u32SampleRate, uint32_t u32MinFrames, void *pMemory)
+{
+    if (u32SampleRate == 0 || u32MinFrames == 0 || pMemory == NULL)
+    {
+        return false;
+    }
+
+    size_t cb = 0;
+
+    m_u32Capacity = GetCapacity(u32MinFrames);
+    cb = CApoFft::Carve((uint8_t*)pMemory, cb, sizeof(float) * m_u32Capacity, (void**)&m_pf32Ring);
+    cb = CApoFft::Carve((uint8_t*)pMemory, cb, sizeof(TIMESTAMP) * AEC_REFERENCE_TIMESTAMPS, (void**)&m_pTimestamps);
+
+    m_u64FramesWritten.store(0, std::memory_order_relaxed);
+    m_u64BuffersWritten.store(0, std::memory_order_relaxed);
+    m_u64BuffersConsumed = 0;
+    m_u64FramesRead = 0;
+    m_ReferenceClock.Reset(u32SampleRate);
+    m_CaptureClock.Reset(u32SampleRate);
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Producer. Stores the frames first and publishes them, together with
+//  their timestamp, with release stores.
+//
+void CAecReferenceBuffer::Write(const float *pf32Frames, uint32_t u32Channels, uint32_t u32FrameCount, uint64_t u64QpcTime)
+{
+    uint64_t u64Written = m_u64FramesWritten.load(std::memory_order_relaxed);
+    uint64_t u64Buffers = m_u64BuffersWritten.load(std::memory_order_relaxed);
+    uint32_t u32Mask = m_u32Capacity - 1;
+    float    f32Scale = 1.0f / u32Channels;
+
+    for (uint32_t n = 0; n < u32FrameCount; n++)
+    {
+        float f32Sample = 0.0f;
+        if (pf32Frames != NULL)
+        {
+            for (uint32_t c = 0; c < u32Channels; c++)
+            {
+                f32Sample += pf32Frames[c];
+            }
+            f32Sample *= f32Scale;
+            pf32Frames += u32Channels;
+        }
+        m_pf32Ring[(uint32_t)(u64Written + n) & u32Mask] = f32Sample;
+    }
+
+    TIMESTAMP *pTimestamp = &m_pTimestamps[u64Buffers % AEC_REFERENCE_TIMESTAMPS];
+    pTimestamp->u64Position = u64Written;
+    pTimestamp->u64QpcTime = u64QpcTime;
+
+    m_u64FramesWritten.store(u64Written + u32FrameCount, std::memory_order_release);
+    m_u64BuffersWritten.store(u64Buffers + 1, std::memory_order_release);
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Ring sample at an absolute position, or silence when the position is
+//  outside [u64Oldest, u64Written).
+//
+float CAecReferenceBuffer::GetSample(int64_t i64Position, uint64_t u64Oldest, uint64_t u64Written) const
+{
+    if (i64Position < 0 || (uint64_t)i64Position < u64Oldest || (uint64_t)i64Position >= u64Written)
+    {
+        return 0.0f;
+    }
+    return m_pf32Ring[(uint32_t)i64Position & (m_u32Capacity - 1)];
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Consumer. Updates both clocks, maps the microphone period onto the
+//  reference timeline and resamples it with a 4 point (cubic Lagrange)
+//  fractional-delay interpolator.
+//
+void CAecReferenceBuffer::Read(float *pf32Frames, uint32_t u32FrameCount, uint64_t u64QpcTime)
+{
+    uint64_t u64Buffers = m_u64BuffersWritten.load(std::memory_order_acquire);
+    uint64_t u64Written = m_u64FramesWritten.load(std::memory_order_acquire);
+
+    // Only the newest half of the timestamps is read, the producer may be
+    // writing into the older half.
+    uint64_t u64First = m_u64BuffersConsumed;
+    if (u64Buffers - u64First > AEC_REFERENCE_TIMESTAMPS / 2)
+    {
+        u64First = u64Buffers - AEC_REFERENCE_TIMESTAMPS / 2;
+    }
+    for (uint64_t b = u64First; b < u64Buffers; b++)
+    {
+        const TIMESTAMP *pTimestamp = &m_pTimestamps[b % AEC_REFERENCE_TIMESTAMPS];
+        m_ReferenceClock.Update(pTimestamp->u64Position, pTimestamp->u64QpcTime);
+    }
+    m_u64BuffersConsumed = u64Buffers;
+
+    // The microphone timestamp is as jittery as the loopback ones; the
+    // period is placed using the smoothed capture clock instead.
+    m_CaptureClock.Update(m_u64FramesRead, u64QpcTime);
+    uint64_t u64CaptureTime = m_CaptureClock.GetTime((double)m_u64FramesRead);
+    m_u64FramesRead += u32FrameCount;
+
+    if (!m_ReferenceClock.IsValid())
+    {
+        for (uint32_t n = 0; n < u32FrameCount; n++)
+        {
+            pf32Frames[n] = 0.0f;
+        }
+        return;
+    }
+
+    uint64_t u64Oldest = (u64Written > m_u32Capacity - m_u32Capacity / 4) ? u64Written - (m_u32Capacity - m_u32Capacity / 4) : 0;
+    double   dStart = m_ReferenceClock.GetPosition(u64CaptureTime);
+    double   dStep = m_ReferenceClock.GetRate() / m_CaptureClock.GetRate();
+
+    for (uint32_t n = 0; n < u32FrameCount; n++)
+    {
+        double  dPosition = dStart + n * dStep;
+        double  dIndex = floor(dPosition);
+        float   f = (float)(dPosition - dIndex);
+        int64_t i = (int64_t)dIndex;
+
+        float s0 = GetSample(i - 1, u64Oldest, u64Written);
+        float s1 = GetSample(i, u64Oldest, u64Written);
+        float s2 = GetSample(i + 1, u64Oldest, u64Written);
+        float s3 = GetSample(i + 2, u64Oldest, u64Written);
+
+        float fm1 = f - 1.0f;
+        float fm2 = f - 2.0f;
+        float fp1 = f + 1.0f;
+
+        pf32Frames[n] =
+            s0 * (-f * fm1 * fm2 * (1.0f / 6.0f)) +
+            s1 * (fp1 * fm1 * fm2 * 0.5f) +
+            s2 * (-fp1 * f * fm2 * 0.5f) +
+            s3 * (fp1 * f * fm1 * (1.0f / 6.0f));
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Drift of the render clock relative to the capture clock, in parts per
+//  million. Consumer side only.
+//
+double CAecReferenceBuffer::GetDriftPpm() const
+{
+    return (m_ReferenceClock.GetRate() / m_CaptureClock.GetRate() - 1.0) * 1e6;
+}
@@ -0,0 +1,145 @@
+//
+// AecReferenceBuffer.h -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Declaration of CAecReferenceBuffer, the timestamped loopback history
+//   used by CAecApoMFX to align the echo reference with the microphone.
+//
+//   The loopback input (AcceptInput) writes mono frames together with the
+//   QPC time of each buffer. For every microphone period, APOProcess asks
+//   for the reference frames that were rendered at the same QPC times. The
+//   mapping from QPC time to ring position is tracked with a second order
+//   loop per stream, which also estimates the clock drift between the
+//   render and capture devices; the window is then resampled with a cubic
+//   fractional-delay interpolator so that the echo appears at a fixed,
+//   short lag in the adaptive filter.
+//
+//   Single producer, single consumer, no locks: the producer publishes the
+//   frame and buffer counts with release stores and the consumer reads them
+//   with acquire loads. The producer never waits; the oldest frames are
+//   overwritten and the consumer treats overwritten frames as silence.
+//
+//   Only depends on the C runtime. All storage is provided by the caller.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+
+// Loopback history kept in addition to two periods, to absorb the skew
+// between loopback delivery and microphone capture.
+#define AEC_REFERENCE_HISTORY_MS    250
+
+// Timestamps remembered; only the ones newer than the last Read are used.
+#define AEC_REFERENCE_TIMESTAMPS    64
+
+//
+// Tracks the linear relationship between QPC time (100 ns units) and a
+// stream's sample position. The phase follows each timestamp with a small
+// gain and the rate integrates the remaining error, so timestamp jitter is
+// filtered while a constant drift is followed without bias. An error larger
+// than AEC_CLOCK_RESYNC_HNS (a glitch or a stream restart) starts over.
+//
+class CAecClockTracker
+{
+public:
+    CAecClockTracker() : m_fValid(false), m_u64Time(0), m_dPosition(0), m_dNominal(0), m_dRate(0) {}
+
+    void Reset(uint32_t u32SampleRate)
+    {
+        m_fValid = false;
+        m_dNominal = u32SampleRate / 1e7;
+        m_dRate = m_dNominal;
+    }
+
+    // Position u64Position was observed at QPC time u64Time.
+    void Update(uint64_t u64Position, uint64_t u64Time);
+
+    bool IsValid() const { return m_fValid; }
+
+    // Estimated (fractional) position at QPC time u64Time.
+    double GetPosition(uint64_t u64Time) const
+    {
+        return m_dPosition + (double)(int64_t)(u64Time - m_u64Time) * m_dRate;
+    }
+
+    // Estimated QPC time at which the stream reaches dPosition.
+    uint64_t GetTime(double dPosition) const
+    {
+        return m_u64Time + (uint64_t)(int64_t)floor((dPosition - m_dPosition) / m_dRate + 0.5);
+    }
+
+    // Samples per 100 ns.
+    double GetRate() const { return m_dRate; }
+
+    // Deviation from the nominal rate, in parts per million.
+    double GetDriftPpm() const { return (m_dRate / m_dNominal - 1.0) * 1e6; }
+
+private:
+    bool        m_fValid;
+    uint64_t    m_u64Time;
+    double      m_dPosition;
+    double      m_dNominal;
+    double      m_dRate;
+};
+
+class CAecReferenceBuffer
+{
+public:
+    CAecReferenceBuffer();
+
+    //
+    // Bytes of memory Initialize needs to hold at least u32MinFrames.
+    //
+    static size_t GetRequiredBytes(uint32_t u32MinFrames);
+
+    //
+    // Non-realtime. pMemory must hold GetRequiredBytes(u32MinFrames) bytes,
+    // aligned to 16 bytes, and outlive the object.
+    //
+    bool Initialize(uint32_t u32SampleRate, uint32_t u32MinFrames, void *pMemory);
+
+    //
+    // Producer side. Downmixes u32FrameCount frames of u32Channels to mono
+    // and stores them with u64QpcTime, the time of the first frame. NULL
+    // stores silence.
+    //
+    void Write(const float *pf32Frames, uint32_t u32Channels, uint32_t u32FrameCount, uint64_t u64QpcTime);
+
+    //
+    // Consumer side. Produces the u32FrameCount reference frames matching
+    // u32FrameCount microphone frames starting at u64QpcTime. Frames that
+    // have not been written yet or were already overwritten are silence.
+    //
+    void Read(float *pf32Frames, uint32_t u32FrameCount, uint64_t u64QpcTime);
+
+    double GetDriftPpm() const;
+
+private:
+    static uint32_t GetCapacity(uint32_t u32MinFrames);
+    float GetSample(int64_t i64Position, uint64_t u64Oldest, uint64_t u64Written) const;
+
+    struct TIMESTAMP
+    {
+        uint64_t    u64Position;
+        uint64_t    u64QpcTime;
+    };
+
+private:
+    // producer owned
+    float                  *m_pf32Ring;             // [capacity]
+    TIMESTAMP              *m_pTimestamps;          // [AEC_REFERENCE_TIMESTAMPS]
+    uint32_t                m_u32Capacity;          // power of two
+    std::atomic<uint64_t>   m_u64FramesWritten;
+    std::atomic<uint64_t>   m_u64BuffersWritten;
+
+    // consumer owned
+    uint64_t                m_u64BuffersConsumed;
+    CAecClockTracker        m_ReferenceClock;
+    CAecClockTracker        m_CaptureClock;
+    uint64_t                m_u64FramesRead;
+};
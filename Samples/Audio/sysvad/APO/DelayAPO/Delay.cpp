@@ -5,6 +5,9 @@
 //
 //  Implementation of ProcessDelay
 //
+//  The delay line itself lives in ApoDsp.h so it can be built and
+//  exercised outside of the audio engine.
+//
 #include <atlbase.h>
 #include <atlcom.h>
 #include <atlcoll.h>
@@ -17,6 +20,8 @@
 
 #include <float.h>
 
+#include <ApoDsp.h>
+
 #include "DelayAPO.h"
 
 #pragma AVRT_CODE_BEGIN
@@ -44,10 +49,29 @@ void CopyFrames(
 #pragma AVRT_CODE_END
 
 #pragma AVRT_CODE_BEGIN
-void ProcessDelay(
+//
+// ProcessDelay
+//
+//  Delays the input by u32DelayFrames frames using the circular delay line
+//  pf32DelayBuffer.
+//
+//  pf32InputFrames may be NULL to indicate a silent input (BUFFER_SILENT);
+//  the connection buffer is then never read and the delay line is refilled
+//  with zeros instead of copied input.
+//
+//  pf32InputFrames may equal pf32OutputFrames, in which case the connection
+//  buffer and the delay line are swapped in place.
+//
+//  *pu32SilentFrames counts how many of the most recently written frames in
+//  the delay line are known to be silent (at most u32DelayFrames). When the
+//  whole delay line is silent and the input is silent, nothing is touched
+//  and the routine returns TRUE to tell the caller the output is silent and
+//  pf32OutputFrames was not written. Otherwise it returns FALSE.
+//
+BOOL ProcessDelay(
     _Out_writes_(u32ValidFrameCount * u32SamplesPerFrame)
         FLOAT32 *pf32OutputFrames,
-    _In_reads_(u32ValidFrameCount * u32SamplesPerFrame)
+    _In_reads_opt_(u32ValidFrameCount * u32SamplesPerFrame)
         const FLOAT32 *pf32InputFrames,
     UINT32       u32ValidFrameCount,
     UINT32       u32SamplesPerFrame,
@@ -55,58 +79,20 @@ void ProcessDelay(
         FLOAT32 *pf32DelayBuffer,
     UINT32       u32DelayFrames,
     _Inout_
-        UINT32  *pu32DelayIndex )
+        UINT32  *pu32DelayIndex,
+    _Inout_
+        UINT32  *pu32SilentFrames )
 {
     ASSERT_REALTIME();
-    ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32InputFrames) );
-    ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32OutputFrames) );
-    
-    if (u32DelayFrames == 0)
-    {
-        CopyFrames( pf32OutputFrames,
-                    pf32InputFrames,
-                    u32ValidFrameCount,
-                    u32SamplesPerFrame );
-    }
-    else
-    {
+    ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
 
-        // Invariants:
-        // 0 <= (*pu32DelayIndex) < u32DelayFrames
-        // pf32OutputFrames[0 ... u32ValidFrameCount * u32SamplesPerFrame - 1] is writable
-        // pf32InputFrames[0 ... u32ValidFrameCount * u32SamplesPerFrame - 1] is readable
-        while (u32ValidFrameCount > 0)
-        {
-            // copy either the rest of the input/output buffer,
-            // or the rest of the delay buffer,
-            // whichever is smaller
-            UINT32 framesToCopy = min(u32ValidFrameCount, u32DelayFrames - (*pu32DelayIndex));
-            
-            // delay => output
-#pragma prefast(suppress: __WARNING_POTENTIAL_BUFFER_OVERFLOW_HIGH_PRIORITY, "this copy to pf32OutputFrames is in-range")
-            CopyFrames( pf32OutputFrames,
-                        &pf32DelayBuffer[(*pu32DelayIndex) * u32SamplesPerFrame],
-                        framesToCopy,
-                        u32SamplesPerFrame );
-            
-            // input => delay
-            CopyFrames( &pf32DelayBuffer[(*pu32DelayIndex) * u32SamplesPerFrame],
-                        pf32InputFrames,
-                        framesToCopy,
-                        u32SamplesPerFrame );
-
-            pf32OutputFrames += framesToCopy * u32SamplesPerFrame;
-            pf32InputFrames += framesToCopy * u32SamplesPerFrame;
-            u32ValidFrameCount -= framesToCopy;
-            
-            *pu32DelayIndex += framesToCopy;
-            if (*pu32DelayIndex == u32DelayFrames)
-            {
-                *pu32DelayIndex = 0;
-            }
-        }
-
-    }
+    return ApoDsp_Delay( pf32OutputFrames,
+                         pf32InputFrames,
+                         u32ValidFrameCount,
+                         u32SamplesPerFrame,
+                         pf32DelayBuffer,
+                         u32DelayFrames,
+                         pu32DelayIndex,
+                         pu32SilentFrames ) ? TRUE : FALSE;
 }
 #pragma AVRT_CODE_END
-
@@ -59,6 +59,7 @@ public:
     ,   m_fEnableDelayMFX(FALSE)
     ,   m_nDelayFrames(0)
     ,   m_iDelayIndex(0)
+    ,   m_nSilentFrames(0)
     {
         m_pf32Coefficients = NULL;
     }
@@ -154,6 +155,7 @@ public:
     CComHeapPtr<FLOAT32>                    m_pf32DelayBuffer;
     UINT32                                  m_nDelayFrames;
     UINT32                                  m_iDelayIndex;
+    UINT32                                  m_nSilentFrames;    // trailing silent frames in the delay buffer
 
 private:
     CCriticalSection                        m_EffectsLock;
@@ -184,6 +186,7 @@ public:
     ,   m_fEnableDelaySFX(FALSE)
     ,   m_nDelayFrames(0)
     ,   m_iDelayIndex(0)
+    ,   m_nSilentFrames(0)
     {
     }
 
@@ -258,6 +261,7 @@ public:
     CComHeapPtr<FLOAT32>                    m_pf32DelayBuffer;
     UINT32                                  m_nDelayFrames;
     UINT32                                  m_iDelayIndex;
+    UINT32                                  m_nSilentFrames;    // trailing silent frames in the delay buffer
 };
 #pragma AVRT_VTABLES_END
 
@@ -267,10 +271,10 @@ OBJECT_ENTRY_AUTO(__uuidof(DelayAPOSFX), CDelayAPOSFX)
 //
 //   Declaration of the ProcessDelay routine.
 //
-void ProcessDelay(
+BOOL ProcessDelay(
     _Out_writes_(u32ValidFrameCount * u32SamplesPerFrame)
         FLOAT32 *pf32OutputFrames,
-    _In_reads_(u32ValidFrameCount * u32SamplesPerFrame)
+    _In_reads_opt_(u32ValidFrameCount * u32SamplesPerFrame)
         const FLOAT32 *pf32InputFrames,
     UINT32       u32ValidFrameCount,
     UINT32       u32SamplesPerFrame,
@@ -278,7 +282,9 @@ void ProcessDelay(
         FLOAT32 *pf32DelayBuffer,
     UINT32       u32DelayFrames,
     _Inout_
-        UINT32  *pu32DelayIndex );
+        UINT32  *pu32DelayIndex,
+    _Inout_
+        UINT32  *pu32SilentFrames );
 
 //
 //   Convenience methods
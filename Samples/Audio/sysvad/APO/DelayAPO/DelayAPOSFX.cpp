@@ -111,34 +111,41 @@ STDMETHODIMP_(void) CDelayAPOSFX::APOProcess(
             pf32OutputFrames = reinterpret_cast<FLOAT32*>(ppOutputConnections[0]->pBuffer);
             ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
 
-            if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
-            {
-                WriteSilence( pf32InputFrames,
-                              ppInputConnections[0]->u32ValidFrameCount,
-                              GetSamplesPerFrame() );
-            }
-
             // copy to the delay buffer
             if (
                 !IsEqualGUID(m_AudioProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) &&
                 m_fEnableDelaySFX
             )
             {
-                ProcessDelay(pf32OutputFrames, pf32InputFrames,
+                // a silent input buffer is never read or zeroed; the delay line
+                // tracks silence itself and only reports silence once it has drained
+                BOOL fOutputSilent = ProcessDelay(pf32OutputFrames,
+                             (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags) ? NULL : pf32InputFrames,
                              ppInputConnections[0]->u32ValidFrameCount,
                              GetSamplesPerFrame(),
                              m_pf32DelayBuffer,
                              m_nDelayFrames,
-                             &m_iDelayIndex);
+                             &m_iDelayIndex,
+                             &m_nSilentFrames);
 
-                // we don't try to remember silence
-                ppOutputConnections[0]->u32BufferFlags = BUFFER_VALID;
+                ppOutputConnections[0]->u32BufferFlags = fOutputSilent ? BUFFER_SILENT : BUFFER_VALID;
             }
             else
             {
+                // a silent input buffer holds stale data: write the silence out,
+                // in place too, rather than copying it
+                if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
+                {
+                    if (0 != u32NumOutputConnections)
+                    {
+                        WriteSilence( pf32OutputFrames,
+                                      ppInputConnections[0]->u32ValidFrameCount,
+                                      GetSamplesPerFrame() );
+                    }
+                }
                 // copy the memory only if there is an output connection, and input/output pointers are unequal
-                if ( (0 != u32NumOutputConnections) &&
-                      (ppOutputConnections[0]->pBuffer != ppInputConnections[0]->pBuffer) )
+                else if ( (0 != u32NumOutputConnections) &&
+                          (ppOutputConnections[0]->pBuffer != ppInputConnections[0]->pBuffer) )
                 {
                     CopyFrames( pf32OutputFrames, pf32InputFrames,
                                 ppInputConnections[0]->u32ValidFrameCount,
@@ -231,6 +238,7 @@ STDMETHODIMP CDelayAPOSFX::LockForProcess(UINT32 u32NumInputConnections,
     {
         m_nDelayFrames = FRAMES_FROM_HNS(HNS_DELAY);
         m_iDelayIndex = 0;
+        m_nSilentFrames = m_nDelayFrames;
 
         m_pf32DelayBuffer.Free();
         
@@ -0,0 +1,578 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    ApoDsp.h
+//
+// Abstract:    Portable signal processing kernels shared by the sample APOs.
+//
+//              The APO classes only deal with connection buffers, formats
+//              and flags; the sample-level work is done here. This header
+//              depends on nothing but the C runtime so that the kernels can
+//              be compiled and exercised outside of audiodg, on any host.
+//
+//              All kernels are realtime safe: they do not allocate, block or
+//              touch anything other than the buffers passed in.
+//
+//              Hot kernels have SSE2 (x64) and NEON (ARM64) paths; every
+//              other target uses the portable C loop, which is also the
+//              reference the vector paths must match bit for bit. Define
+//              APODSP_NO_SIMD to build the portable loops on any target.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(APODSP_NO_SIMD)
+// portable loops only
+#elif defined(_M_X64) || defined(__x86_64__)
+#define APODSP_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define APODSP_NEON
+#include <arm_neon.h>
+#endif
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Fills u32FrameCount frames with silence.
+//
+inline void ApoDsp_WriteSilence(
+    float *pf32Frames,
+    uint32_t u32FrameCount,
+    uint32_t u32SamplesPerFrame )
+{
+    memset(pf32Frames, 0, sizeof(float) * (size_t)u32FrameCount * u32SamplesPerFrame);
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Copies u32FrameCount frames. The buffers must not overlap.
+//
+inline void ApoDsp_CopyFrames(
+    float *pf32OutFrames,
+    const float *pf32InFrames,
+    uint32_t u32FrameCount,
+    uint32_t u32SamplesPerFrame )
+{
+    memcpy(pf32OutFrames, pf32InFrames, sizeof(float) * (size_t)u32FrameCount * u32SamplesPerFrame);
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Exchanges u32FrameCount frames between a connection buffer and a delay
+//  line in a single pass, so the buffer is read and written exactly once.
+//
+inline void ApoDsp_SwapFrames(
+    float *pf32Frames,
+    float *pf32DelayFrames,
+    uint32_t u32FrameCount,
+    uint32_t u32SamplesPerFrame )
+{
+    size_t  cSamples = (size_t)u32FrameCount * u32SamplesPerFrame;
+    size_t  i = 0;
+    float   f32Swap;
+
+#if defined(APODSP_SSE2)
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(&pf32DelayFrames[i]);
+        _mm_storeu_ps(&pf32DelayFrames[i], _mm_loadu_ps(&pf32Frames[i]));
+        _mm_storeu_ps(&pf32Frames[i], v);
+    }
+#elif defined(APODSP_NEON)
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        float32x4_t v = vld1q_f32(&pf32DelayFrames[i]);
+        vst1q_f32(&pf32DelayFrames[i], vld1q_f32(&pf32Frames[i]));
+        vst1q_f32(&pf32Frames[i], v);
+    }
+#endif
+
+    for (; i < cSamples; i++)
+    {
+        f32Swap = pf32DelayFrames[i];
+        pf32DelayFrames[i] = pf32Frames[i];
+        pf32Frames[i] = f32Swap;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Emits u32FrameCount frames of a delay line to the output and replaces
+//  them with the input, in a single pass.
+//
+inline void ApoDsp_ExchangeFrames(
+    float *pf32OutFrames,
+    const float *pf32InFrames,
+    float *pf32DelayFrames,
+    uint32_t u32FrameCount,
+    uint32_t u32SamplesPerFrame )
+{
+    size_t cSamples = (size_t)u32FrameCount * u32SamplesPerFrame;
+    size_t i = 0;
+
+#if defined(APODSP_SSE2)
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        _mm_storeu_ps(&pf32OutFrames[i], _mm_loadu_ps(&pf32DelayFrames[i]));
+        _mm_storeu_ps(&pf32DelayFrames[i], _mm_loadu_ps(&pf32InFrames[i]));
+    }
+#elif defined(APODSP_NEON)
+    for (; i + 4 <= cSamples; i += 4)
+    {
+        vst1q_f32(&pf32OutFrames[i], vld1q_f32(&pf32DelayFrames[i]));
+        vst1q_f32(&pf32DelayFrames[i], vld1q_f32(&pf32InFrames[i]));
+    }
+#endif
+
+    for (; i < cSamples; i++)
+    {
+        pf32OutFrames[i] = pf32DelayFrames[i];
+        pf32DelayFrames[i] = pf32InFrames[i];
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Delays the input by u32DelayFrames frames using a circular delay line.
+//
+// Parameters:
+//
+//      pf32OutputFrames    - [out] u32ValidFrameCount frames of output
+//      pf32InputFrames     - [in] u32ValidFrameCount frames of input, NULL
+//                            for a silent input, or pf32OutputFrames to
+//                            process in place
+//      u32ValidFrameCount  - [in] frames to process
+//      u32SamplesPerFrame  - [in] channels per frame
+//      pf32DelayBuffer     - [in,out] u32DelayFrames frames of delay line
+//      u32DelayFrames      - [in] length of the delay line
+//      pu32DelayIndex      - [in,out] read/write position in the delay line
+//      pu32SilentFrames    - [in,out] number of most recently written frames
+//                            in the delay line known to be silent
+//
+// Return values:
+//
+//      true if the output is silent, in which case pf32OutputFrames was not
+//      written; false otherwise.
+//
+inline bool ApoDsp_Delay(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32SamplesPerFrame,
+    float *pf32DelayBuffer,
+    uint32_t u32DelayFrames,
+    uint32_t *pu32DelayIndex,
+    uint32_t *pu32SilentFrames )
+{
+    if (u32DelayFrames == 0)
+    {
+        if (pf32InputFrames == NULL)
+        {
+            return true;
+        }
+
+        if (pf32OutputFrames != pf32InputFrames)
+        {
+            ApoDsp_CopyFrames(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32SamplesPerFrame);
+        }
+        return false;
+    }
+
+    // Fast path: silence in, silence already queued => silence out.
+    // Only the read/write position moves; no audio memory is touched.
+    if (pf32InputFrames == NULL && *pu32SilentFrames >= u32DelayFrames)
+    {
+        *pu32DelayIndex = (uint32_t)(((uint64_t)(*pu32DelayIndex) + u32ValidFrameCount) % u32DelayFrames);
+        return true;
+    }
+
+    // Update the silence run for the frames about to enter the delay line.
+    if (pf32InputFrames == NULL)
+    {
+        uint64_t u64Silent = (uint64_t)(*pu32SilentFrames) + u32ValidFrameCount;
+        *pu32SilentFrames = (u64Silent < u32DelayFrames) ? (uint32_t)u64Silent : u32DelayFrames;
+    }
+    else
+    {
+        *pu32SilentFrames = 0;
+    }
+
+    // Invariants:
+    // 0 <= (*pu32DelayIndex) < u32DelayFrames
+    // pf32OutputFrames[0 ... u32ValidFrameCount * u32SamplesPerFrame - 1] is writable
+    // pf32InputFrames[0 ... u32ValidFrameCount * u32SamplesPerFrame - 1] is readable, if present
+    while (u32ValidFrameCount > 0)
+    {
+        // process either the rest of the input/output buffer,
+        // or the rest of the delay buffer,
+        // whichever is smaller
+        uint32_t framesToCopy = u32DelayFrames - (*pu32DelayIndex);
+        if (u32ValidFrameCount < framesToCopy)
+        {
+            framesToCopy = u32ValidFrameCount;
+        }
+        float *pf32Delay = &pf32DelayBuffer[(size_t)(*pu32DelayIndex) * u32SamplesPerFrame];
+
+        if (pf32InputFrames == NULL)
+        {
+            // delay => output, silence => delay
+            ApoDsp_CopyFrames(pf32OutputFrames, pf32Delay, framesToCopy, u32SamplesPerFrame);
+            ApoDsp_WriteSilence(pf32Delay, framesToCopy, u32SamplesPerFrame);
+        }
+        else if (pf32InputFrames == pf32OutputFrames)
+        {
+            // delay <=> buffer
+            ApoDsp_SwapFrames(pf32OutputFrames, pf32Delay, framesToCopy, u32SamplesPerFrame);
+            pf32InputFrames += (size_t)framesToCopy * u32SamplesPerFrame;
+        }
+        else
+        {
+            // delay => output, input => delay
+            ApoDsp_ExchangeFrames(pf32OutputFrames, pf32InputFrames, pf32Delay, framesToCopy, u32SamplesPerFrame);
+            pf32InputFrames += (size_t)framesToCopy * u32SamplesPerFrame;
+        }
+
+        pf32OutputFrames += (size_t)framesToCopy * u32SamplesPerFrame;
+        u32ValidFrameCount -= framesToCopy;
+
+        *pu32DelayIndex += framesToCopy;
+        if (*pu32DelayIndex == u32DelayFrames)
+        {
+            *pu32DelayIndex = 0;
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Swaps each adjacent pair of channels. With an odd channel count the
+//  last channel has no partner and is copied to the output unchanged.
+//  pf32OutputFrames may equal pf32InputFrames.
+//
+inline void ApoDsp_Swap(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32SamplesPerFrame )
+{
+    uint32_t u32SampleIndex;
+    float    fSwap32;
+
+    // loop through samples
+    while (u32ValidFrameCount--)
+    {
+        for (u32SampleIndex = 0; u32SampleIndex + 1 < u32SamplesPerFrame; u32SampleIndex += 2)
+        {
+            // apply swap
+            fSwap32 = pf32InputFrames[u32SampleIndex];
+            pf32OutputFrames[u32SampleIndex] = pf32InputFrames[u32SampleIndex + 1];
+            pf32OutputFrames[u32SampleIndex + 1] = fSwap32;
+        }
+
+        // unpaired last channel
+        if (u32SampleIndex < u32SamplesPerFrame)
+        {
+            pf32OutputFrames[u32SampleIndex] = pf32InputFrames[u32SampleIndex];
+        }
+
+        pf32OutputFrames += u32SamplesPerFrame;
+        pf32InputFrames += u32SamplesPerFrame;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Swaps each adjacent pair of channels and scales every output channel by
+//  the matching entry of pf32Coefficients. With an odd channel count the
+//  last channel is only scaled. pf32OutputFrames may equal pf32InputFrames.
+//
+inline void ApoDsp_SwapScale(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32SamplesPerFrame,
+    const float *pf32Coefficients )
+{
+    uint32_t u32SampleIndex;
+    float    fSwap32;
+
+    // loop through samples
+    while (u32ValidFrameCount--)
+    {
+        for (u32SampleIndex = 0; u32SampleIndex + 1 < u32SamplesPerFrame; u32SampleIndex += 2)
+        {
+            // save left channel
+            fSwap32 = pf32InputFrames[u32SampleIndex];
+            // left output equals right input times 1st coefficient
+            pf32OutputFrames[u32SampleIndex] = pf32InputFrames[u32SampleIndex + 1] * pf32Coefficients[u32SampleIndex];
+
+            // right output equals left input times 2nd coefficient
+            pf32OutputFrames[u32SampleIndex + 1] = fSwap32 * pf32Coefficients[u32SampleIndex + 1];
+        }
+
+        // unpaired last channel
+        if (u32SampleIndex < u32SamplesPerFrame)
+        {
+            pf32OutputFrames[u32SampleIndex] = pf32InputFrames[u32SampleIndex] * pf32Coefficients[u32SampleIndex];
+        }
+
+        pf32OutputFrames += u32SamplesPerFrame;
+        pf32InputFrames += u32SamplesPerFrame;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Gathers one channel out of frames of u32Stride channels. pf32InputFrames
+//  points at the channel in the first frame.
+//
+//  The vector loops load whole groups of four frames starting at the
+//  gathered channel, which can reach into the frame after the group; they
+//  stop one frame early so that never goes past the end of the buffer.
+//
+inline void ApoDsp_GatherMono(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32Stride )
+{
+    uint32_t n = 0;
+
+#if defined(APODSP_SSE2)
+    if (u32Stride == 2)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 8)
+        {
+            __m128 a = _mm_loadu_ps(pf32InputFrames);
+            __m128 b = _mm_loadu_ps(pf32InputFrames + 4);
+            _mm_storeu_ps(&pf32OutputFrames[n], _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+    }
+    else if (u32Stride == 4)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 16)
+        {
+            __m128 ab = _mm_unpacklo_ps(_mm_loadu_ps(pf32InputFrames), _mm_loadu_ps(pf32InputFrames + 4));
+            __m128 cd = _mm_unpacklo_ps(_mm_loadu_ps(pf32InputFrames + 8), _mm_loadu_ps(pf32InputFrames + 12));
+            _mm_storeu_ps(&pf32OutputFrames[n], _mm_movelh_ps(ab, cd));
+        }
+    }
+#elif defined(APODSP_NEON)
+    if (u32Stride == 2)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 8)
+        {
+            vst1q_f32(&pf32OutputFrames[n], vld2q_f32(pf32InputFrames).val[0]);
+        }
+    }
+    else if (u32Stride == 3)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 12)
+        {
+            vst1q_f32(&pf32OutputFrames[n], vld3q_f32(pf32InputFrames).val[0]);
+        }
+    }
+    else if (u32Stride == 4)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 16)
+        {
+            vst1q_f32(&pf32OutputFrames[n], vld4q_f32(pf32InputFrames).val[0]);
+        }
+    }
+#endif
+
+    for (; n < u32ValidFrameCount; n++, pf32InputFrames += u32Stride)
+    {
+        pf32OutputFrames[n] = *pf32InputFrames;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Gathers two adjacent channels out of frames of u32Stride channels.
+//  pf32InputFrames points at the first of them in the first frame.
+//
+inline void ApoDsp_GatherStereo(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32Stride )
+{
+    uint32_t n = 0;
+
+#if defined(APODSP_SSE2)
+    if (u32Stride == 4)
+    {
+        for (; n + 3 <= u32ValidFrameCount; n += 2, pf32InputFrames += 8)
+        {
+            __m128 a = _mm_loadu_ps(pf32InputFrames);
+            __m128 b = _mm_loadu_ps(pf32InputFrames + 4);
+            _mm_storeu_ps(&pf32OutputFrames[2 * n], _mm_movelh_ps(a, b));
+        }
+    }
+    else
+    {
+        // one 64 bit move per frame
+        for (; n < u32ValidFrameCount; n++, pf32InputFrames += u32Stride)
+        {
+            _mm_storel_pi((__m64*)&pf32OutputFrames[2 * n], _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)pf32InputFrames));
+        }
+    }
+#elif defined(APODSP_NEON)
+    if (u32Stride == 4)
+    {
+        for (; n + 5 <= u32ValidFrameCount; n += 4, pf32InputFrames += 16)
+        {
+            float32x4x4_t v = vld4q_f32(pf32InputFrames);
+            float32x4x2_t w = { { v.val[0], v.val[1] } };
+            vst2q_f32(&pf32OutputFrames[2 * n], w);
+        }
+    }
+    else
+    {
+        for (; n < u32ValidFrameCount; n++, pf32InputFrames += u32Stride)
+        {
+            vst1_f32(&pf32OutputFrames[2 * n], vld1_f32(pf32InputFrames));
+        }
+    }
+#endif
+
+    for (; n < u32ValidFrameCount; n++, pf32InputFrames += u32Stride)
+    {
+        pf32OutputFrames[2 * n] = pf32InputFrames[0];
+        pf32OutputFrames[2 * n + 1] = pf32InputFrames[1];
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Gathers u32ChannelCount adjacent channels out of frames of u32Stride
+//  channels, four channels at a time. pf32InputFrames points at the first
+//  of them in the first frame.
+//
+inline void ApoDsp_GatherFrames(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32ChannelCount,
+    uint32_t u32Stride )
+{
+#if defined(APODSP_SSE2) || defined(APODSP_NEON)
+    // four channel arrays: one vector per frame
+    if (u32ChannelCount == 4)
+    {
+        for (uint32_t n = 0; n < u32ValidFrameCount; n++, pf32InputFrames += u32Stride)
+        {
+#if defined(APODSP_SSE2)
+            _mm_storeu_ps(&pf32OutputFrames[4 * n], _mm_loadu_ps(pf32InputFrames));
+#else
+            vst1q_f32(&pf32OutputFrames[4 * n], vld1q_f32(pf32InputFrames));
+#endif
+        }
+        return;
+    }
+#endif
+
+    while (u32ValidFrameCount--)
+    {
+        uint32_t c = 0;
+
+#if defined(APODSP_SSE2)
+        for (; c + 4 <= u32ChannelCount; c += 4)
+        {
+            _mm_storeu_ps(&pf32OutputFrames[c], _mm_loadu_ps(&pf32InputFrames[c]));
+        }
+#elif defined(APODSP_NEON)
+        for (; c + 4 <= u32ChannelCount; c += 4)
+        {
+            vst1q_f32(&pf32OutputFrames[c], vld1q_f32(&pf32InputFrames[c]));
+        }
+#endif
+        for (; c < u32ChannelCount; c++)
+        {
+            pf32OutputFrames[c] = pf32InputFrames[c];
+        }
+
+        pf32OutputFrames += u32ChannelCount;
+        pf32InputFrames += u32Stride;
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Extracts the primary channels from frames that also carry interleaved
+//  (e.g. keyword spotter loopback) channels.
+//
+//  Without interleaved channels the layouts are identical and the frames
+//  are copied in bulk, or not touched at all when processing in place.
+//  One and two primary channels, the keyword formats the sample driver
+//  exposes, have dedicated gather kernels.
+//
+// Parameters:
+//
+//      pf32OutputFrames        - [out] u32ValidFrameCount frames of
+//                                u32PrimaryChannelCount channels
+//      pf32InputFrames         - [in] u32ValidFrameCount frames of
+//                                u32TotalChannelCount channels
+//      u32ValidFrameCount      - [in] frames to process
+//      u32PrimaryChannelStart  - [in] first primary channel in an input frame
+//      u32PrimaryChannelCount  - [in] number of primary channels
+//      u32TotalChannelCount    - [in] primary plus interleaved channels
+//
+inline void ApoDsp_ExtractPrimaryChannels(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32PrimaryChannelStart,
+    uint32_t u32PrimaryChannelCount,
+    uint32_t u32TotalChannelCount )
+{
+    if (u32PrimaryChannelCount == u32TotalChannelCount)
+    {
+        if (pf32OutputFrames != pf32InputFrames)
+        {
+            ApoDsp_CopyFrames(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32TotalChannelCount);
+        }
+        return;
+    }
+
+    pf32InputFrames += u32PrimaryChannelStart;
+
+    switch (u32PrimaryChannelCount)
+    {
+        case 0:
+            break;
+        case 1:
+            ApoDsp_GatherMono(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32TotalChannelCount);
+            break;
+        case 2:
+            ApoDsp_GatherStereo(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32TotalChannelCount);
+            break;
+        default:
+            ApoDsp_GatherFrames(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32PrimaryChannelCount, u32TotalChannelCount);
+            break;
+    }
+}
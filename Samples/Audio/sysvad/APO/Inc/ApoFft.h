@@ -0,0 +1,279 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    ApoFft.h
+//
+// Abstract:    Portable real FFT for the sample APOs.
+//
+//              A real transform of N points is computed as a complex
+//              transform of N/2 points plus a split step. Data is kept as
+//              separate real and imaginary arrays, and the twiddles of each
+//              radix-2 stage are stored contiguously, so every butterfly
+//              inner loop is unit stride and is vectorized by the compiler.
+//
+//              The object never allocates. The caller sizes a block with
+//              GetRequiredBytes, provides it to Initialize (non-realtime)
+//              and keeps it alive for the lifetime of the object. Forward
+//              and Inverse are realtime safe.
+//
+//              A spectrum is N/2+1 bins held in two arrays (real, imaginary).
+//              Inverse applies the 1/N scaling, so Inverse(Forward(x)) == x.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+
+#define APOFFT_ALIGNMENT    16
+
+class CApoFft
+{
+public:
+    CApoFft()
+    :   m_u32Size(0)
+    ,   m_u32HalfSize(0)
+    ,   m_pf32StageCos(NULL)
+    ,   m_pf32StageSin(NULL)
+    ,   m_pf32SplitCos(NULL)
+    ,   m_pf32SplitSin(NULL)
+    ,   m_pu32BitReverse(NULL)
+    ,   m_pf32Re(NULL)
+    ,   m_pf32Im(NULL)
+    {
+    }
+
+    //
+    // Bytes of memory Initialize needs for an N point transform.
+    //
+    static size_t GetRequiredBytes(uint32_t u32Size)
+    {
+        return Layout(u32Size, NULL, NULL);
+    }
+
+    //
+    // u32Size must be a power of two, at least 4. pMemory must hold
+    // GetRequiredBytes(u32Size) bytes aligned to APOFFT_ALIGNMENT.
+    //
+    bool Initialize(uint32_t u32Size, void *pMemory)
+    {
+        if (u32Size < 4 || (u32Size & (u32Size - 1)) != 0 || pMemory == NULL)
+        {
+            return false;
+        }
+
+        Layout(u32Size, (uint8_t*)pMemory, this);
+
+        m_u32Size = u32Size;
+        m_u32HalfSize = u32Size / 2;
+
+        const double dPi = 3.14159265358979323846;
+        uint32_t     M = m_u32HalfSize;
+
+        // Stage twiddles for the M point complex transform: the stage with
+        // half-span h uses h twiddles stored at [h - 1, 2h - 1).
+        for (uint32_t h = 1; h < M; h <<= 1)
+        {
+            for (uint32_t j = 0; j < h; j++)
+            {
+                double dAngle = -dPi * j / h;
+                m_pf32StageCos[h - 1 + j] = (float)cos(dAngle);
+                m_pf32StageSin[h - 1 + j] = (float)sin(dAngle);
+            }
+        }
+
+        // Split twiddles W_N^k for k = 0 .. N/2.
+        for (uint32_t k = 0; k <= M; k++)
+        {
+            double dAngle = -2.0 * dPi * k / u32Size;
+            m_pf32SplitCos[k] = (float)cos(dAngle);
+            m_pf32SplitSin[k] = (float)sin(dAngle);
+        }
+
+        uint32_t u32Bits = 0;
+        while ((1u << u32Bits) < M)
+        {
+            u32Bits++;
+        }
+        for (uint32_t i = 0; i < M; i++)
+        {
+            uint32_t r = 0;
+            for (uint32_t b = 0; b < u32Bits; b++)
+            {
+                r |= ((i >> b) & 1) << (u32Bits - 1 - b);
+            }
+            m_pu32BitReverse[i] = r;
+        }
+
+        return true;
+    }
+
+    uint32_t GetSize() const { return m_u32Size; }
+    uint32_t GetBinCount() const { return m_u32HalfSize + 1; }
+
+    //
+    // pf32In: N real samples. pf32OutRe/pf32OutIm: N/2+1 bins.
+    //
+    void Forward(const float *pf32In, float *pf32OutRe, float *pf32OutIm)
+    {
+        uint32_t M = m_u32HalfSize;
+
+        // pack even/odd samples as one complex sequence, in bit reversed order
+        for (uint32_t n = 0; n < M; n++)
+        {
+            uint32_t r = m_pu32BitReverse[n];
+            m_pf32Re[r] = pf32In[2 * n];
+            m_pf32Im[r] = pf32In[2 * n + 1];
+        }
+
+        Butterflies(false);
+
+        // split: X[k] = Xe[k] + W^k Xo[k]
+        pf32OutRe[0] = m_pf32Re[0] + m_pf32Im[0];
+        pf32OutIm[0] = 0.0f;
+        pf32OutRe[M] = m_pf32Re[0] - m_pf32Im[0];
+        pf32OutIm[M] = 0.0f;
+
+        for (uint32_t k = 1; k < M; k++)
+        {
+            float zr = m_pf32Re[k], zi = m_pf32Im[k];
+            float cr = m_pf32Re[M - k], ci = -m_pf32Im[M - k];
+
+            float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+            // Xo = (Z - conj(Z'))/(2i)
+            float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+
+            float wr = m_pf32SplitCos[k], wi = m_pf32SplitSin[k];
+            pf32OutRe[k] = er + (wr * orr - wi * oi);
+            pf32OutIm[k] = ei + (wr * oi + wi * orr);
+        }
+    }
+
+    //
+    // pf32InRe/pf32InIm: N/2+1 bins. pf32Out: N real samples.
+    //
+    void Inverse(const float *pf32InRe, const float *pf32InIm, float *pf32Out)
+    {
+        uint32_t M = m_u32HalfSize;
+        float    fScale = 1.0f / (float)m_u32Size;
+
+        // unsplit: Z[k] = Xe[k] + i Xo[k], stored bit reversed
+        for (uint32_t k = 0; k < M; k++)
+        {
+            float xr = pf32InRe[k], xi = pf32InIm[k];
+            float cr = pf32InRe[M - k], ci = -pf32InIm[M - k];
+
+            float er = xr + cr, ei = xi + ci;
+            float dr = xr - cr, di = xi - ci;
+
+            // Xo = (X - conj(X')) * conj(W^k)
+            float wr = m_pf32SplitCos[k], wi = -m_pf32SplitSin[k];
+            float orr = dr * wr - di * wi, oi = dr * wi + di * wr;
+
+            uint32_t r = m_pu32BitReverse[k];
+            m_pf32Re[r] = er - oi;
+            m_pf32Im[r] = ei + orr;
+        }
+
+        // the inverse transform is the forward transform with conjugated twiddles
+        Butterflies(true);
+
+        for (uint32_t n = 0; n < M; n++)
+        {
+            pf32Out[2 * n] = m_pf32Re[n] * fScale;
+            pf32Out[2 * n + 1] = m_pf32Im[n] * fScale;
+        }
+    }
+
+private:
+    //
+    // In-place radix-2 decimation in time over m_pf32Re/m_pf32Im, which
+    // must already be in bit reversed order. fInverse conjugates the
+    // twiddles; no scaling is applied.
+    //
+    void Butterflies(bool fInverse)
+    {
+        uint32_t M = m_u32HalfSize;
+        float    fSign = fInverse ? -1.0f : 1.0f;
+
+        for (uint32_t h = 1; h < M; h <<= 1)
+        {
+            const float *pf32Cos = &m_pf32StageCos[h - 1];
+            const float *pf32Sn = &m_pf32StageSin[h - 1];
+
+            for (uint32_t g = 0; g < M; g += 2 * h)
+            {
+                float *pf32ARe = &m_pf32Re[g];
+                float *pf32AIm = &m_pf32Im[g];
+                float *pf32BRe = &m_pf32Re[g + h];
+                float *pf32BIm = &m_pf32Im[g + h];
+
+                for (uint32_t j = 0; j < h; j++)
+                {
+                    float wr = pf32Cos[j], wi = fSign * pf32Sn[j];
+                    float tr = wr * pf32BRe[j] - wi * pf32BIm[j];
+                    float ti = wr * pf32BIm[j] + wi * pf32BRe[j];
+
+                    pf32BRe[j] = pf32ARe[j] - tr;
+                    pf32BIm[j] = pf32AIm[j] - ti;
+                    pf32ARe[j] = pf32ARe[j] + tr;
+                    pf32AIm[j] = pf32AIm[j] + ti;
+                }
+            }
+        }
+    }
+
+    //
+    // Carves the tables out of pBase, or just sizes them when pBase is NULL.
+    //
+    static size_t Layout(uint32_t u32Size, uint8_t *pBase, CApoFft *pFft)
+    {
+        size_t   cb = 0;
+        uint32_t M = u32Size / 2;
+
+        cb = Carve(pBase, cb, sizeof(float) * M, pFft ? (void**)&pFft->m_pf32StageCos : NULL);
+        cb = Carve(pBase, cb, sizeof(float) * M, pFft ? (void**)&pFft->m_pf32StageSin : NULL);
+        cb = Carve(pBase, cb, sizeof(float) * (M + 1), pFft ? (void**)&pFft->m_pf32SplitCos : NULL);
+        cb = Carve(pBase, cb, sizeof(float) * (M + 1), pFft ? (void**)&pFft->m_pf32SplitSin : NULL);
+        cb = Carve(pBase, cb, sizeof(uint32_t) * M, pFft ? (void**)&pFft->m_pu32BitReverse : NULL);
+        cb = Carve(pBase, cb, sizeof(float) * M, pFft ? (void**)&pFft->m_pf32Re : NULL);
+        cb = Carve(pBase, cb, sizeof(float) * M, pFft ? (void**)&pFft->m_pf32Im : NULL);
+
+        return cb;
+    }
+
+public:
+    //
+    // Reserves cbItem bytes at offset cb (rounded up to APOFFT_ALIGNMENT),
+    // storing the address in *ppItem when pBase is not NULL. Returns the
+    // new offset. Shared with the other DSP objects that lay out their state
+    // in a single caller-provided block.
+    //
+    static size_t Carve(uint8_t *pBase, size_t cb, size_t cbItem, void **ppItem)
+    {
+        cb = (cb + (APOFFT_ALIGNMENT - 1)) & ~(size_t)(APOFFT_ALIGNMENT - 1);
+        if (pBase != NULL && ppItem != NULL)
+        {
+            *ppItem = pBase + cb;
+        }
+        return cb + cbItem;
+    }
+
+private:
+    uint32_t    m_u32Size;
+    uint32_t    m_u32HalfSize;
+    float      *m_pf32StageCos;
+    float      *m_pf32StageSin;
+    float      *m_pf32SplitCos;
+    float      *m_pf32SplitSin;
+    uint32_t   *m_pu32BitReverse;
+    float      *m_pf32Re;
+    float      *m_pf32Im;
+};
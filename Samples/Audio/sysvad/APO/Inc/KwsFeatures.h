@@ -0,0 +1,312 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    KwsFeatures.h
+//
+// Abstract:    Streaming log-mel / MFCC front end for keyword detection.
+//
+//              The extractor consumes the 10 ms, 16 kHz packets the keyword
+//              detector buffers and produces one feature frame per packet:
+//              a 25 ms Hamming window over the most recent samples (the
+//              overlap is kept between calls), a 512 point real FFT, a 40
+//              band mel filterbank and 13 cepstral coefficients.
+//
+//              Every keyword model of the driver consumes the same frames,
+//              so the spectrum is computed once per packet. Windows of pure
+//              digital silence skip the transform and return a precomputed
+//              frame.
+//
+//              The KWS APO does not run the extractor. The detectors run in
+//              the driver on every packet, before any client opens the
+//              keyword pin, so the APO only sees audio after a detection.
+//              Its only output is the audio connection, so it has no way to
+//              hand frames to a consumer. The float ProcessPacket is there
+//              for a user-mode second stage that reads the pin.
+//
+//              All tables live inside the object; Initialize (non-realtime)
+//              fills them and ProcessPacket never allocates. The code only
+//              depends on the C runtime so it builds in the driver, in the
+//              APOs and on any host. Driver callers must save the floating
+//              point state around Initialize and ProcessPacket.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "ApoFft.h"
+
+#define KWSFEATURES_SAMPLE_RATE     16000
+#define KWSFEATURES_HOP_SAMPLES     160     // 10 ms, one keyword packet
+#define KWSFEATURES_WINDOW_SAMPLES  400     // 25 ms
+#define KWSFEATURES_FFT_SIZE        512
+#define KWSFEATURES_BIN_COUNT       (KWSFEATURES_FFT_SIZE / 2 + 1)
+#define KWSFEATURES_MEL_BANDS       40
+#define KWSFEATURES_MFCC_COUNT      13
+
+#define KWSFEATURES_MEL_LOW_HZ      20.0
+#define KWSFEATURES_MEL_HIGH_HZ     7600.0
+#define KWSFEATURES_PREEMPHASIS     0.97f
+#define KWSFEATURES_ENERGY_FLOOR    1e-10f
+
+// Upper bound of the FFT tables, checked by Initialize
+#define KWSFEATURES_FFT_BYTES       (8 * 1024)
+
+//
+// Features of one packet.
+//
+typedef struct
+{
+    float   LogMel[KWSFEATURES_MEL_BANDS];
+    float   Mfcc[KWSFEATURES_MFCC_COUNT];
+} KWSFEATURES_FRAME;
+
+class CKwsFeatureExtractor
+{
+public:
+    CKwsFeatureExtractor() : m_fInitialized(false), m_u32SilentSamples(0), m_f32PreviousSample(0.0f)
+    {
+    }
+
+    //
+    // Builds the window, filterbank and DCT tables. Non-realtime.
+    //
+    bool Initialize()
+    {
+        const double dPi = 3.14159265358979323846;
+
+        if (CApoFft::GetRequiredBytes(KWSFEATURES_FFT_SIZE) > sizeof(m_abFftMemory) ||
+            !m_Fft.Initialize(KWSFEATURES_FFT_SIZE, m_abFftMemory))
+        {
+            return false;
+        }
+
+        for (uint32_t n = 0; n < KWSFEATURES_WINDOW_SAMPLES; n++)
+        {
+            m_af32Window[n] = (float)(0.54 - 0.46 * cos(2.0 * dPi * n / (KWSFEATURES_WINDOW_SAMPLES - 1)));
+        }
+
+        // Band b is a triangle over mel points b, b + 1 and b + 2. A bin
+        // between points p and p + 1 rises into band p and falls out of
+        // band p - 1, so one point index and one weight describe it.
+        double adPointsHz[KWSFEATURES_MEL_BANDS + 2];
+        double dMelLow = HzToMel(KWSFEATURES_MEL_LOW_HZ);
+        double dMelHigh = HzToMel(KWSFEATURES_MEL_HIGH_HZ);
+
+        for (uint32_t p = 0; p < KWSFEATURES_MEL_BANDS + 2; p++)
+        {
+            adPointsHz[p] = MelToHz(dMelLow + (dMelHigh - dMelLow) * p / (KWSFEATURES_MEL_BANDS + 1));
+        }
+
+        for (uint32_t k = 0; k < KWSFEATURES_BIN_COUNT; k++)
+        {
+            double dHz = (double)k * KWSFEATURES_SAMPLE_RATE / KWSFEATURES_FFT_SIZE;
+
+            m_ai16BinPoint[k] = -1;
+            m_af32BinWeight[k] = 0.0f;
+
+            for (uint32_t p = 0; p + 1 < KWSFEATURES_MEL_BANDS + 2; p++)
+            {
+                if (dHz >= adPointsHz[p] && dHz < adPointsHz[p + 1])
+                {
+                    m_ai16BinPoint[k] = (int16_t)p;
+                    m_af32BinWeight[k] = (float)((dHz - adPointsHz[p]) / (adPointsHz[p + 1] - adPointsHz[p]));
+                    break;
+                }
+            }
+        }
+
+        // Orthonormal DCT-II
+        for (uint32_t i = 0; i < KWSFEATURES_MFCC_COUNT; i++)
+        {
+            double dScale = sqrt((i == 0 ? 1.0 : 2.0) / KWSFEATURES_MEL_BANDS);
+            for (uint32_t j = 0; j < KWSFEATURES_MEL_BANDS; j++)
+            {
+                m_af32Dct[i][j] = (float)(dScale * cos(dPi * i * (j + 0.5) / KWSFEATURES_MEL_BANDS));
+            }
+        }
+
+        // Features of a silent window, returned without running the transform
+        float f32LogFloor = (float)log((double)KWSFEATURES_ENERGY_FLOOR);
+        for (uint32_t b = 0; b < KWSFEATURES_MEL_BANDS; b++)
+        {
+            m_SilentFrame.LogMel[b] = f32LogFloor;
+        }
+        Cepstrum(&m_SilentFrame);
+
+        m_fInitialized = true;
+        Reset();
+
+        return true;
+    }
+
+    bool IsInitialized() const { return m_fInitialized; }
+
+    //
+    // Forgets the overlap, e.g. when the stream restarts.
+    //
+    void Reset()
+    {
+        memset(m_af32History, 0, sizeof(m_af32History));
+        m_u32SilentSamples = KWSFEATURES_WINDOW_SAMPLES;
+        m_f32PreviousSample = 0.0f;
+    }
+
+    //
+    // Consumes KWSFEATURES_HOP_SAMPLES 16-bit samples and produces the
+    // features of the window ending with them.
+    //
+    void ProcessPacket(const int16_t *pi16Samples, KWSFEATURES_FRAME *pFrame)
+    {
+        float *pf32New = Advance();
+        bool   fSilent = (m_f32PreviousSample == 0.0f);
+
+        for (uint32_t n = 0; n < KWSFEATURES_HOP_SAMPLES; n++)
+        {
+            float f32Sample = pi16Samples[n] * (1.0f / 32768.0f);
+            fSilent = fSilent && (pi16Samples[n] == 0);
+            pf32New[n] = f32Sample - KWSFEATURES_PREEMPHASIS * m_f32PreviousSample;
+            m_f32PreviousSample = f32Sample;
+        }
+
+        Analyze(fSilent, pFrame);
+    }
+
+    //
+    // Same for float samples in [-1, 1], as used by the APOs.
+    //
+    void ProcessPacket(const float *pf32Samples, KWSFEATURES_FRAME *pFrame)
+    {
+        float *pf32New = Advance();
+        bool   fSilent = (m_f32PreviousSample == 0.0f);
+
+        for (uint32_t n = 0; n < KWSFEATURES_HOP_SAMPLES; n++)
+        {
+            fSilent = fSilent && (pf32Samples[n] == 0.0f);
+            pf32New[n] = pf32Samples[n] - KWSFEATURES_PREEMPHASIS * m_f32PreviousSample;
+            m_f32PreviousSample = pf32Samples[n];
+        }
+
+        Analyze(fSilent, pFrame);
+    }
+
+private:
+    static double HzToMel(double dHz) { return 2595.0 * log10(1.0 + dHz / 700.0); }
+    static double MelToHz(double dMel) { return 700.0 * (pow(10.0, dMel / 2595.0) - 1.0); }
+
+    //
+    // Drops the oldest hop from the history and returns where the new one
+    // goes.
+    //
+    float *Advance()
+    {
+        memmove(m_af32History, &m_af32History[KWSFEATURES_HOP_SAMPLES],
+                sizeof(float) * (KWSFEATURES_WINDOW_SAMPLES - KWSFEATURES_HOP_SAMPLES));
+        return &m_af32History[KWSFEATURES_WINDOW_SAMPLES - KWSFEATURES_HOP_SAMPLES];
+    }
+
+    //
+    // fSilentPacket: every pre-emphasized sample of the new hop is zero.
+    //
+    void Analyze(bool fSilentPacket, KWSFEATURES_FRAME *pFrame)
+    {
+        if (fSilentPacket)
+        {
+            m_u32SilentSamples += KWSFEATURES_HOP_SAMPLES;
+        }
+        else
+        {
+            m_u32SilentSamples = 0;
+        }
+
+        if (m_u32SilentSamples >= KWSFEATURES_WINDOW_SAMPLES)
+        {
+            m_u32SilentSamples = KWSFEATURES_WINDOW_SAMPLES;
+            *pFrame = m_SilentFrame;
+            return;
+        }
+
+        for (uint32_t n = 0; n < KWSFEATURES_WINDOW_SAMPLES; n++)
+        {
+            m_af32Frame[n] = m_af32History[n] * m_af32Window[n];
+        }
+        memset(&m_af32Frame[KWSFEATURES_WINDOW_SAMPLES], 0,
+               sizeof(float) * (KWSFEATURES_FFT_SIZE - KWSFEATURES_WINDOW_SAMPLES));
+
+        m_Fft.Forward(m_af32Frame, m_af32Re, m_af32Im);
+
+        float af32Mel[KWSFEATURES_MEL_BANDS];
+        memset(af32Mel, 0, sizeof(af32Mel));
+
+        // A bin at point index p adds its rising part to band p and the
+        // rest to band p - 1.
+        for (uint32_t k = 0; k < KWSFEATURES_BIN_COUNT; k++)
+        {
+            int32_t p = m_ai16BinPoint[k];
+            if (p < 0)
+            {
+                continue;
+            }
+
+            float f32Power = m_af32Re[k] * m_af32Re[k] + m_af32Im[k] * m_af32Im[k];
+            float f32Rise = m_af32BinWeight[k] * f32Power;
+
+            if (p > 0)
+            {
+                af32Mel[p - 1] += f32Power - f32Rise;
+            }
+            if (p < KWSFEATURES_MEL_BANDS)
+            {
+                af32Mel[p] += f32Rise;
+            }
+        }
+
+        for (uint32_t b = 0; b < KWSFEATURES_MEL_BANDS; b++)
+        {
+            pFrame->LogMel[b] = (float)log((double)(af32Mel[b] + KWSFEATURES_ENERGY_FLOOR));
+        }
+
+        Cepstrum(pFrame);
+    }
+
+    void Cepstrum(KWSFEATURES_FRAME *pFrame) const
+    {
+        for (uint32_t i = 0; i < KWSFEATURES_MFCC_COUNT; i++)
+        {
+            float f32Sum = 0.0f;
+            for (uint32_t j = 0; j < KWSFEATURES_MEL_BANDS; j++)
+            {
+                f32Sum += m_af32Dct[i][j] * pFrame->LogMel[j];
+            }
+            pFrame->Mfcc[i] = f32Sum;
+        }
+    }
+
+private:
+    bool                m_fInitialized;
+    uint32_t            m_u32SilentSamples;     // trailing digital silence in the history, capped at the window
+    float               m_f32PreviousSample;    // pre-emphasis state
+
+    CApoFft             m_Fft;
+    alignas(APOFFT_ALIGNMENT) uint8_t m_abFftMemory[KWSFEATURES_FFT_BYTES];
+
+    alignas(APOFFT_ALIGNMENT) float m_af32History[KWSFEATURES_WINDOW_SAMPLES];
+    alignas(APOFFT_ALIGNMENT) float m_af32Frame[KWSFEATURES_FFT_SIZE];
+    alignas(APOFFT_ALIGNMENT) float m_af32Re[KWSFEATURES_BIN_COUNT];
+    alignas(APOFFT_ALIGNMENT) float m_af32Im[KWSFEATURES_BIN_COUNT];
+
+    float               m_af32Window[KWSFEATURES_WINDOW_SAMPLES];
+    int16_t             m_ai16BinPoint[KWSFEATURES_BIN_COUNT];      // -1 outside the filterbank
+    float               m_af32BinWeight[KWSFEATURES_BIN_COUNT];
+    float               m_af32Dct[KWSFEATURES_MFCC_COUNT][KWSFEATURES_MEL_BANDS];
+    KWSFEATURES_FRAME   m_SilentFrame;
+};
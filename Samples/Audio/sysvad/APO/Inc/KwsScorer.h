@@ -0,0 +1,311 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    KwsScorer.h
+//
+// Abstract:    Second-stage keyword scorer shared by all armed keywords.
+//
+//              The model is a small two layer network over the last T
+//              feature frames (T x D cepstral coefficients):
+//
+//                  hidden = relu(W1' x + b1)       H units, shared
+//                  score  = W2' hidden + b2        one logit per keyword
+//
+//              The hidden layer is computed once per packet for every
+//              keyword, and each keyword only adds a column of W2, so
+//              adding a keyword costs H multiply-adds against T x D x H for
+//              the shared part.
+//
+//              Weights are stored with the output dimension fastest (W1 is
+//              [T x D][H], W2 is [H][N4], N4 being the keyword count rounded
+//              up to 4), so both layers are a sequence of broadcast
+//              multiply-adds over contiguous rows. The SSE2 (x64) and NEON
+//              (ARM64) paths perform the same operations in the same order
+//              as the portable loop.
+//
+//              The object never allocates: GetRequiredBytes sizes a block,
+//              Initialize (non-realtime) copies the weights into it. Depends
+//              only on the C runtime. Driver callers must save the floating
+//              point state around PushFrame and Score.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ApoDsp.h"
+#include "ApoFft.h"
+
+// Output count rounded up to the vector width
+#define KWSSCORER_PADDED(n)     (((n) + 3) & ~(uint32_t)3)
+
+class CKwsScorer
+{
+public:
+    CKwsScorer()
+    :   m_u32Frames(0)
+    ,   m_u32Features(0)
+    ,   m_u32Hidden(0)
+    ,   m_u32Outputs(0)
+    ,   m_u32FramesPushed(0)
+    ,   m_u32Position(0)
+    ,   m_pf32HiddenWeights(NULL)
+    ,   m_pf32HiddenBias(NULL)
+    ,   m_pf32OutputWeights(NULL)
+    ,   m_pf32OutputBias(NULL)
+    ,   m_pf32History(NULL)
+    ,   m_pf32Hidden(NULL)
+    ,   m_pf32Scores(NULL)
+    {
+    }
+
+    //
+    // Bytes of memory Initialize needs. u32Hidden must be a multiple of 4.
+    //
+    static size_t GetRequiredBytes(uint32_t u32Frames, uint32_t u32Features, uint32_t u32Hidden, uint32_t u32Outputs)
+    {
+        return Layout(u32Frames, u32Features, u32Hidden, u32Outputs, NULL, NULL);
+    }
+
+    //
+    // Copies the weights (layout above) into pMemory, which must hold
+    // GetRequiredBytes bytes aligned to APOFFT_ALIGNMENT and outlive the
+    // object. The source weights need no particular alignment.
+    //
+    bool Initialize(
+        uint32_t u32Frames,
+        uint32_t u32Features,
+        uint32_t u32Hidden,
+        uint32_t u32Outputs,
+        const float *pf32HiddenWeights,
+        const float *pf32HiddenBias,
+        const float *pf32OutputWeights,
+        const float *pf32OutputBias,
+        void *pMemory )
+    {
+        if (u32Frames == 0 || u32Features == 0 || u32Hidden == 0 || (u32Hidden & 3) != 0 ||
+            u32Outputs == 0 || pMemory == NULL)
+        {
+            return false;
+        }
+
+        Layout(u32Frames, u32Features, u32Hidden, u32Outputs, (uint8_t*)pMemory, this);
+
+        m_u32Frames = u32Frames;
+        m_u32Features = u32Features;
+        m_u32Hidden = u32Hidden;
+        m_u32Outputs = u32Outputs;
+
+        uint32_t u32Padded = KWSSCORER_PADDED(u32Outputs);
+
+        memcpy(m_pf32HiddenWeights, pf32HiddenWeights, sizeof(float) * u32Frames * u32Features * u32Hidden);
+        memcpy(m_pf32HiddenBias, pf32HiddenBias, sizeof(float) * u32Hidden);
+        memcpy(m_pf32OutputWeights, pf32OutputWeights, sizeof(float) * u32Hidden * u32Padded);
+        memcpy(m_pf32OutputBias, pf32OutputBias, sizeof(float) * u32Padded);
+
+        Reset();
+
+        return true;
+    }
+
+    uint32_t GetFrameCount() const { return m_u32Frames; }
+    uint32_t GetFeatureCount() const { return m_u32Features; }
+    uint32_t GetOutputCount() const { return m_u32Outputs; }
+
+    //
+    // Forgets the frame history.
+    //
+    void Reset()
+    {
+        m_u32FramesPushed = 0;
+        m_u32Position = 0;
+        if (m_pf32History != NULL)
+        {
+            memset(m_pf32History, 0, sizeof(float) * 2 * m_u32Frames * m_u32Features);
+        }
+    }
+
+    //
+    // Appends the newest frame of GetFeatureCount() features. Every frame
+    // is stored twice, T frames apart, so the last T frames are always
+    // contiguous.
+    //
+    void PushFrame(const float *pf32Features)
+    {
+        size_t cbFrame = sizeof(float) * m_u32Features;
+
+        memcpy(&m_pf32History[(size_t)m_u32Position * m_u32Features], pf32Features, cbFrame);
+        memcpy(&m_pf32History[(size_t)(m_u32Position + m_u32Frames) * m_u32Features], pf32Features, cbFrame);
+
+        m_u32Position = (m_u32Position + 1 == m_u32Frames) ? 0 : m_u32Position + 1;
+        if (m_u32FramesPushed < m_u32Frames)
+        {
+            m_u32FramesPushed++;
+        }
+    }
+
+    //
+    // True once T frames have been pushed since the last Reset.
+    //
+    bool IsPrimed() const { return m_u32FramesPushed == m_u32Frames; }
+
+    //
+    // Scores the last T frames. Returns GetOutputCount() logits, valid
+    // until the next call.
+    //
+    const float *Score()
+    {
+        const float *pf32Input = &m_pf32History[(size_t)m_u32Position * m_u32Features];
+        uint32_t     u32Inputs = m_u32Frames * m_u32Features;
+        uint32_t     u32Padded = KWSSCORER_PADDED(m_u32Outputs);
+
+        memcpy(m_pf32Hidden, m_pf32HiddenBias, sizeof(float) * m_u32Hidden);
+        Accumulate(m_pf32Hidden, pf32Input, m_pf32HiddenWeights, u32Inputs, m_u32Hidden);
+
+        for (uint32_t h = 0; h < m_u32Hidden; h++)
+        {
+            m_pf32Hidden[h] = (m_pf32Hidden[h] > 0.0f) ? m_pf32Hidden[h] : 0.0f;
+        }
+
+        memcpy(m_pf32Scores, m_pf32OutputBias, sizeof(float) * u32Padded);
+        Accumulate(m_pf32Scores, m_pf32Hidden, m_pf32OutputWeights, m_u32Hidden, u32Padded);
+
+        return m_pf32Scores;
+    }
+
+private:
+    //
+    // pf32Out[0..u32Width) += sum over i of pf32In[i] * pf32Weights[i][0..u32Width).
+    // u32Width is a multiple of 4; pf32Out and pf32Weights are aligned. The
+    // outputs are kept in registers 16 at a time while the inputs stream by.
+    //
+    static void Accumulate(float *pf32Out, const float *pf32In, const float *pf32Weights, uint32_t u32Inputs, uint32_t u32Width)
+    {
+        uint32_t j = 0;
+
+#if defined(APODSP_SSE2)
+        for (; j + 16 <= u32Width; j += 16)
+        {
+            const float *pf32W = &pf32Weights[j];
+            __m128 acc0 = _mm_load_ps(&pf32Out[j]);
+            __m128 acc1 = _mm_load_ps(&pf32Out[j + 4]);
+            __m128 acc2 = _mm_load_ps(&pf32Out[j + 8]);
+            __m128 acc3 = _mm_load_ps(&pf32Out[j + 12]);
+
+            for (uint32_t i = 0; i < u32Inputs; i++, pf32W += u32Width)
+            {
+                __m128 vx = _mm_set1_ps(pf32In[i]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(vx, _mm_load_ps(&pf32W[0])));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(vx, _mm_load_ps(&pf32W[4])));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(vx, _mm_load_ps(&pf32W[8])));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(vx, _mm_load_ps(&pf32W[12])));
+            }
+
+            _mm_store_ps(&pf32Out[j], acc0);
+            _mm_store_ps(&pf32Out[j + 4], acc1);
+            _mm_store_ps(&pf32Out[j + 8], acc2);
+            _mm_store_ps(&pf32Out[j + 12], acc3);
+        }
+        for (; j < u32Width; j += 4)
+        {
+            const float *pf32W = &pf32Weights[j];
+            __m128 acc = _mm_load_ps(&pf32Out[j]);
+
+            for (uint32_t i = 0; i < u32Inputs; i++, pf32W += u32Width)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pf32In[i]), _mm_load_ps(pf32W)));
+            }
+
+            _mm_store_ps(&pf32Out[j], acc);
+        }
+#elif defined(APODSP_NEON)
+        for (; j + 16 <= u32Width; j += 16)
+        {
+            const float *pf32W = &pf32Weights[j];
+            float32x4_t acc0 = vld1q_f32(&pf32Out[j]);
+            float32x4_t acc1 = vld1q_f32(&pf32Out[j + 4]);
+            float32x4_t acc2 = vld1q_f32(&pf32Out[j + 8]);
+            float32x4_t acc3 = vld1q_f32(&pf32Out[j + 12]);
+
+            for (uint32_t i = 0; i < u32Inputs; i++, pf32W += u32Width)
+            {
+                float32x4_t vx = vdupq_n_f32(pf32In[i]);
+                acc0 = vaddq_f32(acc0, vmulq_f32(vx, vld1q_f32(&pf32W[0])));
+                acc1 = vaddq_f32(acc1, vmulq_f32(vx, vld1q_f32(&pf32W[4])));
+                acc2 = vaddq_f32(acc2, vmulq_f32(vx, vld1q_f32(&pf32W[8])));
+                acc3 = vaddq_f32(acc3, vmulq_f32(vx, vld1q_f32(&pf32W[12])));
+            }
+
+            vst1q_f32(&pf32Out[j], acc0);
+            vst1q_f32(&pf32Out[j + 4], acc1);
+            vst1q_f32(&pf32Out[j + 8], acc2);
+            vst1q_f32(&pf32Out[j + 12], acc3);
+        }
+        for (; j < u32Width; j += 4)
+        {
+            const float *pf32W = &pf32Weights[j];
+            float32x4_t acc = vld1q_f32(&pf32Out[j]);
+
+            for (uint32_t i = 0; i < u32Inputs; i++, pf32W += u32Width)
+            {
+                acc = vaddq_f32(acc, vmulq_f32(vdupq_n_f32(pf32In[i]), vld1q_f32(pf32W)));
+            }
+
+            vst1q_f32(&pf32Out[j], acc);
+        }
+#endif
+        for (; j < u32Width; j++)
+        {
+            const float *pf32W = &pf32Weights[j];
+            float f32Acc = pf32Out[j];
+
+            for (uint32_t i = 0; i < u32Inputs; i++, pf32W += u32Width)
+            {
+                f32Acc = f32Acc + pf32In[i] * pf32W[0];
+            }
+
+            pf32Out[j] = f32Acc;
+        }
+    }
+
+    static size_t Layout(uint32_t u32Frames, uint32_t u32Features, uint32_t u32Hidden, uint32_t u32Outputs, uint8_t *pBase, CKwsScorer *pScorer)
+    {
+        size_t   cb = 0;
+        uint32_t u32Padded = KWSSCORER_PADDED(u32Outputs);
+        size_t   cInputs = (size_t)u32Frames * u32Features;
+
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * cInputs * u32Hidden, pScorer ? (void**)&pScorer->m_pf32HiddenWeights : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * u32Hidden, pScorer ? (void**)&pScorer->m_pf32HiddenBias : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * u32Hidden * u32Padded, pScorer ? (void**)&pScorer->m_pf32OutputWeights : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * u32Padded, pScorer ? (void**)&pScorer->m_pf32OutputBias : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * 2 * cInputs, pScorer ? (void**)&pScorer->m_pf32History : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * u32Hidden, pScorer ? (void**)&pScorer->m_pf32Hidden : NULL);
+        cb = CApoFft::Carve(pBase, cb, sizeof(float) * u32Padded, pScorer ? (void**)&pScorer->m_pf32Scores : NULL);
+
+        return cb;
+    }
+
+private:
+    uint32_t    m_u32Frames;            // T
+    uint32_t    m_u32Features;          // D
+    uint32_t    m_u32Hidden;            // H
+    uint32_t    m_u32Outputs;           // N
+    uint32_t    m_u32FramesPushed;
+    uint32_t    m_u32Position;          // oldest frame of the window
+
+    float      *m_pf32HiddenWeights;    // [T * D][H]
+    float      *m_pf32HiddenBias;       // [H]
+    float      *m_pf32OutputWeights;    // [H][N4]
+    float      *m_pf32OutputBias;       // [N4]
+    float      *m_pf32History;          // [2 * T][D]
+    float      *m_pf32Hidden;           // [H]
+    float      *m_pf32Scores;           // [N4]
+};
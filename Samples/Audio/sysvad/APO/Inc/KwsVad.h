@@ -0,0 +1,355 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    KwsVad.h
+//
+// Abstract:    First-stage voice detector for the keyword path.
+//
+//              Runs on every 10 ms keyword packet, after the feature front
+//              end, and decides cheaply whether the second stage (the
+//              keyword model) is worth waking. Three measurements are made
+//              per packet:
+//
+//              - energy above a tracked noise floor (dB),
+//              - zero-crossing rate, which rejects broadband hiss,
+//              - spectral flux of the log-mel frame, which catches onsets
+//                that are quiet but not stationary.
+//
+//              CKwsVad makes the measurements once per packet; each armed
+//              keyword has a CKwsVadTrigger with its own thresholds and
+//              hysteresis. Energy and zero crossings have SSE2 (x64) and NEON
+//              (ARM64) paths that match the portable loop exactly.
+//
+//              Depends only on the C runtime. Driver callers must save the
+//              floating point state around Measure and Process.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "ApoDsp.h"
+#include "KwsFeatures.h"
+
+// Defaults of the thresholds, used for fields left at zero
+#define KWSVAD_DEFAULT_ENERGY_DB        12      // above the noise floor
+#define KWSVAD_DEFAULT_FLUX_TENTHS      8       // 0.8 log units per band
+#define KWSVAD_DEFAULT_ONSET_PACKETS    5       // 50 ms of activity to trigger
+#define KWSVAD_DEFAULT_HANGOVER_PACKETS 20      // 200 ms of inactivity to re-arm
+
+// Above this crossing rate a packet is treated as hiss unless its flux is high
+#define KWSVAD_MAX_SPEECH_ZCR           0.45f
+
+// Noise floor tracking: follows drops quickly and rises over a few seconds
+#define KWSVAD_NOISE_FALL               0.5f
+#define KWSVAD_NOISE_RISE               0.002f
+#define KWSVAD_SILENCE_DB               (-100.0f)
+
+//
+// Thresholds of one trigger. A field of zero selects its default.
+//
+typedef struct
+{
+    uint8_t     EnergyDb;           // energy above the noise floor, dB
+    uint8_t     FluxTenths;         // mean positive log-mel change, tenths
+    uint8_t     OnsetPackets;       // consecutive active packets to trigger
+    uint8_t     HangoverPackets;    // consecutive inactive packets to re-arm
+} KWSVAD_THRESHOLDS;
+
+//
+// Unpacks the thresholds from detector configuration data: one byte per
+// field, EnergyDb in the low byte.
+//
+inline KWSVAD_THRESHOLDS KwsVad_UnpackThresholds(uint64_t u64Data)
+{
+    KWSVAD_THRESHOLDS thresholds;
+
+    thresholds.EnergyDb = (uint8_t)(u64Data & 0xFF);
+    thresholds.FluxTenths = (uint8_t)((u64Data >> 8) & 0xFF);
+    thresholds.OnsetPackets = (uint8_t)((u64Data >> 16) & 0xFF);
+    thresholds.HangoverPackets = (uint8_t)((u64Data >> 24) & 0xFF);
+
+    return thresholds;
+}
+
+//
+// Measurements of one packet.
+//
+typedef struct
+{
+    float   SnrDb;                  // energy above the noise floor
+    float   ZeroCrossingRate;       // crossings per sample, 0 to 1
+    float   Flux;                   // mean positive log-mel change per band
+} KWSVAD_MEASUREMENT;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Sum of squares of u32Count samples and the number of sign changes
+//  between consecutive samples, starting with i16Previous, the sample
+//  before the first one.
+//
+inline void KwsVad_EnergyAndCrossings(
+    const int16_t *pi16Samples,
+    uint32_t u32Count,
+    int16_t i16Previous,
+    uint64_t *pu64Energy,
+    uint32_t *pu32Crossings )
+{
+    uint64_t u64Energy = 0;
+    uint32_t u32Crossings = 0;
+    uint32_t n = 0;
+
+    if (u32Count == 0)
+    {
+        *pu64Energy = 0;
+        *pu32Crossings = 0;
+        return;
+    }
+
+    // the pair across the packet boundary
+    u64Energy += (uint64_t)((int32_t)pi16Samples[0] * pi16Samples[0]);
+    u32Crossings += ((pi16Samples[0] ^ i16Previous) < 0) ? 1 : 0;
+    n = 1;
+
+#if defined(APODSP_SSE2)
+    {
+        __m128i vEnergy = _mm_setzero_si128();
+        __m128i vCrossings = _mm_setzero_si128();
+        __m128i vZero = _mm_setzero_si128();
+
+        for (; n + 8 <= u32Count; n += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)&pi16Samples[n]);
+            __m128i p = _mm_loadu_si128((const __m128i*)&pi16Samples[n - 1]);
+
+            // A lane of madd reaches 2^31 only for two -32768 samples, so it
+            // is widened as unsigned.
+            __m128i sq = _mm_madd_epi16(v, v);
+            vEnergy = _mm_add_epi64(vEnergy, _mm_unpacklo_epi32(sq, vZero));
+            vEnergy = _mm_add_epi64(vEnergy, _mm_unpackhi_epi32(sq, vZero));
+
+            // -1 where the signs differ; at most 2^15 / 8 iterations per lane
+            vCrossings = _mm_sub_epi16(vCrossings, _mm_srai_epi16(_mm_xor_si128(v, p), 15));
+        }
+
+        uint64_t au64Energy[2];
+        int16_t  ai16Crossings[8];
+        _mm_storeu_si128((__m128i*)au64Energy, vEnergy);
+        _mm_storeu_si128((__m128i*)ai16Crossings, vCrossings);
+
+        u64Energy += au64Energy[0] + au64Energy[1];
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            u32Crossings += (uint16_t)ai16Crossings[i];
+        }
+    }
+#elif defined(APODSP_NEON)
+    {
+        int64x2_t vEnergy = vdupq_n_s64(0);
+        int16x8_t vCrossings = vdupq_n_s16(0);
+
+        for (; n + 8 <= u32Count; n += 8)
+        {
+            int16x8_t v = vld1q_s16(&pi16Samples[n]);
+            int16x8_t p = vld1q_s16(&pi16Samples[n - 1]);
+
+            vEnergy = vpadalq_s32(vEnergy, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+            vEnergy = vpadalq_s32(vEnergy, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+
+            vCrossings = vsubq_s16(vCrossings, vshrq_n_s16(veorq_s16(v, p), 15));
+        }
+
+        u64Energy += (uint64_t)vaddvq_s64(vEnergy);
+        u32Crossings += (uint32_t)vaddlvq_u16(vreinterpretq_u16_s16(vCrossings));
+    }
+#endif
+
+    for (; n < u32Count; n++)
+    {
+        u64Energy += (uint64_t)((int32_t)pi16Samples[n] * pi16Samples[n]);
+        u32Crossings += ((pi16Samples[n] ^ pi16Samples[n - 1]) < 0) ? 1 : 0;
+    }
+
+    *pu64Energy = u64Energy;
+    *pu32Crossings = u32Crossings;
+}
+
+//
+// Per-packet measurements, shared by all the triggers of a stream.
+//
+class CKwsVad
+{
+public:
+    CKwsVad()
+    {
+        Reset();
+    }
+
+    //
+    // Forgets the noise floor and the previous packet.
+    //
+    void Reset()
+    {
+        m_fValid = false;
+        m_fHavePreviousFrame = false;
+        m_i16PreviousSample = 0;
+        m_f32NoiseDb = KWSVAD_SILENCE_DB;
+        memset(m_af32PreviousLogMel, 0, sizeof(m_af32PreviousLogMel));
+    }
+
+    //
+    // Measures one packet of KWSFEATURES_HOP_SAMPLES samples. pFrame holds
+    // the features of the same packet, or is NULL when the front end is not
+    // running, in which case the flux is zero.
+    //
+    void Measure(const int16_t *pi16Samples, const KWSFEATURES_FRAME *pFrame, KWSVAD_MEASUREMENT *pMeasurement)
+    {
+        uint64_t u64Energy;
+        uint32_t u32Crossings;
+
+        KwsVad_EnergyAndCrossings(pi16Samples, KWSFEATURES_HOP_SAMPLES, m_i16PreviousSample, &u64Energy, &u32Crossings);
+        m_i16PreviousSample = pi16Samples[KWSFEATURES_HOP_SAMPLES - 1];
+
+        // mean power relative to full scale
+        double dPower = (double)u64Energy / ((double)KWSFEATURES_HOP_SAMPLES * 32768.0 * 32768.0);
+        float  f32EnergyDb = (dPower > 1e-10) ? (float)(10.0 * log10(dPower)) : KWSVAD_SILENCE_DB;
+
+        if (!m_fValid)
+        {
+            m_f32NoiseDb = f32EnergyDb;
+            m_fValid = true;
+        }
+        else if (f32EnergyDb < m_f32NoiseDb)
+        {
+            m_f32NoiseDb += KWSVAD_NOISE_FALL * (f32EnergyDb - m_f32NoiseDb);
+        }
+        else
+        {
+            m_f32NoiseDb += KWSVAD_NOISE_RISE * (f32EnergyDb - m_f32NoiseDb);
+        }
+
+        pMeasurement->SnrDb = f32EnergyDb - m_f32NoiseDb;
+        pMeasurement->ZeroCrossingRate = (float)u32Crossings * (1.0f / KWSFEATURES_HOP_SAMPLES);
+        pMeasurement->Flux = 0.0f;
+
+        if (pFrame != NULL)
+        {
+            if (m_fHavePreviousFrame)
+            {
+                float f32Flux = 0.0f;
+                for (uint32_t b = 0; b < KWSFEATURES_MEL_BANDS; b++)
+                {
+                    float f32Delta = pFrame->LogMel[b] - m_af32PreviousLogMel[b];
+                    f32Flux += (f32Delta > 0.0f) ? f32Delta : 0.0f;
+                }
+                pMeasurement->Flux = f32Flux * (1.0f / KWSFEATURES_MEL_BANDS);
+            }
+            memcpy(m_af32PreviousLogMel, pFrame->LogMel, sizeof(m_af32PreviousLogMel));
+            m_fHavePreviousFrame = true;
+        }
+        else
+        {
+            m_fHavePreviousFrame = false;
+        }
+    }
+
+private:
+    bool        m_fValid;
+    bool        m_fHavePreviousFrame;
+    int16_t     m_i16PreviousSample;
+    float       m_f32NoiseDb;
+    float       m_af32PreviousLogMel[KWSFEATURES_MEL_BANDS];
+};
+
+//
+// Decision with hysteresis for one keyword: triggers after OnsetPackets
+// consecutive active packets and does not trigger again until
+// HangoverPackets consecutive inactive packets have been seen.
+//
+class CKwsVadTrigger
+{
+public:
+    CKwsVadTrigger()
+    {
+        KWSVAD_THRESHOLDS thresholds = { 0, 0, 0, 0 };
+        Configure(thresholds);
+    }
+
+    void Configure(const KWSVAD_THRESHOLDS &thresholds)
+    {
+        m_u32EnergyDb = thresholds.EnergyDb ? thresholds.EnergyDb : KWSVAD_DEFAULT_ENERGY_DB;
+        m_u32FluxTenths = thresholds.FluxTenths ? thresholds.FluxTenths : KWSVAD_DEFAULT_FLUX_TENTHS;
+        m_u32OnsetPackets = thresholds.OnsetPackets ? thresholds.OnsetPackets : KWSVAD_DEFAULT_ONSET_PACKETS;
+        m_u32HangoverPackets = thresholds.HangoverPackets ? thresholds.HangoverPackets : KWSVAD_DEFAULT_HANGOVER_PACKETS;
+        Reset();
+    }
+
+    void Reset()
+    {
+        m_fActive = false;
+        m_u32ActiveRun = 0;
+        m_u32InactiveRun = 0;
+    }
+
+    //
+    // Returns true on the packet that completes an onset. The onset started
+    // GetActiveRun() - 1 packets before it.
+    //
+    bool Process(const KWSVAD_MEASUREMENT &measurement)
+    {
+        float f32EnergyDb = (float)m_u32EnergyDb;
+        float f32Flux = m_u32FluxTenths * 0.1f;
+
+        bool fLoud = measurement.SnrDb >= f32EnergyDb && measurement.ZeroCrossingRate <= KWSVAD_MAX_SPEECH_ZCR;
+        bool fOnset = measurement.Flux >= f32Flux && measurement.SnrDb >= 0.5f * f32EnergyDb;
+
+        if (fLoud || fOnset)
+        {
+            m_u32InactiveRun = 0;
+            if (m_u32ActiveRun < UINT32_MAX)
+            {
+                m_u32ActiveRun++;
+            }
+
+            if (!m_fActive && m_u32ActiveRun >= m_u32OnsetPackets)
+            {
+                m_fActive = true;
+                return true;
+            }
+        }
+        else
+        {
+            m_u32ActiveRun = 0;
+            if (m_fActive && ++m_u32InactiveRun >= m_u32HangoverPackets)
+            {
+                m_fActive = false;
+                m_u32InactiveRun = 0;
+            }
+        }
+
+        return false;
+    }
+
+    bool IsActive() const { return m_fActive; }
+    uint32_t GetActiveRun() const { return m_u32ActiveRun; }
+
+private:
+    uint32_t    m_u32EnergyDb;
+    uint32_t    m_u32FluxTenths;
+    uint32_t    m_u32OnsetPackets;
+    uint32_t    m_u32HangoverPackets;
+
+    bool        m_fActive;
+    uint32_t    m_u32ActiveRun;
+    uint32_t    m_u32InactiveRun;
+};
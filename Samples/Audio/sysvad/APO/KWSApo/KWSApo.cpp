@@ -17,6 +17,8 @@
 
 #include <float.h>
 
+#include <ApoDsp.h>
+
 #include "KWSApo.h"
 
 #pragma AVRT_CODE_BEGIN
@@ -37,25 +39,14 @@ void ProcessBuffer(
     UINT32   u32ValidFrameCount,
     INTERLEAVED_AUDIO_FORMAT_INFORMATION *formatInfo)
 {
-    UINT32 totalChannelCount = (formatInfo->PrimaryChannelCount + formatInfo->InterleavedChannelCount);
-
     ASSERT_REALTIME();
     ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32InputFrames) );
     ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
 
-    // loop through samples
-    while (u32ValidFrameCount--)
-    {
-        // copy over the Primary channel data
-        for (UINT32 i = formatInfo->PrimaryChannelStartPosition; i < (formatInfo->PrimaryChannelStartPosition + formatInfo->PrimaryChannelCount); i++)
-        {
-            *pf32OutputFrames = *(pf32InputFrames + i);
-            pf32OutputFrames++;
-        }
-
-        // step forward to the next frame, ignoring interleaved data
-        pf32InputFrames += (totalChannelCount);
-    }
+    ApoDsp_ExtractPrimaryChannels(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount,
+                                  formatInfo->PrimaryChannelStartPosition,
+                                  formatInfo->PrimaryChannelCount,
+                                  formatInfo->PrimaryChannelCount + formatInfo->InterleavedChannelCount);
 }
 
 #pragma AVRT_CODE_END
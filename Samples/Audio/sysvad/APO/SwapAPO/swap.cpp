@@ -17,6 +17,8 @@
 
 #include <float.h>
 
+#include <ApoDsp.h>
+
 #include "SwapAPO.h"
 
 #pragma AVRT_CODE_BEGIN
@@ -50,27 +52,11 @@ void ProcessSwap(
     UINT32   u32ValidFrameCount,
     UINT32   u32SamplesPerFrame )
 {
-    UINT32   u32SampleIndex;
-    FLOAT32  fSwap32;
-
     ASSERT_REALTIME();
     ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32InputFrames) );
     ATLASSERT( IS_VALID_TYPED_WRITE_POINTER(pf32OutputFrames) );
 
-    // loop through samples
-    while (u32ValidFrameCount--)
-    {
-        for (u32SampleIndex=0; u32SampleIndex+1<u32SamplesPerFrame; u32SampleIndex += 2)
-        {
-            // apply swap
-            fSwap32 = *pf32InputFrames;
-            *pf32OutputFrames = *(pf32InputFrames + 1);
-            pf32OutputFrames++;
-            *pf32OutputFrames = fSwap32;
-            pf32OutputFrames++;
-            pf32InputFrames += 2;
-        }
-    }
+    ApoDsp_Swap(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32SamplesPerFrame);
 }
 #pragma AVRT_CODE_END
 
@@ -83,32 +69,10 @@ void ProcessSwapScale(
     UINT32   u32SamplesPerFrame,
     FLOAT32  *pf32Coefficients )
 {
-    UINT32   u32SampleIndex;
-    FLOAT32  fSwap32;
-
     ASSERT_REALTIME();
     ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32InputFrames) );
     ATLASSERT( IS_VALID_TYPED_READ_POINTER(pf32OutputFrames) );
 
-    // loop through samples
-    while (u32ValidFrameCount--)
-    {
-        for (u32SampleIndex=0; u32SampleIndex+1<u32SamplesPerFrame; u32SampleIndex += 2)
-        {
-            // apply swap for each stereo pair and scale
-
-            // save left channel
-            fSwap32 = *pf32InputFrames;
-            // left output equals right input times 1st coefficient
-            *pf32OutputFrames = *(pf32InputFrames + 1) * pf32Coefficients[u32SampleIndex];
-            pf32OutputFrames++;
-            
-            // right output equals left input times 2nd coefficient
-            *pf32OutputFrames = fSwap32  * pf32Coefficients[u32SampleIndex+1];      
-            pf32OutputFrames++;
-
-            pf32InputFrames += 2;
-        }
-    }
+    ApoDsp_SwapScale(pf32OutputFrames, pf32InputFrames, u32ValidFrameCount, u32SamplesPerFrame, pf32Coefficients);
 }
 #pragma AVRT_CODE_END
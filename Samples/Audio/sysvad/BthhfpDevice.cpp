@@ -160,6 +160,8 @@ BthHfpDevice::Init
      //
     m_State = eBthHfpStateInitializing;
     m_Adapter = Adapter;
+    m_ArrivalQpc = KeQueryPerformanceCounter(NULL);
+    m_FirstStreamTraced = FALSE;
 
     // Static config.
     m_WdfIoTarget               = NULL;
@@ -191,10 +193,16 @@ BthHfpDevice::Init
     
     m_nStreams                  = 0;
 
+    // The interface is watched without bypass only for the software codec.
+    m_ScoBypass                 = !g_DisableBthScoBypass;
+    m_ScoHead                   = 0;
+    m_ScoCount                  = 0;
+
     KeInitializeEvent(&m_StreamStatusEvent, NotificationEvent, TRUE);
 
     InitializeListHead(&m_ListEntry);
     KeInitializeSpinLock(&m_Lock);
+    KeInitializeSpinLock(&m_ScoLock);
 
     RtlZeroMemory(&m_SymbolicLinkName, sizeof(m_SymbolicLinkName));
 
@@ -238,6 +246,15 @@ BthHfpDevice::Init
         DPF(D_ERROR, ("Init: WdfCollectionCreate failed: 0x%x", ntStatus)),
         Done);
 
+    //
+    // Volume changes are sent to the SCO bypass device from the control queue.
+    //
+    ntStatus = m_ControlQueue.Init(m_Adapter->GetWdfDevice(), SendBthHfpControl, this);
+    IF_FAILED_ACTION_JUMP(
+        ntStatus,
+        DPF(D_ERROR, ("Init: SidebandControlQueue::Init failed: 0x%x", ntStatus)),
+        Done);
+
     //
     // Open the target interface.
     //
@@ -661,6 +678,11 @@ void
         m_StreamReq = NULL;
     }
 
+    //
+    // Control queue.
+    //
+    m_ControlQueue.Cleanup();
+
     //
     // Notification work-item.
     //
@@ -760,6 +782,12 @@ BthHfpDevice::GetVolume
 
     if (eBthHfpSpeakerDevice == DeviceType)
     {
+        // A volume that is not on the device yet is reported as set.
+        if (m_ControlQueue.GetOutstandingValue(eBthHfpControlSpeakerVolume, 0, pVolume))
+        {
+            goto Done;
+        }
+
         status = GetBthHfpSpeakerVolume(pVolume);
         IF_FAILED_ACTION_JUMP(
             status,
@@ -770,6 +798,11 @@ BthHfpDevice::GetVolume
     }
     else if(eBthHfpMicDevice == DeviceType)
     {
+        if (m_ControlQueue.GetOutstandingValue(eBthHfpControlMicVolume, 0, pVolume))
+        {
+            goto Done;
+        }
+
         status = GetBthHfpMicVolume(pVolume);
         IF_FAILED_ACTION_JUMP(
             status,
@@ -802,12 +835,29 @@ BthHfpDevice::SetVolume
     UNREFERENCED_PARAMETER(Channel);
     DPF_ENTER(("[BthHfpDevice::SetSpeakerVolume]"));
 
+    //
+    // The new volume is reported right away and sent to the device from the
+    // control queue; a burst of changes only sends the latest one. Fall back
+    // to a synchronous set if the queue does not take the value.
+    //
     if (eBthHfpSpeakerDevice == DeviceType)
     {
+        if (NT_SUCCESS(m_ControlQueue.Post(eBthHfpControlSpeakerVolume, 0, Volume)))
+        {
+            InterlockedExchange(&m_SpeakerVolumeLevel, Volume);
+            return STATUS_SUCCESS;
+        }
+
         return SetBthHfpSpeakerVolume(Volume);
     }
     else if(eBthHfpMicDevice == DeviceType)
     {
+        if (NT_SUCCESS(m_ControlQueue.Post(eBthHfpControlMicVolume, 0, Volume)))
+        {
+            InterlockedExchange(&m_MicVolumeLevel, Volume);
+            return STATUS_SUCCESS;
+        }
+
         return SetBthHfpMicVolume(Volume);
     }
     else
@@ -1018,6 +1068,8 @@ BthHfpDevice::StreamStart
     {
         BOOLEAN  streamStart = FALSE;
 
+        ResetScoLoopback();
+
         ntStatus = SetBthHfpStreamOpen();
         if (NT_SUCCESS(ntStatus))
         {
@@ -1044,6 +1096,11 @@ BthHfpDevice::StreamStart
         }
     }
 
+    if (NT_SUCCESS(ntStatus) && !InterlockedExchange(&m_FirstStreamTraced, TRUE))
+    {
+        DPF(D_VERBOSE, ("StreamStart: %wZ first stream started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+    }
+
     return ntStatus;
 }
 
@@ -1071,6 +1128,8 @@ BthHfpDevice::StreamSuspend
 
         StopBthHfpStreamStatusNotification();
 
+        ResetScoLoopback();
+
         m_StreamStatus = STATUS_INVALID_DEVICE_STATE;
     }
 
@@ -1294,10 +1353,141 @@ BthHfpDevice::GetNRECDisableStatus()
     return (BOOL)InterlockedCompareExchange(&m_NRECDisableStatusLong, 0, 0);
 }
 
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOL
+BthHfpDevice::IsEncodingOffloaded(_In_ eDeviceType deviceType)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    DPF_ENTER(("[BthHfpDevice::IsEncodingOffloaded]"));
+
+    return m_ScoBypass;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthHfpDevice::SendPacket
+(
+    _In_        eDeviceType             deviceType,
+    _In_reads_bytes_(Length) const BYTE *Packet,
+    _In_        ULONG                   Length
+)
+{
+    KIRQL       oldIrql;
+    ULONG       slot;
+
+    if (m_ScoBypass || deviceType != eBthHfpSpeakerDevice || Length != HFP_PACKET_BYTES)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    KeAcquireSpinLock(&m_ScoLock, &oldIrql);
+
+    //
+    // SCO has no retransmission: when the mic side falls behind, the
+    // oldest packet is overwritten.
+    //
+    if (m_ScoCount == BTHHFP_SCO_LOOPBACK_PACKETS)
+    {
+        m_ScoHead = (m_ScoHead + 1) % BTHHFP_SCO_LOOPBACK_PACKETS;
+        m_ScoCount--;
+    }
+
+    slot = (m_ScoHead + m_ScoCount) % BTHHFP_SCO_LOOPBACK_PACKETS;
+    RtlCopyMemory(m_ScoPackets[slot], Packet, HFP_PACKET_BYTES);
+    m_ScoCount++;
+
+    KeReleaseSpinLock(&m_ScoLock, oldIrql);
+
+    return STATUS_SUCCESS;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthHfpDevice::ReceivePacket
+(
+    _In_        eDeviceType             deviceType,
+    _Out_writes_bytes_(Length) BYTE     *Packet,
+    _In_        ULONG                   Length
+)
+{
+    NTSTATUS    ntStatus = STATUS_SUCCESS;
+    KIRQL       oldIrql;
+
+    if (m_ScoBypass || deviceType != eBthHfpMicDevice || Length != HFP_PACKET_BYTES)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    KeAcquireSpinLock(&m_ScoLock, &oldIrql);
+
+    //
+    // Nothing arrived for this slot: the packet is lost.
+    //
+    if (m_ScoCount == 0)
+    {
+        ntStatus = STATUS_NO_MORE_ENTRIES;
+    }
+    else
+    {
+        RtlCopyMemory(Packet, m_ScoPackets[m_ScoHead], HFP_PACKET_BYTES);
+        m_ScoHead = (m_ScoHead + 1) % BTHHFP_SCO_LOOPBACK_PACKETS;
+        m_ScoCount--;
+    }
+
+    KeReleaseSpinLock(&m_ScoLock, oldIrql);
+
+    return ntStatus;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+BthHfpDevice::StartPacketTransport
+(
+    _In_        eDeviceType             deviceType,
+    _In_        A2DP_SBC_STAGE          *Stage
+)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(Stage);
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+BthHfpDevice::StopPacketTransport(_In_ eDeviceType deviceType)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(deviceType);
+}
+
 //
 // Helper functions.
 //
 
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthHfpDevice::ResetScoLoopback()
+{
+    KIRQL       oldIrql;
+
+    KeAcquireSpinLock(&m_ScoLock, &oldIrql);
+    m_ScoHead = 0;
+    m_ScoCount = 0;
+    KeReleaseSpinLock(&m_ScoLock, oldIrql);
+}
+
 //=============================================================================
 #pragma code_seg()
 NTSTATUS
@@ -1524,6 +1714,15 @@ WorkItem    - WDF work-item object.
             {
                 LONG oldVolume;
 
+                //
+                // While a set is outstanding the update may predate it;
+                // keep the value that was set.
+                //
+                if (This->m_ControlQueue.GetOutstandingValue(eBthHfpControlSpeakerVolume, 0, &oldVolume))
+                {
+                    break;
+                }
+
                 oldVolume = InterlockedExchange(&This->m_SpeakerVolumeLevel, reqCtx->Buffer.Volume);
                 if (reqCtx->Buffer.Volume != oldVolume)
                 {
@@ -1541,6 +1740,11 @@ WorkItem    - WDF work-item object.
             {
                 LONG oldVolume;
 
+                if (This->m_ControlQueue.GetOutstandingValue(eBthHfpControlMicVolume, 0, &oldVolume))
+                {
+                    break;
+                }
+
                 oldVolume = InterlockedExchange(&This->m_MicVolumeLevel, reqCtx->Buffer.Volume);
                 if (reqCtx->Buffer.Volume != oldVolume)
                 {
@@ -2036,6 +2240,46 @@ Done:
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+BthHfpDevice::SendBthHfpControl
+(
+    _In_ PVOID  Context,
+    _In_ ULONG  Control,
+    _In_ LONG   Channel,
+    _In_ LONG   Value
+)
+/*++
+
+Routine Description:
+
+Control queue callback, sends a queued control value to the Bluetooth
+Hands-Free Profile SCO Bypass device.
+
+--*/
+{
+    PAGED_CODE();
+    DPF_ENTER(("[BthHfpDevice::SendBthHfpControl]"));
+
+    BthHfpDevice  * This = (BthHfpDevice *)Context;
+
+    UNREFERENCED_PARAMETER(Channel);
+
+    switch (Control)
+    {
+    case eBthHfpControlSpeakerVolume:
+        return This->SetBthHfpSpeakerVolume(Value);
+
+    case eBthHfpControlMicVolume:
+        return This->SetBthHfpMicVolume(Value);
+
+    default:
+        ASSERTMSG("Invalid control", FALSE);
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
@@ -2991,6 +3235,8 @@ Asynchronously called to start the audio device.
         DPF(D_ERROR, ("Start: EnableBthHfpConnectionStatusNotification: failed, 0x%x", ntStatus)),
         Done);
 
+    DPF(D_VERBOSE, ("Start: %wZ started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+
     //
     // All done.
     //
@@ -3214,6 +3460,11 @@ pending (volume, connection, etc.).
     ASSERT(state == eBthHfpStateRunning || state == eBthHfpStateFailed);
     UNREFERENCED_VAR(state);
 
+    //
+    // Send the queued volume changes while the target still takes requests.
+    //
+    m_ControlQueue.Stop();
+
     //
     // Stop async notifications.
     //
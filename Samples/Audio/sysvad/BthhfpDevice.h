@@ -4,6 +4,9 @@
 //
 #ifdef SYSVAD_BTH_BYPASS
 
+#include "SidebandControlQueue.h"
+#include "HfpCodec.h"
+
 //=====================================================================
 //
 // CAdapterCommon: Bluetooth Hands-Free Profile SCO Bypass definitions.
@@ -23,6 +26,11 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME
     GetBthHfpWorkItemContext
 )
 
+//
+// SCO packets held by the loopback link, 60 ms.
+//
+#define BTHHFP_SCO_LOOPBACK_PACKETS     8
+
 // start/stop the device
 enum eBthHfpTaskAction
 {
@@ -89,6 +97,13 @@ enum eBthHfpState
     eBthHfpStateFailed          = 5,
 };
 
+// Controls set through the device's control queue.
+enum eBthHfpControl
+{
+    eBthHfpControlSpeakerVolume = 0,
+    eBthHfpControlMicVolume     = 1,
+};
+
 // To support event notification.
 struct BthHfpEventCallback
 {
@@ -110,6 +125,9 @@ private:
     IAdapterCommon        * m_Adapter;
     WDFIOTARGET             m_WdfIoTarget;
 
+    LARGE_INTEGER           m_ArrivalQpc;       // When the interface arrived.
+    LONG                    m_FirstStreamTraced;
+
     LIST_ENTRY              m_ListEntry;
     UNICODE_STRING          m_SymbolicLinkName;
     WCHAR                   m_SpeakerWaveNameBuffer[BTHHFP_INTERFACE_REFSTRING_MAX_LENGTH];
@@ -168,8 +186,21 @@ private:
     WDFCOLLECTION           m_ReqCollection;
     KSPIN_LOCK              m_Lock;
 
+    SidebandControlQueue    m_ControlQueue;
+
     LONG                    m_nStreams; // # of open streams.
 
+    //
+    // Without SCO bypass the SCO packets come through the driver. The
+    // sample has no HCI channel to put them on, so it loops the link
+    // back: packets sent on the speaker stream arrive on the mic stream.
+    //
+    BOOL                    m_ScoBypass;
+    KSPIN_LOCK              m_ScoLock;
+    ULONG                   m_ScoHead;  // oldest packet
+    ULONG                   m_ScoCount;
+    BYTE                    m_ScoPackets[BTHHFP_SCO_LOOPBACK_PACKETS][HFP_PACKET_BYTES];
+
     BthHfpEventCallback     m_SpeakerVolumeCallback;
     BthHfpEventCallback     m_SpeakerMuteCallback;
     BthHfpEventCallback     m_SpeakerConnectionStatusCallback;
@@ -330,6 +361,33 @@ public:
 
     STDMETHODIMP_(BOOL)                 GetNRECDisableStatus();
 
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHODIMP_(BOOL)                 IsEncodingOffloaded(_In_ eDeviceType deviceType);
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHODIMP_(NTSTATUS)             SendPacket
+    (
+        _In_        eDeviceType             deviceType,
+        _In_reads_bytes_(Length) const BYTE *Packet,
+        _In_        ULONG                   Length
+    );
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHODIMP_(NTSTATUS)             ReceivePacket
+    (
+        _In_        eDeviceType             deviceType,
+        _Out_writes_bytes_(Length) BYTE     *Packet,
+        _In_        ULONG                   Length
+    );
+
+    STDMETHODIMP_(NTSTATUS)             StartPacketTransport
+    (
+        _In_        eDeviceType             deviceType,
+        _In_        A2DP_SBC_STAGE          *Stage
+    );
+
+    STDMETHODIMP_(VOID)                 StopPacketTransport(_In_ eDeviceType deviceType);
+
 private:
     //=====================================================================
     //
@@ -398,6 +456,15 @@ private:
 
     NTSTATUS    EnableBthHfpMicVolumeStatusNotification();
 
+    static
+        NTSTATUS    SendBthHfpControl
+        (
+            _In_ PVOID  Context,
+            _In_ ULONG  Control,
+            _In_ LONG   Channel,
+            _In_ LONG   Value
+        );
+
     NTSTATUS    GetBthHfpConnectionStatus
     (
         _Out_ BOOL * ConnectionStatus
@@ -445,6 +512,9 @@ private:
 
     NTSTATUS    StopBthHfpStreamStatusNotification();
 
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    VOID        ResetScoLoopback();
+
     NTSTATUS    CreateFilterNames(
         _In_ PUNICODE_STRING HfpDeviceSymbolicLinkName
     );
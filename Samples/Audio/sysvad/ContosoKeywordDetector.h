@@ -26,12 +26,74 @@ DEFINE_GUID(CONTOSO_KEYWORD2, 0x655e417a, 0x80a5, 0x4a77, 0xb3, 0xf1, 0x51, 0x2e
 //
 // The format of the Contoso keyword pattern matching data.
 //
+// The low 32 bits of ContosoDetectorConfigurationData configure the driver's
+// first-stage voice detector, one byte per field, zero for the default:
+//   bits  0-7   energy above the noise floor, in dB            (default 12)
+//   bits  8-15  spectral flux, in tenths of a log-mel unit     (default 8)
+//   bits 16-23  active 10 ms packets before a detection        (default 5)
+//   bits 24-31  inactive 10 ms packets before re-triggering    (default 20)
+//
 typedef struct
 {
     SOUNDDETECTOR_PATTERNHEADER Header;
     LONGLONG                    ContosoDetectorConfigurationData;
 } CONTOSO_KEYWORDCONFIGURATION;
 
+//
+// The format of a Contoso keyword model, sent with the same pattern type as
+// CONTOSO_KEYWORDCONFIGURATION and told apart by its size.
+//
+// One model scores all its keywords in a single pass over the driver's
+// feature stream: a hidden layer over the last ContextFrames frames of
+// FeatureCount cepstral coefficients is shared by every keyword, and each
+// keyword adds one output. A keyword is detected when its first-stage voice
+// detector (configured by DetectorData as above) is active and its output
+// reaches Threshold.
+//
+// The structure is followed by, packed and in this order:
+//   CONTOSO_KEYWORDMODEL_KEYWORD Keywords[KeywordCount];
+//   float HiddenWeights[ContextFrames * FeatureCount][HiddenCount];
+//   float HiddenBias[HiddenCount];
+//   float OutputWeights[HiddenCount][CONTOSO_KEYWORDMODEL_PADDED(KeywordCount)];
+//   float OutputBias[CONTOSO_KEYWORDMODEL_PADDED(KeywordCount)];
+// Frames are oldest first. The output of keyword k is column k; the padding
+// columns are ignored. Header.Size covers the whole model.
+//
+#define CONTOSO_KEYWORDMODEL_VERSION            1
+#define CONTOSO_KEYWORDMODEL_MAX_KEYWORDS       16
+#define CONTOSO_KEYWORDMODEL_MAX_FRAMES         100     // 1 second of 10 ms frames
+#define CONTOSO_KEYWORDMODEL_FEATURES           13      // MFCC coefficients per frame
+#define CONTOSO_KEYWORDMODEL_MAX_HIDDEN         256     // multiple of 4
+#define CONTOSO_KEYWORDMODEL_PADDED(n)          (((n) + 3) & ~3)
+
+typedef struct
+{
+    GUID                        EventId;
+    LONGLONG                    DetectorData;
+    float                       Threshold;
+    ULONG                       Reserved;
+} CONTOSO_KEYWORDMODEL_KEYWORD;
+
+typedef struct
+{
+    CONTOSO_KEYWORDCONFIGURATION Configuration;         // ContosoDetectorConfigurationData is unused
+    ULONG                       Version;
+    ULONG                       KeywordCount;
+    ULONG                       ContextFrames;
+    ULONG                       FeatureCount;
+    ULONG                       HiddenCount;
+    ULONG                       Reserved;
+} CONTOSO_KEYWORDMODEL;
+
+//
+// Size in bytes of a model with the given dimensions.
+//
+#define CONTOSO_KEYWORDMODEL_SIZE(keywords, frames, features, hidden)                            \
+    (sizeof(CONTOSO_KEYWORDMODEL) +                                                             \
+     (keywords) * sizeof(CONTOSO_KEYWORDMODEL_KEYWORD) +                                        \
+     sizeof(float) * ((ULONGLONG)(frames) * (features) * (hidden) + (hidden) +                  \
+                      ((ULONGLONG)(hidden) + 1) * CONTOSO_KEYWORDMODEL_PADDED(keywords)))
+
 //
 // The format of the Contoso match result data.
 //
@@ -0,0 +1,360 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    A2dpSbcEncoder.h
+
+Abstract:
+
+    SBC encoder stage of the A2DP speaker path, for links without a
+    sideband controller doing the encoding.
+
+    PCM from the render stream is encoded straight into the packets of a
+    single producer, single consumer ring: every slot is a complete AVDTP
+    media packet (RTP header, SBC payload header and as many frames as
+    fit the MTU), so the transport sends it in place and hands the slot
+    back. The bitpool follows a link quality input between the bounds of
+    the SBC configuration.
+
+    The transport drains the ring with A2dpSbcTransmit on its own
+    schedule, as the link has room, and derives the link quality from the
+    packets it leaves waiting.
+
+--*/
+
+#ifndef _SYSVAD_A2DPSBCENCODER_H_
+#define _SYSVAD_A2DPSBCENCODER_H_
+
+#include "SbcCodec.h"
+
+#define A2DP_SBC_PACKET_BYTES           672     // default L2CAP MTU
+#define A2DP_SBC_RTP_HEADER_BYTES       12
+#define A2DP_SBC_PAYLOAD_HEADER_BYTES   1
+#define A2DP_SBC_MAX_FRAMES_PER_PACKET  15      // 4 bit frame count
+#define A2DP_SBC_RING_PACKETS           16
+#define A2DP_SBC_RTP_PAYLOAD_TYPE       96      // dynamic
+#define A2DP_SBC_BITPOOL_STEP_UP        2       // per packet, down is immediate
+#define A2DP_SBC_BACKLOG_PACKETS        (A2DP_SBC_RING_PACKETS / 2) // waiting packets at link quality 0
+
+typedef struct _A2DP_SBC_PACKET
+{
+    ULONG       Length;
+    BYTE        Data[A2DP_SBC_PACKET_BYTES];
+} A2DP_SBC_PACKET;
+
+//
+// Head and Tail count the packets committed by the producer and released
+// by the consumer; the slot of a count is count % A2DP_SBC_RING_PACKETS.
+//
+typedef struct _A2DP_SBC_PACKET_RING
+{
+    LONG                Head;
+    LONG                Tail;
+    A2DP_SBC_PACKET     Packets[A2DP_SBC_RING_PACKETS];
+} A2DP_SBC_PACKET_RING;
+
+//
+// The link. Returns FALSE if it cannot take the packet now.
+//
+typedef BOOLEAN (*PFNA2DPSENDPACKET)
+(
+    _In_                        PVOID           Context,
+    _In_reads_bytes_(Length)    const BYTE      *Packet,
+    _In_                        ULONG           Length
+);
+
+typedef struct _A2DP_SBC_STAGE
+{
+    SBC_ENCODER             Encoder;
+    ULONG                   Channels;
+    ULONG                   FrameSamples;       // PCM frames per SBC frame
+    ULONG                   FrameBytes;         // SBC frame size at the current bitpool
+    ULONG                   MinBitpool;
+    ULONG                   MaxBitpool;
+    LONG                    LinkQuality;        // 0 (worst) to 100, set by the transport
+    ULONG                   PcmCount;           // PCM frames waiting in Pcm
+    INT16                   Pcm[SBC_MAX_BLOCKS * SBC_SUBBANDS_8 * SBC_MAX_CHANNELS];
+    A2DP_SBC_PACKET *       Filling;            // ring slot being filled, NULL if none
+    USHORT                  RtpSequence;
+    ULONG                   RtpTimestamp;       // in PCM frames
+    ULONG                   DroppedFrames;      // frames lost to a full ring
+    A2DP_SBC_PACKET_RING    Ring;
+} A2DP_SBC_STAGE;
+
+//
+// Upper bitpool of the A2DP specification's recommended high quality
+// settings (16 blocks, 8 subbands, loudness).
+//
+inline ULONG A2dpSbcHighQualityBitpool(_In_ ULONG SampleRate, _In_ ULONG Channels)
+{
+    if (Channels == 1)
+    {
+        return (SampleRate == 48000) ? 29 : 31;
+    }
+
+    return (SampleRate == 48000) ? 51 : 53;
+}
+
+//
+// Sets the stage up for 44.1 or 48 kHz, 16-bit, mono (mono mode) or
+// stereo (joint stereo mode) PCM, 16 blocks, loudness allocation, with the
+// bitpool kept between MinBitpool and MaxBitpool. Returns FALSE for a PCM
+// format SBC cannot take.
+//
+inline BOOLEAN A2dpSbcInit
+(
+    _Out_   A2DP_SBC_STAGE  *Stage,
+    _In_    ULONG           SampleRate,
+    _In_    ULONG           Channels,
+    _In_    ULONG           MinBitpool,
+    _In_    ULONG           MaxBitpool
+)
+{
+    RtlZeroMemory(Stage, sizeof(*Stage));
+
+    switch (SampleRate)
+    {
+    case 44100:
+        Stage->Encoder.Frequency = SBC_FREQ_44100;
+        break;
+    case 48000:
+        Stage->Encoder.Frequency = SBC_FREQ_48000;
+        break;
+    default:
+        return FALSE;
+    }
+
+    if (Channels != 1 && Channels != 2)
+    {
+        return FALSE;
+    }
+
+    Stage->Encoder.Blocks = SBC_MAX_BLOCKS;
+    Stage->Encoder.ChannelMode = (Channels == 1) ? SBC_CHANNEL_MODE_MONO : SBC_CHANNEL_MODE_JOINT;
+    Stage->Encoder.Allocation = SBC_ALLOCATION_LOUDNESS;
+
+    //
+    // 16 bits per sample at most: a mono frame can't take more than
+    // 16 * subbands, a stereo one 32 * subbands capped at 250.
+    //
+    MaxBitpool = min(MaxBitpool, (Channels == 1) ? SBC_MAX_BITS * SBC_SUBBANDS_8 : SBC_MAX_BITPOOL);
+    MinBitpool = max(min(MinBitpool, MaxBitpool), 2);
+
+    Stage->Channels = Channels;
+    Stage->FrameSamples = Stage->Encoder.Blocks * SBC_SUBBANDS_8;
+    Stage->MinBitpool = MinBitpool;
+    Stage->MaxBitpool = MaxBitpool;
+    Stage->LinkQuality = 100;
+    Stage->Encoder.Bitpool = MaxBitpool;
+    Stage->FrameBytes = SbcFrameLength(&Stage->Encoder);
+
+    return TRUE;
+}
+
+//
+// Link quality input, 0 (worst) to 100 (best). A2dpSbcTransmit reports it
+// from the transport's backlog; a transport that sees the radio can also
+// report retransmissions, flushes or RSSI here.
+//
+inline VOID A2dpSbcSetLinkQuality(_Inout_ A2DP_SBC_STAGE *Stage, _In_ ULONG Quality)
+{
+    InterlockedExchange(&Stage->LinkQuality, (LONG)min(Quality, 100));
+}
+
+//
+// Next packet ready to send, or NULL. The packet stays valid, in place,
+// until A2dpSbcRingRelease.
+//
+inline A2DP_SBC_PACKET * A2dpSbcRingPeek(_In_ A2DP_SBC_PACKET_RING *Ring)
+{
+    LONG head = InterlockedCompareExchange(&Ring->Head, 0, 0);
+    LONG tail = Ring->Tail;
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    return &Ring->Packets[(ULONG)tail % A2DP_SBC_RING_PACKETS];
+}
+
+inline VOID A2dpSbcRingRelease(_Inout_ A2DP_SBC_PACKET_RING *Ring)
+{
+    InterlockedIncrement(&Ring->Tail);
+}
+
+//
+// Transport side: sends the waiting packets in place, oldest first, while
+// they fit in Credit (the bytes the link can take now) and Send takes
+// them. A link that keeps up leaves nothing waiting; the link quality is
+// reported down from 100 by the packets left behind, reaching 0 at
+// A2DP_SBC_BACKLOG_PACKETS. Returns the bytes sent.
+//
+inline ULONG A2dpSbcTransmit
+(
+    _Inout_                 A2DP_SBC_STAGE      *Stage,
+    _In_                    ULONG               Credit,
+    _In_                    PFNA2DPSENDPACKET   Send,
+    _In_                    PVOID               Context
+)
+{
+    A2DP_SBC_PACKET *   packet;
+    ULONG               sent = 0;
+    ULONG               waiting;
+
+    while ((packet = A2dpSbcRingPeek(&Stage->Ring)) != NULL &&
+           packet->Length <= Credit - sent &&
+           Send(Context, packet->Data, packet->Length))
+    {
+        sent += packet->Length;
+        A2dpSbcRingRelease(&Stage->Ring);
+    }
+
+    waiting = (ULONG)(InterlockedCompareExchange(&Stage->Ring.Head, 0, 0) - Stage->Ring.Tail);
+    waiting = min(waiting, A2DP_SBC_BACKLOG_PACKETS);
+
+    A2dpSbcSetLinkQuality(Stage, 100 - waiting * 100 / A2DP_SBC_BACKLOG_PACKETS);
+
+    return sent;
+}
+
+//
+// Bitpool for the next packet: the link quality mapped onto the bitpool
+// range. It drops at once when the link degrades and climbs back slowly
+// so the quality does not pump with every report.
+//
+inline ULONG A2dpSbcAdaptBitpool(_Inout_ A2DP_SBC_STAGE *Stage)
+{
+    ULONG quality = (ULONG)InterlockedCompareExchange(&Stage->LinkQuality, 0, 0);
+    ULONG target = Stage->MinBitpool + (Stage->MaxBitpool - Stage->MinBitpool) * quality / 100;
+    ULONG bitpool = Stage->Encoder.Bitpool;
+
+    if (target < bitpool)
+    {
+        bitpool = target;
+    }
+    else
+    {
+        bitpool = min(bitpool + A2DP_SBC_BITPOOL_STEP_UP, target);
+    }
+
+    if (bitpool != Stage->Encoder.Bitpool)
+    {
+        Stage->Encoder.Bitpool = bitpool;
+        Stage->FrameBytes = SbcFrameLength(&Stage->Encoder);
+    }
+
+    return bitpool;
+}
+
+//
+// Claims the next ring slot and writes its RTP and SBC payload headers.
+// Returns FALSE if the transport has not released any slot.
+//
+inline BOOLEAN A2dpSbcStartPacket(_Inout_ A2DP_SBC_STAGE *Stage)
+{
+    A2DP_SBC_PACKET_RING *  ring = &Stage->Ring;
+    LONG                    head = ring->Head;
+    BYTE *                  data;
+
+    if (head - InterlockedCompareExchange(&ring->Tail, 0, 0) >= A2DP_SBC_RING_PACKETS)
+    {
+        return FALSE;
+    }
+
+    A2dpSbcAdaptBitpool(Stage);
+
+    Stage->Filling = &ring->Packets[(ULONG)head % A2DP_SBC_RING_PACKETS];
+    data = Stage->Filling->Data;
+
+    // RTP: version 2, no padding/extension/CSRC, no marker.
+    data[0] = 0x80;
+    data[1] = A2DP_SBC_RTP_PAYLOAD_TYPE;
+    data[2] = (BYTE)(Stage->RtpSequence >> 8);
+    data[3] = (BYTE)(Stage->RtpSequence);
+    data[4] = (BYTE)(Stage->RtpTimestamp >> 24);
+    data[5] = (BYTE)(Stage->RtpTimestamp >> 16);
+    data[6] = (BYTE)(Stage->RtpTimestamp >> 8);
+    data[7] = (BYTE)(Stage->RtpTimestamp);
+    data[8] = 0;
+    data[9] = 0;
+    data[10] = 0;
+    data[11] = 1;                               // SSRC
+
+    // SBC payload header: not fragmented, frame count filled in as frames are added.
+    data[A2DP_SBC_RTP_HEADER_BYTES] = 0;
+
+    Stage->Filling->Length = A2DP_SBC_RTP_HEADER_BYTES + A2DP_SBC_PAYLOAD_HEADER_BYTES;
+    Stage->RtpSequence++;
+
+    return TRUE;
+}
+
+inline VOID A2dpSbcCommitPacket(_Inout_ A2DP_SBC_STAGE *Stage)
+{
+    Stage->Filling = NULL;
+    InterlockedIncrement(&Stage->Ring.Head);
+}
+
+//
+// Encodes the buffered PCM frame into the packet being filled, and sends
+// the packet to the ring when the next frame would not fit.
+//
+inline VOID A2dpSbcEncodeFrame(_Inout_ A2DP_SBC_STAGE *Stage)
+{
+    A2DP_SBC_PACKET *   packet;
+    BYTE *              frameCount;
+
+    if (Stage->Filling == NULL && !A2dpSbcStartPacket(Stage))
+    {
+        Stage->DroppedFrames++;
+        Stage->RtpTimestamp += Stage->FrameSamples;
+        return;
+    }
+
+    packet = Stage->Filling;
+    frameCount = &packet->Data[A2DP_SBC_RTP_HEADER_BYTES];
+
+    packet->Length += SbcEncodeFrame(&Stage->Encoder, Stage->Pcm, &packet->Data[packet->Length]);
+    (*frameCount)++;
+    Stage->RtpTimestamp += Stage->FrameSamples;
+
+    if (*frameCount == A2DP_SBC_MAX_FRAMES_PER_PACKET ||
+        packet->Length + Stage->FrameBytes > A2DP_SBC_PACKET_BYTES)
+    {
+        A2dpSbcCommitPacket(Stage);
+    }
+}
+
+//
+// Takes ByteCount bytes of the stream's 16-bit PCM.
+//
+inline VOID A2dpSbcProcess
+(
+    _Inout_                     A2DP_SBC_STAGE  *Stage,
+    _In_reads_bytes_(ByteCount) const BYTE      *Data,
+    _In_                        ULONG           ByteCount
+)
+{
+    ULONG frameBytes = Stage->Channels * sizeof(INT16);
+
+    while (ByteCount >= frameBytes)
+    {
+        ULONG count = min(ByteCount / frameBytes, Stage->FrameSamples - Stage->PcmCount);
+
+        RtlCopyMemory(&Stage->Pcm[Stage->PcmCount * Stage->Channels], Data, count * frameBytes);
+        Stage->PcmCount += count;
+        Data += count * frameBytes;
+        ByteCount -= count * frameBytes;
+
+        if (Stage->PcmCount == Stage->FrameSamples)
+        {
+            A2dpSbcEncodeFrame(Stage);
+            Stage->PcmCount = 0;
+        }
+    }
+}
+
+#endif // _SYSVAD_A2DPSBCENCODER_H_
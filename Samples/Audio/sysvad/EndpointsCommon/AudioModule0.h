@@ -56,7 +56,7 @@ typedef struct _AUDIOMODULE0_CONTEXT {
     BYTE                        Parameter2;
     ULONG                       InstanceId;
     AUDIOMODULE0_NOTIFICATION   Notification;  
-    PPORTCLSNOTIFICATIONS       PortNotifications;
+    PAUDIOMODULE_NOTIFIER       Notifier;
 } AUDIOMODULE0_CONTEXT, *PAUDIOMODULE0_CONTEXT;
 
 static
@@ -94,7 +94,7 @@ AudioModule0_InitClass(
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
     _In_        KSAUDIOMODULE_NOTIFICATION * NotificationHeader,
-    _In_opt_    PPORTCLSNOTIFICATIONS PortNotifications
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
     )
 {
     PAUDIOMODULE0_CONTEXT ctx = (PAUDIOMODULE0_CONTEXT)Context;
@@ -113,11 +113,7 @@ AudioModule0_InitClass(
     RtlZeroMemory(Context, Size);
 
     ctx->Notification.Header = *NotificationHeader;
-    ctx->PortNotifications = PortNotifications;
-    if (ctx->PortNotifications != NULL)
-    {
-        ctx->PortNotifications->AddRef();
-    }
+    ctx->Notifier = Notifier;
     
     return STATUS_SUCCESS;
 }
@@ -130,7 +126,8 @@ AudioModule0_InitInstance(
     _In_opt_    PVOID           TemplateContext,
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
-    _In_        ULONG           InstanceId
+    _In_        ULONG           InstanceId,
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
     )
 {
     PAUDIOMODULE0_CONTEXT ctx = (PAUDIOMODULE0_CONTEXT)Context;
@@ -152,10 +149,7 @@ AudioModule0_InitInstance(
     
     ctx->InstanceId = InstanceId;
     ctx->Notification.Header.ProviderId.InstanceId = InstanceId;
-    if (ctx->PortNotifications != NULL)
-    {
-        ctx->PortNotifications->AddRef();
-    }
+    ctx->Notifier = Notifier;
     
     return STATUS_SUCCESS;
 }
@@ -177,7 +171,8 @@ AudioModule0_Cleanup(
         return;
     }
     
-    SAFE_RELEASE(ctx->PortNotifications);
+    // The notifier is owned by the module list.
+    ctx->Notifier = NULL;
 }
 
 inline
@@ -272,7 +267,7 @@ AudioModule0_Handler(
         goto exit;
     }
     
-    if (fNewValue && ctx->PortNotifications &&
+    if (fNewValue && ctx->Notifier &&
         (parameterInfo->Flags & AUDIOMODULE_PARAMETER_FLAG_CHANGE_NOTIFICATION))
     {
         // This logic assumes that access to this function is serialized.
@@ -280,9 +275,10 @@ AudioModule0_Handler(
         ctx->Notification.CustomNotification.ParameterChanged.ParameterId = 
             command->ParameterId;
 
-        AudioModule_SendNotification(ctx->PortNotifications,
-                                     (PVOID)&ctx->Notification,
-                                     (USHORT)sizeof(ctx->Notification));
+        AudioModule_QueueNotification(ctx->Notifier,
+                                      command->ParameterId,
+                                      (PVOID)&ctx->Notification,
+                                      (USHORT)sizeof(ctx->Notification));
     }
 
     // Normalize error code.
@@ -58,7 +58,7 @@ typedef struct _AUDIOMODULE1_CONTEXT {
     DWORD                       Parameter3;
     ULONG                       InstanceId;
     AUDIOMODULE1_NOTIFICATION   Notification;  
-    PPORTCLSNOTIFICATIONS       PortNotifications;
+    PAUDIOMODULE_NOTIFIER       Notifier;
 } AUDIOMODULE1_CONTEXT, *PAUDIOMODULE1_CONTEXT;
 
 static
@@ -104,7 +104,7 @@ AudioModule1_InitClass(
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
     _In_        KSAUDIOMODULE_NOTIFICATION * NotificationHeader,
-    _In_opt_    PPORTCLSNOTIFICATIONS PortNotifications
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
     )
 {
     PAUDIOMODULE1_CONTEXT ctx = (PAUDIOMODULE1_CONTEXT)Context;
@@ -123,11 +123,7 @@ AudioModule1_InitClass(
     RtlZeroMemory(Context, Size);
     
     ctx->Notification.Header = *NotificationHeader;
-    ctx->PortNotifications = PortNotifications;
-    if (ctx->PortNotifications != NULL)
-    {
-        ctx->PortNotifications->AddRef();
-    }
+    ctx->Notifier = Notifier;
         
     return STATUS_SUCCESS;
 }
@@ -140,7 +136,8 @@ AudioModule1_InitInstance(
     _In_opt_    PVOID           TemplateContext,
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
-    _In_        ULONG           InstanceId
+    _In_        ULONG           InstanceId,
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
     )
 {
     PAUDIOMODULE1_CONTEXT ctx = (PAUDIOMODULE1_CONTEXT)Context;
@@ -162,10 +159,7 @@ AudioModule1_InitInstance(
     
     ctx->InstanceId = InstanceId;
     ctx->Notification.Header.ProviderId.InstanceId = InstanceId;
-    if (ctx->PortNotifications != NULL)
-    {
-        ctx->PortNotifications->AddRef();
-    }
+    ctx->Notifier = Notifier;
     
     return STATUS_SUCCESS;
 }
@@ -187,7 +181,8 @@ AudioModule1_Cleanup(
         return;
     }
     
-    SAFE_RELEASE(ctx->PortNotifications);
+    // The notifier is owned by the module list.
+    ctx->Notifier = NULL;
 }
 
 inline
@@ -287,7 +282,7 @@ AudioModule1_Handler(
         goto exit;
     }
     
-    if (fNewValue && ctx->PortNotifications &&
+    if (fNewValue && ctx->Notifier &&
         (parameterInfo->Flags & AUDIOMODULE_PARAMETER_FLAG_CHANGE_NOTIFICATION))
     {
         // This logic assumes that access to this function is serialized.
@@ -295,9 +290,10 @@ AudioModule1_Handler(
         ctx->Notification.CustomNotification.ParameterChanged.ParameterId = 
             command->ParameterId;
 
-        AudioModule_SendNotification(ctx->PortNotifications,
-                                     (PVOID)&ctx->Notification,
-                                     (USHORT)sizeof(ctx->Notification));
+        AudioModule_QueueNotification(ctx->Notifier,
+                                      command->ParameterId,
+                                      (PVOID)&ctx->Notification,
+                                      (USHORT)sizeof(ctx->Notification));
     }
 
     // Normalize error code.
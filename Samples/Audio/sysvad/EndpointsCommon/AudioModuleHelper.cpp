@@ -259,6 +259,137 @@ AudioModule_FindModuleInList(
     return NULL;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+static
+ULONG
+AudioModule_HashId(
+    _In_ const GUID *           ClassId,
+    _In_ ULONG                  InstanceId
+    )
+{
+    PAGED_CODE();
+
+    const ULONG *   id = (const ULONG *)ClassId;
+    ULONG           hash = id[0] ^ id[1] ^ id[2] ^ id[3] ^ (InstanceId * 0x9E3779B1);
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+AudioModule_InitIndex(
+    _Out_ AUDIOMODULE_INDEX *   AudioModuleIndex,
+    _In_reads_opt_(AudioModuleCount) AUDIOMODULE * AudioModules,
+    _In_ ULONG                  AudioModuleCount
+    )
+{
+    ULONG   cSlots = 8;
+
+    PAGED_CODE();
+
+    KeInitializeMutex(&AudioModuleIndex->Lock, 1);
+    AudioModuleIndex->SlotMask = 0;
+    AudioModuleIndex->Slots = NULL;
+
+    //
+    // Lists too long for the slots to address are left unindexed and
+    // looked up with a scan.
+    //
+    if (AudioModules == NULL || AudioModuleCount == 0 || AudioModuleCount >= MAXUSHORT / 2)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // Keep at least half of the slots empty, so that probes stay short.
+    while (cSlots < 2 * AudioModuleCount)
+    {
+        cSlots <<= 1;
+    }
+
+    AudioModuleIndex->Slots = (PUSHORT)ExAllocatePool2(POOL_FLAG_PAGED, cSlots * sizeof(USHORT), AUDIOMODULE_POOLTAG);
+    if (AudioModuleIndex->Slots == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    AudioModuleIndex->SlotMask = cSlots - 1;
+
+    for (ULONG i = 0; i < AudioModuleCount; ++i)
+    {
+        ULONG iSlot = AudioModule_HashId(AudioModules[i].Descriptor->ClassId, AudioModules[i].InstanceId);
+
+        while (AudioModuleIndex->Slots[iSlot & AudioModuleIndex->SlotMask] != 0)
+        {
+            iSlot++;
+        }
+
+        AudioModuleIndex->Slots[iSlot & AudioModuleIndex->SlotMask] = (USHORT)(i + 1);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+AudioModule_CleanupIndex(
+    _Inout_ AUDIOMODULE_INDEX * AudioModuleIndex
+    )
+{
+    PAGED_CODE();
+
+    if (AudioModuleIndex->Slots != NULL)
+    {
+        ExFreePoolWithTag(AudioModuleIndex->Slots, AUDIOMODULE_POOLTAG);
+        AudioModuleIndex->Slots = NULL;
+    }
+
+    AudioModuleIndex->SlotMask = 0;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+AUDIOMODULE *
+AudioModule_FindModuleInIndex(
+    _In_ AUDIOMODULE_INDEX *    AudioModuleIndex,
+    _In_ AUDIOMODULE *          AudioModules,
+    _In_ ULONG                  AudioModuleCount,
+    _In_ GUID *                 ClassId,
+    _In_ ULONG                  InstanceId
+    )
+{
+    PAGED_CODE();
+
+    if (AudioModuleIndex->Slots == NULL)
+    {
+        return AudioModule_FindModuleInList(AudioModules, AudioModuleCount, ClassId, InstanceId);
+    }
+
+    for (ULONG iSlot = AudioModule_HashId(ClassId, InstanceId); ; iSlot++)
+    {
+        USHORT iModule = AudioModuleIndex->Slots[iSlot & AudioModuleIndex->SlotMask];
+
+        if (iModule == 0)
+        {
+            return NULL;
+        }
+
+        AUDIOMODULE * module = &AudioModules[iModule - 1];
+
+        if (module->InstanceId == InstanceId &&
+            IsEqualGUIDAligned(*(module->Descriptor->ClassId), *ClassId))
+        {
+            return module;
+        }
+    }
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
@@ -444,16 +575,227 @@ AudioModule_GenericHandler_ModulesListRequest(
     return STATUS_INVALID_DEVICE_REQUEST;
 } // AudioModule_GenericHandler_ModulesListRequest
 
+//=============================================================================
+#pragma code_seg("PAGE")
+static
+NTSTATUS
+AudioModule_GenericHandler_ModuleBatchCommand(
+    _In_ PPCPROPERTY_REQUEST                PropertyRequest,
+    _In_ AUDIOMODULE *                      AudioModules,
+    _In_ ULONG                              AudioModuleCount,
+    _In_opt_ AUDIOMODULE_INDEX *            AudioModuleIndex,
+    _In_reads_bytes_opt_(BatchCb) PVOID     Batch,
+    _In_ ULONG                              BatchCb
+    )
+{
+    NTSTATUS                            status = STATUS_SUCCESS;
+    PSYSVAD_AUDIOMODULE_BATCH_HEADER    header = (PSYSVAD_AUDIOMODULE_BATCH_HEADER)Batch;
+    BYTE *                              command = NULL;
+    BYTE *                              result = NULL;
+    BYTE *                              snapshot = NULL;
+    BYTE *                              context = NULL;
+    ULONG                               remainingCb = 0;
+    ULONG                               cbMinSize = 0;
+    ULONG                               cbSnapshot = 0;
+    ULONG                               i = 0;
+
+    PAGED_CODE();
+
+    DPF_ENTER(("[AudioModule_GenericHandler_ModuleBatchCommand]"));
+
+    if (Batch == NULL ||
+        BatchCb < sizeof(SYSVAD_AUDIOMODULE_BATCH_HEADER) ||
+        header->Count == 0 ||
+        header->Count > SYSVAD_AUDIOMODULE_BATCH_MAX_COMMANDS)
+    {
+        status = STATUS_INVALID_PARAMETER;
+        goto exit;
+    }
+
+    //
+    // Validate all the commands, and size the results, before running any.
+    //
+    command = (BYTE *)(header + 1);
+    remainingCb = BatchCb - sizeof(SYSVAD_AUDIOMODULE_BATCH_HEADER);
+
+    for (i = 0; i < header->Count; ++i)
+    {
+        PSYSVAD_AUDIOMODULE_BATCH_COMMAND   entry = (PSYSVAD_AUDIOMODULE_BATCH_COMMAND)command;
+        AUDIOMODULE *                       module = NULL;
+        ULONG                               entryCb = 0;
+
+        if (remainingCb < sizeof(SYSVAD_AUDIOMODULE_BATCH_COMMAND) ||
+            entry->CommandSize > remainingCb - sizeof(SYSVAD_AUDIOMODULE_BATCH_COMMAND) ||
+            entry->ValueSize > MAXULONG / 2)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        if (AudioModuleIndex != NULL)
+        {
+            module = AudioModule_FindModuleInIndex(AudioModuleIndex, AudioModules, AudioModuleCount, &entry->ClassId, entry->InstanceId);
+        }
+        else
+        {
+            module = AudioModule_FindModuleInList(AudioModules, AudioModuleCount, &entry->ClassId, entry->InstanceId);
+        }
+
+        if (module == NULL ||
+            module->Descriptor == NULL ||
+            module->Descriptor->Handler == NULL)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        status = RtlULongAdd(cbMinSize,
+                             sizeof(SYSVAD_AUDIOMODULE_BATCH_RESULT) + SYSVAD_AUDIOMODULE_BATCH_ALIGN(entry->ValueSize),
+                             &cbMinSize);
+        if (!NT_SUCCESS(status))
+        {
+            goto exit;
+        }
+
+        // The last command does not need to be padded.
+        entryCb = SYSVAD_AUDIOMODULE_BATCH_ALIGN(sizeof(SYSVAD_AUDIOMODULE_BATCH_COMMAND) + entry->CommandSize);
+        entryCb = MIN(entryCb, remainingCb);
+
+        command += entryCb;
+        remainingCb -= entryCb;
+    }
+
+    // Verify value size
+    if (PropertyRequest->ValueSize == 0)
+    {
+        PropertyRequest->ValueSize = cbMinSize;
+        return STATUS_BUFFER_OVERFLOW;
+    }
+    if (PropertyRequest->ValueSize < cbMinSize)
+    {
+        status = STATUS_BUFFER_TOO_SMALL;
+        goto exit;
+    }
+
+    //
+    // Save the state of the modules, to put it back if a command fails.
+    // Module lists are short and contexts small, so all of them are saved.
+    //
+    for (i = 0; i < AudioModuleCount; ++i)
+    {
+        if (AudioModules[i].Context != NULL)
+        {
+            cbSnapshot += (ULONG)AudioModules[i].Descriptor->ContextSize;
+        }
+    }
+
+    if (cbSnapshot != 0)
+    {
+        snapshot = (BYTE *)ExAllocatePool2(POOL_FLAG_PAGED, cbSnapshot, AUDIOMODULE_POOLTAG);
+        if (snapshot == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+        }
+
+        for (i = 0, context = snapshot; i < AudioModuleCount; ++i)
+        {
+            if (AudioModules[i].Context != NULL)
+            {
+                RtlCopyMemory(context, AudioModules[i].Context, AudioModules[i].Descriptor->ContextSize);
+                context += AudioModules[i].Descriptor->ContextSize;
+            }
+        }
+    }
+
+    //
+    // Run the commands in order, each writing its result in its own slot.
+    //
+    command = (BYTE *)(header + 1);
+    result = (BYTE *)PropertyRequest->Value;
+
+    for (i = 0; i < header->Count; ++i)
+    {
+        PSYSVAD_AUDIOMODULE_BATCH_COMMAND   entry = (PSYSVAD_AUDIOMODULE_BATCH_COMMAND)command;
+        PSYSVAD_AUDIOMODULE_BATCH_RESULT    entryResult = (PSYSVAD_AUDIOMODULE_BATCH_RESULT)result;
+        AUDIOMODULE *                       module = NULL;
+        ULONG                               outBufferCb = entry->ValueSize;
+
+        if (AudioModuleIndex != NULL)
+        {
+            module = AudioModule_FindModuleInIndex(AudioModuleIndex, AudioModules, AudioModuleCount, &entry->ClassId, entry->InstanceId);
+        }
+        else
+        {
+            module = AudioModule_FindModuleInList(AudioModules, AudioModuleCount, &entry->ClassId, entry->InstanceId);
+        }
+
+        status = module->Descriptor->Handler(module->Context,
+                                             entry->CommandSize ? (PVOID)(entry + 1) : NULL,
+                                             entry->CommandSize,
+                                             outBufferCb ? (PVOID)(entryResult + 1) : NULL,
+                                             &outBufferCb);
+
+        entryResult->Status = status;
+        entryResult->ValueSize = NT_SUCCESS(status) ? outBufferCb : 0;
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        command += SYSVAD_AUDIOMODULE_BATCH_ALIGN(sizeof(SYSVAD_AUDIOMODULE_BATCH_COMMAND) + entry->CommandSize);
+        result += sizeof(SYSVAD_AUDIOMODULE_BATCH_RESULT) + SYSVAD_AUDIOMODULE_BATCH_ALIGN(entry->ValueSize);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        DPF(D_VERBOSE, ("AudioModule batch: command %u of %u failed, 0x%x", i, header->Count, status));
+
+        //
+        // Put back the state from before the batch. Change notifications
+        // already sent for the earlier commands are not taken back; a
+        // client reads the parameter again when it gets one.
+        //
+        for (i = 0, context = snapshot; i < AudioModuleCount && snapshot != NULL; ++i)
+        {
+            if (AudioModules[i].Context != NULL)
+            {
+                RtlCopyMemory(AudioModules[i].Context, context, AudioModules[i].Descriptor->ContextSize);
+                context += AudioModules[i].Descriptor->ContextSize;
+            }
+        }
+    }
+
+    PropertyRequest->ValueSize = cbMinSize;
+
+exit:
+    if (!NT_SUCCESS(status) && result == NULL)
+    {
+        PropertyRequest->ValueSize = 0;
+    }
+
+    if (snapshot != NULL)
+    {
+        ExFreePoolWithTag(snapshot, AUDIOMODULE_POOLTAG);
+        snapshot = NULL;
+    }
+
+    return status;
+} // AudioModule_GenericHandler_ModuleBatchCommand
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
 AudioModule_GenericHandler_ModuleCommand(
     _In_ PPCPROPERTY_REQUEST    PropertyRequest,
     _In_ AUDIOMODULE *          AudioModules,
-    _In_ ULONG                  AudioModuleCount
+    _In_ ULONG                  AudioModuleCount,
+    _In_opt_ AUDIOMODULE_INDEX * AudioModuleIndex
     )
 {
     AUDIOMODULE *   module = NULL;
+    BOOL            isBatch = FALSE;
     
     PAGED_CODE();
 
@@ -480,19 +822,41 @@ AudioModule_GenericHandler_ModuleCommand(
     PKSAUDIOMODULE_PROPERTY moduleProperty = CONTAINING_RECORD(
         PropertyRequest->Instance, KSAUDIOMODULE_PROPERTY, ClassId);
 
-    // Get a ptr to the module.
-    module = AudioModule_FindModuleInList(AudioModules, 
-                                          AudioModuleCount, 
-                                          &moduleProperty->ClassId,
-                                          moduleProperty->InstanceId);
     //
-    // Invoke the handler.
+    // A batch names its modules in each of its commands.
     //
-    if (module == NULL || 
-        module->Descriptor == NULL || 
-        module->Descriptor->Handler == NULL)
+    if (IsEqualGUID(moduleProperty->ClassId, SYSVAD_AUDIOMODULE_BATCH_CLASSID))
     {
-        return STATUS_INVALID_PARAMETER;
+        isBatch = TRUE;
+    }
+    else
+    {
+        // Get a ptr to the module.
+        if (AudioModuleIndex != NULL)
+        {
+            module = AudioModule_FindModuleInIndex(AudioModuleIndex,
+                                                   AudioModules,
+                                                   AudioModuleCount,
+                                                   &moduleProperty->ClassId,
+                                                   moduleProperty->InstanceId);
+        }
+        else
+        {
+            module = AudioModule_FindModuleInList(AudioModules, 
+                                                  AudioModuleCount, 
+                                                  &moduleProperty->ClassId,
+                                                  moduleProperty->InstanceId);
+        }
+
+        //
+        // Invoke the handler.
+        //
+        if (module == NULL || 
+            module->Descriptor == NULL || 
+            module->Descriptor->Handler == NULL)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
     }
     
     // Handle KSPROPERTY_TYPE_BASICSUPPORT query
@@ -528,16 +892,47 @@ AudioModule_GenericHandler_ModuleCommand(
             inBuffer = (PVOID)(moduleProperty+1);
         }
 
-        status =  module->Descriptor->Handler(module->Context,
-                                              inBuffer,
-                                              inBufferCb,
-                                              outBuffer,
-                                              &outBufferCb);
         //
-        // Set the size of the returned output data, or in the case of
-        // buffer overflow error, return the expected buffer length.
+        // Commands to the modules of a list are serialized, so that the
+        // commands of a batch are not interleaved with any other.
         //
-        PropertyRequest->ValueSize = outBufferCb;
+        if (AudioModuleIndex != NULL)
+        {
+            KeWaitForSingleObject(&AudioModuleIndex->Lock,
+                                  Executive,
+                                  KernelMode,
+                                  FALSE,
+                                  NULL);
+        }
+
+        if (isBatch)
+        {
+            status = AudioModule_GenericHandler_ModuleBatchCommand(PropertyRequest,
+                                                                   AudioModules,
+                                                                   AudioModuleCount,
+                                                                   AudioModuleIndex,
+                                                                   inBuffer,
+                                                                   inBufferCb);
+        }
+        else
+        {
+            status =  module->Descriptor->Handler(module->Context,
+                                                  inBuffer,
+                                                  inBufferCb,
+                                                  outBuffer,
+                                                  &outBufferCb);
+            //
+            // Set the size of the returned output data, or in the case of
+            // buffer overflow error, return the expected buffer length.
+            //
+            PropertyRequest->ValueSize = outBufferCb;
+        }
+
+        if (AudioModuleIndex != NULL)
+        {
+            KeReleaseMutex(&AudioModuleIndex->Lock, FALSE);
+        }
+
         return status;
     }
 
@@ -643,4 +1038,345 @@ exit:
     }
 }
 
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+static
+VOID
+AudioModule_SendPendingNotifications(
+    _In_ PAUDIOMODULE_NOTIFIER          Notifier
+    )
+{
+    AUDIOMODULE_PENDING_NOTIFICATION    pending[AUDIOMODULE_NOTIFIER_MAX_PENDING];
+    ULONG                               cPending;
+    KIRQL                               oldIrql;
+
+    KeAcquireSpinLock(&Notifier->Lock, &oldIrql);
+
+    cPending = Notifier->PendingCount;
+    RtlCopyMemory(pending, Notifier->Pending, cPending * sizeof(AUDIOMODULE_PENDING_NOTIFICATION));
+    Notifier->PendingCount = 0;
+
+    if (cPending != 0)
+    {
+        Notifier->LastSendTime = KeQueryInterruptTime();
+    }
+
+    KeReleaseSpinLock(&Notifier->Lock, oldIrql);
+
+    for (ULONG i = 0; i < cPending; ++i)
+    {
+        AudioModule_SendNotification(Notifier->PortNotifications,
+                                     (PVOID)pending[i].Buffer,
+                                     pending[i].BufferCb);
+    }
+}
+
+//=============================================================================
+#pragma code_seg()
+_Function_class_(IO_WORKITEM_ROUTINE)
+_IRQL_requires_(PASSIVE_LEVEL)
+static
+VOID
+AudioModule_NotifierWorkItem(
+    _In_     PDEVICE_OBJECT             DeviceObject,
+    _In_opt_ PVOID                      Context
+    )
+{
+    PAUDIOMODULE_NOTIFIER   notifier = (PAUDIOMODULE_NOTIFIER)Context;
+    KIRQL                   oldIrql;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    ASSERT(notifier != NULL);
+    _Analysis_assume_(notifier != NULL);
+
+    AudioModule_SendPendingNotifications(notifier);
+
+    KeAcquireSpinLock(&notifier->Lock, &oldIrql);
+
+    notifier->WorkItemQueued = FALSE;
+
+    //
+    // Changes that came in while sending wait for the next interval.
+    //
+    if (notifier->PendingCount != 0 && !notifier->TimerArmed && !notifier->Deleting)
+    {
+        notifier->TimerArmed = TRUE;
+        ExSetTimer(notifier->Timer, -(LONGLONG)notifier->Interval, 0, NULL);
+    }
+
+    KeSetEvent(&notifier->WorkItemIdle, IO_NO_INCREMENT, FALSE);
+
+    KeReleaseSpinLock(&notifier->Lock, oldIrql);
+}
+
+//=============================================================================
+#pragma code_seg()
+_Function_class_(EXT_CALLBACK)
+_IRQL_requires_(DISPATCH_LEVEL)
+static
+VOID
+AudioModule_NotifierTimer(
+    _In_     PEX_TIMER                  Timer,
+    _In_opt_ PVOID                      Context
+    )
+{
+    PAUDIOMODULE_NOTIFIER   notifier = (PAUDIOMODULE_NOTIFIER)Context;
+
+    UNREFERENCED_PARAMETER(Timer);
+
+    ASSERT(notifier != NULL);
+    _Analysis_assume_(notifier != NULL);
+
+    KeAcquireSpinLockAtDpcLevel(&notifier->Lock);
+
+    notifier->TimerArmed = FALSE;
+
+    //
+    // Notifications are sent at passive level.
+    //
+    if (notifier->PendingCount != 0 && !notifier->WorkItemQueued && !notifier->Deleting)
+    {
+        notifier->WorkItemQueued = TRUE;
+        KeClearEvent(&notifier->WorkItemIdle);
+        IoQueueWorkItem(notifier->WorkItem, AudioModule_NotifierWorkItem, DelayedWorkQueue, notifier);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&notifier->Lock);
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+AudioModule_CreateNotifier(
+    _Out_ PAUDIOMODULE_NOTIFIER *       Notifier,
+    _In_  PPORTCLSNOTIFICATIONS         PortNotifications,
+    _In_  PDEVICE_OBJECT                DeviceObject,
+    _In_  ULONG                         IntervalMs
+    )
+{
+    NTSTATUS                ntStatus = STATUS_SUCCESS;
+    PAUDIOMODULE_NOTIFIER   notifier = NULL;
+
+    PAGED_CODE();
+
+    DPF_ENTER(("[AudioModule_CreateNotifier]"));
+
+    *Notifier = NULL;
+
+    notifier = (PAUDIOMODULE_NOTIFIER)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(AUDIOMODULE_NOTIFIER), AUDIOMODULE_POOLTAG);
+    if (notifier == NULL)
+    {
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    KeInitializeSpinLock(&notifier->Lock);
+    KeInitializeEvent(&notifier->WorkItemIdle, NotificationEvent, TRUE);
+    notifier->Interval = (ULONGLONG)IntervalMs * HNSTIME_PER_MILLISECOND;
+
+    notifier->Timer = ExAllocateTimer(AudioModule_NotifierTimer, notifier, EX_TIMER_HIGH_RESOLUTION);
+    if (notifier->Timer == NULL)
+    {
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    notifier->WorkItem = IoAllocateWorkItem(DeviceObject);
+    if (notifier->WorkItem == NULL)
+    {
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    notifier->PortNotifications = PortNotifications;
+    notifier->PortNotifications->AddRef();
+
+    *Notifier = notifier;
+    notifier = NULL;
+
+exit:
+    if (notifier != NULL)
+    {
+        AudioModule_DeleteNotifier(notifier);
+    }
+
+    return ntStatus;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_DeleteNotifier(
+    _In_opt_ PAUDIOMODULE_NOTIFIER      Notifier
+    )
+{
+    KIRQL   oldIrql;
+
+    if (Notifier == NULL)
+    {
+        return;
+    }
+
+    KeAcquireSpinLock(&Notifier->Lock, &oldIrql);
+    Notifier->Deleting = TRUE;
+    KeReleaseSpinLock(&Notifier->Lock, oldIrql);
+
+    //
+    // Nothing re-arms the timer or queues the work item from now on. Wait for
+    // a running timer callback, then for a queued work item, to finish.
+    //
+    if (Notifier->Timer != NULL)
+    {
+        ExDeleteTimer(Notifier->Timer, TRUE, TRUE, NULL);
+        Notifier->Timer = NULL;
+    }
+
+    KeWaitForSingleObject(&Notifier->WorkItemIdle, Executive, KernelMode, FALSE, NULL);
+
+    // The work item signals the event under the lock; let it drop the lock.
+    KeAcquireSpinLock(&Notifier->Lock, &oldIrql);
+    KeReleaseSpinLock(&Notifier->Lock, oldIrql);
+
+    //
+    // The module is going away, pending changes are dropped.
+    //
+    if (Notifier->WorkItem != NULL)
+    {
+        IoFreeWorkItem(Notifier->WorkItem);
+        Notifier->WorkItem = NULL;
+    }
+
+    SAFE_RELEASE(Notifier->PortNotifications);
+
+    ExFreePoolWithTag(Notifier, AUDIOMODULE_POOLTAG);
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_QueueNotification(
+    _In_ PAUDIOMODULE_NOTIFIER          Notifier,
+    _In_ ULONG                          ParameterId,
+    _In_reads_bytes_(NotificationBufferCb) PVOID NotificationBuffer,
+    _In_ USHORT                         NotificationBufferCb
+    )
+{
+    AUDIOMODULE_PENDING_NOTIFICATION *  pending = NULL;
+    BOOL                                fSendNow = FALSE;
+    BOOL                                fFull = FALSE;
+    ULONGLONG                           now;
+    KIRQL                               oldIrql;
+
+    DPF_ENTER(("[AudioModule_QueueNotification]"));
+
+    if (NotificationBufferCb > AUDIOMODULE_NOTIFIER_MAX_NOTIFICATION_CB)
+    {
+        ASSERT(FALSE);  // the pending entries are sized for the sample modules.
+        AudioModule_SendNotification(Notifier->PortNotifications, NotificationBuffer, NotificationBufferCb);
+        return;
+    }
+
+    KeAcquireSpinLock(&Notifier->Lock, &oldIrql);
+
+    //
+    // A pending notification for the same parameter is superseded.
+    //
+    for (ULONG i = 0; i < Notifier->PendingCount; ++i)
+    {
+        if (Notifier->Pending[i].ParameterId == ParameterId)
+        {
+            pending = &Notifier->Pending[i];
+            break;
+        }
+    }
+
+    if (pending == NULL && Notifier->PendingCount < AUDIOMODULE_NOTIFIER_MAX_PENDING)
+    {
+        pending = &Notifier->Pending[Notifier->PendingCount++];
+    }
+
+    if (pending != NULL)
+    {
+        pending->ParameterId = ParameterId;
+        pending->BufferCb = NotificationBufferCb;
+        RtlCopyMemory(pending->Buffer, NotificationBuffer, NotificationBufferCb);
+    }
+    else
+    {
+        fFull = TRUE;
+    }
+
+    //
+    // Send right away if the interval has elapsed since the last burst,
+    // else make sure the end of the interval picks the change up.
+    //
+    now = KeQueryInterruptTime();
+
+    if (fFull)
+    {
+        fSendNow = TRUE;
+    }
+    else if (!Notifier->TimerArmed && !Notifier->WorkItemQueued)
+    {
+        if (now - Notifier->LastSendTime >= Notifier->Interval)
+        {
+            fSendNow = TRUE;
+        }
+        else
+        {
+            Notifier->TimerArmed = TRUE;
+            ExSetTimer(Notifier->Timer,
+                       -(LONGLONG)(Notifier->LastSendTime + Notifier->Interval - now),
+                       0,
+                       NULL);
+        }
+    }
+
+    KeReleaseSpinLock(&Notifier->Lock, oldIrql);
+
+    if (fSendNow)
+    {
+        AudioModule_SendPendingNotifications(Notifier);
+    }
+
+    if (fFull)
+    {
+        AudioModule_SendNotification(Notifier->PortNotifications, NotificationBuffer, NotificationBufferCb);
+    }
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_FlushNotifications(
+    _In_opt_ PAUDIOMODULE_NOTIFIER      Notifier
+    )
+{
+    KIRQL   oldIrql;
+
+    if (Notifier == NULL)
+    {
+        return;
+    }
+
+    KeAcquireSpinLock(&Notifier->Lock, &oldIrql);
+
+    //
+    // If the timer already fired, its work item finds nothing left to send.
+    //
+    if (Notifier->TimerArmed && ExCancelTimer(Notifier->Timer, NULL))
+    {
+        Notifier->TimerArmed = FALSE;
+    }
+
+    KeReleaseSpinLock(&Notifier->Lock, oldIrql);
+
+    AudioModule_SendPendingNotifications(Notifier);
+}
+
 
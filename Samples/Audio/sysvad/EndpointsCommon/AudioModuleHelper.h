@@ -43,6 +43,30 @@ AudioModule_FindModuleInList(
     _In_ ULONG                  InstanceId
     );
 
+#pragma code_seg("PAGE")
+NTSTATUS
+AudioModule_InitIndex(
+    _Out_ AUDIOMODULE_INDEX *   AudioModuleIndex,
+    _In_reads_opt_(AudioModuleCount) AUDIOMODULE * AudioModules,
+    _In_ ULONG                  AudioModuleCount
+    );
+
+#pragma code_seg("PAGE")
+VOID
+AudioModule_CleanupIndex(
+    _Inout_ AUDIOMODULE_INDEX * AudioModuleIndex
+    );
+
+#pragma code_seg("PAGE")
+AUDIOMODULE *
+AudioModule_FindModuleInIndex(
+    _In_ AUDIOMODULE_INDEX *    AudioModuleIndex,
+    _In_ AUDIOMODULE *          AudioModules,
+    _In_ ULONG                  AudioModuleCount,
+    _In_ GUID *                 ClassId,
+    _In_ ULONG                  InstanceId
+    );
+
 #pragma code_seg("PAGE")
 NTSTATUS
 AudioModule_GenericHandler(
@@ -73,7 +97,8 @@ NTSTATUS
 AudioModule_GenericHandler_ModuleCommand(
     _In_ PPCPROPERTY_REQUEST    PropertyRequest,
     _In_ AUDIOMODULE *          AudioModules,
-    _In_ ULONG                  AudioModuleCount
+    _In_ ULONG                  AudioModuleCount,
+    _In_opt_ AUDIOMODULE_INDEX * AudioModuleIndex
     );
 
 #pragma code_seg("PAGE")
@@ -90,6 +115,42 @@ AudioModule_SendNotification(
     _In_ PVOID                          NotificationBuffer, 
     _In_ USHORT                         NotificationBufferCb
     );
+
+//
+// Change notification coalescing.
+//
+#pragma code_seg("PAGE")
+NTSTATUS
+AudioModule_CreateNotifier(
+    _Out_ PAUDIOMODULE_NOTIFIER *       Notifier,
+    _In_  PPORTCLSNOTIFICATIONS         PortNotifications,
+    _In_  PDEVICE_OBJECT                DeviceObject,
+    _In_  ULONG                         IntervalMs
+    );
+
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_DeleteNotifier(
+    _In_opt_ PAUDIOMODULE_NOTIFIER      Notifier
+    );
+
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_QueueNotification(
+    _In_ PAUDIOMODULE_NOTIFIER          Notifier,
+    _In_ ULONG                          ParameterId,
+    _In_reads_bytes_(NotificationBufferCb) PVOID NotificationBuffer,
+    _In_ USHORT                         NotificationBufferCb
+    );
+
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+AudioModule_FlushNotifications(
+    _In_opt_ PAUDIOMODULE_NOTIFIER      Notifier
+    );
 #endif // _SYSVAD_AUDIOMODULEHELPER_H_
 
 
@@ -0,0 +1,532 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    HfpCodec.h
+
+Abstract:
+
+    Hands-Free Profile speech codec stage: CVSD for narrowband (8 kHz) and
+    mSBC for wideband (16 kHz) audio, with packet loss concealment on the
+    receive side.
+
+    Both codecs work on 7.5 ms frames carried in 60 byte SCO packets. CVSD
+    runs at 64 kHz, one bit per sample, behind an 8x polyphase interpolator
+    on transmit and decimator on receive. mSBC frames are wrapped in the H2
+    synchronization header and padded to the packet size.
+
+    The stage meets the transport at the packet boundary: a render stream
+    hands each encoded packet to a send routine, a capture stream asks a
+    receive routine for the packet of each frame and conceals the ones the
+    transport lost.
+
+    Everything is integer fixed point so the stage can run in the DPC that
+    moves the stream data.
+
+--*/
+
+#ifndef _SYSVAD_HFPCODEC_H_
+#define _SYSVAD_HFPCODEC_H_
+
+#include "SbcCodec.h"
+
+#define HFP_PACKET_BYTES            60
+#define HFP_MAX_FRAME_SAMPLES       MSBC_SAMPLES
+
+#define HFP_CODEC_NONE              0
+#define HFP_CODEC_CVSD              1
+#define HFP_CODEC_MSBC              2
+
+//
+// CVSD, Bluetooth Core specification vol 2 part B 9.2. The accumulator
+// and step size are kept with CVSD_FRAC fractional bits.
+//
+#define CVSD_FRAC                   10
+#define CVSD_OVERSAMPLING           8
+#define CVSD_FRAME_SAMPLES          (HFP_PACKET_BYTES * 8 / CVSD_OVERSAMPLING)
+#define CVSD_STEP_MIN               (10 << CVSD_FRAC)
+#define CVSD_STEP_MAX               (1280 << CVSD_FRAC)
+#define CVSD_RUN_MASK               0x0F            // J = 4 equal bits
+#define CVSD_FILTER_TAPS            96
+#define CVSD_FILTER_PHASE_TAPS      (CVSD_FILTER_TAPS / CVSD_OVERSAMPLING)
+#define CVSD_FILTER_FRAC            14
+
+//
+// mSBC over SCO: 2 byte H2 header, 57 byte frame, 1 pad byte.
+//
+#define MSBC_H2_SYNC                0x01
+#define MSBC_H2_BYTES               2
+
+//
+// Packet loss concealment.
+//
+#define HFP_PLC_HISTORY             384             // max pitch lag plus window at 16 kHz
+#define HFP_PLC_MUTE_FRAMES         4               // frames to fade out over
+
+//
+// 4 kHz low pass at 64 kHz (Kaiser window, beta 5), gain of CVSD_OVERSAMPLING
+// so that every polyphase branch has unity gain.
+//
+static const INT16 g_CvsdFilter[CVSD_FILTER_TAPS] =
+{
+       -6,   -23,   -44,   -65,   -79,   -81,   -64,   -26,
+       31,   102,   175,   237,   269,   258,   195,    77,
+      -86,  -273,  -455,  -596,  -660,  -619,  -456,  -176,
+      194,   608,   999,  1294,  1420,  1321,   970,   374,
+     -412, -1294, -2140, -2800, -3119, -2961, -2231,  -892,
+     1027,  3422,  6125,  8919, 11559, 13801, 15430, 16288,
+    16288, 15430, 13801, 11559,  8919,  6125,  3422,  1027,
+     -892, -2231, -2961, -3119, -2800, -2140, -1294,  -412,
+      374,   970,  1321,  1420,  1294,   999,   608,   194,
+     -176,  -456,  -619,  -660,  -596,  -455,  -273,   -86,
+       77,   195,   258,   269,   237,   175,   102,    31,
+      -26,   -64,   -81,   -79,   -65,   -44,   -23,    -6
+};
+
+//
+// H2 header second byte for sequence numbers 0..3.
+//
+static const BYTE g_MsbcH2Sequence[4] = { 0x08, 0x38, 0xC8, 0xF8 };
+
+typedef struct _CVSD_STATE
+{
+    LONG        Estimate;                   // x^(k), CVSD_FRAC fractional bits
+    LONG        Step;                       // delta(k), CVSD_FRAC fractional bits
+    ULONG       Run;                        // last bits, newest in bit 0
+    INT16       Delay[CVSD_FILTER_TAPS];    // filter input, newest first
+} CVSD_STATE;
+
+typedef struct _HFP_PLC_STATE
+{
+    INT16       History[HFP_PLC_HISTORY];   // last output, oldest first
+    ULONG       LostFrames;
+    ULONG       Pitch;
+    ULONG       ReplayPos;
+} HFP_PLC_STATE;
+
+//
+// The SCO transport. Send takes one encoded packet. Receive fills in the
+// packet for the next frame and returns FALSE if it was lost.
+//
+typedef VOID (*PFNHFPSENDPACKET)
+(
+    _In_                            PVOID           Context,
+    _In_reads_(HFP_PACKET_BYTES)    const BYTE      *Packet
+);
+
+typedef BOOLEAN (*PFNHFPRECEIVEPACKET)
+(
+    _In_                            PVOID           Context,
+    _Out_writes_(HFP_PACKET_BYTES)  BYTE            *Packet
+);
+
+typedef struct _HFP_CODEC_STAGE
+{
+    ULONG                   Codec;
+    ULONG                   SampleRate;
+    ULONG                   FrameSamples;
+    ULONG                   TxPosition;     // within InFrame
+    ULONG                   RxPosition;     // within OutFrame
+    ULONG                   TxSequence;
+    ULONG                   LostPackets;
+    CVSD_STATE              CvsdEncoder;
+    CVSD_STATE              CvsdDecoder;
+    SBC_ANALYSIS_STATE      SbcAnalysis;
+    SBC_SYNTHESIS_STATE     SbcSynthesis;
+    HFP_PLC_STATE           Plc;
+    INT16                   InFrame[HFP_MAX_FRAME_SAMPLES];
+    INT16                   OutFrame[HFP_MAX_FRAME_SAMPLES];
+    BYTE                    Packet[HFP_PACKET_BYTES];
+} HFP_CODEC_STAGE;
+
+inline INT16 HfpSaturate(_In_ LONGLONG Value)
+{
+    return (INT16)((Value > 32767) ? 32767 : ((Value < -32768) ? -32768 : Value));
+}
+
+//
+// Applies one CVSD bit (1 for up) to the state and returns the new
+// estimate, CVSD_FRAC fractional bits.
+//
+inline LONG CvsdStep(_Inout_ CVSD_STATE *State, _In_ ULONG Bit)
+{
+    LONG y;
+
+    State->Run = ((State->Run << 1) | Bit) & CVSD_RUN_MASK;
+
+    if (State->Run == 0 || State->Run == CVSD_RUN_MASK)
+    {
+        State->Step = min(State->Step + CVSD_STEP_MIN, CVSD_STEP_MAX);
+    }
+    else
+    {
+        // beta = 1 - 1/1024
+        State->Step = max(State->Step - (State->Step >> 10), CVSD_STEP_MIN);
+    }
+
+    y = Bit ? State->Estimate + State->Step : State->Estimate - State->Step;
+    y = max(min(y, 32767 << CVSD_FRAC), -32768 * (1 << CVSD_FRAC));
+
+    // h = 1 - 1/32
+    State->Estimate = y - (y >> 5);
+
+    return State->Estimate;
+}
+
+//
+// Encodes CVSD_FRAME_SAMPLES 8 kHz samples into one packet, 64 kHz bits
+// LSB first.
+//
+inline VOID CvsdEncodeFrame
+(
+    _Inout_                         CVSD_STATE      *State,
+    _In_reads_(CVSD_FRAME_SAMPLES)  const INT16     *Pcm,
+    _Out_writes_(HFP_PACKET_BYTES)  BYTE            *Packet
+)
+{
+    for (ULONG n = 0; n < CVSD_FRAME_SAMPLES; n++)
+    {
+        BYTE bits = 0;
+
+        RtlMoveMemory(&State->Delay[1], &State->Delay[0], (CVSD_FILTER_PHASE_TAPS - 1) * sizeof(INT16));
+        State->Delay[0] = Pcm[n];
+
+        for (ULONG p = 0; p < CVSD_OVERSAMPLING; p++)
+        {
+            LONG x = 0;
+
+            for (ULONG j = 0; j < CVSD_FILTER_PHASE_TAPS; j++)
+            {
+                x += (LONG)g_CvsdFilter[j * CVSD_OVERSAMPLING + p] * State->Delay[j];
+            }
+
+            x = (LONG)HfpSaturate(x >> CVSD_FILTER_FRAC) * (1 << CVSD_FRAC);
+
+            if (x >= State->Estimate)
+            {
+                bits |= (BYTE)(1 << p);
+                CvsdStep(State, 1);
+            }
+            else
+            {
+                CvsdStep(State, 0);
+            }
+        }
+
+        Packet[n] = bits;
+    }
+}
+
+//
+// Decodes one packet into CVSD_FRAME_SAMPLES 8 kHz samples.
+//
+inline VOID CvsdDecodeFrame
+(
+    _Inout_                         CVSD_STATE      *State,
+    _In_reads_(HFP_PACKET_BYTES)    const BYTE      *Packet,
+    _Out_writes_(CVSD_FRAME_SAMPLES) INT16          *Pcm
+)
+{
+    for (ULONG n = 0; n < CVSD_FRAME_SAMPLES; n++)
+    {
+        LONGLONG y = 0;
+
+        RtlMoveMemory(&State->Delay[CVSD_OVERSAMPLING], &State->Delay[0], (CVSD_FILTER_TAPS - CVSD_OVERSAMPLING) * sizeof(INT16));
+        for (ULONG p = 0; p < CVSD_OVERSAMPLING; p++)
+        {
+            State->Delay[CVSD_OVERSAMPLING - 1 - p] = (INT16)(CvsdStep(State, (Packet[n] >> p) & 1) >> CVSD_FRAC);
+        }
+
+        for (ULONG i = 0; i < CVSD_FILTER_TAPS; i++)
+        {
+            y += (LONG)g_CvsdFilter[i] * State->Delay[i];
+        }
+
+        // Decimation keeps one sample in CVSD_OVERSAMPLING, remove the filter gain.
+        Pcm[n] = HfpSaturate(y >> (CVSD_FILTER_FRAC + 3));
+    }
+}
+
+//
+// Pitch lag, between 2.5 ms and 20 ms, whose segment best matches the last
+// 4 ms of the history.
+//
+inline ULONG HfpPlcFindPitch(_In_ const HFP_PLC_STATE *State, _In_ ULONG SampleRate)
+{
+    const ULONG     minLag = SampleRate / 400;
+    const ULONG     maxLag = SampleRate / 50;
+    const ULONG     window = SampleRate / 250;
+    const INT16 *   last = &State->History[HFP_PLC_HISTORY - window];
+    ULONG           bestLag = maxLag;
+    LONGLONG        bestScore = -1;
+
+    for (ULONG lag = minLag; lag <= maxLag; lag++)
+    {
+        const INT16 *   candidate = last - lag;
+        LONGLONG        corr = 0;
+        LONGLONG        energy = 1;
+        LONGLONG        score;
+
+        //
+        // 12 bit samples keep the squared correlation of the window in
+        // 64 bits.
+        //
+        for (ULONG i = 0; i < window; i++)
+        {
+            corr   += (LONG)(last[i] >> 4) * (candidate[i] >> 4);
+            energy += (LONG)(candidate[i] >> 4) * (candidate[i] >> 4);
+        }
+
+        score = (corr > 0) ? (corr * corr) / energy : 0;
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestLag = lag;
+        }
+    }
+
+    return bestLag;
+}
+
+//
+// Next concealment sample: the last pitch period repeated, faded out over
+// HFP_PLC_MUTE_FRAMES frames.
+//
+inline INT16 HfpPlcReplay(_Inout_ HFP_PLC_STATE *State, _In_ ULONG FrameSamples)
+{
+    ULONG   fadeLength = HFP_PLC_MUTE_FRAMES * FrameSamples;
+    LONG    sample = State->History[HFP_PLC_HISTORY - State->Pitch + (State->ReplayPos % State->Pitch)];
+
+    State->ReplayPos++;
+
+    if (State->ReplayPos >= fadeLength)
+    {
+        return 0;
+    }
+
+    return (INT16)((sample * (LONG)(fadeLength - State->ReplayPos)) / (LONG)fadeLength);
+}
+
+inline VOID HfpPlcAppend
+(
+    _Inout_                     HFP_PLC_STATE   *State,
+    _In_reads_(Count)           const INT16     *Pcm,
+    _In_                        ULONG           Count
+)
+{
+    RtlMoveMemory(&State->History[0], &State->History[Count], (HFP_PLC_HISTORY - Count) * sizeof(INT16));
+    RtlCopyMemory(&State->History[HFP_PLC_HISTORY - Count], Pcm, Count * sizeof(INT16));
+}
+
+//
+// Fills a lost frame.
+//
+inline VOID HfpPlcConceal
+(
+    _Inout_                     HFP_PLC_STATE   *State,
+    _In_                        ULONG           SampleRate,
+    _In_                        ULONG           FrameSamples,
+    _Out_writes_(FrameSamples)  INT16           *Pcm
+)
+{
+    if (State->LostFrames++ == 0)
+    {
+        State->Pitch = HfpPlcFindPitch(State, SampleRate);
+        State->ReplayPos = 0;
+    }
+
+    for (ULONG i = 0; i < FrameSamples; i++)
+    {
+        Pcm[i] = HfpPlcReplay(State, FrameSamples);
+    }
+}
+
+//
+// Takes a good frame; after a loss its start is cross faded from the
+// concealment into the decoded audio.
+//
+inline VOID HfpPlcGoodFrame
+(
+    _Inout_                     HFP_PLC_STATE   *State,
+    _In_                        ULONG           FrameSamples,
+    _Inout_updates_(FrameSamples) INT16         *Pcm
+)
+{
+    if (State->LostFrames != 0)
+    {
+        ULONG overlap = FrameSamples / 4;
+
+        for (ULONG i = 0; i < overlap; i++)
+        {
+            LONG concealed = HfpPlcReplay(State, FrameSamples);
+
+            Pcm[i] = (INT16)((Pcm[i] * (LONG)(i + 1) + concealed * (LONG)(overlap - i - 1)) / (LONG)overlap);
+        }
+
+        State->LostFrames = 0;
+    }
+
+    HfpPlcAppend(State, Pcm, FrameSamples);
+}
+
+//
+// Sets the stage up for 8000 (CVSD) or 16000 (mSBC) Hz mono 16-bit audio.
+// Returns FALSE for any other rate.
+//
+inline BOOLEAN HfpCodecInit(_Out_ HFP_CODEC_STAGE *Stage, _In_ ULONG SampleRate)
+{
+    RtlZeroMemory(Stage, sizeof(*Stage));
+
+    switch (SampleRate)
+    {
+    case 8000:
+        Stage->Codec = HFP_CODEC_CVSD;
+        Stage->FrameSamples = CVSD_FRAME_SAMPLES;
+        break;
+    case 16000:
+        Stage->Codec = HFP_CODEC_MSBC;
+        Stage->FrameSamples = MSBC_SAMPLES;
+        break;
+    default:
+        return FALSE;
+    }
+
+    Stage->SampleRate = SampleRate;
+    Stage->CvsdEncoder.Step = CVSD_STEP_MIN;
+    Stage->CvsdDecoder.Step = CVSD_STEP_MIN;
+
+    return TRUE;
+}
+
+//
+// Encodes one frame of FrameSamples samples into an SCO packet.
+//
+inline VOID HfpCodecEncodePacket
+(
+    _Inout_                         HFP_CODEC_STAGE *Stage,
+    _In_reads_(Stage->FrameSamples) const INT16     *Pcm,
+    _Out_writes_(HFP_PACKET_BYTES)  BYTE            *Packet
+)
+{
+    if (Stage->Codec == HFP_CODEC_CVSD)
+    {
+        CvsdEncodeFrame(&Stage->CvsdEncoder, Pcm, Packet);
+    }
+    else
+    {
+        Packet[0] = MSBC_H2_SYNC;
+        Packet[1] = g_MsbcH2Sequence[Stage->TxSequence++ % 4];
+        MsbcEncodeFrame(&Stage->SbcAnalysis, Pcm, &Packet[MSBC_H2_BYTES]);
+        Packet[HFP_PACKET_BYTES - 1] = 0;
+    }
+}
+
+//
+// Decodes one SCO packet into FrameSamples samples. Packet is NULL when
+// the transport lost it; lost and corrupt packets are concealed.
+//
+inline VOID HfpCodecDecodePacket
+(
+    _Inout_                         HFP_CODEC_STAGE *Stage,
+    _In_reads_opt_(HFP_PACKET_BYTES) const BYTE     *Packet,
+    _Out_writes_(Stage->FrameSamples) INT16         *Pcm
+)
+{
+    BOOLEAN good = FALSE;
+
+    if (Packet != NULL)
+    {
+        if (Stage->Codec == HFP_CODEC_CVSD)
+        {
+            CvsdDecodeFrame(&Stage->CvsdDecoder, Packet, Pcm);
+            good = TRUE;
+        }
+        else if (Packet[0] == MSBC_H2_SYNC && (Packet[1] & 0x0F) == 0x08)
+        {
+            good = MsbcDecodeFrame(&Stage->SbcSynthesis, &Packet[MSBC_H2_BYTES], Pcm);
+        }
+    }
+
+    if (good)
+    {
+        HfpPlcGoodFrame(&Stage->Plc, Stage->FrameSamples, Pcm);
+    }
+    else
+    {
+        HfpPlcConceal(&Stage->Plc, Stage->SampleRate, Stage->FrameSamples, Pcm);
+    }
+}
+
+//
+// Takes Count samples to send. Each completed frame is encoded and handed
+// to Send.
+//
+inline VOID HfpCodecTransmit
+(
+    _Inout_                 HFP_CODEC_STAGE     *Stage,
+    _In_reads_(Count)       const INT16         *Samples,
+    _In_                    ULONG               Count,
+    _In_                    PFNHFPSENDPACKET    Send,
+    _In_                    PVOID               Context
+)
+{
+    while (Count > 0)
+    {
+        ULONG run = min(Count, Stage->FrameSamples - Stage->TxPosition);
+
+        RtlCopyMemory(&Stage->InFrame[Stage->TxPosition], Samples, run * sizeof(INT16));
+        Stage->TxPosition += run;
+        Samples += run;
+        Count -= run;
+
+        if (Stage->TxPosition == Stage->FrameSamples)
+        {
+            HfpCodecEncodePacket(Stage, Stage->InFrame, Stage->Packet);
+            Send(Context, Stage->Packet);
+            Stage->TxPosition = 0;
+        }
+    }
+}
+
+//
+// Fills Count samples with received audio. The packet of each frame is
+// fetched from Receive when the frame starts; a lost one is concealed.
+//
+inline VOID HfpCodecReceive
+(
+    _Inout_                 HFP_CODEC_STAGE     *Stage,
+    _Out_writes_(Count)     INT16               *Samples,
+    _In_                    ULONG               Count,
+    _In_                    PFNHFPRECEIVEPACKET Receive,
+    _In_                    PVOID               Context
+)
+{
+    while (Count > 0)
+    {
+        ULONG run;
+
+        if (Stage->RxPosition == 0)
+        {
+            if (Receive(Context, Stage->Packet))
+            {
+                HfpCodecDecodePacket(Stage, Stage->Packet, Stage->OutFrame);
+            }
+            else
+            {
+                Stage->LostPackets++;
+                HfpCodecDecodePacket(Stage, NULL, Stage->OutFrame);
+            }
+        }
+
+        run = min(Count, Stage->FrameSamples - Stage->RxPosition);
+
+        RtlCopyMemory(Samples, &Stage->OutFrame[Stage->RxPosition], run * sizeof(INT16));
+        Stage->RxPosition = (Stage->RxPosition + run) % Stage->FrameSamples;
+        Samples += run;
+        Count -= run;
+    }
+}
+
+#endif // _SYSVAD_HFPCODEC_H_
@@ -0,0 +1,146 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    ImaAdpcm.h
+
+Abstract:
+
+    IMA ADPCM (4 bits per sample) block codec for 16-bit PCM, used to keep
+    long keyword detector history in a quarter of the memory.
+
+    A block starts with the codec state (predictor and step index) so each
+    block decodes on its own, while the encoder state carries over from
+    block to block.
+
+--*/
+
+#ifndef _SYSVAD_IMAADPCM_H_
+#define _SYSVAD_IMAADPCM_H_
+
+typedef struct _IMA_ADPCM_STATE
+{
+    INT16   Predictor;
+    UINT8   StepIndex;
+    UINT8   Reserved;
+} IMA_ADPCM_STATE;
+
+static const INT16 g_ImaAdpcmStepTable[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const INT8 g_ImaAdpcmIndexTable[16] =
+{
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//
+// Applies one 4-bit code to the state and returns the reconstructed sample.
+//
+inline INT16 ImaAdpcmStep(_Inout_ IMA_ADPCM_STATE *State, _In_ UINT8 Code)
+{
+    LONG step = g_ImaAdpcmStepTable[State->StepIndex];
+    LONG diff = step >> 3;
+    LONG predictor = State->Predictor;
+    LONG index = State->StepIndex + g_ImaAdpcmIndexTable[Code];
+
+    if (Code & 4) diff += step;
+    if (Code & 2) diff += step >> 1;
+    if (Code & 1) diff += step >> 2;
+
+    predictor += (Code & 8) ? -diff : diff;
+    predictor = (predictor > 32767) ? 32767 : ((predictor < -32768) ? -32768 : predictor);
+    index = (index > 88) ? 88 : ((index < 0) ? 0 : index);
+
+    State->Predictor = (INT16)predictor;
+    State->StepIndex = (UINT8)index;
+
+    return State->Predictor;
+}
+
+//
+// Encodes SampleCount (even) samples into SampleCount / 2 bytes, low nibble
+// first. State is the encoder state on entry and is updated.
+//
+inline VOID ImaAdpcmEncode
+(
+    _Inout_                         IMA_ADPCM_STATE *State,
+    _In_reads_(SampleCount)         const INT16     *Samples,
+    _In_                            ULONG           SampleCount,
+    _Out_writes_(SampleCount / 2)   BYTE            *Data
+)
+{
+    for (ULONG i = 0; i < SampleCount; i++)
+    {
+        LONG step = g_ImaAdpcmStepTable[State->StepIndex];
+        LONG diff = (LONG)Samples[i] - State->Predictor;
+        UINT8 code = 0;
+
+        if (diff < 0)
+        {
+            code = 8;
+            diff = -diff;
+        }
+        if (diff >= step)
+        {
+            code |= 4;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step)
+        {
+            code |= 2;
+            diff -= step;
+        }
+        step >>= 1;
+        if (diff >= step)
+        {
+            code |= 1;
+        }
+
+        // track the decoder exactly, so the error does not accumulate
+        ImaAdpcmStep(State, code);
+
+        if (i & 1)
+        {
+            Data[i / 2] |= (BYTE)(code << 4);
+        }
+        else
+        {
+            Data[i / 2] = code;
+        }
+    }
+}
+
+//
+// Decodes SampleCount samples from a block that was encoded starting at
+// State.
+//
+inline VOID ImaAdpcmDecode
+(
+    _In_                            IMA_ADPCM_STATE State,
+    _In_reads_(SampleCount / 2)     const BYTE      *Data,
+    _In_                            ULONG           SampleCount,
+    _Out_writes_(SampleCount)       INT16           *Samples
+)
+{
+    for (ULONG i = 0; i < SampleCount; i++)
+    {
+        UINT8 code = (i & 1) ? (Data[i / 2] >> 4) : (Data[i / 2] & 0x0F);
+        Samples[i] = ImaAdpcmStep(&State, code);
+    }
+}
+
+#endif // _SYSVAD_IMAADPCM_H_
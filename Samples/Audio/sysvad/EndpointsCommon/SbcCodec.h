@@ -0,0 +1,819 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    SbcCodec.h
+
+Abstract:
+
+    Fixed point SBC (sub-band codec) core, the A2DP SBC frame encoder and
+    the mSBC framing of the Hands-Free Profile wideband speech codec built
+    on it.
+
+    The analysis and synthesis filterbanks use the 8 subband prototype
+    window of the A2DP specification. The 80 tap window is applied as
+    five 16 tap phases followed by an 8x16 cosine modulation, which is
+    the polyphase form of the specification's equations.
+
+    Subband samples are 32-bit with SBC_SB_FRAC fractional bits, on the
+    scale of the 16-bit PCM they were analyzed from.
+
+--*/
+
+#ifndef _SYSVAD_SBCCODEC_H_
+#define _SYSVAD_SBCCODEC_H_
+
+#define SBC_SUBBANDS_8              8
+#define SBC_WINDOW_8                80      // analysis/synthesis window taps
+#define SBC_SB_FRAC                 15      // fractional bits of subband samples
+#define SBC_COEF_FRAC               16      // fractional bits of window coefficients
+#define SBC_COS_FRAC                15      // fractional bits of modulation coefficients
+
+#define SBC_MAX_BLOCKS              16
+#define SBC_MAX_CHANNELS            2
+#define SBC_MAX_BITS                16
+#define SBC_MAX_SCALE_FACTOR        15
+
+#define SBC_CRC_INIT                0x0F
+#define SBC_CRC_POLY                0x1D    // x^8 + x^4 + x^3 + x^2 + 1
+
+//
+// mSBC: 16 kHz, mono, 15 blocks, 8 subbands, loudness, bitpool 26.
+//
+#define MSBC_SYNCWORD               0xAD
+#define MSBC_BLOCKS                 15
+#define MSBC_BITPOOL                26
+#define MSBC_SAMPLES                (MSBC_BLOCKS * SBC_SUBBANDS_8)
+#define MSBC_FRAME_BYTES            57
+
+#define SBC_FREQ_16000              0
+#define SBC_FREQ_32000              1
+#define SBC_FREQ_44100              2
+#define SBC_FREQ_48000              3
+
+#define SBC_ALLOCATION_LOUDNESS     0
+#define SBC_ALLOCATION_SNR          1
+
+//
+// A2DP SBC frames. Only 8 subbands are encoded.
+//
+#define SBC_SYNCWORD                0x9C
+#define SBC_HEADER_BYTES            4
+
+#define SBC_CHANNEL_MODE_MONO       0
+#define SBC_CHANNEL_MODE_DUAL       1
+#define SBC_CHANNEL_MODE_STEREO     2
+#define SBC_CHANNEL_MODE_JOINT      3
+
+#define SBC_MAX_BITPOOL             250
+#define SBC_MAX_FRAME_BYTES         (SBC_HEADER_BYTES + SBC_MAX_CHANNELS * SBC_SUBBANDS_8 / 2 + \
+                                     SBC_MAX_BLOCKS * SBC_MAX_CHANNELS * SBC_SUBBANDS_8 * SBC_MAX_BITS / 8)
+
+#define SBC_COEF(x)     ((INT32)((x) * (1 << SBC_COEF_FRAC) + ((x) >= 0 ? 0.5 : -0.5)))
+#define SBC_COS(x)      ((INT32)((x) * (1 << SBC_COS_FRAC) + ((x) >= 0 ? 0.5 : -0.5)))
+
+//
+// Prototype window C[0..79] for 8 subbands, as tabulated in the A2DP
+// specification (the sign changes of the odd 16 tap phases included).
+//
+static constexpr INT32 g_SbcWindow8[SBC_WINDOW_8] =
+{
+    SBC_COEF( 0.00000000E+00), SBC_COEF( 1.56575398E-04), SBC_COEF( 3.43256425E-04), SBC_COEF( 5.54620202E-04),
+    SBC_COEF( 8.23919506E-04), SBC_COEF( 1.13992507E-03), SBC_COEF( 1.47640169E-03), SBC_COEF( 1.78371725E-03),
+    SBC_COEF( 2.01182542E-03), SBC_COEF( 2.10371989E-03), SBC_COEF( 1.99454554E-03), SBC_COEF( 1.61656283E-03),
+    SBC_COEF( 9.02154502E-04), SBC_COEF(-1.78805361E-04), SBC_COEF(-1.64973098E-03), SBC_COEF(-3.49717454E-03),
+    SBC_COEF( 5.65949473E-03), SBC_COEF( 8.02941163E-03), SBC_COEF( 1.04584443E-02), SBC_COEF( 1.27472335E-02),
+    SBC_COEF( 1.46525263E-02), SBC_COEF( 1.59045603E-02), SBC_COEF( 1.62208471E-02), SBC_COEF( 1.53184106E-02),
+    SBC_COEF( 1.29371806E-02), SBC_COEF( 8.85757540E-03), SBC_COEF( 2.92408442E-03), SBC_COEF(-4.91578024E-03),
+    SBC_COEF(-1.46404076E-02), SBC_COEF(-2.61098752E-02), SBC_COEF(-3.90751381E-02), SBC_COEF(-5.31873032E-02),
+    SBC_COEF( 6.79989431E-02), SBC_COEF( 8.29847578E-02), SBC_COEF( 9.75753918E-02), SBC_COEF( 1.11196689E-01),
+    SBC_COEF( 1.23264548E-01), SBC_COEF( 1.33264415E-01), SBC_COEF( 1.40753505E-01), SBC_COEF( 1.45389847E-01),
+    SBC_COEF( 1.46955068E-01), SBC_COEF( 1.45389847E-01), SBC_COEF( 1.40753505E-01), SBC_COEF( 1.33264415E-01),
+    SBC_COEF( 1.23264548E-01), SBC_COEF( 1.11196689E-01), SBC_COEF( 9.75753918E-02), SBC_COEF( 8.29847578E-02),
+    SBC_COEF(-6.79989431E-02), SBC_COEF(-5.31873032E-02), SBC_COEF(-3.90751381E-02), SBC_COEF(-2.61098752E-02),
+    SBC_COEF(-1.46404076E-02), SBC_COEF(-4.91578024E-03), SBC_COEF( 2.92408442E-03), SBC_COEF( 8.85757540E-03),
+    SBC_COEF( 1.29371806E-02), SBC_COEF( 1.53184106E-02), SBC_COEF( 1.62208471E-02), SBC_COEF( 1.59045603E-02),
+    SBC_COEF( 1.46525263E-02), SBC_COEF( 1.27472335E-02), SBC_COEF( 1.04584443E-02), SBC_COEF( 8.02941163E-03),
+    SBC_COEF(-5.65949473E-03), SBC_COEF(-3.49717454E-03), SBC_COEF(-1.64973098E-03), SBC_COEF(-1.78805361E-04),
+    SBC_COEF( 9.02154502E-04), SBC_COEF( 1.61656283E-03), SBC_COEF( 1.99454554E-03), SBC_COEF( 2.10371989E-03),
+    SBC_COEF( 2.01182542E-03), SBC_COEF( 1.78371725E-03), SBC_COEF( 1.47640169E-03), SBC_COEF( 1.13992507E-03),
+    SBC_COEF( 8.23919506E-04), SBC_COEF( 5.54620202E-04), SBC_COEF( 3.43256425E-04), SBC_COEF( 1.56575398E-04),
+};
+
+//
+// Analysis modulation, cos((k + 0.5) * (i - 4) * pi / 8), k = 0..7, i = 0..15.
+//
+static constexpr INT32 g_SbcCos8[SBC_SUBBANDS_8][16] =
+{
+    { SBC_COS( 0.70710678), SBC_COS( 0.83146961), SBC_COS( 0.92387953), SBC_COS( 0.98078528), SBC_COS( 1.00000000), SBC_COS( 0.98078528), SBC_COS( 0.92387953), SBC_COS( 0.83146961),
+      SBC_COS( 0.70710678), SBC_COS( 0.55557023), SBC_COS( 0.38268343), SBC_COS( 0.19509032), SBC_COS( 0.00000000), SBC_COS(-0.19509032), SBC_COS(-0.38268343), SBC_COS(-0.55557023) },
+    { SBC_COS(-0.70710678), SBC_COS(-0.19509032), SBC_COS( 0.38268343), SBC_COS( 0.83146961), SBC_COS( 1.00000000), SBC_COS( 0.83146961), SBC_COS( 0.38268343), SBC_COS(-0.19509032),
+      SBC_COS(-0.70710678), SBC_COS(-0.98078528), SBC_COS(-0.92387953), SBC_COS(-0.55557023), SBC_COS( 0.00000000), SBC_COS( 0.55557023), SBC_COS( 0.92387953), SBC_COS( 0.98078528) },
+    { SBC_COS(-0.70710678), SBC_COS(-0.98078528), SBC_COS(-0.38268343), SBC_COS( 0.55557023), SBC_COS( 1.00000000), SBC_COS( 0.55557023), SBC_COS(-0.38268343), SBC_COS(-0.98078528),
+      SBC_COS(-0.70710678), SBC_COS( 0.19509032), SBC_COS( 0.92387953), SBC_COS( 0.83146961), SBC_COS( 0.00000000), SBC_COS(-0.83146961), SBC_COS(-0.92387953), SBC_COS(-0.19509032) },
+    { SBC_COS( 0.70710678), SBC_COS(-0.55557023), SBC_COS(-0.92387953), SBC_COS( 0.19509032), SBC_COS( 1.00000000), SBC_COS( 0.19509032), SBC_COS(-0.92387953), SBC_COS(-0.55557023),
+      SBC_COS( 0.70710678), SBC_COS( 0.83146961), SBC_COS(-0.38268343), SBC_COS(-0.98078528), SBC_COS( 0.00000000), SBC_COS( 0.98078528), SBC_COS( 0.38268343), SBC_COS(-0.83146961) },
+    { SBC_COS( 0.70710678), SBC_COS( 0.55557023), SBC_COS(-0.92387953), SBC_COS(-0.19509032), SBC_COS( 1.00000000), SBC_COS(-0.19509032), SBC_COS(-0.92387953), SBC_COS( 0.55557023),
+      SBC_COS( 0.70710678), SBC_COS(-0.83146961), SBC_COS(-0.38268343), SBC_COS( 0.98078528), SBC_COS( 0.00000000), SBC_COS(-0.98078528), SBC_COS( 0.38268343), SBC_COS( 0.83146961) },
+    { SBC_COS(-0.70710678), SBC_COS( 0.98078528), SBC_COS(-0.38268343), SBC_COS(-0.55557023), SBC_COS( 1.00000000), SBC_COS(-0.55557023), SBC_COS(-0.38268343), SBC_COS( 0.98078528),
+      SBC_COS(-0.70710678), SBC_COS(-0.19509032), SBC_COS( 0.92387953), SBC_COS(-0.83146961), SBC_COS( 0.00000000), SBC_COS( 0.83146961), SBC_COS(-0.92387953), SBC_COS( 0.19509032) },
+    { SBC_COS(-0.70710678), SBC_COS( 0.19509032), SBC_COS( 0.38268343), SBC_COS(-0.83146961), SBC_COS( 1.00000000), SBC_COS(-0.83146961), SBC_COS( 0.38268343), SBC_COS( 0.19509032),
+      SBC_COS(-0.70710678), SBC_COS( 0.98078528), SBC_COS(-0.92387953), SBC_COS( 0.55557023), SBC_COS( 0.00000000), SBC_COS(-0.55557023), SBC_COS( 0.92387953), SBC_COS(-0.98078528) },
+    { SBC_COS( 0.70710678), SBC_COS(-0.83146961), SBC_COS( 0.92387953), SBC_COS(-0.98078528), SBC_COS( 1.00000000), SBC_COS(-0.98078528), SBC_COS( 0.92387953), SBC_COS(-0.83146961),
+      SBC_COS( 0.70710678), SBC_COS(-0.55557023), SBC_COS( 0.38268343), SBC_COS(-0.19509032), SBC_COS( 0.00000000), SBC_COS( 0.19509032), SBC_COS(-0.38268343), SBC_COS( 0.55557023) },
+};
+
+//
+// Synthesis modulation, cos((i + 0.5) * (k + 4) * pi / 8), k = 0..15, i = 0..7.
+//
+static constexpr INT32 g_SbcSynthesisCos8[16][SBC_SUBBANDS_8] =
+{
+    { SBC_COS( 0.70710678), SBC_COS(-0.70710678), SBC_COS(-0.70710678), SBC_COS( 0.70710678), SBC_COS( 0.70710678), SBC_COS(-0.70710678), SBC_COS(-0.70710678), SBC_COS( 0.70710678) },
+    { SBC_COS( 0.55557023), SBC_COS(-0.98078528), SBC_COS( 0.19509032), SBC_COS( 0.83146961), SBC_COS(-0.83146961), SBC_COS(-0.19509032), SBC_COS( 0.98078528), SBC_COS(-0.55557023) },
+    { SBC_COS( 0.38268343), SBC_COS(-0.92387953), SBC_COS( 0.92387953), SBC_COS(-0.38268343), SBC_COS(-0.38268343), SBC_COS( 0.92387953), SBC_COS(-0.92387953), SBC_COS( 0.38268343) },
+    { SBC_COS( 0.19509032), SBC_COS(-0.55557023), SBC_COS( 0.83146961), SBC_COS(-0.98078528), SBC_COS( 0.98078528), SBC_COS(-0.83146961), SBC_COS( 0.55557023), SBC_COS(-0.19509032) },
+    { SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000), SBC_COS( 0.00000000) },
+    { SBC_COS(-0.19509032), SBC_COS( 0.55557023), SBC_COS(-0.83146961), SBC_COS( 0.98078528), SBC_COS(-0.98078528), SBC_COS( 0.83146961), SBC_COS(-0.55557023), SBC_COS( 0.19509032) },
+    { SBC_COS(-0.38268343), SBC_COS( 0.92387953), SBC_COS(-0.92387953), SBC_COS( 0.38268343), SBC_COS( 0.38268343), SBC_COS(-0.92387953), SBC_COS( 0.92387953), SBC_COS(-0.38268343) },
+    { SBC_COS(-0.55557023), SBC_COS( 0.98078528), SBC_COS(-0.19509032), SBC_COS(-0.83146961), SBC_COS( 0.83146961), SBC_COS( 0.19509032), SBC_COS(-0.98078528), SBC_COS( 0.55557023) },
+    { SBC_COS(-0.70710678), SBC_COS( 0.70710678), SBC_COS( 0.70710678), SBC_COS(-0.70710678), SBC_COS(-0.70710678), SBC_COS( 0.70710678), SBC_COS( 0.70710678), SBC_COS(-0.70710678) },
+    { SBC_COS(-0.83146961), SBC_COS( 0.19509032), SBC_COS( 0.98078528), SBC_COS( 0.55557023), SBC_COS(-0.55557023), SBC_COS(-0.98078528), SBC_COS(-0.19509032), SBC_COS( 0.83146961) },
+    { SBC_COS(-0.92387953), SBC_COS(-0.38268343), SBC_COS( 0.38268343), SBC_COS( 0.92387953), SBC_COS( 0.92387953), SBC_COS( 0.38268343), SBC_COS(-0.38268343), SBC_COS(-0.92387953) },
+    { SBC_COS(-0.98078528), SBC_COS(-0.83146961), SBC_COS(-0.55557023), SBC_COS(-0.19509032), SBC_COS( 0.19509032), SBC_COS( 0.55557023), SBC_COS( 0.83146961), SBC_COS( 0.98078528) },
+    { SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000), SBC_COS(-1.00000000) },
+    { SBC_COS(-0.98078528), SBC_COS(-0.83146961), SBC_COS(-0.55557023), SBC_COS(-0.19509032), SBC_COS( 0.19509032), SBC_COS( 0.55557023), SBC_COS( 0.83146961), SBC_COS( 0.98078528) },
+    { SBC_COS(-0.92387953), SBC_COS(-0.38268343), SBC_COS( 0.38268343), SBC_COS( 0.92387953), SBC_COS( 0.92387953), SBC_COS( 0.38268343), SBC_COS(-0.38268343), SBC_COS(-0.92387953) },
+    { SBC_COS(-0.83146961), SBC_COS( 0.19509032), SBC_COS( 0.98078528), SBC_COS( 0.55557023), SBC_COS(-0.55557023), SBC_COS(-0.98078528), SBC_COS(-0.19509032), SBC_COS( 0.83146961) },
+};
+
+//
+// Loudness offsets for 8 subbands, by sampling frequency.
+//
+static const INT8 g_SbcOffset8[4][SBC_SUBBANDS_8] =
+{
+    { -2, 0, 0, 0, 0, 0, 0, 1 },    // 16 kHz
+    { -3, 0, 0, 0, 0, 0, 1, 2 },    // 32 kHz
+    { -4, 0, 0, 0, 0, 0, 1, 2 },    // 44.1 kHz
+    { -4, 0, 0, 0, 0, 0, 1, 2 },    // 48 kHz
+};
+
+typedef struct _SBC_ANALYSIS_STATE
+{
+    INT32       X[SBC_WINDOW_8];        // newest sample first
+} SBC_ANALYSIS_STATE;
+
+typedef struct _SBC_SYNTHESIS_STATE
+{
+    LONGLONG    V[2 * SBC_WINDOW_8];    // newest vector first
+} SBC_SYNTHESIS_STATE;
+
+//
+// Analyzes 8 PCM samples (oldest first) into one block of 8 subband samples.
+//
+inline VOID SbcAnalyze8
+(
+    _Inout_                         SBC_ANALYSIS_STATE  *State,
+    _In_reads_(SBC_SUBBANDS_8)      const INT16         *Pcm,
+    _Out_writes_(SBC_SUBBANDS_8)    INT32               *Subbands
+)
+{
+    LONGLONG y[16];
+
+    RtlMoveMemory(&State->X[SBC_SUBBANDS_8], &State->X[0], (SBC_WINDOW_8 - SBC_SUBBANDS_8) * sizeof(INT32));
+    for (ULONG i = 0; i < SBC_SUBBANDS_8; i++)
+    {
+        State->X[SBC_SUBBANDS_8 - 1 - i] = Pcm[i];
+    }
+
+    //
+    // Window: Y[i] = sum over the five phases of C[i + 16j] * X[i + 16j].
+    //
+    for (ULONG i = 0; i < 16; i++)
+    {
+        y[i] = (LONGLONG)g_SbcWindow8[i]      * State->X[i]      +
+               (LONGLONG)g_SbcWindow8[i + 16] * State->X[i + 16] +
+               (LONGLONG)g_SbcWindow8[i + 32] * State->X[i + 32] +
+               (LONGLONG)g_SbcWindow8[i + 48] * State->X[i + 48] +
+               (LONGLONG)g_SbcWindow8[i + 64] * State->X[i + 64];
+    }
+
+    //
+    // Modulation: S[k] = sum of M[k][i] * Y[i].
+    //
+    for (ULONG k = 0; k < SBC_SUBBANDS_8; k++)
+    {
+        LONGLONG s = 0;
+
+        for (ULONG i = 0; i < 16; i++)
+        {
+            s += g_SbcCos8[k][i] * y[i];
+        }
+
+        Subbands[k] = (INT32)(s >> (SBC_COEF_FRAC + SBC_COS_FRAC - SBC_SB_FRAC));
+    }
+}
+
+//
+// Synthesizes 8 PCM samples (oldest first) from one block of 8 subband
+// samples.
+//
+inline VOID SbcSynthesize8
+(
+    _Inout_                         SBC_SYNTHESIS_STATE *State,
+    _In_reads_(SBC_SUBBANDS_8)      const INT32         *Subbands,
+    _Out_writes_(SBC_SUBBANDS_8)    INT16               *Pcm
+)
+{
+    LONGLONG *v = State->V;
+
+    RtlMoveMemory(&v[16], &v[0], (2 * SBC_WINDOW_8 - 16) * sizeof(LONGLONG));
+
+    //
+    // V[k] = sum of N[k][i] * S[i], N[k][i] = cos((i + 0.5) * (k + 4) * pi / 8).
+    //
+    for (ULONG k = 0; k < 16; k++)
+    {
+        LONGLONG s = 0;
+
+        for (ULONG i = 0; i < SBC_SUBBANDS_8; i++)
+        {
+            s += (LONGLONG)g_SbcSynthesisCos8[k][i] * Subbands[i];
+        }
+
+        v[k] = s >> SBC_COS_FRAC;
+    }
+
+    //
+    // Build U from V, window it with D = -8 * C and sum the ten taps of
+    // every output sample.
+    //
+    for (ULONG j = 0; j < SBC_SUBBANDS_8; j++)
+    {
+        LONGLONG out = 0;
+
+        for (ULONG i = 0; i < 5; i++)
+        {
+            out += v[i * 32 + j]      * g_SbcWindow8[i * 16 + j];
+            out += v[i * 32 + 24 + j] * g_SbcWindow8[i * 16 + 8 + j];
+        }
+
+        out = -(out * 8) >> (SBC_COEF_FRAC + SBC_SB_FRAC);
+        Pcm[j] = (INT16)((out > 32767) ? 32767 : ((out < -32768) ? -32768 : out));
+    }
+}
+
+//
+// Smallest scale factor whose range 2^(scf + 1) holds every sample.
+//
+inline UINT8 SbcScaleFactor
+(
+    _In_reads_(Count)   const INT32 *Samples,
+    _In_                ULONG       Count,
+    _In_                ULONG       Stride
+)
+{
+    ULONG   peak = 0;
+    UINT8   scf = 0;
+
+    for (ULONG i = 0; i < Count; i++)
+    {
+        INT32 s = Samples[i * Stride];
+        ULONG a = (ULONG)((s < 0) ? -(LONGLONG)s : s);
+
+        peak = (a > peak) ? a : peak;
+    }
+
+    while (scf < SBC_MAX_SCALE_FACTOR &&
+           (ULONGLONG)peak >= (1ULL << (scf + 1 + SBC_SB_FRAC)))
+    {
+        scf++;
+    }
+
+    return scf;
+}
+
+//
+// Bit allocation of the SBC specification. ScaleFactors and Bits hold
+// ChannelCount runs of SubbandCount entries; two channels share the
+// bitpool as in the stereo and joint stereo modes, and the leftover bits
+// go out subband by subband, alternating between the channels.
+//
+inline VOID SbcAllocateBits
+(
+    _In_reads_(ChannelCount * SubbandCount)     const UINT8 *ScaleFactors,
+    _In_                                        ULONG       ChannelCount,
+    _In_                                        ULONG       SubbandCount,
+    _In_                                        ULONG       Frequency,
+    _In_                                        ULONG       Allocation,
+    _In_                                        ULONG       Bitpool,
+    _Out_writes_(ChannelCount * SubbandCount)   UINT8       *Bits
+)
+{
+    INT32   bitneed[SBC_MAX_CHANNELS * SBC_SUBBANDS_8];
+    INT32   maxBitneed = 0;
+    INT32   bitcount = 0;
+    INT32   slicecount = 0;
+    INT32   bitslice = 0;
+    ULONG   count = ChannelCount * SubbandCount;
+    ULONG   i = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        ULONG sb = i % SubbandCount;
+
+        if (Allocation == SBC_ALLOCATION_SNR)
+        {
+            bitneed[i] = ScaleFactors[i];
+        }
+        else if (ScaleFactors[i] == 0)
+        {
+            bitneed[i] = -5;
+        }
+        else
+        {
+            INT32 loudness = ScaleFactors[i] - g_SbcOffset8[Frequency][sb];
+
+            bitneed[i] = (loudness > 0) ? loudness / 2 : loudness;
+        }
+
+        maxBitneed = (bitneed[i] > maxBitneed) ? bitneed[i] : maxBitneed;
+    }
+
+    bitslice = maxBitneed + 1;
+    do
+    {
+        bitslice--;
+        bitcount += slicecount;
+        slicecount = 0;
+
+        for (i = 0; i < count; i++)
+        {
+            if (bitneed[i] > bitslice + 1 && bitneed[i] < bitslice + 16)
+            {
+                slicecount++;
+            }
+            else if (bitneed[i] == bitslice + 1)
+            {
+                slicecount += 2;
+            }
+        }
+    } while (bitcount + slicecount < (INT32)Bitpool);
+
+    if (bitcount + slicecount == (INT32)Bitpool)
+    {
+        bitcount += slicecount;
+        bitslice--;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        INT32 bits = (bitneed[i] < bitslice + 2) ? 0 : bitneed[i] - bitslice;
+
+        Bits[i] = (UINT8)((bits > SBC_MAX_BITS) ? SBC_MAX_BITS : bits);
+    }
+
+    //
+    // j walks subband 0 of every channel, then subband 1, and so on.
+    //
+    for (ULONG j = 0; bitcount < (INT32)Bitpool && j < count; j++)
+    {
+        i = (j % ChannelCount) * SubbandCount + j / ChannelCount;
+
+        if (Bits[i] >= 2 && Bits[i] < SBC_MAX_BITS)
+        {
+            Bits[i]++;
+            bitcount++;
+        }
+        else if (bitneed[i] == bitslice + 1 && (INT32)Bitpool > bitcount + 1)
+        {
+            Bits[i] = 2;
+            bitcount += 2;
+        }
+    }
+
+    for (ULONG j = 0; bitcount < (INT32)Bitpool && j < count; j++)
+    {
+        i = (j % ChannelCount) * SubbandCount + j / ChannelCount;
+
+        if (Bits[i] < SBC_MAX_BITS)
+        {
+            Bits[i]++;
+            bitcount++;
+        }
+    }
+}
+
+//
+// floor((Sample / 2^(scf + 1) + 1) * levels / 2), levels = 2^Bits - 1.
+//
+inline ULONG SbcQuantize
+(
+    _In_ INT32  Sample,
+    _In_ UINT8  ScaleFactor,
+    _In_ UINT8  Bits
+)
+{
+    LONGLONG levels = (1LL << Bits) - 1;
+    LONGLONG offset = (LONGLONG)Sample + (1LL << (ScaleFactor + 1 + SBC_SB_FRAC));
+
+    return (ULONG)((offset * levels) >> (ScaleFactor + 2 + SBC_SB_FRAC));
+}
+
+//
+// 2^(scf + 1) * ((2 * Code + 1) / levels - 1).
+//
+inline INT32 SbcDequantize
+(
+    _In_ ULONG  Code,
+    _In_ UINT8  ScaleFactor,
+    _In_ UINT8  Bits
+)
+{
+    LONGLONG levels = (1LL << Bits) - 1;
+    LONGLONG range = 1LL << (ScaleFactor + 1 + SBC_SB_FRAC);
+
+    return (INT32)((((2LL * Code + 1) * range) / levels) - range);
+}
+
+//
+// MSB first bit writer and reader over a frame.
+//
+typedef struct _SBC_BITSTREAM
+{
+    BYTE *      Data;
+    ULONG       Bit;
+} SBC_BITSTREAM;
+
+//
+// Feeds BitCount bits of Value, MSB first, to the frame check CRC-8.
+//
+inline VOID SbcCrcBits
+(
+    _Inout_ UINT8   *Crc,
+    _In_    ULONG   Value,
+    _In_    ULONG   BitCount
+)
+{
+    while (BitCount-- > 0)
+    {
+        UINT8 feedback = (UINT8)(((*Crc >> 7) ^ (Value >> BitCount)) & 1);
+
+        *Crc = (UINT8)(*Crc << 1);
+        if (feedback)
+        {
+            *Crc ^= SBC_CRC_POLY;
+        }
+    }
+}
+
+inline VOID SbcPutBits
+(
+    _Inout_ SBC_BITSTREAM   *Stream,
+    _In_    ULONG           Value,
+    _In_    ULONG           BitCount
+)
+{
+    while (BitCount-- > 0)
+    {
+        BYTE *byte = &Stream->Data[Stream->Bit / 8];
+        BYTE mask = (BYTE)(0x80 >> (Stream->Bit % 8));
+
+        if ((Value >> BitCount) & 1)
+        {
+            *byte |= mask;
+        }
+        else
+        {
+            *byte &= (BYTE)~mask;
+        }
+        Stream->Bit++;
+    }
+}
+
+inline ULONG SbcGetBits
+(
+    _Inout_ SBC_BITSTREAM   *Stream,
+    _In_    ULONG           BitCount
+)
+{
+    ULONG value = 0;
+
+    while (BitCount-- > 0)
+    {
+        value = (value << 1) | ((Stream->Data[Stream->Bit / 8] >> (7 - Stream->Bit % 8)) & 1);
+        Stream->Bit++;
+    }
+
+    return value;
+}
+
+//
+// Encodes MSBC_SAMPLES 16 kHz samples into one MSBC_FRAME_BYTES frame.
+//
+inline VOID MsbcEncodeFrame
+(
+    _Inout_                         SBC_ANALYSIS_STATE  *State,
+    _In_reads_(MSBC_SAMPLES)        const INT16         *Pcm,
+    _Out_writes_(MSBC_FRAME_BYTES)  BYTE                *Frame
+)
+{
+    INT32           subbands[MSBC_BLOCKS][SBC_SUBBANDS_8];
+    UINT8           scaleFactors[SBC_SUBBANDS_8];
+    UINT8           bits[SBC_SUBBANDS_8];
+    UINT8           crc = SBC_CRC_INIT;
+    SBC_BITSTREAM   stream = { Frame, 0 };
+
+    for (ULONG blk = 0; blk < MSBC_BLOCKS; blk++)
+    {
+        SbcAnalyze8(State, &Pcm[blk * SBC_SUBBANDS_8], subbands[blk]);
+    }
+
+    for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+    {
+        scaleFactors[sb] = SbcScaleFactor(&subbands[0][sb], MSBC_BLOCKS, SBC_SUBBANDS_8);
+    }
+
+    SbcAllocateBits(scaleFactors, 1, SBC_SUBBANDS_8, SBC_FREQ_16000, SBC_ALLOCATION_LOUDNESS, MSBC_BITPOOL, bits);
+
+    RtlZeroMemory(Frame, MSBC_FRAME_BYTES);
+
+    //
+    // Sync word, two reserved bytes (covered by the CRC) and the CRC itself,
+    // which is filled in once the scale factors went through it.
+    //
+    SbcPutBits(&stream, MSBC_SYNCWORD, 8);
+    SbcPutBits(&stream, 0, 16);
+    SbcCrcBits(&crc, 0, 16);
+    SbcPutBits(&stream, 0, 8);
+
+    for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+    {
+        SbcPutBits(&stream, scaleFactors[sb], 4);
+        SbcCrcBits(&crc, scaleFactors[sb], 4);
+    }
+
+    for (ULONG blk = 0; blk < MSBC_BLOCKS; blk++)
+    {
+        for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+        {
+            if (bits[sb] != 0)
+            {
+                SbcPutBits(&stream, SbcQuantize(subbands[blk][sb], scaleFactors[sb], bits[sb]), bits[sb]);
+            }
+        }
+    }
+
+    Frame[3] = crc;
+}
+
+//
+// Decodes one MSBC_FRAME_BYTES frame into MSBC_SAMPLES 16 kHz samples.
+// Returns FALSE, leaving Pcm and the state untouched, if the frame is not
+// a valid mSBC frame.
+//
+inline BOOLEAN MsbcDecodeFrame
+(
+    _Inout_                         SBC_SYNTHESIS_STATE *State,
+    _In_reads_(MSBC_FRAME_BYTES)    const BYTE          *Frame,
+    _Out_writes_(MSBC_SAMPLES)      INT16               *Pcm
+)
+{
+    INT32           subbands[SBC_SUBBANDS_8];
+    UINT8           scaleFactors[SBC_SUBBANDS_8];
+    UINT8           bits[SBC_SUBBANDS_8];
+    UINT8           crc = SBC_CRC_INIT;
+    SBC_BITSTREAM   stream = { const_cast<BYTE *>(Frame), 32 };
+
+    if (Frame[0] != MSBC_SYNCWORD || Frame[1] != 0 || Frame[2] != 0)
+    {
+        return FALSE;
+    }
+
+    SbcCrcBits(&crc, 0, 16);
+    for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+    {
+        scaleFactors[sb] = (UINT8)SbcGetBits(&stream, 4);
+        SbcCrcBits(&crc, scaleFactors[sb], 4);
+    }
+
+    if (crc != Frame[3])
+    {
+        return FALSE;
+    }
+
+    SbcAllocateBits(scaleFactors, 1, SBC_SUBBANDS_8, SBC_FREQ_16000, SBC_ALLOCATION_LOUDNESS, MSBC_BITPOOL, bits);
+
+    for (ULONG blk = 0; blk < MSBC_BLOCKS; blk++)
+    {
+        for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+        {
+            subbands[sb] = (bits[sb] != 0) ?
+                SbcDequantize(SbcGetBits(&stream, bits[sb]), scaleFactors[sb], bits[sb]) : 0;
+        }
+
+        SbcSynthesize8(State, subbands, &Pcm[blk * SBC_SUBBANDS_8]);
+    }
+
+    return TRUE;
+}
+
+//
+// A2DP SBC encoder: configuration, one analysis state per channel and the
+// subband samples of the frame being encoded.
+//
+typedef struct _SBC_ENCODER
+{
+    ULONG               Frequency;      // SBC_FREQ_*
+    ULONG               Blocks;         // 4, 8, 12 or 16
+    ULONG               ChannelMode;    // SBC_CHANNEL_MODE_*
+    ULONG               Allocation;     // SBC_ALLOCATION_*
+    ULONG               Bitpool;
+    SBC_ANALYSIS_STATE  Analysis[SBC_MAX_CHANNELS];
+    INT32               Subbands[SBC_MAX_BLOCKS][SBC_MAX_CHANNELS][SBC_SUBBANDS_8];
+} SBC_ENCODER;
+
+inline ULONG SbcChannelCount(_In_ ULONG ChannelMode)
+{
+    return (ChannelMode == SBC_CHANNEL_MODE_MONO) ? 1 : 2;
+}
+
+//
+// Encoded size of one frame with the current configuration.
+//
+inline ULONG SbcFrameLength(_In_ const SBC_ENCODER *Encoder)
+{
+    ULONG channels = SbcChannelCount(Encoder->ChannelMode);
+    ULONG dataBits;
+
+    switch (Encoder->ChannelMode)
+    {
+    case SBC_CHANNEL_MODE_MONO:
+    case SBC_CHANNEL_MODE_DUAL:
+        dataBits = Encoder->Blocks * channels * Encoder->Bitpool;
+        break;
+    case SBC_CHANNEL_MODE_JOINT:
+        dataBits = SBC_SUBBANDS_8 + Encoder->Blocks * Encoder->Bitpool;
+        break;
+    default:
+        dataBits = Encoder->Blocks * Encoder->Bitpool;
+        break;
+    }
+
+    return SBC_HEADER_BYTES + channels * SBC_SUBBANDS_8 / 2 + (dataBits + 7) / 8;
+}
+
+//
+// Encodes Blocks * 8 frames of interleaved 16-bit PCM, one or two channels
+// as the channel mode says, into Frame. Returns the frame length.
+//
+inline ULONG SbcEncodeFrame
+(
+    _Inout_                             SBC_ENCODER *Encoder,
+    _In_                                const INT16 *Pcm,
+    _Out_writes_(SBC_MAX_FRAME_BYTES)   BYTE        *Frame
+)
+{
+    ULONG           channels = SbcChannelCount(Encoder->ChannelMode);
+    UINT8           scaleFactors[SBC_MAX_CHANNELS * SBC_SUBBANDS_8];
+    UINT8           bits[SBC_MAX_CHANNELS * SBC_SUBBANDS_8];
+    ULONG           join = 0;
+    UINT8           crc = SBC_CRC_INIT;
+    SBC_BITSTREAM   stream = { Frame, 0 };
+    ULONG           header;
+
+    for (ULONG blk = 0; blk < Encoder->Blocks; blk++)
+    {
+        for (ULONG ch = 0; ch < channels; ch++)
+        {
+            INT16 pcm[SBC_SUBBANDS_8];
+
+            for (ULONG i = 0; i < SBC_SUBBANDS_8; i++)
+            {
+                pcm[i] = Pcm[(blk * SBC_SUBBANDS_8 + i) * channels + ch];
+            }
+
+            SbcAnalyze8(&Encoder->Analysis[ch], pcm, Encoder->Subbands[blk][ch]);
+        }
+    }
+
+    for (ULONG ch = 0; ch < channels; ch++)
+    {
+        for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+        {
+            scaleFactors[ch * SBC_SUBBANDS_8 + sb] =
+                SbcScaleFactor(&Encoder->Subbands[0][ch][sb], Encoder->Blocks, SBC_MAX_CHANNELS * SBC_SUBBANDS_8);
+        }
+    }
+
+    //
+    // Joint stereo: code a subband (the last one excepted) as mid and side
+    // when that needs smaller scale factors than left and right.
+    //
+    if (Encoder->ChannelMode == SBC_CHANNEL_MODE_JOINT)
+    {
+        for (ULONG sb = 0; sb < SBC_SUBBANDS_8 - 1; sb++)
+        {
+            INT32 mid[SBC_MAX_BLOCKS];
+            INT32 side[SBC_MAX_BLOCKS];
+            UINT8 scfMid;
+            UINT8 scfSide;
+
+            for (ULONG blk = 0; blk < Encoder->Blocks; blk++)
+            {
+                INT32 left = Encoder->Subbands[blk][0][sb];
+                INT32 right = Encoder->Subbands[blk][1][sb];
+
+                mid[blk] = (left >> 1) + (right >> 1);
+                side[blk] = (left >> 1) - (right >> 1);
+            }
+
+            scfMid = SbcScaleFactor(mid, Encoder->Blocks, 1);
+            scfSide = SbcScaleFactor(side, Encoder->Blocks, 1);
+
+            if (scfMid + scfSide < scaleFactors[sb] + scaleFactors[SBC_SUBBANDS_8 + sb])
+            {
+                join |= 0x80 >> sb;
+                scaleFactors[sb] = scfMid;
+                scaleFactors[SBC_SUBBANDS_8 + sb] = scfSide;
+
+                for (ULONG blk = 0; blk < Encoder->Blocks; blk++)
+                {
+                    Encoder->Subbands[blk][0][sb] = mid[blk];
+                    Encoder->Subbands[blk][1][sb] = side[blk];
+                }
+            }
+        }
+    }
+
+    if (Encoder->ChannelMode == SBC_CHANNEL_MODE_DUAL)
+    {
+        for (ULONG ch = 0; ch < channels; ch++)
+        {
+            SbcAllocateBits(&scaleFactors[ch * SBC_SUBBANDS_8], 1, SBC_SUBBANDS_8, Encoder->Frequency,
+                            Encoder->Allocation, Encoder->Bitpool, &bits[ch * SBC_SUBBANDS_8]);
+        }
+    }
+    else
+    {
+        SbcAllocateBits(scaleFactors, channels, SBC_SUBBANDS_8, Encoder->Frequency,
+                        Encoder->Allocation, Encoder->Bitpool, bits);
+    }
+
+    //
+    // Header: sync word, frequency/blocks/mode/allocation/subbands, bitpool
+    // and the CRC, which covers everything up to the scale factors.
+    //
+    header = (Encoder->Frequency << 6) | ((Encoder->Blocks / 4 - 1) << 4) |
+             (Encoder->ChannelMode << 2) | (Encoder->Allocation << 1) | 1;
+
+    SbcPutBits(&stream, SBC_SYNCWORD, 8);
+    SbcPutBits(&stream, header, 8);
+    SbcCrcBits(&crc, header, 8);
+    SbcPutBits(&stream, Encoder->Bitpool, 8);
+    SbcCrcBits(&crc, Encoder->Bitpool, 8);
+    SbcPutBits(&stream, 0, 8);
+
+    if (Encoder->ChannelMode == SBC_CHANNEL_MODE_JOINT)
+    {
+        SbcPutBits(&stream, join, SBC_SUBBANDS_8);
+        SbcCrcBits(&crc, join, SBC_SUBBANDS_8);
+    }
+
+    for (ULONG i = 0; i < channels * SBC_SUBBANDS_8; i++)
+    {
+        SbcPutBits(&stream, scaleFactors[i], 4);
+        SbcCrcBits(&crc, scaleFactors[i], 4);
+    }
+
+    for (ULONG blk = 0; blk < Encoder->Blocks; blk++)
+    {
+        for (ULONG ch = 0; ch < channels; ch++)
+        {
+            for (ULONG sb = 0; sb < SBC_SUBBANDS_8; sb++)
+            {
+                ULONG i = ch * SBC_SUBBANDS_8 + sb;
+
+                if (bits[i] != 0)
+                {
+                    SbcPutBits(&stream, SbcQuantize(Encoder->Subbands[blk][ch][sb], scaleFactors[i], bits[i]), bits[i]);
+                }
+            }
+        }
+    }
+
+    //
+    // Zero the padding up to the byte boundary.
+    //
+    if (stream.Bit % 8 != 0)
+    {
+        SbcPutBits(&stream, 0, 8 - stream.Bit % 8);
+    }
+
+    Frame[3] = crc;
+
+    return stream.Bit / 8;
+}
+
+#endif // _SYSVAD_SBCCODEC_H_
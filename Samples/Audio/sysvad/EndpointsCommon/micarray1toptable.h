@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_MICARRAY1TOPTABLE_H_
 #define _SYSVAD_MICARRAY1TOPTABLE_H_
 
+#include "SysVadShared.h"
+
 //
 // {6ae81ff4-203e-4fe1-88aa-f2d57775cd4a}
 DEFINE_GUID(MICARRAY1_CUSTOM_NAME, 
@@ -98,6 +100,12 @@ PCPROPERTY_ITEM MicArray1PropertiesVolume[] =
     KSPROPERTY_AUDIO_VOLUMELEVEL,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+    },
+    {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
     }
 };
 
@@ -112,6 +120,12 @@ PCPROPERTY_ITEM MicArray1PropertiesMute[] =
     KSPROPERTY_AUDIO_MUTE,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_MUTEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
   }
 };
 
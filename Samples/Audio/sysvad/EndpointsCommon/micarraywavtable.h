@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_MICARRAYWAVTABLE_H_
 #define _SYSVAD_MICARRAYWAVTABLE_H_
 
+#include "SysVadShared.h"
+
 //
 // Mic array range.
 //
@@ -717,6 +719,7 @@ DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_SoundDetectorArmed2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Set_SoundDetectorArmed2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Set_SoundDetectorReset2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_SoundDetectorStreamingSupport2);
+DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_KeywordBurstRead);
 
 
 static
@@ -917,6 +920,21 @@ SYSVADPROPERTY_ITEM PropertiesMicArrayWaveFilter[] =
         NULL,
         0
     },
+    {
+        {
+            &KSPROPSETID_SysVAD,
+            KSPROPERTY_SYSVAD_KEYWORDBURSTREAD,
+            KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+            SysvadPropertyDispatch,
+        },
+        sizeof(KSP_PIN) - sizeof(KSPROPERTY),
+        SYSVAD_KEYWORD_BURST_SIZE(1),
+        CMiniportWaveRT_Get_KeywordBurstRead,
+        NULL,
+        NULL,
+        NULL,
+        0
+    },
 };
 
 NTSTATUS CMiniportWaveRT_EventHandler_SoundDetectorMatchDetected(
@@ -187,12 +187,23 @@ Return Value:
         m_LoopbackStreams = NULL;
     }
 
+    AudioModule_CleanupIndex(&m_AudioModuleIndex);
+
     if (m_pAudioModules)
     {
         FreeStreamAudioModules(m_pAudioModules, GetAudioModuleListCount());
         m_pAudioModules = NULL;
     }
 
+    if (m_FormatIndex)
+    {
+        ExFreePoolWithTag( m_FormatIndex, MINWAVERT_POOLTAG );
+        m_FormatIndex = NULL;
+    }
+
+    // Every stream holds a reference on the miniport, so all blocks are back.
+    ExDeleteNPagedLookasideList(&m_StreamBlockPool);
+
 #if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND)
     if (IsSidebandDevice())
     {
@@ -440,6 +451,20 @@ Return Value:
             m_pAudioModules[i].Context    = NULL;
             m_pAudioModules[i].InstanceId = moduleDesc->InstanceId;
             m_pAudioModules[i].Enabled    = TRUE;
+            m_pAudioModules[i].Notifier   = NULL;
+
+            if (m_pPortClsNotifications != NULL)
+            {
+                ntStatus = AudioModule_CreateNotifier(&m_pAudioModules[i].Notifier,
+                                                      m_pPortClsNotifications,
+                                                      m_pAdapterCommon->GetDeviceObject(),
+                                                      g_AudioModuleNotificationIntervalMs);
+                if (!NT_SUCCESS(ntStatus))
+                {
+                    return ntStatus;
+                }
+            }
+
             //
             // Module context size.
             //
@@ -467,7 +492,7 @@ Return Value:
                                                  m_pAudioModules[i].Context,
                                                  size,
                                                  &NotificationHeader,
-                                                 m_pPortClsNotifications);
+                                                 m_pAudioModules[i].Notifier);
                 if (!NT_SUCCESS(ntStatus))
                 {
                     ASSERT(FALSE);
@@ -477,6 +502,12 @@ Return Value:
         }
     }
 
+    ntStatus = AudioModule_InitIndex(&m_AudioModuleIndex, m_pAudioModules, cModules);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return ntStatus;
+    }
+
     //
     // Init the audio-engine used by the render devices.
     //
@@ -597,6 +628,15 @@ Return Value:
         }
     }
     
+    //
+    // Index the device formats before anything can swap them.
+    //
+    ntStatus = BuildFormatIndex();
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return ntStatus;
+    }
+
     // 
     // For KS event support.
     //
@@ -1505,6 +1545,8 @@ CMiniportWaveRT::IsFormatSupported
     NTSTATUS                            ntStatus = STATUS_NO_MATCH;
     PKSDATAFORMAT_WAVEFORMATEXTENSIBLE  pPinFormats = NULL;
     ULONG                               cPinFormats = 0;
+    PWAVEFORMATEX                       pWaveFormat = reinterpret_cast<PWAVEFORMATEX>(_pDataFormat + 1);
+    PFORMAT_INDEX                       pIndex = NULL;
 
     UNREFERENCED_PARAMETER(_bCapture);
 
@@ -1515,46 +1557,254 @@ CMiniportWaveRT::IsFormatSupported
 
     cPinFormats = GetPinSupportedDeviceFormats(_ulPin, &pPinFormats);
 
-    for (UINT iFormat = 0; iFormat < cPinFormats; iFormat++)
+    if (m_FormatIndex != NULL && _ulPin < m_DeviceFormatsAndModesCount)
     {
-        PKSDATAFORMAT_WAVEFORMATEXTENSIBLE pFormat = &pPinFormats[iFormat];
-        // KSDATAFORMAT VALIDATION
-        if (!IsEqualGUIDAligned(pFormat->DataFormat.MajorFormat, _pDataFormat->MajorFormat)) { continue; }
-        if (!IsEqualGUIDAligned(pFormat->DataFormat.SubFormat, _pDataFormat->SubFormat)) { continue; }
-        if (!IsEqualGUIDAligned(pFormat->DataFormat.Specifier, _pDataFormat->Specifier)) { continue; }
-        if (pFormat->DataFormat.FormatSize < sizeof(KSDATAFORMAT_WAVEFORMATEX)) { continue; }
+        pIndex = &m_FormatIndex[_ulPin];
+    }
 
-        // WAVEFORMATEX VALIDATION
-        PWAVEFORMATEX pWaveFormat = reinterpret_cast<PWAVEFORMATEX>(_pDataFormat + 1);
-        
-        if (pWaveFormat->wFormatTag != WAVE_FORMAT_EXTENSIBLE)
+    //
+    // The index is only valid for the table it was built from; a sideband
+    // device may have swapped the formats since.
+    //
+    if (pIndex != NULL && pIndex->Slots != NULL &&
+        pIndex->Formats == pPinFormats && pIndex->FormatCount == cPinFormats)
+    {
+        USHORT usFormatTag = pWaveFormat->wFormatTag;
+
+        if (usFormatTag == WAVE_FORMAT_EXTENSIBLE)
         {
-            if (pWaveFormat->wFormatTag != EXTRACT_WAVEFORMATEX_ID(&(pFormat->WaveFormatExt.SubFormat))) { continue; }
+            if (pWaveFormat->cbSize < sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+            {
+                return STATUS_NO_MATCH;
+            }
+
+            usFormatTag = EXTRACT_WAVEFORMATEX_ID(&(reinterpret_cast<PWAVEFORMATEXTENSIBLE>(pWaveFormat)->SubFormat));
+        }
+
+        ULONG iSlot = HashFormat(usFormatTag, pWaveFormat->nChannels, pWaveFormat->nSamplesPerSec, pWaveFormat->wBitsPerSample);
+
+        for (;; iSlot++)
+        {
+            USHORT usEntry = pIndex->Slots[iSlot & pIndex->SlotMask];
+
+            if (usEntry == 0)
+            {
+                break;
+            }
+
+            if (IsFormatMatch(&pPinFormats[usEntry - 1], _pDataFormat))
+            {
+                ntStatus = STATUS_SUCCESS;
+                break;
+            }
         }
-        if (pWaveFormat->nChannels  != pFormat->WaveFormatExt.Format.nChannels) { continue; }
-        if (pWaveFormat->nSamplesPerSec != pFormat->WaveFormatExt.Format.nSamplesPerSec) { continue; }
-        if (pWaveFormat->nBlockAlign != pFormat->WaveFormatExt.Format.nBlockAlign) { continue; }
-        if (pWaveFormat->wBitsPerSample != pFormat->WaveFormatExt.Format.wBitsPerSample) { continue; }
 
-        if (pWaveFormat->wFormatTag != WAVE_FORMAT_EXTENSIBLE)
+        return ntStatus;
+    }
+
+    for (UINT iFormat = 0; iFormat < cPinFormats; iFormat++)
+    {
+        if (IsFormatMatch(&pPinFormats[iFormat], _pDataFormat))
         {
             ntStatus = STATUS_SUCCESS;
             break;
         }
+    }
 
-        // WAVEFORMATEXTENSIBLE VALIDATION
-        if (pWaveFormat->cbSize < sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) { continue; }
+    return ntStatus;
+}
 
-        PWAVEFORMATEXTENSIBLE pWaveFormatExt = reinterpret_cast<PWAVEFORMATEXTENSIBLE>(pWaveFormat);
-        if (pWaveFormatExt->Samples.wValidBitsPerSample != pFormat->WaveFormatExt.Samples.wValidBitsPerSample) { continue; }
-        if (pWaveFormatExt->dwChannelMask != pFormat->WaveFormatExt.dwChannelMask) { continue; }
-        if (!IsEqualGUIDAligned(pWaveFormatExt->SubFormat, pFormat->WaveFormatExt.SubFormat)) { continue; }
+//=============================================================================
+#pragma code_seg("PAGE")
+BOOL
+CMiniportWaveRT::IsFormatMatch
+(
+    _In_ PKSDATAFORMAT_WAVEFORMATEXTENSIBLE _pFormat,
+    _In_ PKSDATAFORMAT  _pDataFormat
+)
+/*++
 
-        ntStatus = STATUS_SUCCESS;
-        break;
+Routine Description:
+
+  Compares a requested data format with one of the device formats.
+
+Arguments:
+
+  _pFormat - device format
+
+  _pDataFormat - requested format, followed by its WAVEFORMATEX
+
+Return Value:
+
+  TRUE if the requested format is the device format.
+
+--*/
+{
+    PAGED_CODE();
+
+    // KSDATAFORMAT VALIDATION
+    if (!IsEqualGUIDAligned(_pFormat->DataFormat.MajorFormat, _pDataFormat->MajorFormat)) { return FALSE; }
+    if (!IsEqualGUIDAligned(_pFormat->DataFormat.SubFormat, _pDataFormat->SubFormat)) { return FALSE; }
+    if (!IsEqualGUIDAligned(_pFormat->DataFormat.Specifier, _pDataFormat->Specifier)) { return FALSE; }
+    if (_pFormat->DataFormat.FormatSize < sizeof(KSDATAFORMAT_WAVEFORMATEX)) { return FALSE; }
+
+    // WAVEFORMATEX VALIDATION
+    PWAVEFORMATEX pWaveFormat = reinterpret_cast<PWAVEFORMATEX>(_pDataFormat + 1);
+    
+    if (pWaveFormat->wFormatTag != WAVE_FORMAT_EXTENSIBLE)
+    {
+        if (pWaveFormat->wFormatTag != EXTRACT_WAVEFORMATEX_ID(&(_pFormat->WaveFormatExt.SubFormat))) { return FALSE; }
     }
+    if (pWaveFormat->nChannels  != _pFormat->WaveFormatExt.Format.nChannels) { return FALSE; }
+    if (pWaveFormat->nSamplesPerSec != _pFormat->WaveFormatExt.Format.nSamplesPerSec) { return FALSE; }
+    if (pWaveFormat->nBlockAlign != _pFormat->WaveFormatExt.Format.nBlockAlign) { return FALSE; }
+    if (pWaveFormat->wBitsPerSample != _pFormat->WaveFormatExt.Format.wBitsPerSample) { return FALSE; }
 
-    return ntStatus;
+    if (pWaveFormat->wFormatTag != WAVE_FORMAT_EXTENSIBLE)
+    {
+        return TRUE;
+    }
+
+    // WAVEFORMATEXTENSIBLE VALIDATION
+    if (pWaveFormat->cbSize < sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)) { return FALSE; }
+
+    PWAVEFORMATEXTENSIBLE pWaveFormatExt = reinterpret_cast<PWAVEFORMATEXTENSIBLE>(pWaveFormat);
+    if (pWaveFormatExt->Samples.wValidBitsPerSample != _pFormat->WaveFormatExt.Samples.wValidBitsPerSample) { return FALSE; }
+    if (pWaveFormatExt->dwChannelMask != _pFormat->WaveFormatExt.dwChannelMask) { return FALSE; }
+    if (!IsEqualGUIDAligned(pWaveFormatExt->SubFormat, _pFormat->WaveFormatExt.SubFormat)) { return FALSE; }
+
+    return TRUE;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+ULONG
+CMiniportWaveRT::HashFormat
+(
+    _In_ USHORT         _usFormatTag,
+    _In_ WORD           _nChannels,
+    _In_ DWORD          _nSamplesPerSec,
+    _In_ WORD           _wBitsPerSample
+)
+/*++
+
+Routine Description:
+
+  Hashes the fields of a format that both a WAVEFORMATEX and a
+  WAVEFORMATEXTENSIBLE request carry. Valid bits and the channel mask are
+  left out, IsFormatMatch checks them on the probed entries.
+
+--*/
+{
+    PAGED_CODE();
+
+    ULONGLONG key = ((ULONGLONG)_nSamplesPerSec << 32) |
+                    ((ULONGLONG)_usFormatTag << 16) |
+                    ((ULONGLONG)(_nChannels & 0xFF) << 8) |
+                    (ULONGLONG)(_wBitsPerSample & 0xFF);
+
+    key *= 0x9E3779B97F4A7C15ULL;
+
+    return (ULONG)(key >> 32);
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+CMiniportWaveRT::BuildFormatIndex()
+/*++
+
+Routine Description:
+
+  Builds m_FormatIndex over the device formats of every pin, with an open
+  addressing table of at least twice as many slots as formats. Pins without
+  formats, or with more than the slots can address, are left unindexed and
+  IsFormatSupported scans them.
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    ULONG   cSlots = 0;
+    size_t  size;
+    PUSHORT pSlots;
+
+    if (m_DeviceFormatsAndModes == NULL || m_DeviceFormatsAndModesCount == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    for (ULONG i = 0; i < m_DeviceFormatsAndModesCount; i++)
+    {
+        ULONG cFormats = m_DeviceFormatsAndModes[i].WaveFormatsCount;
+
+        if (m_DeviceFormatsAndModes[i].WaveFormats != NULL && cFormats > 0 && cFormats < MAXUSHORT / 2)
+        {
+            ULONG cPinSlots = 8;
+
+            while (cPinSlots < 2 * cFormats)
+            {
+                cPinSlots <<= 1;
+            }
+
+            cSlots += cPinSlots;
+        }
+    }
+
+    size = m_DeviceFormatsAndModesCount * sizeof(FORMAT_INDEX) + cSlots * sizeof(USHORT);
+    m_FormatIndex = (PFORMAT_INDEX)ExAllocatePool2(POOL_FLAG_PAGED, size, MINWAVERT_POOLTAG);
+    if (m_FormatIndex == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pSlots = (PUSHORT)(m_FormatIndex + m_DeviceFormatsAndModesCount);
+
+    for (ULONG i = 0; i < m_DeviceFormatsAndModesCount; i++)
+    {
+        PFORMAT_INDEX                       pIndex = &m_FormatIndex[i];
+        PKSDATAFORMAT_WAVEFORMATEXTENSIBLE  pFormats = m_DeviceFormatsAndModes[i].WaveFormats;
+        ULONG                               cFormats = m_DeviceFormatsAndModes[i].WaveFormatsCount;
+        ULONG                               cPinSlots = 8;
+
+        if (pFormats == NULL || cFormats == 0 || cFormats >= MAXUSHORT / 2)
+        {
+            continue;
+        }
+
+        while (cPinSlots < 2 * cFormats)
+        {
+            cPinSlots <<= 1;
+        }
+
+        pIndex->Formats = pFormats;
+        pIndex->FormatCount = cFormats;
+        pIndex->SlotMask = cPinSlots - 1;
+        pIndex->Slots = pSlots;
+        pSlots += cPinSlots;
+
+        for (ULONG iFormat = 0; iFormat < cFormats; iFormat++)
+        {
+            PWAVEFORMATEX pWaveFormat = &pFormats[iFormat].WaveFormatExt.Format;
+            ULONG iSlot = HashFormat(EXTRACT_WAVEFORMATEX_ID(&pFormats[iFormat].WaveFormatExt.SubFormat),
+                                     pWaveFormat->nChannels,
+                                     pWaveFormat->nSamplesPerSec,
+                                     pWaveFormat->wBitsPerSample);
+
+            while (pIndex->Slots[iSlot & pIndex->SlotMask] != 0)
+            {
+                iSlot++;
+            }
+
+            pIndex->Slots[iSlot & pIndex->SlotMask] = (USHORT)(iFormat + 1);
+        }
+    }
+
+    return STATUS_SUCCESS;
 }
 
 #ifdef SYSVAD_BTH_BYPASS
@@ -2138,7 +2388,8 @@ CMiniportWaveRT::PropertyHandlerModuleCommand
     return AudioModule_GenericHandler_ModuleCommand(
                 PropertyRequest,
                 GetAudioModuleList(),
-                GetAudioModuleListCount());
+                GetAudioModuleListCount(),
+                &m_AudioModuleIndex);
 } // PropertyHandlerModuleCommand
 
 //=============================================================================
@@ -2685,6 +2936,7 @@ CMiniportWaveRT::AllocStreamAudioModules
             //
             pAudioModules[j].Descriptor = moduleDesc;
             pAudioModules[j].Context    = NULL;
+            pAudioModules[j].Notifier   = NULL;
 
             //
             // Create a unique InstanceId for this module instance.
@@ -2701,6 +2953,21 @@ CMiniportWaveRT::AllocStreamAudioModules
                                         CfgInstanceId);
                                         
             pAudioModules[j].Enabled = m_pAudioModules[i].Enabled;
+
+            //
+            // Each instance coalesces its own change notifications.
+            //
+            if (m_pPortClsNotifications != NULL)
+            {
+                ntStatus = AudioModule_CreateNotifier(&pAudioModules[j].Notifier,
+                                                      m_pPortClsNotifications,
+                                                      m_pAdapterCommon->GetDeviceObject(),
+                                                      g_AudioModuleNotificationIntervalMs);
+                if (!NT_SUCCESS(ntStatus))
+                {
+                    goto exit;
+                }
+            }
         
             //
             // Alloc context for module instance.
@@ -2728,7 +2995,8 @@ CMiniportWaveRT::AllocStreamAudioModules
                                                  m_pAudioModules[i].Context,
                                                  pAudioModules[j].Context,
                                                  size,
-                                                 pAudioModules[j].InstanceId);
+                                                 pAudioModules[j].InstanceId,
+                                                 pAudioModules[j].Notifier);
                 if (!NT_SUCCESS(ntStatus))
                 {
                     ASSERT(FALSE);
@@ -2792,12 +3060,100 @@ CMiniportWaveRT::FreeStreamAudioModules
                 ExFreePoolWithTag(pAudioModules[i].Context, MINWAVERT_POOLTAG);
                 pAudioModules[i].Context = NULL;
             }
+
+            AudioModule_DeleteNotifier(pAudioModules[i].Notifier);
+            pAudioModules[i].Notifier = NULL;
         }
 
         ExFreePoolWithTag(pAudioModules, MINWAVERT_POOLTAG);
     }
 }
 
+//=============================================================================
+#pragma code_seg()
+PVOID NTAPI
+CMiniportWaveRT::AllocateStreamBlockPoolElement
+(
+    _In_ POOL_TYPE  PoolType,
+    _In_ SIZE_T     NumberOfBytes,
+    _In_ ULONG      Tag
+)
+{
+    UNREFERENCED_PARAMETER(PoolType);
+
+    return ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, NumberOfBytes, Tag);
+}
+
+//=============================================================================
+#pragma code_seg()
+VOID NTAPI
+CMiniportWaveRT::FreeStreamBlockPoolElement
+(
+    _In_ PVOID      Buffer
+)
+{
+    ExFreePoolWithTag(Buffer, MINWAVERT_POOLTAG);
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+PVOID
+CMiniportWaveRT::AllocStreamBlock
+(
+    _In_ ULONG      Size
+)
+/*++
+
+Routine Description:
+
+  Returns a zeroed, cache-aligned block of Size bytes for the per-stream
+  state of a stream (see GetStreamBlockLayout). Blocks that fit the pool's
+  element size come from the lookaside list, so opening and closing
+  streams recycles them instead of allocating each array from pool.
+
+--*/
+{
+    PVOID block;
+
+    PAGED_CODE();
+
+    if (Size <= m_StreamBlockPoolElementSize)
+    {
+        block = ExAllocateFromNPagedLookasideList(&m_StreamBlockPool);
+        if (block != NULL)
+        {
+            RtlZeroMemory(block, Size);
+        }
+    }
+    else
+    {
+        block = ExAllocatePool2(POOL_FLAG_NON_PAGED | POOL_FLAG_CACHE_ALIGNED, Size, MINWAVERT_POOLTAG);
+    }
+
+    return block;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CMiniportWaveRT::FreeStreamBlock
+(
+    _In_ PVOID      Block,
+    _In_ ULONG      Size
+)
+{
+    PAGED_CODE();
+
+    if (Size <= m_StreamBlockPoolElementSize)
+    {
+        ExFreeToNPagedLookasideList(&m_StreamBlockPool, Block);
+    }
+    else
+    {
+        ExFreePoolWithTag(Block, MINWAVERT_POOLTAG);
+    }
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 
@@ -3090,6 +3446,12 @@ DEFINE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Set_SoundDetectorPatterns2)
         return STATUS_INVALID_PARAMETER;
     }
 
+    // A larger pattern is a keyword model, validated by the detector.
+    if (patternHeader->Size > sizeof(CONTOSO_KEYWORDCONFIGURATION))
+    {
+        return m_KeywordDetector.DownloadModel(propertyInstance->EventId, patternHeader, patternHeader->Size);
+    }
+
     // Verify the pattern is large enough.
     if (patternHeader->Size != sizeof(CONTOSO_KEYWORDCONFIGURATION))
     {
@@ -3255,34 +3617,76 @@ DEFINE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_InterleavedFormatInformation)
     return STATUS_SUCCESS;
 }
 
-
-#pragma code_seg()
-NTSTATUS CMiniportWaveRT_EventHandler_SoundDetectorMatchDetected
-(
-    _In_  PPCEVENT_REQUEST EventRequest
-)
+DEFINE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_KeywordBurstRead)
 {
-    CMiniportWaveRT* miniport = reinterpret_cast<CMiniportWaveRT*>(EventRequest->MajorTarget);
-    return miniport->EventHandler_SoundDetectorMatchDetected(EventRequest);
-}
+    NTSTATUS                ntStatus;
+    PKSP_PIN                propertyInstance = NULL;
+    SYSVAD_KEYWORD_BURST   *value;
+    ULONG                   maxPackets;
 
-#pragma code_seg()
-NTSTATUS CMiniportWaveRT::EventHandler_SoundDetectorMatchDetected
-(
-    _In_  PPCEVENT_REQUEST EventRequest
-)
-{
-    if (EventRequest->Verb == PCEVENT_VERB_ADD)
+    PAGED_CODE();
+
+    if (PropertyRequest->InstanceSize < (sizeof(KSP_PIN) - RTL_SIZEOF_THROUGH_FIELD(KSP_PIN, Property)))
     {
-        _IRQL_limited_to_(PASSIVE_LEVEL);
-        m_pPortEvents->AddEventToEventList(EventRequest->EventEntry);
+        return STATUS_INVALID_PARAMETER;
     }
-    return STATUS_SUCCESS;
-}
-#pragma code_seg("PAGE")
-NTSTATUS
-PropertyHandler_WaveFilter
-( 
+
+    propertyInstance = CONTAINING_RECORD(PropertyRequest->Instance, KSP_PIN, PinId);
+
+    if (!IsKeywordDetectorPin(propertyInstance->PinId))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // The SYSVADPROPERTY_ITEM for this property ensures room for at least
+    // one packet.
+    NT_ASSERT(PropertyRequest->ValueSize >= SYSVAD_KEYWORD_BURST_SIZE(1));
+
+    value = (SYSVAD_KEYWORD_BURST*)PropertyRequest->Value;
+    maxPackets = (PropertyRequest->ValueSize - FIELD_OFFSET(SYSVAD_KEYWORD_BURST, Packets)) / sizeof(SYSVAD_KEYWORD_PACKET);
+
+    RtlZeroMemory(value, FIELD_OFFSET(SYSVAD_KEYWORD_BURST, Packets));
+
+    ntStatus = m_KeywordDetector.ReadPacketBurst(maxPackets, value->Packets, &value->FirstPacketNumber, &value->PacketCount, &value->MoreData);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        PropertyRequest->ValueSize = 0;
+        return ntStatus;
+    }
+
+    PropertyRequest->ValueSize = SYSVAD_KEYWORD_BURST_SIZE(value->PacketCount);
+
+    return STATUS_SUCCESS;
+}
+
+
+#pragma code_seg()
+NTSTATUS CMiniportWaveRT_EventHandler_SoundDetectorMatchDetected
+(
+    _In_  PPCEVENT_REQUEST EventRequest
+)
+{
+    CMiniportWaveRT* miniport = reinterpret_cast<CMiniportWaveRT*>(EventRequest->MajorTarget);
+    return miniport->EventHandler_SoundDetectorMatchDetected(EventRequest);
+}
+
+#pragma code_seg()
+NTSTATUS CMiniportWaveRT::EventHandler_SoundDetectorMatchDetected
+(
+    _In_  PPCEVENT_REQUEST EventRequest
+)
+{
+    if (EventRequest->Verb == PCEVENT_VERB_ADD)
+    {
+        _IRQL_limited_to_(PASSIVE_LEVEL);
+        m_pPortEvents->AddEventToEventList(EventRequest->EventEntry);
+    }
+    return STATUS_SUCCESS;
+}
+#pragma code_seg("PAGE")
+NTSTATUS
+PropertyHandler_WaveFilter
+( 
     _In_ PPCPROPERTY_REQUEST      PropertyRequest 
 )
 /*++
@@ -3320,6 +3724,22 @@ Return Value:
             case KSPROPERTY_SYSVAD_DEFAULTSTREAMEFFECTS:
                 ntStatus = pWaveHelper->PropertyHandlerEffectListRequest(PropertyRequest);
                 break;
+
+            case KSPROPERTY_SYSVAD_VOLUMEVECTOR:
+            case KSPROPERTY_SYSVAD_MUTEVECTOR:
+                if (pWaveHelper->m_DeviceType == eHdmiRenderDevice || 
+                    pWaveHelper->m_DeviceType == eCellularDevice || 
+                    pWaveHelper->m_DeviceType == eHandsetSpeakerDevice)
+                {
+                    ntStatus = PropertyHandler_MixerVector(
+                                        pWaveHelper->m_pAdapterCommon,
+                                        PropertyRequest,
+                                        pWaveHelper->m_DeviceMaxChannels,
+                                        PropertyRequest->PropertyItem->Id == KSPROPERTY_SYSVAD_VOLUMEVECTOR ?
+                                            eMixerVolume : eMixerMute);
+                }
+                break;
+
             default:
                 DPF(D_TERSE, ("[PropertyHandler_WaveFilter: Invalid Device Request]"));
         }
@@ -3579,21 +3999,180 @@ CKeywordDetector::CKeywordDetector()
     m_streamRunning(FALSE),
     m_qpcStartCapture(0),
     m_nLastQueuedPacket(-1),
-    m_SoundDetectorArmed1(FALSE),
-    m_SoundDetectorArmed2(FALSE),
-    m_SoundDetectorData1(0),
-    m_SoundDetectorData2(0),
+    m_nNextReadPacket(0),
     m_ullKeywordStartTimestamp(0),
-    m_ullKeywordStopTimestamp(0)
+    m_ullKeywordStopTimestamp(0),
+    m_ulHistoryMs(MinHistoryMs),
+    m_pCompressedRing(NULL),
+    m_ulCompressedRingSize(0),
+    m_pFeatureExtractor(NULL),
+    m_ulKeywordCount(0),
+    m_ulArmedKeywords(0),
+    m_pModel(NULL),
+    m_lDetectionsPending(0)
 {
     PAGED_CODE();
 
-    // Initialize our pool of packets and the list structures
-    KeInitializeSpinLock(&PacketPoolSpinLock);
-    KeInitializeSpinLock(&PacketFifoSpinLock);
+    C_ASSERT((PacketRingSize & (PacketRingSize - 1)) == 0);
+    C_ASSERT((SamplesPerPacket & 1) == 0);
+    C_ASSERT(MaxKeywords >= BuiltInKeywords + CONTOSO_KEYWORDMODEL_MAX_KEYWORDS && MaxKeywords <= 32);
+
+    RtlZeroMemory(&m_AdpcmState, sizeof(m_AdpcmState));
+    ExInitializeFastMutex(&m_ReadLock);
+    KeInitializeSpinLock(&m_KeywordLock);
+
+    // The keywords advertised by the Contoso adapter are always registered.
+    m_Keywords[0].EventId = CONTOSO_KEYWORD1;
+    m_Keywords[1].EventId = CONTOSO_KEYWORD2;
+    m_ulKeywordCount = BuiltInKeywords;
+    for (ULONG i = 0; i < MaxKeywords; i++)
+    {
+        m_Keywords[i].Data = 0;
+        m_Keywords[i].ModelOutput = -1;
+        m_Keywords[i].Threshold = 0.0f;
+        m_Keywords[i].TriggerData = 0;
+    }
+
     ResetFifo();
 }
 
+#pragma code_seg("PAGE")
+CKeywordDetector::~CKeywordDetector()
+{
+    PAGED_CODE();
+
+    if (m_pCompressedRing != NULL)
+    {
+        ExFreePoolWithTag(m_pCompressedRing, MINWAVERT_POOLTAG);
+        m_pCompressedRing = NULL;
+    }
+
+    if (m_pFeatureExtractor != NULL)
+    {
+        delete m_pFeatureExtractor;
+        m_pFeatureExtractor = NULL;
+    }
+
+    if (m_pModel != NULL)
+    {
+        ExFreePoolWithTag(m_pModel, MINWAVERT_POOLTAG);
+        m_pModel = NULL;
+    }
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID CKeywordDetector::AllocateHistory()
+/*++
+
+Routine Description:
+
+  Sizes the keyword pre-roll from the KeywordHistoryMs registry value and
+  allocates the compressed ring holding it. Called before the first packet
+  is queued, so DpcRoutine never sees the ring change.
+
+  Compressed packets take 100 bytes against 336 for a raw packet with its
+  features. If the allocation fails the history is limited to the raw ring.
+
+--*/
+{
+    ULONG historyMs;
+    ULONG ringSize;
+
+    PAGED_CODE();
+
+    if (m_pCompressedRing != NULL)
+    {
+        return;
+    }
+
+    historyMs = g_KeywordHistoryMs;
+    if (historyMs < MinHistoryMs)
+    {
+        historyMs = MinHistoryMs;
+    }
+    else if (historyMs > MaxHistoryMs)
+    {
+        historyMs = MaxHistoryMs;
+    }
+    m_ulHistoryMs = historyMs;
+
+    // The slot after the last published packet may be being written, so
+    // two more slots than the history are needed.
+    ringSize = historyMs * (SamplesPerSecond / SamplesPerPacket) / 1000 + 2;
+    if (ringSize <= PacketRingSize)
+    {
+        return;
+    }
+
+    m_pCompressedRing = (COMPRESSED_PACKET_ENTRY*)ExAllocatePool2(POOL_FLAG_NON_PAGED, ringSize * sizeof(COMPRESSED_PACKET_ENTRY), MINWAVERT_POOLTAG);
+    if (m_pCompressedRing == NULL)
+    {
+        DPF(D_ERROR, ("CKeywordDetector: no memory for %u ms of keyword history", historyMs));
+        return;
+    }
+
+    // no packet yet
+    for (ULONG i = 0; i < ringSize; i++)
+    {
+        m_pCompressedRing[i].PacketNumber = -1;
+    }
+
+    m_ulCompressedRingSize = ringSize;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID CKeywordDetector::AllocateFeatureExtractor()
+/*++
+
+Routine Description:
+
+  Allocates the feature front-end and builds its tables (about 16 KB,
+  mostly the FFT twiddles and the filterbank). Called before the first
+  packet is queued, like AllocateHistory. If this fails the packets are
+  still buffered, with zeroed features, and only the energy detector runs.
+
+--*/
+{
+    CKwsFeatureExtractor*   featureExtractor;
+    KFLOATING_SAVE          saveData;
+
+    PAGED_CODE();
+
+    if (m_pFeatureExtractor != NULL)
+    {
+        return;
+    }
+
+    featureExtractor = new (POOL_FLAG_NON_PAGED, MINWAVERT_POOLTAG) CKwsFeatureExtractor();
+    if (featureExtractor == NULL)
+    {
+        DPF(D_ERROR, ("CKeywordDetector: no memory for the feature front-end"));
+        return;
+    }
+
+    if (!NT_SUCCESS(KeSaveFloatingPointState(&saveData)))
+    {
+        delete featureExtractor;
+        return;
+    }
+
+    if (!featureExtractor->Initialize())
+    {
+        DPF(D_ERROR, ("CKeywordDetector: feature front-end initialization failed"));
+        KeRestoreFloatingPointState(&saveData);
+        delete featureExtractor;
+        return;
+    }
+
+    KeRestoreFloatingPointState(&saveData);
+
+    m_pFeatureExtractor = featureExtractor;
+}
+
 #pragma code_seg("PAGE")
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS CKeywordDetector::ReadKeywordTimestampRegistry()
@@ -3647,100 +4226,310 @@ NTSTATUS CKeywordDetector::ReadKeywordTimestampRegistry()
 }
 
 
-#pragma code_seg("PAGE")
+// The keyword registry is shared with DpcRoutine, so the functions below
+// take m_KeywordLock and are not pageable.
+#pragma code_seg()
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS CKeywordDetector::ResetDetector(_In_ GUID eventId)
 {
-    PAGED_CODE();
+    KIRQL           oldIrql;
+    KEYWORD_MODEL*  oldModel = NULL;
+    NTSTATUS        ntStatus = STATUS_SUCCESS;
 
-    if (eventId == CONTOSO_KEYWORD1)
-    {
-        m_SoundDetectorData1 = 0;
-        m_SoundDetectorArmed1 = FALSE;
-    }
-    else if(eventId == CONTOSO_KEYWORD2)
-    {
-        m_SoundDetectorData2 = 0;
-        m_SoundDetectorArmed2 = FALSE;
-    }
-    else if(eventId == GUID_NULL)
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
+
+    if(eventId == GUID_NULL)
     {
         // When DownloadDetectorData is called to set the pattern for multiple keywords
         // at once, all keyword detectors must be reset. Also used during keyword detector
         // initialization and cleanup to restore it back to initial state and power down.
-        m_SoundDetectorData1 = 0;
-        m_SoundDetectorArmed1 = FALSE;
-        m_SoundDetectorData2 = 0;
-        m_SoundDetectorArmed2 = FALSE;
+        // The keyword model and the keywords it registered are dropped.
+        oldModel = m_pModel;
+        m_pModel = NULL;
+        m_ulKeywordCount = BuiltInKeywords;
+        m_ulArmedKeywords = 0;
+        for (ULONG i = 0; i < m_ulKeywordCount; i++)
+        {
+            m_Keywords[i].Data = 0;
+            m_Keywords[i].ModelOutput = -1;
+        }
     }
     else
     {
-        return STATUS_INVALID_PARAMETER;
+        LONG index = FindKeyword(eventId);
+
+        if (index >= 0)
+        {
+            m_Keywords[index].Data = 0;
+            m_Keywords[index].ModelOutput = -1;
+            m_ulArmedKeywords &= ~(1UL << index);
+        }
+        else
+        {
+            ntStatus = STATUS_INVALID_PARAMETER;
+        }
     }
 
-    return STATUS_SUCCESS;
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
+    if (oldModel != NULL)
+    {
+        ExFreePoolWithTag(oldModel, MINWAVERT_POOLTAG);
+    }
+
+    return ntStatus;
 }
 
-#pragma code_seg("PAGE")
+#pragma code_seg()
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS CKeywordDetector::DownloadDetectorData(_In_ GUID eventId, _In_ LONGLONG Data)
 {
-    PAGED_CODE();
+    KIRQL       oldIrql;
+    NTSTATUS    ntStatus = STATUS_SUCCESS;
 
     // reset the detector for this event Id
-    ResetDetector(eventId);
+    ntStatus = ResetDetector(eventId);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return ntStatus;
+    }
 
     // In this example, the driver supports detection data 
-    // set with a single call for both detectors, or each
+    // set with a single call for all detectors, or each
     // detector set individually.
-    if (eventId == CONTOSO_KEYWORD1)
-    {
-        m_SoundDetectorData1 = Data;
-    }
-    else if(eventId == CONTOSO_KEYWORD2)
-    {
-        m_SoundDetectorData2 = Data;
-    }
-    else if(eventId == GUID_NULL)
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
+
+    if(eventId == GUID_NULL)
     {
-        // in this simplified example "Data" is set on both detectors,
+        // in this simplified example "Data" is set on all detectors,
         // however in a real system "Data" could be a data structure which
-        // contains different values for each detector.
-        m_SoundDetectorData1 = m_SoundDetectorData2 = Data;
+        // contains different values for each detector, see DownloadModel.
+        for (ULONG i = 0; i < m_ulKeywordCount; i++)
+        {
+            m_Keywords[i].Data = Data;
+        }
     }
     else
     {
-        return STATUS_INVALID_PARAMETER;
+        LONG index = FindKeyword(eventId);
+
+        if (index >= 0)
+        {
+            m_Keywords[index].Data = Data;
+        }
+        else
+        {
+            ntStatus = STATUS_INVALID_PARAMETER;
+        }
     }
 
-    return STATUS_SUCCESS;
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
+    return ntStatus;
 }
 
-// The following function is only applicable to single keyword detection systems,
-// and assumes keyword detector #1.
-#pragma code_seg("PAGE")
+#pragma code_seg()
 _IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS CKeywordDetector::GetDetectorData(_In_ GUID eventId, _Out_ LONGLONG *Data)
+NTSTATUS CKeywordDetector::DownloadModel
+(
+    _In_                        GUID        eventId,
+    _In_reads_bytes_(ModelSize) const VOID  *Model,
+    _In_                        ULONG       ModelSize
+)
+/*++
+
+Routine Description:
+
+  Loads a CONTOSO_KEYWORDMODEL (see ContosoKeywordDetector.h) as the second
+  stage of its keywords, registering the keywords that are not registered
+  yet, and replaces the previous model. The keywords of the previous model
+  other than CONTOSO_KEYWORD1 and CONTOSO_KEYWORD2 that the new model does
+  not have are dropped.
+
+  eventId is reset as for DownloadDetectorData: it is disarmed, or every
+  keyword is when it is GUID_NULL, the model being set for all of them at
+  once. Any other keyword that is still registered keeps its arming and
+  its first-stage state, so a model update does not disarm keywords the
+  client armed.
+
+--*/
 {
-    PAGED_CODE();
+    const CONTOSO_KEYWORDMODEL*         header = (const CONTOSO_KEYWORDMODEL*)Model;
+    const CONTOSO_KEYWORDMODEL_KEYWORD* keywords;
+    const float*                        hiddenWeights;
+    const float*                        hiddenBias;
+    const float*                        outputWeights;
+    const float*                        outputBias;
+    KEYWORD_MODEL*                      model = NULL;
+    KEYWORD_MODEL*                      oldModel = NULL;
+    SIZE_T                              scorerBytes;
+    SIZE_T                              headerBytes;
+    KIRQL                               oldIrql;
+    BOOL                                eventFound = (eventId == GUID_NULL);
+    ULONG                               armed = 0;
+    ULONG                               count = BuiltInKeywords;
+
+    C_ASSERT(CONTOSO_KEYWORDMODEL_FEATURES == KWSFEATURES_MFCC_COUNT);
+
+    if (ModelSize < sizeof(CONTOSO_KEYWORDMODEL) ||
+        header->Version != CONTOSO_KEYWORDMODEL_VERSION ||
+        header->KeywordCount == 0 || header->KeywordCount > CONTOSO_KEYWORDMODEL_MAX_KEYWORDS ||
+        header->ContextFrames == 0 || header->ContextFrames > CONTOSO_KEYWORDMODEL_MAX_FRAMES ||
+        header->FeatureCount != CONTOSO_KEYWORDMODEL_FEATURES ||
+        header->HiddenCount == 0 || header->HiddenCount > CONTOSO_KEYWORDMODEL_MAX_HIDDEN ||
+        (header->HiddenCount & 3) != 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
 
-    if (eventId == CONTOSO_KEYWORD1)
+    // The limits above keep the size well within a ULONG.
+    if (ModelSize != CONTOSO_KEYWORDMODEL_SIZE(header->KeywordCount, header->ContextFrames, header->FeatureCount, header->HiddenCount))
     {
-        *Data = m_SoundDetectorData1;
+        return STATUS_INVALID_PARAMETER;
     }
-    else if(eventId == CONTOSO_KEYWORD2)
+
+    keywords = (const CONTOSO_KEYWORDMODEL_KEYWORD*)(header + 1);
+    hiddenWeights = (const float*)(keywords + header->KeywordCount);
+    hiddenBias = hiddenWeights + header->ContextFrames * header->FeatureCount * header->HiddenCount;
+    outputWeights = hiddenBias + header->HiddenCount;
+    outputBias = outputWeights + header->HiddenCount * CONTOSO_KEYWORDMODEL_PADDED(header->KeywordCount);
+
+    for (ULONG k = 0; k < header->KeywordCount; k++)
     {
-        *Data = m_SoundDetectorData2;
+        if (keywords[k].EventId == GUID_NULL)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+        for (ULONG j = 0; j < k; j++)
+        {
+            if (keywords[j].EventId == keywords[k].EventId)
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+        }
+        eventFound = eventFound || (keywords[k].EventId == eventId);
     }
-    else
+
+    if (!eventFound)
     {
         return STATUS_INVALID_PARAMETER;
     }
 
+    // The scorer state follows the structure in the same non-paged block.
+    headerBytes = ALIGN_UP_BY(sizeof(KEYWORD_MODEL), APOFFT_ALIGNMENT);
+    scorerBytes = CKwsScorer::GetRequiredBytes(header->ContextFrames, header->FeatureCount, header->HiddenCount, header->KeywordCount);
+
+    model = (KEYWORD_MODEL*)ExAllocatePool2(POOL_FLAG_NON_PAGED, headerBytes + scorerBytes, MINWAVERT_POOLTAG);
+    if (model == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    // a zeroed scorer is an uninitialized one
+    RtlZeroMemory(model, headerBytes);
+    if (!model->Scorer.Initialize(header->ContextFrames, header->FeatureCount, header->HiddenCount, header->KeywordCount,
+                                  hiddenWeights, hiddenBias, outputWeights, outputBias, (BYTE*)model + headerBytes))
+    {
+        ExFreePoolWithTag(model, MINWAVERT_POOLTAG);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
+
+    // Keep the built-in keywords and those of the previous model that the
+    // new one has, moved down over the dropped ones with their armed bits.
+    armed = m_ulArmedKeywords & ((1UL << BuiltInKeywords) - 1);
+    for (ULONG i = 0; i < BuiltInKeywords; i++)
+    {
+        m_Keywords[i].ModelOutput = -1;
+    }
+
+    for (ULONG i = BuiltInKeywords; i < m_ulKeywordCount; i++)
+    {
+        BOOL inModel = FALSE;
+
+        for (ULONG k = 0; k < header->KeywordCount && !inModel; k++)
+        {
+            inModel = (keywords[k].EventId == m_Keywords[i].EventId);
+        }
+
+        if (inModel)
+        {
+            if ((m_ulArmedKeywords & (1UL << i)) != 0)
+            {
+                armed |= (1UL << count);
+            }
+            m_Keywords[count++] = m_Keywords[i];
+        }
+    }
+    m_ulKeywordCount = count;
+
+    // Register the new keywords, disarmed, and point the model's keywords
+    // at their outputs.
+    for (ULONG k = 0; k < header->KeywordCount; k++)
+    {
+        LONG index = FindKeyword(keywords[k].EventId);
+
+        if (index < 0)
+        {
+            index = (LONG)m_ulKeywordCount++;
+            m_Keywords[index].EventId = keywords[k].EventId;
+            m_Keywords[index].Trigger.Reset();
+        }
+
+        m_Keywords[index].Data = keywords[k].DetectorData;
+        m_Keywords[index].ModelOutput = (LONG)k;
+        m_Keywords[index].Threshold = keywords[k].Threshold;
+    }
+
+    // Now that every keyword of the model is registered, reset eventId.
+    if (eventId == GUID_NULL)
+    {
+        armed = 0;
+        for (ULONG i = 0; i < BuiltInKeywords; i++)
+        {
+            if (m_Keywords[i].ModelOutput < 0)
+            {
+                m_Keywords[i].Data = 0;
+            }
+        }
+    }
+    else
+    {
+        armed &= ~(1UL << FindKeyword(eventId));
+    }
+    m_ulArmedKeywords = armed;
+
+    oldModel = m_pModel;
+    m_pModel = model;
+
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
+    if (oldModel != NULL)
+    {
+        ExFreePoolWithTag(oldModel, MINWAVERT_POOLTAG);
+    }
 
     return STATUS_SUCCESS;
 }
 
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS CKeywordDetector::GetDetectorData(_In_ GUID eventId, _Out_ LONGLONG *Data)
+{
+    KIRQL       oldIrql;
+    LONG        index;
+
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
+
+    index = FindKeyword(eventId);
+    *Data = (index >= 0) ? m_Keywords[index].Data : 0;
+
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
+    return (index >= 0) ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+}
+
 #pragma code_seg("PAGE")
 _IRQL_requires_max_(PASSIVE_LEVEL)
 ULONGLONG CKeywordDetector::GetStartTimestamp()
@@ -3766,79 +4555,97 @@ VOID CKeywordDetector::ResetFifo()
     PAGED_CODE();
 
     m_qpcStartCapture = 0;
-    m_nLastQueuedPacket = (-1);
-    InitializeListHead(&PacketPoolHead);
-    InitializeListHead(&PacketFifoHead);
 
-    for (int i = 0; i < ARRAYSIZE(PacketPool); i++)
+    ExAcquireFastMutex(&m_ReadLock);
+    m_nNextReadPacket = 0;
+    WriteRelease64(&m_nLastQueuedPacket, -1);
+
+    // Packet numbers start over; a slot the next run skips must not match
+    // by its number from this one.
+    for (ULONG i = 0; i < PacketRingSize; i++)
+    {
+        WriteNoFence64(&PacketRing[i].PacketNumber, -1);
+    }
+    for (ULONG i = 0; i < m_ulCompressedRingSize; i++)
     {
-        InsertTailList(&PacketPoolHead, &PacketPool[i].ListEntry);
+        WriteNoFence64(&m_pCompressedRing[i].PacketNumber, -1);
     }
+    ExReleaseFastMutex(&m_ReadLock);
+
+    m_bResetFeatures = TRUE;
     return;
 }
 
-#pragma code_seg("PAGE")
+#pragma code_seg()
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS CKeywordDetector::SetArmed(_In_ GUID eventId, _In_ BOOL Arm)
 {
-    PAGED_CODE();
-
+    KIRQL oldIrql;
+    LONG index;
     BOOL previousArming = FALSE;
-    NTSTATUS ntStatus = STATUS_SUCCESS;
+    BOOL arming = FALSE;
 
-    // the previous state is "armed" if either detector is armed.
-    // this reflects the fact that both detectors are sharing the
-    // same stream.
-    previousArming = m_SoundDetectorArmed1 || m_SoundDetectorArmed2;
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
 
-    if (eventId == CONTOSO_KEYWORD1)
+    index = FindKeyword(eventId);
+    if (index < 0)
     {
-        m_SoundDetectorArmed1 = Arm;
+        KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+        return STATUS_INVALID_PARAMETER;
     }
-    else if(eventId == CONTOSO_KEYWORD2)
+
+    // the previous state is "armed" if any detector is armed.
+    // this reflects the fact that all detectors are sharing the
+    // same stream.
+    previousArming = (m_ulArmedKeywords != 0);
+
+    if (Arm)
     {
-        m_SoundDetectorArmed2 = Arm;
+        if ((m_ulArmedKeywords & (1UL << index)) == 0)
+        {
+            // start from a clean hysteresis state
+            m_Keywords[index].Trigger.Reset();
+        }
+        m_ulArmedKeywords |= (1UL << index);
     }
     else
     {
-        return STATUS_INVALID_PARAMETER;
+        m_ulArmedKeywords &= ~(1UL << index);
     }
 
+    arming = (m_ulArmedKeywords != 0);
+
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
     if (Arm && !previousArming && m_qpcStartCapture == 0)
     {
         StartBufferingStream();
     }
-    else if (!Arm && previousArming && !m_streamRunning)
+    else if (!arming && previousArming && !m_streamRunning)
     {
         // if it's not actively streaming and everything has been disarmed,
         // then stop buffering.
         ResetFifo();
     }
 
-    return ntStatus;
+    return STATUS_SUCCESS;
 }
 
-#pragma code_seg("PAGE")
+#pragma code_seg()
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS CKeywordDetector::GetArmed(_In_ GUID eventId, _Out_ BOOL *Arm)
 {
-    PAGED_CODE();
-    NTSTATUS ntStatus = STATUS_SUCCESS;
+    KIRQL oldIrql;
+    LONG index;
 
-    if (eventId == CONTOSO_KEYWORD1)
-    {
-        *Arm = m_SoundDetectorArmed1;
-    }
-    else if(eventId == CONTOSO_KEYWORD2)
-    {
-        *Arm = m_SoundDetectorArmed2;
-    }
-    else
-    {
-        return STATUS_INVALID_PARAMETER;
-    }
+    KeAcquireSpinLock(&m_KeywordLock, &oldIrql);
 
-    return ntStatus;
+    index = FindKeyword(eventId);
+    *Arm = (index >= 0) && ((m_ulArmedKeywords & (1UL << index)) != 0);
+
+    KeReleaseSpinLock(&m_KeywordLock, oldIrql);
+
+    return (index >= 0) ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
 }
 
 #pragma code_seg("PAGE")
@@ -3894,7 +4701,14 @@ VOID CKeywordDetector::StartBufferingStream()
     PAGED_CODE();
 
     NT_ASSERT(m_qpcStartCapture == 0);
-    NT_ASSERT(IsListEmpty(&PacketFifoHead));
+    NT_ASSERT(m_nNextReadPacket > m_nLastQueuedPacket);
+
+    AllocateHistory();
+    AllocateFeatureExtractor();
+
+    // DpcRoutine starts queuing once m_qpcStartCapture is set; the history
+    // ring and the front-end must be visible to it by then.
+    KeMemoryBarrier();
 
     qpc = KeQueryPerformanceCounter(&qpcFrequency);
     m_qpcStartCapture = qpc.QuadPart;
@@ -3921,12 +4735,13 @@ VOID CKeywordDetector::NotifyDetection()
         // m_qpcFrequency is defined to be the number of ticks in 1 second.
         // Use the stream start time (the current time retrieved in StartBufferStream) to 
         // mark when the keyword ended, and the start time minus 1 second worth of ticks
-        // to mark when the keyword started. Also, adjust the stream start time to align
-        // to this new keyword start time, so that the simulated stream contains the full keyword.
+        // to mark when the keyword started. Also, move the stream start time back by the
+        // configured history, so that the simulated stream contains the pre-roll and the
+        // full keyword.
 
         m_ullKeywordStopTimestamp = m_qpcStartCapture; // stop time is the current time
-        m_qpcStartCapture = m_qpcStartCapture - m_qpcFrequency; // buffer start time is 1 second ago
-        m_ullKeywordStartTimestamp = m_qpcStartCapture; // buffer start time = keyword start time
+        m_ullKeywordStartTimestamp = m_qpcStartCapture - m_qpcFrequency; // keyword start time is 1 second ago
+        m_qpcStartCapture = m_qpcStartCapture - (m_qpcFrequency * m_ulHistoryMs / 1000); // buffer start time is the history length ago
 
     }
     else
@@ -3963,8 +4778,16 @@ VOID CKeywordDetector::NotifyDetection()
 _IRQL_requires_min_(DISPATCH_LEVEL)
 VOID CKeywordDetector::DpcRoutine(_In_ LONGLONG PerformanceCounter, _In_ LONGLONG PerformanceFrequency)
 {
-    LONGLONG currentPacket;
-    LONGLONG packetsToQueue;
+    LONGLONG        currentPacket;
+    LONGLONG        packetsToQueue;
+    LONGLONG        historyRingSize;
+    KFLOATING_SAVE  saveData;
+    BOOL            floatingPointSaved = FALSE;
+    BOOL            extractFeatures = FALSE;
+    BOOL            detectVoice = FALSE;
+
+    C_ASSERT(SamplesPerSecond == KWSFEATURES_SAMPLE_RATE);
+    C_ASSERT(SamplesPerPacket == KWSFEATURES_HOP_SAMPLES);
 
     if (m_qpcStartCapture <= 0)
     {
@@ -3974,38 +4797,322 @@ VOID CKeywordDetector::DpcRoutine(_In_ LONGLONG PerformanceCounter, _In_ LONGLON
     currentPacket = (PerformanceCounter - m_qpcStartCapture) * (SamplesPerSecond / SamplesPerPacket) / PerformanceFrequency;
     packetsToQueue = currentPacket - m_nLastQueuedPacket;
 
-    while (packetsToQueue > 0)
+    // The features of every packet are computed once here, for all the
+    // keyword models, while the samples are still hot. The keyword
+    // detectors run on the same packets.
+    if (packetsToQueue > 0 &&
+        NT_SUCCESS(KeSaveFloatingPointState(&saveData)))
     {
-        LIST_ENTRY*     packetListEntry;
-        PACKET_ENTRY*   packetEntry;
+        floatingPointSaved = TRUE;
+        extractFeatures = (m_pFeatureExtractor != NULL);
+        // unlocked read, RunDetectors checks again under the lock
+        detectVoice = (ReadULongNoFence(&m_ulArmedKeywords) != 0);
 
-        do
+        if (m_bResetFeatures)
         {
-            packetListEntry = ExInterlockedRemoveHeadList(&PacketPoolHead, &PacketPoolSpinLock);
-            if (packetListEntry != NULL) break;
+            if (m_pFeatureExtractor != NULL)
+            {
+                m_pFeatureExtractor->Reset();
+            }
+            m_Vad.Reset();
 
-            // Pool is empty, no room to buffer more, an overrun is occurring. Drop and reuse the
-            // oldest packet from head of fifo.
+            KeAcquireSpinLockAtDpcLevel(&m_KeywordLock);
+            if (m_pModel != NULL)
+            {
+                m_pModel->Scorer.Reset();
+            }
+            KeReleaseSpinLockFromDpcLevel(&m_KeywordLock);
+
+            m_bResetFeatures = FALSE;
+        }
+    }
+
+    // More than a whole history behind: the older packets would be overwritten
+    // before anyone could read them, so skip straight to the last history's worth.
+    historyRingSize = GetHistoryRingSize();
+    if (packetsToQueue > historyRingSize)
+    {
+        WriteRelease64(&m_nLastQueuedPacket, currentPacket - historyRingSize);
+        packetsToQueue = historyRingSize;
+    }
 
-            // Since the pool is empty, the fifo should be full. However, although unlikely, the
-            // driver might empty the fifo before this routine removes a packet. In that case, the
-            // pool should have packets available again. Therefore this is a retry loop.
-            packetListEntry = ExInterlockedRemoveHeadList(&PacketFifoHead, &PacketFifoSpinLock);
-            if (packetListEntry != NULL) break;
-        } while (TRUE);
+    while (packetsToQueue > 0)
+    {
+        LONGLONG        packetNumber = m_nLastQueuedPacket + 1;
+        PACKET_ENTRY*   packetEntry = &PacketRing[packetNumber & (PacketRingSize - 1)];
 
-        packetEntry = CONTAINING_RECORD(packetListEntry, PACKET_ENTRY, ListEntry);
+        // The slot of the oldest packet is reused; overwriting the oldest
+        // data is the overrun behavior. The slot is stamped with its new
+        // packet number before any of its data changes, so a reader copying
+        // the old packet sees the stamp change (see CopyNextPacket).
+        WriteNoFence64(&packetEntry->PacketNumber, packetNumber);
+        KeMemoryBarrier();
 
-        packetEntry->PacketNumber = ++m_nLastQueuedPacket;
-        packetEntry->QpcWhenSampled = m_qpcStartCapture + (packetEntry->PacketNumber * PerformanceFrequency * SamplesPerPacket / SamplesPerSecond);
+        packetEntry->QpcWhenSampled = m_qpcStartCapture + (packetNumber * PerformanceFrequency * SamplesPerPacket / SamplesPerSecond);
 
         RtlZeroMemory(&packetEntry->Samples[0], sizeof(packetEntry->Samples));
 
-        InitializeListHead(packetListEntry);
-        ExInterlockedInsertTailList(&PacketFifoHead, packetListEntry, &PacketFifoSpinLock);
+        if (extractFeatures)
+        {
+            m_pFeatureExtractor->ProcessPacket((const int16_t*)&packetEntry->Samples[0], &packetEntry->Features);
+        }
+        else
+        {
+            RtlZeroMemory(&packetEntry->Features, sizeof(packetEntry->Features));
+        }
+
+        if (m_pCompressedRing != NULL)
+        {
+            COMPRESSED_PACKET_ENTRY* compressedEntry = &m_pCompressedRing[packetNumber % m_ulCompressedRingSize];
+
+            WriteNoFence64(&compressedEntry->PacketNumber, packetNumber);
+            KeMemoryBarrier();
+
+            compressedEntry->QpcWhenSampled = packetEntry->QpcWhenSampled;
+            compressedEntry->State = m_AdpcmState;
+            ImaAdpcmEncode(&m_AdpcmState, (const INT16*)&packetEntry->Samples[0], SamplesPerPacket, compressedEntry->Data);
+        }
+
+        if (detectVoice)
+        {
+            RunDetectors(packetEntry, extractFeatures, PerformanceFrequency);
+        }
+
+        // Publish the packet. The cursor is advanced one packet at a time so
+        // a reader can tell whether the slot it copied was reused meanwhile.
+        WriteRelease64(&m_nLastQueuedPacket, packetNumber);
 
         packetsToQueue -= 1;
     }
+
+    if (floatingPointSaved)
+    {
+        KeRestoreFloatingPointState(&saveData);
+    }
+}
+
+#pragma code_seg()
+_IRQL_requires_min_(DISPATCH_LEVEL)
+VOID CKeywordDetector::RunDetectors
+(
+    _In_ const PACKET_ENTRY *PacketEntry,
+    _In_ BOOL FeaturesValid,
+    _In_ LONGLONG PerformanceFrequency
+)
+/*++
+
+Routine Description:
+
+  Runs the keyword detectors on a queued packet. The first-stage voice
+  detector of each armed keyword runs on the shared measurement. A keyword
+  without a model is detected on its onset; the keywords of the model whose
+  first stage is active are scored with a single pass of the model, which
+  costs the same for all of them but one output each. Floating point state
+  is saved by the caller.
+
+--*/
+{
+    KWSVAD_MEASUREMENT measurement;
+    ULONG              armed;
+    ULONG              scoreKeywords = 0;
+
+    m_Vad.Measure((const int16_t*)PacketEntry->Samples, FeaturesValid ? &PacketEntry->Features : NULL, &measurement);
+
+    KeAcquireSpinLockAtDpcLevel(&m_KeywordLock);
+
+    // the model sees every frame, so its context is full when a first
+    // stage wakes it up
+    if (m_pModel != NULL && FeaturesValid)
+    {
+        m_pModel->Scorer.PushFrame(PacketEntry->Features.Mfcc);
+    }
+
+    armed = m_ulArmedKeywords;
+
+    for (ULONG i = 0; i < m_ulKeywordCount; i++)
+    {
+        KEYWORD_ENTRY* keyword = &m_Keywords[i];
+        bool onset;
+
+        if ((armed & (1UL << i)) == 0)
+        {
+            continue;
+        }
+
+        if (keyword->Data != keyword->TriggerData)
+        {
+            keyword->Trigger.Configure(KwsVad_UnpackThresholds((ULONGLONG)keyword->Data));
+            keyword->TriggerData = keyword->Data;
+        }
+
+        onset = keyword->Trigger.Process(measurement);
+
+        if (keyword->ModelOutput < 0)
+        {
+            if (onset)
+            {
+                RaiseDetection(i, PacketEntry->PacketNumber - (LONGLONG)keyword->Trigger.GetActiveRun() + 1, PacketEntry->PacketNumber, PerformanceFrequency);
+            }
+        }
+        else if (keyword->Trigger.IsActive())
+        {
+            scoreKeywords |= (1UL << i);
+        }
+    }
+
+    if (scoreKeywords != 0 && m_pModel->Scorer.IsPrimed())
+    {
+        const float* scores = m_pModel->Scorer.Score();
+        LONGLONG startPacket = PacketEntry->PacketNumber - (LONGLONG)m_pModel->Scorer.GetFrameCount() + 1;
+
+        for (ULONG i = 0; i < m_ulKeywordCount; i++)
+        {
+            if ((scoreKeywords & (1UL << i)) != 0 &&
+                scores[m_Keywords[i].ModelOutput] >= m_Keywords[i].Threshold)
+            {
+                RaiseDetection(i, startPacket, PacketEntry->PacketNumber, PerformanceFrequency);
+            }
+        }
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&m_KeywordLock);
+}
+
+#pragma code_seg()
+_IRQL_requires_min_(DISPATCH_LEVEL)
+VOID CKeywordDetector::RaiseDetection
+(
+    _In_ ULONG Index,
+    _In_ LONGLONG StartPacket,
+    _In_ LONGLONG StopPacket,
+    _In_ LONGLONG PerformanceFrequency
+)
+/*++
+
+Routine Description:
+
+  Records packets StartPacket through StopPacket as the keyword start and
+  stop times, disarms the keyword and leaves the detection for
+  TakeDetections. Called with m_KeywordLock held.
+
+--*/
+{
+    m_ullKeywordStartTimestamp = m_qpcStartCapture + (StartPacket * PerformanceFrequency * SamplesPerPacket / SamplesPerSecond);
+    m_ullKeywordStopTimestamp = m_qpcStartCapture + ((StopPacket + 1) * PerformanceFrequency * SamplesPerPacket / SamplesPerSecond);
+
+    m_ulArmedKeywords &= ~(1UL << Index);
+
+    InterlockedOr(&m_lDetectionsPending, (LONG)(1UL << Index));
+}
+
+#pragma code_seg()
+_IRQL_requires_max_(APC_LEVEL)
+NTSTATUS CKeywordDetector::CopyNextPacket
+(
+    _Out_ BYTE *Buffer,
+    _In_ ULONG BufferPackets,
+    _Out_ LONGLONG *PacketNumber,
+    _Out_ LONGLONG *QpcWhenSampled,
+    _Out_ LONGLONG *LastPacket
+)
+/*++
+
+Routine Description:
+
+  Copies the packet at the read cursor, or the oldest packet still buffered
+  after an overrun, into slot (packet number % BufferPackets) of Buffer. The
+  read cursor is not moved. The caller holds m_ReadLock.
+
+  A copy is only returned if the slot still carries the packet's number
+  once it is done. A different number means the slot was reused during the
+  copy, or it was never written because DpcRoutine skipped that packet when
+  it fell more than a history behind; the next packet is tried then.
+
+Return Value:
+
+  STATUS_DEVICE_NOT_READY if no new packet is available.
+
+--*/
+{
+    BYTE *packetData;
+    PACKET_ENTRY *packetEntry;
+    LONGLONG lastPacket;
+    LONGLONG packetNumber;
+    LONGLONG firstPacket = m_nNextReadPacket;
+    LONGLONG slotPacket;
+    LONGLONG qpcWhenSampled;
+    LONGLONG historyRingSize = GetHistoryRingSize();
+    LONGLONG usedRingSize;
+    const ULONG packetSize = sizeof(packetEntry->Samples);
+
+    for (;;)
+    {
+        lastPacket = ReadAcquire64(&m_nLastQueuedPacket);
+        packetNumber = firstPacket;
+
+        if (packetNumber > lastPacket)
+        {
+            return STATUS_DEVICE_NOT_READY;
+        }
+
+        // Overrun: the oldest packets were overwritten. The slot after the
+        // last published packet may be being written right now, so the
+        // oldest readable packet is one newer than a full ring.
+        if (lastPacket - packetNumber > historyRingSize - 2)
+        {
+            packetNumber = lastPacket - (historyRingSize - 2);
+        }
+
+        packetData = Buffer + ((packetNumber % BufferPackets) * packetSize);
+
+        if (lastPacket - packetNumber <= PacketRingSize - 2)
+        {
+            // Recent packet, still raw
+            packetEntry = &PacketRing[packetNumber & (PacketRingSize - 1)];
+            usedRingSize = PacketRingSize;
+
+            qpcWhenSampled = packetEntry->QpcWhenSampled;
+            RtlCopyMemory(packetData, packetEntry->Samples, packetSize);
+
+            KeMemoryBarrier();
+            slotPacket = ReadNoFence64(&packetEntry->PacketNumber);
+        }
+        else
+        {
+            // Older pre-roll, decoded straight into the client buffer
+            COMPRESSED_PACKET_ENTRY* compressedEntry = &m_pCompressedRing[packetNumber % m_ulCompressedRingSize];
+            usedRingSize = m_ulCompressedRingSize;
+
+            qpcWhenSampled = compressedEntry->QpcWhenSampled;
+            ImaAdpcmDecode(compressedEntry->State, compressedEntry->Data, SamplesPerPacket, (INT16*)packetData);
+
+            KeMemoryBarrier();
+            slotPacket = ReadNoFence64(&compressedEntry->PacketNumber);
+        }
+
+        if (slotPacket != packetNumber)
+        {
+            // An older packet in the slot: the writer skipped this one. A
+            // newer one: it was overwritten during the copy. Either way the
+            // packet is lost; move past it.
+            firstPacket = packetNumber + 1;
+            continue;
+        }
+
+        // If the writer got far enough to reuse this slot while it was being
+        // copied, the copy may be torn; retry with a newer packet.
+        lastPacket = ReadAcquire64(&m_nLastQueuedPacket);
+        if (lastPacket - packetNumber <= usedRingSize - 2)
+        {
+            break;
+        }
+    }
+
+    *PacketNumber = packetNumber;
+    *QpcWhenSampled = qpcWhenSampled;
+    *LastPacket = lastPacket;
+
+    return STATUS_SUCCESS;
 }
 
 #pragma code_seg()
@@ -4020,41 +5127,119 @@ NTSTATUS CKeywordDetector::GetReadPacket
     _Out_ BOOL *MoreData
 )
 {
-    NTSTATUS ntStatus;
-    BYTE *packetData;
-    PACKET_ENTRY *packetEntry;
-    LIST_ENTRY *packetListEntry = NULL;
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    LONGLONG lastPacket;
+    LONGLONG packetNumber;
+    LONGLONG qpcWhenSampled;
     ULONG packetSize = WaveRtBufferSize / PacketsPerWaveRtBuffer;
 
     NT_ASSERT(SamplesPerPacket * 2 == packetSize);
-    NT_ASSERT(sizeof(packetEntry->Samples) == packetSize);
+    UNREFERENCED_PARAMETER(packetSize);
+
+    ExAcquireFastMutex(&m_ReadLock);
 
-    packetListEntry = ExInterlockedRemoveHeadList(&PacketFifoHead, &PacketFifoSpinLock);
-    if (packetListEntry == NULL)
+    ntStatus = CopyNextPacket(WaveRtBuffer, PacketsPerWaveRtBuffer, &packetNumber, &qpcWhenSampled, &lastPacket);
+    if (!NT_SUCCESS(ntStatus))
     {
-        ntStatus = STATUS_DEVICE_NOT_READY;
         goto Exit;
     }
-    packetEntry = CONTAINING_RECORD(packetListEntry, PACKET_ENTRY, ListEntry);
-
-    packetData = WaveRtBuffer + ((packetEntry->PacketNumber * packetSize) % WaveRtBufferSize);
 
-    ntStatus = RtlLongLongToULong(packetEntry->PacketNumber, PacketNumber);
+    ntStatus = RtlLongLongToULong(packetNumber, PacketNumber);
     if (!NT_SUCCESS(ntStatus))
     {
         goto Exit;
     }
 
-    *PerformanceCounterValue = packetEntry->QpcWhenSampled;
-    *MoreData = !IsListEmpty(&PacketFifoHead);
-    RtlCopyMemory(packetData, packetEntry->Samples, sizeof(packetEntry->Samples));
+    m_nNextReadPacket = packetNumber + 1;
+
+    *PerformanceCounterValue = qpcWhenSampled;
+    *MoreData = (m_nNextReadPacket <= lastPacket);
 
 Exit:
-    if (packetListEntry != NULL)
+    ExReleaseFastMutex(&m_ReadLock);
+    return ntStatus;
+}
+
+#pragma code_seg()
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS CKeywordDetector::ReadPacketBurst
+(
+    _In_ ULONG MaxPackets,
+    _Out_writes_(MaxPackets) SYSVAD_KEYWORD_PACKET *Packets,
+    _Out_ ULONG *FirstPacketNumber,
+    _Out_ ULONG *PacketCount,
+    _Out_ BOOL *MoreData
+)
+/*++
+
+Routine Description:
+
+  Reads up to MaxPackets consecutive packets in one call, so that the
+  history buffered before a detection can be drained without a round trip
+  per packet. The burst stops early at the newest packet, or where an
+  overrun would skip packets; the skipped range is then reported by the
+  next read.
+
+Return Value:
+
+  STATUS_DEVICE_NOT_READY if no new packet is available.
+
+--*/
+{
+    NTSTATUS ntStatus = STATUS_SUCCESS;
+    LONGLONG lastPacket = 0;
+    LONGLONG firstPacket = 0;
+    LONGLONG packetNumber;
+    LONGLONG qpcWhenSampled;
+    ULONG count = 0;
+
+    C_ASSERT(SamplesPerPacket == SYSVAD_KEYWORD_SAMPLES_PER_PACKET);
+
+    *FirstPacketNumber = 0;
+    *PacketCount = 0;
+    *MoreData = FALSE;
+
+    ExAcquireFastMutex(&m_ReadLock);
+
+    while (count < MaxPackets)
     {
-        ExInterlockedInsertTailList(&PacketPoolHead, packetListEntry, &PacketPoolSpinLock);
+        ntStatus = CopyNextPacket((BYTE*)Packets[count].Samples, 1, &packetNumber, &qpcWhenSampled, &lastPacket);
+        if (!NT_SUCCESS(ntStatus))
+        {
+            break;
+        }
+
+        if (count == 0)
+        {
+            firstPacket = packetNumber;
+        }
+        else if (packetNumber != firstPacket + count)
+        {
+            // Not consecutive; leave the packet for the next read
+            break;
+        }
+
+        Packets[count].PerformanceCounter = qpcWhenSampled;
+        m_nNextReadPacket = packetNumber + 1;
+        count++;
+    }
+
+    if (count == 0)
+    {
+        goto Exit;
     }
 
+    ntStatus = RtlLongLongToULong(firstPacket, FirstPacketNumber);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        goto Exit;
+    }
+
+    *PacketCount = count;
+    *MoreData = (m_nNextReadPacket <= ReadAcquire64(&m_nLastQueuedPacket));
+
+Exit:
+    ExReleaseFastMutex(&m_ReadLock);
     return ntStatus;
 }
 
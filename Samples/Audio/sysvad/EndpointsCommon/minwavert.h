@@ -22,12 +22,50 @@ Abstract:
 #include "usbhsmicwavtable.h"
 #endif // SYSVAD_USB_SIDEBAND
 
+#include "..\APO\Inc\KwsFeatures.h"
+#include "..\APO\Inc\KwsVad.h"
+#include "..\APO\Inc\KwsScorer.h"
+#include "ImaAdpcm.h"
+#include "SysVadShared.h"
+
 //=============================================================================
 // Referenced Forward
 //=============================================================================
 class CMiniportWaveRTStream;
 typedef CMiniportWaveRTStream *PCMiniportWaveRTStream;
 
+//=============================================================================
+// Per-stream block
+//=============================================================================
+//
+// A stream keeps its DPC, its copy of the format and its mute, volume and
+// peak meter arrays in one block. Each part starts on a cache line, so the
+// peak meters written by the stream's timer do not share a line with the
+// volume and mute state of the property handlers.
+//
+typedef struct _STREAM_BLOCK_LAYOUT
+{
+    ULONG   FormatOffset;
+    ULONG   MutedOffset;
+    ULONG   VolumeLevelOffset;
+    ULONG   PeakMeterOffset;
+    ULONG   Size;
+} STREAM_BLOCK_LAYOUT;
+
+inline VOID GetStreamBlockLayout
+(
+    _In_    ULONG                   Channels,
+    _In_    ULONG                   FormatBytes,
+    _Out_   STREAM_BLOCK_LAYOUT *   Layout
+)
+{
+    Layout->FormatOffset = (ULONG)ALIGN_UP_BY(sizeof(KDPC), SYSTEM_CACHE_ALIGNMENT_SIZE);
+    Layout->MutedOffset = (ULONG)ALIGN_UP_BY(Layout->FormatOffset + FormatBytes, SYSTEM_CACHE_ALIGNMENT_SIZE);
+    Layout->VolumeLevelOffset = (ULONG)ALIGN_UP_BY(Layout->MutedOffset + Channels * sizeof(BOOL), SYSTEM_CACHE_ALIGNMENT_SIZE);
+    Layout->PeakMeterOffset = (ULONG)ALIGN_UP_BY(Layout->VolumeLevelOffset + Channels * sizeof(LONG), SYSTEM_CACHE_ALIGNMENT_SIZE);
+    Layout->Size = (ULONG)ALIGN_UP_BY(Layout->PeakMeterOffset + Channels * sizeof(LONG), SYSTEM_CACHE_ALIGNMENT_SIZE);
+}
+
 //=============================================================================
 // Classes
 //=============================================================================
@@ -38,6 +76,7 @@ class CKeywordDetector
 {
 public:
     CKeywordDetector();
+    ~CKeywordDetector();
 
     _IRQL_requires_max_(PASSIVE_LEVEL)
     NTSTATUS ResetDetector(_In_ GUID eventId);
@@ -45,6 +84,9 @@ public:
     _IRQL_requires_max_(PASSIVE_LEVEL)
     NTSTATUS DownloadDetectorData(_In_ GUID eventId, _In_ LONGLONG Data);
 
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS DownloadModel(_In_ GUID eventId, _In_reads_bytes_(ModelSize) const VOID *Model, _In_ ULONG ModelSize);
+
     _IRQL_requires_max_(PASSIVE_LEVEL)
     NTSTATUS GetDetectorData(_In_ GUID eventId, _Out_ LONGLONG *Data);
 
@@ -75,10 +117,24 @@ public:
     _IRQL_requires_min_(DISPATCH_LEVEL)
     VOID DpcRoutine(_In_ LONGLONG PerformanceCounter, _In_ LONGLONG PerformanceFrequency);
 
+    // Returns and clears the detections raised by DpcRoutine, one bit per
+    // keyword registry entry (bit 0 for CONTOSO_KEYWORD1, bit 1 for
+    // CONTOSO_KEYWORD2).
+    LONG TakeDetections()
+    {
+        return InterlockedExchange(&m_lDetectionsPending, 0);
+    }
+
     _IRQL_requires_max_(PASSIVE_LEVEL)
     NTSTATUS GetReadPacket(_In_ ULONG PacketsPerWaveRtBuffer, _In_  ULONG WaveRtBufferSize, _Out_writes_(WaveRtBufferSize) BYTE *WaveRtBuffer, _Out_ ULONG *PacketNumber, _Out_ ULONGLONG *PerformanceCount, _Out_ BOOL *MoreData);
 
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    NTSTATUS ReadPacketBurst(_In_ ULONG MaxPackets, _Out_writes_(MaxPackets) SYSVAD_KEYWORD_PACKET *Packets, _Out_ ULONG *FirstPacketNumber, _Out_ ULONG *PacketCount, _Out_ BOOL *MoreData);
+
 private:
+    _IRQL_requires_max_(APC_LEVEL)
+    NTSTATUS CopyNextPacket(_Out_ BYTE *Buffer, _In_ ULONG BufferPackets, _Out_ LONGLONG *PacketNumber, _Out_ LONGLONG *QpcWhenSampled, _Out_ LONGLONG *LastPacket);
+
     _IRQL_requires_max_(PASSIVE_LEVEL)
     VOID ResetFifo();
 
@@ -88,39 +144,127 @@ private:
     _IRQL_requires_max_(PASSIVE_LEVEL)
     VOID StartBufferingStream();
 
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    VOID AllocateHistory();
+
+    _IRQL_requires_max_(PASSIVE_LEVEL)
+    VOID AllocateFeatureExtractor();
+
+    _IRQL_requires_min_(DISPATCH_LEVEL)
+    VOID RunDetectors(_In_ const PACKET_ENTRY *PacketEntry, _In_ BOOL FeaturesValid, _In_ LONGLONG PerformanceFrequency);
+
+    _IRQL_requires_min_(DISPATCH_LEVEL)
+    VOID RaiseDetection(_In_ ULONG Index, _In_ LONGLONG StartPacket, _In_ LONGLONG StopPacket, _In_ LONGLONG PerformanceFrequency);
+
+    // Registry index of eventId, or -1. Called with m_KeywordLock held.
+    LONG FindKeyword(_In_ const GUID &eventId)
+    {
+        for (ULONG i = 0; i < m_ulKeywordCount; i++)
+        {
+            if (m_Keywords[i].EventId == eventId)
+            {
+                return (LONG)i;
+            }
+        }
+        return -1;
+    }
+
+    LONGLONG GetHistoryRingSize()
+    {
+        return (m_pCompressedRing != NULL) ? m_ulCompressedRingSize : PacketRingSize;
+    }
+
     // The Contoso keyword detector processes 10ms packets of 16KHz 16-bit PCM
     // audio samples
     static const int SamplesPerSecond = 16000;
     static const int SamplesPerPacket = (10 * SamplesPerSecond / 1000);
 
+    // Ring of the most recent packets, raw and with their features, indexed
+    // by packet number. Must be a power of two.
+    static const int PacketRingSize = 32;      // 320 ms of audio data
+
+    // Limits of the KeywordHistoryMs registry value
+    static const ULONG MinHistoryMs = 1000;
+    static const ULONG MaxHistoryMs = 10000;
+
     typedef struct
     {
-        LIST_ENTRY  ListEntry;
         LONGLONG    PacketNumber;
         LONGLONG    QpcWhenSampled;
         UINT16      Samples[SamplesPerPacket];
+        KWSFEATURES_FRAME Features;     // front-end output for Samples, shared by all keyword models
     } PACKET_ENTRY;
 
-    BOOL            m_streamRunning;
+    // Every packet is also kept IMA ADPCM compressed, a quarter of the size,
+    // for the pre-roll older than the raw ring.
+    typedef struct
+    {
+        LONGLONG        PacketNumber;
+        LONGLONG        QpcWhenSampled;
+        IMA_ADPCM_STATE State;          // decoder state at the first sample
+        BYTE            Data[SamplesPerPacket / 2];
+    } COMPRESSED_PACKET_ENTRY;
 
-    BOOL            m_SoundDetectorArmed1;
-    BOOL            m_SoundDetectorArmed2;
-    LONGLONG        m_SoundDetectorData1;
-    LONGLONG        m_SoundDetectorData2;
+    BOOL            m_streamRunning;
 
     LONGLONG        m_qpcStartCapture;
     LONGLONG        m_qpcFrequency;
-    LONGLONG        m_nLastQueuedPacket;
+    volatile LONGLONG m_nLastQueuedPacket;      // write cursor, published by DpcRoutine
+    LONGLONG        m_nNextReadPacket;          // read cursor, protected by m_ReadLock
+    FAST_MUTEX      m_ReadLock;                 // serializes GetReadPacket and ReadPacketBurst
 
     ULONGLONG       m_ullKeywordStartTimestamp;
     ULONGLONG       m_ullKeywordStopTimestamp;
 
-    KSPIN_LOCK      PacketPoolSpinLock;
-    LIST_ENTRY      PacketPoolHead;
-    PACKET_ENTRY    PacketPool[1 * SamplesPerSecond / SamplesPerPacket];    // Enough storage for 1 second of audio data
+    PACKET_ENTRY    PacketRing[PacketRingSize];
+
+    // Compressed history, allocated on first use. NULL if the configured
+    // history fits in the raw ring or the allocation failed.
+    ULONG           m_ulHistoryMs;
+    COMPRESSED_PACKET_ENTRY* m_pCompressedRing;
+    ULONG           m_ulCompressedRingSize;
+    IMA_ADPCM_STATE m_AdpcmState;               // encoder state, owned by DpcRoutine
+
+    // Feature front-end, run once per packet in DpcRoutine. Allocated with
+    // the history when buffering first starts, so only miniports that buffer
+    // keyword audio pay for its tables. NULL until then or if it failed.
+    CKwsFeatureExtractor* m_pFeatureExtractor;
+    BOOL            m_bResetFeatures;
+
+    // Keyword registry. Entries 0 and 1 are CONTOSO_KEYWORD1 and
+    // CONTOSO_KEYWORD2; a keyword model appends its other keywords. Every
+    // packet goes through the first-stage voice detector of each armed
+    // keyword, and the keywords of the model whose first stage is active are
+    // scored together by the second stage. m_KeywordLock protects the
+    // registry and the model; DpcRoutine holds it while it runs the detectors
+    // on a packet.
+    static const ULONG BuiltInKeywords = 2;
+    static const ULONG MaxKeywords = BuiltInKeywords + 16;     // room for a full model
+
+    typedef struct
+    {
+        GUID            EventId;
+        LONGLONG        Data;               // first-stage thresholds
+        LONG            ModelOutput;        // output of m_pModel scoring this keyword, -1 if none
+        float           Threshold;          // model output needed for a detection
+        CKwsVadTrigger  Trigger;
+        LONGLONG        TriggerData;        // Data the trigger was configured with
+    } KEYWORD_ENTRY;
+
+    // Second stage, with its weights and state carved out of the same
+    // allocation after the structure.
+    typedef struct
+    {
+        CKwsScorer      Scorer;
+    } KEYWORD_MODEL;
 
-    KSPIN_LOCK      PacketFifoSpinLock;
-    LIST_ENTRY      PacketFifoHead;
+    KSPIN_LOCK      m_KeywordLock;
+    KEYWORD_ENTRY   m_Keywords[MaxKeywords];
+    ULONG           m_ulKeywordCount;
+    ULONG           m_ulArmedKeywords;          // one bit per entry
+    KEYWORD_MODEL*  m_pModel;
+    CKwsVad         m_Vad;
+    volatile LONG   m_lDetectionsPending;
 
 };
 
@@ -177,6 +321,42 @@ private:
     };
 
     AUDIOMODULE *                       m_pAudioModules;
+    AUDIOMODULE_INDEX                   m_AudioModuleIndex;
+
+    //
+    // Hash index over the device formats of a pin, built at Init so that
+    // IsFormatSupported probes a few slots instead of scanning the table.
+    // Slots are keyed on (format tag, channels, rate, bits per sample) and
+    // hold the format index + 1, 0 for an empty slot.
+    //
+    typedef struct _FORMAT_INDEX
+    {
+        PKSDATAFORMAT_WAVEFORMATEXTENSIBLE  Formats;        // table the index was built from
+        ULONG                               FormatCount;
+        ULONG                               SlotMask;
+        PUSHORT                             Slots;
+    } FORMAT_INDEX, *PFORMAT_INDEX;
+
+    PFORMAT_INDEX                       m_FormatIndex;      // one per entry of m_DeviceFormatsAndModes
+
+    //
+    // Stream blocks sized for m_DeviceMaxChannels channels and an
+    // extensible format. Streams that need a bigger block get it from pool.
+    //
+    NPAGED_LOOKASIDE_LIST               m_StreamBlockPool;
+    ULONG                               m_StreamBlockPoolElementSize;
+
+    static PVOID NTAPI AllocateStreamBlockPoolElement
+    (
+        _In_ POOL_TYPE  PoolType,
+        _In_ SIZE_T     NumberOfBytes,
+        _In_ ULONG      Tag
+    );
+
+    static VOID NTAPI FreeStreamBlockPoolElement
+    (
+        _In_ PVOID      Buffer
+    );
 
 protected:
     PADAPTERCOMMON                      m_pAdapterCommon;
@@ -202,6 +382,7 @@ public:
     DECLARE_PROPERTYHANDLER(Get_SoundDetectorStreamingSupport2);
 
     DECLARE_PROPERTYHANDLER(Get_InterleavedFormatInformation);
+    DECLARE_PROPERTYHANDLER(Get_KeywordBurstRead);
 
 
     NTSTATUS EventHandler_PinCapsChange
@@ -239,6 +420,22 @@ public:
         _In_ PKSDATAFORMAT  _pDataFormat
     );
 
+    NTSTATUS BuildFormatIndex();
+
+    static ULONG HashFormat
+    (
+        _In_ USHORT         _usFormatTag,
+        _In_ WORD           _nChannels,
+        _In_ DWORD          _nSamplesPerSec,
+        _In_ WORD           _wBitsPerSample
+    );
+
+    static BOOL IsFormatMatch
+    (
+        _In_ PKSDATAFORMAT_WAVEFORMATEXTENSIBLE _pFormat,
+        _In_ PKSDATAFORMAT  _pDataFormat
+    );
+
     static NTSTATUS GetAttributesFromAttributeList
     (
         _In_ const KSMULTIPLE_ITEM *_pAttributes,
@@ -309,6 +506,8 @@ public:
         m_DeviceFlags(MiniportPair->DeviceFlags),
         m_pMiniportPair(MiniportPair),
         m_pAudioModules(NULL),
+        m_AudioModuleIndex(),
+        m_FormatIndex(NULL),
         m_pPortClsNotifications(NULL)
     {
         PAGED_CODE();
@@ -385,6 +584,17 @@ public:
 
         KeInitializeSpinLock(&m_DeviceFormatsAndModesLock);
         m_DeviceFormatsAndModesIrql = PASSIVE_LEVEL;
+
+        STREAM_BLOCK_LAYOUT layout;
+        GetStreamBlockLayout(m_DeviceMaxChannels, sizeof(WAVEFORMATEXTENSIBLE), &layout);
+        m_StreamBlockPoolElementSize = layout.Size;
+        ExInitializeNPagedLookasideList(&m_StreamBlockPool,
+                                        AllocateStreamBlockPoolElement,
+                                        FreeStreamBlockPoolElement,
+                                        POOL_NX_ALLOCATION,
+                                        m_StreamBlockPoolElementSize,
+                                        MINWAVERT_POOLTAG,
+                                        0);
     }
 
 #pragma code_seg()
@@ -408,6 +618,12 @@ public:
     VOID DpcRoutine(LONGLONG PerformanceCounter, LONGLONG PerformanceFrequency)
     {
         m_KeywordDetector.DpcRoutine(PerformanceCounter, PerformanceFrequency);
+
+        // The first-stage detector fired on an armed keyword
+        if (m_KeywordDetector.TakeDetections() != 0 && m_pPortEvents != NULL)
+        {
+            m_pPortEvents->GenerateEventList(const_cast<GUID*>(&KSEVENTSETID_SoundDetector), KSEVENT_SOUNDDETECTOR_MATCHDETECTED, FALSE, 0, FALSE, 0);
+        }
     }
 
     NTSTATUS PropertyHandlerEffectListRequest
@@ -712,6 +928,17 @@ protected:
         _In_ ULONG              AudioModuleCount
         );
 
+    PVOID
+    AllocStreamBlock(
+        _In_ ULONG              Size
+        );
+
+    VOID
+    FreeStreamBlock(
+        _In_ PVOID              Block,
+        _In_ ULONG              Size
+        );
+
 #if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND)
 public:
 #pragma code_seg()
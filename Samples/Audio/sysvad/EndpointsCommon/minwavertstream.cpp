@@ -37,6 +37,8 @@ Return Value:
     PAGED_CODE();
     if (NULL != m_pMiniport)
     {
+        AudioModule_CleanupIndex(&m_AudioModuleIndex);
+
         if (m_pAudioModules)
         {
             m_pMiniport->FreeStreamAudioModules(m_pAudioModules, m_AudioModuleCount);
@@ -49,46 +51,52 @@ Return Value:
             m_pMiniport->StreamClosed(m_ulPin, this);
             m_bUnregisterStream = FALSE;
         }
+
+        if (m_pStreamBlock)
+        {
+            m_pMiniport->FreeStreamBlock(m_pStreamBlock, m_ulStreamBlockSize);
+            m_pStreamBlock = NULL;
+            m_pDpc = NULL;
+            m_pWfExt = NULL;
+            m_pbMuted = NULL;
+            m_plVolumeLevel = NULL;
+            m_plPeakMeter = NULL;
+        }
+
+#ifdef SYSVAD_A2DP_SIDEBAND
+        if (m_pA2dpSbc)
+        {
+            // The device's transport drains the ring until it is stopped.
+            m_pMiniport->GetSidebandDevice()->StopPacketTransport(eA2dpHpSpeakerDevice);
+        }
+#endif  // SYSVAD_A2DP_SIDEBAND
         
         m_pMiniport->Release();
         m_pMiniport = NULL;
     }
 
-    if (m_pDpc)
-    {
-        ExFreePoolWithTag( m_pDpc, MINWAVERTSTREAM_POOLTAG );
-        m_pDpc = NULL;
-    }
-
     if (m_pTimer)
     {
         ExFreePoolWithTag( m_pTimer, MINWAVERTSTREAM_POOLTAG );
         m_pTimer = NULL;
     }
 
-    if (m_pbMuted)
-    {
-        ExFreePoolWithTag( m_pbMuted, MINWAVERTSTREAM_POOLTAG );
-        m_pbMuted = NULL;
-    }
-
-    if (m_plVolumeLevel)
-    {
-        ExFreePoolWithTag( m_plVolumeLevel, MINWAVERTSTREAM_POOLTAG );
-        m_plVolumeLevel = NULL;
-    }
-
-    if (m_plPeakMeter)
+#ifdef SYSVAD_BTH_BYPASS
+    if (m_pHfpCodec)
     {
-        ExFreePoolWithTag( m_plPeakMeter, MINWAVERTSTREAM_POOLTAG );
-        m_plPeakMeter = NULL;
+        ExFreePoolWithTag( m_pHfpCodec, MINWAVERTSTREAM_POOLTAG );
+        m_pHfpCodec = NULL;
     }
+#endif  // SYSVAD_BTH_BYPASS
 
-    if (m_pWfExt)
+#ifdef SYSVAD_A2DP_SIDEBAND
+    if (m_pA2dpSbc)
     {
-        ExFreePoolWithTag( m_pWfExt, MINWAVERTSTREAM_POOLTAG );
-        m_pWfExt = NULL;
+        DPF(D_TERSE, ("A2DP SBC encoder: %u frames dropped", m_pA2dpSbc->DroppedFrames));
+        ExFreePoolWithTag( m_pA2dpSbc, MINWAVERTSTREAM_POOLTAG );
+        m_pA2dpSbc = NULL;
     }
+#endif  // SYSVAD_A2DP_SIDEBAND
     if (m_pNotificationTimer)
     {
         ExDeleteTimer
@@ -212,6 +220,7 @@ Return Value:
 
     PWAVEFORMATEX pWfEx = NULL;
     NTSTATUS ntStatus = STATUS_SUCCESS;
+    STREAM_BLOCK_LAYOUT layout;
 
     m_pMiniport = NULL;
     m_ulPin = 0;
@@ -237,6 +246,8 @@ Return Value:
     m_plVolumeLevel = NULL;
     m_plPeakMeter = NULL;
     m_pWfExt = NULL;
+    m_pStreamBlock = NULL;
+    m_ulStreamBlockSize = 0;
     m_ullLinearPosition = 0;
     m_ullPresentationPosition = 0;
     m_ulContentId = 0;
@@ -249,6 +260,7 @@ Return Value:
     m_bLastBufferRendered = FALSE;
     m_pAudioModules = NULL;
     m_AudioModuleCount = 0;
+    RtlZeroMemory(&m_AudioModuleIndex, sizeof(m_AudioModuleIndex));
 
     m_ulHostCaptureToneFrequency = IsEqualGUID(SignalProcessingMode, AUDIO_SIGNALPROCESSINGMODE_RAW) ? 1000 : 2000;
     m_ulLoopbackCaptureToneFrequency = 3000; // 3 kHz (default)
@@ -265,6 +277,14 @@ Return Value:
     m_SidebandStarted = FALSE;
 #endif  // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND)
 
+#ifdef SYSVAD_BTH_BYPASS
+    m_pHfpCodec = NULL;
+#endif  // SYSVAD_BTH_BYPASS
+
+#ifdef SYSVAD_A2DP_SIDEBAND
+    m_pA2dpSbc = NULL;
+#endif  // SYSVAD_A2DP_SIDEBAND
+
     m_pPortStream = PortStream_;
     InitializeListHead(&m_NotificationList);
     m_ulNotificationIntervalMs = 0;
@@ -302,36 +322,98 @@ Return Value:
     m_bCapture = Capture_;
     m_ulDmaMovementRate = pWfEx->nAvgBytesPerSec;
 
-    m_pDpc = (PRKDPC)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(KDPC), MINWAVERTSTREAM_POOLTAG);
-    if (!m_pDpc)
+    //
+    // The DPC, the format and the per-channel arrays share one block from
+    // the miniport's stream block pool.
+    //
+    GetStreamBlockLayout(pWfEx->nChannels, sizeof(WAVEFORMATEX) + pWfEx->cbSize, &layout);
+    m_pStreamBlock = m_pMiniport->AllocStreamBlock(layout.Size);
+    if (m_pStreamBlock == NULL)
     {
         return STATUS_INSUFFICIENT_RESOURCES;
     }
+    m_ulStreamBlockSize = layout.Size;
+
+    m_pDpc = (PRKDPC)m_pStreamBlock;
+    m_pWfExt = (PWAVEFORMATEXTENSIBLE)((PBYTE)m_pStreamBlock + layout.FormatOffset);
+    m_pbMuted = (PBOOL)((PBYTE)m_pStreamBlock + layout.MutedOffset);
+    m_plVolumeLevel = (PLONG)((PBYTE)m_pStreamBlock + layout.VolumeLevelOffset);
+    m_plPeakMeter = (PLONG)((PBYTE)m_pStreamBlock + layout.PeakMeterOffset);
 
-    m_pWfExt = (PWAVEFORMATEXTENSIBLE)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(WAVEFORMATEX) + pWfEx->cbSize, MINWAVERTSTREAM_POOLTAG);
-    if (m_pWfExt == NULL)
-    {
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
     RtlCopyMemory(m_pWfExt, pWfEx, sizeof(WAVEFORMATEX) + pWfEx->cbSize);
 
-    m_pbMuted = (PBOOL)ExAllocatePool2(POOL_FLAG_NON_PAGED, m_pWfExt->Format.nChannels * sizeof(BOOL), MINWAVERTSTREAM_POOLTAG);
-    if (m_pbMuted == NULL)
+#ifdef SYSVAD_BTH_BYPASS
+    //
+    // Without SCO bypass the HFP audio is encoded in the driver, CVSD at
+    // 8 kHz or mSBC at 16 kHz, and the device carries the SCO packets.
+    //
+    if ((m_pMiniport->m_DeviceType == eBthHfpSpeakerDevice || m_pMiniport->m_DeviceType == eBthHfpMicDevice) &&
+        m_pMiniport->GetSidebandDevice() != NULL &&
+        !m_pMiniport->GetSidebandDevice()->IsEncodingOffloaded(m_pMiniport->m_DeviceType))
     {
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
+        if (m_pWfExt->Format.nChannels != 1 || m_pWfExt->Format.wBitsPerSample != 16)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
 
-    m_plVolumeLevel = (PLONG)ExAllocatePool2(POOL_FLAG_NON_PAGED, m_pWfExt->Format.nChannels * sizeof(LONG), MINWAVERTSTREAM_POOLTAG);
-    if (m_plVolumeLevel == NULL)
-    {
-        return STATUS_INSUFFICIENT_RESOURCES;
+        m_pHfpCodec = (HFP_CODEC_STAGE *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(HFP_CODEC_STAGE), MINWAVERTSTREAM_POOLTAG);
+        if (m_pHfpCodec == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (!HfpCodecInit(m_pHfpCodec, m_pWfExt->Format.nSamplesPerSec))
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        DPF(D_TERSE, ("HFP software codec: %s", m_pHfpCodec->Codec == HFP_CODEC_MSBC ? "mSBC" : "CVSD"));
     }
+#endif  // SYSVAD_BTH_BYPASS
 
-    m_plPeakMeter = (PLONG)ExAllocatePool2(POOL_FLAG_NON_PAGED, m_pWfExt->Format.nChannels * sizeof(LONG), MINWAVERTSTREAM_POOLTAG);
-    if (m_plPeakMeter == NULL)
+#ifdef SYSVAD_A2DP_SIDEBAND
+    //
+    // Without sideband encoding, the A2DP speaker stream is SBC encoded in
+    // the driver, in the PCM format negotiated for the endpoint. The device
+    // sends the packets from the ring and reports back the link quality.
+    //
+    if (m_pMiniport->m_DeviceType == eA2dpHpSpeakerDevice &&
+        m_pMiniport->GetSidebandDevice() != NULL &&
+        !m_pMiniport->GetSidebandDevice()->IsEncodingOffloaded(eA2dpHpSpeakerDevice))
     {
-        return STATUS_INSUFFICIENT_RESOURCES;
+        if (m_pWfExt->Format.wBitsPerSample != 16)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        m_pA2dpSbc = (A2DP_SBC_STAGE *)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(A2DP_SBC_STAGE), MINWAVERTSTREAM_POOLTAG);
+        if (m_pA2dpSbc == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (!A2dpSbcInit(m_pA2dpSbc,
+                         m_pWfExt->Format.nSamplesPerSec,
+                         m_pWfExt->Format.nChannels,
+                         2,
+                         A2dpSbcHighQualityBitpool(m_pWfExt->Format.nSamplesPerSec, m_pWfExt->Format.nChannels)))
+        {
+            ExFreePoolWithTag(m_pA2dpSbc, MINWAVERTSTREAM_POOLTAG);
+            m_pA2dpSbc = NULL;
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        ntStatus = m_pMiniport->GetSidebandDevice()->StartPacketTransport(eA2dpHpSpeakerDevice, m_pA2dpSbc);
+        if (!NT_SUCCESS(ntStatus))
+        {
+            ExFreePoolWithTag(m_pA2dpSbc, MINWAVERTSTREAM_POOLTAG);
+            m_pA2dpSbc = NULL;
+            return ntStatus;
+        }
+
+        DPF(D_TERSE, ("A2DP SBC encoder: bitpool %u..%u, %u byte frames", m_pA2dpSbc->MinBitpool, m_pA2dpSbc->MaxBitpool, m_pA2dpSbc->FrameBytes));
     }
+#endif  // SYSVAD_A2DP_SIDEBAND
 
     //
     // Allocate stream audio module resources.
@@ -344,6 +426,12 @@ Return Value:
         return ntStatus;
     }
 
+    ntStatus = AudioModule_InitIndex(&m_AudioModuleIndex, m_pAudioModules, m_AudioModuleCount);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        return ntStatus;
+    }
+
     if (m_bCapture)
     {
         ReadRegistrySettings();
@@ -1194,6 +1282,19 @@ NTSTATUS CMiniportWaveRTStream::SetState
                                 m_ulCurrentWritePosition, // replace with the previous WaveRtBufferWritePosition that the driver received
                                 State_, // replace with the correct "Data length completed"
                                 0); // always zero
+
+    //
+    // Deliver the audio module changes held back by the notification
+    // interval, so that clients see them before the state change.
+    //
+    if (State_ != m_KsState)
+    {
+        for (ULONG i = 0; i < m_AudioModuleCount; ++i)
+        {
+            AudioModule_FlushNotifications(m_pAudioModules[i].Notifier);
+        }
+    }
+
     switch (State_)
     {
         case KSSTATE_STOP:
@@ -1497,6 +1598,22 @@ VOID CMiniportWaveRTStream::UpdatePosition
                                         0);
         }
 
+#ifdef SYSVAD_BTH_BYPASS
+        if (m_pHfpCodec != NULL)
+        {
+            // Encode what was rendered and send it over the SCO link.
+            SendBytes(ByteDisplacement);
+        }
+#endif  // SYSVAD_BTH_BYPASS
+
+#ifdef SYSVAD_A2DP_SIDEBAND
+        if (m_pA2dpSbc != NULL)
+        {
+            // Encode what was rendered into the packet ring the device sends from.
+            SendBytes(ByteDisplacement);
+        }
+#endif  // SYSVAD_A2DP_SIDEBAND
+
         if (!g_DoNotCreateDataFiles)
         {
             // Read from buffer and write to a file.
@@ -1544,7 +1661,17 @@ ByteDisplacement - # of bytes to process.
     while (ByteDisplacement > 0)
     {
         ULONG runWrite = min(ByteDisplacement, m_ulDmaBufferSize - bufferOffset);
+#ifdef SYSVAD_BTH_BYPASS
+        if (m_pHfpCodec != NULL)
+        {
+            // Decode the SCO packets received from the link.
+            HfpCodecReceive(m_pHfpCodec, (INT16 *)(m_pDmaBuffer + bufferOffset), runWrite / sizeof(INT16), HfpReceivePacket, this);
+        }
+        else
+#endif  // SYSVAD_BTH_BYPASS
+        {
             m_ToneGenerator.GenerateSine(m_pDmaBuffer + bufferOffset, runWrite);
+        }
         bufferOffset = (bufferOffset + runWrite) % m_ulDmaBufferSize;
         ByteDisplacement -= runWrite;
     }
@@ -1581,6 +1708,82 @@ ByteDisplacement - # of bytes to process.
     }
 }
 
+#if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_A2DP_SIDEBAND)
+//=============================================================================
+#pragma code_seg()
+VOID CMiniportWaveRTStream::SendBytes
+(
+    _In_ ULONG ByteDisplacement
+)
+/*++
+
+Routine Description:
+
+This function encodes the audio buffer for the Bluetooth link: into SCO
+packets sent over the HFP link, or into the A2DP packet ring the device's
+transport drains.
+
+Arguments:
+
+ByteDisplacement - # of bytes to process.
+
+--*/
+{
+    ULONG bufferOffset = m_ullLinearPosition % m_ulDmaBufferSize;
+
+    while (ByteDisplacement > 0)
+    {
+        ULONG runWrite = min(ByteDisplacement, m_ulDmaBufferSize - bufferOffset);
+#ifdef SYSVAD_BTH_BYPASS
+        if (m_pHfpCodec != NULL)
+        {
+            HfpCodecTransmit(m_pHfpCodec, (INT16 *)(m_pDmaBuffer + bufferOffset), runWrite / sizeof(INT16), HfpSendPacket, this);
+        }
+#endif  // SYSVAD_BTH_BYPASS
+#ifdef SYSVAD_A2DP_SIDEBAND
+        if (m_pA2dpSbc != NULL)
+        {
+            A2dpSbcProcess(m_pA2dpSbc, m_pDmaBuffer + bufferOffset, runWrite);
+        }
+#endif  // SYSVAD_A2DP_SIDEBAND
+        bufferOffset = (bufferOffset + runWrite) % m_ulDmaBufferSize;
+        ByteDisplacement -= runWrite;
+    }
+}
+#endif  // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_A2DP_SIDEBAND)
+
+#ifdef SYSVAD_BTH_BYPASS
+
+//=============================================================================
+#pragma code_seg()
+VOID CMiniportWaveRTStream::HfpSendPacket
+(
+    _In_                            PVOID   Context,
+    _In_reads_(HFP_PACKET_BYTES)    const BYTE *Packet
+)
+{
+    CMiniportWaveRTStream * This = (CMiniportWaveRTStream *)Context;
+
+    This->m_pMiniport->GetSidebandDevice()->SendPacket(eBthHfpSpeakerDevice, Packet, HFP_PACKET_BYTES);
+}
+
+//=============================================================================
+#pragma code_seg()
+BOOLEAN CMiniportWaveRTStream::HfpReceivePacket
+(
+    _In_                            PVOID   Context,
+    _Out_writes_(HFP_PACKET_BYTES)  BYTE    *Packet
+)
+{
+    CMiniportWaveRTStream * This = (CMiniportWaveRTStream *)Context;
+    NTSTATUS                ntStatus;
+
+    ntStatus = This->m_pMiniport->GetSidebandDevice()->ReceivePacket(eBthHfpMicDevice, Packet, HFP_PACKET_BYTES);
+
+    return NT_SUCCESS(ntStatus) ? TRUE : FALSE;
+}
+#endif  // SYSVAD_BTH_BYPASS
+
 //=============================================================================
 #pragma code_seg("PAGE")
 STDMETHODIMP_(NTSTATUS) 
@@ -1749,7 +1952,8 @@ CMiniportWaveRTStream::PropertyHandlerModuleCommand
     return AudioModule_GenericHandler_ModuleCommand(
                 PropertyRequest,
                 GetAudioModuleList(),
-                GetAudioModuleListCount());
+                GetAudioModuleListCount(),
+                &m_AudioModuleIndex);
 } // PropertyHandlerModuleCommand
 
 //=============================================================================
@@ -17,6 +17,8 @@ Abstract:
 
 #include "savedata.h"
 #include "tonegenerator.h"
+#include "HfpCodec.h"
+#include "A2dpSbcEncoder.h"
 
 
 //
@@ -118,6 +120,8 @@ protected:
     PLONG                       m_plVolumeLevel;
     PLONG                       m_plPeakMeter;
     PWAVEFORMATEXTENSIBLE       m_pWfExt;
+    PVOID                       m_pStreamBlock;         // holds m_pDpc, m_pWfExt and the channel arrays
+    ULONG                       m_ulStreamBlockSize;
     ULONG                       m_ulContentId;
     CSaveData                   m_SaveData;
     ToneGenerator               m_ToneGenerator;
@@ -127,6 +131,7 @@ protected:
     KSPIN_LOCK                  m_PositionSpinLock;
     AUDIOMODULE *               m_pAudioModules;
     ULONG                       m_AudioModuleCount;
+    AUDIOMODULE_INDEX           m_AudioModuleIndex;
     // Member variable as config params for tone generator
     ULONG                       m_ulHostCaptureToneFrequency;
     ULONG                       m_ulLoopbackCaptureToneFrequency;
@@ -145,6 +150,14 @@ protected:
     BOOL                        m_SidebandStarted;
 #endif  // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND)
 
+#ifdef SYSVAD_BTH_BYPASS
+    HFP_CODEC_STAGE *           m_pHfpCodec;    // HFP streams without SCO bypass
+#endif  // SYSVAD_BTH_BYPASS
+
+#ifdef SYSVAD_A2DP_SIDEBAND
+    A2DP_SBC_STAGE *            m_pA2dpSbc;     // A2DP speaker without sideband encoding
+#endif  // SYSVAD_A2DP_SIDEBAND
+
 public:
     
     NTSTATUS GetVolumeChannelCount
@@ -291,6 +304,29 @@ private:
         _In_ ULONG ByteDisplacement
     );
     
+#if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_A2DP_SIDEBAND)
+    VOID SendBytes
+    (
+        _In_ ULONG ByteDisplacement
+    );
+#endif  // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_A2DP_SIDEBAND)
+
+#ifdef SYSVAD_BTH_BYPASS
+    static
+    VOID HfpSendPacket
+    (
+        _In_                            PVOID   Context,
+        _In_reads_(HFP_PACKET_BYTES)    const BYTE *Packet
+    );
+
+    static
+    BOOLEAN HfpReceivePacket
+    (
+        _In_                            PVOID   Context,
+        _Out_writes_(HFP_PACKET_BYTES)  BYTE    *Packet
+    );
+#endif  // SYSVAD_BTH_BYPASS
+
     VOID UpdatePosition
     (
         _In_ LARGE_INTEGER ilQPC
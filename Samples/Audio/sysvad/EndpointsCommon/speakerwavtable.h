@@ -16,6 +16,7 @@ Abstract:
 #define _SYSVAD_SPEAKERWAVTABLE_H_
 
 #include "SysVadShared.h"
+#include "WaveFormatTable.h"
 #include "AudioModule0.h"
 #include "AudioModule1.h"
 
@@ -55,346 +56,68 @@ Abstract:
 #define SPEAKER_MAX_OUTPUT_LOOPBACK_STREAMS         2       // Pre + Post Volume Tap
 
 //=============================================================================
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerAudioEngineSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_LAYOUT SpeakerStereoLayout[] =
 {
-    { // 0 : First entry in this table is the default format for the audio engine
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                24000,
-                96000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 4
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    }
+    { 2, KSAUDIO_SPEAKER_STEREO }
 };
 
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerHostPinSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_DEPTH SpeakerPcm16Depth[] =
 {
-    { // 0
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                24000,
-                96000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                32000,
-                128000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 4
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 5
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    }
+    { 16, 16 }
 };
 
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpeakerOffloadPinSupportedDeviceFormats[] =
+static constexpr
+DWORD SpeakerAudioEngineRates[] =
 {
-    { // 0
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    }
+    44100,      // First entry in this table is the default format for the audio engine
+    24000,
+    48000,
+    88200,
+    96000
+};
+
+static constexpr
+DWORD SpeakerHostPinRates[] =
+{
+    24000,
+    32000,
+    44100,
+    48000,
+    88200,
+    96000
+};
+
+static constexpr
+DWORD SpeakerOffloadPinRates[] =
+{
+    44100,
+    48000
 };
 
+static constexpr
+WAVEFORMAT_GROUP SpeakerAudioEngineFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(SpeakerStereoLayout), WAVEFORMAT_LIST(SpeakerPcm16Depth), WAVEFORMAT_LIST(SpeakerAudioEngineRates) }
+};
+
+static constexpr
+WAVEFORMAT_GROUP SpeakerHostPinFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(SpeakerStereoLayout), WAVEFORMAT_LIST(SpeakerPcm16Depth), WAVEFORMAT_LIST(SpeakerHostPinRates) }
+};
+
+static constexpr
+WAVEFORMAT_GROUP SpeakerOffloadPinFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(SpeakerStereoLayout), WAVEFORMAT_LIST(SpeakerPcm16Depth), WAVEFORMAT_LIST(SpeakerOffloadPinRates) }
+};
+
+DECLARE_WAVEFORMAT_TABLE(SpeakerAudioEngineSupportedDeviceFormats, SpeakerAudioEngineFormatGroups);
+DECLARE_WAVEFORMAT_TABLE(SpeakerHostPinSupportedDeviceFormats, SpeakerHostPinFormatGroups);
+DECLARE_WAVEFORMAT_TABLE(SpeakerOffloadPinSupportedDeviceFormats, SpeakerOffloadPinFormatGroups);
+
 //
 // Supported modes (only on streaming pins).
 //
@@ -403,27 +126,27 @@ MODE_AND_DEFAULT_FORMAT SpeakerHostPinSupportedDeviceModes[] =
 {
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_RAW,
-        &SpeakerHostPinSupportedDeviceFormats[3].DataFormat  // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 3)  // 48KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_DEFAULT,
-        &SpeakerHostPinSupportedDeviceFormats[3].DataFormat  // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 3)  // 48KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_MEDIA,
-        &SpeakerHostPinSupportedDeviceFormats[3].DataFormat  // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 3)  // 48KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_MOVIE,
-        &SpeakerHostPinSupportedDeviceFormats[3].DataFormat  // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 3)  // 48KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_COMMUNICATIONS,
-        &SpeakerHostPinSupportedDeviceFormats[0].DataFormat  // 24KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 0)  // 24KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_NOTIFICATION,
-        &SpeakerHostPinSupportedDeviceFormats[3].DataFormat  // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerHostPinSupportedDeviceFormats, 3)  // 48KHz
     }
 };
 
@@ -432,11 +155,11 @@ MODE_AND_DEFAULT_FORMAT SpeakerOffloadPinSupportedDeviceModes[] =
 {
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_DEFAULT,
-        &SpeakerOffloadPinSupportedDeviceFormats[1].DataFormat // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerOffloadPinSupportedDeviceFormats, 1) // 48KHz
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_MEDIA,
-        &SpeakerOffloadPinSupportedDeviceFormats[1].DataFormat // 48KHz
+        WAVEFORMAT_TABLE_FORMAT(SpeakerOffloadPinSupportedDeviceFormats, 1) // 48KHz
     }
 };
 
@@ -449,22 +172,22 @@ PIN_DEVICE_FORMATS_AND_MODES SpeakerPinDeviceFormatsAndModes[] =
 {
     {
         SystemRenderPin,
-        SpeakerHostPinSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpeakerHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpeakerHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpeakerHostPinSupportedDeviceFormats),
         SpeakerHostPinSupportedDeviceModes,
         SIZEOF_ARRAY(SpeakerHostPinSupportedDeviceModes)
     },
     {
         OffloadRenderPin,
-        SpeakerOffloadPinSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpeakerOffloadPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpeakerOffloadPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpeakerOffloadPinSupportedDeviceFormats),
         SpeakerOffloadPinSupportedDeviceModes,
         SIZEOF_ARRAY(SpeakerOffloadPinSupportedDeviceModes),
     },
     {
         RenderLoopbackPin,
-        SpeakerHostPinSupportedDeviceFormats,  // Must support all the formats supported by host pin
-        SIZEOF_ARRAY(SpeakerHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpeakerHostPinSupportedDeviceFormats),  // Must support all the formats supported by host pin
+        WAVEFORMAT_TABLE_COUNT(SpeakerHostPinSupportedDeviceFormats),
         NULL,   // loopback doesn't support modes.
         0
     },
@@ -477,8 +200,8 @@ PIN_DEVICE_FORMATS_AND_MODES SpeakerPinDeviceFormatsAndModes[] =
     },
     {
         NoPin,      // For convenience, offload engine device formats appended here
-        SpeakerAudioEngineSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpeakerAudioEngineSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpeakerAudioEngineSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpeakerAudioEngineSupportedDeviceFormats),
         NULL,       // no modes for this entry.
         0
     }
@@ -0,0 +1,440 @@
+//
+// A2dpSbcBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Cost of the driver's A2DP SBC encoder stage (EndpointsCommon/
+//   A2dpSbcEncoder.h) per SBC frame of 128 samples, at 44.1 and 48 kHz,
+//   mono and joint stereo, at the high quality bitpool. The run fails if a
+//   frame allocates or takes more than a tenth of its duration. Every
+//   packet the ring hands out is parsed: RTP and SBC payload headers,
+//   frame headers and frame lengths.
+//
+//   Then the transport side: the stream is fed 10 ms DMA runs and drained
+//   with A2dpSbcTransmit every 10 ms, as A2dpHpDevice's timer does, over a
+//   link whose rate drops below the stream's and comes back. The bitpool
+//   must follow the link down without the ring overflowing, and climb back
+//   to the top when the link recovers. A fixed bitpool, the encoder
+//   without the link quality input, runs next to it on the same link.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "ApoHost.h"
+
+#include "CodecHost.h"
+#include "A2dpSbcEncoder.h"
+
+#define A2DP_TICK_MS    10
+
+static bool MakeSpeech(uint32_t u32Rate, uint32_t u32Channels, uint32_t u32Seconds, std::vector<INT16> *pSamples)
+{
+    char szSpec[64];
+    APOHOST_AUDIO Audio;
+
+    snprintf(szSpec, sizeof(szSpec), "gen:speech:%u:%u:%u", u32Rate, u32Channels, u32Seconds);
+    if (!ApoHost_Generate(szSpec, &Audio))
+    {
+        return false;
+    }
+
+    pSamples->resize(Audio.Samples.size());
+    for (size_t n = 0; n < Audio.Samples.size(); n++)
+    {
+        (*pSamples)[n] = (INT16)fmax(fmin(Audio.Samples[n] * 32768.0f, 32767.0f), -32768.0f);
+    }
+
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// The receiving side of the link: parses every packet against the stage's
+// configuration and keeps the counts.
+//
+typedef struct BENCH_SINK
+{
+    const A2DP_SBC_STAGE *  pStage;
+    uint32_t                u32Rate;        // link rate in kbps, 0 for no limit
+    uint32_t                u32Credit;      // bytes the link can take, carried between ticks
+    bool                    fStarted;
+    USHORT                  usSequence;
+    ULONG                   ulTimestamp;
+    uint64_t                u64Packets;
+    uint64_t                u64Bytes;
+    uint64_t                u64Frames;
+    uint64_t                u64BitpoolSum;  // over frames
+    ULONG                   ulLastBitpool;
+    uint32_t                u32Errors;
+} BENCH_SINK;
+
+static void SinkError(BENCH_SINK *pSink, const char *pszWhat)
+{
+    if (pSink->u32Errors++ == 0)
+    {
+        fprintf(stderr, "FAIL: packet %llu: %s\n", (unsigned long long)pSink->u64Packets, pszWhat);
+    }
+}
+
+static BOOLEAN BenchSend(PVOID Context, const BYTE *Packet, ULONG Length)
+{
+    BENCH_SINK *pSink = (BENCH_SINK *)Context;
+    const SBC_ENCODER *pConfig = &pSink->pStage->Encoder;
+
+    if (Length > A2DP_SBC_PACKET_BYTES || Length < A2DP_SBC_RTP_HEADER_BYTES + A2DP_SBC_PAYLOAD_HEADER_BYTES)
+    {
+        SinkError(pSink, "bad length");
+        return TRUE;
+    }
+
+    USHORT usSequence = (USHORT)((Packet[2] << 8) | Packet[3]);
+    ULONG ulTimestamp = ((ULONG)Packet[4] << 24) | ((ULONG)Packet[5] << 16) | ((ULONG)Packet[6] << 8) | Packet[7];
+    ULONG cFrames = Packet[A2DP_SBC_RTP_HEADER_BYTES] & 0x0F;
+
+    if (Packet[0] != 0x80 || Packet[1] != A2DP_SBC_RTP_PAYLOAD_TYPE)
+    {
+        SinkError(pSink, "bad RTP header");
+    }
+
+    // Frames the ring had no room for leave a gap in the timestamps only.
+    if (pSink->fStarted &&
+        (usSequence != pSink->usSequence || (LONG)(ulTimestamp - pSink->ulTimestamp) < 0))
+    {
+        SinkError(pSink, "RTP sequence or timestamp out of order");
+    }
+
+    if (cFrames == 0 || (Packet[A2DP_SBC_RTP_HEADER_BYTES] & 0xF0) != 0)
+    {
+        SinkError(pSink, "bad SBC payload header");
+    }
+
+    //
+    // Frame headers: 44.1 or 48 kHz, 16 blocks, the stage's channel mode,
+    // loudness, 8 subbands; each frame as long as its bitpool says.
+    //
+    BYTE bConfig = (BYTE)((pConfig->Frequency << 6) | (3 << 4) | (pConfig->ChannelMode << 2) | (pConfig->Allocation << 1) | 1);
+    ULONG offset = A2DP_SBC_RTP_HEADER_BYTES + A2DP_SBC_PAYLOAD_HEADER_BYTES;
+
+    for (ULONG f = 0; f < cFrames && offset + SBC_HEADER_BYTES <= Length; f++)
+    {
+        SBC_ENCODER Frame = *pConfig;
+
+        Frame.Bitpool = Packet[offset + 2];
+        if (Packet[offset] != SBC_SYNCWORD || Packet[offset + 1] != bConfig)
+        {
+            SinkError(pSink, "bad SBC frame header");
+        }
+
+        if (Frame.Bitpool < pSink->pStage->MinBitpool || Frame.Bitpool > pSink->pStage->MaxBitpool)
+        {
+            SinkError(pSink, "bitpool out of range");
+        }
+
+        pSink->u64BitpoolSum += Frame.Bitpool;
+        pSink->ulLastBitpool = Frame.Bitpool;
+        offset += SbcFrameLength(&Frame);
+    }
+
+    if (offset != Length)
+    {
+        SinkError(pSink, "frames do not fill the packet");
+    }
+
+    pSink->fStarted = true;
+    pSink->usSequence = usSequence + 1;
+    pSink->ulTimestamp = ulTimestamp + cFrames * pSink->pStage->FrameSamples;
+    pSink->u64Packets++;
+    pSink->u64Bytes += Length;
+    pSink->u64Frames += cFrames;
+
+    return TRUE;
+}
+
+static void SinkInit(BENCH_SINK *pSink, const A2DP_SBC_STAGE *pStage)
+{
+    memset(pSink, 0, sizeof(*pSink));
+    pSink->pStage = pStage;
+}
+
+//-------------------------------------------------------------------------
+// One 10 ms run of A2dpHpDevice's transport timer: the credit the link's
+// rate earned, at most two packets of it kept from earlier runs.
+//
+static ULONG TransportTick(A2DP_SBC_STAGE *pStage, BENCH_SINK *pSink)
+{
+    ULONG ulCredit = UINT32_MAX;
+    ULONG ulSent;
+
+    if (pSink->u32Rate != 0)
+    {
+        ulCredit = min(pSink->u32Credit + pSink->u32Rate * A2DP_TICK_MS / 8, 2 * A2DP_SBC_PACKET_BYTES);
+    }
+
+    ulSent = A2dpSbcTransmit(pStage, ulCredit, BenchSend, pSink);
+
+    pSink->u32Credit = (pSink->u32Rate != 0) ? ulCredit - ulSent : 0;
+
+    return ulSent;
+}
+
+static bool RunFrames(uint32_t u32Rate, uint32_t u32Channels, const std::vector<INT16> &Samples)
+{
+    A2DP_SBC_STAGE Stage;
+    BENCH_SINK Sink;
+    std::vector<uint64_t> Cycles;
+    uint64_t u64Nanoseconds = 0;
+
+    A2dpSbcInit(&Stage, u32Rate, u32Channels, 2, A2dpSbcHighQualityBitpool(u32Rate, u32Channels));
+    SinkInit(&Sink, &Stage);
+
+    ULONG ulFrameBytes = Stage.FrameSamples * u32Channels * sizeof(INT16);
+    size_t cFrames = Samples.size() / (Stage.FrameSamples * u32Channels);
+    const BYTE *pbPcm = (const BYTE *)Samples.data();
+
+    Cycles.reserve(cFrames);
+
+    uint64_t u64Allocations = ApoHost_AllocationCount();
+
+    for (size_t f = 0; f < cFrames; f++)
+    {
+        uint64_t u64Start = ApoHost_ReadNanoseconds();
+        uint64_t u64StartCycles = ApoHost_ReadCycles();
+
+        A2dpSbcProcess(&Stage, pbPcm + f * ulFrameBytes, ulFrameBytes);
+
+        Cycles.push_back(ApoHost_ReadCycles() - u64StartCycles);
+        u64Nanoseconds += ApoHost_ReadNanoseconds() - u64Start;
+
+        TransportTick(&Stage, &Sink);
+    }
+
+    u64Allocations = ApoHost_AllocationCount() - u64Allocations;
+
+    APOHOST_STATS Stats;
+    ApoHost_Summarize(Cycles, &Stats);
+
+    double dFrameNs = Stage.FrameSamples * 1e9 / u32Rate;
+    double dNsPerFrame = (double)u64Nanoseconds / cFrames;
+    printf("%-5u %-7s %7u %10llu %10llu %10.0f %10.0f %9.3f%% %8.0fx %7llu\n",
+           u32Rate, u32Channels == 1 ? "mono" : "joint", Stage.MaxBitpool,
+           (unsigned long long)Stats.u64Median, (unsigned long long)Stats.u64P99, Stats.dMean,
+           dNsPerFrame, dNsPerFrame * 100 / dFrameNs, dFrameNs / dNsPerFrame,
+           (unsigned long long)u64Allocations);
+
+    bool fPassed = Sink.u32Errors == 0;
+    if (u64Allocations != 0)
+    {
+        fprintf(stderr, "FAIL: %u Hz %u ch: the encoder allocated\n", u32Rate, u32Channels);
+        fPassed = false;
+    }
+
+    if (dNsPerFrame * 10 > dFrameNs)
+    {
+        fprintf(stderr, "FAIL: %u Hz %u ch: %.0f ns per %.0f ns frame\n", u32Rate, u32Channels, dNsPerFrame, dFrameNs);
+        fPassed = false;
+    }
+
+    // all but the frames of the packet still being filled
+    ULONG cFilling = Stage.Filling ? Stage.Filling->Data[A2DP_SBC_RTP_HEADER_BYTES] : 0;
+    if (Sink.u64Frames + cFilling != cFrames || Stage.DroppedFrames != 0)
+    {
+        fprintf(stderr, "FAIL: %u Hz %u ch: %llu of %zu frames sent\n",
+                u32Rate, u32Channels, (unsigned long long)Sink.u64Frames, cFrames);
+        fPassed = false;
+    }
+
+    return fPassed;
+}
+
+//-------------------------------------------------------------------------
+// The stream over a link that is fast enough, then too slow for the top
+// bitpool, then fast enough again.
+//
+typedef struct BENCH_PHASE
+{
+    const char *    pszName;
+    uint32_t        u32Rate;        // kbps
+} BENCH_PHASE;
+
+static const BENCH_PHASE g_aPhases[] =
+{
+    { "clear",      1000 },
+    { "congested",  200 },
+    { "recovered",  1000 },
+};
+
+#define BENCH_PHASES    (sizeof(g_aPhases) / sizeof(g_aPhases[0]))
+
+typedef struct PHASE_RESULT
+{
+    uint64_t    u64Frames;
+    uint64_t    u64Bytes;
+    double      dMeanBitpool;
+    ULONG       ulLastBitpool;
+    ULONG       ulDropped;
+    ULONG       ulMaxWaiting;   // packets
+} PHASE_RESULT;
+
+static bool RunLink(
+    uint32_t u32Rate,
+    uint32_t u32Channels,
+    const std::vector<INT16> &Samples,
+    bool fAdaptive,
+    PHASE_RESULT aResults[BENCH_PHASES])
+{
+    A2DP_SBC_STAGE Stage;
+    BENCH_SINK Sink;
+
+    A2dpSbcInit(&Stage, u32Rate, u32Channels, 2, A2dpSbcHighQualityBitpool(u32Rate, u32Channels));
+    SinkInit(&Sink, &Stage);
+
+    ULONG ulRunBytes = u32Rate * A2DP_TICK_MS / 1000 * u32Channels * sizeof(INT16);
+    size_t cRuns = Samples.size() * sizeof(INT16) / ulRunBytes;
+    size_t cPhaseRuns = cRuns / BENCH_PHASES;
+    const BYTE *pbPcm = (const BYTE *)Samples.data();
+
+    for (size_t p = 0; p < BENCH_PHASES; p++)
+    {
+        PHASE_RESULT *pResult = &aResults[p];
+        uint64_t u64Frames = Sink.u64Frames;
+        uint64_t u64Bytes = Sink.u64Bytes;
+        uint64_t u64BitpoolSum = Sink.u64BitpoolSum;
+        ULONG ulDropped = Stage.DroppedFrames;
+
+        memset(pResult, 0, sizeof(*pResult));
+        Sink.u32Rate = g_aPhases[p].u32Rate;
+
+        for (size_t r = p * cPhaseRuns; r < (p + 1) * cPhaseRuns; r++)
+        {
+            A2dpSbcProcess(&Stage, pbPcm + r * ulRunBytes, ulRunBytes);
+            TransportTick(&Stage, &Sink);
+
+            // the encoder without the link quality input
+            if (!fAdaptive)
+            {
+                A2dpSbcSetLinkQuality(&Stage, 100);
+            }
+
+            pResult->ulMaxWaiting = max(pResult->ulMaxWaiting, (ULONG)(Stage.Ring.Head - Stage.Ring.Tail));
+        }
+
+        pResult->u64Frames = Sink.u64Frames - u64Frames;
+        pResult->u64Bytes = Sink.u64Bytes - u64Bytes;
+        pResult->dMeanBitpool = pResult->u64Frames ? (double)(Sink.u64BitpoolSum - u64BitpoolSum) / pResult->u64Frames : 0;
+        pResult->ulLastBitpool = Sink.ulLastBitpool;
+        pResult->ulDropped = Stage.DroppedFrames - ulDropped;
+
+        double dSeconds = cPhaseRuns * A2DP_TICK_MS / 1000.0;
+        printf("%-5u %-7s %-8s %-10s %6u %8.0f %9.1f %6u %8u %8u\n",
+               u32Rate, u32Channels == 1 ? "mono" : "joint", fAdaptive ? "adaptive" : "fixed",
+               g_aPhases[p].pszName, g_aPhases[p].u32Rate, pResult->u64Bytes * 8 / 1000.0 / dSeconds,
+               pResult->dMeanBitpool, pResult->ulLastBitpool, pResult->ulDropped, pResult->ulMaxWaiting);
+    }
+
+    return Sink.u32Errors == 0;
+}
+
+static bool RunLinkSteps(uint32_t u32Rate, uint32_t u32Channels, const std::vector<INT16> &Samples)
+{
+    PHASE_RESULT aAdaptive[BENCH_PHASES];
+    PHASE_RESULT aFixed[BENCH_PHASES];
+    ULONG ulMaxBitpool = A2dpSbcHighQualityBitpool(u32Rate, u32Channels);
+    bool fPassed = true;
+
+    fPassed = RunLink(u32Rate, u32Channels, Samples, true, aAdaptive) && fPassed;
+    fPassed = RunLink(u32Rate, u32Channels, Samples, false, aFixed) && fPassed;
+
+    // the link must in fact be too slow for the top bitpool
+    if (aFixed[1].ulDropped == 0)
+    {
+        fprintf(stderr, "FAIL: %u Hz: the congested link does not constrain a fixed bitpool\n", u32Rate);
+        fPassed = false;
+    }
+
+    if (aAdaptive[0].ulDropped != 0 || aAdaptive[0].ulLastBitpool != ulMaxBitpool)
+    {
+        fprintf(stderr, "FAIL: %u Hz: the clear link does not hold the top bitpool\n", u32Rate);
+        fPassed = false;
+    }
+
+    if (aAdaptive[1].ulLastBitpool >= ulMaxBitpool || aAdaptive[1].ulMaxWaiting >= A2DP_SBC_RING_PACKETS)
+    {
+        fprintf(stderr, "FAIL: %u Hz: the bitpool does not drop on the congested link (ends at %u, ring %u full)\n",
+                u32Rate, aAdaptive[1].ulLastBitpool, aAdaptive[1].ulMaxWaiting);
+        fPassed = false;
+    }
+
+    if (aAdaptive[1].ulDropped * 10 > aFixed[1].ulDropped)
+    {
+        fprintf(stderr, "FAIL: %u Hz: %u frames dropped adapting, %u with a fixed bitpool\n",
+                u32Rate, aAdaptive[1].ulDropped, aFixed[1].ulDropped);
+        fPassed = false;
+    }
+
+    if (aAdaptive[2].ulDropped != 0 || aAdaptive[2].ulLastBitpool != ulMaxBitpool)
+    {
+        fprintf(stderr, "FAIL: %u Hz: the bitpool does not recover (ends at %u of %u)\n",
+                u32Rate, aAdaptive[2].ulLastBitpool, ulMaxBitpool);
+        fPassed = false;
+    }
+
+    return fPassed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Seconds = 30;
+    if (argc > 2 && strcmp(argv[1], "--seconds") == 0)
+    {
+        u32Seconds = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    const uint32_t au32Rates[] = { 44100, 48000 };
+    std::vector<INT16> Speech[2][2];
+    int iResult = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (uint32_t c = 1; c <= 2; c++)
+        {
+            if (!MakeSpeech(au32Rates[i], c, u32Seconds, &Speech[i][c - 1]))
+            {
+                fprintf(stderr, "FAIL: cannot generate %u Hz speech\n", au32Rates[i]);
+                return 1;
+            }
+        }
+    }
+
+    printf("A2DP SBC encoder stage, %u s of speech, 128 sample frames; %s per frame\n\n", u32Seconds, ApoHost_CycleUnit());
+    printf("%-5s %-7s %7s %10s %10s %10s %10s %10s %9s %7s\n",
+           "rate", "mode", "bitpool", "median", "p99", "mean", "ns/frame", "of frame", "realtime", "allocs");
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (uint32_t c = 1; c <= 2; c++)
+        {
+            if (!RunFrames(au32Rates[i], c, Speech[i][c - 1]))
+            {
+                iResult = 1;
+            }
+        }
+    }
+
+    printf("\nstream over a rate limited link, 10 ms DMA runs and transport ticks\n\n");
+    printf("%-5s %-7s %-8s %-10s %6s %8s %9s %6s %8s %8s\n",
+           "rate", "mode", "bitpool", "link", "kbps", "sent", "mean", "last", "dropped", "waiting");
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!RunLinkSteps(au32Rates[i], 2, Speech[i][1]))
+        {
+            iResult = 1;
+        }
+    }
+
+    return iResult;
+}
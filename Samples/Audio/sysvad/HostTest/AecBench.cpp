@@ -0,0 +1,219 @@
+//
+// AecBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   AEC APO cost per 10 ms period at each supported rate, and how well it
+//   cancels a synthetic echo path.
+//
+//   The far end is the speech signal of ApoHost_Generate on a stereo
+//   loopback. The microphone hears its downmix through a fixed room
+//   response (direct delay plus an exponentially decaying random tail,
+//   well inside AEC_DEFAULT_TAIL_MS) and a low noise floor. Mic and
+//   loopback carry the same timestamps, as they would with the reference
+//   already aligned by the engine.
+//
+//   Two seconds in the middle of the run add a near-end talker. Reported:
+//
+//   ERLE      echo return loss enhancement on far-end-only audio, after
+//             the canceller has converged and before the double talk
+//   after DT  the same once the double talk is over, which shows whether
+//             the filter diverged during it
+//   near-end  output to near-end energy during the double talk; the
+//             canceller must pass the near-end talker
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "ApoHost.h"
+
+// a run fails below these
+#define AECBENCH_MIN_ERLE_DB        20.0
+#define AECBENCH_MIN_NEAR_END_DB    -6.0
+
+// the first seconds are the canceller converging, and it gets one second
+// to recover from the double talk
+#define AECBENCH_CONVERGE_SECONDS   3
+#define AECBENCH_DOUBLE_TALK_SECONDS 2
+#define AECBENCH_RECOVER_SECONDS    1
+
+static void MakeEchoPath(uint32_t u32FramesPerSecond, std::vector<float> *pPath)
+{
+    uint32_t u32Direct = u32FramesPerSecond * 4 / 1000;     // 4 ms
+    uint32_t u32Tail = u32FramesPerSecond * 40 / 1000;      // 40 ms
+    uint32_t u32Seed = 0x5eed;
+
+    pPath->assign(u32Direct + u32Tail, 0.0f);
+    (*pPath)[u32Direct] = 0.5f;
+    for (uint32_t n = 1; n < u32Tail; n++)
+    {
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        float f32Random = (float)(int16_t)(u32Seed >> 16) / 32768.0f;
+        (*pPath)[u32Direct + n] = 0.2f * f32Random * expf(-6.0f * n / u32Tail);
+    }
+}
+
+//
+// ERLE over the far-end active frames in [u32First, u32End).
+//
+static double MeasureErle(const APOHOST_AUDIO *pReference, const APOHOST_AUDIO *pMic, const APOHOST_AUDIO *pOutput,
+                          uint32_t u32First, uint32_t u32End)
+{
+    double dMicEnergy = 0, dOutEnergy = 0;
+    for (uint32_t n = u32First; n < u32End; n++)
+    {
+        if (pReference->Samples[(size_t)n * pReference->u32SamplesPerFrame] != 0.0f)
+        {
+            dMicEnergy += (double)pMic->Samples[n] * pMic->Samples[n];
+            dOutEnergy += (double)pOutput->Samples[n] * pOutput->Samples[n];
+        }
+    }
+    return 10 * log10(dMicEnergy / (dOutEnergy + 1e-20));
+}
+
+static bool RunRate(uint32_t u32FramesPerSecond, uint32_t u32Seconds, bool fVerbose)
+{
+    char szSpec[64];
+    APOHOST_AUDIO Reference, Mic, Output;
+
+    snprintf(szSpec, sizeof(szSpec), "gen:speech:%u:2:%u", u32FramesPerSecond, u32Seconds);
+    if (!ApoHost_Generate(szSpec, &Reference))
+    {
+        return false;
+    }
+
+    // microphone: downmixed loopback through the room, plus noise at -60 dBFS
+    // and, during the double talk, a gliding tone that is not in the loopback
+    std::vector<float> Path;
+    MakeEchoPath(u32FramesPerSecond, &Path);
+
+    uint32_t u32Frames = Reference.GetFrameCount();
+    uint32_t u32DoubleTalkStart = u32Seconds / 2 * u32FramesPerSecond;
+    uint32_t u32DoubleTalkEnd = u32DoubleTalkStart + AECBENCH_DOUBLE_TALK_SECONDS * u32FramesPerSecond;
+    std::vector<float> NearEnd(u32Frames, 0.0f);
+    const double dPi = 3.14159265358979323846;
+    for (uint32_t n = u32DoubleTalkStart; n < u32DoubleTalkEnd; n++)
+    {
+        double dTime = (double)n / u32FramesPerSecond;
+        double dFrequency = 310.0 + 60.0 * sin(2 * dPi * 0.7 * dTime);
+        NearEnd[n] = (float)(0.1 * sin(2 * dPi * dFrequency * dTime) * (0.5 + 0.5 * sin(2 * dPi * 3.0 * dTime)));
+    }
+
+    uint32_t u32Seed = 0x600d;
+    Mic.u32FramesPerSecond = u32FramesPerSecond;
+    Mic.u32SamplesPerFrame = 1;
+    Mic.Samples.assign(u32Frames, 0.0f);
+
+    for (uint32_t n = 0; n < u32Frames; n++)
+    {
+        double dEcho = 0;
+        for (uint32_t k = 0; k < Path.size() && k <= n; k++)
+        {
+            const float *pf32Frame = &Reference.Samples[(size_t)(n - k) * 2];
+            dEcho += Path[k] * 0.5 * (pf32Frame[0] + pf32Frame[1]);
+        }
+        u32Seed = u32Seed * 1664525u + 1013904223u;
+        Mic.Samples[n] = (float)(dEcho + NearEnd[n] + 0.001 * (int16_t)(u32Seed >> 16) / 32768.0);
+    }
+
+    CApoHostGraph Graph;
+    if (!Graph.Create("aec") ||
+        !Graph.LockForProcess(u32FramesPerSecond, 1, u32FramesPerSecond / 100) ||
+        !Graph.Run(&Mic, &Reference, &Output))
+    {
+        return false;
+    }
+
+    double dErle = MeasureErle(&Reference, &Mic, &Output, u32FramesPerSecond * AECBENCH_CONVERGE_SECONDS, u32DoubleTalkStart);
+    double dErleAfter = MeasureErle(&Reference, &Mic, &Output, u32DoubleTalkEnd + u32FramesPerSecond * AECBENCH_RECOVER_SECONDS, u32Frames);
+
+    double dNearEnergy = 0, dOutEnergy = 0;
+    for (uint32_t n = u32DoubleTalkStart; n < u32DoubleTalkEnd; n++)
+    {
+        dNearEnergy += (double)NearEnd[n] * NearEnd[n];
+        dOutEnergy += (double)Output.Samples[n] * Output.Samples[n];
+    }
+    double dNearEnd = 10 * log10(dOutEnergy / dNearEnergy);
+
+    std::vector<uint64_t> Cycles(Graph.GetPeriodCycles());
+    APOHOST_STATS Stats;
+    ApoHost_Summarize(Cycles, &Stats);
+
+    double dNsPerPeriod = (double)Graph.GetProcessNanoseconds() / Cycles.size();
+    printf("%6u Hz %10llu %10llu %10.0f %10.0f %9.2f%% %8.1f %8.1f %8.1f %7llu\n",
+           u32FramesPerSecond,
+           (unsigned long long)Stats.u64Median, (unsigned long long)Stats.u64P99, Stats.dMean,
+           dNsPerPeriod, dNsPerPeriod / 1e5, dErle, dErleAfter, dNearEnd,
+           (unsigned long long)Graph.GetProcessAllocations());
+
+    bool fPassed = true;
+    if (dErle < AECBENCH_MIN_ERLE_DB || dErleAfter < AECBENCH_MIN_ERLE_DB)
+    {
+        fprintf(stderr, "FAIL: %u Hz: ERLE %.1f dB, %.1f dB after double talk, expected at least %.1f dB\n",
+                u32FramesPerSecond, dErle, dErleAfter, AECBENCH_MIN_ERLE_DB);
+        fPassed = false;
+    }
+    if (dNearEnd < AECBENCH_MIN_NEAR_END_DB)
+    {
+        fprintf(stderr, "FAIL: %u Hz: near-end talker at %.1f dB, expected at least %.1f dB\n",
+                u32FramesPerSecond, dNearEnd, AECBENCH_MIN_NEAR_END_DB);
+        fPassed = false;
+    }
+    if (Graph.GetProcessAllocations() != 0)
+    {
+        fprintf(stderr, "FAIL: %u Hz: APOProcess allocated\n", u32FramesPerSecond);
+        fPassed = false;
+    }
+
+    if (fVerbose)
+    {
+        Graph.PrintReport(&Mic);
+    }
+    return fPassed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Seconds = 20;
+    bool fVerbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            u32Seconds = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            fVerbose = true;
+        }
+    }
+
+    // converge, far end only, double talk, recover, far end only
+    if (u32Seconds / 2 <= AECBENCH_CONVERGE_SECONDS ||
+        u32Seconds - u32Seconds / 2 <= AECBENCH_DOUBLE_TALK_SECONDS + AECBENCH_RECOVER_SECONDS)
+    {
+        fprintf(stderr, "--seconds must be at least %u\n", 2 * (AECBENCH_CONVERGE_SECONDS + 1));
+        return 2;
+    }
+
+    printf("aec, %u s of far-end speech, 10 ms periods; %s per period\n\n", u32Seconds, ApoHost_CycleUnit());
+    printf("%9s %10s %10s %10s %10s %10s %8s %8s %8s %7s\n",
+           "rate", "median", "p99", "mean", "ns/period", "of period", "ERLE dB", "after DT", "near-end", "allocs");
+
+    int iResult = 0;
+    const uint32_t au32Rates[] = { 16000, 32000, 48000 };
+    for (uint32_t u32Rate : au32Rates)
+    {
+        if (!RunRate(u32Rate, u32Seconds, fVerbose))
+        {
+            iResult = 1;
+        }
+    }
+    return iResult;
+}
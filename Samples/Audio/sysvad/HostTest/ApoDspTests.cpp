@@ -0,0 +1,336 @@
+//
+// ApoDspTests.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Checks the ApoDsp.h kernels against plain reference loops, bit for bit.
+//   Built twice: once with the SSE2/NEON paths of the host and once with
+//   APODSP_NO_SIMD, so both the vector and the portable code are covered.
+//
+//   Buffers are placed so that they end on an inaccessible page; a kernel
+//   that reads or writes past the end of its buffer faults.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#include <ApoDsp.h>
+
+static unsigned g_cChecks;
+static unsigned g_cFailures;
+
+#define CHECK(expr, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        g_cChecks++;                                                        \
+        if (!(expr))                                                        \
+        {                                                                   \
+            if (g_cFailures++ < 20)                                         \
+            {                                                               \
+                fprintf(stderr, "%s:%d: %s: ", __FILE__, __LINE__, #expr);  \
+                fprintf(stderr, __VA_ARGS__);                               \
+                fprintf(stderr, "\n");                                      \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  cFloats floats that end right before a PROT_NONE page.
+//
+class CGuardedBuffer
+{
+public:
+    explicit CGuardedBuffer(size_t cFloats)
+    {
+        m_cbPage = (size_t)sysconf(_SC_PAGESIZE);
+        m_cbMapping = ((cFloats * sizeof(float) + m_cbPage - 1) / m_cbPage + 1) * m_cbPage;
+        m_pbMapping = (unsigned char *)mmap(NULL, m_cbMapping, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_pbMapping == MAP_FAILED)
+        {
+            perror("mmap");
+            abort();
+        }
+        mprotect(m_pbMapping + m_cbMapping - m_cbPage, m_cbPage, PROT_NONE);
+        m_pf32 = (float *)(m_pbMapping + m_cbMapping - m_cbPage) - cFloats;
+    }
+
+    ~CGuardedBuffer()
+    {
+        munmap(m_pbMapping, m_cbMapping);
+    }
+
+    float *Get() { return m_pf32; }
+
+private:
+    unsigned char  *m_pbMapping;
+    size_t          m_cbMapping;
+    size_t          m_cbPage;
+    float          *m_pf32;
+};
+
+static uint32_t g_u32Seed = 1;
+
+static uint32_t Random()
+{
+    g_u32Seed = g_u32Seed * 1664525u + 1013904223u;
+    return g_u32Seed >> 8;
+}
+
+static float RandomSample()
+{
+    return (float)((int32_t)(Random() & 0xffff) - 32768) / 32768.0f;
+}
+
+static bool SameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+//-------------------------------------------------------------------------
+// ApoDsp_ExtractPrimaryChannels and the gather kernels behind it, for every
+// layout up to eight channels and frame counts on both sides of the vector
+// loop boundaries.
+//
+static void TestExtractPrimaryChannels()
+{
+    for (uint32_t u32Total = 1; u32Total <= 8; u32Total++)
+    {
+        for (uint32_t u32Primary = 1; u32Primary <= u32Total; u32Primary++)
+        {
+            for (uint32_t u32Start = 0; u32Start + u32Primary <= u32Total; u32Start++)
+            {
+                if (u32Primary == u32Total && u32Start != 0)
+                {
+                    continue;
+                }
+
+                for (uint32_t u32Frames = 0; u32Frames <= 37; u32Frames++)
+                {
+                    CGuardedBuffer Input((size_t)u32Frames * u32Total);
+                    CGuardedBuffer Output((size_t)u32Frames * u32Primary);
+
+                    for (size_t i = 0; i < (size_t)u32Frames * u32Total; i++)
+                    {
+                        Input.Get()[i] = RandomSample();
+                    }
+
+                    ApoDsp_ExtractPrimaryChannels(Output.Get(), Input.Get(), u32Frames, u32Start, u32Primary, u32Total);
+
+                    for (uint32_t n = 0; n < u32Frames; n++)
+                    {
+                        for (uint32_t c = 0; c < u32Primary; c++)
+                        {
+                            CHECK(SameBits(Output.Get()[n * u32Primary + c], Input.Get()[n * u32Total + u32Start + c]),
+                                  "total %u primary %u start %u frames %u: frame %u channel %u",
+                                  u32Total, u32Primary, u32Start, u32Frames, n, c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // primary only, in place: nothing moves
+    CGuardedBuffer Frames(64);
+    for (int i = 0; i < 64; i++)
+    {
+        Frames.Get()[i] = (float)i;
+    }
+    ApoDsp_ExtractPrimaryChannels(Frames.Get(), Frames.Get(), 16, 0, 4, 4);
+    for (int i = 0; i < 64; i++)
+    {
+        CHECK(Frames.Get()[i] == (float)i, "in place sample %d", i);
+    }
+}
+
+//-------------------------------------------------------------------------
+// ApoDsp_Swap and ApoDsp_SwapScale, in place and out of place. Odd channel
+// counts are the interesting case: the last channel has no partner and
+// every frame must stay aligned.
+//
+static void TestSwap()
+{
+    for (uint32_t u32Channels = 1; u32Channels <= 7; u32Channels++)
+    {
+        std::vector<float> Coefficients(u32Channels);
+        for (uint32_t c = 0; c < u32Channels; c++)
+        {
+            Coefficients[c] = 1.0f - (1.0f / u32Channels) * c;
+        }
+
+        for (uint32_t u32Frames = 0; u32Frames <= 9; u32Frames++)
+        {
+            size_t cSamples = (size_t)u32Frames * u32Channels;
+            std::vector<float> Source(cSamples);
+            for (float &f32 : Source)
+            {
+                f32 = RandomSample();
+            }
+
+            for (int iScale = 0; iScale < 2; iScale++)
+            {
+                for (int iInPlace = 0; iInPlace < 2; iInPlace++)
+                {
+                    CGuardedBuffer Input(cSamples);
+                    CGuardedBuffer Output(cSamples);
+                    memcpy(Input.Get(), Source.data(), sizeof(float) * cSamples);
+                    float *pf32Out = iInPlace ? Input.Get() : Output.Get();
+
+                    if (iScale)
+                    {
+                        ApoDsp_SwapScale(pf32Out, Input.Get(), u32Frames, u32Channels, Coefficients.data());
+                    }
+                    else
+                    {
+                        ApoDsp_Swap(pf32Out, Input.Get(), u32Frames, u32Channels);
+                    }
+
+                    for (uint32_t n = 0; n < u32Frames; n++)
+                    {
+                        for (uint32_t c = 0; c < u32Channels; c++)
+                        {
+                            // partner channel, or the channel itself when it has none
+                            uint32_t u32From = (c ^ 1) < u32Channels ? (c ^ 1) : c;
+                            float f32Expected = Source[n * u32Channels + u32From];
+                            if (iScale)
+                            {
+                                f32Expected *= Coefficients[c];
+                            }
+                            CHECK(SameBits(pf32Out[n * u32Channels + c], f32Expected),
+                                  "%s%s channels %u frames %u: frame %u channel %u is %g, expected %g",
+                                  iScale ? "SwapScale" : "Swap", iInPlace ? " in place" : "",
+                                  u32Channels, u32Frames, n, c, pf32Out[n * u32Channels + c], f32Expected);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// ApoDsp_Delay against a FIFO of frames, over random chunk sizes (shorter
+// and longer than the delay line), silent chunks and all three buffer
+// arrangements. The delay line starts out silent, as the APOs set it up.
+//
+enum DELAY_MODE
+{
+    DELAY_COPY,         // separate input and output buffers
+    DELAY_IN_PLACE,     // output buffer is the input buffer
+    DELAY_MIXED         // in place or silent at random
+};
+
+static void TestDelayOnce(uint32_t u32DelayFrames, uint32_t u32Channels, DELAY_MODE Mode)
+{
+    std::vector<float> DelayLine((size_t)u32DelayFrames * u32Channels + 1, 0.0f);
+    std::deque<float> Fifo((size_t)u32DelayFrames * u32Channels, 0.0f);
+    uint32_t u32DelayIndex = 0;
+    uint32_t u32SilentFrames = u32DelayFrames;
+    uint32_t u32SilentSince = u32DelayFrames;  // frames of silent input in a row
+
+    for (int iChunk = 0; iChunk < 200; iChunk++)
+    {
+        uint32_t u32Frames = Random() % (2 * u32DelayFrames + 50);
+        size_t cSamples = (size_t)u32Frames * u32Channels;
+        bool fSilentIn = (Random() % 3) == 0;
+        bool fInPlace = (Mode == DELAY_IN_PLACE) || (Mode == DELAY_MIXED && (Random() & 1));
+
+        CGuardedBuffer Input(cSamples);
+        CGuardedBuffer Output(cSamples);
+        std::vector<float> Expected(cSamples);
+
+        for (size_t i = 0; i < cSamples; i++)
+        {
+            Input.Get()[i] = fSilentIn ? 0.0f : RandomSample();
+            Output.Get()[i] = NAN;
+
+            Fifo.push_back(Input.Get()[i]);
+            Expected[i] = Fifo.front();
+            Fifo.pop_front();
+        }
+
+        bool fAllSilentBefore = (u32SilentSince >= u32DelayFrames);
+        float *pf32Out = fInPlace ? Input.Get() : Output.Get();
+        bool fOutputSilent = ApoDsp_Delay(pf32Out,
+                                          fSilentIn ? NULL : (fInPlace ? pf32Out : Input.Get()),
+                                          u32Frames,
+                                          u32Channels,
+                                          DelayLine.data(),
+                                          u32DelayFrames,
+                                          &u32DelayIndex,
+                                          &u32SilentFrames);
+
+        u32SilentSince = fSilentIn ? u32SilentSince + u32Frames : 0;
+
+        if (fOutputSilent)
+        {
+            for (size_t i = 0; i < cSamples; i++)
+            {
+                CHECK(Expected[i] == 0.0f, "delay %u ch %u chunk %d: reported silent, sample %zu is %g",
+                      u32DelayFrames, u32Channels, iChunk, i, Expected[i]);
+            }
+        }
+        else
+        {
+            // a silent input never reads the input buffer, in place or not
+            for (size_t i = 0; i < cSamples; i++)
+            {
+                CHECK(SameBits(pf32Out[i], Expected[i]), "delay %u ch %u chunk %d%s%s: sample %zu is %g, expected %g",
+                      u32DelayFrames, u32Channels, iChunk, fInPlace ? " in place" : "", fSilentIn ? " silent" : "",
+                      i, pf32Out[i], Expected[i]);
+            }
+        }
+
+        // a delay line full of silence must take the fast path
+        if (fSilentIn && fAllSilentBefore && u32DelayFrames != 0)
+        {
+            CHECK(fOutputSilent, "delay %u ch %u chunk %d: silent in, silent line, output not flagged silent",
+                  u32DelayFrames, u32Channels, iChunk);
+        }
+
+        CHECK(u32DelayFrames == 0 || u32DelayIndex < u32DelayFrames, "delay index %u out of range", u32DelayIndex);
+    }
+}
+
+static void TestDelay()
+{
+    const uint32_t au32DelayFrames[] = { 0, 1, 7, 160, 480 };
+
+    for (uint32_t u32DelayFrames : au32DelayFrames)
+    {
+        for (uint32_t u32Channels = 1; u32Channels <= 3; u32Channels++)
+        {
+            TestDelayOnce(u32DelayFrames, u32Channels, DELAY_COPY);
+            TestDelayOnce(u32DelayFrames, u32Channels, DELAY_IN_PLACE);
+            TestDelayOnce(u32DelayFrames, u32Channels, DELAY_MIXED);
+        }
+    }
+}
+
+int main()
+{
+#if defined(APODSP_SSE2)
+    const char *pszPath = "SSE2";
+#elif defined(APODSP_NEON)
+    const char *pszPath = "NEON";
+#else
+    const char *pszPath = "portable";
+#endif
+
+    TestExtractPrimaryChannels();
+    TestSwap();
+    TestDelay();
+
+    printf("ApoDsp (%s): %u checks, %u failures\n", pszPath, g_cChecks, g_cFailures);
+    return g_cFailures ? 1 : 0;
+}
@@ -0,0 +1,728 @@
+//
+// ApoHost.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Audio engine stand-in: WAVE I/O, test signals, measurement and the
+//   graph runner.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ApoHost.h"
+
+//-------------------------------------------------------------------------
+// Allocation counting
+//
+// glibc lets the executable replace the allocator entry points; every one
+// of them is counted and forwarded to the C library. Elsewhere only
+// operator new is seen.
+//
+static std::atomic<uint64_t> g_u64Allocations(0);
+
+uint64_t ApoHost_AllocationCount()
+{
+    return g_u64Allocations.load(std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+extern "C"
+{
+void *__libc_malloc(size_t cb);
+void *__libc_calloc(size_t c, size_t cb);
+void *__libc_realloc(void *p, size_t cb);
+void *__libc_memalign(size_t cbAlignment, size_t cb);
+void __libc_free(void *p);
+
+void *malloc(size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(cb);
+}
+
+void *calloc(size_t c, size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(c, cb);
+}
+
+void *realloc(void *p, size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, cb);
+}
+
+void *memalign(size_t cbAlignment, size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(cbAlignment, cb);
+}
+
+void *aligned_alloc(size_t cbAlignment, size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(cbAlignment, cb);
+}
+
+int posix_memalign(void **pp, size_t cbAlignment, size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    *pp = __libc_memalign(cbAlignment, cb);
+    return (*pp != NULL) ? 0 : 12; // ENOMEM
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+}
+#else
+void *operator new(size_t cb)
+{
+    g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(cb ? cb : 1);
+    if (p == NULL)
+    {
+        abort();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+#endif
+
+//-------------------------------------------------------------------------
+// Timing
+//
+uint64_t ApoHost_ReadCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t u64Ticks;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(u64Ticks));
+    return u64Ticks;
+#else
+    return ApoHost_ReadNanoseconds();
+#endif
+}
+
+const char *ApoHost_CycleUnit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return "tsc cycles";
+#elif defined(__aarch64__)
+    return "cntvct ticks";
+#else
+    return "ns";
+#endif
+}
+
+uint64_t ApoHost_ReadNanoseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void ApoHost_Summarize(std::vector<uint64_t> &Values, APOHOST_STATS *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    if (Values.empty())
+    {
+        return;
+    }
+
+    double dSum = 0;
+    for (uint64_t u64Value : Values)
+    {
+        dSum += (double)u64Value;
+    }
+
+    std::sort(Values.begin(), Values.end());
+    pStats->u64Min = Values.front();
+    pStats->u64Median = Values[Values.size() / 2];
+    pStats->u64P99 = Values[std::min(Values.size() - 1, Values.size() * 99 / 100)];
+    pStats->u64Max = Values.back();
+    pStats->dMean = dSum / Values.size();
+}
+
+uint64_t ApoHost_HashSamples(const float *pf32Samples, size_t cSamples)
+{
+    uint64_t u64Hash = 0xcbf29ce484222325ULL;
+    const uint8_t *pb = (const uint8_t *)pf32Samples;
+
+    for (size_t i = 0; i < cSamples * sizeof(float); i++)
+    {
+        u64Hash ^= pb[i];
+        u64Hash *= 0x100000001b3ULL;
+    }
+    return u64Hash;
+}
+
+//-------------------------------------------------------------------------
+// WAVE files
+//
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_IEEE_FLOAT  0x0003
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+static uint32_t ReadLe(const uint8_t *pb, uint32_t cb)
+{
+    uint32_t u32Value = 0;
+    for (uint32_t i = 0; i < cb; i++)
+    {
+        u32Value |= (uint32_t)pb[i] << (8 * i);
+    }
+    return u32Value;
+}
+
+static void WriteLe(std::string &Out, uint32_t u32Value, uint32_t cb)
+{
+    for (uint32_t i = 0; i < cb; i++)
+    {
+        Out.push_back((char)(u32Value >> (8 * i)));
+    }
+}
+
+bool ApoHost_ReadWav(const char *pszPath, APOHOST_AUDIO *pAudio)
+{
+    FILE *pFile = fopen(pszPath, "rb");
+    if (pFile == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", pszPath);
+        return false;
+    }
+
+    std::vector<uint8_t> File;
+    uint8_t abChunk[65536];
+    size_t cb;
+    while ((cb = fread(abChunk, 1, sizeof(abChunk), pFile)) != 0)
+    {
+        File.insert(File.end(), abChunk, abChunk + cb);
+    }
+    fclose(pFile);
+
+    if (File.size() < 12 || memcmp(&File[0], "RIFF", 4) != 0 || memcmp(&File[8], "WAVE", 4) != 0)
+    {
+        fprintf(stderr, "%s: not a RIFF/WAVE file\n", pszPath);
+        return false;
+    }
+
+    uint32_t u32Tag = 0, u32Channels = 0, u32Rate = 0, u32Bits = 0;
+    const uint8_t *pbData = NULL;
+    uint32_t cbData = 0;
+
+    for (size_t off = 12; off + 8 <= File.size(); )
+    {
+        uint32_t cbChunk = ReadLe(&File[off + 4], 4);
+        const uint8_t *pbChunk = &File[off + 8];
+        if (cbChunk > File.size() - off - 8)
+        {
+            cbChunk = (uint32_t)(File.size() - off - 8);
+        }
+
+        if (memcmp(&File[off], "fmt ", 4) == 0 && cbChunk >= 16)
+        {
+            u32Tag = ReadLe(pbChunk, 2);
+            u32Channels = ReadLe(pbChunk + 2, 2);
+            u32Rate = ReadLe(pbChunk + 4, 4);
+            u32Bits = ReadLe(pbChunk + 14, 2);
+            if (u32Tag == WAVE_FORMAT_EXTENSIBLE && cbChunk >= 26)
+            {
+                // first two bytes of the subformat GUID are the format tag
+                u32Tag = ReadLe(pbChunk + 24, 2);
+            }
+        }
+        else if (memcmp(&File[off], "data", 4) == 0)
+        {
+            pbData = pbChunk;
+            cbData = cbChunk;
+        }
+
+        off += 8 + cbChunk + (cbChunk & 1);
+    }
+
+    bool fSupported = (u32Tag == WAVE_FORMAT_PCM && (u32Bits == 16 || u32Bits == 24 || u32Bits == 32)) ||
+                      (u32Tag == WAVE_FORMAT_IEEE_FLOAT && u32Bits == 32);
+    if (pbData == NULL || u32Channels == 0 || !fSupported)
+    {
+        fprintf(stderr, "%s: unsupported format (tag %u, %u bits)\n", pszPath, u32Tag, u32Bits);
+        return false;
+    }
+
+    uint32_t cbSample = u32Bits / 8;
+    size_t cSamples = cbData / cbSample / u32Channels * u32Channels;
+
+    pAudio->u32FramesPerSecond = u32Rate;
+    pAudio->u32SamplesPerFrame = u32Channels;
+    pAudio->Samples.resize(cSamples);
+
+    for (size_t i = 0; i < cSamples; i++)
+    {
+        const uint8_t *pb = pbData + i * cbSample;
+        uint32_t u32Raw = ReadLe(pb, cbSample);
+
+        if (u32Tag == WAVE_FORMAT_IEEE_FLOAT)
+        {
+            memcpy(&pAudio->Samples[i], &u32Raw, sizeof(float));
+        }
+        else
+        {
+            // left justify, then scale the signed value to [-1, 1)
+            int32_t i32Value = (int32_t)(u32Raw << (32 - u32Bits));
+            pAudio->Samples[i] = (float)((double)i32Value / 2147483648.0);
+        }
+    }
+
+    return true;
+}
+
+bool ApoHost_WriteWav(const char *pszPath, const APOHOST_AUDIO *pAudio)
+{
+    uint32_t cbData = (uint32_t)(pAudio->Samples.size() * sizeof(float));
+    std::string Out;
+
+    Out.append("RIFF");
+    WriteLe(Out, 4 + 8 + 16 + 8 + cbData, 4);
+    Out.append("WAVEfmt ");
+    WriteLe(Out, 16, 4);
+    WriteLe(Out, WAVE_FORMAT_IEEE_FLOAT, 2);
+    WriteLe(Out, pAudio->u32SamplesPerFrame, 2);
+    WriteLe(Out, pAudio->u32FramesPerSecond, 4);
+    WriteLe(Out, pAudio->u32FramesPerSecond * pAudio->u32SamplesPerFrame * sizeof(float), 4);
+    WriteLe(Out, pAudio->u32SamplesPerFrame * sizeof(float), 2);
+    WriteLe(Out, 32, 2);
+    Out.append("data");
+    WriteLe(Out, cbData, 4);
+    for (float f32Sample : pAudio->Samples)
+    {
+        uint32_t u32Raw;
+        memcpy(&u32Raw, &f32Sample, sizeof(u32Raw));
+        WriteLe(Out, u32Raw, 4);
+    }
+
+    FILE *pFile = fopen(pszPath, "wb");
+    if (pFile == NULL || fwrite(Out.data(), 1, Out.size(), pFile) != Out.size())
+    {
+        fprintf(stderr, "%s: cannot write\n", pszPath);
+        if (pFile != NULL)
+        {
+            fclose(pFile);
+        }
+        return false;
+    }
+    fclose(pFile);
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Test signals
+//
+static float Quantize(double dValue)
+{
+    long lValue = lrint(dValue * 32768.0);
+    lValue = std::max(-32768L, std::min(32767L, lValue));
+    return (float)lValue / 32768.0f;
+}
+
+bool ApoHost_Generate(const char *pszSpec, APOHOST_AUDIO *pAudio)
+{
+    char szKind[16];
+    unsigned uRate, uChannels;
+    double dSeconds;
+
+    if (sscanf(pszSpec, "gen:%15[a-z]:%u:%u:%lf", szKind, &uRate, &uChannels, &dSeconds) != 4 ||
+        uRate == 0 || uChannels == 0 || dSeconds <= 0)
+    {
+        fprintf(stderr, "%s: expected gen:kind:rate:channels:seconds\n", pszSpec);
+        return false;
+    }
+
+    uint32_t u32Frames = (uint32_t)(uRate * dSeconds);
+    const double dPi = 3.14159265358979323846;
+
+    pAudio->u32FramesPerSecond = uRate;
+    pAudio->u32SamplesPerFrame = uChannels;
+    pAudio->Samples.assign((size_t)u32Frames * uChannels, 0.0f);
+
+    if (strcmp(szKind, "sine") == 0)
+    {
+        for (uint32_t n = 0; n < u32Frames; n++)
+        {
+            for (uint32_t c = 0; c < uChannels; c++)
+            {
+                double dFrequency = 250.0 * (c + 1) + 31.0;
+                pAudio->Samples[(size_t)n * uChannels + c] = Quantize(0.5 * sin(2 * dPi * dFrequency * n / uRate));
+            }
+        }
+    }
+    else if (strcmp(szKind, "noise") == 0)
+    {
+        uint32_t u32Seed = 0x12345678;
+        for (float &f32Sample : pAudio->Samples)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            f32Sample = (float)(int16_t)(u32Seed >> 16) / 65536.0f;
+        }
+    }
+    else if (strcmp(szKind, "speech") == 0)
+    {
+        // 700 ms voiced, 300 ms of digital silence, repeated
+        for (uint32_t n = 0; n < u32Frames; n++)
+        {
+            uint32_t u32InCycle = n % uRate;
+            if (u32InCycle >= uRate * 7 / 10)
+            {
+                continue;
+            }
+
+            double dTime = (double)u32InCycle / uRate;
+            double dPitch = 120.0 + 40.0 * sin(2 * dPi * 1.5 * dTime) + 20.0 * (n / uRate % 3);
+            double dEnvelope = sin(dPi * dTime / 0.7) * (0.6 + 0.4 * sin(2 * dPi * 4.0 * dTime));
+            double dValue = 0;
+            for (int h = 1; h <= 6; h++)
+            {
+                dValue += sin(2 * dPi * dPitch * h * dTime) / h;
+            }
+
+            for (uint32_t c = 0; c < uChannels; c++)
+            {
+                pAudio->Samples[(size_t)n * uChannels + c] = Quantize(0.25 * dEnvelope * dValue / (1 + c));
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "%s: unknown signal '%s'\n", pszSpec, szKind);
+        return false;
+    }
+
+    return true;
+}
+
+bool ApoHost_LoadAudio(const char *pszSource, APOHOST_AUDIO *pAudio)
+{
+    if (strncmp(pszSource, "gen:", 4) == 0)
+    {
+        return ApoHost_Generate(pszSource, pAudio);
+    }
+    return ApoHost_ReadWav(pszSource, pAudio);
+}
+
+//-------------------------------------------------------------------------
+// Graph
+//
+CApoHostGraph::CApoHostGraph()
+:   m_pf32LoopbackBuffer(NULL)
+,   m_u32LoopbackSamplesPerFrame(0)
+,   m_u32PeriodFrames(0)
+,   m_fFlagSilence(false)
+,   m_fPoisonSilence(false)
+,   m_u64ProcessNanoseconds(0)
+,   m_u64ProcessAllocations(0)
+{
+    memset(&m_InputFormat, 0, sizeof(m_InputFormat));
+    memset(&m_OutputFormat, 0, sizeof(m_OutputFormat));
+    memset(&m_Loopback, 0, sizeof(m_Loopback));
+}
+
+CApoHostGraph::~CApoHostGraph()
+{
+    Destroy();
+    for (CApoHostNode *pNode : m_Nodes)
+    {
+        delete pNode;
+    }
+}
+
+void CApoHostGraph::Destroy()
+{
+    for (float *pf32Buffer : m_Buffers)
+    {
+        free(pf32Buffer);
+    }
+    m_Buffers.clear();
+    free(m_pf32LoopbackBuffer);
+    m_pf32LoopbackBuffer = NULL;
+}
+
+bool CApoHostGraph::Create(const char *pszGraph)
+{
+    std::string Graph(pszGraph);
+    size_t off = 0;
+
+    while (off <= Graph.size())
+    {
+        size_t end = Graph.find(',', off);
+        if (end == std::string::npos)
+        {
+            end = Graph.size();
+        }
+
+        bool fInPlace = false;
+        CApoHostNode *pNode = ApoHost_CreateNode(Graph.substr(off, end - off).c_str(), &fInPlace);
+        if (pNode == NULL)
+        {
+            return false;
+        }
+        if (fInPlace && !pNode->CanProcessInPlace())
+        {
+            fprintf(stderr, "%s: cannot process in place\n", pNode->GetName());
+            delete pNode;
+            return false;
+        }
+
+        m_Nodes.push_back(pNode);
+        m_InPlace.push_back(fInPlace);
+        off = end + 1;
+    }
+
+    return !m_Nodes.empty();
+}
+
+bool CApoHostGraph::LockForProcess(uint32_t u32FramesPerSecond, uint32_t u32SamplesPerFrame, uint32_t u32PeriodFrames)
+{
+    Destroy();
+
+    m_u32PeriodFrames = u32PeriodFrames;
+    m_InputFormat.u32FramesPerSecond = u32FramesPerSecond;
+    m_InputFormat.u32SamplesPerFrame = u32SamplesPerFrame;
+    m_InputFormat.u32MaxFrameCount = u32PeriodFrames;
+
+    m_Formats.assign(1, m_InputFormat);
+    m_Connections.assign(m_Nodes.size() + 1, APO_CONNECTION_PROPERTY_V2());
+    m_NodeCycles.assign(m_Nodes.size(), 0);
+
+    for (size_t k = 0; k <= m_Nodes.size(); k++)
+    {
+        if (k > 0)
+        {
+            APOHOST_FORMAT Output = m_Formats[k - 1];
+            if (!m_Nodes[k - 1]->LockForProcess(&m_Formats[k - 1], &Output))
+            {
+                fprintf(stderr, "%s: cannot run on %u Hz, %u channels\n", m_Nodes[k - 1]->GetName(),
+                        m_Formats[k - 1].u32FramesPerSecond, m_Formats[k - 1].u32SamplesPerFrame);
+                return false;
+            }
+            m_Formats.push_back(Output);
+        }
+
+        APO_CONNECTION_PROPERTY_V2 *pConnection = &m_Connections[k];
+        pConnection->property.u32Signature = APO_CONNECTION_PROPERTY_V2_SIGNATURE;
+        pConnection->property.u32BufferFlags = BUFFER_VALID;
+
+        if (k > 0 && m_InPlace[k - 1] &&
+            m_Formats[k].u32SamplesPerFrame <= m_Formats[k - 1].u32SamplesPerFrame)
+        {
+            pConnection->property.pBuffer = m_Connections[k - 1].property.pBuffer;
+        }
+        else
+        {
+            size_t cb = sizeof(float) * (size_t)m_Formats[k].u32MaxFrameCount * m_Formats[k].u32SamplesPerFrame;
+            float *pf32Buffer = (float *)aligned_alloc(64, (cb + 63) & ~(size_t)63);
+            if (pf32Buffer == NULL)
+            {
+                return false;
+            }
+            memset(pf32Buffer, 0, cb);
+            m_Buffers.push_back(pf32Buffer);
+            pConnection->property.pBuffer = (uintptr_t)pf32Buffer;
+        }
+    }
+
+    m_OutputFormat = m_Formats.back();
+    return true;
+}
+
+bool CApoHostGraph::Run(const APOHOST_AUDIO *pInput, const APOHOST_AUDIO *pLoopback, APOHOST_AUDIO *pOutput)
+{
+    if (pInput->u32FramesPerSecond != m_InputFormat.u32FramesPerSecond ||
+        pInput->u32SamplesPerFrame != m_InputFormat.u32SamplesPerFrame)
+    {
+        fprintf(stderr, "input format does not match the locked format\n");
+        return false;
+    }
+
+    bool fLoopback = false;
+    for (CApoHostNode *pNode : m_Nodes)
+    {
+        fLoopback = fLoopback || pNode->UsesLoopback();
+    }
+
+    if (fLoopback && pLoopback != NULL)
+    {
+        APOHOST_FORMAT LoopbackFormat = { pLoopback->u32FramesPerSecond, pLoopback->u32SamplesPerFrame, m_u32PeriodFrames };
+        for (CApoHostNode *pNode : m_Nodes)
+        {
+            if (pNode->UsesLoopback() && !pNode->LockLoopback(&LoopbackFormat))
+            {
+                fprintf(stderr, "%s: cannot take a %u Hz loopback\n", pNode->GetName(), pLoopback->u32FramesPerSecond);
+                return false;
+            }
+        }
+        m_u32LoopbackSamplesPerFrame = pLoopback->u32SamplesPerFrame;
+        m_pf32LoopbackBuffer = (float *)aligned_alloc(64, ((sizeof(float) * m_u32PeriodFrames * m_u32LoopbackSamplesPerFrame) + 63) & ~(size_t)63);
+        if (m_pf32LoopbackBuffer == NULL)
+        {
+            return false;
+        }
+        m_Loopback.property.pBuffer = (uintptr_t)m_pf32LoopbackBuffer;
+        m_Loopback.property.u32Signature = APO_CONNECTION_PROPERTY_V2_SIGNATURE;
+    }
+    else
+    {
+        pLoopback = NULL;
+    }
+
+    uint32_t u32Frames = pInput->GetFrameCount();
+    uint32_t u32Periods = (u32Frames + m_u32PeriodFrames - 1) / m_u32PeriodFrames;
+    uint32_t u32InChannels = m_InputFormat.u32SamplesPerFrame;
+    uint32_t u32OutChannels = m_OutputFormat.u32SamplesPerFrame;
+
+    // everything the loop touches is sized up front
+    pOutput->u32FramesPerSecond = m_OutputFormat.u32FramesPerSecond;
+    pOutput->u32SamplesPerFrame = u32OutChannels;
+    pOutput->Samples.assign((size_t)u32Frames * u32OutChannels, 0.0f);
+    m_PeriodCycles.assign(u32Periods, 0);
+    m_NodeCycles.assign(m_Nodes.size(), 0);
+
+    std::vector<APO_CONNECTION_PROPERTY *> Inputs(2), Outputs(1);
+    float *pf32Source = (float *)m_Connections[0].property.pBuffer;
+    const float *pf32Sink = (const float *)m_Connections.back().property.pBuffer;
+    uint64_t u64ProcessNanoseconds = 0;
+    uint64_t u64Allocations = ApoHost_AllocationCount();
+
+    for (uint32_t u32Period = 0; u32Period < u32Periods; u32Period++)
+    {
+        uint32_t u32First = u32Period * m_u32PeriodFrames;
+        uint32_t u32Count = std::min(m_u32PeriodFrames, u32Frames - u32First);
+        uint64_t u64QpcTime = HNS_PER_SECOND + (uint64_t)u32First * HNS_PER_SECOND / m_InputFormat.u32FramesPerSecond;
+        size_t cInSamples = (size_t)u32Count * u32InChannels;
+        const float *pf32In = &pInput->Samples[(size_t)u32First * u32InChannels];
+
+        // the engine fills the first connection
+        bool fSilent = m_fFlagSilence;
+        for (size_t i = 0; fSilent && i < cInSamples; i++)
+        {
+            fSilent = (pf32In[i] == 0.0f);
+        }
+        if (fSilent && m_fPoisonSilence)
+        {
+            for (size_t i = 0; i < cInSamples; i++)
+            {
+                pf32Source[i] = NAN;
+            }
+        }
+        else
+        {
+            memcpy(pf32Source, pf32In, sizeof(float) * cInSamples);
+        }
+        m_Connections[0].property.u32ValidFrameCount = u32Count;
+        m_Connections[0].property.u32BufferFlags = fSilent ? BUFFER_SILENT : BUFFER_VALID;
+        m_Connections[0].u64QPCTime = u64QpcTime;
+
+        if (pLoopback != NULL)
+        {
+            uint32_t u32Available = (u32First < pLoopback->GetFrameCount()) ? std::min(u32Count, pLoopback->GetFrameCount() - u32First) : 0;
+            size_t cLoopbackSamples = (size_t)u32Count * m_u32LoopbackSamplesPerFrame;
+            memset(m_pf32LoopbackBuffer, 0, sizeof(float) * cLoopbackSamples);
+            if (u32Available != 0)
+            {
+                memcpy(m_pf32LoopbackBuffer, &pLoopback->Samples[(size_t)u32First * m_u32LoopbackSamplesPerFrame],
+                       sizeof(float) * u32Available * m_u32LoopbackSamplesPerFrame);
+            }
+            m_Loopback.property.u32ValidFrameCount = u32Count;
+            m_Loopback.property.u32BufferFlags = BUFFER_VALID;
+            m_Loopback.u64QPCTime = u64QpcTime;
+        }
+
+        uint64_t u64Nanoseconds = ApoHost_ReadNanoseconds();
+        uint64_t u64PeriodStart = ApoHost_ReadCycles();
+
+        for (size_t k = 0; k < m_Nodes.size(); k++)
+        {
+            uint64_t u64NodeStart = ApoHost_ReadCycles();
+
+            if (pLoopback != NULL && m_Nodes[k]->UsesLoopback())
+            {
+                m_Nodes[k]->AcceptLoopback(&m_Loopback);
+            }
+
+            Inputs[0] = &m_Connections[k].property;
+            Outputs[0] = &m_Connections[k + 1].property;
+            m_Nodes[k]->APOProcess(1, Inputs.data(), 1, Outputs.data());
+
+            m_NodeCycles[k] += ApoHost_ReadCycles() - u64NodeStart;
+        }
+
+        m_PeriodCycles[u32Period] = ApoHost_ReadCycles() - u64PeriodStart;
+        u64ProcessNanoseconds += ApoHost_ReadNanoseconds() - u64Nanoseconds;
+
+        // the engine drains the last connection; a silent buffer is zeros
+        if (m_Connections.back().property.u32BufferFlags != BUFFER_SILENT)
+        {
+            memcpy(&pOutput->Samples[(size_t)u32First * u32OutChannels], pf32Sink,
+                   sizeof(float) * u32Count * u32OutChannels);
+        }
+    }
+
+    m_u64ProcessAllocations = ApoHost_AllocationCount() - u64Allocations;
+    m_u64ProcessNanoseconds = u64ProcessNanoseconds;
+
+    free(m_pf32LoopbackBuffer);
+    m_pf32LoopbackBuffer = NULL;
+    return true;
+}
+
+void CApoHostGraph::PrintReport(const APOHOST_AUDIO *pInput) const
+{
+    std::vector<uint64_t> Cycles(m_PeriodCycles);
+    APOHOST_STATS Stats;
+    double dSeconds = (double)pInput->GetFrameCount() / pInput->u32FramesPerSecond;
+    size_t cPeriods = Cycles.size();
+
+    ApoHost_Summarize(Cycles, &Stats);
+
+    printf("graph:");
+    for (size_t k = 0; k < m_Nodes.size(); k++)
+    {
+        printf("%s %s%s", k ? " ->" : "", m_Nodes[k]->GetName(), m_InPlace[k] ? " (in place)" : "");
+    }
+    printf("\n");
+    printf("input: %u Hz, %u ch -> %u ch, %u frames/period, %zu periods (%.3f s)\n",
+           m_InputFormat.u32FramesPerSecond, m_InputFormat.u32SamplesPerFrame, m_OutputFormat.u32SamplesPerFrame,
+           m_u32PeriodFrames, cPeriods, dSeconds);
+    printf("%s/period: min %llu  median %llu  p99 %llu  max %llu  mean %.0f\n", ApoHost_CycleUnit(),
+           (unsigned long long)Stats.u64Min, (unsigned long long)Stats.u64Median,
+           (unsigned long long)Stats.u64P99, (unsigned long long)Stats.u64Max, Stats.dMean);
+    for (size_t k = 0; k < m_Nodes.size(); k++)
+    {
+        printf("  %-12s mean %.0f %s/period\n", m_Nodes[k]->GetName(),
+               cPeriods ? (double)m_NodeCycles[k] / cPeriods : 0.0, ApoHost_CycleUnit());
+    }
+    printf("time: %.0f ns/period, %.0fx realtime\n",
+           cPeriods ? (double)m_u64ProcessNanoseconds / cPeriods : 0.0,
+           m_u64ProcessNanoseconds ? dSeconds * 1e9 / m_u64ProcessNanoseconds : 0.0);
+    printf("allocations during processing: %llu\n", (unsigned long long)m_u64ProcessAllocations);
+}
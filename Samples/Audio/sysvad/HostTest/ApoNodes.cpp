@@ -0,0 +1,569 @@
+//
+// ApoNodes.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Graph nodes for the sample APOs. Each APOProcess below follows the
+//   APOProcess of the APO it is named after, flag handling included, and
+//   calls the same kernels; keep them in step when an APO changes.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <ApoDsp.h>
+#include <AecCanceller.h>
+#include <AecReferenceBuffer.h>
+
+#include "ApoHost.h"
+
+// DelayAPO.h: HNS_DELAY
+#define DELAY_DEFAULT_MS    1000
+
+//-------------------------------------------------------------------------
+// Node options, "key=value" pairs after the node name.
+//
+class CNodeOptions
+{
+public:
+    explicit CNodeOptions(const char *pszSpec) : m_fValid(true), m_fInPlace(false)
+    {
+        std::string Spec(pszSpec);
+        size_t off = Spec.find(':');
+
+        m_Name = Spec.substr(0, off);
+        while (off != std::string::npos)
+        {
+            size_t end = Spec.find(':', off + 1);
+            std::string Option = Spec.substr(off + 1, (end == std::string::npos) ? std::string::npos : end - off - 1);
+            size_t eq = Option.find('=');
+
+            if (Option == "inplace")
+            {
+                m_fInPlace = true;
+            }
+            else if (eq == std::string::npos)
+            {
+                fprintf(stderr, "%s: option '%s' is not key=value\n", m_Name.c_str(), Option.c_str());
+                m_fValid = false;
+            }
+            else
+            {
+                m_Keys.push_back(Option.substr(0, eq));
+                m_Values.push_back(Option.substr(eq + 1));
+                m_Used.push_back(false);
+            }
+            off = end;
+        }
+    }
+
+    const std::string &GetName() const { return m_Name; }
+    bool IsInPlace() const { return m_fInPlace; }
+
+    uint32_t Get(const char *pszKey, uint32_t u32Default)
+    {
+        for (size_t i = 0; i < m_Keys.size(); i++)
+        {
+            if (m_Keys[i] == pszKey)
+            {
+                m_Used[i] = true;
+                return (uint32_t)strtoul(m_Values[i].c_str(), NULL, 0);
+            }
+        }
+        return u32Default;
+    }
+
+    // false if an option was malformed or not consumed by the node
+    bool Validate() const
+    {
+        bool fValid = m_fValid;
+        for (size_t i = 0; i < m_Keys.size(); i++)
+        {
+            if (!m_Used[i])
+            {
+                fprintf(stderr, "%s: unknown option '%s'\n", m_Name.c_str(), m_Keys[i].c_str());
+                fValid = false;
+            }
+        }
+        return fValid;
+    }
+
+private:
+    std::string                 m_Name;
+    std::vector<std::string>    m_Keys;
+    std::vector<std::string>    m_Values;
+    std::vector<bool>           m_Used;
+    bool                        m_fValid;
+    bool                        m_fInPlace;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  CDelayAPOMFX / CDelayAPOSFX::APOProcess, which are identical.
+//
+class CDelayNode : public CApoHostNode
+{
+public:
+    CDelayNode(const char *pszName, uint32_t u32DelayMs, bool fEnable)
+    :   m_pszName(pszName)
+    ,   m_u32DelayMs(u32DelayMs)
+    ,   m_fEnable(fEnable)
+    ,   m_u32SamplesPerFrame(0)
+    ,   m_pf32DelayBuffer(NULL)
+    ,   m_nDelayFrames(0)
+    ,   m_iDelayIndex(0)
+    ,   m_nSilentFrames(0)
+    {
+    }
+
+    ~CDelayNode()
+    {
+        free(m_pf32DelayBuffer);
+    }
+
+    const char *GetName() const { return m_pszName; }
+
+    bool LockForProcess(const APOHOST_FORMAT *pInput, APOHOST_FORMAT *pOutput)
+    {
+        // FRAMES_FROM_HNS, rounded the same way
+        m_nDelayFrames = (uint32_t)(1.0 * m_u32DelayMs / 1000 * pInput->u32FramesPerSecond + 0.5);
+        m_u32SamplesPerFrame = pInput->u32SamplesPerFrame;
+        m_iDelayIndex = 0;
+
+        // the delay line starts out silent
+        m_pf32DelayBuffer = (float *)calloc((size_t)m_nDelayFrames * m_u32SamplesPerFrame + 1, sizeof(float));
+        m_nSilentFrames = m_nDelayFrames;
+
+        *pOutput = *pInput;
+        return m_pf32DelayBuffer != NULL;
+    }
+
+    void APOProcess(
+        uint32_t u32NumInputConnections,
+        APO_CONNECTION_PROPERTY **ppInputConnections,
+        uint32_t u32NumOutputConnections,
+        APO_CONNECTION_PROPERTY **ppOutputConnections)
+    {
+        (void)u32NumInputConnections;
+
+        float *pf32InputFrames = reinterpret_cast<float *>(ppInputConnections[0]->pBuffer);
+        float *pf32OutputFrames = reinterpret_cast<float *>(ppOutputConnections[0]->pBuffer);
+
+        if (ppInputConnections[0]->u32BufferFlags != BUFFER_VALID &&
+            ppInputConnections[0]->u32BufferFlags != BUFFER_SILENT)
+        {
+            return;
+        }
+
+        if (m_fEnable)
+        {
+            bool fOutputSilent = ApoDsp_Delay(pf32OutputFrames,
+                                              (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags) ? NULL : pf32InputFrames,
+                                              ppInputConnections[0]->u32ValidFrameCount,
+                                              m_u32SamplesPerFrame,
+                                              m_pf32DelayBuffer,
+                                              m_nDelayFrames,
+                                              &m_iDelayIndex,
+                                              &m_nSilentFrames);
+
+            ppOutputConnections[0]->u32BufferFlags = fOutputSilent ? BUFFER_SILENT : BUFFER_VALID;
+        }
+        else
+        {
+            if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
+            {
+                if (0 != u32NumOutputConnections)
+                {
+                    ApoDsp_WriteSilence(pf32OutputFrames, ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame);
+                }
+            }
+            else if ((0 != u32NumOutputConnections) &&
+                     (ppOutputConnections[0]->pBuffer != ppInputConnections[0]->pBuffer))
+            {
+                ApoDsp_CopyFrames(pf32OutputFrames, pf32InputFrames,
+                                  ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame);
+            }
+            ppOutputConnections[0]->u32BufferFlags = ppInputConnections[0]->u32BufferFlags;
+        }
+
+        ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
+    }
+
+private:
+    const char *m_pszName;
+    uint32_t    m_u32DelayMs;
+    bool        m_fEnable;
+    uint32_t    m_u32SamplesPerFrame;
+    float      *m_pf32DelayBuffer;
+    uint32_t    m_nDelayFrames;
+    uint32_t    m_iDelayIndex;
+    uint32_t    m_nSilentFrames;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  CSwapAPOSFX::APOProcess (swap) and CSwapAPOMFX::APOProcess (swap and
+//  scale by 1 - channel / channels).
+//
+class CSwapNode : public CApoHostNode
+{
+public:
+    CSwapNode(const char *pszName, bool fScale, bool fEnable)
+    :   m_pszName(pszName)
+    ,   m_fScale(fScale)
+    ,   m_fEnable(fEnable)
+    ,   m_u32SamplesPerFrame(0)
+    ,   m_pf32Coefficients(NULL)
+    {
+    }
+
+    ~CSwapNode()
+    {
+        free(m_pf32Coefficients);
+    }
+
+    const char *GetName() const { return m_pszName; }
+
+    bool LockForProcess(const APOHOST_FORMAT *pInput, APOHOST_FORMAT *pOutput)
+    {
+        m_u32SamplesPerFrame = pInput->u32SamplesPerFrame;
+
+        // CSwapAPOMFX::ValidateAndCacheConnectionInfo
+        m_pf32Coefficients = (float *)malloc(sizeof(float) * m_u32SamplesPerFrame);
+        if (m_pf32Coefficients == NULL)
+        {
+            return false;
+        }
+        float f32InverseChannelCount = 1.0f / m_u32SamplesPerFrame;
+        for (uint32_t u32Index = 0; u32Index < m_u32SamplesPerFrame; u32Index++)
+        {
+            m_pf32Coefficients[u32Index] = 1.0f - (float)(f32InverseChannelCount) * u32Index;
+        }
+
+        *pOutput = *pInput;
+        return true;
+    }
+
+    void APOProcess(
+        uint32_t u32NumInputConnections,
+        APO_CONNECTION_PROPERTY **ppInputConnections,
+        uint32_t u32NumOutputConnections,
+        APO_CONNECTION_PROPERTY **ppOutputConnections)
+    {
+        (void)u32NumInputConnections;
+
+        float *pf32InputFrames = reinterpret_cast<float *>(ppInputConnections[0]->pBuffer);
+        float *pf32OutputFrames = reinterpret_cast<float *>(ppOutputConnections[0]->pBuffer);
+
+        if (ppInputConnections[0]->u32BufferFlags != BUFFER_VALID &&
+            ppInputConnections[0]->u32BufferFlags != BUFFER_SILENT)
+        {
+            return;
+        }
+
+        if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
+        {
+            ApoDsp_WriteSilence(pf32InputFrames, ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame);
+        }
+
+        if (m_fEnable && m_fScale && 1 < m_u32SamplesPerFrame)
+        {
+            ApoDsp_SwapScale(pf32InputFrames, pf32InputFrames,
+                             ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame, m_pf32Coefficients);
+        }
+        else if (m_fEnable && !m_fScale)
+        {
+            ApoDsp_Swap(pf32InputFrames, pf32InputFrames,
+                        ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame);
+        }
+
+        if ((0 != u32NumOutputConnections) &&
+            (ppOutputConnections[0]->pBuffer != ppInputConnections[0]->pBuffer))
+        {
+            ApoDsp_CopyFrames(pf32OutputFrames, pf32InputFrames,
+                              ppInputConnections[0]->u32ValidFrameCount, m_u32SamplesPerFrame);
+        }
+
+        ppOutputConnections[0]->u32BufferFlags = ppInputConnections[0]->u32BufferFlags;
+        ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
+    }
+
+private:
+    const char *m_pszName;
+    bool        m_fScale;
+    bool        m_fEnable;
+    uint32_t    m_u32SamplesPerFrame;
+    float      *m_pf32Coefficients;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  CKWSApoMFX::APOProcess: extracts the primary channels of a keyword
+//  burst that interleaves microphone and loopback audio, as described by
+//  INTERLEAVED_AUDIO_FORMAT_INFORMATION.
+//
+class CKwsNode : public CApoHostNode
+{
+public:
+    CKwsNode(uint32_t u32PrimaryStart, uint32_t u32PrimaryCount, uint32_t u32InterleavedCount)
+    :   m_u32PrimaryStart(u32PrimaryStart)
+    ,   m_u32PrimaryCount(u32PrimaryCount)
+    ,   m_u32InterleavedCount(u32InterleavedCount)
+    {
+    }
+
+    const char *GetName() const { return "kws"; }
+
+    bool CanProcessInPlace() const { return false; }
+
+    bool LockForProcess(const APOHOST_FORMAT *pInput, APOHOST_FORMAT *pOutput)
+    {
+        if (pInput->u32SamplesPerFrame != m_u32PrimaryCount + m_u32InterleavedCount ||
+            m_u32PrimaryStart + m_u32PrimaryCount > pInput->u32SamplesPerFrame ||
+            m_u32PrimaryCount == 0)
+        {
+            return false;
+        }
+
+        *pOutput = *pInput;
+        pOutput->u32SamplesPerFrame = m_u32PrimaryCount;
+        return true;
+    }
+
+    void APOProcess(
+        uint32_t u32NumInputConnections,
+        APO_CONNECTION_PROPERTY **ppInputConnections,
+        uint32_t u32NumOutputConnections,
+        APO_CONNECTION_PROPERTY **ppOutputConnections)
+    {
+        (void)u32NumInputConnections;
+        (void)u32NumOutputConnections;
+
+        const float *pf32InputFrames = reinterpret_cast<const float *>(ppInputConnections[0]->pBuffer);
+        float *pf32OutputFrames = reinterpret_cast<float *>(ppOutputConnections[0]->pBuffer);
+
+        if (ppInputConnections[0]->u32BufferFlags != BUFFER_VALID &&
+            ppInputConnections[0]->u32BufferFlags != BUFFER_SILENT)
+        {
+            return;
+        }
+
+        if (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags)
+        {
+            ApoDsp_WriteSilence(pf32OutputFrames, ppInputConnections[0]->u32ValidFrameCount, m_u32PrimaryCount);
+        }
+        else
+        {
+            ApoDsp_ExtractPrimaryChannels(pf32OutputFrames, pf32InputFrames,
+                                          ppInputConnections[0]->u32ValidFrameCount,
+                                          m_u32PrimaryStart, m_u32PrimaryCount,
+                                          m_u32PrimaryCount + m_u32InterleavedCount);
+
+            ppOutputConnections[0]->u32BufferFlags = BUFFER_VALID;
+        }
+
+        ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
+    }
+
+private:
+    uint32_t    m_u32PrimaryStart;
+    uint32_t    m_u32PrimaryCount;
+    uint32_t    m_u32InterleavedCount;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  CAecApoMFX: LockForProcess, AcceptInput (the loopback) and APOProcess.
+//  The output is the mono echo-cancelled first microphone channel.
+//
+class CAecNode : public CApoHostNode
+{
+public:
+    CAecNode(uint32_t u32TailMs)
+    :   m_u32TailMs(u32TailMs)
+    ,   m_u32MicChannels(0)
+    ,   m_u32FramesPerSecond(0)
+    ,   m_u32LoopbackChannels(0)
+    ,   m_pbProcessingMemory(NULL)
+    ,   m_pf32ReferenceFrames(NULL)
+    ,   m_fReference(false)
+    {
+    }
+
+    ~CAecNode()
+    {
+        free(m_pbProcessingMemory);
+    }
+
+    const char *GetName() const { return "aec"; }
+
+    bool CanProcessInPlace() const { return false; }
+
+    bool UsesLoopback() const { return true; }
+
+    bool LockForProcess(const APOHOST_FORMAT *pInput, APOHOST_FORMAT *pOutput)
+    {
+        if (!CAecCanceller::IsSampleRateSupported(pInput->u32FramesPerSecond))
+        {
+            return false;
+        }
+
+        m_u32MicChannels = pInput->u32SamplesPerFrame;
+        m_u32FramesPerSecond = pInput->u32FramesPerSecond;
+
+        uint32_t u32MaxFrames = pInput->u32MaxFrameCount;
+        uint32_t u32HistoryFrames = pInput->u32FramesPerSecond * AEC_REFERENCE_HISTORY_MS / 1000 + 2 * u32MaxFrames;
+        size_t cbCanceller = CAecCanceller::GetRequiredBytes(pInput->u32FramesPerSecond, m_u32TailMs);
+        size_t cbReference = CAecReferenceBuffer::GetRequiredBytes(u32HistoryFrames);
+        size_t cbFrames = sizeof(float) * u32MaxFrames;
+
+        cbCanceller = (cbCanceller + (APOFFT_ALIGNMENT - 1)) & ~(size_t)(APOFFT_ALIGNMENT - 1);
+        cbReference = (cbReference + (APOFFT_ALIGNMENT - 1)) & ~(size_t)(APOFFT_ALIGNMENT - 1);
+
+        m_pbProcessingMemory = (uint8_t *)calloc(cbCanceller + cbReference + cbFrames + APOFFT_ALIGNMENT, 1);
+        if (m_pbProcessingMemory == NULL)
+        {
+            return false;
+        }
+
+        uint8_t *pbAligned = (uint8_t *)(((uintptr_t)m_pbProcessingMemory + (APOFFT_ALIGNMENT - 1)) & ~(uintptr_t)(APOFFT_ALIGNMENT - 1));
+
+        if (!m_Canceller.Initialize(pInput->u32FramesPerSecond, m_u32TailMs, pbAligned) ||
+            !m_Reference.Initialize(pInput->u32FramesPerSecond, u32HistoryFrames, pbAligned + cbCanceller))
+        {
+            return false;
+        }
+        m_pf32ReferenceFrames = (float *)(pbAligned + cbCanceller + cbReference);
+
+        *pOutput = *pInput;
+        pOutput->u32SamplesPerFrame = 1;
+        return true;
+    }
+
+    void AcceptLoopback(const APO_CONNECTION_PROPERTY_V2 *pLoopback)
+    {
+        m_Reference.Write(
+            (BUFFER_SILENT == pLoopback->property.u32BufferFlags) ? NULL : reinterpret_cast<const float *>(pLoopback->property.pBuffer),
+            m_u32LoopbackChannels,
+            pLoopback->property.u32ValidFrameCount,
+            pLoopback->u64QPCTime);
+        m_fReference = true;
+    }
+
+    bool LockLoopback(const APOHOST_FORMAT *pLoopback)
+    {
+        m_u32LoopbackChannels = pLoopback->u32SamplesPerFrame;
+        return pLoopback->u32FramesPerSecond == m_u32FramesPerSecond;
+    }
+
+    void APOProcess(
+        uint32_t u32NumInputConnections,
+        APO_CONNECTION_PROPERTY **ppInputConnections,
+        uint32_t u32NumOutputConnections,
+        APO_CONNECTION_PROPERTY **ppOutputConnections)
+    {
+        (void)u32NumInputConnections;
+        (void)u32NumOutputConnections;
+
+        const APO_CONNECTION_PROPERTY_V2 *inConnection = reinterpret_cast<const APO_CONNECTION_PROPERTY_V2 *>(ppInputConnections[0]);
+        const float *pf32InputFrames = reinterpret_cast<const float *>(ppInputConnections[0]->pBuffer);
+        float *pf32OutputFrames = reinterpret_cast<float *>(ppOutputConnections[0]->pBuffer);
+
+        if (ppInputConnections[0]->u32BufferFlags != BUFFER_VALID &&
+            ppInputConnections[0]->u32BufferFlags != BUFFER_SILENT)
+        {
+            return;
+        }
+
+        const float *pf32Reference = NULL;
+        if (m_fReference)
+        {
+            m_Reference.Read(m_pf32ReferenceFrames, ppInputConnections[0]->u32ValidFrameCount, inConnection->u64QPCTime);
+            pf32Reference = m_pf32ReferenceFrames;
+        }
+
+        m_Canceller.Process(
+            (BUFFER_SILENT == ppInputConnections[0]->u32BufferFlags) ? NULL : pf32InputFrames,
+            m_u32MicChannels,
+            pf32Reference,
+            pf32OutputFrames,
+            ppInputConnections[0]->u32ValidFrameCount);
+
+        ppOutputConnections[0]->u32ValidFrameCount = ppInputConnections[0]->u32ValidFrameCount;
+        ppOutputConnections[0]->u32BufferFlags = BUFFER_VALID;
+    }
+
+    const CAecCanceller &GetCanceller() const { return m_Canceller; }
+
+private:
+    uint32_t            m_u32TailMs;
+    uint32_t            m_u32MicChannels;
+    uint32_t            m_u32FramesPerSecond;
+    uint32_t            m_u32LoopbackChannels;
+    CAecCanceller       m_Canceller;
+    CAecReferenceBuffer m_Reference;
+    uint8_t            *m_pbProcessingMemory;
+    float              *m_pf32ReferenceFrames;
+    bool                m_fReference;
+};
+
+//-------------------------------------------------------------------------
+// Factory
+//
+CApoHostNode *ApoHost_CreateNode(const char *pszSpec, bool *pfInPlace)
+{
+    CNodeOptions Options(pszSpec);
+    CApoHostNode *pNode = NULL;
+    const std::string &Name = Options.GetName();
+
+    if (Name == "delay-mfx" || Name == "delay-sfx")
+    {
+        pNode = new CDelayNode((Name == "delay-mfx") ? "delay-mfx" : "delay-sfx",
+                               Options.Get("ms", DELAY_DEFAULT_MS), Options.Get("enable", 1) != 0);
+    }
+    else if (Name == "swap-mfx" || Name == "swap-sfx")
+    {
+        bool fMfx = (Name == "swap-mfx");
+        pNode = new CSwapNode(fMfx ? "swap-mfx" : "swap-sfx", fMfx, Options.Get("enable", 1) != 0);
+    }
+    else if (Name == "kws")
+    {
+        pNode = new CKwsNode(Options.Get("start", 0), Options.Get("primary", 1), Options.Get("interleaved", 0));
+    }
+    else if (Name == "aec")
+    {
+        pNode = new CAecNode(Options.Get("tail", AEC_DEFAULT_TAIL_MS));
+    }
+    else
+    {
+        fprintf(stderr, "unknown node '%s' (--list shows the nodes)\n", Name.c_str());
+        return NULL;
+    }
+
+    if (!Options.Validate())
+    {
+        delete pNode;
+        return NULL;
+    }
+
+    *pfInPlace = Options.IsInPlace();
+    return pNode;
+}
+
+void ApoHost_PrintNodes()
+{
+    printf("nodes (options after ':', any node but kws and aec takes 'inplace'):\n"
+           "  delay-mfx, delay-sfx   DelayAPO        ms=%u enable=1\n"
+           "  swap-mfx               SwapAPO MFX     enable=1 (swap and scale)\n"
+           "  swap-sfx               SwapAPO SFX     enable=1\n"
+           "  kws                    KWSApo MFX      start=0 primary=1 interleaved=0\n"
+           "  aec                    AecApo MFX      tail=%u (loopback from --ref)\n",
+           DELAY_DEFAULT_MS, AEC_DEFAULT_TAIL_MS);
+}
@@ -0,0 +1,1432 @@
+//
+// CodecTests.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Conformance checks of the driver's Bluetooth codecs (EndpointsCommon/
+//   SbcCodec.h, HfpCodec.h) against reference implementations written
+//   here from the specifications, in double precision and in the direct
+//   form the specifications give, sharing no code with the driver:
+//
+//   - SBC (A2DP specification, section 12 and appendix B): bit allocation,
+//     frame syntax and CRC, analysis and synthesis filterbanks.
+//   - mSBC (HFP specification, section 5.7 and appendix A): the frame
+//     parameters, the H2 synchronization header and the 60 byte packet.
+//   - CVSD (Bluetooth Core specification, vol 2 part B 9.2).
+//
+//   Each driver encoder is decoded by the reference decoder, and each
+//   driver decoder decodes the reference encoder's output. Known answer
+//   vectors pin the silent mSBC frame and the CVSD idle and overload
+//   patterns. Packet loss concealment is checked on a lossy link.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "CodecHost.h"
+#include "HfpCodec.h"
+
+static unsigned g_cChecks;
+static unsigned g_cFailures;
+
+#define CHECK(expr, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        g_cChecks++;                                                        \
+        if (!(expr))                                                        \
+        {                                                                   \
+            if (g_cFailures++ < 20)                                         \
+            {                                                               \
+                fprintf(stderr, "%s:%d: %s: ", __FILE__, __LINE__, #expr);  \
+                fprintf(stderr, __VA_ARGS__);                               \
+                fprintf(stderr, "\n");                                      \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+static const double c_Pi = 3.14159265358979323846;
+
+static uint32_t g_u32Seed = 1;
+
+static uint32_t Random()
+{
+    g_u32Seed = g_u32Seed * 1664525u + 1013904223u;
+    return g_u32Seed >> 8;
+}
+
+//-------------------------------------------------------------------------
+// Test signals.
+//
+enum SIGNAL
+{
+    SIGNAL_TONES,       // two steady tones
+    SIGNAL_SPEECH,      // voiced harmonics under a syllable envelope, with noise
+};
+
+static std::vector<INT16> MakeSignal(SIGNAL eSignal, uint32_t u32Rate, uint32_t u32Samples)
+{
+    std::vector<INT16> samples(u32Samples);
+
+    for (uint32_t i = 0; i < u32Samples; i++)
+    {
+        double t = (double)i / u32Rate;
+        double x = 0;
+
+        if (eSignal == SIGNAL_TONES)
+        {
+            x = 8000 * sin(2 * c_Pi * 300 * t) + 5000 * sin(2 * c_Pi * 1100 * t);
+        }
+        else
+        {
+            double f0 = 140 + 30 * sin(2 * c_Pi * 0.7 * t);
+            double envelope = 0.55 + 0.45 * sin(2 * c_Pi * 3.1 * t);
+
+            for (int h = 1; h <= 12 && h * f0 < u32Rate * 0.45; h++)
+            {
+                x += 9000.0 / h * sin(2 * c_Pi * h * f0 * t + h);
+            }
+            x = x * envelope + (double)((int32_t)(Random() % 801) - 400);
+        }
+
+        samples[i] = (INT16)lrint(x);
+    }
+
+    return samples;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  SNR in dB of Out against Ref, with Out delayed by the best of 0 to
+//  u32MaxDelay samples. The first u32Skip samples (codec start up) are
+//  left out.
+//
+static double BestSnr(
+    const std::vector<double>& ref,
+    const std::vector<double>& out,
+    uint32_t u32Skip,
+    uint32_t u32MaxDelay,
+    uint32_t *pu32Delay)
+{
+    double best = -1000;
+
+    for (uint32_t d = 0; d <= u32MaxDelay; d++)
+    {
+        double signal = 0;
+        double noise = 1e-9;
+
+        for (size_t i = u32Skip; i + d < out.size() && i + u32MaxDelay < ref.size(); i++)
+        {
+            double e = ref[i] - out[i + d];
+
+            signal += ref[i] * ref[i];
+            noise += e * e;
+        }
+
+        double snr = 10 * log10(signal / noise);
+        if (snr > best)
+        {
+            best = snr;
+            if (pu32Delay != NULL)
+            {
+                *pu32Delay = d;
+            }
+        }
+    }
+
+    return best;
+}
+
+static std::vector<double> ToDouble(const std::vector<INT16>& samples)
+{
+    return std::vector<double>(samples.begin(), samples.end());
+}
+
+//=========================================================================
+// Reference SBC, 8 subbands, after the A2DP specification.
+//
+
+//
+// Prototype filter coefficients C[0..79] for 8 subbands (table 12.23).
+//
+static const double g_RefProto8[80] =
+{
+     0.00000000E+00,  1.56575398E-04,  3.43256425E-04,  5.54620202E-04,
+     8.23919506E-04,  1.13992507E-03,  1.47640169E-03,  1.78371725E-03,
+     2.01182542E-03,  2.10371989E-03,  1.99454554E-03,  1.61656283E-03,
+     9.02154502E-04, -1.78805361E-04, -1.64973098E-03, -3.49717454E-03,
+     5.65949473E-03,  8.02941163E-03,  1.04584443E-02,  1.27472335E-02,
+     1.46525263E-02,  1.59045603E-02,  1.62208471E-02,  1.53184106E-02,
+     1.29371806E-02,  8.85757540E-03,  2.92408442E-03, -4.91578024E-03,
+    -1.46404076E-02, -2.61098752E-02, -3.90751381E-02, -5.31873032E-02,
+     6.79989431E-02,  8.29847578E-02,  9.75753918E-02,  1.11196689E-01,
+     1.23264548E-01,  1.33264415E-01,  1.40753505E-01,  1.45389847E-01,
+     1.46955068E-01,  1.45389847E-01,  1.40753505E-01,  1.33264415E-01,
+     1.23264548E-01,  1.11196689E-01,  9.75753918E-02,  8.29847578E-02,
+    -6.79989431E-02, -5.31873032E-02, -3.90751381E-02, -2.61098752E-02,
+    -1.46404076E-02, -4.91578024E-03,  2.92408442E-03,  8.85757540E-03,
+     1.29371806E-02,  1.53184106E-02,  1.62208471E-02,  1.59045603E-02,
+     1.46525263E-02,  1.27472335E-02,  1.04584443E-02,  8.02941163E-03,
+    -5.65949473E-03, -3.49717454E-03, -1.64973098E-03, -1.78805361E-04,
+     9.02154502E-04,  1.61656283E-03,  1.99454554E-03,  2.10371989E-03,
+     2.01182542E-03,  1.78371725E-03,  1.47640169E-03,  1.13992507E-03,
+     8.23919506E-04,  5.54620202E-04,  3.43256425E-04,  1.56575398E-04,
+};
+
+//
+// Loudness offsets for 8 subbands (table 12.20), 16, 32, 44.1, 48 kHz.
+//
+static const int g_RefOffset8[4][8] =
+{
+    { -2, 0, 0, 0, 0, 0, 0, 1 },
+    { -3, 0, 0, 0, 0, 0, 1, 2 },
+    { -4, 0, 0, 0, 0, 0, 1, 2 },
+    { -4, 0, 0, 0, 0, 0, 1, 2 },
+};
+
+enum
+{
+    REF_MONO,
+    REF_DUAL_CHANNEL,
+    REF_STEREO,
+    REF_JOINT_STEREO,
+};
+
+enum
+{
+    REF_LOUDNESS,
+    REF_SNR,
+};
+
+typedef struct REF_SBC_PARAMS
+{
+    int     iFrequency;         // 0..3: 16, 32, 44.1, 48 kHz
+    int     iBlocks;
+    int     iChannelMode;
+    int     iAllocation;
+    int     iBitpool;
+} REF_SBC_PARAMS;
+
+static const REF_SBC_PARAMS c_MsbcParams = { 0, 15, REF_MONO, REF_LOUDNESS, 26 };
+
+static int RefChannels(const REF_SBC_PARAMS& params)
+{
+    return params.iChannelMode == REF_MONO ? 1 : 2;
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Bit allocation, section 12.6.3, for one channel (mono and dual channel)
+//  or both channels together (stereo and joint stereo).
+//
+static void RefAllocate(
+    const REF_SBC_PARAMS& params,
+    const int aScf[2][8],
+    int aBits[2][8])
+{
+    int cChannels = RefChannels(params);
+    bool fShared = params.iChannelMode == REF_STEREO || params.iChannelMode == REF_JOINT_STEREO;
+    int cPasses = fShared ? 1 : cChannels;
+
+    for (int pass = 0; pass < cPasses; pass++)
+    {
+        int chFirst = fShared ? 0 : pass;
+        int chLast = fShared ? cChannels - 1 : pass;
+        int bitneed[2][8];
+        int maxBitneed = 0;
+
+        for (int ch = chFirst; ch <= chLast; ch++)
+        {
+            for (int sb = 0; sb < 8; sb++)
+            {
+                if (params.iAllocation == REF_SNR)
+                {
+                    bitneed[ch][sb] = aScf[ch][sb];
+                }
+                else if (aScf[ch][sb] == 0)
+                {
+                    bitneed[ch][sb] = -5;
+                }
+                else
+                {
+                    int loudness = aScf[ch][sb] - g_RefOffset8[params.iFrequency][sb];
+                    bitneed[ch][sb] = loudness > 0 ? loudness / 2 : loudness;
+                }
+
+                if (bitneed[ch][sb] > maxBitneed)
+                {
+                    maxBitneed = bitneed[ch][sb];
+                }
+            }
+        }
+
+        int bitcount = 0;
+        int slicecount = 0;
+        int bitslice = maxBitneed + 1;
+
+        do
+        {
+            bitslice--;
+            bitcount += slicecount;
+            slicecount = 0;
+            for (int ch = chFirst; ch <= chLast; ch++)
+            {
+                for (int sb = 0; sb < 8; sb++)
+                {
+                    if (bitneed[ch][sb] > bitslice + 1 && bitneed[ch][sb] < bitslice + 16)
+                    {
+                        slicecount++;
+                    }
+                    else if (bitneed[ch][sb] == bitslice + 1)
+                    {
+                        slicecount += 2;
+                    }
+                }
+            }
+        } while (bitcount + slicecount < params.iBitpool);
+
+        if (bitcount + slicecount == params.iBitpool)
+        {
+            bitcount += slicecount;
+            bitslice--;
+        }
+
+        for (int ch = chFirst; ch <= chLast; ch++)
+        {
+            for (int sb = 0; sb < 8; sb++)
+            {
+                if (bitneed[ch][sb] < bitslice + 2)
+                {
+                    aBits[ch][sb] = 0;
+                }
+                else
+                {
+                    aBits[ch][sb] = bitneed[ch][sb] - bitslice < 16 ? bitneed[ch][sb] - bitslice : 16;
+                }
+            }
+        }
+
+        int ch = chFirst;
+        int sb = 0;
+        while (bitcount < params.iBitpool && sb < 8)
+        {
+            if (aBits[ch][sb] >= 2 && aBits[ch][sb] < 16)
+            {
+                aBits[ch][sb]++;
+                bitcount++;
+            }
+            else if (bitneed[ch][sb] == bitslice + 1 && params.iBitpool > bitcount + 1)
+            {
+                aBits[ch][sb] = 2;
+                bitcount += 2;
+            }
+
+            if (ch < chLast)
+            {
+                ch++;
+            }
+            else
+            {
+                ch = chFirst;
+                sb++;
+            }
+        }
+
+        ch = chFirst;
+        sb = 0;
+        while (bitcount < params.iBitpool && sb < 8)
+        {
+            if (aBits[ch][sb] < 16)
+            {
+                aBits[ch][sb]++;
+                bitcount++;
+            }
+
+            if (ch < chLast)
+            {
+                ch++;
+            }
+            else
+            {
+                ch = chFirst;
+                sb++;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  The frame check, section 12.6.4: CRC-8 with generator
+//  x^8 + x^4 + x^3 + x^2 + 1 and initial value 0x0F over the listed bits.
+//
+static uint8_t RefCrc8(const std::vector<int>& bits)
+{
+    unsigned crc = 0x0F;
+
+    for (int bit : bits)
+    {
+        unsigned top = (crc >> 7) & 1;
+
+        crc = (crc << 1) & 0xFF;
+        if (top ^ (unsigned)bit)
+        {
+            crc ^= 0x1D;
+        }
+    }
+
+    return (uint8_t)crc;
+}
+
+static void AppendBits(std::vector<int> *pBits, unsigned value, int cBits)
+{
+    for (int i = cBits - 1; i >= 0; i--)
+    {
+        pBits->push_back((value >> i) & 1);
+    }
+}
+
+class CRefBitReader
+{
+public:
+    CRefBitReader(const BYTE *pbData, size_t cbData) : m_pbData(pbData), m_cBits(cbData * 8), m_iBit(0) {}
+
+    unsigned Read(int cBits)
+    {
+        unsigned value = 0;
+
+        while (cBits-- > 0)
+        {
+            unsigned bit = 0;
+            if (m_iBit < m_cBits)
+            {
+                bit = (m_pbData[m_iBit / 8] >> (7 - m_iBit % 8)) & 1;
+            }
+            m_iBit++;
+            value = (value << 1) | bit;
+        }
+
+        return value;
+    }
+
+    size_t Position() const { return m_iBit; }
+    bool Overrun() const { return m_iBit > m_cBits; }
+
+private:
+    const BYTE *    m_pbData;
+    size_t          m_cBits;
+    size_t          m_iBit;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Synthesis filterbank, figure 12.3 and section 12.8, one channel.
+//
+class CRefSynthesis
+{
+public:
+    CRefSynthesis() { memset(m_V, 0, sizeof(m_V)); }
+
+    void Synthesize(const double aSubbands[8], double aOut[8])
+    {
+        double U[80];
+
+        memmove(&m_V[16], &m_V[0], 144 * sizeof(double));
+        for (int k = 0; k < 16; k++)
+        {
+            m_V[k] = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                m_V[k] += cos((i + 0.5) * (k + 4) * c_Pi / 8) * aSubbands[i];
+            }
+        }
+
+        for (int i = 0; i < 5; i++)
+        {
+            for (int j = 0; j < 8; j++)
+            {
+                U[i * 16 + j] = m_V[i * 32 + j];
+                U[i * 16 + 8 + j] = m_V[i * 32 + 24 + j];
+            }
+        }
+
+        for (int j = 0; j < 8; j++)
+        {
+            aOut[j] = 0;
+            for (int i = 0; i < 10; i++)
+            {
+                aOut[j] += U[j + 8 * i] * g_RefProto8[j + 8 * i] * -8;
+            }
+        }
+    }
+
+private:
+    double m_V[160];
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Analysis filterbank, figure 12.5 and section 12.5, one channel.
+//
+class CRefAnalysis
+{
+public:
+    CRefAnalysis() { memset(m_X, 0, sizeof(m_X)); }
+
+    void Analyze(const double aIn[8], double aSubbands[8])
+    {
+        double Y[16];
+
+        memmove(&m_X[8], &m_X[0], 72 * sizeof(double));
+        for (int i = 0; i < 8; i++)
+        {
+            m_X[i] = aIn[7 - i];
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            Y[i] = 0;
+            for (int j = 0; j < 5; j++)
+            {
+                Y[i] += g_RefProto8[i + 16 * j] * m_X[i + 16 * j];
+            }
+        }
+
+        for (int k = 0; k < 8; k++)
+        {
+            aSubbands[k] = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                aSubbands[k] += cos((k + 0.5) * (i - 4) * c_Pi / 8) * Y[i];
+            }
+        }
+    }
+
+private:
+    double m_X[80];
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Audio data of a frame, section 12.6.5: from the scale factors on, with
+//  the header fields already read. Adds the scale factor bits to pCrcBits
+//  and writes iBlocks * 8 samples per channel, interleaved, to pOut.
+//
+static void RefDecodeAudio(
+    const REF_SBC_PARAMS& params,
+    CRefBitReader *pReader,
+    std::vector<int> *pCrcBits,
+    CRefSynthesis aSynthesis[2],
+    double *pOut)
+{
+    int cChannels = RefChannels(params);
+    unsigned join = 0;
+    int aScf[2][8];
+    int aBits[2][8];
+
+    if (params.iChannelMode == REF_JOINT_STEREO)
+    {
+        join = pReader->Read(8);
+        AppendBits(pCrcBits, join, 8);
+    }
+
+    for (int ch = 0; ch < cChannels; ch++)
+    {
+        for (int sb = 0; sb < 8; sb++)
+        {
+            aScf[ch][sb] = (int)pReader->Read(4);
+            AppendBits(pCrcBits, aScf[ch][sb], 4);
+        }
+    }
+
+    RefAllocate(params, aScf, aBits);
+
+    for (int blk = 0; blk < params.iBlocks; blk++)
+    {
+        double sb[2][8];
+
+        for (int ch = 0; ch < cChannels; ch++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                if (aBits[ch][k] == 0)
+                {
+                    sb[ch][k] = 0;
+                }
+                else
+                {
+                    double levels = (1 << aBits[ch][k]) - 1;
+                    double scale = pow(2.0, aScf[ch][k] + 1);
+                    unsigned q = pReader->Read(aBits[ch][k]);
+
+                    sb[ch][k] = scale * ((2 * q + 1) / levels - 1);
+                }
+            }
+        }
+
+        for (int k = 0; k < 8; k++)
+        {
+            if (join & (0x80 >> k))
+            {
+                double m = sb[0][k];
+                double s = sb[1][k];
+                sb[0][k] = m + s;
+                sb[1][k] = m - s;
+            }
+        }
+
+        for (int ch = 0; ch < cChannels; ch++)
+        {
+            double out[8];
+
+            aSynthesis[ch].Synthesize(sb[ch], out);
+            for (int j = 0; j < 8; j++)
+            {
+                pOut[(blk * 8 + j) * cChannels + ch] = out[j];
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Scale factors and quantized samples of a frame, section 12.6. The
+//  scale factor is the smallest 2^(scf + 1) above the subband's peak, the
+//  sample code floor((s / 2^(scf + 1) + 1) * (2^bits - 1) / 2). Joint
+//  stereo codes a subband as mid and side when that lowers its scale
+//  factors.
+//
+static void RefEncodeAudio(
+    const REF_SBC_PARAMS& params,
+    CRefAnalysis aAnalysis[2],
+    const INT16 *pIn,
+    std::vector<int> *pCrcBits,
+    std::vector<int> *pAudioBits)
+{
+    int cChannels = RefChannels(params);
+    std::vector<double> subbands(params.iBlocks * 2 * 8);
+    int aScf[2][8];
+    int aBits[2][8];
+    unsigned join = 0;
+
+    auto S = [&](int blk, int ch, int k) -> double& { return subbands[(blk * 2 + ch) * 8 + k]; };
+
+    for (int blk = 0; blk < params.iBlocks; blk++)
+    {
+        for (int ch = 0; ch < cChannels; ch++)
+        {
+            double in[8];
+
+            for (int j = 0; j < 8; j++)
+            {
+                in[j] = pIn[(blk * 8 + j) * cChannels + ch];
+            }
+            aAnalysis[ch].Analyze(in, &S(blk, ch, 0));
+        }
+    }
+
+    auto ScaleFactor = [&](int ch, int k, bool fMidSide) -> int
+    {
+        double peak = 0;
+
+        for (int blk = 0; blk < params.iBlocks; blk++)
+        {
+            double s = S(blk, ch, k);
+            if (fMidSide)
+            {
+                s = (S(blk, 0, k) + (ch == 0 ? 1 : -1) * S(blk, 1, k)) / 2;
+            }
+            peak = fabs(s) > peak ? fabs(s) : peak;
+        }
+
+        int scf = 0;
+        while (scf < 15 && peak >= pow(2.0, scf + 1))
+        {
+            scf++;
+        }
+        return scf;
+    };
+
+    for (int k = 0; k < 8; k++)
+    {
+        for (int ch = 0; ch < cChannels; ch++)
+        {
+            aScf[ch][k] = ScaleFactor(ch, k, false);
+        }
+
+        if (params.iChannelMode == REF_JOINT_STEREO && k < 7)
+        {
+            int mid = ScaleFactor(0, k, true);
+            int side = ScaleFactor(1, k, true);
+
+            if (mid + side < aScf[0][k] + aScf[1][k])
+            {
+                join |= 0x80 >> k;
+                for (int blk = 0; blk < params.iBlocks; blk++)
+                {
+                    double l = S(blk, 0, k);
+                    double r = S(blk, 1, k);
+                    S(blk, 0, k) = (l + r) / 2;
+                    S(blk, 1, k) = (l - r) / 2;
+                }
+                aScf[0][k] = mid;
+                aScf[1][k] = side;
+            }
+        }
+    }
+
+    if (params.iChannelMode == REF_JOINT_STEREO)
+    {
+        AppendBits(pCrcBits, join, 8);
+        AppendBits(pAudioBits, join, 8);
+    }
+
+    for (int ch = 0; ch < cChannels; ch++)
+    {
+        for (int k = 0; k < 8; k++)
+        {
+            AppendBits(pCrcBits, aScf[ch][k], 4);
+            AppendBits(pAudioBits, aScf[ch][k], 4);
+        }
+    }
+
+    RefAllocate(params, aScf, aBits);
+
+    for (int blk = 0; blk < params.iBlocks; blk++)
+    {
+        for (int ch = 0; ch < cChannels; ch++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                if (aBits[ch][k] != 0)
+                {
+                    double levels = (1 << aBits[ch][k]) - 1;
+                    double scale = pow(2.0, aScf[ch][k] + 1);
+                    int q = (int)floor((S(blk, ch, k) / scale + 1) * levels / 2);
+
+                    q = q < 0 ? 0 : (q > (int)levels - 1 ? (int)levels - 1 : q);
+                    AppendBits(pAudioBits, (unsigned)q, aBits[ch][k]);
+                }
+            }
+        }
+    }
+}
+
+static void PackBits(const std::vector<int>& bits, BYTE *pbOut, size_t cbOut)
+{
+    memset(pbOut, 0, cbOut);
+    for (size_t i = 0; i < bits.size() && i < cbOut * 8; i++)
+    {
+        pbOut[i / 8] |= (BYTE)(bits[i] << (7 - i % 8));
+    }
+}
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  mSBC frame, HFP specification section 5.7.4: syncword 0xAD, two
+//  reserved bytes that are zero, the CRC, then the audio data of a 16 kHz
+//  mono loudness frame of 15 blocks at bitpool 26, 57 bytes in all.
+//
+static bool RefDecodeMsbc(CRefSynthesis *pSynthesis, const BYTE *pbFrame, double aOut[120])
+{
+    CRefBitReader reader(pbFrame, 57);
+    std::vector<int> crcBits;
+
+    if (reader.Read(8) != 0xAD)
+    {
+        return false;
+    }
+
+    unsigned reserved = reader.Read(16);
+    unsigned crc = reader.Read(8);
+
+    if (reserved != 0)
+    {
+        return false;
+    }
+
+    AppendBits(&crcBits, reserved, 16);
+    RefDecodeAudio(c_MsbcParams, &reader, &crcBits, pSynthesis, aOut);
+
+    return RefCrc8(crcBits) == crc && !reader.Overrun();
+}
+
+static void RefEncodeMsbc(CRefAnalysis *pAnalysis, const INT16 aIn[120], BYTE abFrame[57])
+{
+    std::vector<int> crcBits;
+    std::vector<int> audioBits;
+    std::vector<int> frame;
+
+    AppendBits(&crcBits, 0, 16);
+    RefEncodeAudio(c_MsbcParams, pAnalysis, aIn, &crcBits, &audioBits);
+
+    AppendBits(&frame, 0xAD, 8);
+    AppendBits(&frame, 0, 16);
+    AppendBits(&frame, RefCrc8(crcBits), 8);
+    frame.insert(frame.end(), audioBits.begin(), audioBits.end());
+
+    PackBits(frame, abFrame, 57);
+}
+
+//=========================================================================
+// Reference CVSD, Bluetooth Core specification vol 2 part B 9.2, on the
+// 64 kHz bit stream, with its own 8x interpolation and decimation.
+//
+
+typedef struct REF_CVSD
+{
+    double  dEstimate;      // x^(k)
+    double  dStep;          // delta(k)
+    unsigned uRun;          // last J = 4 bits
+} REF_CVSD;
+
+static void RefCvsdInit(REF_CVSD *pState)
+{
+    pState->dEstimate = 0;
+    pState->dStep = 10;     // delta min
+    pState->uRun = 0;
+}
+
+static double RefCvsdBit(REF_CVSD *pState, unsigned bit)
+{
+    const double h = 1 - 1.0 / 32;
+    const double beta = 1 - 1.0 / 1024;
+
+    pState->uRun = ((pState->uRun << 1) | bit) & 0xF;
+
+    if (pState->uRun == 0 || pState->uRun == 0xF)
+    {
+        pState->dStep = pState->dStep + 10 < 1280 ? pState->dStep + 10 : 1280;
+    }
+    else
+    {
+        pState->dStep = beta * pState->dStep > 10 ? beta * pState->dStep : 10;
+    }
+
+    double y = pState->dEstimate + (bit ? pState->dStep : -pState->dStep);
+    y = y > 32767 ? 32767 : (y < -32768 ? -32768 : y);
+
+    pState->dEstimate = h * y;
+    return pState->dEstimate;
+}
+
+//
+// 4 kHz low pass at 64 kHz, 255 taps, Blackman window, unity DC gain.
+//
+static std::vector<double> RefLowpass()
+{
+    const int cTaps = 255;
+    const double fc = 3800.0 / 64000;
+    std::vector<double> taps(cTaps);
+    double sum = 0;
+
+    for (int i = 0; i < cTaps; i++)
+    {
+        double n = i - (cTaps - 1) / 2.0;
+        double sinc = n == 0 ? 2 * fc : sin(2 * c_Pi * fc * n) / (c_Pi * n);
+        double window = 0.42 - 0.5 * cos(2 * c_Pi * i / (cTaps - 1)) + 0.08 * cos(4 * c_Pi * i / (cTaps - 1));
+
+        taps[i] = sinc * window;
+        sum += taps[i];
+    }
+
+    for (double& tap : taps)
+    {
+        tap /= sum;
+    }
+
+    return taps;
+}
+
+static std::vector<double> RefCvsdDecode(const std::vector<BYTE>& bits)
+{
+    std::vector<double> taps = RefLowpass();
+    std::vector<double> estimates;
+    std::vector<double> out;
+    REF_CVSD state;
+
+    RefCvsdInit(&state);
+    for (BYTE byte : bits)
+    {
+        for (int p = 0; p < 8; p++)
+        {
+            estimates.push_back(RefCvsdBit(&state, (byte >> p) & 1));
+        }
+    }
+
+    for (size_t n = 0; n < bits.size(); n++)
+    {
+        double y = 0;
+
+        for (size_t i = 0; i < taps.size(); i++)
+        {
+            size_t k = n * 8 + 7;
+            if (k >= i)
+            {
+                y += taps[i] * estimates[k - i];
+            }
+        }
+        out.push_back(y);
+    }
+
+    return out;
+}
+
+static std::vector<BYTE> RefCvsdEncode(const std::vector<INT16>& pcm)
+{
+    std::vector<double> taps = RefLowpass();
+    std::vector<BYTE> bits(pcm.size());
+    REF_CVSD state;
+
+    RefCvsdInit(&state);
+    for (size_t n = 0; n < pcm.size(); n++)
+    {
+        BYTE byte = 0;
+
+        for (int p = 0; p < 8; p++)
+        {
+            size_t k = n * 8 + p;
+            double x = 0;
+
+            // zero stuffing: only every eighth input is non-zero
+            for (size_t i = p; i < taps.size() && i <= k; i += 8)
+            {
+                x += 8 * taps[i] * pcm[(k - i) / 8];
+            }
+
+            unsigned bit = x >= state.dEstimate ? 1 : 0;
+            byte |= (BYTE)(bit << p);
+            RefCvsdBit(&state, bit);
+        }
+
+        bits[n] = byte;
+    }
+
+    return bits;
+}
+
+//=========================================================================
+// Tests.
+//
+
+//
+// The silent mSBC frame Bluetooth stacks use to fill the link.
+//
+static const BYTE c_abMsbcZeroFrame[MSBC_FRAME_BYTES] =
+{
+    0xAD, 0x00, 0x00, 0xC5, 0x00, 0x00, 0x00, 0x00, 0x77, 0x6D, 0xB6, 0xDD,
+    0xDB, 0x6D, 0xB7, 0x76, 0xDB, 0x6D, 0xDD, 0xB6, 0xDB, 0x77, 0x6D, 0xB6,
+    0xDD, 0xDB, 0x6D, 0xB7, 0x76, 0xDB, 0x6D, 0xDD, 0xB6, 0xDB, 0x77, 0x6D,
+    0xB6, 0xDD, 0xDB, 0x6D, 0xB7, 0x76, 0xDB, 0x6D, 0xDD, 0xB6, 0xDB, 0x77,
+    0x6D, 0xB6, 0xDD, 0xDB, 0x6D, 0xB7, 0x76, 0xDB, 0x6C,
+};
+
+static void TestMsbcKnownAnswer()
+{
+    SBC_ANALYSIS_STATE analysis = {};
+    SBC_SYNTHESIS_STATE synthesis = {};
+    CRefSynthesis refSynthesis;
+    INT16 silence[MSBC_SAMPLES] = {};
+    INT16 decoded[MSBC_SAMPLES];
+    double refDecoded[MSBC_SAMPLES];
+    BYTE frame[MSBC_FRAME_BYTES];
+
+    MsbcEncodeFrame(&analysis, silence, frame);
+    CHECK(memcmp(frame, c_abMsbcZeroFrame, sizeof(frame)) == 0, "silence does not encode to the zero frame");
+
+    CHECK(RefDecodeMsbc(&refSynthesis, c_abMsbcZeroFrame, refDecoded), "reference rejects the zero frame");
+    CHECK(MsbcDecodeFrame(&synthesis, c_abMsbcZeroFrame, decoded), "driver rejects the zero frame");
+
+    for (int i = 0; i < MSBC_SAMPLES; i++)
+    {
+        CHECK(fabs(refDecoded[i]) < 1 && abs(decoded[i]) <= 1, "zero frame sample %d decodes to %g / %d", i, refDecoded[i], decoded[i]);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Every packet of the encode stage: the H2 header and its sequence, the
+// mSBC frame header with a CRC computed here, the pad byte.
+//
+static void TestMsbcPacketSyntax()
+{
+    static const BYTE abSequence[4] = { 0x08, 0x38, 0xC8, 0xF8 };
+    std::vector<INT16> speech = MakeSignal(SIGNAL_SPEECH, 16000, 16000);
+    HFP_CODEC_STAGE stage;
+    CRefSynthesis refSynthesis;
+
+    HfpCodecInit(&stage, 16000);
+    CHECK(stage.FrameSamples == MSBC_SAMPLES, "mSBC frame of %u samples", stage.FrameSamples);
+
+    for (size_t f = 0; (f + 1) * MSBC_SAMPLES <= speech.size(); f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+        double out[MSBC_SAMPLES];
+        std::vector<int> crcBits;
+
+        HfpCodecEncodePacket(&stage, &speech[f * MSBC_SAMPLES], packet);
+
+        CHECK(packet[0] == 0x01 && packet[1] == abSequence[f % 4], "frame %zu: H2 header %02x %02x", f, packet[0], packet[1]);
+        CHECK(packet[2] == 0xAD && packet[3] == 0 && packet[4] == 0, "frame %zu: mSBC header %02x %02x %02x", f, packet[2], packet[3], packet[4]);
+        CHECK(packet[HFP_PACKET_BYTES - 1] == 0, "frame %zu: pad byte %02x", f, packet[HFP_PACKET_BYTES - 1]);
+
+        AppendBits(&crcBits, 0, 16);
+        for (int i = 0; i < 4; i++)
+        {
+            AppendBits(&crcBits, packet[6 + i], 8);
+        }
+        CHECK(RefCrc8(crcBits) == packet[5], "frame %zu: CRC %02x, expected %02x", f, packet[5], RefCrc8(crcBits));
+
+        CHECK(RefDecodeMsbc(&refSynthesis, &packet[2], out), "frame %zu: reference rejects the frame", f);
+    }
+}
+
+//-------------------------------------------------------------------------
+// The driver's mSBC encoder through the reference decoder, and the
+// reference encoder through the driver's decoder. The reference decodes
+// the same frames as the driver's decoder to within rounding.
+//
+static void TestMsbcConformance(SIGNAL eSignal, double dMinSnr)
+{
+    std::vector<INT16> in = MakeSignal(eSignal, 16000, 32000);
+    std::vector<double> refOut(in.size());
+    std::vector<double> driverOut(in.size());
+    std::vector<double> crossOut(in.size());
+    SBC_ANALYSIS_STATE analysis = {};
+    SBC_SYNTHESIS_STATE synthesis = {};
+    SBC_SYNTHESIS_STATE crossSynthesis = {};
+    CRefAnalysis refAnalysis;
+    CRefSynthesis refSynthesis;
+    double maxDiff = 0;
+
+    for (size_t f = 0; (f + 1) * MSBC_SAMPLES <= in.size(); f++)
+    {
+        BYTE frame[MSBC_FRAME_BYTES];
+        BYTE refFrame[MSBC_FRAME_BYTES];
+        INT16 pcm[MSBC_SAMPLES];
+
+        MsbcEncodeFrame(&analysis, &in[f * MSBC_SAMPLES], frame);
+        CHECK(RefDecodeMsbc(&refSynthesis, frame, &refOut[f * MSBC_SAMPLES]), "frame %zu: reference rejects the driver's frame", f);
+
+        // The driver's decoder on the same frames, to compare with the reference.
+        CHECK(MsbcDecodeFrame(&crossSynthesis, frame, pcm), "frame %zu: driver rejects its own frame", f);
+        for (int i = 0; i < MSBC_SAMPLES; i++)
+        {
+            double diff = fabs(pcm[i] - refOut[f * MSBC_SAMPLES + i]);
+            maxDiff = diff > maxDiff ? diff : maxDiff;
+        }
+
+        RefEncodeMsbc(&refAnalysis, &in[f * MSBC_SAMPLES], refFrame);
+        CHECK(MsbcDecodeFrame(&synthesis, refFrame, pcm), "frame %zu: driver rejects the reference frame", f);
+        for (int i = 0; i < MSBC_SAMPLES; i++)
+        {
+            driverOut[f * MSBC_SAMPLES + i] = pcm[i];
+        }
+    }
+
+    std::vector<double> ref = ToDouble(in);
+    uint32_t u32Delay = 0;
+    double encodeSnr = BestSnr(ref, refOut, 1600, 200, &u32Delay);
+    double decodeSnr = BestSnr(ref, driverOut, 1600, 200, NULL);
+
+    CHECK(encodeSnr >= dMinSnr, "driver mSBC encoder, reference decoder: %.1f dB", encodeSnr);
+    CHECK(decodeSnr >= dMinSnr, "reference mSBC encoder, driver decoder: %.1f dB", decodeSnr);
+    CHECK(u32Delay == 73, "mSBC codec delay of %u samples, expected 73", u32Delay);
+    CHECK(maxDiff <= 4, "driver and reference decoders differ by %.2f", maxDiff);
+}
+
+//-------------------------------------------------------------------------
+// A frame failing its CRC is concealed rather than decoded.
+//
+static void TestMsbcCorruptFrame()
+{
+    std::vector<INT16> tones = MakeSignal(SIGNAL_TONES, 16000, MSBC_SAMPLES * 8);
+    HFP_CODEC_STAGE encoder;
+    HFP_CODEC_STAGE decoder;
+    INT16 out[MSBC_SAMPLES];
+
+    HfpCodecInit(&encoder, 16000);
+    HfpCodecInit(&decoder, 16000);
+
+    for (int f = 0; f < 8; f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+
+        HfpCodecEncodePacket(&encoder, &tones[f * MSBC_SAMPLES], packet);
+        if (f == 6)
+        {
+            packet[6] ^= 0x10;      // a scale factor
+        }
+        HfpCodecDecodePacket(&decoder, packet, out);
+
+        CHECK((decoder.Plc.LostFrames != 0) == (f == 6), "frame %d: %u frames concealed", f, decoder.Plc.LostFrames);
+    }
+}
+
+//-------------------------------------------------------------------------
+// The CVSD accumulator and step size against the reference on a random
+// bit stream with runs long enough to reach the step size limits.
+//
+static void TestCvsdStep()
+{
+    CVSD_STATE state = {};
+    REF_CVSD ref;
+    double maxDiff = 0;
+    unsigned bit = 0;
+
+    state.Step = CVSD_STEP_MIN;
+    RefCvsdInit(&ref);
+
+    for (int k = 0; k < 64000 * 4; k++)
+    {
+        if (Random() % 100 < ((k / 16000) % 2 ? 40 : 8))
+        {
+            bit ^= 1;
+        }
+
+        double expected = RefCvsdBit(&ref, bit);
+        double actual = (double)CvsdStep(&state, bit) / (1 << CVSD_FRAC);
+        double diff = fabs(expected - actual);
+
+        maxDiff = diff > maxDiff ? diff : maxDiff;
+    }
+
+    CHECK(maxDiff < 2, "CVSD accumulator off the reference by %.2f", maxDiff);
+}
+
+//-------------------------------------------------------------------------
+// Idle channel and slope overload: silence encodes to alternating bits,
+// a full scale level to a run of ones (or zeros).
+//
+static void TestCvsdKnownAnswer()
+{
+    const INT16 aLevels[3] = { 0, 32767, -32768 };
+    const BYTE abExpected[3] = { 0x55, 0xFF, 0x00 };
+
+    for (int i = 0; i < 3; i++)
+    {
+        CVSD_STATE state = {};
+        INT16 pcm[CVSD_FRAME_SAMPLES];
+        BYTE packet[HFP_PACKET_BYTES];
+
+        state.Step = CVSD_STEP_MIN;
+        for (int n = 0; n < CVSD_FRAME_SAMPLES; n++)
+        {
+            pcm[n] = aLevels[i];
+        }
+
+        for (int f = 0; f < 20; f++)
+        {
+            CvsdEncodeFrame(&state, pcm, packet);
+        }
+
+        for (int n = 0; n < HFP_PACKET_BYTES; n++)
+        {
+            CHECK(packet[n] == abExpected[i], "level %d: byte %d is %02x", aLevels[i], n, packet[n]);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// The driver's CVSD encoder through the reference decoder, and the
+// reference encoder through the driver's decoder.
+//
+static void TestCvsdConformance(SIGNAL eSignal, double dMinSnr)
+{
+    std::vector<INT16> in = MakeSignal(eSignal, 8000, 16000);
+    std::vector<BYTE> driverBits;
+    std::vector<double> driverOut;
+    CVSD_STATE encoder = {};
+    CVSD_STATE decoder = {};
+
+    encoder.Step = CVSD_STEP_MIN;
+    decoder.Step = CVSD_STEP_MIN;
+
+    for (size_t f = 0; (f + 1) * CVSD_FRAME_SAMPLES <= in.size(); f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+
+        CvsdEncodeFrame(&encoder, &in[f * CVSD_FRAME_SAMPLES], packet);
+        driverBits.insert(driverBits.end(), packet, packet + HFP_PACKET_BYTES);
+    }
+
+    std::vector<BYTE> refBits = RefCvsdEncode(in);
+
+    for (size_t f = 0; (f + 1) * HFP_PACKET_BYTES <= refBits.size(); f++)
+    {
+        INT16 pcm[CVSD_FRAME_SAMPLES];
+
+        CvsdDecodeFrame(&decoder, &refBits[f * HFP_PACKET_BYTES], pcm);
+        driverOut.insert(driverOut.end(), pcm, pcm + CVSD_FRAME_SAMPLES);
+    }
+
+    std::vector<double> ref = ToDouble(in);
+    double encodeSnr = BestSnr(ref, RefCvsdDecode(driverBits), 800, 100, NULL);
+    double decodeSnr = BestSnr(ref, driverOut, 800, 100, NULL);
+
+    CHECK(encodeSnr >= dMinSnr, "driver CVSD encoder, reference decoder: %.1f dB", encodeSnr);
+    CHECK(decodeSnr >= dMinSnr, "reference CVSD encoder, driver decoder: %.1f dB", decodeSnr);
+}
+
+//-------------------------------------------------------------------------
+// The stream side: HfpCodecTransmit and HfpCodecReceive over a link that
+// loses packets, fed in DMA runs that do not line up with the frames.
+//
+typedef struct LOSSY_LINK
+{
+    std::vector<std::vector<BYTE>>  packets;
+    size_t                          next;
+    uint32_t                        u32LossPercent;
+    std::vector<bool>               lost;
+} LOSSY_LINK;
+
+static VOID LinkSend(PVOID Context, const BYTE *Packet)
+{
+    LOSSY_LINK *pLink = (LOSSY_LINK *)Context;
+
+    pLink->packets.push_back(std::vector<BYTE>(Packet, Packet + HFP_PACKET_BYTES));
+}
+
+static BOOLEAN LinkReceive(PVOID Context, BYTE *Packet)
+{
+    LOSSY_LINK *pLink = (LOSSY_LINK *)Context;
+    bool fLost = pLink->next >= pLink->packets.size() || Random() % 100 < pLink->u32LossPercent;
+
+    if (!fLost)
+    {
+        memcpy(Packet, pLink->packets[pLink->next].data(), HFP_PACKET_BYTES);
+    }
+    pLink->lost.push_back(fLost);
+    pLink->next++;
+
+    return fLost ? FALSE : TRUE;
+}
+
+static std::vector<double> RunLink(
+    uint32_t u32Rate,
+    const std::vector<INT16>& in,
+    uint32_t u32LossPercent,
+    LOSSY_LINK *pLink)
+{
+    const uint32_t au32Runs[] = { 1, 37, 160, 7, 96 };
+    HFP_CODEC_STAGE sender;
+    HFP_CODEC_STAGE receiver;
+    std::vector<INT16> out(in.size());
+    size_t offset = 0;
+
+    HfpCodecInit(&sender, u32Rate);
+    HfpCodecInit(&receiver, u32Rate);
+    pLink->packets.clear();
+    pLink->lost.clear();
+    pLink->next = 0;
+    pLink->u32LossPercent = u32LossPercent;
+
+    // Send everything first so the receiver never runs ahead of the link.
+    for (int r = 0; offset < in.size(); r++)
+    {
+        uint32_t run = (uint32_t)min((size_t)au32Runs[r % 5], in.size() - offset);
+
+        HfpCodecTransmit(&sender, &in[offset], run, LinkSend, pLink);
+        offset += run;
+    }
+
+    offset = 0;
+    for (int r = 0; offset < out.size(); r++)
+    {
+        uint32_t run = (uint32_t)min((size_t)au32Runs[(r + 2) % 5], out.size() - offset);
+
+        HfpCodecReceive(&receiver, &out[offset], run, LinkReceive, pLink);
+        offset += run;
+    }
+
+    CHECK(receiver.LostPackets == (uint32_t)std::count(pLink->lost.begin(), pLink->lost.end(), true),
+          "%u packets counted lost", receiver.LostPackets);
+
+    return std::vector<double>(out.begin(), out.end());
+}
+
+static void TestStreamLink(uint32_t u32Rate)
+{
+    uint32_t u32Frame = u32Rate == 8000 ? CVSD_FRAME_SAMPLES : MSBC_SAMPLES;
+    std::vector<INT16> in = MakeSignal(SIGNAL_SPEECH, u32Rate, u32Rate * 2 / u32Frame * u32Frame);
+    LOSSY_LINK link;
+
+    //
+    // Without loss the stream matches frame by frame encode and decode.
+    //
+    std::vector<double> out = RunLink(u32Rate, in, 0, &link);
+    HFP_CODEC_STAGE encoder;
+    HFP_CODEC_STAGE decoder;
+    bool fSame = true;
+
+    HfpCodecInit(&encoder, u32Rate);
+    HfpCodecInit(&decoder, u32Rate);
+    CHECK(link.packets.size() == in.size() / u32Frame, "%zu packets sent", link.packets.size());
+
+    for (size_t f = 0; f < link.packets.size(); f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+        INT16 pcm[HFP_MAX_FRAME_SAMPLES];
+
+        HfpCodecEncodePacket(&encoder, &in[f * u32Frame], packet);
+        HfpCodecDecodePacket(&decoder, packet, pcm);
+        fSame = fSame && memcmp(packet, link.packets[f].data(), HFP_PACKET_BYTES) == 0;
+        for (uint32_t i = 0; i < u32Frame; i++)
+        {
+            fSame = fSame && pcm[i] == out[f * u32Frame + i];
+        }
+    }
+    CHECK(fSame, "%u Hz: streamed packets or audio differ from the frame API", u32Rate);
+
+    //
+    // With 10% loss, concealment beats leaving the lost frames silent.
+    //
+    std::vector<double> concealed = RunLink(u32Rate, in, 10, &link);
+    std::vector<double> muted(in.size(), 0.0);
+    HFP_CODEC_STAGE bare;
+
+    // the same packets through the bare decoders, lost frames left silent
+    HfpCodecInit(&bare, u32Rate);
+    for (size_t f = 0; f < link.packets.size(); f++)
+    {
+        INT16 pcm[HFP_MAX_FRAME_SAMPLES];
+
+        if (link.lost[f])
+        {
+            continue;
+        }
+
+        if (u32Rate == 8000)
+        {
+            CvsdDecodeFrame(&bare.CvsdDecoder, link.packets[f].data(), pcm);
+        }
+        else
+        {
+            MsbcDecodeFrame(&bare.SbcSynthesis, &link.packets[f][MSBC_H2_BYTES], pcm);
+        }
+        std::copy(pcm, pcm + u32Frame, muted.begin() + f * u32Frame);
+    }
+
+    std::vector<double> ref = ToDouble(in);
+    uint32_t u32Delay = 0;
+    BestSnr(ref, out, u32Rate / 10, 200, &u32Delay);
+
+    double concealedSnr = BestSnr(ref, concealed, u32Rate / 10, u32Delay, NULL);
+    double mutedSnr = BestSnr(ref, muted, u32Rate / 10, u32Delay, NULL);
+
+    CHECK(concealedSnr > mutedSnr + 1.5, "%u Hz: concealed %.1f dB, muted %.1f dB", u32Rate, concealedSnr, mutedSnr);
+}
+
+//-------------------------------------------------------------------------
+// Concealment of a steady voiced sound: the first lost frame repeats the
+// pitch period, a long loss fades to silence, and the first good frame
+// after it joins without a step.
+//
+static void TestPlc()
+{
+    const uint32_t u32Rate = 16000;
+    HFP_CODEC_STAGE encoder;
+    HFP_CODEC_STAGE decoder;
+    std::vector<INT16> in(MSBC_SAMPLES * 40);
+    std::vector<INT16> out(in.size());
+
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        double t = (double)i / u32Rate;
+        in[i] = (INT16)lrint(6000 * sin(2 * c_Pi * 200 * t) + 3000 * sin(2 * c_Pi * 400 * t + 1));
+    }
+
+    HfpCodecInit(&encoder, u32Rate);
+    HfpCodecInit(&decoder, u32Rate);
+
+    for (int f = 0; f < 40; f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+        bool fLost = (f >= 20 && f < 20 + HFP_PLC_MUTE_FRAMES + 2);
+
+        HfpCodecEncodePacket(&encoder, &in[f * MSBC_SAMPLES], packet);
+        HfpCodecDecodePacket(&decoder, fLost ? NULL : packet, &out[f * MSBC_SAMPLES]);
+    }
+
+    //
+    // The decoded audio lags the input by the codec delay; compare the
+    // first concealed frame with what the decoder would have produced.
+    //
+    HFP_CODEC_STAGE clean;
+    std::vector<INT16> reference(in.size());
+
+    HfpCodecInit(&encoder, u32Rate);
+    HfpCodecInit(&clean, u32Rate);
+    for (int f = 0; f < 40; f++)
+    {
+        BYTE packet[HFP_PACKET_BYTES];
+
+        HfpCodecEncodePacket(&encoder, &in[f * MSBC_SAMPLES], packet);
+        HfpCodecDecodePacket(&clean, packet, &reference[f * MSBC_SAMPLES]);
+    }
+
+    double signal = 0;
+    double noise = 1e-9;
+    for (int i = 0; i < MSBC_SAMPLES / 2; i++)
+    {
+        double x = reference[20 * MSBC_SAMPLES + i];
+        double e = x - out[20 * MSBC_SAMPLES + i];
+        signal += x * x;
+        noise += e * e;
+    }
+    CHECK(10 * log10(signal / noise) > 10, "first concealed half frame at %.1f dB", 10 * log10(signal / noise));
+
+    for (int i = 0; i < MSBC_SAMPLES; i++)
+    {
+        int16_t sample = out[(20 + HFP_PLC_MUTE_FRAMES) * MSBC_SAMPLES + i];
+        CHECK(sample == 0, "sample %d after %d lost frames is %d", i, HFP_PLC_MUTE_FRAMES, sample);
+    }
+
+    //
+    // Recovery fades in from silence: no jump bigger than the signal's own
+    // largest step.
+    //
+    int maxStep = 0;
+    for (size_t i = 1; i < reference.size(); i++)
+    {
+        maxStep = max(maxStep, abs(reference[i] - reference[i - 1]));
+    }
+
+    size_t recover = (20 + HFP_PLC_MUTE_FRAMES + 2) * MSBC_SAMPLES;
+    for (size_t i = recover - 1; i < recover + MSBC_SAMPLES; i++)
+    {
+        CHECK(abs(out[i + 1] - out[i]) <= maxStep, "step of %d at sample %zu", abs(out[i + 1] - out[i]), i);
+    }
+}
+
+int main()
+{
+    TestMsbcKnownAnswer();
+    TestMsbcPacketSyntax();
+    TestMsbcConformance(SIGNAL_TONES, 50);
+    TestMsbcConformance(SIGNAL_SPEECH, 25);
+    TestMsbcCorruptFrame();
+
+    TestCvsdStep();
+    TestCvsdKnownAnswer();
+    TestCvsdConformance(SIGNAL_TONES, 22);
+    TestCvsdConformance(SIGNAL_SPEECH, 13);
+
+    TestStreamLink(8000);
+    TestStreamLink(16000);
+    TestPlc();
+
+    printf("Bluetooth codecs: %u checks, %u failures\n", g_cChecks, g_cFailures);
+    return g_cFailures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+//
+// DelayBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Delay APO cost per period: the two-copy ProcessDelay the APO used to
+//   run against ApoDsp_Delay, for valid, in-place and silent input.
+//
+//   Both run on the same input and their outputs are compared, so the
+//   benchmark also fails if the two ever disagree. Memory traffic is
+//   counted from the passes each implementation makes over the buffers.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ApoDsp.h>
+
+#include "ApoHost.h"
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Delay.cpp ProcessDelay before the single-pass rewrite: delay => output,
+//  then input => delay, one block copy each. A silent input was zeroed by
+//  APOProcess first, and the output was never flagged silent.
+//
+static void ProcessDelayTwoCopy(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32SamplesPerFrame,
+    float *pf32DelayBuffer,
+    uint32_t u32DelayFrames,
+    uint32_t *pu32DelayIndex )
+{
+    while (u32ValidFrameCount > 0)
+    {
+        uint32_t framesToCopy = std::min(u32ValidFrameCount, u32DelayFrames - (*pu32DelayIndex));
+
+        // delay => output
+        ApoDsp_CopyFrames(pf32OutputFrames, &pf32DelayBuffer[(size_t)(*pu32DelayIndex) * u32SamplesPerFrame],
+                          framesToCopy, u32SamplesPerFrame);
+
+        // input => delay
+        ApoDsp_CopyFrames(&pf32DelayBuffer[(size_t)(*pu32DelayIndex) * u32SamplesPerFrame], pf32InputFrames,
+                          framesToCopy, u32SamplesPerFrame);
+
+        pf32OutputFrames += (size_t)framesToCopy * u32SamplesPerFrame;
+        pf32InputFrames += (size_t)framesToCopy * u32SamplesPerFrame;
+        u32ValidFrameCount -= framesToCopy;
+
+        *pu32DelayIndex += framesToCopy;
+        if (*pu32DelayIndex == u32DelayFrames)
+        {
+            *pu32DelayIndex = 0;
+        }
+    }
+}
+
+enum BENCH_INPUT
+{
+    INPUT_VALID,        // separate input and output connections
+    INPUT_IN_PLACE,     // output connection aliases the input
+    INPUT_SILENT        // BUFFER_SILENT input, after a full delay of silence
+};
+
+static const char *g_apszInput[] = { "valid", "in place", "silent" };
+
+typedef struct BENCH_RESULT
+{
+    APOHOST_STATS   Cycles;
+    uint64_t        u64BytesRead;       // per period
+    uint64_t        u64BytesWritten;    // per period
+} BENCH_RESULT;
+
+static bool RunBench(
+    BENCH_INPUT Input,
+    bool fSinglePass,
+    uint32_t u32FramesPerSecond,
+    uint32_t u32SamplesPerFrame,
+    uint32_t u32PeriodFrames,
+    uint32_t u32Periods,
+    std::vector<float> *pOutput,
+    BENCH_RESULT *pResult)
+{
+    // DelayAPO.h HNS_DELAY: one second
+    uint32_t u32DelayFrames = u32FramesPerSecond;
+    size_t cPeriodSamples = (size_t)u32PeriodFrames * u32SamplesPerFrame;
+    uint64_t cbPeriod = sizeof(float) * cPeriodSamples;
+
+    std::vector<float> DelayLine((size_t)u32DelayFrames * u32SamplesPerFrame, 0.0f);
+    std::vector<float> InBuffer(cPeriodSamples), OutBuffer(cPeriodSamples);
+    std::vector<uint64_t> Cycles(u32Periods);
+    uint32_t u32DelayIndex = 0;
+    uint32_t u32SilentFrames = u32DelayFrames;
+    uint32_t u32Seed = 0x2468ace0;
+
+    pOutput->assign(cPeriodSamples * u32Periods, 0.0f);
+    pResult->u64BytesRead = 0;
+    pResult->u64BytesWritten = 0;
+
+    for (uint32_t u32Period = 0; u32Period < u32Periods; u32Period++)
+    {
+        // the engine fills the input connection
+        for (float &f32Sample : InBuffer)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            f32Sample = (Input == INPUT_SILENT) ? 0.0f : (float)(int16_t)(u32Seed >> 16) / 32768.0f;
+        }
+
+        float *pf32In = InBuffer.data();
+        float *pf32Out = (Input == INPUT_IN_PLACE) ? pf32In : OutBuffer.data();
+        bool fOutputSilent = false;
+        uint64_t u64Start = ApoHost_ReadCycles();
+
+        if (fSinglePass)
+        {
+            fOutputSilent = ApoDsp_Delay(pf32Out, (Input == INPUT_SILENT) ? NULL : pf32In, u32PeriodFrames,
+                                         u32SamplesPerFrame, DelayLine.data(), u32DelayFrames,
+                                         &u32DelayIndex, &u32SilentFrames);
+        }
+        else
+        {
+            if (Input == INPUT_SILENT)
+            {
+                ApoDsp_WriteSilence(pf32In, u32PeriodFrames, u32SamplesPerFrame);
+            }
+            if (Input == INPUT_IN_PLACE)
+            {
+                // delay => output would overwrite the input before
+                // input => delay reads it, so the input needs a copy
+                ApoDsp_CopyFrames(OutBuffer.data(), pf32In, u32PeriodFrames, u32SamplesPerFrame);
+                pf32In = OutBuffer.data();
+            }
+            ProcessDelayTwoCopy(pf32Out, pf32In, u32PeriodFrames, u32SamplesPerFrame,
+                                DelayLine.data(), u32DelayFrames, &u32DelayIndex);
+        }
+
+        Cycles[u32Period] = ApoHost_ReadCycles() - u64Start;
+
+        // passes over period-sized buffers (input, output, delay line)
+        if (fSinglePass)
+        {
+            if (fOutputSilent)
+            {
+                // index only
+            }
+            else if (Input == INPUT_SILENT)
+            {
+                // delay => output, zero => delay
+                pResult->u64BytesRead += cbPeriod;
+                pResult->u64BytesWritten += 2 * cbPeriod;
+            }
+            else
+            {
+                // one fused pass: read input and delay, write output and delay
+                pResult->u64BytesRead += 2 * cbPeriod;
+                pResult->u64BytesWritten += 2 * cbPeriod;
+            }
+        }
+        else
+        {
+            uint64_t cPasses = (Input == INPUT_IN_PLACE) ? 3 : 2;
+            pResult->u64BytesRead += cPasses * cbPeriod;
+            pResult->u64BytesWritten += cPasses * cbPeriod + ((Input == INPUT_SILENT) ? cbPeriod : 0);
+        }
+
+        if (!fOutputSilent)
+        {
+            memcpy(&(*pOutput)[cPeriodSamples * u32Period], pf32Out, cbPeriod);
+        }
+    }
+
+    pResult->u64BytesRead /= u32Periods;
+    pResult->u64BytesWritten /= u32Periods;
+    ApoHost_Summarize(Cycles, &pResult->Cycles);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Periods = 3000;
+    if (argc > 2 && strcmp(argv[1], "--periods") == 0)
+    {
+        u32Periods = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    static const struct
+    {
+        uint32_t u32FramesPerSecond;
+        uint32_t u32SamplesPerFrame;
+    } aFormats[] = { { 48000, 2 }, { 48000, 8 }, { 192000, 2 } };
+
+    int iResult = 0;
+
+    printf("delay line of 1 s, 10 ms periods, %u periods; %s per period\n\n", u32Periods, ApoHost_CycleUnit());
+    printf("%-16s %-9s %-11s %10s %10s %10s %12s %12s\n",
+           "format", "input", "kernel", "median", "p99", "mean", "read B", "written B");
+
+    for (const auto &Format : aFormats)
+    {
+        uint32_t u32PeriodFrames = Format.u32FramesPerSecond / 100;
+
+        for (int iInput = INPUT_VALID; iInput <= INPUT_SILENT; iInput++)
+        {
+            std::vector<float> TwoCopyOutput, SinglePassOutput;
+            BENCH_RESULT TwoCopy, SinglePass;
+
+            RunBench((BENCH_INPUT)iInput, false, Format.u32FramesPerSecond, Format.u32SamplesPerFrame,
+                     u32PeriodFrames, u32Periods, &TwoCopyOutput, &TwoCopy);
+            RunBench((BENCH_INPUT)iInput, true, Format.u32FramesPerSecond, Format.u32SamplesPerFrame,
+                     u32PeriodFrames, u32Periods, &SinglePassOutput, &SinglePass);
+
+            char szFormat[32];
+            snprintf(szFormat, sizeof(szFormat), "%u Hz %u ch", Format.u32FramesPerSecond, Format.u32SamplesPerFrame);
+
+            const BENCH_RESULT *apResults[] = { &TwoCopy, &SinglePass };
+            const char *apszKernel[] = { "two-copy", "single" };
+            for (int i = 0; i < 2; i++)
+            {
+                printf("%-16s %-9s %-11s %10llu %10llu %10.0f %12llu %12llu\n",
+                       szFormat, g_apszInput[iInput], apszKernel[i],
+                       (unsigned long long)apResults[i]->Cycles.u64Median,
+                       (unsigned long long)apResults[i]->Cycles.u64P99,
+                       apResults[i]->Cycles.dMean,
+                       (unsigned long long)apResults[i]->u64BytesRead,
+                       (unsigned long long)apResults[i]->u64BytesWritten);
+            }
+
+            if (TwoCopyOutput != SinglePassOutput)
+            {
+                fprintf(stderr, "FAIL: %s, %s input: outputs differ\n", szFormat, g_apszInput[iInput]);
+                iResult = 1;
+            }
+        }
+    }
+
+    return iResult;
+}
@@ -0,0 +1,650 @@
+//
+// DriverTests.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Checks of driver code that runs unchanged on the host. The sources are
+//   the driver's own, compiled against the WDK stand-in in Wdk/:
+//
+//   - hw.cpp: the mixer register file. Reset values, per channel
+//     registers, the change result of vector writes and fills, clamping of
+//     out of range nodes and channels, and that a vector read never sees
+//     half of a concurrent vector write.
+//   - EndpointsCommon/AudioModuleHelper.cpp: batches of module commands,
+//     run on two instances of the sample's AudioModule0, with and without
+//     the module index. Results, sizing, validation before any command
+//     runs, restore of every module after a failed command, and that a
+//     batch is not interleaved with another.
+//
+
+#include <stdio.h>
+
+#include <thread>
+
+#include <sysvad.h>
+#include "hw.h"
+#include "SysVadShared.h"
+#include "AudioModule0.h"
+
+static unsigned g_cChecks;
+static unsigned g_cFailures;
+
+#define CHECK(expr, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        g_cChecks++;                                                        \
+        if (!(expr))                                                        \
+        {                                                                   \
+            if (g_cFailures++ < 20)                                         \
+            {                                                               \
+                fprintf(stderr, "%s:%d: %s: ", __FILE__, __LINE__, #expr);  \
+                fprintf(stderr, __VA_ARGS__);                               \
+                fprintf(stderr, "\n");                                      \
+            }                                                               \
+        }                                                                   \
+    } while (0)
+
+//
+// PropertyHandler_BasicSupport lives in kshelper.cpp, which needs more of
+// PortCls than the stand-in has. No test sends a basic support request.
+//
+NTSTATUS PropertyHandler_BasicSupport(PPCPROPERTY_REQUEST PropertyRequest, ULONG Flags, DWORD PropTypeSetId)
+{
+    UNREFERENCED_PARAMETER(PropertyRequest);
+    UNREFERENCED_PARAMETER(Flags);
+    UNREFERENCED_PARAMETER(PropTypeSetId);
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+//
+// Mixer register file.
+//
+static void TestMixerReset()
+{
+    CSYSVADHW hw;
+
+    for (ULONG node = 0; node < MAX_TOPOLOGY_NODES; node++)
+    {
+        for (ULONG channel = 0; channel < MAX_TOPOLOGY_CHANNELS; channel++)
+        {
+            CHECK(hw.GetMixerVolume(node, channel) == -1, "node %u channel %u volume %d", node, channel, hw.GetMixerVolume(node, channel));
+            CHECK(hw.GetMixerMute(node, channel) == FALSE, "node %u channel %u muted", node, channel);
+            CHECK(hw.GetMixerPeakMeter(node, channel) == PEAKMETER_SIGNED_MAXIMUM / 2, "node %u channel %u peak %d", node, channel, hw.GetMixerPeakMeter(node, channel));
+        }
+    }
+
+    hw.SetMixerVolume(3, 1, -96);
+    hw.SetMixerMute(3, 1, TRUE);
+    hw.MixerReset();
+
+    CHECK(hw.GetMixerVolume(3, 1) == -1, "volume %d after reset", hw.GetMixerVolume(3, 1));
+    CHECK(hw.GetMixerMute(3, 1) == FALSE, "muted after reset");
+}
+
+static void TestMixerChannels()
+{
+    CSYSVADHW hw;
+
+    for (ULONG channel = 0; channel < MAX_TOPOLOGY_CHANNELS; channel++)
+    {
+        hw.SetMixerVolume(5, channel, -(LONG)channel * 1000);
+    }
+    hw.SetMixerMute(5, 2, TRUE);
+
+    for (ULONG channel = 0; channel < MAX_TOPOLOGY_CHANNELS; channel++)
+    {
+        CHECK(hw.GetMixerVolume(5, channel) == -(LONG)channel * 1000, "channel %u volume %d", channel, hw.GetMixerVolume(5, channel));
+        CHECK(hw.GetMixerMute(5, channel) == (channel == 2), "channel %u mute %d", channel, hw.GetMixerMute(5, channel));
+        CHECK(hw.GetMixerVolume(4, channel) == -1, "neighbor node channel %u volume %d", channel, hw.GetMixerVolume(4, channel));
+        CHECK(hw.GetMixerVolume(6, channel) == -1, "neighbor node channel %u volume %d", channel, hw.GetMixerVolume(6, channel));
+    }
+
+    // Out of range registers read as 0 and ignore writes.
+    hw.SetMixerVolume(MAX_TOPOLOGY_NODES, 0, -5);
+    hw.SetMixerVolume(0, MAX_TOPOLOGY_CHANNELS, -5);
+    CHECK(hw.GetMixerVolume(MAX_TOPOLOGY_NODES, 0) == 0, "volume %d", hw.GetMixerVolume(MAX_TOPOLOGY_NODES, 0));
+    CHECK(hw.GetMixerVolume(0, MAX_TOPOLOGY_CHANNELS) == 0, "volume %d", hw.GetMixerVolume(0, MAX_TOPOLOGY_CHANNELS));
+    CHECK(hw.GetMixerVolume(0, 0) == -1, "volume %d", hw.GetMixerVolume(0, 0));
+}
+
+static void TestMixerVectors()
+{
+    CSYSVADHW   hw;
+    LONG        values[MAX_TOPOLOGY_CHANNELS + 4];
+
+    for (ULONG i = 0; i < MAX_TOPOLOGY_CHANNELS; i++)
+    {
+        values[i] = -(LONG)(i + 1) * 256;
+    }
+
+    CHECK(hw.WriteMixerRegisters(eMixerVolume, 7, 0, MAX_TOPOLOGY_CHANNELS, values) == TRUE, "first write reports no change");
+    CHECK(hw.WriteMixerRegisters(eMixerVolume, 7, 0, MAX_TOPOLOGY_CHANNELS, values) == FALSE, "same write reports a change");
+
+    for (ULONG i = 0; i < MAX_TOPOLOGY_CHANNELS; i++)
+    {
+        CHECK(hw.GetMixerVolume(7, i) == values[i], "channel %u volume %d", i, hw.GetMixerVolume(7, i));
+    }
+
+    // One changed channel is a change of the vector.
+    values[6] = 0;
+    CHECK(hw.WriteMixerRegisters(eMixerVolume, 7, 0, MAX_TOPOLOGY_CHANNELS, values) == TRUE, "one channel change not reported");
+
+    // A read past the last channel zero-fills the rest.
+    RtlFillMemory(values, sizeof(values), 0x55);
+    hw.ReadMixerRegisters(eMixerVolume, 7, 4, 8, values);
+    for (ULONG i = 0; i < 8; i++)
+    {
+        LONG expected = (i < 4) ? hw.GetMixerVolume(7, 4 + i) : 0;
+        CHECK(values[i] == expected, "read slot %u is %d, expected %d", i, values[i], expected);
+    }
+    CHECK(values[8] == 0x55555555, "read wrote past its count");
+
+    // A write past the last channel drops the rest.
+    LONG ones[4] = { 1, 1, 1, 1 };
+    CHECK(hw.WriteMixerRegisters(eMixerMute, 7, MAX_TOPOLOGY_CHANNELS - 2, 4, ones) == TRUE, "clamped write reports no change");
+    CHECK(hw.GetMixerMute(7, MAX_TOPOLOGY_CHANNELS - 3) == FALSE, "write started early");
+    CHECK(hw.GetMixerMute(7, MAX_TOPOLOGY_CHANNELS - 1) == TRUE, "write not applied");
+    CHECK(hw.GetMixerMute(8, 0) == FALSE, "write spilled into the next node");
+
+    // Out of range banks and nodes.
+    RtlFillMemory(values, sizeof(values), 0x55);
+    hw.ReadMixerRegisters(eMixerRegisterBankCount, 0, 0, MAX_TOPOLOGY_CHANNELS, values);
+    CHECK(values[0] == 0 && values[MAX_TOPOLOGY_CHANNELS - 1] == 0, "bad bank read not zero-filled");
+    hw.ReadMixerRegisters(eMixerVolume, MAX_TOPOLOGY_NODES, 0, MAX_TOPOLOGY_CHANNELS, values);
+    CHECK(values[0] == 0 && values[MAX_TOPOLOGY_CHANNELS - 1] == 0, "bad node read not zero-filled");
+    CHECK(hw.WriteMixerRegisters(eMixerVolume, MAX_TOPOLOGY_NODES, 0, 4, ones) == FALSE, "bad node write reports a change");
+    CHECK(hw.WriteMixerRegisters(eMixerVolume, 0, MAX_TOPOLOGY_CHANNELS, 4, ones) == FALSE, "bad channel write reports a change");
+}
+
+static void TestMixerFill()
+{
+    CSYSVADHW hw;
+
+    // ALL_CHANNELS_ID sets every channel of the node.
+    CHECK(hw.FillMixerRegisters(eMixerVolume, 2, MAX_TOPOLOGY_CHANNELS, -1024) == TRUE, "fill reports no change");
+    CHECK(hw.FillMixerRegisters(eMixerVolume, 2, MAX_TOPOLOGY_CHANNELS, -1024) == FALSE, "same fill reports a change");
+
+    for (ULONG channel = 0; channel < MAX_TOPOLOGY_CHANNELS; channel++)
+    {
+        CHECK(hw.GetMixerVolume(2, channel) == -1024, "channel %u volume %d", channel, hw.GetMixerVolume(2, channel));
+    }
+
+    // A fill of fewer channels leaves the others alone.
+    CHECK(hw.FillMixerRegisters(eMixerMute, 2, 2, TRUE) == TRUE, "partial fill reports no change");
+    CHECK(hw.GetMixerMute(2, 1) == TRUE && hw.GetMixerMute(2, 2) == FALSE, "partial fill covers the wrong channels");
+
+    CHECK(hw.FillMixerRegisters(eMixerVolume, MAX_TOPOLOGY_NODES, MAX_TOPOLOGY_CHANNELS, 0) == FALSE, "bad node fill reports a change");
+}
+
+//
+// A reader of a channel vector sees either the whole old vector or the
+// whole new one while another thread writes it.
+//
+static void TestMixerVectorsConcurrent()
+{
+    CSYSVADHW           hw;
+    std::atomic<bool>   stop(false);
+    unsigned            torn = 0;
+    unsigned            reads = 0;
+
+    std::thread writer([&]()
+    {
+        LONG values[MAX_TOPOLOGY_CHANNELS];
+
+        for (LONG generation = 0; !stop.load(); generation++)
+        {
+            for (ULONG i = 0; i < MAX_TOPOLOGY_CHANNELS; i++)
+            {
+                values[i] = generation;
+            }
+            hw.WriteMixerRegisters(eMixerVolume, 9, 0, MAX_TOPOLOGY_CHANNELS, values);
+        }
+    });
+
+    for (reads = 0; reads < 200000; reads++)
+    {
+        LONG values[MAX_TOPOLOGY_CHANNELS];
+
+        hw.ReadMixerRegisters(eMixerVolume, 9, 0, MAX_TOPOLOGY_CHANNELS, values);
+        for (ULONG i = 1; i < MAX_TOPOLOGY_CHANNELS; i++)
+        {
+            if (values[i] != values[0])
+            {
+                torn++;
+                break;
+            }
+        }
+    }
+
+    stop.store(true);
+    writer.join();
+
+    CHECK(torn == 0, "%u of %u vector reads were torn", torn, reads);
+}
+
+//
+// Module command batches.
+//
+static AUDIOMODULE_DESCRIPTOR g_ModuleDescriptor =
+{
+    &AudioModule0Id,
+    &NULL_GUID,
+    L"Generic system module",
+    AUDIOMODULE_INSTANCE_ID(0,0),
+    AUDIOMODULE0_MAJOR,
+    AUDIOMODULE0_MINOR,
+    AUDIOMODULE_DESCRIPTOR_FLAG_NONE,
+    sizeof(AUDIOMODULE0_CONTEXT),
+    AudioModule0_InitClass,
+    AudioModule0_InitInstance,
+    AudioModule0_Cleanup,
+    AudioModule0_Handler
+};
+
+//
+// AudioModule0 with a yield after each set, so that a reader gets to run
+// in the middle of a batch of sets even on a single processor.
+//
+static NTSTATUS YieldingModule_Handler(PVOID Context, PVOID InBuffer, ULONG InBufferCb, PVOID OutBuffer, ULONG *OutBufferCb)
+{
+    NTSTATUS status = AudioModule0_Handler(Context, InBuffer, InBufferCb, OutBuffer, OutBufferCb);
+
+    if (((AUDIOMODULE0_CUSTOM_COMMAND *)InBuffer)->Verb & KSPROPERTY_TYPE_SET)
+    {
+        std::this_thread::yield();
+    }
+    return status;
+}
+
+static AUDIOMODULE_DESCRIPTOR g_YieldingModuleDescriptor =
+{
+    &AudioModule0Id,
+    &NULL_GUID,
+    L"Generic system module",
+    AUDIOMODULE_INSTANCE_ID(0,0),
+    AUDIOMODULE0_MAJOR,
+    AUDIOMODULE0_MINOR,
+    AUDIOMODULE_DESCRIPTOR_FLAG_NONE,
+    sizeof(AUDIOMODULE0_CONTEXT),
+    AudioModule0_InitClass,
+    AudioModule0_InitInstance,
+    AudioModule0_Cleanup,
+    YieldingModule_Handler
+};
+
+#define TEST_MODULE_COUNT   2
+
+struct MODULE_LIST
+{
+    AUDIOMODULE             Modules[TEST_MODULE_COUNT];
+    AUDIOMODULE0_CONTEXT    Contexts[TEST_MODULE_COUNT];
+    AUDIOMODULE_INDEX       Index;
+    BOOL                    Indexed;
+};
+
+static void ModuleListInit(MODULE_LIST *List, BOOL Indexed, AUDIOMODULE_DESCRIPTOR *Descriptor = &g_ModuleDescriptor)
+{
+    KSAUDIOMODULE_NOTIFICATION header = {};
+
+    for (ULONG i = 0; i < TEST_MODULE_COUNT; i++)
+    {
+        AudioModule0_InitClass(Descriptor, &List->Contexts[i], sizeof(List->Contexts[i]), &header, NULL);
+        List->Contexts[i].Parameter1 = 1;
+        List->Contexts[i].Parameter2 = (BYTE)(0x40 + i);
+
+        List->Modules[i].Descriptor = Descriptor;
+        List->Modules[i].Context = &List->Contexts[i];
+        List->Modules[i].InstanceId = AUDIOMODULE_INSTANCE_ID(0, i);
+        List->Modules[i].NextCfgInstanceId = 0;
+        List->Modules[i].Enabled = TRUE;
+        List->Modules[i].Notifier = NULL;
+    }
+
+    List->Indexed = Indexed;
+    if (Indexed)
+    {
+        CHECK(NT_SUCCESS(AudioModule_InitIndex(&List->Index, List->Modules, TEST_MODULE_COUNT)), "index not built");
+    }
+}
+
+static void ModuleListCleanup(MODULE_LIST *List)
+{
+    if (List->Indexed)
+    {
+        AudioModule_CleanupIndex(&List->Index);
+    }
+}
+
+//
+// A KSPROPERTY_AUDIOMODULE_COMMAND instance addressed to the batch class,
+// followed by the batch.
+//
+struct MODULE_BATCH
+{
+    ULONGLONG   Buffer[64];
+    ULONG       Cb;                 // batch bytes after the property
+    ULONG       ResultCb;           // value bytes the batch needs
+};
+
+static KSAUDIOMODULE_PROPERTY *BatchProperty(MODULE_BATCH *Batch)
+{
+    return (KSAUDIOMODULE_PROPERTY *)Batch->Buffer;
+}
+
+static BYTE *BatchData(MODULE_BATCH *Batch)
+{
+    return (BYTE *)(BatchProperty(Batch) + 1);
+}
+
+static void BatchInit(MODULE_BATCH *Batch)
+{
+    memset(Batch, 0, sizeof(*Batch));
+    BatchProperty(Batch)->ClassId = SYSVAD_AUDIOMODULE_BATCH_CLASSID;
+    Batch->Cb = sizeof(SYSVAD_AUDIOMODULE_BATCH_HEADER);
+}
+
+static void BatchAdd(MODULE_BATCH *Batch, ULONG Module, ULONG Verb, AudioModule0_Parameter ParameterId, ULONG Value, ULONG ValueCb, ULONG ResultCb)
+{
+    PSYSVAD_AUDIOMODULE_BATCH_HEADER    header = (PSYSVAD_AUDIOMODULE_BATCH_HEADER)BatchData(Batch);
+    PSYSVAD_AUDIOMODULE_BATCH_COMMAND   entry = (PSYSVAD_AUDIOMODULE_BATCH_COMMAND)(BatchData(Batch) + Batch->Cb);
+    AUDIOMODULE0_CUSTOM_COMMAND *       command = (AUDIOMODULE0_CUSTOM_COMMAND *)(entry + 1);
+
+    entry->ClassId = AudioModule0Id;
+    entry->InstanceId = AUDIOMODULE_INSTANCE_ID(0, Module);
+    entry->CommandSize = sizeof(*command) + ValueCb;
+    entry->ValueSize = ResultCb;
+
+    command->Verb = Verb;
+    command->ParameterId = ParameterId;
+    RtlCopyMemory(command + 1, &Value, ValueCb);
+
+    header->Count++;
+    Batch->Cb += SYSVAD_AUDIOMODULE_BATCH_ALIGN(sizeof(*entry) + entry->CommandSize);
+    Batch->ResultCb += sizeof(SYSVAD_AUDIOMODULE_BATCH_RESULT) + SYSVAD_AUDIOMODULE_BATCH_ALIGN(ResultCb);
+}
+
+static void BatchSet(MODULE_BATCH *Batch, ULONG Module, AudioModule0_Parameter ParameterId, ULONG Value)
+{
+    ULONG cb = (ParameterId == AudioModule0Parameter1) ? sizeof(ULONG) : sizeof(BYTE);
+
+    BatchAdd(Batch, Module, KSPROPERTY_TYPE_SET, ParameterId, Value, cb, 0);
+}
+
+static void BatchGet(MODULE_BATCH *Batch, ULONG Module, AudioModule0_Parameter ParameterId)
+{
+    BatchAdd(Batch, Module, KSPROPERTY_TYPE_GET, ParameterId, 0, 0, sizeof(ULONG));
+}
+
+static NTSTATUS BatchRun(MODULE_BATCH *Batch, MODULE_LIST *List, PVOID Value, ULONG *ValueCb)
+{
+    PCPROPERTY_REQUEST  request = {};
+    NTSTATUS            status;
+
+    // PortCls hands the handler the instance that follows the KSPROPERTY.
+    request.Verb = KSPROPERTY_TYPE_GET;
+    request.Instance = &BatchProperty(Batch)->ClassId;
+    request.InstanceSize = sizeof(KSAUDIOMODULE_PROPERTY) - sizeof(KSPROPERTY) + Batch->Cb;
+    request.Value = (*ValueCb != 0) ? Value : NULL;
+    request.ValueSize = *ValueCb;
+
+    status = AudioModule_GenericHandler_ModuleCommand(&request,
+                                                      List->Modules,
+                                                      TEST_MODULE_COUNT,
+                                                      List->Indexed ? &List->Index : NULL);
+    *ValueCb = request.ValueSize;
+    return status;
+}
+
+// The result of command Index of the batch whose value is Value.
+static PSYSVAD_AUDIOMODULE_BATCH_RESULT BatchResult(MODULE_BATCH *Batch, PVOID Value, ULONG Index)
+{
+    BYTE *  command = BatchData(Batch) + sizeof(SYSVAD_AUDIOMODULE_BATCH_HEADER);
+    BYTE *  result = (BYTE *)Value;
+
+    for (ULONG i = 0; i < Index; i++)
+    {
+        PSYSVAD_AUDIOMODULE_BATCH_COMMAND entry = (PSYSVAD_AUDIOMODULE_BATCH_COMMAND)command;
+
+        command += SYSVAD_AUDIOMODULE_BATCH_ALIGN(sizeof(*entry) + entry->CommandSize);
+        result += sizeof(SYSVAD_AUDIOMODULE_BATCH_RESULT) + SYSVAD_AUDIOMODULE_BATCH_ALIGN(entry->ValueSize);
+    }
+
+    return (PSYSVAD_AUDIOMODULE_BATCH_RESULT)result;
+}
+
+static ULONG BatchResultValue(MODULE_BATCH *Batch, PVOID Value, ULONG Index)
+{
+    PSYSVAD_AUDIOMODULE_BATCH_RESULT    result = BatchResult(Batch, Value, Index);
+    ULONG                               value = 0;
+
+    RtlCopyMemory(&value, result + 1, min(result->ValueSize, (ULONG)sizeof(value)));
+    return value;
+}
+
+static void TestBatchApply(BOOL Indexed)
+{
+    MODULE_LIST     list;
+    MODULE_BATCH    batch;
+    ULONGLONG       value[32];
+    ULONG           valueCb = 0;
+    NTSTATUS        status;
+
+    ModuleListInit(&list, Indexed);
+
+    BatchInit(&batch);
+    BatchSet(&batch, 0, AudioModule0Parameter1, 2);
+    BatchSet(&batch, 1, AudioModule0Parameter1, 5);
+    BatchGet(&batch, 0, AudioModule0Parameter1);
+    BatchGet(&batch, 1, AudioModule0Parameter2);
+
+    // A value size of 0 asks for the size of the results.
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_BUFFER_OVERFLOW, "size query returned 0x%x", status);
+    CHECK(valueCb == batch.ResultCb, "size query returned %u, expected %u", valueCb, batch.ResultCb);
+    CHECK(list.Contexts[0].Parameter1 == 1, "size query ran a command");
+
+    valueCb = batch.ResultCb - 1;
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_BUFFER_TOO_SMALL, "short value returned 0x%x", status);
+    CHECK(list.Contexts[0].Parameter1 == 1, "short value ran a command");
+
+    RtlFillMemory(value, sizeof(value), 0xAA);
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_SUCCESS, "batch returned 0x%x", status);
+    CHECK(valueCb == batch.ResultCb, "batch returned %u bytes, expected %u", valueCb, batch.ResultCb);
+
+    for (ULONG i = 0; i < 4; i++)
+    {
+        CHECK(BatchResult(&batch, value, i)->Status == STATUS_SUCCESS, "command %u status 0x%x", i, BatchResult(&batch, value, i)->Status);
+    }
+    CHECK(BatchResult(&batch, value, 0)->ValueSize == 0, "set returned %u bytes", BatchResult(&batch, value, 0)->ValueSize);
+    CHECK(BatchResult(&batch, value, 2)->ValueSize == sizeof(ULONG), "get returned %u bytes", BatchResult(&batch, value, 2)->ValueSize);
+    CHECK(BatchResultValue(&batch, value, 2) == 2, "get after set returned %u", BatchResultValue(&batch, value, 2));
+    CHECK(BatchResult(&batch, value, 3)->ValueSize == sizeof(BYTE), "get returned %u bytes", BatchResult(&batch, value, 3)->ValueSize);
+    CHECK(BatchResultValue(&batch, value, 3) == 0x41, "get returned 0x%x", BatchResultValue(&batch, value, 3));
+
+    CHECK(list.Contexts[0].Parameter1 == 2, "module 0 parameter is %u", list.Contexts[0].Parameter1);
+    CHECK(list.Contexts[1].Parameter1 == 5, "module 1 parameter is %u", list.Contexts[1].Parameter1);
+
+    ModuleListCleanup(&list);
+}
+
+static void TestBatchRestore(BOOL Indexed)
+{
+    MODULE_LIST     list;
+    MODULE_BATCH    batch;
+    ULONGLONG       value[32];
+    ULONG           valueCb;
+    NTSTATUS        status;
+
+    ModuleListInit(&list, Indexed);
+    list.Contexts[0].Parameter1 = 2;
+    list.Contexts[1].Parameter1 = 5;
+
+    //
+    // The third command sets a value outside the valid set. The two before
+    // it ran, and are undone.
+    //
+    BatchInit(&batch);
+    BatchSet(&batch, 0, AudioModule0Parameter1, 5);
+    BatchSet(&batch, 1, AudioModule0Parameter1, 1);
+    BatchSet(&batch, 0, AudioModule0Parameter1, 3);
+    BatchGet(&batch, 1, AudioModule0Parameter1);
+
+    RtlFillMemory(value, sizeof(value), 0xAA);
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_INVALID_PARAMETER, "batch returned 0x%x", status);
+    CHECK(BatchResult(&batch, value, 0)->Status == STATUS_SUCCESS, "command 0 status 0x%x", BatchResult(&batch, value, 0)->Status);
+    CHECK(BatchResult(&batch, value, 1)->Status == STATUS_SUCCESS, "command 1 status 0x%x", BatchResult(&batch, value, 1)->Status);
+    CHECK(BatchResult(&batch, value, 2)->Status == STATUS_INVALID_PARAMETER, "command 2 status 0x%x", BatchResult(&batch, value, 2)->Status);
+    CHECK(BatchResult(&batch, value, 2)->ValueSize == 0, "failed command returned %u bytes", BatchResult(&batch, value, 2)->ValueSize);
+    CHECK(BatchResult(&batch, value, 3)->Status == (LONG)0xAAAAAAAA, "command after the failure ran");
+
+    CHECK(list.Contexts[0].Parameter1 == 2, "module 0 parameter is %u, not restored", list.Contexts[0].Parameter1);
+    CHECK(list.Contexts[1].Parameter1 == 5, "module 1 parameter is %u, not restored", list.Contexts[1].Parameter1);
+    CHECK(list.Contexts[0].Parameter2 == 0x40 && list.Contexts[1].Parameter2 == 0x41, "untouched parameters changed");
+
+    // A set of a read-only parameter fails the same way.
+    BatchInit(&batch);
+    BatchSet(&batch, 1, AudioModule0Parameter1, 2);
+    BatchSet(&batch, 1, AudioModule0Parameter2, 7);
+
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_INVALID_DEVICE_REQUEST, "batch returned 0x%x", status);
+    CHECK(list.Contexts[1].Parameter1 == 5, "module 1 parameter is %u, not restored", list.Contexts[1].Parameter1);
+    CHECK(list.Contexts[1].Parameter2 == 0x41, "read-only parameter changed");
+
+    ModuleListCleanup(&list);
+}
+
+static void TestBatchValidation(BOOL Indexed)
+{
+    MODULE_LIST     list;
+    MODULE_BATCH    batch;
+    ULONGLONG       value[32];
+    ULONG           valueCb;
+    NTSTATUS        status;
+
+    ModuleListInit(&list, Indexed);
+
+    // A command to a module that is not in the list fails the batch before
+    // any command runs.
+    BatchInit(&batch);
+    BatchSet(&batch, 0, AudioModule0Parameter1, 5);
+    BatchSet(&batch, TEST_MODULE_COUNT, AudioModule0Parameter1, 5);
+
+    RtlFillMemory(value, sizeof(value), 0xAA);
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_INVALID_PARAMETER, "batch returned 0x%x", status);
+    CHECK(valueCb == 0, "invalid batch returned %u bytes", valueCb);
+    CHECK(BatchResult(&batch, value, 0)->Status == (LONG)0xAAAAAAAA, "command of an invalid batch ran");
+    CHECK(list.Contexts[0].Parameter1 == 1, "command of an invalid batch changed module 0");
+
+    // A command that runs past the end of the batch.
+    BatchInit(&batch);
+    BatchSet(&batch, 0, AudioModule0Parameter1, 5);
+    batch.Cb -= SYSVAD_AUDIOMODULE_BATCH_ALIGN(sizeof(ULONG) + 1);
+
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_INVALID_PARAMETER, "truncated batch returned 0x%x", status);
+    CHECK(list.Contexts[0].Parameter1 == 1, "truncated batch changed module 0");
+
+    // An empty batch.
+    BatchInit(&batch);
+
+    valueCb = sizeof(value);
+    status = BatchRun(&batch, &list, value, &valueCb);
+    CHECK(status == STATUS_INVALID_PARAMETER, "empty batch returned 0x%x", status);
+
+    ModuleListCleanup(&list);
+}
+
+//
+// Batches to one module list run one at a time: a batch that reads both
+// modules never sees only one of them changed by a batch that sets both.
+//
+static void TestBatchConcurrent()
+{
+    MODULE_LIST             list;
+    std::atomic<bool>       stop(false);
+    std::atomic<unsigned>   writes(0);
+    std::atomic<unsigned>   failed(0);
+    unsigned                mixed = 0;
+    unsigned                reads = 0;
+
+    ModuleListInit(&list, TRUE, &g_YieldingModuleDescriptor);
+
+    std::thread writer([&]()
+    {
+        for (ULONG generation = 1; !stop.load(); generation++)
+        {
+            MODULE_BATCH    batch;
+            ULONGLONG       value[8];
+            ULONG           valueCb = sizeof(value);
+            ULONG           parameter = (generation & 1) ? 5 : 1;
+
+            BatchInit(&batch);
+            BatchSet(&batch, 0, AudioModule0Parameter1, parameter);
+            BatchSet(&batch, 1, AudioModule0Parameter1, parameter);
+            if (BatchRun(&batch, &list, value, &valueCb) != STATUS_SUCCESS)
+            {
+                failed++;
+            }
+            writes++;
+        }
+    });
+
+    for (reads = 0; writes.load() < 2000; reads++)
+    {
+        MODULE_BATCH    batch;
+        ULONGLONG       value[8];
+        ULONG           valueCb = sizeof(value);
+
+        BatchInit(&batch);
+        BatchGet(&batch, 0, AudioModule0Parameter1);
+        BatchGet(&batch, 1, AudioModule0Parameter1);
+        if (BatchRun(&batch, &list, value, &valueCb) != STATUS_SUCCESS)
+        {
+            failed++;
+        }
+        else if (BatchResultValue(&batch, value, 0) != BatchResultValue(&batch, value, 1))
+        {
+            mixed++;
+        }
+
+        std::this_thread::yield();
+    }
+
+    stop.store(true);
+    writer.join();
+
+    CHECK(failed.load() == 0, "%u batches failed", failed.load());
+    CHECK(mixed == 0, "%u of %u reads saw half of a batch", mixed, reads);
+
+    ModuleListCleanup(&list);
+}
+
+int main()
+{
+    TestMixerReset();
+    TestMixerChannels();
+    TestMixerVectors();
+    TestMixerFill();
+    TestMixerVectorsConcurrent();
+
+    for (BOOL indexed = FALSE; indexed <= TRUE; indexed++)
+    {
+        TestBatchApply(indexed);
+        TestBatchRestore(indexed);
+        TestBatchValidation(indexed);
+    }
+    TestBatchConcurrent();
+
+    printf("Driver: %u checks, %u failures\n", g_cChecks, g_cFailures);
+    return g_cFailures ? 1 : 0;
+}
@@ -0,0 +1,385 @@
+//
+// HfpBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Cost of the driver's HFP codec stage (EndpointsCommon/HfpCodec.h) per
+//   7.5 ms SCO frame: CVSD at 8 kHz and mSBC at 16 kHz, encode, decode and
+//   concealment of a lost packet. The run fails if a frame allocates or
+//   takes more than a tenth of its 7.5 ms.
+//
+//   Then the stream side, HfpCodecTransmit and HfpCodecReceive, fed 10 ms
+//   DMA runs over a link losing a share of the packets. The audio must
+//   match the frame by frame API when nothing is lost, and concealment
+//   must do better than leaving the lost frames silent.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "ApoHost.h"
+
+#include "CodecHost.h"
+#include "HfpCodec.h"
+
+#define HFP_FRAME_NS    7500000ULL
+
+static uint32_t FrameSamples(uint32_t u32Rate)
+{
+    return (u32Rate == 8000) ? CVSD_FRAME_SAMPLES : MSBC_SAMPLES;
+}
+
+static bool MakeSpeech(uint32_t u32Rate, uint32_t u32Seconds, std::vector<INT16> *pSamples)
+{
+    char szSpec[64];
+    APOHOST_AUDIO Audio;
+
+    snprintf(szSpec, sizeof(szSpec), "gen:speech:%u:1:%u", u32Rate, u32Seconds);
+    if (!ApoHost_Generate(szSpec, &Audio))
+    {
+        return false;
+    }
+
+    // whole frames only
+    size_t cSamples = Audio.Samples.size() / FrameSamples(u32Rate) * FrameSamples(u32Rate);
+
+    pSamples->resize(cSamples);
+    for (size_t n = 0; n < cSamples; n++)
+    {
+        (*pSamples)[n] = (INT16)fmax(fmin(Audio.Samples[n] * 32768.0f, 32767.0f), -32768.0f);
+    }
+
+    return true;
+}
+
+enum BENCH_OP
+{
+    OP_ENCODE,
+    OP_DECODE,
+    OP_CONCEAL,         // one lost packet in four
+};
+
+static const char *g_apszOp[] = { "encode", "decode", "conceal" };
+
+static bool RunFrames(uint32_t u32Rate, BENCH_OP Op, const std::vector<INT16> &Samples)
+{
+    uint32_t u32Frame = FrameSamples(u32Rate);
+    uint32_t u32Frames = (uint32_t)(Samples.size() / u32Frame);
+    std::vector<BYTE> Packets((size_t)u32Frames * HFP_PACKET_BYTES);
+    std::vector<INT16> Output(Samples.size());
+    std::vector<uint64_t> Cycles;
+    HFP_CODEC_STAGE Encoder;
+    HFP_CODEC_STAGE Decoder;
+    uint64_t u64Nanoseconds = 0;
+
+    HfpCodecInit(&Encoder, u32Rate);
+    HfpCodecInit(&Decoder, u32Rate);
+
+    // the packets to decode
+    if (Op != OP_ENCODE)
+    {
+        for (uint32_t f = 0; f < u32Frames; f++)
+        {
+            HfpCodecEncodePacket(&Encoder, &Samples[(size_t)f * u32Frame], &Packets[(size_t)f * HFP_PACKET_BYTES]);
+        }
+    }
+
+    Cycles.reserve(u32Frames);
+
+    uint64_t u64Allocations = ApoHost_AllocationCount();
+
+    for (uint32_t f = 0; f < u32Frames; f++)
+    {
+        BYTE *pbPacket = &Packets[(size_t)f * HFP_PACKET_BYTES];
+        INT16 *pOut = &Output[(size_t)f * u32Frame];
+        bool fLost = (Op == OP_CONCEAL) && (f % 4 == 3);
+        uint64_t u64Start = ApoHost_ReadNanoseconds();
+        uint64_t u64StartCycles = ApoHost_ReadCycles();
+
+        if (Op == OP_ENCODE)
+        {
+            HfpCodecEncodePacket(&Encoder, &Samples[(size_t)f * u32Frame], pbPacket);
+        }
+        else
+        {
+            HfpCodecDecodePacket(&Decoder, fLost ? NULL : pbPacket, pOut);
+        }
+
+        uint64_t u64Cycles = ApoHost_ReadCycles() - u64StartCycles;
+        uint64_t u64Elapsed = ApoHost_ReadNanoseconds() - u64Start;
+
+        // only the concealed frames count for the concealment cost
+        if (Op != OP_CONCEAL || fLost)
+        {
+            Cycles.push_back(u64Cycles);
+            u64Nanoseconds += u64Elapsed;
+        }
+    }
+
+    u64Allocations = ApoHost_AllocationCount() - u64Allocations;
+
+    APOHOST_STATS Stats;
+    ApoHost_Summarize(Cycles, &Stats);
+
+    double dNsPerFrame = (double)u64Nanoseconds / Cycles.size();
+    printf("%-6s %-5u %-8s %10llu %10llu %10.0f %10.0f %9.3f%% %7llu\n",
+           u32Rate == 8000 ? "CVSD" : "mSBC", u32Rate, g_apszOp[Op],
+           (unsigned long long)Stats.u64Median, (unsigned long long)Stats.u64P99, Stats.dMean,
+           dNsPerFrame, dNsPerFrame * 100 / HFP_FRAME_NS, (unsigned long long)u64Allocations);
+
+    bool fPassed = true;
+    if (u64Allocations != 0)
+    {
+        fprintf(stderr, "FAIL: %u Hz %s: the codec allocated\n", u32Rate, g_apszOp[Op]);
+        fPassed = false;
+    }
+
+    if (dNsPerFrame * 10 > HFP_FRAME_NS)
+    {
+        fprintf(stderr, "FAIL: %u Hz %s: %.0f ns per 7.5 ms frame\n", u32Rate, g_apszOp[Op], dNsPerFrame);
+        fPassed = false;
+    }
+
+    return fPassed;
+}
+
+//-------------------------------------------------------------------------
+// The SCO link between the stages: every packet sent is queued, and the
+// receive side loses u32LossPercent of them at random.
+//
+typedef struct BENCH_LINK
+{
+    std::vector<BYTE>   Packets;
+    size_t              Next;
+    uint32_t            u32LossPercent;
+    uint32_t            u32Seed;
+    std::vector<bool>   Lost;
+} BENCH_LINK;
+
+static VOID BenchSend(PVOID Context, const BYTE *Packet)
+{
+    BENCH_LINK *pLink = (BENCH_LINK *)Context;
+
+    pLink->Packets.insert(pLink->Packets.end(), Packet, Packet + HFP_PACKET_BYTES);
+}
+
+static BOOLEAN BenchReceive(PVOID Context, BYTE *Packet)
+{
+    BENCH_LINK *pLink = (BENCH_LINK *)Context;
+    size_t offset = pLink->Next++ * HFP_PACKET_BYTES;
+
+    pLink->u32Seed = pLink->u32Seed * 1664525u + 1013904223u;
+
+    bool fLost = offset >= pLink->Packets.size() || (pLink->u32Seed >> 8) % 100 < pLink->u32LossPercent;
+    if (!fLost)
+    {
+        memcpy(Packet, &pLink->Packets[offset], HFP_PACKET_BYTES);
+    }
+    pLink->Lost.push_back(fLost);
+
+    return fLost ? FALSE : TRUE;
+}
+
+static void RunLink(
+    uint32_t u32Rate,
+    const std::vector<INT16> &Samples,
+    uint32_t u32LossPercent,
+    std::vector<INT16> *pOutput,
+    BENCH_LINK *pLink)
+{
+    uint32_t u32Run = u32Rate / 100;
+    HFP_CODEC_STAGE Sender;
+    HFP_CODEC_STAGE Receiver;
+
+    HfpCodecInit(&Sender, u32Rate);
+    HfpCodecInit(&Receiver, u32Rate);
+    pLink->Packets.clear();
+    pLink->Lost.clear();
+    pLink->Next = 0;
+    pLink->u32LossPercent = u32LossPercent;
+    pLink->u32Seed = 0x13579bdf;
+    pOutput->assign(Samples.size(), 0);
+
+    //
+    // The render DMA runs a period ahead of the capture DMA, so a packet
+    // is sent before it is due on the other side.
+    //
+    size_t received = 0;
+    for (size_t offset = 0; offset < Samples.size(); offset += u32Run)
+    {
+        uint32_t run = (uint32_t)min((size_t)u32Run, Samples.size() - offset);
+
+        HfpCodecTransmit(&Sender, &Samples[offset], run, BenchSend, pLink);
+        if (offset >= u32Run)
+        {
+            HfpCodecReceive(&Receiver, &(*pOutput)[received], u32Run, BenchReceive, pLink);
+            received += u32Run;
+        }
+    }
+
+    HfpCodecReceive(&Receiver, &(*pOutput)[received], (ULONG)(Samples.size() - received), BenchReceive, pLink);
+}
+
+static double Snr(const std::vector<INT16> &Ref, const std::vector<INT16> &Out, size_t cSkip, uint32_t u32Delay)
+{
+    double dSignal = 0;
+    double dNoise = 1e-9;
+
+    for (size_t n = cSkip; n + u32Delay < Out.size(); n++)
+    {
+        double e = (double)Ref[n] - Out[n + u32Delay];
+
+        dSignal += (double)Ref[n] * Ref[n];
+        dNoise += e * e;
+    }
+
+    return 10 * log10(dSignal / dNoise);
+}
+
+static bool RunLossSweep(uint32_t u32Rate, const std::vector<INT16> &Samples)
+{
+    uint32_t u32Frame = FrameSamples(u32Rate);
+    std::vector<INT16> Clean;
+    std::vector<INT16> Output;
+    BENCH_LINK Link;
+    bool fPassed = true;
+
+    //
+    // Without loss the stream must give what the frame API gives.
+    //
+    RunLink(u32Rate, Samples, 0, &Clean, &Link);
+
+    HFP_CODEC_STAGE Encoder;
+    HFP_CODEC_STAGE Decoder;
+    std::vector<INT16> Expected(Samples.size());
+    BYTE abPacket[HFP_PACKET_BYTES];
+
+    HfpCodecInit(&Encoder, u32Rate);
+    HfpCodecInit(&Decoder, u32Rate);
+    for (size_t f = 0; f < Samples.size() / u32Frame; f++)
+    {
+        HfpCodecEncodePacket(&Encoder, &Samples[f * u32Frame], abPacket);
+        HfpCodecDecodePacket(&Decoder, abPacket, &Expected[f * u32Frame]);
+    }
+
+    if (Clean != Expected)
+    {
+        fprintf(stderr, "FAIL: %u Hz: streamed audio differs from the frame API\n", u32Rate);
+        fPassed = false;
+    }
+
+    uint32_t u32Delay = 0;
+    double dBest = -1000;
+    for (uint32_t d = 0; d < 200; d++)
+    {
+        double dSnr = Snr(Samples, Clean, u32Rate / 10, d);
+        if (dSnr > dBest)
+        {
+            dBest = dSnr;
+            u32Delay = d;
+        }
+    }
+
+    const uint32_t au32Loss[] = { 0, 1, 5, 10, 20 };
+    for (uint32_t u32Loss : au32Loss)
+    {
+        RunLink(u32Rate, Samples, u32Loss, &Output, &Link);
+
+        //
+        // The same packets through the bare decoders, with each lost frame
+        // left silent.
+        //
+        HFP_CODEC_STAGE Bare;
+        std::vector<INT16> Muted(Samples.size(), 0);
+        uint32_t u32Lost = 0;
+
+        HfpCodecInit(&Bare, u32Rate);
+        for (size_t f = 0; f < Link.Lost.size() && (f + 1) * u32Frame <= Muted.size(); f++)
+        {
+            const BYTE *pbPacket = &Link.Packets[f * HFP_PACKET_BYTES];
+
+            if (Link.Lost[f])
+            {
+                u32Lost++;
+            }
+            else if (Bare.Codec == HFP_CODEC_CVSD)
+            {
+                CvsdDecodeFrame(&Bare.CvsdDecoder, pbPacket, &Muted[f * u32Frame]);
+            }
+            else
+            {
+                MsbcDecodeFrame(&Bare.SbcSynthesis, &pbPacket[MSBC_H2_BYTES], &Muted[f * u32Frame]);
+            }
+        }
+
+        double dConcealed = Snr(Samples, Output, u32Rate / 10, u32Delay);
+        double dMuted = Snr(Samples, Muted, u32Rate / 10, u32Delay);
+
+        printf("%-6s %-5u %5u%% %8u %12.1f %12.1f\n",
+               u32Rate == 8000 ? "CVSD" : "mSBC", u32Rate, u32Loss, u32Lost, dConcealed, dMuted);
+
+        if (u32Lost != 0 && dConcealed <= dMuted)
+        {
+            fprintf(stderr, "FAIL: %u Hz, %u%% loss: concealment %.1f dB, silence %.1f dB\n",
+                    u32Rate, u32Loss, dConcealed, dMuted);
+            fPassed = false;
+        }
+    }
+
+    return fPassed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Seconds = 60;
+    if (argc > 2 && strcmp(argv[1], "--seconds") == 0)
+    {
+        u32Seconds = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    const uint32_t au32Rates[] = { 8000, 16000 };
+    std::vector<INT16> Speech[2];
+    int iResult = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!MakeSpeech(au32Rates[i], u32Seconds, &Speech[i]))
+        {
+            fprintf(stderr, "FAIL: cannot generate %u Hz speech\n", au32Rates[i]);
+            return 1;
+        }
+    }
+
+    printf("HFP codec stage, %u s of speech, 7.5 ms frames; %s per frame\n\n", u32Seconds, ApoHost_CycleUnit());
+    printf("%-6s %-5s %-8s %10s %10s %10s %10s %10s %7s\n",
+           "codec", "rate", "op", "median", "p99", "mean", "ns/frame", "of frame", "allocs");
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (BENCH_OP Op : { OP_ENCODE, OP_DECODE, OP_CONCEAL })
+        {
+            if (!RunFrames(au32Rates[i], Op, Speech[i]))
+            {
+                iResult = 1;
+            }
+        }
+    }
+
+    printf("\nstream over a lossy link, 10 ms DMA runs; SNR against the input in dB\n\n");
+    printf("%-6s %-5s %6s %8s %12s %12s\n", "codec", "rate", "loss", "lost", "concealed", "silenced");
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!RunLossSweep(au32Rates[i], Speech[i]))
+        {
+            iResult = 1;
+        }
+    }
+
+    return iResult;
+}
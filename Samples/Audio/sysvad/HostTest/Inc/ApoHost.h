@@ -0,0 +1,295 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    ApoHost.h
+//
+// Abstract:    User-mode stand-in for the audio engine, used to run the
+//              sample APOs' processing off Windows.
+//
+//              The engine side of APOProcess is faked: connection buffers
+//              are described with the same APO_CONNECTION_PROPERTY(_V2)
+//              layouts as audioenginebaseapo.h, and a graph of nodes is
+//              driven one period at a time, the way audiodg calls a chain
+//              of SFX/MFX APOs. Every node mirrors the APOProcess routine
+//              of one sample APO and calls the same ApoDsp.h / AecApo
+//              kernels, so what the harness measures is what ships.
+//
+//              The graph runner counts heap allocations and CPU cycles
+//              per period. APOProcess must not allocate; a period that
+//              does is reported.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//-------------------------------------------------------------------------
+// Engine types, as declared by audioenginebaseapo.h.
+//
+typedef enum APO_BUFFER_FLAGS
+{
+    BUFFER_INVALID = 0,
+    BUFFER_VALID = 1,
+    BUFFER_SILENT = 2
+} APO_BUFFER_FLAGS;
+
+#define APO_CONNECTION_PROPERTY_SIGNATURE       0x41435053      // 'ACPS'
+#define APO_CONNECTION_PROPERTY_V2_SIGNATURE    0x41435032      // 'ACP2'
+
+typedef struct APO_CONNECTION_PROPERTY
+{
+    uintptr_t           pBuffer;
+    uint32_t            u32ValidFrameCount;
+    APO_BUFFER_FLAGS    u32BufferFlags;
+    uint32_t            u32Signature;
+} APO_CONNECTION_PROPERTY;
+
+typedef struct APO_CONNECTION_PROPERTY_V2
+{
+    APO_CONNECTION_PROPERTY property;
+    uint64_t                u64QPCTime;
+} APO_CONNECTION_PROPERTY_V2;
+
+#define HNS_PER_SECOND  10000000ULL
+
+//-------------------------------------------------------------------------
+// Format of a connection, as LockForProcess sees it.
+//
+typedef struct APOHOST_FORMAT
+{
+    uint32_t    u32FramesPerSecond;
+    uint32_t    u32SamplesPerFrame;
+    uint32_t    u32MaxFrameCount;
+} APOHOST_FORMAT;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  One APO of a graph. LockForProcess and Unlock run on the "control"
+//  side and may allocate; APOProcess and AcceptLoopback are the realtime
+//  entry points.
+//
+class CApoHostNode
+{
+public:
+    virtual ~CApoHostNode() {}
+
+    virtual const char *GetName() const = 0;
+
+    //
+    // Validates the input format and returns the output format. Returns
+    // false if the node cannot run on pInput.
+    //
+    virtual bool LockForProcess(const APOHOST_FORMAT *pInput, APOHOST_FORMAT *pOutput) = 0;
+
+    //
+    // True if the node may be given the same buffer for input and output.
+    //
+    virtual bool CanProcessInPlace() const { return true; }
+
+    //
+    // True if the node takes the render loopback as a second input.
+    //
+    virtual bool UsesLoopback() const { return false; }
+
+    //
+    // Format of the loopback, before the first AcceptLoopback.
+    //
+    virtual bool LockLoopback(const APOHOST_FORMAT *pLoopback) { (void)pLoopback; return true; }
+
+    virtual void AcceptLoopback(const APO_CONNECTION_PROPERTY_V2 *pLoopback) { (void)pLoopback; }
+
+    virtual void APOProcess(
+        uint32_t u32NumInputConnections,
+        APO_CONNECTION_PROPERTY **ppInputConnections,
+        uint32_t u32NumOutputConnections,
+        APO_CONNECTION_PROPERTY **ppOutputConnections) = 0;
+};
+
+//
+// Creates a node from a graph spec element, "name[:key=value]...", e.g.
+// "delay-mfx:ms=20" or "kws:start=0:primary=1:interleaved=1". Returns
+// NULL and prints the reason for an unknown name or option.
+//
+CApoHostNode *ApoHost_CreateNode(const char *pszSpec, bool *pfInPlace);
+
+//
+// Prints the node names and options ApoHost_CreateNode knows.
+//
+void ApoHost_PrintNodes();
+
+//-------------------------------------------------------------------------
+// Interleaved float audio, the unit WAV files are read to and written from.
+//
+typedef struct APOHOST_AUDIO
+{
+    uint32_t            u32FramesPerSecond;
+    uint32_t            u32SamplesPerFrame;
+    std::vector<float>  Samples;
+
+    uint32_t GetFrameCount() const
+    {
+        return u32SamplesPerFrame ? (uint32_t)(Samples.size() / u32SamplesPerFrame) : 0;
+    }
+} APOHOST_AUDIO;
+
+//
+// Reads 16, 24 or 32-bit PCM or 32-bit float WAVE files, plain or
+// WAVE_FORMAT_EXTENSIBLE.
+//
+bool ApoHost_ReadWav(const char *pszPath, APOHOST_AUDIO *pAudio);
+
+//
+// Writes 32-bit float WAVE; the samples are stored bit for bit.
+//
+bool ApoHost_WriteWav(const char *pszPath, const APOHOST_AUDIO *pAudio);
+
+//
+// Deterministic test signals, "gen:kind:rate:channels:seconds", where kind
+// is one of:
+//
+//  sine    a different tone per channel
+//  noise   white noise
+//  speech  amplitude modulated harmonic bursts with silent gaps
+//
+// Samples are 16-bit values scaled to float, so the signal is the same bit
+// for bit on every host and compiler.
+//
+bool ApoHost_Generate(const char *pszSpec, APOHOST_AUDIO *pAudio);
+
+//
+// Loads "gen:..." specs with ApoHost_Generate and anything else as a file.
+//
+bool ApoHost_LoadAudio(const char *pszSource, APOHOST_AUDIO *pAudio);
+
+//
+// 64-bit FNV-1a over the bit patterns of the samples.
+//
+uint64_t ApoHost_HashSamples(const float *pf32Samples, size_t cSamples);
+
+//-------------------------------------------------------------------------
+// Measurement.
+//
+
+//
+// Cycle counter: TSC on x86, the virtual counter on ARM64, nanoseconds
+// elsewhere.
+//
+uint64_t ApoHost_ReadCycles();
+const char *ApoHost_CycleUnit();
+
+//
+// Monotonic time in nanoseconds.
+//
+uint64_t ApoHost_ReadNanoseconds();
+
+//
+// Heap allocations (malloc, calloc, realloc, aligned allocations and
+// operator new) made by this process so far.
+//
+uint64_t ApoHost_AllocationCount();
+
+//
+// Summary of per-period samples, e.g. cycles.
+//
+typedef struct APOHOST_STATS
+{
+    uint64_t    u64Min;
+    uint64_t    u64Median;
+    uint64_t    u64P99;
+    uint64_t    u64Max;
+    double      dMean;
+} APOHOST_STATS;
+
+void ApoHost_Summarize(std::vector<uint64_t> &Values, APOHOST_STATS *pStats);
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  A chain of nodes driven with one input (and optionally a loopback)
+//  period by period.
+//
+class CApoHostGraph
+{
+public:
+    CApoHostGraph();
+    ~CApoHostGraph();
+
+    //
+    // Parses a comma separated chain of node specs.
+    //
+    bool Create(const char *pszGraph);
+
+    //
+    // Allocates the connection buffers and locks every node for the input
+    // format. u32PeriodFrames is the engine period.
+    //
+    bool LockForProcess(uint32_t u32FramesPerSecond, uint32_t u32SamplesPerFrame, uint32_t u32PeriodFrames);
+
+    //
+    // Flags periods of digital silence BUFFER_SILENT, as the engine does,
+    // and optionally fills them with NaNs so a node that reads a silent
+    // buffer shows up in the output.
+    //
+    void SetSilenceFlags(bool fFlagSilence, bool fPoisonSilence)
+    {
+        m_fFlagSilence = fFlagSilence;
+        m_fPoisonSilence = fPoisonSilence;
+    }
+
+    //
+    // Runs the whole input through the graph. pLoopback, if given, is
+    // delivered to the nodes that take one, with the same timestamps as
+    // the input. Returns false if the input format does not match Lock.
+    //
+    bool Run(const APOHOST_AUDIO *pInput, const APOHOST_AUDIO *pLoopback, APOHOST_AUDIO *pOutput);
+
+    uint32_t GetOutputSamplesPerFrame() const { return m_OutputFormat.u32SamplesPerFrame; }
+
+    //
+    // Per-period measurements of the last Run.
+    //
+    const std::vector<uint64_t> &GetPeriodCycles() const { return m_PeriodCycles; }
+    uint64_t GetProcessNanoseconds() const { return m_u64ProcessNanoseconds; }
+    uint64_t GetProcessAllocations() const { return m_u64ProcessAllocations; }
+    uint64_t GetNodeCycles(size_t iNode) const { return m_NodeCycles[iNode]; }
+    size_t GetNodeCount() const { return m_Nodes.size(); }
+    const char *GetNodeName(size_t iNode) const { return m_Nodes[iNode]->GetName(); }
+
+    //
+    // Prints the measurements of the last Run.
+    //
+    void PrintReport(const APOHOST_AUDIO *pInput) const;
+
+private:
+    void Destroy();
+
+private:
+    std::vector<CApoHostNode *>     m_Nodes;
+    std::vector<bool>               m_InPlace;          // per node
+    std::vector<APOHOST_FORMAT>     m_Formats;          // per connection, node k reads k and writes k + 1
+    std::vector<APO_CONNECTION_PROPERTY_V2> m_Connections;
+    std::vector<float *>            m_Buffers;          // allocated connection buffers, 64-byte aligned
+    APO_CONNECTION_PROPERTY_V2      m_Loopback;
+    float *                         m_pf32LoopbackBuffer;
+    uint32_t                        m_u32LoopbackSamplesPerFrame;
+    uint32_t                        m_u32PeriodFrames;
+    APOHOST_FORMAT                  m_InputFormat;
+    APOHOST_FORMAT                  m_OutputFormat;
+    bool                            m_fFlagSilence;
+    bool                            m_fPoisonSilence;
+
+    std::vector<uint64_t>           m_PeriodCycles;
+    std::vector<uint64_t>           m_NodeCycles;
+    uint64_t                        m_u64ProcessNanoseconds;
+    uint64_t                        m_u64ProcessAllocations;
+};
@@ -0,0 +1,84 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    CodecHost.h
+//
+// Abstract:    The kernel types, SAL annotations and Rtl routines the
+//              driver's Bluetooth codec headers (EndpointsCommon/SbcCodec.h,
+//              HfpCodec.h, A2dpSbcEncoder.h) use, mapped onto the C
+//              runtime so the headers compile unchanged on the host.
+//
+//              Include this after any C++ library header: it defines the
+//              min and max macros the driver code expects.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef void                VOID;
+typedef void *              PVOID;
+typedef uint8_t             BYTE;
+typedef uint8_t             BOOLEAN;
+typedef uint8_t             UINT8;
+typedef int8_t              INT8;
+typedef int16_t             INT16;
+typedef uint16_t            USHORT;
+typedef int32_t             INT32;
+typedef int32_t             LONG;
+typedef uint32_t            ULONG;
+typedef int64_t             LONGLONG;
+typedef uint64_t            ULONGLONG;
+
+#ifndef TRUE
+#define TRUE                1
+#define FALSE               0
+#endif
+
+#define _In_
+#define _In_opt_
+#define _Out_
+#define _Inout_
+#define _In_reads_(n)
+#define _In_reads_opt_(n)
+#define _In_reads_bytes_(n)
+#define _Out_writes_(n)
+#define _Out_writes_bytes_(n)
+#define _Inout_updates_(n)
+
+#define RtlCopyMemory(d, s, n)      memcpy((d), (s), (n))
+#define RtlMoveMemory(d, s, n)      memmove((d), (s), (n))
+#define RtlZeroMemory(d, n)         memset((d), 0, (n))
+
+#ifndef min
+#define min(a, b)           (((a) < (b)) ? (a) : (b))
+#define max(a, b)           (((a) > (b)) ? (a) : (b))
+#endif
+
+//
+// The stages are single producer, single consumer; the host runs both
+// sides on one thread.
+//
+inline LONG InterlockedExchange(LONG volatile *Target, LONG Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange(LONG volatile *Target, LONG Exchange, LONG Comparand)
+{
+    __atomic_compare_exchange_n(Target, &Comparand, Exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comparand;
+}
+
+inline LONG InterlockedIncrement(LONG volatile *Target)
+{
+    return __atomic_add_fetch(Target, 1, __ATOMIC_SEQ_CST);
+}
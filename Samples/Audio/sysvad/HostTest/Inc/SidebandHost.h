@@ -0,0 +1,411 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    SidebandHost.h
+//
+// Abstract:    User-mode stand-in for the sideband audio stacks the sample
+//              talks to: the A2DP sideband and USB sideband interfaces
+//              (IOCTL_SBAUD_*) and the BT HFP SCO bypass interface
+//              (IOCTL_BTHHFP_*).
+//
+//              A CSidebandFakeDevice is one arrival of a sideband
+//              interface. It answers the IOCTLs the device classes send,
+//              with the same completion rules as the real stacks: size
+//              queries that fail with STATUS_BUFFER_TOO_SMALL, status
+//              updates that complete at once when bImmediate is set and
+//              otherwise pend until the value changes, stream open, start,
+//              suspend and close, and the claimed state. Every IOCTL takes
+//              a configurable time on a virtual microsecond clock, and the
+//              device's control channel handles one IOCTL at a time.
+//
+//              The fake also checks the caller: an IOCTL the stack does not
+//              implement, a stream call out of order or a second status
+//              request of a kind already pending is a contract violation.
+//
+//              SidebandDevices.cpp models the IOCTL sequences of
+//              A2dpHpDevice, UsbHsDevice and BthHfpDevice and the adapter's
+//              arrival/removal work items on top of it; it is a copy, not
+//              the driver's code. Everything runs on one event queue in
+//              virtual time, so a run depends only on its seed.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+//-------------------------------------------------------------------------
+// Status codes, as declared by ntstatus.h.
+//
+typedef int32_t NTSTATUS;
+
+#define NT_SUCCESS(Status)              (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_PENDING                  ((NTSTATUS)0x00000103L)
+#define STATUS_DEVICE_BUSY              ((NTSTATUS)0x80000011L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_SUCH_DEVICE           ((NTSTATUS)0xC000000EL)
+#define STATUS_INVALID_DEVICE_REQUEST   ((NTSTATUS)0xC0000010L)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023L)
+#define STATUS_CANCELLED                ((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE     ((NTSTATUS)0xC0000184L)
+
+//-------------------------------------------------------------------------
+// The IOCTLs of sidebandaudio.h and bthhfpddi.h that the sample sends.
+//
+typedef enum SIDEBANDHOST_IOCTL
+{
+    IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR,
+    IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2,
+    IOCTL_SBAUD_GET_SUPPORTED_FORMATS,
+    IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES,
+    IOCTL_SBAUD_GET_MUTEPROPERTYVALUES,
+    IOCTL_SBAUD_SET_VOLUME,
+    IOCTL_SBAUD_SET_MUTE,
+    IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE,
+    IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE,
+    IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE,
+    IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE,
+    IOCTL_SBAUD_GET_SIOP,
+    IOCTL_SBAUD_SET_SIOP,
+    IOCTL_SBAUD_GET_SIOP_UPDATE,
+    IOCTL_SBAUD_STREAM_OPEN,
+    IOCTL_SBAUD_STREAM_START,
+    IOCTL_SBAUD_STREAM_SUSPEND,
+    IOCTL_SBAUD_STREAM_CLOSE,
+    IOCTL_SBAUD_SET_DEVICE_CLAIMED,
+
+    IOCTL_BTHHFP_DEVICE_INDICATE_AUDIO_DEVICE_CAPABILITIES,
+    IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2,
+    IOCTL_BTHHFP_DEVICE_GET_VOLUMEPROPERTYVALUES,
+    IOCTL_BTHHFP_SPEAKER_SET_VOLUME,
+    IOCTL_BTHHFP_MIC_SET_VOLUME,
+    IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE,
+    IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE,
+    IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE,
+    IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE,
+    IOCTL_BTHHFP_DEVICE_GET_CODEC_ID,
+    IOCTL_BTHHFP_DEVICE_REQUEST_CONNECT,
+    IOCTL_BTHHFP_DEVICE_REQUEST_DISCONNECT,
+    IOCTL_BTHHFP_STREAM_OPEN,
+    IOCTL_BTHHFP_STREAM_CLOSE,
+    IOCTL_BTHHFP_STREAM_GET_STATUS_UPDATE,
+
+    SIDEBANDHOST_IOCTL_COUNT
+} SIDEBANDHOST_IOCTL;
+
+const char *SidebandHost_IoctlName(SIDEBANDHOST_IOCTL Ioctl);
+
+//-------------------------------------------------------------------------
+// The three sideband interfaces.
+//
+typedef enum SIDEBANDHOST_PROFILE
+{
+    SIDEBANDHOST_A2DP,          // GUID_DEVINTERFACE_A2DP_SIDEBAND_AUDIO
+    SIDEBANDHOST_USB,           // GUID_DEVINTERFACE_USB_SIDEBAND_AUDIO_HS_HCIBYPASS
+    SIDEBANDHOST_HFP,           // GUID_DEVINTERFACE_BLUETOOTH_HFP_SCO_HCIBYPASS
+    SIDEBANDHOST_PROFILE_COUNT
+} SIDEBANDHOST_PROFILE;
+
+const char *SidebandHost_ProfileName(SIDEBANDHOST_PROFILE Profile);
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  What a fake interface reports and how long its IOCTLs take. Latencies
+//  are in microseconds of virtual time, from the IOCTL reaching the
+//  device's control channel to its completion.
+//
+typedef struct SIDEBANDHOST_DEVICE_CONFIG
+{
+    SIDEBANDHOST_PROFILE    Profile;
+
+    //
+    // Seed of the descriptors. Two arrivals with the same identity are the
+    // same headset: same container id, same endpoint descriptors.
+    //
+    uint32_t                u32Identity;
+
+    bool                    fSpeaker;
+    bool                    fMic;
+    bool                    fVolume;
+    bool                    fMute;
+    bool                    fConnected;         // HFP: service level connection up
+    bool                    fCodecId;           // HFP: IOCTL_BTHHFP_DEVICE_GET_CODEC_ID implemented
+
+    uint32_t                u32ControlUs;       // any other IOCTL
+    uint32_t                u32DescriptorUs;    // device and endpoint descriptors
+    uint32_t                u32FormatsUs;       // supported formats intersection
+    uint32_t                u32StreamOpenUs;    // AVDTP open / USB alternate setting / SCO setup
+    uint32_t                u32StreamStartUs;   // AVDTP start / first isochronous transfer
+} SIDEBANDHOST_DEVICE_CONFIG;
+
+//
+// Latencies typical of each stack, with a speaker and (USB, HFP) a mic
+// that support volume and (A2DP, USB) mute.
+//
+void SidebandHost_DefaultConfig(SIDEBANDHOST_PROFILE Profile, uint32_t u32Identity, SIDEBANDHOST_DEVICE_CONFIG *pConfig);
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  The input and output of one IOCTL. The real buffers are structures of
+//  sidebandaudio.h and bthhfpddi.h; the fake only needs their fields that
+//  change what the device classes do next.
+//
+// IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2 i32Value
+#define SIDEBANDHOST_EP_CAPTURE     0x1     // KSPIN_DATAFLOW_IN, else OUT
+#define SIDEBANDHOST_EP_VOLUME      0x2     // Capabilities.Volume
+#define SIDEBANDHOST_EP_MUTE        0x4     // Capabilities.Mute
+
+typedef struct SIDEBANDHOST_BUFFER
+{
+    uint32_t    u32EndpointIndex;   // SBAUD: endpoint the IOCTL addresses
+    bool        fImmediate;         // status updates: return the current value, don't pend
+    int32_t     i32Value;           // volume, mute, connection, codec id, claimed...
+    uint32_t    cbOutput;           // 0 for a size query
+    uint32_t    cbInformation;      // out: bytes returned, or needed
+    uint32_t    u32Hash;            // out: digest of a descriptor's contents
+} SIDEBANDHOST_BUFFER;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Virtual time. Events run in time order, ties in the order they were
+//  posted.
+//
+class CSidebandHostScheduler
+{
+public:
+    CSidebandHostScheduler() : m_u64NowUs(0), m_u64Sequence(0) {}
+
+    uint64_t GetNowUs() const { return m_u64NowUs; }
+
+    void Post(uint64_t u64AtUs, std::function<void()> Event);
+
+    //
+    // Runs events until none is left at or before u64UntilUs.
+    //
+    void RunUntil(uint64_t u64UntilUs);
+
+private:
+    struct EVENT
+    {
+        uint64_t                u64AtUs;
+        uint64_t                u64Sequence;
+        std::function<void()>   Event;
+    };
+
+    uint64_t            m_u64NowUs;
+    uint64_t            m_u64Sequence;
+    std::vector<EVENT>  m_Events;       // heap, earliest first
+};
+
+class CSidebandFakeDevice;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  An asynchronous request, the WDFREQUEST the device classes allocate
+//  once per status kind and re-send after every completion.
+//
+typedef struct SIDEBANDHOST_REQUEST
+{
+    SIDEBANDHOST_IOCTL                                      Ioctl;
+    SIDEBANDHOST_BUFFER                                     Buffer;
+    std::function<void(SIDEBANDHOST_REQUEST *, NTSTATUS)>   Completion;
+
+    // owned by the fake
+    bool                                                    fPending;
+    uint32_t                                                u32Sends;
+} SIDEBANDHOST_REQUEST;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  Counters of one fake interface, or summed over many.
+//
+typedef struct SIDEBANDHOST_COUNTERS
+{
+    uint64_t    u64Ioctls;              // synchronous and asynchronous
+    uint64_t    u64Removed;             // failed because the interface was gone, or went away
+    uint64_t    u64Violations;          // IOCTLs the contract does not allow
+    uint64_t    u64Completions;         // status updates completed with a new value
+    uint64_t    u64PerIoctl[SIDEBANDHOST_IOCTL_COUNT];
+} SIDEBANDHOST_COUNTERS;
+
+void SidebandHost_AddCounters(SIDEBANDHOST_COUNTERS *pTotal, const SIDEBANDHOST_COUNTERS *pCounters);
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  One arrival of a sideband interface, from its arrival to the removal
+//  of its device interface. Completions of pended requests are posted to
+//  the scheduler.
+//
+class CSidebandFakeDevice
+{
+public:
+    CSidebandFakeDevice(CSidebandHostScheduler *pScheduler, const SIDEBANDHOST_DEVICE_CONFIG *pConfig);
+
+    const SIDEBANDHOST_DEVICE_CONFIG &GetConfig() const { return m_Config; }
+    const SIDEBANDHOST_COUNTERS &GetCounters() const { return m_Counters; }
+
+    //
+    // Sends a synchronous IOCTL at u64IssueUs. Returns its status and, in
+    // *pu64DoneUs, when it completed; the caller's thread is blocked until
+    // then.
+    //
+    NTSTATUS Ioctl(
+        SIDEBANDHOST_IOCTL Ioctl,
+        uint64_t u64IssueUs,
+        SIDEBANDHOST_BUFFER *pBuffer,
+        uint64_t *pu64DoneUs);
+
+    //
+    // Sends pRequest, WdfRequestSend style. Returns false if it could not
+    // be sent; otherwise the request completes through its Completion.
+    //
+    bool Send(SIDEBANDHOST_REQUEST *pRequest, uint64_t u64IssueUs);
+
+    //
+    // WdfRequestCancelSentRequest and WdfIoTargetPurge: pended requests
+    // complete with STATUS_CANCELLED before these return. After a purge the
+    // target takes no more requests.
+    //
+    void Cancel(SIDEBANDHOST_REQUEST *pRequest);
+    void Purge();
+
+    //
+    // The remote side, at the scheduler's time: a value a status update
+    // reports changes, e.g. the user turns the headset's volume knob. A
+    // pended update for it completes.
+    //
+    void ChangeStatus(SIDEBANDHOST_IOCTL UpdateIoctl, uint32_t u32EndpointIndex, int32_t i32Value);
+
+    //
+    // The device interface goes away at u64AtUs, which may be ahead of the
+    // scheduler: a device class still in a synchronous IOCTL at that time
+    // sees it fail. Later IOCTLs fail at once, and the stack fails the
+    // requests it has pended.
+    //
+    void Remove(uint64_t u64AtUs);
+    bool IsRemoved(uint64_t u64AtUs) const { return u64AtUs >= m_u64RemovalUs; }
+
+    uint32_t GetPendingCount() const { return (uint32_t)m_Pending.size(); }
+
+    bool IsClaimed() const { return m_fClaimed; }
+    bool IsStreamOpen() const;
+
+private:
+    bool IsImplemented(SIDEBANDHOST_IOCTL Ioctl) const;
+    uint32_t GetLatencyUs(SIDEBANDHOST_IOCTL Ioctl) const;
+    int StatusSlot(SIDEBANDHOST_IOCTL UpdateIoctl, uint32_t u32EndpointIndex) const;
+    NTSTATUS Execute(SIDEBANDHOST_IOCTL Ioctl, SIDEBANDHOST_BUFFER *pBuffer);
+    void Complete(SIDEBANDHOST_REQUEST *pRequest, NTSTATUS Status);
+    void Violation(SIDEBANDHOST_IOCTL Ioctl, const char *pszWhy);
+
+    // status kinds an update can be pended for, per endpoint
+    enum { STATUS_SLOTS = 16 };
+
+    CSidebandHostScheduler         *m_pScheduler;
+    SIDEBANDHOST_DEVICE_CONFIG      m_Config;
+    SIDEBANDHOST_COUNTERS           m_Counters;
+    uint32_t                        m_cEndpoints;
+    uint64_t                        m_u64ChannelFreeUs;
+    uint64_t                        m_u64RemovalUs;
+    bool                            m_fPurged;
+    bool                            m_fClaimed;
+    bool                            m_afStreamOpen[2];
+    bool                            m_afStreamStarted[2];
+    int32_t                         m_ai32Status[STATUS_SLOTS];
+    std::vector<SIDEBANDHOST_REQUEST *> m_Pending;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  The audio engine's view of one sideband device: when its endpoints
+//  appeared, when a stream first started on them.
+//
+typedef struct SIDEBANDHOST_ARRIVAL
+{
+    SIDEBANDHOST_PROFILE    Profile;
+    uint64_t                u64ArrivalUs;
+    uint64_t                u64RemovalUs;       // UINT64_MAX while present
+    uint64_t                u64StartedUs;       // Start done, UINT64_MAX if it never was
+    uint64_t                u64FirstAudioUs;    // first stream started, UINT64_MAX if none
+    bool                    fCachedDiscovery;   // USB: formats and minipairs from the cache
+    bool                    fStartFailed;
+    bool                    fStreamFailed;      // the engine's StreamOpen or StreamStart failed
+} SIDEBANDHOST_ARRIVAL;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  The sample's adapter, reduced to its sideband paths: the interface
+//  arrival and removal notifications, one serial work item per profile
+//  that runs device Start and Stop, and the USB discovery cache. Behind
+//  each device's endpoints sits an audio engine stand-in that opens and
+//  starts a stream as soon as the device is running, and stops it when the
+//  endpoints go away.
+//
+class CSidebandHostAdapter
+{
+public:
+    virtual ~CSidebandHostAdapter() {}
+
+    //
+    // The interface notifications, delivered at the scheduler's current
+    // time. pDevice stays owned by the caller and must outlive the adapter.
+    // An arrival for a symbolic link already present is ignored.
+    //
+    virtual void InterfaceArrival(uint32_t u32SymbolicLink, CSidebandFakeDevice *pDevice) = 0;
+    virtual void InterfaceRemoval(uint32_t u32SymbolicLink) = 0;
+
+    //
+    // Stops every device still present, as adapter cleanup does. Run the
+    // scheduler afterwards to let the work items finish.
+    //
+    virtual void Cleanup() = 0;
+
+    //
+    // The engine stops and closes its stream on the device's render
+    // endpoint and opens and starts it again, as when playback ends and
+    // another begins.
+    //
+    virtual void RestartStream(uint32_t u32SymbolicLink) = 0;
+
+    virtual const std::vector<SIDEBANDHOST_ARRIVAL> &GetArrivals() const = 0;
+
+    //
+    // Requests still pending on the interface of a device when it was
+    // destroyed. Anything but zero is a leak.
+    //
+    virtual uint64_t GetLeakedRequests() const = 0;
+
+    //
+    // Status updates of the running devices, now, that are neither pended
+    // on the interface nor queued for the work item: a change on the
+    // headset would go unnoticed. Anything but zero is a bug.
+    //
+    virtual uint32_t CountStalledNotifications() const = 0;
+
+    virtual uint64_t GetUsbCacheHits() const = 0;
+};
+
+//
+// fUsbCache: cache USB discovery results across reconnects. Without it
+// every arrival does the full discovery, as before the cache was added.
+//
+CSidebandHostAdapter *SidebandHost_CreateAdapter(CSidebandHostScheduler *pScheduler, bool fUsbCache);
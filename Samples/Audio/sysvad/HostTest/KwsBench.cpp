@@ -0,0 +1,317 @@
+//
+// KwsBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   KWS APO cost per 10 ms period: the per-sample loop the APO used to run
+//   to pull the primary channels out of each frame, against
+//   ApoDsp_ExtractPrimaryChannels, over the keyword and raw capture formats
+//   of the mic array endpoints.
+//
+//   Both run on the same input and their outputs are compared bit for bit,
+//   so the benchmark also fails if the two ever disagree.
+//
+//   Then the cost of the driver's feature front end (KwsFeatures.h) per
+//   10 ms keyword packet, on the 16-bit samples DpcRoutine hands it. The
+//   run fails if a packet allocates, if a feature is not finite, or if the
+//   log-mel peak of a tone is not in the band holding the tone.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include <ApoDsp.h>
+#include <KwsFeatures.h>
+
+#include "ApoHost.h"
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  KWSApo.cpp ProcessKWS before the gather kernels: one sample at a time,
+//  with the channel loop bounds recomputed on every frame.
+//
+static void __attribute__((noinline)) ProcessKWSPerSample(
+    float *pf32OutputFrames,
+    const float *pf32InputFrames,
+    uint32_t u32ValidFrameCount,
+    uint32_t u32PrimaryChannelStart,
+    uint32_t u32PrimaryChannelCount,
+    uint32_t u32TotalChannelCount )
+{
+    while (u32ValidFrameCount--)
+    {
+        for (uint32_t i = u32PrimaryChannelStart; i < u32PrimaryChannelStart + u32PrimaryChannelCount; i++)
+        {
+            *pf32OutputFrames = *(pf32InputFrames + i);
+            pf32OutputFrames++;
+        }
+        pf32InputFrames += u32TotalChannelCount;
+    }
+}
+
+typedef struct BENCH_FORMAT
+{
+    const char *pszName;
+    uint32_t    u32FramesPerSecond;
+    uint32_t    u32PrimaryChannelStart;
+    uint32_t    u32PrimaryChannelCount;
+    uint32_t    u32TotalChannelCount;
+    bool        fInPlace;
+} BENCH_FORMAT;
+
+static const BENCH_FORMAT g_aFormats[] =
+{
+    // micarray2wavtable.h KeywordPin2: four mics, then the interleaved loopback
+    { "micarray2 keyword",  16000, 0, 4, 6, false },
+    // single and dual mic keyword pins with an interleaved loopback
+    { "mono keyword",       16000, 0, 1, 2, false },
+    { "stereo keyword",     16000, 0, 2, 4, false },
+    // raw mic array capture: no loopback, every channel is primary
+    { "micarray2 raw",      48000, 0, 2, 2, false },
+    { "micarray2 raw",      48000, 0, 2, 2, true  },
+    { "micarray3 raw",      48000, 0, 4, 4, false },
+    { "micarray3 raw",      48000, 0, 4, 4, true  },
+};
+
+static void RunBench(
+    const BENCH_FORMAT *pFormat,
+    bool fGather,
+    uint32_t u32Periods,
+    std::vector<float> *pOutput,
+    APOHOST_STATS *pStats)
+{
+    uint32_t u32PeriodFrames = pFormat->u32FramesPerSecond / 100;
+    size_t cInSamples = (size_t)u32PeriodFrames * pFormat->u32TotalChannelCount;
+    size_t cOutSamples = (size_t)u32PeriodFrames * pFormat->u32PrimaryChannelCount;
+
+    std::vector<float> InBuffer(cInSamples), OutBuffer(cOutSamples);
+    std::vector<uint64_t> Cycles(u32Periods);
+    uint32_t u32Seed = 0x13579bdf;
+
+    pOutput->assign(cOutSamples * u32Periods, 0.0f);
+
+    for (uint32_t u32Period = 0; u32Period < u32Periods; u32Period++)
+    {
+        // the engine fills the input connection
+        for (float &f32Sample : InBuffer)
+        {
+            u32Seed = u32Seed * 1664525u + 1013904223u;
+            f32Sample = (float)(int16_t)(u32Seed >> 16) / 32768.0f;
+        }
+
+        const float *pf32In = InBuffer.data();
+        float *pf32Out = pFormat->fInPlace ? InBuffer.data() : OutBuffer.data();
+        uint64_t u64Start = ApoHost_ReadCycles();
+
+        if (fGather)
+        {
+            ApoDsp_ExtractPrimaryChannels(pf32Out, pf32In, u32PeriodFrames, pFormat->u32PrimaryChannelStart,
+                                          pFormat->u32PrimaryChannelCount, pFormat->u32TotalChannelCount);
+        }
+        else
+        {
+            ProcessKWSPerSample(pf32Out, pf32In, u32PeriodFrames, pFormat->u32PrimaryChannelStart,
+                                pFormat->u32PrimaryChannelCount, pFormat->u32TotalChannelCount);
+        }
+
+        Cycles[u32Period] = ApoHost_ReadCycles() - u64Start;
+
+        memcpy(&(*pOutput)[cOutSamples * u32Period], pf32Out, sizeof(float) * cOutSamples);
+    }
+
+    ApoHost_Summarize(Cycles, pStats);
+}
+
+//
+// Mel band whose center is closest to dHz, as Initialize lays them out.
+//
+static uint32_t NearestMelBand(double dHz)
+{
+    double dMelLow = 2595.0 * log10(1.0 + KWSFEATURES_MEL_LOW_HZ / 700.0);
+    double dMelHigh = 2595.0 * log10(1.0 + KWSFEATURES_MEL_HIGH_HZ / 700.0);
+    double dMel = 2595.0 * log10(1.0 + dHz / 700.0);
+    double dBand = (dMel - dMelLow) / (dMelHigh - dMelLow) * (KWSFEATURES_MEL_BANDS + 1) - 1;
+
+    return (uint32_t)fmin(fmax(dBand + 0.5, 0.0), KWSFEATURES_MEL_BANDS - 1);
+}
+
+static bool RunFeatures(const char *pszSignal, uint32_t u32Seconds, CKwsFeatureExtractor *pExtractor)
+{
+    char szSpec[64];
+    APOHOST_AUDIO Audio;
+
+    if (strcmp(pszSignal, "silence") == 0)
+    {
+        Audio.u32FramesPerSecond = KWSFEATURES_SAMPLE_RATE;
+        Audio.u32SamplesPerFrame = 1;
+        Audio.Samples.assign((size_t)u32Seconds * KWSFEATURES_SAMPLE_RATE, 0.0f);
+    }
+    else
+    {
+        snprintf(szSpec, sizeof(szSpec), "gen:%s:%u:1:%u", pszSignal, KWSFEATURES_SAMPLE_RATE, u32Seconds);
+        if (!ApoHost_Generate(szSpec, &Audio))
+        {
+            return false;
+        }
+    }
+
+    // the keyword packets are 16-bit PCM
+    std::vector<int16_t> Samples(Audio.Samples.size());
+    for (size_t n = 0; n < Samples.size(); n++)
+    {
+        Samples[n] = (int16_t)fmax(fmin(Audio.Samples[n] * 32768.0f, 32767.0f), -32768.0f);
+    }
+
+    uint32_t u32Packets = (uint32_t)(Samples.size() / KWSFEATURES_HOP_SAMPLES);
+    std::vector<KWSFEATURES_FRAME> Frames(u32Packets);
+    std::vector<uint64_t> Cycles(u32Packets);
+
+    pExtractor->Reset();
+
+    uint64_t u64Allocations = ApoHost_AllocationCount();
+    uint64_t u64Nanoseconds = ApoHost_ReadNanoseconds();
+
+    for (uint32_t u32Packet = 0; u32Packet < u32Packets; u32Packet++)
+    {
+        uint64_t u64Start = ApoHost_ReadCycles();
+        pExtractor->ProcessPacket(&Samples[(size_t)u32Packet * KWSFEATURES_HOP_SAMPLES], &Frames[u32Packet]);
+        Cycles[u32Packet] = ApoHost_ReadCycles() - u64Start;
+    }
+
+    u64Nanoseconds = ApoHost_ReadNanoseconds() - u64Nanoseconds;
+    u64Allocations = ApoHost_AllocationCount() - u64Allocations;
+
+    APOHOST_STATS Stats;
+    ApoHost_Summarize(Cycles, &Stats);
+
+    double dNsPerPacket = (double)u64Nanoseconds / u32Packets;
+    printf("%-10s %10llu %10llu %10.0f %10.0f %9.2f%% %7llu\n",
+           pszSignal, (unsigned long long)Stats.u64Median, (unsigned long long)Stats.u64P99, Stats.dMean,
+           dNsPerPacket, dNsPerPacket / 1e5, (unsigned long long)u64Allocations);
+
+    bool fPassed = true;
+    if (u64Allocations != 0)
+    {
+        fprintf(stderr, "FAIL: %s: ProcessPacket allocated\n", pszSignal);
+        fPassed = false;
+    }
+
+    for (const KWSFEATURES_FRAME &Frame : Frames)
+    {
+        bool fFinite = true;
+        for (float f32Value : Frame.LogMel)
+        {
+            fFinite = fFinite && isfinite(f32Value);
+        }
+        for (float f32Value : Frame.Mfcc)
+        {
+            fFinite = fFinite && isfinite(f32Value);
+        }
+        if (!fFinite)
+        {
+            fprintf(stderr, "FAIL: %s: packet %zu has a feature that is not finite\n", pszSignal, &Frame - Frames.data());
+            fPassed = false;
+            break;
+        }
+    }
+
+    // gen:sine channel 0 is a 281 Hz tone; once the window is full its
+    // energy must peak in that band or, at the bin resolution, a neighbour
+    if (strcmp(pszSignal, "sine") == 0)
+    {
+        const KWSFEATURES_FRAME &Frame = Frames[u32Packets / 2];
+        uint32_t u32Peak = 0;
+        for (uint32_t b = 1; b < KWSFEATURES_MEL_BANDS; b++)
+        {
+            if (Frame.LogMel[b] > Frame.LogMel[u32Peak])
+            {
+                u32Peak = b;
+            }
+        }
+
+        uint32_t u32Expected = NearestMelBand(281.0);
+        if (u32Peak + 1 < u32Expected || u32Peak > u32Expected + 1)
+        {
+            fprintf(stderr, "FAIL: sine: log-mel peaks in band %u, expected band %u\n", u32Peak, u32Expected);
+            fPassed = false;
+        }
+    }
+
+    return fPassed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Periods = 3000;
+    if (argc > 2 && strcmp(argv[1], "--periods") == 0)
+    {
+        u32Periods = (uint32_t)strtoul(argv[2], NULL, 0);
+    }
+
+    int iResult = 0;
+
+    printf("primary channel extraction, 10 ms periods, %u periods; %s per period\n\n", u32Periods, ApoHost_CycleUnit());
+    printf("%-18s %-17s %-11s %10s %10s %10s %8s\n",
+           "format", "layout", "kernel", "median", "p99", "mean", "speedup");
+
+    for (const BENCH_FORMAT &Format : g_aFormats)
+    {
+        std::vector<float> PerSampleOutput, GatherOutput;
+        APOHOST_STATS PerSample, Gather;
+
+        RunBench(&Format, false, u32Periods, &PerSampleOutput, &PerSample);
+        RunBench(&Format, true, u32Periods, &GatherOutput, &Gather);
+
+        char szLayout[32];
+        snprintf(szLayout, sizeof(szLayout), "%u of %u @%uk%s", Format.u32PrimaryChannelCount,
+                 Format.u32TotalChannelCount, Format.u32FramesPerSecond / 1000, Format.fInPlace ? " inpl" : "");
+
+        printf("%-18s %-17s %-11s %10llu %10llu %10.0f\n",
+               Format.pszName, szLayout, "per-sample",
+               (unsigned long long)PerSample.u64Median, (unsigned long long)PerSample.u64P99, PerSample.dMean);
+        printf("%-18s %-17s %-11s %10llu %10llu %10.0f %7.1fx\n",
+               Format.pszName, szLayout, "gather",
+               (unsigned long long)Gather.u64Median, (unsigned long long)Gather.u64P99, Gather.dMean,
+               (double)PerSample.u64Median / (Gather.u64Median ? Gather.u64Median : 1));
+
+        if (PerSampleOutput.size() != GatherOutput.size() ||
+            memcmp(PerSampleOutput.data(), GatherOutput.data(), sizeof(float) * GatherOutput.size()) != 0)
+        {
+            fprintf(stderr, "FAIL: %s, %s: outputs differ\n", Format.pszName, szLayout);
+            iResult = 1;
+        }
+    }
+
+    // front end; speech is 700 ms voiced and 300 ms silent every second
+    CKwsFeatureExtractor *pExtractor = new CKwsFeatureExtractor();
+    if (!pExtractor->Initialize())
+    {
+        fprintf(stderr, "FAIL: feature front-end initialization failed\n");
+        delete pExtractor;
+        return 1;
+    }
+
+    uint32_t u32Seconds = (u32Periods + 99) / 100;
+
+    printf("\nkeyword feature front end, %u s per signal, 10 ms packets; %s per packet\n\n",
+           u32Seconds, ApoHost_CycleUnit());
+    printf("%-10s %10s %10s %10s %10s %10s %7s\n",
+           "signal", "median", "p99", "mean", "ns/packet", "of packet", "allocs");
+
+    const char *apszSignals[] = { "speech", "noise", "sine", "silence" };
+    for (const char *pszSignal : apszSignals)
+    {
+        if (!RunFeatures(pszSignal, u32Seconds, pExtractor))
+        {
+            iResult = 1;
+        }
+    }
+
+    delete pExtractor;
+    return iResult;
+}
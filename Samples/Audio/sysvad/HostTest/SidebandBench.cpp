@@ -0,0 +1,543 @@
+//
+// SidebandBench.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   The model of the sideband device classes (SidebandDevices.cpp)
+//   against the fake interfaces, in virtual time. It evaluates the
+//   protocol the classes follow; it does not run the driver's code.
+//
+//   connect   one arrival per profile on an idle adapter: how long until
+//             Start is done and until the engine's first stream runs, and
+//             the IOCTLs it took. A USB headset is then unplugged and
+//             plugged back, with and without the discovery cache.
+//
+//   storm     headsets of every profile arrive and leave at random for
+//             --seconds of virtual time, some leaving during their Start
+//             or their first stream, some coming straight back; the
+//             headsets meanwhile change their volume and codec settings,
+//             and the engine ends and begins playback on them.
+//             Reported per profile: connect-to-first-audio percentiles,
+//             IOCTLs, IOCTLs that found the interface gone, contract
+//             violations, leaked requests and USB cache hits.
+//
+//   A run fails on a contract violation, a leaked or stalled request, a
+//   headset that stays longer than SIDEBANDBENCH_SETTLE_MS without a
+//   stream, a cache that does not save IOCTLs, or a storm that does not
+//   replay the same with the same seed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SidebandHost.h"
+
+// a headset present this long must be streaming
+#define SIDEBANDBENCH_SETTLE_MS     2000
+
+// headsets per profile in the storm, each on its own symbolic link
+#define SIDEBANDBENCH_SLOTS         3
+
+static uint32_t NextRandom(uint32_t *pu32Seed)
+{
+    *pu32Seed = *pu32Seed * 1664525u + 1013904223u;
+    return *pu32Seed >> 8;
+}
+
+// uniform in [u32Low, u32High]
+static uint32_t RandomRange(uint32_t *pu32Seed, uint32_t u32Low, uint32_t u32High)
+{
+    return u32Low + NextRandom(pu32Seed) % (u32High - u32Low + 1);
+}
+
+static uint64_t Percentile(std::vector<uint64_t> Values, double dFraction)
+{
+    if (Values.empty())
+    {
+        return 0;
+    }
+    std::sort(Values.begin(), Values.end());
+    size_t i = (size_t)(dFraction * (Values.size() - 1) + 0.5);
+    return Values[i];
+}
+
+//-------------------------------------------------------------------------
+// connect
+//
+typedef struct CONNECT_RESULT
+{
+    uint64_t    u64StartedUs;
+    uint64_t    u64FirstAudioUs;
+    uint64_t    u64Ioctls;
+    uint64_t    u64Violations;
+    bool        fCachedDiscovery;
+} CONNECT_RESULT;
+
+//
+// Plugs the headset in at the scheduler's time and lets it settle.
+//
+static CONNECT_RESULT Connect(CSidebandHostScheduler *pScheduler, CSidebandHostAdapter *pAdapter,
+                              CSidebandFakeDevice *pDevice, uint32_t u32SymbolicLink)
+{
+    CONNECT_RESULT Result = {};
+    uint64_t u64ArrivalUs = pScheduler->GetNowUs();
+
+    pAdapter->InterfaceArrival(u32SymbolicLink, pDevice);
+    pScheduler->RunUntil(u64ArrivalUs + SIDEBANDBENCH_SETTLE_MS * 1000ull);
+
+    const SIDEBANDHOST_ARRIVAL &Arrival = pAdapter->GetArrivals().back();
+    Result.u64StartedUs = Arrival.u64StartedUs - u64ArrivalUs;
+    Result.u64FirstAudioUs = Arrival.u64FirstAudioUs - u64ArrivalUs;
+    Result.u64Ioctls = pDevice->GetCounters().u64Ioctls;
+    Result.u64Violations = pDevice->GetCounters().u64Violations;
+    Result.fCachedDiscovery = Arrival.fCachedDiscovery;
+    return Result;
+}
+
+static void PrintConnect(const char *pszProfile, const char *pszCase, const CONNECT_RESULT *pResult)
+{
+    printf("%-6s %-22s %10.1f %14.1f %8llu\n", pszProfile, pszCase,
+           pResult->u64StartedUs / 1000.0, pResult->u64FirstAudioUs / 1000.0,
+           (unsigned long long)pResult->u64Ioctls);
+}
+
+static bool CheckConnect(const char *pszProfile, const char *pszCase, const CONNECT_RESULT *pResult)
+{
+    bool fPassed = true;
+
+    if (pResult->u64FirstAudioUs > SIDEBANDBENCH_SETTLE_MS * 1000ull)
+    {
+        fprintf(stderr, "FAIL: %s %s: no stream %u ms after arrival\n", pszProfile, pszCase, SIDEBANDBENCH_SETTLE_MS);
+        fPassed = false;
+    }
+    if (pResult->u64Violations != 0)
+    {
+        fprintf(stderr, "FAIL: %s %s: %llu contract violations\n", pszProfile, pszCase,
+                (unsigned long long)pResult->u64Violations);
+        fPassed = false;
+    }
+    return fPassed;
+}
+
+//
+// A USB headset plugged in, out and back in again; returns the second
+// arrival.
+//
+static bool UsbReconnect(bool fUsbCache, CONNECT_RESULT *pFirst, CONNECT_RESULT *pSecond)
+{
+    CSidebandHostScheduler Scheduler;
+    std::unique_ptr<CSidebandHostAdapter> Adapter(SidebandHost_CreateAdapter(&Scheduler, fUsbCache));
+    SIDEBANDHOST_DEVICE_CONFIG Config;
+
+    SidebandHost_DefaultConfig(SIDEBANDHOST_USB, 0x05b0, &Config);
+    CSidebandFakeDevice First(&Scheduler, &Config);
+    CSidebandFakeDevice Second(&Scheduler, &Config);
+
+    *pFirst = Connect(&Scheduler, Adapter.get(), &First, 1);
+
+    First.Remove(Scheduler.GetNowUs());
+    Adapter->InterfaceRemoval(1);
+    Scheduler.RunUntil(Scheduler.GetNowUs() + 1000000);
+
+    *pSecond = Connect(&Scheduler, Adapter.get(), &Second, 1);
+
+    Adapter->Cleanup();
+    Scheduler.RunUntil(UINT64_MAX);
+
+    bool fPassed = CheckConnect("usb", "first arrival", pFirst) &&
+                   CheckConnect("usb", "re-arrival", pSecond);
+    if (pSecond->fCachedDiscovery != fUsbCache)
+    {
+        fprintf(stderr, "FAIL: usb re-arrival: discovery %s the cache\n", pSecond->fCachedDiscovery ? "taken from" : "not taken from");
+        fPassed = false;
+    }
+    return fPassed;
+}
+
+static bool RunConnect()
+{
+    bool fPassed = true;
+
+    printf("connect, one headset on an idle adapter; virtual time\n\n");
+    printf("%-6s %-22s %10s %14s %8s\n", "", "", "start ms", "first audio ms", "IOCTLs");
+
+    for (int p = 0; p < SIDEBANDHOST_PROFILE_COUNT; p++)
+    {
+        SIDEBANDHOST_PROFILE Profile = (SIDEBANDHOST_PROFILE)p;
+        CSidebandHostScheduler Scheduler;
+        std::unique_ptr<CSidebandHostAdapter> Adapter(SidebandHost_CreateAdapter(&Scheduler, true));
+        SIDEBANDHOST_DEVICE_CONFIG Config;
+
+        if (Profile == SIDEBANDHOST_USB)
+        {
+            continue;
+        }
+        SidebandHost_DefaultConfig(Profile, 0x1000 + p, &Config);
+        CSidebandFakeDevice Device(&Scheduler, &Config);
+
+        CONNECT_RESULT Result = Connect(&Scheduler, Adapter.get(), &Device, 1);
+        PrintConnect(SidebandHost_ProfileName(Profile), "arrival", &Result);
+        fPassed &= CheckConnect(SidebandHost_ProfileName(Profile), "arrival", &Result);
+
+        Adapter->Cleanup();
+        Scheduler.RunUntil(UINT64_MAX);
+        if (Adapter->GetLeakedRequests() != 0 || Device.GetPendingCount() != 0)
+        {
+            fprintf(stderr, "FAIL: %s: requests left pending after cleanup\n", SidebandHost_ProfileName(Profile));
+            fPassed = false;
+        }
+    }
+
+    CONNECT_RESULT Uncached, Cached, First;
+    fPassed &= UsbReconnect(false, &First, &Uncached);
+    fPassed &= UsbReconnect(true, &First, &Cached);
+    PrintConnect("usb", "arrival", &First);
+    PrintConnect("usb", "re-arrival, no cache", &Uncached);
+    PrintConnect("usb", "re-arrival, cached", &Cached);
+
+    if (Cached.u64Ioctls >= Uncached.u64Ioctls || Cached.u64StartedUs >= Uncached.u64StartedUs)
+    {
+        fprintf(stderr, "FAIL: usb: the discovery cache saves no IOCTLs or time\n");
+        fPassed = false;
+    }
+    printf("\n");
+    return fPassed;
+}
+
+//-------------------------------------------------------------------------
+// storm
+//
+typedef struct STORM_RESULT
+{
+    std::vector<SIDEBANDHOST_ARRIVAL>   Arrivals;
+    SIDEBANDHOST_COUNTERS               aCounters[SIDEBANDHOST_PROFILE_COUNT];
+    uint64_t                            u64Leaked;
+    uint64_t                            u64Stalled;
+    uint64_t                            u64CacheHits;
+    uint64_t                            u64EndUs;
+    uint64_t                            u64Digest;
+} STORM_RESULT;
+
+class CStorm
+{
+public:
+    CStorm(uint32_t u32Seed, uint32_t u32Seconds)
+        : m_u32Seed(u32Seed),
+          m_u64EndUs(u32Seconds * 1000000ull),
+          m_Adapter(SidebandHost_CreateAdapter(&m_Scheduler, true))
+    {
+        memset(m_aSlots, 0, sizeof(m_aSlots));
+    }
+
+    void Run(STORM_RESULT *pResult);
+
+private:
+    typedef struct SLOT
+    {
+        SIDEBANDHOST_PROFILE    Profile;
+        uint32_t                u32Identity;
+        CSidebandFakeDevice    *Device;     // NULL while unplugged
+    } SLOT;
+
+    void Arrive(int iSlot);
+    void Leave(int iSlot);
+    void ChangeStatus();
+    void RestartStream();
+
+    CSidebandHostScheduler          m_Scheduler;
+    uint32_t                        m_u32Seed;
+    uint64_t                        m_u64EndUs;
+    std::unique_ptr<CSidebandHostAdapter> m_Adapter;
+    SLOT                            m_aSlots[SIDEBANDHOST_PROFILE_COUNT * SIDEBANDBENCH_SLOTS];
+    std::vector<std::unique_ptr<CSidebandFakeDevice>> m_Devices;
+};
+
+void CStorm::Arrive(int iSlot)
+{
+    SLOT *pSlot = &m_aSlots[iSlot];
+    SIDEBANDHOST_DEVICE_CONFIG Config;
+
+    if (m_Scheduler.GetNowUs() >= m_u64EndUs)
+    {
+        return;
+    }
+
+    // now and then a different headset on the same port
+    if (pSlot->u32Identity == 0 || RandomRange(&m_u32Seed, 0, 3) == 0)
+    {
+        pSlot->u32Identity = (uint32_t)iSlot << 16 | RandomRange(&m_u32Seed, 1, 0xffff);
+    }
+    SidebandHost_DefaultConfig(pSlot->Profile, pSlot->u32Identity, &Config);
+    m_Devices.emplace_back(new CSidebandFakeDevice(&m_Scheduler, &Config));
+    pSlot->Device = m_Devices.back().get();
+
+    // some leave during Start or the first stream, most stay a while; the
+    // interface knows when, so that IOCTLs in flight then fail
+    uint32_t u32StayMs = RandomRange(&m_u32Seed, 0, 2) == 0 ? RandomRange(&m_u32Seed, 1, 200) : RandomRange(&m_u32Seed, 500, 4000);
+    uint64_t u64LeaveUs = m_Scheduler.GetNowUs() + u32StayMs * 1000ull;
+    pSlot->Device->Remove(u64LeaveUs);
+    m_Scheduler.Post(u64LeaveUs, [this, iSlot]() { Leave(iSlot); });
+
+    m_Adapter->InterfaceArrival(iSlot, pSlot->Device);
+    if (RandomRange(&m_u32Seed, 0, 15) == 0)
+    {
+        // PnP reports the interface twice
+        m_Adapter->InterfaceArrival(iSlot, pSlot->Device);
+    }
+}
+
+void CStorm::Leave(int iSlot)
+{
+    SLOT *pSlot = &m_aSlots[iSlot];
+
+    m_Adapter->InterfaceRemoval(iSlot);
+    pSlot->Device = NULL;
+
+    // quick re-plugs come straight back
+    uint32_t u32AwayMs = RandomRange(&m_u32Seed, 0, 2) == 0 ? RandomRange(&m_u32Seed, 1, 50) : RandomRange(&m_u32Seed, 100, 3000);
+    m_Scheduler.Post(m_Scheduler.GetNowUs() + u32AwayMs * 1000ull, [this, iSlot]() { Arrive(iSlot); });
+}
+
+//
+// A headset changes a value it reports: volume, and the A2DP codec or the
+// HFP echo cancellation setting.
+//
+void CStorm::ChangeStatus()
+{
+    if (m_Scheduler.GetNowUs() >= m_u64EndUs)
+    {
+        return;
+    }
+
+    SLOT *pSlot = &m_aSlots[RandomRange(&m_u32Seed, 0, SIDEBANDHOST_PROFILE_COUNT * SIDEBANDBENCH_SLOTS - 1)];
+    if (pSlot->Device != NULL)
+    {
+        int32_t i32Value = (int32_t)RandomRange(&m_u32Seed, 0, 100);
+        bool fOther = RandomRange(&m_u32Seed, 0, 1) != 0;
+
+        switch (pSlot->Profile)
+        {
+        case SIDEBANDHOST_A2DP:
+            pSlot->Device->ChangeStatus(fOther ? IOCTL_SBAUD_GET_SIOP_UPDATE : IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, 0, i32Value);
+            break;
+        case SIDEBANDHOST_USB:
+            pSlot->Device->ChangeStatus(IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, fOther ? 1 : 0, i32Value);
+            break;
+        default:
+            pSlot->Device->ChangeStatus(fOther ? IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE : IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE,
+                                        0, fOther ? i32Value & 1 : i32Value);
+            break;
+        }
+    }
+
+    m_Scheduler.Post(m_Scheduler.GetNowUs() + RandomRange(&m_u32Seed, 10, 200) * 1000ull, [this]() { ChangeStatus(); });
+}
+
+void CStorm::RestartStream()
+{
+    if (m_Scheduler.GetNowUs() >= m_u64EndUs)
+    {
+        return;
+    }
+
+    m_Adapter->RestartStream(RandomRange(&m_u32Seed, 0, SIDEBANDHOST_PROFILE_COUNT * SIDEBANDBENCH_SLOTS - 1));
+    m_Scheduler.Post(m_Scheduler.GetNowUs() + RandomRange(&m_u32Seed, 50, 500) * 1000ull, [this]() { RestartStream(); });
+}
+
+void CStorm::Run(STORM_RESULT *pResult)
+{
+    for (int i = 0; i < SIDEBANDHOST_PROFILE_COUNT * SIDEBANDBENCH_SLOTS; i++)
+    {
+        m_aSlots[i].Profile = (SIDEBANDHOST_PROFILE)(i / SIDEBANDBENCH_SLOTS);
+        m_Scheduler.Post(RandomRange(&m_u32Seed, 0, 1000) * 1000ull, [this, i]() { Arrive(i); });
+    }
+    m_Scheduler.Post(0, [this]() { ChangeStatus(); });
+    m_Scheduler.Post(0, [this]() { RestartStream(); });
+
+    m_Scheduler.RunUntil(m_u64EndUs);
+    pResult->u64Stalled = m_Adapter->CountStalledNotifications();
+
+    // the driver unloads with headsets still plugged in
+    m_Adapter->Cleanup();
+    m_Scheduler.RunUntil(UINT64_MAX);
+
+    pResult->Arrivals = m_Adapter->GetArrivals();
+    pResult->u64CacheHits = m_Adapter->GetUsbCacheHits();
+    pResult->u64EndUs = m_u64EndUs;
+    memset(pResult->aCounters, 0, sizeof(pResult->aCounters));
+    for (const std::unique_ptr<CSidebandFakeDevice> &Device : m_Devices)
+    {
+        SidebandHost_AddCounters(&pResult->aCounters[Device->GetConfig().Profile], &Device->GetCounters());
+    }
+
+    m_Adapter.reset();
+    pResult->u64Leaked = 0;
+    for (const std::unique_ptr<CSidebandFakeDevice> &Device : m_Devices)
+    {
+        pResult->u64Leaked += Device->GetPendingCount();
+    }
+
+    // FNV-1a over what the run did
+    uint64_t u64Digest = 14695981039346656037ull;
+    auto Mix = [&u64Digest](uint64_t u64Value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            u64Digest = (u64Digest ^ ((u64Value >> (8 * i)) & 0xff)) * 1099511628211ull;
+        }
+    };
+    for (const SIDEBANDHOST_ARRIVAL &Arrival : pResult->Arrivals)
+    {
+        Mix(Arrival.Profile);
+        Mix(Arrival.u64ArrivalUs);
+        Mix(Arrival.u64RemovalUs);
+        Mix(Arrival.u64StartedUs);
+        Mix(Arrival.u64FirstAudioUs);
+        Mix(Arrival.fCachedDiscovery | Arrival.fStartFailed << 1 | Arrival.fStreamFailed << 2);
+    }
+    for (const SIDEBANDHOST_COUNTERS &Counters : pResult->aCounters)
+    {
+        for (uint64_t u64Count : Counters.u64PerIoctl)
+        {
+            Mix(u64Count);
+        }
+        Mix(Counters.u64Removed);
+        Mix(Counters.u64Completions);
+    }
+    pResult->u64Digest = u64Digest;
+}
+
+static bool RunStorm(uint32_t u32Seed, uint32_t u32Seconds, bool fVerbose)
+{
+    STORM_RESULT Result, Replay;
+    bool fPassed = true;
+
+    CStorm(u32Seed, u32Seconds).Run(&Result);
+    CStorm(u32Seed, u32Seconds).Run(&Replay);
+
+    printf("storm, %u headsets per profile, %u s virtual, seed %u\n\n", SIDEBANDBENCH_SLOTS, u32Seconds, u32Seed);
+    printf("%-6s %8s %7s %7s %8s %8s %8s %8s %8s %6s %6s\n",
+           "", "arrivals", "aborted", "audio", "p50 ms", "p99 ms", "max ms", "IOCTLs", "gone", "viol", "cache");
+
+    for (int p = 0; p < SIDEBANDHOST_PROFILE_COUNT; p++)
+    {
+        SIDEBANDHOST_PROFILE Profile = (SIDEBANDHOST_PROFILE)p;
+        const SIDEBANDHOST_COUNTERS *pCounters = &Result.aCounters[p];
+        std::vector<uint64_t> Latencies;
+        uint32_t cArrivals = 0, cAborted = 0;
+
+        for (const SIDEBANDHOST_ARRIVAL &Arrival : Result.Arrivals)
+        {
+            if (Arrival.Profile != Profile)
+            {
+                continue;
+            }
+            cArrivals++;
+
+            uint64_t u64GoneUs = std::min(Arrival.u64RemovalUs, Result.u64EndUs);
+            if (Arrival.u64FirstAudioUs != UINT64_MAX)
+            {
+                Latencies.push_back(Arrival.u64FirstAudioUs - Arrival.u64ArrivalUs);
+            }
+            else if (u64GoneUs - Arrival.u64ArrivalUs >= SIDEBANDBENCH_SETTLE_MS * 1000ull)
+            {
+                fprintf(stderr, "FAIL: %s arrival at %.3f s: present %.3f s without a stream%s%s\n",
+                        SidebandHost_ProfileName(Profile), Arrival.u64ArrivalUs / 1e6,
+                        (u64GoneUs - Arrival.u64ArrivalUs) / 1e6,
+                        Arrival.fStartFailed ? ", Start failed" : "",
+                        Arrival.fStreamFailed ? ", stream failed" : "");
+                fPassed = false;
+            }
+            else
+            {
+                cAborted++;
+            }
+        }
+
+        printf("%-6s %8u %7u %7zu %8.1f %8.1f %8.1f %8llu %8llu %6llu %6s\n",
+               SidebandHost_ProfileName(Profile), cArrivals, cAborted, Latencies.size(),
+               Percentile(Latencies, 0.5) / 1000.0, Percentile(Latencies, 0.99) / 1000.0,
+               Percentile(Latencies, 1.0) / 1000.0,
+               (unsigned long long)pCounters->u64Ioctls, (unsigned long long)pCounters->u64Removed,
+               (unsigned long long)pCounters->u64Violations,
+               Profile == SIDEBANDHOST_USB ? std::to_string(Result.u64CacheHits).c_str() : "-");
+
+        if (pCounters->u64Violations != 0)
+        {
+            fprintf(stderr, "FAIL: %s: %llu contract violations\n", SidebandHost_ProfileName(Profile),
+                    (unsigned long long)pCounters->u64Violations);
+            fPassed = false;
+        }
+        if (Latencies.empty())
+        {
+            fprintf(stderr, "FAIL: %s: no arrival got to streaming\n", SidebandHost_ProfileName(Profile));
+            fPassed = false;
+        }
+
+        if (fVerbose)
+        {
+            for (int i = 0; i < SIDEBANDHOST_IOCTL_COUNT; i++)
+            {
+                if (pCounters->u64PerIoctl[i] != 0)
+                {
+                    printf("         %-56s %8llu\n", SidebandHost_IoctlName((SIDEBANDHOST_IOCTL)i),
+                           (unsigned long long)pCounters->u64PerIoctl[i]);
+                }
+            }
+        }
+    }
+
+    if (Result.u64Leaked != 0)
+    {
+        fprintf(stderr, "FAIL: %llu requests left pending on the interfaces\n", (unsigned long long)Result.u64Leaked);
+        fPassed = false;
+    }
+    if (Result.u64Stalled != 0)
+    {
+        fprintf(stderr, "FAIL: %llu status updates of running devices neither pended nor queued\n",
+                (unsigned long long)Result.u64Stalled);
+        fPassed = false;
+    }
+    if (Result.u64Digest != Replay.u64Digest)
+    {
+        fprintf(stderr, "FAIL: the replay of seed %u differs (%016llx, %016llx)\n", u32Seed,
+                (unsigned long long)Result.u64Digest, (unsigned long long)Replay.u64Digest);
+        fPassed = false;
+    }
+    printf("\nleaked %llu, stalled %llu, digest %016llx\n", (unsigned long long)Result.u64Leaked,
+           (unsigned long long)Result.u64Stalled, (unsigned long long)Result.u64Digest);
+    return fPassed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t u32Seed = 1;
+    uint32_t u32Seconds = 120;
+    bool fVerbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            u32Seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+        {
+            u32Seconds = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            fVerbose = true;
+        }
+    }
+
+    bool fPassed = RunConnect();
+    fPassed &= RunStorm(u32Seed, u32Seconds, fVerbose);
+    return fPassed ? 0 : 1;
+}
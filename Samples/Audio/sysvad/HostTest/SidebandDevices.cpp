@@ -0,0 +1,1625 @@
+//
+// SidebandDevices.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   A model of the sample's sideband device classes on top of the fake
+//   interfaces of SidebandHost.cpp. The driver classes need WDF and PortCls
+//   and do not build here, so this is a separate, hand-written copy of
+//   their IOCTL sequences: each routine below was written from the routine
+//   of A2dpHpDevice, UsbHsDevice, BthHfpDevice or CAdapterCommon it is
+//   named after. None of the driver's code runs here, so the benchmarks
+//   measure the protocol as modeled, not the driver; a driver change is
+//   only seen here once this model is changed to match.
+//
+//   Left out: the KS property handlers, the miniports, and the volume and
+//   mute sets of the audio engine. Each device's thread has its own virtual
+//   clock; a synchronous IOCTL advances it to the IOCTL's completion.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "SidebandHost.h"
+
+#define SIDEBAND_NOTIFICATION_MAX_ERROR_COUNT   5
+#define USBHS_CACHE_MAX_ENTRIES                 4
+
+// the A2DP class supports one speaker endpoint
+#define A2DPHP_MAX_SPEAKER_ENDPOINTS            1
+
+typedef enum SIDEBAND_STATE
+{
+    eSidebandStateInitializing,
+    eSidebandStateRunning,
+    eSidebandStateFailed,
+    eSidebandStateStopping,
+    eSidebandStateStopped,
+} SIDEBAND_STATE;
+
+//
+// A notification request and the part of its WDF context the classes use.
+//
+typedef struct NOTIFICATION_REQUEST : SIDEBANDHOST_REQUEST
+{
+    uint32_t    Errors;
+    NTSTATUS    IoStatus;       // WDF_REQUEST_COMPLETION_PARAMS.IoStatus.Status
+} NOTIFICATION_REQUEST;
+
+class CHostAdapter;
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  What the three device classes share: the IOCTL helpers, the
+//  notification completion routine and work item, and Stop.
+//
+class CSidebandDevice
+{
+public:
+    CSidebandDevice(CHostAdapter *pAdapter, CSidebandFakeDevice *pTarget, uint32_t u32SymbolicLink, size_t iArrival);
+    virtual ~CSidebandDevice() {}
+
+    void Init();
+    virtual void Start() = 0;
+    virtual void Stop();
+
+    //
+    // What the class's destructor does. The object itself stays until the
+    // adapter goes, since posted events may still name it.
+    //
+    virtual void FinalRelease() {}
+
+    //
+    // The speaker endpoint's stream calls of the miniport.
+    //
+    virtual NTSTATUS StreamOpen() = 0;
+    virtual NTSTATUS StreamStart() = 0;
+    virtual NTSTATUS StreamSuspend() = 0;
+    virtual NTSTATUS StreamClose() = 0;
+
+    //
+    // Status updates that are neither pended on the interface nor waiting
+    // for the work item.
+    //
+    uint32_t CountStalledNotifications() const;
+
+    CSidebandFakeDevice *GetTarget() const { return m_pTarget; }
+    uint32_t GetSymbolicLink() const { return m_u32SymbolicLink; }
+    size_t GetArrival() const { return m_iArrival; }
+    SIDEBAND_STATE GetState() const { return m_State; }
+
+    // clock of the thread running this device's code
+    uint64_t                    m_u64NowUs;
+
+protected:
+    NTSTATUS SendIoCtrlSynchronously(SIDEBANDHOST_IOCTL Ioctl, SIDEBANDHOST_BUFFER *pBuffer);
+    NTSTATUS SendIoCtrlSynchronously(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, int32_t i32Value = 0);
+    NTSTATUS SendIoCtrlAsynchronously(NOTIFICATION_REQUEST *pRequest);
+
+    //
+    // The size query and the fetch of a variable-length structure.
+    //
+    NTSTATUS GetSized(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, uint32_t *pu32Hash, int32_t *pi32Value);
+
+    //
+    // A status update with bImmediate set.
+    //
+    NTSTATUS GetStatus(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, int32_t *pi32Value);
+
+    void InitNotificationRequest(NOTIFICATION_REQUEST *pRequest, SIDEBANDHOST_IOCTL Ioctl, bool fStreamStatus);
+    NTSTATUS EnableNotification(NOTIFICATION_REQUEST *pRequest, uint32_t u32EpIndex);
+    void StopStreamStatusNotification(NOTIFICATION_REQUEST *pRequest);
+
+    void NotificationStatusCompletion(NOTIFICATION_REQUEST *pRequest, NTSTATUS Status);
+    void StreamStatusCompletion(NOTIFICATION_REQUEST *pRequest, NTSTATUS Status);
+    void NotificationStatusWorkItem();
+
+    //
+    // The work item's handling of a successful completion.
+    //
+    virtual void HandleNotification(NOTIFICATION_REQUEST *pRequest) = 0;
+
+    void InstallEndpointFilters(bool fSpeaker);
+    void RemoveEndpointFilters();
+
+    CHostAdapter               *m_pAdapter;
+    CSidebandFakeDevice        *m_pTarget;
+    uint32_t                    m_u32SymbolicLink;
+    size_t                      m_iArrival;
+    SIDEBAND_STATE              m_State;
+
+    std::vector<NOTIFICATION_REQUEST *> m_Notifications;    // every status request of the device
+    std::deque<NOTIFICATION_REQUEST *>  m_ReqCollection;
+    bool                        m_fWorkItemQueued;
+
+    bool                        m_fSpeakerFilters;
+    bool                        m_fMicFilters;
+    NTSTATUS                    m_SpeakerStreamStatus;
+};
+
+//-------------------------------------------------------------------------
+// Description:
+//
+//  CAdapterCommon's sideband part, and the audio engine behind the
+//  endpoints it installs.
+//
+class CHostAdapter : public CSidebandHostAdapter
+{
+public:
+    CHostAdapter(CSidebandHostScheduler *pScheduler, bool fUsbCache);
+    ~CHostAdapter();
+
+    void InterfaceArrival(uint32_t u32SymbolicLink, CSidebandFakeDevice *pDevice) override;
+    void InterfaceRemoval(uint32_t u32SymbolicLink) override;
+    void Cleanup() override;
+    void RestartStream(uint32_t u32SymbolicLink) override;
+
+    const std::vector<SIDEBANDHOST_ARRIVAL> &GetArrivals() const override { return m_Arrivals; }
+    uint64_t GetLeakedRequests() const override { return m_u64LeakedRequests; }
+    uint64_t GetUsbCacheHits() const override { return m_u64UsbCacheHits; }
+    uint32_t CountStalledNotifications() const override;
+
+    CSidebandHostScheduler *GetScheduler() const { return m_pScheduler; }
+
+    //
+    // UsbSidebandCacheTake and UsbSidebandCacheStore. The entry stands for
+    // the descriptors, formats and minipairs the driver caches.
+    //
+    bool UsbSidebandCacheTake(uint32_t u32ContainerId, uint32_t u32Hash);
+    void UsbSidebandCacheStore(uint32_t u32ContainerId, uint32_t u32Hash);
+
+    //
+    // The engine: the endpoint's filters came and went.
+    //
+    void EndpointInstalled(CSidebandDevice *pDevice);
+    void EndpointRemoved(CSidebandDevice *pDevice);
+
+private:
+    typedef struct WORK_TASK
+    {
+        CSidebandDevice    *Device;
+        bool                fStart;
+    } WORK_TASK;
+
+    typedef struct WORKER
+    {
+        std::deque<WORK_TASK>   Tasks;
+        bool                    fQueued;
+        uint64_t                u64FreeUs;  // end of the task last run
+    } WORKER;
+
+    typedef struct ENGINE
+    {
+        bool    fOpen;
+        bool    fStarted;
+    } ENGINE;
+
+    typedef struct CACHE_ENTRY
+    {
+        uint32_t    u32ContainerId;
+        uint32_t    u32Hash;
+    } CACHE_ENTRY;
+
+    CSidebandDevice *DeviceFind(uint32_t u32SymbolicLink) const;
+    void QueueTask(SIDEBANDHOST_PROFILE Profile, CSidebandDevice *pDevice, bool fStart);
+    void InterfaceWorkItem(SIDEBANDHOST_PROFILE Profile);
+    void EngineStart(CSidebandDevice *pDevice);
+    void ReleaseDevice(CSidebandDevice *pDevice);
+
+    CSidebandHostScheduler         *m_pScheduler;
+    bool                            m_fUsbCacheEnabled;
+    WORKER                          m_aWorkers[SIDEBANDHOST_PROFILE_COUNT];
+    std::vector<CSidebandDevice *>  m_Devices;      // present
+    std::vector<std::unique_ptr<CSidebandDevice>> m_Released;
+    std::vector<ENGINE>             m_Engines;      // per arrival
+    std::deque<CACHE_ENTRY>         m_UsbSidebandCache;
+    std::vector<SIDEBANDHOST_ARRIVAL> m_Arrivals;
+    uint64_t                        m_u64LeakedRequests;
+    uint64_t                        m_u64UsbCacheHits;
+};
+
+//-------------------------------------------------------------------------
+// CSidebandDevice
+//
+CSidebandDevice::CSidebandDevice(CHostAdapter *pAdapter, CSidebandFakeDevice *pTarget, uint32_t u32SymbolicLink, size_t iArrival)
+    : m_u64NowUs(0),
+      m_pAdapter(pAdapter),
+      m_pTarget(pTarget),
+      m_u32SymbolicLink(u32SymbolicLink),
+      m_iArrival(iArrival),
+      m_State(eSidebandStateInitializing),
+      m_fWorkItemQueued(false),
+      m_fSpeakerFilters(false),
+      m_fMicFilters(false),
+      m_SpeakerStreamStatus(STATUS_INVALID_DEVICE_STATE)
+{
+}
+
+void CSidebandDevice::Init()
+{
+    // the classes' Init ends in the running state, before Start
+    m_State = eSidebandStateRunning;
+}
+
+NTSTATUS CSidebandDevice::SendIoCtrlSynchronously(SIDEBANDHOST_IOCTL Ioctl, SIDEBANDHOST_BUFFER *pBuffer)
+{
+    uint64_t u64DoneUs;
+    NTSTATUS Status = m_pTarget->Ioctl(Ioctl, m_u64NowUs, pBuffer, &u64DoneUs);
+
+    m_u64NowUs = u64DoneUs;
+    return Status;
+}
+
+NTSTATUS CSidebandDevice::SendIoCtrlSynchronously(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, int32_t i32Value)
+{
+    SIDEBANDHOST_BUFFER Buffer = {};
+
+    Buffer.u32EndpointIndex = u32EpIndex;
+    Buffer.i32Value = i32Value;
+    return SendIoCtrlSynchronously(Ioctl, &Buffer);
+}
+
+NTSTATUS CSidebandDevice::SendIoCtrlAsynchronously(NOTIFICATION_REQUEST *pRequest)
+{
+    return m_pTarget->Send(pRequest, m_u64NowUs) ? STATUS_SUCCESS : STATUS_INVALID_DEVICE_STATE;
+}
+
+NTSTATUS CSidebandDevice::GetSized(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, uint32_t *pu32Hash, int32_t *pi32Value)
+{
+    SIDEBANDHOST_BUFFER Buffer = {};
+
+    Buffer.u32EndpointIndex = u32EpIndex;
+    NTSTATUS Status = SendIoCtrlSynchronously(Ioctl, &Buffer);
+    if (Status != STATUS_BUFFER_TOO_SMALL)
+    {
+        return NT_SUCCESS(Status) ? STATUS_INVALID_DEVICE_STATE : Status;
+    }
+
+    Buffer.cbOutput = Buffer.cbInformation;
+    Status = SendIoCtrlSynchronously(Ioctl, &Buffer);
+    if (NT_SUCCESS(Status))
+    {
+        *pu32Hash = Buffer.u32Hash;
+        if (pi32Value != NULL)
+        {
+            *pi32Value = Buffer.i32Value;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CSidebandDevice::GetStatus(SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EpIndex, int32_t *pi32Value)
+{
+    SIDEBANDHOST_BUFFER Buffer = {};
+
+    Buffer.u32EndpointIndex = u32EpIndex;
+    Buffer.fImmediate = true;
+    NTSTATUS Status = SendIoCtrlSynchronously(Ioctl, &Buffer);
+    if (NT_SUCCESS(Status))
+    {
+        *pi32Value = Buffer.i32Value;
+    }
+    return Status;
+}
+
+void CSidebandDevice::InitNotificationRequest(NOTIFICATION_REQUEST *pRequest, SIDEBANDHOST_IOCTL Ioctl, bool fStreamStatus)
+{
+    pRequest->Ioctl = Ioctl;
+    pRequest->Buffer = SIDEBANDHOST_BUFFER();
+    pRequest->fPending = false;
+    pRequest->u32Sends = 0;
+    pRequest->Errors = 0;
+    pRequest->IoStatus = STATUS_SUCCESS;
+
+    if (fStreamStatus)
+    {
+        pRequest->Completion = [this](SIDEBANDHOST_REQUEST *pSent, NTSTATUS Status)
+        {
+            StreamStatusCompletion(static_cast<NOTIFICATION_REQUEST *>(pSent), Status);
+        };
+    }
+    else
+    {
+        pRequest->Completion = [this](SIDEBANDHOST_REQUEST *pSent, NTSTATUS Status)
+        {
+            NotificationStatusCompletion(static_cast<NOTIFICATION_REQUEST *>(pSent), Status);
+        };
+        m_Notifications.push_back(pRequest);
+    }
+}
+
+//
+// The Enable*StatusNotification routines: the first send returns the
+// current value only when it changes.
+//
+NTSTATUS CSidebandDevice::EnableNotification(NOTIFICATION_REQUEST *pRequest, uint32_t u32EpIndex)
+{
+    pRequest->Buffer.u32EndpointIndex = u32EpIndex;
+    pRequest->Buffer.fImmediate = false;
+    return SendIoCtrlAsynchronously(pRequest);
+}
+
+//
+// The Stop*StreamStatusNotification routines: cancel the request and wait
+// for its completion routine.
+//
+void CSidebandDevice::StopStreamStatusNotification(NOTIFICATION_REQUEST *pRequest)
+{
+    m_pTarget->Cancel(pRequest);
+}
+
+//
+// EvtXxxDeviceNotificationStatusCompletion
+//
+void CSidebandDevice::NotificationStatusCompletion(NOTIFICATION_REQUEST *pRequest, NTSTATUS Status)
+{
+    if (Status == STATUS_CANCELLED)
+    {
+        // the device is shutting down; do not re-send this request
+        return;
+    }
+
+    // if something is wrong with the interface, do not loop forever
+    if (!NT_SUCCESS(Status))
+    {
+        if (++pRequest->Errors > SIDEBAND_NOTIFICATION_MAX_ERROR_COUNT)
+        {
+            return;
+        }
+    }
+    else
+    {
+        pRequest->Errors = 0;
+    }
+
+    pRequest->IoStatus = Status;
+    m_ReqCollection.push_back(pRequest);
+    if (!m_fWorkItemQueued)
+    {
+        CSidebandHostScheduler *pScheduler = m_pAdapter->GetScheduler();
+
+        m_fWorkItemQueued = true;
+        pScheduler->Post(pScheduler->GetNowUs(), [this]()
+        {
+            if (m_fWorkItemQueued)
+            {
+                m_u64NowUs = m_pAdapter->GetScheduler()->GetNowUs();
+                NotificationStatusWorkItem();
+            }
+        });
+    }
+}
+
+//
+// EvtXxxDeviceStreamStatusCompletion
+//
+void CSidebandDevice::StreamStatusCompletion(NOTIFICATION_REQUEST *pRequest, NTSTATUS Status)
+{
+    m_SpeakerStreamStatus = NT_SUCCESS(Status) ? pRequest->Buffer.i32Value : STATUS_INVALID_DEVICE_STATE;
+}
+
+//
+// EvtXxxDeviceNotificationStatusWorkItem
+//
+void CSidebandDevice::NotificationStatusWorkItem()
+{
+    m_fWorkItemQueued = false;
+
+    for (;;)
+    {
+        if (m_ReqCollection.empty())
+        {
+            break;
+        }
+        NOTIFICATION_REQUEST *pRequest = m_ReqCollection.front();
+        m_ReqCollection.pop_front();
+
+        if (NT_SUCCESS(pRequest->IoStatus))
+        {
+            HandleNotification(pRequest);
+        }
+
+        // re-send; the value it returned is the one it waits to change
+        pRequest->Buffer.fImmediate = false;
+        if (!NT_SUCCESS(SendIoCtrlAsynchronously(pRequest)))
+        {
+            break;
+        }
+    }
+}
+
+uint32_t CSidebandDevice::CountStalledNotifications() const
+{
+    uint32_t cStalled = 0;
+
+    for (const NOTIFICATION_REQUEST *pRequest : m_Notifications)
+    {
+        if (pRequest->u32Sends != 0 && !pRequest->fPending &&
+            std::find(m_ReqCollection.begin(), m_ReqCollection.end(), pRequest) == m_ReqCollection.end())
+        {
+            cStalled++;
+        }
+    }
+    return cStalled;
+}
+
+void CSidebandDevice::InstallEndpointFilters(bool fSpeaker)
+{
+    if (fSpeaker)
+    {
+        m_fSpeakerFilters = true;
+        m_pAdapter->EndpointInstalled(this);
+    }
+    else
+    {
+        m_fMicFilters = true;
+    }
+}
+
+void CSidebandDevice::RemoveEndpointFilters()
+{
+    if (m_fSpeakerFilters)
+    {
+        m_pAdapter->EndpointRemoved(this);
+    }
+    m_fSpeakerFilters = false;
+    m_fMicFilters = false;
+}
+
+//
+// The Stop routines: after this returns, no notification is pending and
+// the work item is idle.
+//
+void CSidebandDevice::Stop()
+{
+    m_State = eSidebandStateStopping;
+
+    // WdfIoTargetPurge(WdfIoTargetPurgeIoAndWait)
+    m_pTarget->Purge();
+
+    // WdfWorkItemFlush
+    if (m_fWorkItemQueued)
+    {
+        NotificationStatusWorkItem();
+    }
+
+    RemoveEndpointFilters();
+    m_State = eSidebandStateStopped;
+}
+
+//-------------------------------------------------------------------------
+// CA2dpHpDevice
+//
+class CA2dpHpDevice : public CSidebandDevice
+{
+public:
+    CA2dpHpDevice(CHostAdapter *pAdapter, CSidebandFakeDevice *pTarget, uint32_t u32SymbolicLink, size_t iArrival)
+        : CSidebandDevice(pAdapter, pTarget, u32SymbolicLink, iArrival),
+          m_SpeakerEpIndex(0), m_fVolume(false), m_fMute(false),
+          m_SpeakerVolumeLevel(0), m_SpeakerMute(0), m_ConnectionStatus(0), m_CodecCapsHash(0),
+          m_nSpeakerStreams(0), m_nSpeakerStartedStreams(0)
+    {
+        InitNotificationRequest(&m_SpeakerVolumeReq, IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_SpeakerMuteReq, IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_ConnectionReq, IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_SpeakerSiopReq, IOCTL_SBAUD_GET_SIOP_UPDATE, false);
+        InitNotificationRequest(&m_SpeakerStreamReq, IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE, true);
+    }
+
+    void Start() override;
+    NTSTATUS StreamOpen() override;
+    NTSTATUS StreamStart() override;
+    NTSTATUS StreamSuspend() override;
+    NTSTATUS StreamClose() override;
+
+protected:
+    void HandleNotification(NOTIFICATION_REQUEST *pRequest) override;
+
+private:
+    NTSTATUS GetA2dpHpCodecCaps();
+
+    uint32_t                m_SpeakerEpIndex;
+    bool                    m_fVolume;
+    bool                    m_fMute;
+    int32_t                 m_SpeakerVolumeLevel;
+    int32_t                 m_SpeakerMute;
+    int32_t                 m_ConnectionStatus;
+    uint32_t                m_CodecCapsHash;
+    int32_t                 m_nSpeakerStreams;
+    int32_t                 m_nSpeakerStartedStreams;
+    NOTIFICATION_REQUEST    m_SpeakerVolumeReq;
+    NOTIFICATION_REQUEST    m_SpeakerMuteReq;
+    NOTIFICATION_REQUEST    m_ConnectionReq;
+    NOTIFICATION_REQUEST    m_SpeakerSiopReq;
+    NOTIFICATION_REQUEST    m_SpeakerStreamReq;
+};
+
+NTSTATUS CA2dpHpDevice::GetA2dpHpCodecCaps()
+{
+    return GetSized(IOCTL_SBAUD_GET_SIOP, m_SpeakerEpIndex, &m_CodecCapsHash, NULL);
+}
+
+void CA2dpHpDevice::Start()
+{
+    NTSTATUS Status;
+    uint32_t u32Hash;
+    int32_t i32Endpoints = 0;
+    uint32_t cSpeakers = 0;
+
+    // SetA2dpHpDeviceCapabilities
+    Status = SendIoCtrlSynchronously(IOCTL_SBAUD_SET_SIOP, 0u);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    Status = GetSized(IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR, 0, &u32Hash, &i32Endpoints);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)i32Endpoints; i++)
+    {
+        int32_t i32Flags = 0;
+
+        Status = GetSized(IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2, i, &u32Hash, &i32Flags);
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+        if (!(i32Flags & SIDEBANDHOST_EP_CAPTURE))
+        {
+            cSpeakers++;
+            m_SpeakerEpIndex = i;
+            m_fVolume = (i32Flags & SIDEBANDHOST_EP_VOLUME) != 0;
+            m_fMute = (i32Flags & SIDEBANDHOST_EP_MUTE) != 0;
+        }
+    }
+    if (cSpeakers != A2DPHP_MAX_SPEAKER_ENDPOINTS)
+    {
+        Status = STATUS_INVALID_DEVICE_REQUEST;
+        goto Done;
+    }
+
+    if (m_fVolume)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES, m_SpeakerEpIndex);
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, m_SpeakerEpIndex, &m_SpeakerVolumeLevel);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+    }
+    if (m_fMute)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_GET_MUTEPROPERTYVALUES, m_SpeakerEpIndex);
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE, m_SpeakerEpIndex, &m_SpeakerMute);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+    }
+
+    // the formats are fixed; minipair, then the filters
+    InstallEndpointFilters(true);
+
+    Status = EnableNotification(&m_ConnectionReq, 0);
+    if (NT_SUCCESS(Status))
+    {
+        Status = EnableNotification(&m_SpeakerSiopReq, m_SpeakerEpIndex);
+    }
+    if (NT_SUCCESS(Status) && m_fVolume)
+    {
+        Status = EnableNotification(&m_SpeakerVolumeReq, m_SpeakerEpIndex);
+    }
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    Status = SendIoCtrlSynchronously(IOCTL_SBAUD_SET_DEVICE_CLAIMED, 0u, 1);
+
+Done:
+    if (!NT_SUCCESS(Status))
+    {
+        SendIoCtrlSynchronously(IOCTL_SBAUD_SET_DEVICE_CLAIMED, 0u, 0);
+        m_State = eSidebandStateFailed;
+    }
+}
+
+void CA2dpHpDevice::HandleNotification(NOTIFICATION_REQUEST *pRequest)
+{
+    switch (pRequest->Ioctl)
+    {
+    case IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE:
+        if (pRequest->Buffer.u32EndpointIndex == m_SpeakerEpIndex)
+        {
+            m_SpeakerVolumeLevel = pRequest->Buffer.i32Value;
+        }
+        break;
+
+    case IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE:
+        if (pRequest->Buffer.u32EndpointIndex == m_SpeakerEpIndex)
+        {
+            m_SpeakerMute = pRequest->Buffer.i32Value;
+        }
+        break;
+
+    case IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE:
+        m_ConnectionStatus = pRequest->Buffer.i32Value;
+        break;
+
+    case IOCTL_SBAUD_GET_SIOP_UPDATE:
+        if (pRequest->Buffer.u32EndpointIndex == m_SpeakerEpIndex)
+        {
+            GetA2dpHpCodecCaps();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+NTSTATUS CA2dpHpDevice::StreamOpen()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (++m_nSpeakerStreams == 1)
+    {
+        bool fStreamOpen = false;
+
+        // SetA2dpHpStreamOpen: an open channel is not an error
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_OPEN, m_SpeakerEpIndex);
+        if (Status == STATUS_DEVICE_BUSY)
+        {
+            Status = STATUS_SUCCESS;
+        }
+        if (NT_SUCCESS(Status))
+        {
+            fStreamOpen = true;
+            m_SpeakerStreamStatus = STATUS_SUCCESS;
+            Status = EnableNotification(&m_SpeakerStreamReq, m_SpeakerEpIndex);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            m_nSpeakerStreams--;
+            if (fStreamOpen)
+            {
+                SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_CLOSE, m_SpeakerEpIndex);
+            }
+            m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CA2dpHpDevice::StreamStart()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    // like the driver, the count stays up when the start fails
+    if (++m_nSpeakerStartedStreams == 1)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_START, m_SpeakerEpIndex);
+        if (Status == STATUS_DEVICE_BUSY)
+        {
+            Status = STATUS_SUCCESS;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CA2dpHpDevice::StreamSuspend()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (--m_nSpeakerStartedStreams == 0)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_SUSPEND, m_SpeakerEpIndex);
+        if (Status == STATUS_DEVICE_BUSY)
+        {
+            Status = STATUS_SUCCESS;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CA2dpHpDevice::StreamClose()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (--m_nSpeakerStreams == 0)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_CLOSE, m_SpeakerEpIndex);
+        StopStreamStatusNotification(&m_SpeakerStreamReq);
+        m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+    }
+    return Status;
+}
+
+//-------------------------------------------------------------------------
+// CUsbHsDevice
+//
+class CUsbHsDevice : public CSidebandDevice
+{
+public:
+    CUsbHsDevice(CHostAdapter *pAdapter, CSidebandFakeDevice *pTarget, uint32_t u32SymbolicLink, size_t iArrival)
+        : CSidebandDevice(pAdapter, pTarget, u32SymbolicLink, iArrival),
+          m_u32DeviceHash(0), m_fCachedDiscovery(false), m_CacheDiscovery(false), m_CacheHash(0),
+          m_nSpeakerStreamsOpen(0), m_nSpeakerStreamsStart(0)
+    {
+        for (ENDPOINT &Endpoint : m_aEndpoints)
+        {
+            Endpoint.fPresent = false;
+            Endpoint.EpIndex = 0;
+            Endpoint.i32Flags = 0;
+            Endpoint.u32DescriptorHash = 0;
+            Endpoint.fFormats = false;
+            Endpoint.VolumeLevel = 0;
+            Endpoint.Mute = 0;
+            InitNotificationRequest(&Endpoint.VolumeReq, IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, false);
+        }
+        InitNotificationRequest(&m_SpeakerStreamReq, IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE, true);
+    }
+
+    void FinalRelease() override;
+    void Start() override;
+    NTSTATUS StreamOpen() override;
+    NTSTATUS StreamStart() override;
+    NTSTATUS StreamSuspend() override;
+    NTSTATUS StreamClose() override;
+
+    bool IsCachedDiscovery() const { return m_fCachedDiscovery; }
+
+protected:
+    void HandleNotification(NOTIFICATION_REQUEST *pRequest) override;
+
+private:
+    typedef struct ENDPOINT
+    {
+        bool                    fPresent;
+        uint32_t                EpIndex;
+        int32_t                 i32Flags;
+        uint32_t                u32DescriptorHash;
+        bool                    fFormats;       // supported formats intersection
+        int32_t                 VolumeLevel;
+        int32_t                 Mute;
+        NOTIFICATION_REQUEST    VolumeReq;
+    } ENDPOINT;
+
+    NTSTATUS StartEndpoint(ENDPOINT *pEndpoint, bool fSpeaker);
+    NTSTATUS SetTransportResources(uint32_t EpIndex);
+    NTSTATUS GetTransportResources(uint32_t EpIndex);
+
+    // speaker, mic
+    ENDPOINT                m_aEndpoints[2];
+    uint32_t                m_u32DeviceHash;
+    bool                    m_fCachedDiscovery;
+    bool                    m_CacheDiscovery;
+    uint32_t                m_CacheHash;
+    int32_t                 m_nSpeakerStreamsOpen;
+    int32_t                 m_nSpeakerStreamsStart;
+    NOTIFICATION_REQUEST    m_SpeakerStreamReq;
+};
+
+void CUsbHsDevice::FinalRelease()
+{
+    // StoreCachedDiscovery
+    if (m_CacheDiscovery)
+    {
+        m_pAdapter->UsbSidebandCacheStore(m_pTarget->GetConfig().u32Identity, m_CacheHash);
+        m_CacheDiscovery = false;
+    }
+}
+
+NTSTATUS CUsbHsDevice::StartEndpoint(ENDPOINT *pEndpoint, bool fSpeaker)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    uint32_t u32Hash;
+
+    if (pEndpoint->i32Flags & SIDEBANDHOST_EP_VOLUME)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES, pEndpoint->EpIndex);
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, pEndpoint->EpIndex, &pEndpoint->VolumeLevel);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+    }
+    if (pEndpoint->i32Flags & SIDEBANDHOST_EP_MUTE)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_GET_MUTEPROPERTYVALUES, pEndpoint->EpIndex);
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE, pEndpoint->EpIndex, &pEndpoint->Mute);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+    }
+
+    if (!pEndpoint->fFormats)
+    {
+        Status = GetSized(IOCTL_SBAUD_GET_SUPPORTED_FORMATS, pEndpoint->EpIndex, &u32Hash, NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+        pEndpoint->fFormats = true;
+    }
+
+    InstallEndpointFilters(fSpeaker);
+
+    if (pEndpoint->i32Flags & SIDEBANDHOST_EP_VOLUME)
+    {
+        Status = EnableNotification(&pEndpoint->VolumeReq, pEndpoint->EpIndex);
+    }
+    return Status;
+}
+
+void CUsbHsDevice::Start()
+{
+    NTSTATUS Status;
+    uint32_t u32Hash;
+    int32_t i32Endpoints = 0;
+    uint32_t cSpeakers = 0;
+    uint32_t cMics = 0;
+
+    Status = GetSized(IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR, 0, &m_u32DeviceHash, &i32Endpoints);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    // SIOP_TYPE_USBAUD_CONTROLLER_CONFIG_INFO_DEVICE_BEHIND_HUB
+    Status = GetSized(IOCTL_SBAUD_GET_SIOP, 0, &u32Hash, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)i32Endpoints; i++)
+    {
+        int32_t i32Flags = 0;
+
+        Status = GetSized(IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2, i, &u32Hash, &i32Flags);
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+
+        ENDPOINT *pEndpoint = &m_aEndpoints[(i32Flags & SIDEBANDHOST_EP_CAPTURE) ? 1 : 0];
+        (i32Flags & SIDEBANDHOST_EP_CAPTURE) ? cMics++ : cSpeakers++;
+        pEndpoint->fPresent = true;
+        pEndpoint->EpIndex = i;
+        pEndpoint->i32Flags = i32Flags;
+        pEndpoint->u32DescriptorHash = u32Hash;
+    }
+    if (cSpeakers > 1 || cMics > 1)
+    {
+        Status = STATUS_INVALID_DEVICE_REQUEST;
+        goto Done;
+    }
+
+    // ComputeCacheKey, TakeCachedDiscovery
+    m_CacheHash = m_u32DeviceHash;
+    for (const ENDPOINT &Endpoint : m_aEndpoints)
+    {
+        m_CacheHash = m_CacheHash * 31 + (Endpoint.fPresent ? Endpoint.u32DescriptorHash : 0);
+    }
+    if (m_pAdapter->UsbSidebandCacheTake(m_pTarget->GetConfig().u32Identity, m_CacheHash))
+    {
+        m_fCachedDiscovery = true;
+        m_aEndpoints[0].fFormats = m_aEndpoints[0].fPresent;
+        m_aEndpoints[1].fFormats = m_aEndpoints[1].fPresent;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_aEndpoints[i].fPresent)
+        {
+            Status = StartEndpoint(&m_aEndpoints[i], i == 0);
+            if (!NT_SUCCESS(Status))
+            {
+                goto Done;
+            }
+        }
+    }
+
+    // NotifyEndpointPair does not talk to the interface
+    Status = SendIoCtrlSynchronously(IOCTL_SBAUD_SET_DEVICE_CLAIMED, 0u, 1);
+    if (NT_SUCCESS(Status))
+    {
+        m_CacheDiscovery = true;
+    }
+
+Done:
+    if (!NT_SUCCESS(Status))
+    {
+        SendIoCtrlSynchronously(IOCTL_SBAUD_SET_DEVICE_CLAIMED, 0u, 0);
+        m_State = eSidebandStateFailed;
+    }
+}
+
+void CUsbHsDevice::HandleNotification(NOTIFICATION_REQUEST *pRequest)
+{
+    for (ENDPOINT &Endpoint : m_aEndpoints)
+    {
+        if (Endpoint.fPresent && Endpoint.EpIndex == pRequest->Buffer.u32EndpointIndex)
+        {
+            if (pRequest->Ioctl == IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE)
+            {
+                Endpoint.VolumeLevel = pRequest->Buffer.i32Value;
+            }
+            else if (pRequest->Ioctl == IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE)
+            {
+                Endpoint.Mute = pRequest->Buffer.i32Value;
+            }
+        }
+    }
+}
+
+//
+// The headsets simulated have no feedback endpoint: one SIOP to set and
+// four to read back.
+//
+NTSTATUS CUsbHsDevice::SetTransportResources(uint32_t EpIndex)
+{
+    return SendIoCtrlSynchronously(IOCTL_SBAUD_SET_SIOP, EpIndex);
+}
+
+NTSTATUS CUsbHsDevice::GetTransportResources(uint32_t EpIndex)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    uint32_t u32Hash;
+
+    for (int i = 0; i < 4 && NT_SUCCESS(Status); i++)
+    {
+        Status = GetSized(IOCTL_SBAUD_GET_SIOP, EpIndex, &u32Hash, NULL);
+    }
+    return Status;
+}
+
+NTSTATUS CUsbHsDevice::StreamOpen()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    uint32_t EpIndex = m_aEndpoints[0].EpIndex;
+
+    if (++m_nSpeakerStreamsOpen == 1)
+    {
+        bool fStreamOpen = false;
+
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_OPEN, EpIndex);
+        if (Status == STATUS_DEVICE_BUSY)
+        {
+            Status = STATUS_SUCCESS;
+        }
+        if (NT_SUCCESS(Status))
+        {
+            fStreamOpen = true;
+            m_SpeakerStreamStatus = STATUS_SUCCESS;
+            Status = EnableNotification(&m_SpeakerStreamReq, EpIndex);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            m_nSpeakerStreamsOpen--;
+            if (fStreamOpen)
+            {
+                SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_CLOSE, EpIndex);
+            }
+            m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CUsbHsDevice::StreamStart()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    uint32_t EpIndex = m_aEndpoints[0].EpIndex;
+
+    if (++m_nSpeakerStreamsStart == 1)
+    {
+        bool fStreamStart = false;
+
+        Status = SetTransportResources(EpIndex);
+        if (NT_SUCCESS(Status))
+        {
+            Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_START, EpIndex);
+            if (Status == STATUS_DEVICE_BUSY)
+            {
+                Status = STATUS_SUCCESS;
+            }
+        }
+        if (NT_SUCCESS(Status))
+        {
+            fStreamStart = true;
+            Status = GetTransportResources(EpIndex);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            m_nSpeakerStreamsStart--;
+            if (fStreamStart)
+            {
+                SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_SUSPEND, EpIndex);
+            }
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CUsbHsDevice::StreamSuspend()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (--m_nSpeakerStreamsStart == 0)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_SUSPEND, m_aEndpoints[0].EpIndex);
+    }
+    return Status;
+}
+
+NTSTATUS CUsbHsDevice::StreamClose()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (--m_nSpeakerStreamsOpen == 0)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_SBAUD_STREAM_CLOSE, m_aEndpoints[0].EpIndex);
+        StopStreamStatusNotification(&m_SpeakerStreamReq);
+        m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+    }
+    return Status;
+}
+
+//-------------------------------------------------------------------------
+// CBthHfpDevice
+//
+class CBthHfpDevice : public CSidebandDevice
+{
+public:
+    CBthHfpDevice(CHostAdapter *pAdapter, CSidebandFakeDevice *pTarget, uint32_t u32SymbolicLink, size_t iArrival)
+        : CSidebandDevice(pAdapter, pTarget, u32SymbolicLink, iArrival),
+          m_fVolume(false), m_SpeakerVolumeLevel(0), m_MicVolumeLevel(0),
+          m_ConnectionStatus(0), m_NRECDisableStatus(0), m_CodecId(0), m_nStreams(0)
+    {
+        InitNotificationRequest(&m_NrecDisableStatusReq, IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_SpeakerVolumeReq, IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_MicVolumeReq, IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_ConnectionReq, IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE, false);
+        InitNotificationRequest(&m_StreamReq, IOCTL_BTHHFP_STREAM_GET_STATUS_UPDATE, true);
+    }
+
+    void Start() override;
+    NTSTATUS StreamOpen() override { return STATUS_SUCCESS; }
+    NTSTATUS StreamStart() override;
+    NTSTATUS StreamSuspend() override;
+    NTSTATUS StreamClose() override { return STATUS_SUCCESS; }
+
+protected:
+    void HandleNotification(NOTIFICATION_REQUEST *pRequest) override;
+
+private:
+    NTSTATUS GetBthHfpCodecId();
+
+    bool                    m_fVolume;
+    int32_t                 m_SpeakerVolumeLevel;
+    int32_t                 m_MicVolumeLevel;
+    int32_t                 m_ConnectionStatus;
+    int32_t                 m_NRECDisableStatus;
+    int32_t                 m_CodecId;
+    int32_t                 m_nStreams;
+    NOTIFICATION_REQUEST    m_NrecDisableStatusReq;
+    NOTIFICATION_REQUEST    m_SpeakerVolumeReq;
+    NOTIFICATION_REQUEST    m_MicVolumeReq;
+    NOTIFICATION_REQUEST    m_ConnectionReq;
+    NOTIFICATION_REQUEST    m_StreamReq;
+};
+
+NTSTATUS CBthHfpDevice::GetBthHfpCodecId()
+{
+    SIDEBANDHOST_BUFFER Buffer = {};
+
+    NTSTATUS Status = SendIoCtrlSynchronously(IOCTL_BTHHFP_DEVICE_GET_CODEC_ID, &Buffer);
+    if (NT_SUCCESS(Status))
+    {
+        m_CodecId = Buffer.i32Value;
+    }
+    return Status;
+}
+
+void CBthHfpDevice::Start()
+{
+    NTSTATUS Status;
+    uint32_t u32Hash;
+    int32_t i32Flags = 0;
+
+    Status = SendIoCtrlSynchronously(IOCTL_BTHHFP_DEVICE_INDICATE_AUDIO_DEVICE_CAPABILITIES, 0u);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+
+    Status = GetSized(IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2, 0, &u32Hash, &i32Flags);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+    m_fVolume = (i32Flags & SIDEBANDHOST_EP_VOLUME) != 0;
+
+    if (m_fVolume)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_BTHHFP_DEVICE_GET_VOLUMEPROPERTYVALUES, 0u);
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE, 0, &m_SpeakerVolumeLevel);
+        }
+        if (NT_SUCCESS(Status))
+        {
+            Status = GetStatus(IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE, 0, &m_MicVolumeLevel);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+    }
+
+    Status = GetStatus(IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE, 0, &m_ConnectionStatus);
+    if (!NT_SUCCESS(Status))
+    {
+        goto Done;
+    }
+    if (m_ConnectionStatus)
+    {
+        // older stacks do not implement the codec id query
+        Status = GetBthHfpCodecId();
+        if (Status == STATUS_INVALID_DEVICE_REQUEST)
+        {
+            Status = STATUS_SUCCESS;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            goto Done;
+        }
+    }
+
+    // minipairs; then the render and capture filters, and NotifyEndpointPair
+    InstallEndpointFilters(true);
+    InstallEndpointFilters(false);
+
+    Status = EnableNotification(&m_NrecDisableStatusReq, 0);
+    if (NT_SUCCESS(Status) && m_fVolume)
+    {
+        Status = EnableNotification(&m_SpeakerVolumeReq, 0);
+        if (NT_SUCCESS(Status))
+        {
+            Status = EnableNotification(&m_MicVolumeReq, 0);
+        }
+    }
+    if (NT_SUCCESS(Status))
+    {
+        Status = EnableNotification(&m_ConnectionReq, 0);
+    }
+
+Done:
+    if (!NT_SUCCESS(Status))
+    {
+        m_State = eSidebandStateFailed;
+    }
+}
+
+//
+// The driver skips a volume update while a volume set of the engine is
+// queued on the control queue; the engine here sets no volume.
+//
+void CBthHfpDevice::HandleNotification(NOTIFICATION_REQUEST *pRequest)
+{
+    switch (pRequest->Ioctl)
+    {
+    case IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE:
+        m_NRECDisableStatus = pRequest->Buffer.i32Value;
+        break;
+
+    case IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE:
+        m_SpeakerVolumeLevel = pRequest->Buffer.i32Value;
+        break;
+
+    case IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE:
+        m_MicVolumeLevel = pRequest->Buffer.i32Value;
+        break;
+
+    case IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE:
+        if (pRequest->Buffer.i32Value)
+        {
+            GetBthHfpCodecId();
+        }
+        m_ConnectionStatus = pRequest->Buffer.i32Value;
+        break;
+
+    default:
+        break;
+    }
+}
+
+//
+// The HFP DDI has no start and suspend: STREAM_OPEN on the first start,
+// STREAM_CLOSE on the last suspend.
+//
+NTSTATUS CBthHfpDevice::StreamStart()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (++m_nStreams == 1)
+    {
+        bool fStreamStart = false;
+
+        Status = SendIoCtrlSynchronously(IOCTL_BTHHFP_STREAM_OPEN, 0u);
+        if (Status == STATUS_DEVICE_BUSY)
+        {
+            Status = STATUS_SUCCESS;
+        }
+        if (NT_SUCCESS(Status))
+        {
+            fStreamStart = true;
+            m_SpeakerStreamStatus = STATUS_SUCCESS;
+            Status = EnableNotification(&m_StreamReq, 0);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            m_nStreams--;
+            if (fStreamStart)
+            {
+                SendIoCtrlSynchronously(IOCTL_BTHHFP_STREAM_CLOSE, 0u);
+            }
+            m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+        }
+    }
+    return Status;
+}
+
+NTSTATUS CBthHfpDevice::StreamSuspend()
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (--m_nStreams == 0)
+    {
+        Status = SendIoCtrlSynchronously(IOCTL_BTHHFP_STREAM_CLOSE, 0u);
+        StopStreamStatusNotification(&m_StreamReq);
+        m_SpeakerStreamStatus = STATUS_INVALID_DEVICE_STATE;
+    }
+    return Status;
+}
+
+//-------------------------------------------------------------------------
+// CHostAdapter
+//
+CHostAdapter::CHostAdapter(CSidebandHostScheduler *pScheduler, bool fUsbCache)
+    : m_pScheduler(pScheduler),
+      m_fUsbCacheEnabled(fUsbCache),
+      m_u64LeakedRequests(0),
+      m_u64UsbCacheHits(0)
+{
+    for (WORKER &Worker : m_aWorkers)
+    {
+        Worker.fQueued = false;
+        Worker.u64FreeUs = 0;
+    }
+}
+
+CHostAdapter::~CHostAdapter()
+{
+    // devices never stopped are released as the adapter goes away
+    for (CSidebandDevice *pDevice : m_Devices)
+    {
+        ReleaseDevice(pDevice);
+    }
+    m_Devices.clear();
+    m_Released.clear();
+}
+
+CSidebandDevice *CHostAdapter::DeviceFind(uint32_t u32SymbolicLink) const
+{
+    for (CSidebandDevice *pDevice : m_Devices)
+    {
+        if (pDevice->GetSymbolicLink() == u32SymbolicLink)
+        {
+            return pDevice;
+        }
+    }
+    return NULL;
+}
+
+//
+// The XxxSidebandInterfaceArrival routines
+//
+void CHostAdapter::InterfaceArrival(uint32_t u32SymbolicLink, CSidebandFakeDevice *pTarget)
+{
+    SIDEBANDHOST_PROFILE Profile = pTarget->GetConfig().Profile;
+
+    if (DeviceFind(u32SymbolicLink) != NULL)
+    {
+        return;
+    }
+
+    SIDEBANDHOST_ARRIVAL Arrival = {};
+    Arrival.Profile = Profile;
+    Arrival.u64ArrivalUs = m_pScheduler->GetNowUs();
+    Arrival.u64RemovalUs = UINT64_MAX;
+    Arrival.u64StartedUs = UINT64_MAX;
+    Arrival.u64FirstAudioUs = UINT64_MAX;
+    m_Arrivals.push_back(Arrival);
+    m_Engines.push_back(ENGINE());
+
+    CSidebandDevice *pDevice;
+    switch (Profile)
+    {
+    case SIDEBANDHOST_A2DP:
+        pDevice = new CA2dpHpDevice(this, pTarget, u32SymbolicLink, m_Arrivals.size() - 1);
+        break;
+    case SIDEBANDHOST_USB:
+        pDevice = new CUsbHsDevice(this, pTarget, u32SymbolicLink, m_Arrivals.size() - 1);
+        break;
+    default:
+        pDevice = new CBthHfpDevice(this, pTarget, u32SymbolicLink, m_Arrivals.size() - 1);
+        break;
+    }
+
+    pDevice->Init();
+    m_Devices.push_back(pDevice);
+    QueueTask(Profile, pDevice, true);
+}
+
+//
+// The XxxSidebandInterfaceRemoval routines
+//
+void CHostAdapter::InterfaceRemoval(uint32_t u32SymbolicLink)
+{
+    CSidebandDevice *pDevice = DeviceFind(u32SymbolicLink);
+
+    if (pDevice == NULL)
+    {
+        return;
+    }
+
+    m_Devices.erase(std::find(m_Devices.begin(), m_Devices.end(), pDevice));
+    m_Arrivals[pDevice->GetArrival()].u64RemovalUs = m_pScheduler->GetNowUs();
+    QueueTask(pDevice->GetTarget()->GetConfig().Profile, pDevice, false);
+}
+
+void CHostAdapter::Cleanup()
+{
+    // the cache takes no more entries once cleanup begins
+    m_fUsbCacheEnabled = false;
+    m_UsbSidebandCache.clear();
+
+    std::vector<CSidebandDevice *> Devices;
+    Devices.swap(m_Devices);
+    for (CSidebandDevice *pDevice : Devices)
+    {
+        QueueTask(pDevice->GetTarget()->GetConfig().Profile, pDevice, false);
+    }
+}
+
+void CHostAdapter::QueueTask(SIDEBANDHOST_PROFILE Profile, CSidebandDevice *pDevice, bool fStart)
+{
+    WORKER *pWorker = &m_aWorkers[Profile];
+    WORK_TASK Task = { pDevice, fStart };
+
+    pWorker->Tasks.push_back(Task);
+    if (!pWorker->fQueued)
+    {
+        pWorker->fQueued = true;
+        m_pScheduler->Post(pWorker->u64FreeUs, [this, Profile]() { InterfaceWorkItem(Profile); });
+    }
+}
+
+//
+// EvtXxxSidebandInterfaceWorkItem: one task per event, so that what the
+// other threads do meanwhile runs in time order; the next task starts when
+// this one is done.
+//
+void CHostAdapter::InterfaceWorkItem(SIDEBANDHOST_PROFILE Profile)
+{
+    WORKER *pWorker = &m_aWorkers[Profile];
+
+    pWorker->fQueued = false;
+    if (pWorker->Tasks.empty())
+    {
+        return;
+    }
+    WORK_TASK Task = pWorker->Tasks.front();
+    pWorker->Tasks.pop_front();
+
+    CSidebandDevice *pDevice = Task.Device;
+    SIDEBANDHOST_ARRIVAL *pArrival = &m_Arrivals[pDevice->GetArrival()];
+
+    pDevice->m_u64NowUs = m_pScheduler->GetNowUs();
+    if (Task.fStart)
+    {
+        pDevice->Start();
+        if (pDevice->GetState() == eSidebandStateFailed)
+        {
+            pArrival->fStartFailed = true;
+        }
+        else
+        {
+            pArrival->u64StartedUs = pDevice->m_u64NowUs;
+        }
+        if (Profile == SIDEBANDHOST_USB)
+        {
+            pArrival->fCachedDiscovery = static_cast<CUsbHsDevice *>(pDevice)->IsCachedDiscovery();
+        }
+    }
+    else
+    {
+        pDevice->Stop();
+        ReleaseDevice(pDevice);
+    }
+    pWorker->u64FreeUs = pDevice->m_u64NowUs;
+
+    if (!pWorker->Tasks.empty())
+    {
+        pWorker->fQueued = true;
+        m_pScheduler->Post(pWorker->u64FreeUs, [this, Profile]() { InterfaceWorkItem(Profile); });
+    }
+}
+
+//
+// The last reference goes: whatever is still pending on the interface was
+// never cancelled.
+//
+void CHostAdapter::ReleaseDevice(CSidebandDevice *pDevice)
+{
+    m_u64LeakedRequests += pDevice->GetTarget()->GetPendingCount();
+    pDevice->FinalRelease();
+    m_Released.emplace_back(pDevice);
+}
+
+uint32_t CHostAdapter::CountStalledNotifications() const
+{
+    uint32_t cStalled = 0;
+
+    for (CSidebandDevice *pDevice : m_Devices)
+    {
+        if (pDevice->GetState() == eSidebandStateRunning &&
+            !pDevice->GetTarget()->IsRemoved(m_pScheduler->GetNowUs()))
+        {
+            cStalled += pDevice->CountStalledNotifications();
+        }
+    }
+    return cStalled;
+}
+
+bool CHostAdapter::UsbSidebandCacheTake(uint32_t u32ContainerId, uint32_t u32Hash)
+{
+    for (auto it = m_UsbSidebandCache.begin(); it != m_UsbSidebandCache.end(); ++it)
+    {
+        if (it->u32Hash == u32Hash && it->u32ContainerId == u32ContainerId)
+        {
+            m_UsbSidebandCache.erase(it);
+            m_u64UsbCacheHits++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CHostAdapter::UsbSidebandCacheStore(uint32_t u32ContainerId, uint32_t u32Hash)
+{
+    if (!m_fUsbCacheEnabled)
+    {
+        return;
+    }
+
+    CACHE_ENTRY Entry = { u32ContainerId, u32Hash };
+    m_UsbSidebandCache.push_front(Entry);
+    if (m_UsbSidebandCache.size() > USBHS_CACHE_MAX_ENTRIES)
+    {
+        m_UsbSidebandCache.pop_back();
+    }
+}
+
+//
+// The engine builds its graph as soon as the render endpoint appears, and
+// starts streaming on it.
+//
+void CHostAdapter::EndpointInstalled(CSidebandDevice *pDevice)
+{
+    m_pScheduler->Post(pDevice->m_u64NowUs, [this, pDevice]()
+    {
+        pDevice->m_u64NowUs = m_pScheduler->GetNowUs();
+        EngineStart(pDevice);
+    });
+}
+
+void CHostAdapter::EngineStart(CSidebandDevice *pDevice)
+{
+    ENGINE *pEngine = &m_Engines[pDevice->GetArrival()];
+    SIDEBANDHOST_ARRIVAL *pArrival = &m_Arrivals[pDevice->GetArrival()];
+
+    // the endpoint went away before the engine got to it
+    if (pDevice->GetState() == eSidebandStateStopping || pDevice->GetState() == eSidebandStateStopped)
+    {
+        return;
+    }
+
+    NTSTATUS Status = pDevice->StreamOpen();
+    if (NT_SUCCESS(Status))
+    {
+        pEngine->fOpen = true;
+        Status = pDevice->StreamStart();
+    }
+    if (NT_SUCCESS(Status))
+    {
+        pEngine->fStarted = true;
+        if (pArrival->u64FirstAudioUs == UINT64_MAX)
+        {
+            pArrival->u64FirstAudioUs = pDevice->m_u64NowUs;
+        }
+    }
+    else
+    {
+        pArrival->fStreamFailed = true;
+    }
+}
+
+void CHostAdapter::RestartStream(uint32_t u32SymbolicLink)
+{
+    CSidebandDevice *pDevice = DeviceFind(u32SymbolicLink);
+
+    if (pDevice == NULL || !m_Engines[pDevice->GetArrival()].fOpen)
+    {
+        return;
+    }
+
+    pDevice->m_u64NowUs = m_pScheduler->GetNowUs();
+    EndpointRemoved(pDevice);
+    EngineStart(pDevice);
+}
+
+//
+// RemoveEndpointFilters: the engine stops and closes its stream on the
+// endpoint before the filters go.
+//
+void CHostAdapter::EndpointRemoved(CSidebandDevice *pDevice)
+{
+    ENGINE *pEngine = &m_Engines[pDevice->GetArrival()];
+
+    if (pEngine->fStarted)
+    {
+        pDevice->StreamSuspend();
+        pEngine->fStarted = false;
+    }
+    if (pEngine->fOpen)
+    {
+        pDevice->StreamClose();
+        pEngine->fOpen = false;
+    }
+}
+
+CSidebandHostAdapter *SidebandHost_CreateAdapter(CSidebandHostScheduler *pScheduler, bool fUsbCache)
+{
+    return new CHostAdapter(pScheduler, fUsbCache);
+}
@@ -0,0 +1,657 @@
+//
+// SidebandHost.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Virtual time and the fake sideband interfaces. The contract checked
+//   here is the one the device classes rely on; when a class starts using
+//   another IOCTL, or a stack changes how it completes one, change the fake
+//   to match.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "SidebandHost.h"
+
+// an IOCTL to a closed target fails without reaching the device
+#define SIDEBANDHOST_FAIL_FAST_US   20
+
+static const char *g_apszIoctl[SIDEBANDHOST_IOCTL_COUNT] =
+{
+    "IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR",
+    "IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2",
+    "IOCTL_SBAUD_GET_SUPPORTED_FORMATS",
+    "IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES",
+    "IOCTL_SBAUD_GET_MUTEPROPERTYVALUES",
+    "IOCTL_SBAUD_SET_VOLUME",
+    "IOCTL_SBAUD_SET_MUTE",
+    "IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE",
+    "IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE",
+    "IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE",
+    "IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE",
+    "IOCTL_SBAUD_GET_SIOP",
+    "IOCTL_SBAUD_SET_SIOP",
+    "IOCTL_SBAUD_GET_SIOP_UPDATE",
+    "IOCTL_SBAUD_STREAM_OPEN",
+    "IOCTL_SBAUD_STREAM_START",
+    "IOCTL_SBAUD_STREAM_SUSPEND",
+    "IOCTL_SBAUD_STREAM_CLOSE",
+    "IOCTL_SBAUD_SET_DEVICE_CLAIMED",
+    "IOCTL_BTHHFP_DEVICE_INDICATE_AUDIO_DEVICE_CAPABILITIES",
+    "IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2",
+    "IOCTL_BTHHFP_DEVICE_GET_VOLUMEPROPERTYVALUES",
+    "IOCTL_BTHHFP_SPEAKER_SET_VOLUME",
+    "IOCTL_BTHHFP_MIC_SET_VOLUME",
+    "IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE",
+    "IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE",
+    "IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE",
+    "IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE",
+    "IOCTL_BTHHFP_DEVICE_GET_CODEC_ID",
+    "IOCTL_BTHHFP_DEVICE_REQUEST_CONNECT",
+    "IOCTL_BTHHFP_DEVICE_REQUEST_DISCONNECT",
+    "IOCTL_BTHHFP_STREAM_OPEN",
+    "IOCTL_BTHHFP_STREAM_CLOSE",
+    "IOCTL_BTHHFP_STREAM_GET_STATUS_UPDATE",
+};
+
+const char *SidebandHost_IoctlName(SIDEBANDHOST_IOCTL Ioctl)
+{
+    return (Ioctl < SIDEBANDHOST_IOCTL_COUNT) ? g_apszIoctl[Ioctl] : "?";
+}
+
+const char *SidebandHost_ProfileName(SIDEBANDHOST_PROFILE Profile)
+{
+    static const char *apszProfile[] = { "a2dp", "usb", "hfp" };
+    return (Profile < SIDEBANDHOST_PROFILE_COUNT) ? apszProfile[Profile] : "?";
+}
+
+void SidebandHost_DefaultConfig(SIDEBANDHOST_PROFILE Profile, uint32_t u32Identity, SIDEBANDHOST_DEVICE_CONFIG *pConfig)
+{
+    memset(pConfig, 0, sizeof(*pConfig));
+    pConfig->Profile = Profile;
+    pConfig->u32Identity = u32Identity;
+    pConfig->fSpeaker = true;
+    pConfig->fMic = (Profile != SIDEBANDHOST_A2DP);
+    pConfig->fVolume = true;
+    pConfig->fMute = (Profile != SIDEBANDHOST_HFP);
+    pConfig->fConnected = true;
+    pConfig->fCodecId = true;
+
+    switch (Profile)
+    {
+    case SIDEBANDHOST_A2DP:
+        // the stack answers from its cache; AVDTP open and start go over the air
+        pConfig->u32ControlUs = 300;
+        pConfig->u32DescriptorUs = 800;
+        pConfig->u32FormatsUs = 300;
+        pConfig->u32StreamOpenUs = 120000;
+        pConfig->u32StreamStartUs = 35000;
+        break;
+
+    case SIDEBANDHOST_USB:
+        // class-specific control transfers to the headset
+        pConfig->u32ControlUs = 250;
+        pConfig->u32DescriptorUs = 1500;
+        pConfig->u32FormatsUs = 6000;
+        pConfig->u32StreamOpenUs = 12000;
+        pConfig->u32StreamStartUs = 1000;
+        break;
+
+    default:
+        // HFP has no stream start; STREAM_OPEN sets up the SCO link
+        pConfig->u32ControlUs = 300;
+        pConfig->u32DescriptorUs = 800;
+        pConfig->u32FormatsUs = 0;
+        pConfig->u32StreamOpenUs = 45000;
+        pConfig->u32StreamStartUs = 0;
+        break;
+    }
+}
+
+void SidebandHost_AddCounters(SIDEBANDHOST_COUNTERS *pTotal, const SIDEBANDHOST_COUNTERS *pCounters)
+{
+    pTotal->u64Ioctls += pCounters->u64Ioctls;
+    pTotal->u64Removed += pCounters->u64Removed;
+    pTotal->u64Violations += pCounters->u64Violations;
+    pTotal->u64Completions += pCounters->u64Completions;
+    for (int i = 0; i < SIDEBANDHOST_IOCTL_COUNT; i++)
+    {
+        pTotal->u64PerIoctl[i] += pCounters->u64PerIoctl[i];
+    }
+}
+
+//-------------------------------------------------------------------------
+// CSidebandHostScheduler
+//
+void CSidebandHostScheduler::Post(uint64_t u64AtUs, std::function<void()> Event)
+{
+    EVENT NewEvent = { std::max(u64AtUs, m_u64NowUs), m_u64Sequence++, std::move(Event) };
+
+    m_Events.push_back(std::move(NewEvent));
+    std::push_heap(m_Events.begin(), m_Events.end(), [](const EVENT &a, const EVENT &b)
+    {
+        return a.u64AtUs > b.u64AtUs || (a.u64AtUs == b.u64AtUs && a.u64Sequence > b.u64Sequence);
+    });
+}
+
+void CSidebandHostScheduler::RunUntil(uint64_t u64UntilUs)
+{
+    while (!m_Events.empty() && m_Events.front().u64AtUs <= u64UntilUs)
+    {
+        std::pop_heap(m_Events.begin(), m_Events.end(), [](const EVENT &a, const EVENT &b)
+        {
+            return a.u64AtUs > b.u64AtUs || (a.u64AtUs == b.u64AtUs && a.u64Sequence > b.u64Sequence);
+        });
+        EVENT Event = std::move(m_Events.back());
+        m_Events.pop_back();
+
+        m_u64NowUs = Event.u64AtUs;
+        Event.Event();
+    }
+
+    if (u64UntilUs != UINT64_MAX)
+    {
+        m_u64NowUs = std::max(m_u64NowUs, u64UntilUs);
+    }
+}
+
+//-------------------------------------------------------------------------
+// CSidebandFakeDevice
+//
+static uint32_t HashDescriptor(uint32_t u32Identity, SIDEBANDHOST_IOCTL Ioctl, uint32_t u32EndpointIndex)
+{
+    const uint32_t au32Words[] = { u32Identity, (uint32_t)Ioctl, u32EndpointIndex };
+    uint32_t u32Hash = 2166136261u;
+
+    for (uint32_t u32Word : au32Words)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            u32Hash = (u32Hash ^ ((u32Word >> (8 * i)) & 0xff)) * 16777619u;
+        }
+    }
+    return u32Hash;
+}
+
+static bool IsStatusUpdate(SIDEBANDHOST_IOCTL Ioctl)
+{
+    switch (Ioctl)
+    {
+    case IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_SIOP_UPDATE:
+    case IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE:
+    case IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE:
+    case IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE:
+    case IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE:
+    case IOCTL_BTHHFP_STREAM_GET_STATUS_UPDATE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// IOCTLs that return a variable-length structure; the caller asks for the
+// size first
+static bool IsSized(SIDEBANDHOST_IOCTL Ioctl)
+{
+    switch (Ioctl)
+    {
+    case IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR:
+    case IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2:
+    case IOCTL_SBAUD_GET_SUPPORTED_FORMATS:
+    case IOCTL_SBAUD_GET_SIOP:
+    case IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// SBAUD IOCTLs that address one endpoint
+static bool IsPerEndpoint(SIDEBANDHOST_IOCTL Ioctl)
+{
+    switch (Ioctl)
+    {
+    case IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2:
+    case IOCTL_SBAUD_GET_SUPPORTED_FORMATS:
+    case IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES:
+    case IOCTL_SBAUD_GET_MUTEPROPERTYVALUES:
+    case IOCTL_SBAUD_SET_VOLUME:
+    case IOCTL_SBAUD_SET_MUTE:
+    case IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE:
+    case IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE:
+    case IOCTL_SBAUD_STREAM_OPEN:
+    case IOCTL_SBAUD_STREAM_START:
+    case IOCTL_SBAUD_STREAM_SUSPEND:
+    case IOCTL_SBAUD_STREAM_CLOSE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+CSidebandFakeDevice::CSidebandFakeDevice(CSidebandHostScheduler *pScheduler, const SIDEBANDHOST_DEVICE_CONFIG *pConfig)
+    : m_pScheduler(pScheduler),
+      m_Config(*pConfig),
+      m_u64ChannelFreeUs(0),
+      m_u64RemovalUs(UINT64_MAX),
+      m_fPurged(false),
+      m_fClaimed(false)
+{
+    memset(&m_Counters, 0, sizeof(m_Counters));
+    memset(m_afStreamOpen, 0, sizeof(m_afStreamOpen));
+    memset(m_afStreamStarted, 0, sizeof(m_afStreamStarted));
+
+    // SBAUD endpoints: the speaker first, then the mic. HFP has no endpoint
+    // index, but a speaker and a mic volume.
+    m_cEndpoints = (m_Config.Profile == SIDEBANDHOST_HFP) ? 2 : (m_Config.fSpeaker ? 1 : 0) + (m_Config.fMic ? 1 : 0);
+
+    for (int i = 0; i < STATUS_SLOTS; i++)
+    {
+        m_ai32Status[i] = 0;
+    }
+    m_ai32Status[StatusSlot(IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE, 0)] = m_Config.fConnected;
+    m_ai32Status[StatusSlot(IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE, 0)] = m_Config.fConnected;
+}
+
+bool CSidebandFakeDevice::IsImplemented(SIDEBANDHOST_IOCTL Ioctl) const
+{
+    if (m_Config.Profile == SIDEBANDHOST_HFP)
+    {
+        return Ioctl >= IOCTL_BTHHFP_DEVICE_INDICATE_AUDIO_DEVICE_CAPABILITIES &&
+               (Ioctl != IOCTL_BTHHFP_DEVICE_GET_CODEC_ID || m_Config.fCodecId);
+    }
+    return Ioctl < IOCTL_BTHHFP_DEVICE_INDICATE_AUDIO_DEVICE_CAPABILITIES;
+}
+
+uint32_t CSidebandFakeDevice::GetLatencyUs(SIDEBANDHOST_IOCTL Ioctl) const
+{
+    switch (Ioctl)
+    {
+    case IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR:
+    case IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2:
+    case IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2:
+        return m_Config.u32DescriptorUs;
+    case IOCTL_SBAUD_GET_SUPPORTED_FORMATS:
+        return m_Config.u32FormatsUs;
+    case IOCTL_SBAUD_STREAM_OPEN:
+    case IOCTL_BTHHFP_STREAM_OPEN:
+        return m_Config.u32StreamOpenUs;
+    case IOCTL_SBAUD_STREAM_START:
+        return m_Config.u32StreamStartUs;
+    default:
+        return m_Config.u32ControlUs;
+    }
+}
+
+int CSidebandFakeDevice::StatusSlot(SIDEBANDHOST_IOCTL UpdateIoctl, uint32_t u32EndpointIndex) const
+{
+    uint32_t u32Endpoint = std::min(u32EndpointIndex, 1u);
+
+    switch (UpdateIoctl)
+    {
+    case IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE:              return 0 + u32Endpoint;
+    case IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE:                return 2 + u32Endpoint;
+    case IOCTL_SBAUD_GET_STREAM_STATUS_UPDATE:              return 4 + u32Endpoint;
+    case IOCTL_SBAUD_GET_CONNECTION_STATUS_UPDATE:          return 6;
+    case IOCTL_SBAUD_GET_SIOP_UPDATE:                       return 7;
+    case IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE:     return 8;
+    case IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE:         return 9;
+    case IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE:  return 10;
+    case IOCTL_BTHHFP_DEVICE_GET_NRECDISABLE_STATUS_UPDATE: return 11;
+    case IOCTL_BTHHFP_STREAM_GET_STATUS_UPDATE:             return 12;
+    default:                                                return -1;
+    }
+}
+
+void CSidebandFakeDevice::Violation(SIDEBANDHOST_IOCTL Ioctl, const char *pszWhy)
+{
+    m_Counters.u64Violations++;
+    fprintf(stderr, "contract: %s %08x: %s: %s\n", SidebandHost_ProfileName(m_Config.Profile),
+            m_Config.u32Identity, SidebandHost_IoctlName(Ioctl), pszWhy);
+}
+
+bool CSidebandFakeDevice::IsStreamOpen() const
+{
+    return m_afStreamOpen[0] || m_afStreamOpen[1];
+}
+
+NTSTATUS CSidebandFakeDevice::Execute(SIDEBANDHOST_IOCTL Ioctl, SIDEBANDHOST_BUFFER *pBuffer)
+{
+    uint32_t u32Endpoint = pBuffer->u32EndpointIndex;
+
+    if (!IsImplemented(Ioctl))
+    {
+        // the sample expects the codec id query to be missing on some systems
+        if (Ioctl != IOCTL_BTHHFP_DEVICE_GET_CODEC_ID)
+        {
+            Violation(Ioctl, "not implemented by this stack");
+        }
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    if (IsPerEndpoint(Ioctl) && u32Endpoint >= m_cEndpoints)
+    {
+        Violation(Ioctl, "endpoint index out of range");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (IsSized(Ioctl))
+    {
+        pBuffer->cbInformation = 64 + (HashDescriptor(m_Config.u32Identity, Ioctl, u32Endpoint) & 0xff);
+        if (pBuffer->cbOutput < pBuffer->cbInformation)
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        pBuffer->u32Hash = HashDescriptor(m_Config.u32Identity, Ioctl, u32Endpoint);
+    }
+
+    if (IsStatusUpdate(Ioctl))
+    {
+        pBuffer->i32Value = m_ai32Status[StatusSlot(Ioctl, u32Endpoint)];
+        return STATUS_SUCCESS;
+    }
+
+    bool fCapture = m_Config.fSpeaker ? (u32Endpoint == 1) : true;
+
+    switch (Ioctl)
+    {
+    case IOCTL_SBAUD_GET_DEVICE_DESCRIPTOR:
+        pBuffer->i32Value = (int32_t)m_cEndpoints;
+        break;
+
+    case IOCTL_SBAUD_GET_ENDPOINT_DESCRIPTOR2:
+        pBuffer->i32Value = (fCapture ? SIDEBANDHOST_EP_CAPTURE : 0) |
+                            (m_Config.fVolume ? SIDEBANDHOST_EP_VOLUME : 0) |
+                            (m_Config.fMute ? SIDEBANDHOST_EP_MUTE : 0);
+        break;
+
+    case IOCTL_BTHHFP_DEVICE_GET_DESCRIPTOR2:
+        pBuffer->i32Value = m_Config.fVolume ? SIDEBANDHOST_EP_VOLUME : 0;
+        break;
+
+    case IOCTL_SBAUD_GET_VOLUMEPROPERTYVALUES:
+    case IOCTL_BTHHFP_DEVICE_GET_VOLUMEPROPERTYVALUES:
+        if (!m_Config.fVolume)
+        {
+            Violation(Ioctl, "the descriptor does not report volume");
+            return STATUS_INVALID_DEVICE_REQUEST;
+        }
+        break;
+
+    case IOCTL_SBAUD_GET_MUTEPROPERTYVALUES:
+        if (!m_Config.fMute)
+        {
+            Violation(Ioctl, "the descriptor does not report mute");
+            return STATUS_INVALID_DEVICE_REQUEST;
+        }
+        break;
+
+    case IOCTL_SBAUD_SET_VOLUME:
+        m_ai32Status[StatusSlot(IOCTL_SBAUD_GET_VOLUME_STATUS_UPDATE, u32Endpoint)] = pBuffer->i32Value;
+        break;
+
+    case IOCTL_SBAUD_SET_MUTE:
+        m_ai32Status[StatusSlot(IOCTL_SBAUD_GET_MUTE_STATUS_UPDATE, u32Endpoint)] = pBuffer->i32Value;
+        break;
+
+    case IOCTL_BTHHFP_SPEAKER_SET_VOLUME:
+        m_ai32Status[StatusSlot(IOCTL_BTHHFP_SPEAKER_GET_VOLUME_STATUS_UPDATE, 0)] = pBuffer->i32Value;
+        break;
+
+    case IOCTL_BTHHFP_MIC_SET_VOLUME:
+        m_ai32Status[StatusSlot(IOCTL_BTHHFP_MIC_GET_VOLUME_STATUS_UPDATE, 0)] = pBuffer->i32Value;
+        break;
+
+    case IOCTL_SBAUD_GET_SIOP:
+        pBuffer->i32Value = m_ai32Status[StatusSlot(IOCTL_SBAUD_GET_SIOP_UPDATE, 0)];
+        break;
+
+    case IOCTL_BTHHFP_DEVICE_GET_CODEC_ID:
+        pBuffer->i32Value = 1;      // mSBC
+        break;
+
+    case IOCTL_SBAUD_STREAM_OPEN:
+        if (m_afStreamOpen[u32Endpoint])
+        {
+            // the sample takes this as "already open"
+            return STATUS_DEVICE_BUSY;
+        }
+        m_afStreamOpen[u32Endpoint] = true;
+        break;
+
+    case IOCTL_SBAUD_STREAM_START:
+        if (!m_afStreamOpen[u32Endpoint] || m_afStreamStarted[u32Endpoint])
+        {
+            Violation(Ioctl, m_afStreamOpen[u32Endpoint] ? "stream already started" : "stream not open");
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+        m_afStreamStarted[u32Endpoint] = true;
+        break;
+
+    case IOCTL_SBAUD_STREAM_SUSPEND:
+        if (!m_afStreamStarted[u32Endpoint])
+        {
+            Violation(Ioctl, "stream not started");
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+        m_afStreamStarted[u32Endpoint] = false;
+        break;
+
+    case IOCTL_SBAUD_STREAM_CLOSE:
+        if (!m_afStreamOpen[u32Endpoint] || m_afStreamStarted[u32Endpoint])
+        {
+            Violation(Ioctl, m_afStreamOpen[u32Endpoint] ? "stream still started" : "stream not open");
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+        m_afStreamOpen[u32Endpoint] = false;
+        break;
+
+    case IOCTL_SBAUD_SET_DEVICE_CLAIMED:
+        m_fClaimed = (pBuffer->i32Value != 0);
+        break;
+
+    case IOCTL_BTHHFP_STREAM_OPEN:
+        if (m_afStreamOpen[0])
+        {
+            Violation(Ioctl, "SCO stream already open");
+            return STATUS_DEVICE_BUSY;
+        }
+        if (!m_ai32Status[StatusSlot(IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE, 0)])
+        {
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+        m_afStreamOpen[0] = true;
+        break;
+
+    case IOCTL_BTHHFP_STREAM_CLOSE:
+        if (!m_afStreamOpen[0])
+        {
+            Violation(Ioctl, "SCO stream not open");
+            return STATUS_INVALID_DEVICE_STATE;
+        }
+        m_afStreamOpen[0] = false;
+        break;
+
+    case IOCTL_BTHHFP_DEVICE_REQUEST_CONNECT:
+    case IOCTL_BTHHFP_DEVICE_REQUEST_DISCONNECT:
+        ChangeStatus(IOCTL_BTHHFP_DEVICE_GET_CONNECTION_STATUS_UPDATE, 0, Ioctl == IOCTL_BTHHFP_DEVICE_REQUEST_CONNECT);
+        break;
+
+    default:
+        break;
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS CSidebandFakeDevice::Ioctl(
+    SIDEBANDHOST_IOCTL Ioctl,
+    uint64_t u64IssueUs,
+    SIDEBANDHOST_BUFFER *pBuffer,
+    uint64_t *pu64DoneUs)
+{
+    m_Counters.u64Ioctls++;
+    m_Counters.u64PerIoctl[Ioctl]++;
+
+    if (IsRemoved(u64IssueUs))
+    {
+        m_Counters.u64Removed++;
+        *pu64DoneUs = u64IssueUs + SIDEBANDHOST_FAIL_FAST_US;
+        return STATUS_NO_SUCH_DEVICE;
+    }
+    if (m_fPurged)
+    {
+        *pu64DoneUs = u64IssueUs;
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    uint32_t u32LatencyUs = (IsSized(Ioctl) && pBuffer->cbOutput == 0) ? m_Config.u32ControlUs : GetLatencyUs(Ioctl);
+    uint64_t u64DoneUs = std::max(u64IssueUs, m_u64ChannelFreeUs) + u32LatencyUs;
+
+    if (IsRemoved(u64DoneUs))
+    {
+        // the interface went away while the IOCTL was on the channel
+        m_Counters.u64Removed++;
+        m_u64ChannelFreeUs = m_u64RemovalUs;
+        *pu64DoneUs = std::max(u64IssueUs, m_u64RemovalUs);
+        return STATUS_NO_SUCH_DEVICE;
+    }
+
+    m_u64ChannelFreeUs = u64DoneUs;
+    *pu64DoneUs = u64DoneUs;
+
+    if (IsStatusUpdate(Ioctl) && !pBuffer->fImmediate)
+    {
+        Violation(Ioctl, "a synchronous status update must set bImmediate");
+        return STATUS_INVALID_PARAMETER;
+    }
+    return Execute(Ioctl, pBuffer);
+}
+
+bool CSidebandFakeDevice::Send(SIDEBANDHOST_REQUEST *pRequest, uint64_t u64IssueUs)
+{
+    m_Counters.u64Ioctls++;
+    m_Counters.u64PerIoctl[pRequest->Ioctl]++;
+
+    if (IsRemoved(u64IssueUs))
+    {
+        m_Counters.u64Removed++;
+        return false;
+    }
+    if (m_fPurged)
+    {
+        return false;
+    }
+    if (pRequest->fPending)
+    {
+        Violation(pRequest->Ioctl, "request sent again while pending");
+        return false;
+    }
+
+    bool fDuplicate = false;
+    for (SIDEBANDHOST_REQUEST *pPending : m_Pending)
+    {
+        if (pPending->Ioctl == pRequest->Ioctl &&
+            StatusSlot(pPending->Ioctl, pPending->Buffer.u32EndpointIndex) == StatusSlot(pRequest->Ioctl, pRequest->Buffer.u32EndpointIndex))
+        {
+            Violation(pRequest->Ioctl, "an update of this kind is already pending");
+            fDuplicate = true;
+        }
+    }
+
+    pRequest->fPending = true;
+    pRequest->u32Sends++;
+    m_Pending.push_back(pRequest);
+
+    if (IsStatusUpdate(pRequest->Ioctl) && IsImplemented(pRequest->Ioctl) && !pRequest->Buffer.fImmediate && !fDuplicate)
+    {
+        // pended until the value changes
+        return true;
+    }
+
+    // completes once the channel has handled it
+    NTSTATUS Status = fDuplicate ? STATUS_DEVICE_BUSY : Execute(pRequest->Ioctl, &pRequest->Buffer);
+    uint64_t u64DoneUs = std::max(u64IssueUs, m_u64ChannelFreeUs) + GetLatencyUs(pRequest->Ioctl);
+    uint32_t u32Send = pRequest->u32Sends;
+
+    m_u64ChannelFreeUs = u64DoneUs;
+    m_pScheduler->Post(u64DoneUs, [this, pRequest, u32Send, Status]()
+    {
+        // unless it was cancelled, or failed by the removal, meanwhile
+        if (pRequest->fPending && pRequest->u32Sends == u32Send)
+        {
+            Complete(pRequest, Status);
+        }
+    });
+    return true;
+}
+
+void CSidebandFakeDevice::Complete(SIDEBANDHOST_REQUEST *pRequest, NTSTATUS Status)
+{
+    m_Pending.erase(std::find(m_Pending.begin(), m_Pending.end(), pRequest));
+    pRequest->fPending = false;
+    pRequest->Completion(pRequest, Status);
+}
+
+void CSidebandFakeDevice::Cancel(SIDEBANDHOST_REQUEST *pRequest)
+{
+    if (pRequest->fPending)
+    {
+        Complete(pRequest, STATUS_CANCELLED);
+    }
+}
+
+void CSidebandFakeDevice::Purge()
+{
+    m_fPurged = true;
+    while (!m_Pending.empty())
+    {
+        Complete(m_Pending.front(), STATUS_CANCELLED);
+    }
+}
+
+void CSidebandFakeDevice::ChangeStatus(SIDEBANDHOST_IOCTL UpdateIoctl, uint32_t u32EndpointIndex, int32_t i32Value)
+{
+    int iSlot = StatusSlot(UpdateIoctl, u32EndpointIndex);
+
+    if (iSlot < 0 || m_ai32Status[iSlot] == i32Value || IsRemoved(m_pScheduler->GetNowUs()))
+    {
+        return;
+    }
+    m_ai32Status[iSlot] = i32Value;
+
+    for (SIDEBANDHOST_REQUEST *pPending : m_Pending)
+    {
+        if (pPending->Ioctl == UpdateIoctl && !pPending->Buffer.fImmediate &&
+            StatusSlot(pPending->Ioctl, pPending->Buffer.u32EndpointIndex) == iSlot)
+        {
+            m_Counters.u64Completions++;
+            pPending->Buffer.i32Value = i32Value;
+            Complete(pPending, STATUS_SUCCESS);
+            break;
+        }
+    }
+}
+
+void CSidebandFakeDevice::Remove(uint64_t u64AtUs)
+{
+    m_u64RemovalUs = u64AtUs;
+    m_pScheduler->Post(u64AtUs, [this]()
+    {
+        // the stack fails what it has pended; the link and its streams are gone
+        while (!m_Pending.empty())
+        {
+            Complete(m_Pending.front(), STATUS_NO_SUCH_DEVICE);
+        }
+        memset(m_afStreamOpen, 0, sizeof(m_afStreamOpen));
+        memset(m_afStreamStarted, 0, sizeof(m_afStreamStarted));
+        m_fClaimed = false;
+    });
+}
@@ -0,0 +1,636 @@
+//**@@@*@@@****************************************************
+//
+// Microsoft Windows
+// Copyright (C) Microsoft Corporation. All rights reserved.
+//
+//**@@@*@@@****************************************************
+
+//
+// FileName:    portcls.h
+//
+// Abstract:    Host stand-in for the WDK headers sysvad.h includes. With
+//              this directory first on the include path, the driver's own
+//              sysvad.h, common.h, kshelper.h and SysVadShared.h compile on
+//              the host unchanged, and so do the driver sources that only
+//              need the kernel types, spin locks, mutexes and pool: hw.cpp
+//              and EndpointsCommon/AudioModuleHelper.cpp.
+//
+//              Objects the tested code only passes around (device objects,
+//              IRPs, WDF handles, most port interfaces) are opaque. The
+//              routines the tested code calls work as documented for a
+//              single process: spin locks spin, a KMUTEX is a recursive
+//              mutex, pool is the C heap. Work items and timers are not
+//              needed by the tests and fail to allocate.
+//
+// ----------------------------------------------------------------------------
+
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "CodecHost.h"
+
+//
+// The driver assumes LLP64: LONG is 32 bits on every target, so LONG_MAX
+// must be its limit, not the host long's.
+//
+#undef LONG_MAX
+#define LONG_MAX                    2147483647L
+#undef LONG_MIN
+#define LONG_MIN                    (-LONG_MAX - 1)
+
+//
+// Base types CodecHost.h does not define.
+//
+typedef int                 INT;
+typedef unsigned int        UINT;
+typedef int                 BOOL;
+typedef BOOL *              PBOOL;
+typedef uint32_t            DWORD;
+typedef int32_t             NTSTATUS;
+typedef int32_t             HRESULT;
+typedef uint8_t             UCHAR;
+typedef int16_t             SHORT;
+typedef uint16_t            WORD;
+typedef wchar_t             WCHAR;
+typedef WCHAR *             PWSTR;
+typedef const WCHAR *       PCWSTR;
+typedef char                CHAR;
+typedef LONG *              PLONG;
+typedef ULONG *             PULONG;
+typedef USHORT *            PUSHORT;
+typedef uintptr_t           ULONG_PTR;
+typedef uint8_t             KIRQL;
+typedef KIRQL *             PKIRQL;
+typedef int                 LOGICAL;
+typedef uint64_t            POOL_FLAGS;
+typedef ULONG               DEVPROPTYPE;
+
+typedef union _LARGE_INTEGER
+{
+    LONGLONG    QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _UNICODE_STRING
+{
+    USHORT      Length;
+    USHORT      MaximumLength;
+    PWSTR       Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+#define _Out_opt_
+#define _Inout_opt_
+#define _In_reads_bytes_opt_(n)
+#define _Out_writes_opt_(n)
+#define _Out_writes_bytes_opt_(n)
+#define _Inout_updates_bytes_(n)
+#define _Pre_maybenull_
+#define _IRQL_requires_(x)
+#define _IRQL_requires_max_(x)
+#define _Function_class_(x)
+#define _At_(x, y)
+#define __drv_allocatesMem(x)
+#define __drv_freesMem(x)
+#define __field_bcount_opt(n)
+#define __cdecl
+#define UNREFERENCED_PARAMETER(p)   ((void)(p))
+
+#define PASSIVE_LEVEL               0
+#define APC_LEVEL                   1
+#define DISPATCH_LEVEL              2
+
+#define MAXUSHORT                   0xffff
+#define MAXULONG                    0xffffffffUL
+#define RTL_FIELD_SIZE(type, field) (sizeof(((type *)0)->field))
+#define RTL_SIZEOF_THROUGH_FIELD(type, field) \
+    (offsetof(type, field) + RTL_FIELD_SIZE(type, field))
+#define CONTAINING_RECORD(address, type, field) \
+    ((type *)((char *)(address) - offsetof(type, field)))
+#define FIELD_OFFSET(type, field)   ((LONG)offsetof(type, field))
+#define SIZEOF_ARRAY(a)             (sizeof(a) / sizeof((a)[0]))
+#define ARRAYSIZE(a)                SIZEOF_ARRAY(a)
+#define RtlFillMemory(d, n, v)      memset((d), (v), (n))
+#define _Analysis_assume_(e)        ((void)0)
+
+#define ASSERT(e)                   ((void)0)
+#define PAGED_CODE()                ((void)0)
+
+//
+// Status codes.
+//
+#define NT_SUCCESS(s)                       (((NTSTATUS)(s)) >= 0)
+#define STATUS_SUCCESS                      ((NTSTATUS)0x00000000L)
+#define STATUS_BUFFER_OVERFLOW              ((NTSTATUS)0x80000005L)
+#define STATUS_UNSUCCESSFUL                 ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED              ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER            ((NTSTATUS)0xC000000DL)
+#define STATUS_INVALID_DEVICE_REQUEST       ((NTSTATUS)0xC0000010L)
+#define STATUS_INSUFFICIENT_RESOURCES       ((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED                ((NTSTATUS)0xC00000BBL)
+#define STATUS_INTERNAL_ERROR               ((NTSTATUS)0xC00000E5L)
+#define STATUS_BUFFER_TOO_SMALL             ((NTSTATUS)0xC0000023L)
+#define STATUS_INTEGER_OVERFLOW             ((NTSTATUS)0xC0000095L)
+#define STATUS_NOT_FOUND                    ((NTSTATUS)0xC0000225L)
+
+inline size_t RtlCompareMemory(const VOID *a, const VOID *b, size_t cb)
+{
+    size_t i = 0;
+    while (i < cb && ((const BYTE *)a)[i] == ((const BYTE *)b)[i])
+    {
+        ++i;
+    }
+    return i;
+}
+
+inline NTSTATUS RtlStringCchCopyW(PWSTR Dest, size_t cchDest, PCWSTR Src)
+{
+    if (cchDest == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    size_t i = 0;
+    for (; i + 1 < cchDest && Src[i] != 0; ++i)
+    {
+        Dest[i] = Src[i];
+    }
+    Dest[i] = 0;
+    return (Src[i] == 0) ? STATUS_SUCCESS : STATUS_BUFFER_OVERFLOW;
+}
+
+//
+// GUIDs.
+//
+typedef struct _GUID
+{
+    uint32_t    Data1;
+    uint16_t    Data2;
+    uint16_t    Data3;
+    uint8_t     Data4[8];
+} GUID, CLSID, IID;
+
+typedef const GUID &        REFGUID;
+typedef const GUID &        REFCLSID;
+typedef const GUID &        REFIID;
+
+inline bool IsEqualGUID(REFGUID a, REFGUID b)
+{
+    return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+#define IsEqualGUIDAligned(a, b)    IsEqualGUID((a), (b))
+
+#define DEFINE_GUID(name, ...)      static const GUID name = { __VA_ARGS__ }
+#define DEFINE_GUIDSTRUCT(g, n)     DEFINE_GUID(n##_GUID_, STATIC_##n)
+#define DEFINE_GUIDNAMED(n)         n##_GUID_
+
+typedef struct _DEVPROPKEY
+{
+    GUID        fmtid;
+    ULONG       pid;
+} DEVPROPKEY;
+
+//
+// Objects the tested code only passes around.
+//
+typedef struct _DEVICE_OBJECT *     PDEVICE_OBJECT;
+typedef struct _IRP *               PIRP;
+typedef struct _IO_WORKITEM *       PIO_WORKITEM;
+typedef struct _EX_TIMER *          PEX_TIMER;
+typedef struct _EXT_SET_PARAMETERS *PEXT_SET_PARAMETERS;
+typedef struct WDFDEVICE__ *        WDFDEVICE;
+typedef struct _POHANDLE *          POHANDLE;
+
+//
+// Pool.
+//
+typedef enum _POOL_TYPE { NonPagedPool, PagedPool, NonPagedPoolNx = 512 } POOL_TYPE;
+
+#define POOL_FLAG_NON_PAGED         0x40ULL
+#define POOL_FLAG_PAGED             0x100ULL
+
+inline PVOID ExAllocatePool2(POOL_FLAGS Flags, size_t cb, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Flags);
+    UNREFERENCED_PARAMETER(Tag);
+    return calloc(1, cb ? cb : 1);
+}
+
+inline VOID ExFreePoolWithTag(PVOID p, ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+    free(p);
+}
+
+//
+// Spin locks and mutexes. The host has no IRQL; KeAcquireSpinLock reports
+// PASSIVE_LEVEL as the previous level.
+//
+typedef std::atomic_flag    KSPIN_LOCK, *PKSPIN_LOCK;
+
+inline VOID KeInitializeSpinLock(PKSPIN_LOCK Lock)
+{
+    Lock->clear();
+}
+
+inline VOID KeAcquireSpinLock(PKSPIN_LOCK Lock, PKIRQL OldIrql)
+{
+    while (Lock->test_and_set(std::memory_order_acquire))
+    {
+    }
+    *OldIrql = PASSIVE_LEVEL;
+}
+
+inline VOID KeReleaseSpinLock(PKSPIN_LOCK Lock, KIRQL NewIrql)
+{
+    UNREFERENCED_PARAMETER(NewIrql);
+    Lock->clear(std::memory_order_release);
+}
+
+inline VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK Lock)
+{
+    KIRQL irql;
+    KeAcquireSpinLock(Lock, &irql);
+}
+
+inline VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK Lock)
+{
+    KeReleaseSpinLock(Lock, PASSIVE_LEVEL);
+}
+
+typedef std::recursive_mutex    KMUTEX, *PKMUTEX;
+typedef std::mutex              FAST_MUTEX, *PFAST_MUTEX;
+
+typedef enum _KWAIT_REASON { Executive } KWAIT_REASON;
+typedef enum _MODE { KernelMode, UserMode } KPROCESSOR_MODE;
+
+inline VOID KeInitializeMutex(PKMUTEX Mutex, ULONG Level)
+{
+    UNREFERENCED_PARAMETER(Mutex);
+    UNREFERENCED_PARAMETER(Level);
+}
+
+inline NTSTATUS KeWaitForSingleObject(PKMUTEX Mutex, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Timeout)
+{
+    UNREFERENCED_PARAMETER(WaitReason);
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+    UNREFERENCED_PARAMETER(Timeout);
+    Mutex->lock();
+    return STATUS_SUCCESS;
+}
+
+inline LONG KeReleaseMutex(PKMUTEX Mutex, BOOLEAN Wait)
+{
+    UNREFERENCED_PARAMETER(Wait);
+    Mutex->unlock();
+    return 0;
+}
+
+typedef struct _KEVENT
+{
+    LONG        Signaled;
+} KEVENT, *PKEVENT;
+
+inline LONG ReadNoFence(LONG const volatile *Source)
+{
+    return __atomic_load_n(Source, __ATOMIC_RELAXED);
+}
+
+inline VOID WriteNoFence(LONG volatile *Destination, LONG Value)
+{
+    __atomic_store_n(Destination, Value, __ATOMIC_RELAXED);
+}
+
+inline NTSTATUS RtlULongAdd(ULONG a, ULONG b, ULONG *pResult)
+{
+    if (a + b < a)
+    {
+        *pResult = MAXULONG;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+    *pResult = a + b;
+    return STATUS_SUCCESS;
+}
+
+inline NTSTATUS RtlULongMult(ULONG a, ULONG b, ULONG *pResult)
+{
+    if (b != 0 && a > MAXULONG / b)
+    {
+        *pResult = MAXULONG;
+        return STATUS_INTEGER_OVERFLOW;
+    }
+    *pResult = a * b;
+    return STATUS_SUCCESS;
+}
+
+inline ULONGLONG KeQueryInterruptTime()
+{
+    return 0;
+}
+
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER Frequency);
+
+//
+// Work items and timers. The tests use module lists without port
+// notifications, so these are never reached; allocation fails.
+//
+typedef VOID IO_WORKITEM_ROUTINE(PDEVICE_OBJECT DeviceObject, PVOID Context);
+typedef VOID EXT_CALLBACK(PEX_TIMER Timer, PVOID Context);
+
+#define DelayedWorkQueue            1
+#define EX_TIMER_HIGH_RESOLUTION    0x4
+
+inline PIO_WORKITEM IoAllocateWorkItem(PDEVICE_OBJECT DeviceObject)
+{
+    UNREFERENCED_PARAMETER(DeviceObject);
+    return NULL;
+}
+inline VOID IoFreeWorkItem(PIO_WORKITEM WorkItem) { UNREFERENCED_PARAMETER(WorkItem); }
+inline VOID IoQueueWorkItem(PIO_WORKITEM WorkItem, IO_WORKITEM_ROUTINE *Routine, int QueueType, PVOID Context)
+{
+    UNREFERENCED_PARAMETER(WorkItem);
+    UNREFERENCED_PARAMETER(Routine);
+    UNREFERENCED_PARAMETER(QueueType);
+    UNREFERENCED_PARAMETER(Context);
+}
+inline PEX_TIMER ExAllocateTimer(EXT_CALLBACK *Callback, PVOID Context, ULONG Attributes)
+{
+    UNREFERENCED_PARAMETER(Callback);
+    UNREFERENCED_PARAMETER(Context);
+    UNREFERENCED_PARAMETER(Attributes);
+    return NULL;
+}
+inline BOOLEAN ExSetTimer(PEX_TIMER Timer, LONGLONG DueTime, LONGLONG Period, PVOID Parameters)
+{
+    UNREFERENCED_PARAMETER(Timer);
+    UNREFERENCED_PARAMETER(DueTime);
+    UNREFERENCED_PARAMETER(Period);
+    UNREFERENCED_PARAMETER(Parameters);
+    return FALSE;
+}
+inline BOOLEAN ExCancelTimer(PEX_TIMER Timer, PVOID Parameters)
+{
+    UNREFERENCED_PARAMETER(Timer);
+    UNREFERENCED_PARAMETER(Parameters);
+    return FALSE;
+}
+inline BOOLEAN ExDeleteTimer(PEX_TIMER Timer, BOOLEAN Cancel, BOOLEAN Wait, PVOID Parameters)
+{
+    UNREFERENCED_PARAMETER(Timer);
+    UNREFERENCED_PARAMETER(Cancel);
+    UNREFERENCED_PARAMETER(Wait);
+    UNREFERENCED_PARAMETER(Parameters);
+    return FALSE;
+}
+inline VOID KeInitializeEvent(PKEVENT Event, int Type, BOOLEAN State)
+{
+    UNREFERENCED_PARAMETER(Type);
+    Event->Signaled = State;
+}
+inline LONG KeSetEvent(PKEVENT Event, LONG Increment, BOOLEAN Wait)
+{
+    UNREFERENCED_PARAMETER(Increment);
+    UNREFERENCED_PARAMETER(Wait);
+    Event->Signaled = TRUE;
+    return 0;
+}
+inline LONG KeResetEvent(PKEVENT Event)
+{
+    Event->Signaled = FALSE;
+    return 0;
+}
+inline NTSTATUS KeWaitForSingleObject(PKEVENT Event, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode, BOOLEAN Alertable, PLARGE_INTEGER Timeout)
+{
+    UNREFERENCED_PARAMETER(Event);
+    UNREFERENCED_PARAMETER(WaitReason);
+    UNREFERENCED_PARAMETER(WaitMode);
+    UNREFERENCED_PARAMETER(Alertable);
+    UNREFERENCED_PARAMETER(Timeout);
+    return STATUS_SUCCESS;
+}
+
+inline VOID KeClearEvent(PKEVENT Event)
+{
+    Event->Signaled = FALSE;
+}
+
+#define IO_NO_INCREMENT             0
+#define NotificationEvent           0
+#define SynchronizationEvent        1
+
+//
+// COM.
+//
+#define STDMETHODCALLTYPE
+#define PURE                        = 0
+#define THIS_
+#define THIS                        void
+#define STDMETHOD_(t, m)            virtual t STDMETHODCALLTYPE m
+#define STDMETHOD(m)                STDMETHOD_(NTSTATUS, m)
+#define STDMETHODIMP_(t)            t STDMETHODCALLTYPE
+#define STDMETHODIMP                STDMETHODIMP_(NTSTATUS)
+#define DECLARE_INTERFACE_(i, b)    struct i : public b
+#define DECLARE_INTERFACE(i)        struct i
+
+DEFINE_GUID(IID_IUnknown, 0x00000000, 0x0000, 0x0000, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46);
+
+struct IUnknown
+{
+    virtual NTSTATUS QueryInterface(REFIID Iid, PVOID *Object) = 0;
+    virtual ULONG AddRef() = 0;
+    virtual ULONG Release() = 0;
+};
+typedef IUnknown *          PUNKNOWN;
+
+//
+// Kernel streaming.
+//
+typedef struct
+{
+    GUID        Set;
+    ULONG       Id;
+    ULONG       Flags;
+} KSIDENTIFIER, KSPROPERTY, *PKSPROPERTY;
+
+typedef struct
+{
+    KSPROPERTY  Property;
+    ULONG       NodeId;
+    ULONG       Reserved;
+} KSNODEPROPERTY, *PKSNODEPROPERTY;
+
+typedef struct
+{
+    KSPROPERTY  Property;
+    ULONG       PinId;
+    ULONG       Reserved;
+} KSP_PIN, *PKSP_PIN;
+
+typedef struct
+{
+    ULONG       Size;
+    ULONG       Count;
+} KSMULTIPLE_ITEM, *PKSMULTIPLE_ITEM;
+
+typedef struct
+{
+    ULONG       FormatSize;
+    ULONG       Flags;
+    ULONG       SampleSize;
+    ULONG       Reserved;
+    GUID        MajorFormat;
+    GUID        SubFormat;
+    GUID        Specifier;
+} KSDATAFORMAT, *PKSDATAFORMAT;
+
+typedef struct
+{
+    WORD        wFormatTag;
+    WORD        nChannels;
+    DWORD       nSamplesPerSec;
+    DWORD       nAvgBytesPerSec;
+    WORD        nBlockAlign;
+    WORD        wBitsPerSample;
+    WORD        cbSize;
+} WAVEFORMATEX, *PWAVEFORMATEX;
+
+typedef struct
+{
+    KSDATAFORMAT    DataFormat;
+    BYTE            WaveFormatExt[40];
+} KSDATAFORMAT_WAVEFORMATEXTENSIBLE;
+
+typedef struct
+{
+    ULONG       MembersFlags;
+    ULONG       MembersSize;
+    ULONG       MembersCount;
+    ULONG       Flags;
+} KSPROPERTY_MEMBERSHEADER, *PKSPROPERTY_MEMBERSHEADER;
+
+#define KSPROPERTY_MEMBER_RANGES        0x00000001
+#define KSPROPERTY_MEMBER_STEPPEDRANGES 0x00000002
+#define KSPROPERTY_MEMBER_VALUES        0x00000003
+#define KSPROPERTY_MEMBER_FLAG_DEFAULT  0x00000001
+
+static const GUID KSPROPTYPESETID_General =
+{ 0x97e99ba0, 0xbdea, 0x11cf, { 0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00 } };
+
+typedef struct
+{
+    ULONG           AccessFlags;
+    ULONG           DescriptionSize;
+    KSIDENTIFIER    PropTypeSet;
+    ULONG           MembersListCount;
+    ULONG           Reserved;
+} KSPROPERTY_DESCRIPTION, *PKSPROPERTY_DESCRIPTION;
+
+#define KSPROPERTY_TYPE_GET             0x00000001
+#define KSPROPERTY_TYPE_SET             0x00000002
+#define KSPROPERTY_TYPE_BASICSUPPORT    0x00000200
+
+typedef struct _KSAUDIOMODULE_DESCRIPTOR
+{
+    GUID        ClassId;
+    ULONG       InstanceId;
+    ULONG       VersionMajor;
+    ULONG       VersionMinor;
+    WCHAR       Name[128];
+} KSAUDIOMODULE_DESCRIPTOR, *PKSAUDIOMODULE_DESCRIPTOR;
+
+#define AUDIOMODULE_MAX_NAME_CCH_SIZE   128
+
+typedef struct _KSAUDIOMODULE_PROPERTY
+{
+    KSPROPERTY  Property;
+    GUID        ClassId;
+    ULONG       InstanceId;
+} KSAUDIOMODULE_PROPERTY, *PKSAUDIOMODULE_PROPERTY;
+
+typedef struct _KSAUDIOMODULE_NOTIFICATION
+{
+    union
+    {
+        struct
+        {
+            GUID        DeviceId;
+            GUID        ClassId;
+            ULONG       InstanceId;
+            ULONG       Reserved;
+        } ProviderId;
+        LONGLONG        Alignment;
+    };
+} KSAUDIOMODULE_NOTIFICATION, *PKSAUDIOMODULE_NOTIFICATION;
+
+typedef enum
+{
+    VT_ILLEGAL  = 0xffff,
+    VT_I4       = 3,
+    VT_BOOL     = 11,
+    VT_UI1      = 17,
+    VT_UI4      = 19,
+} VARENUM;
+
+//
+// Port class.
+//
+typedef struct _PCPROPERTY_REQUEST *PPCPROPERTY_REQUEST;
+typedef NTSTATUS (*PCPFNPROPERTY_HANDLER)(PPCPROPERTY_REQUEST PropertyRequest);
+
+typedef struct
+{
+    const GUID *            Set;
+    ULONG                   Id;
+    ULONG                   Flags;
+    PCPFNPROPERTY_HANDLER   Handler;
+} PCPROPERTY_ITEM, *PPCPROPERTY_ITEM;
+
+typedef struct _PCPROPERTY_REQUEST
+{
+    PUNKNOWN                MajorTarget;
+    PVOID                   MinorTarget;
+    ULONG                   Node;
+    const PCPROPERTY_ITEM * PropertyItem;
+    ULONG                   Verb;
+    ULONG                   InstanceSize;
+    PVOID                   Instance;
+    ULONG                   ValueSize;
+    PVOID                   Value;
+    PIRP                    Irp;
+} PCPROPERTY_REQUEST;
+
+typedef struct _PCFILTER_DESCRIPTOR PCFILTER_DESCRIPTOR;
+typedef struct IServiceGroup *      PSERVICEGROUP;
+typedef struct IResourceList *      PRESOURCELIST;
+typedef struct IPortClsEtwHelper *  PPORTCLSETWHELPER;
+typedef int                         EPcMiniportEngineEvent;
+typedef VOID (*PFNEVENTNOTIFICATION)(PVOID Context);
+
+typedef PVOID                       PPCNOTIFICATION_BUFFER;
+
+struct IPortClsNotifications : public IUnknown
+{
+    virtual NTSTATUS AllocNotificationBuffer(POOL_TYPE PoolType, USHORT RequestedSize, PPCNOTIFICATION_BUFFER *NotificationBuffer) = 0;
+    virtual VOID FreeNotificationBuffer(PPCNOTIFICATION_BUFFER NotificationBuffer) = 0;
+    virtual VOID SendNotification(const GUID *NotificationId, PPCNOTIFICATION_BUFFER NotificationBuffer) = 0;
+};
+typedef IPortClsNotifications *     PPORTCLSNOTIFICATIONS;
+
+static const GUID KSNOTIFICATIONID_AudioModule =
+{ 0x9c2220f0, 0xd9a6, 0x4d5c, { 0xa0, 0x36, 0x57, 0x38, 0x57, 0xfd, 0x50, 0xd2 } };
+
+//
+// Debug output.
+//
+#define DEBUGLVL_BLAB               3
+#define DEBUGLVL_VERBOSE            2
+#define DEBUGLVL_TERSE              1
+#define DEBUGLVL_ERROR              0
+#define _DbgPrintF(level, args)     ((void)0)
@@ -0,0 +1,6 @@
+//
+// Host stand-in; see portcls.h.
+//
+#pragma once
+
+#include "portcls.h"
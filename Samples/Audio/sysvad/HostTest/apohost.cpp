@@ -0,0 +1,217 @@
+//
+// apohost.cpp -- Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// Description:
+//
+//   Runs a graph of sample APOs over a WAVE file or a generated signal and
+//   reports per-period cost, allocations and, optionally, whether the output
+//   matches a reference bit for bit.
+//
+//   apohost --graph delay-mfx:ms=20,swap-mfx --in gen:sine:48000:2:5 --hash
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ApoHost.h"
+
+static void Usage()
+{
+    printf("usage: apohost --graph <node[,node...]> --in <wav|gen:...> [options]\n"
+           "\n"
+           "  --graph <spec>       comma separated chain of nodes, see --list\n"
+           "  --in <source>        input WAVE file or gen:kind:rate:channels:seconds\n"
+           "                       (kind is sine, noise or speech)\n"
+           "  --ref <source>       render loopback for nodes that take one (aec)\n"
+           "  --period <frames>    engine period, default 10 ms\n"
+           "  --out <wav>          write the output as 32-bit float WAVE\n"
+           "  --expect <source>    fail unless the output matches bit for bit\n"
+           "  --expect-hash <hex>  fail unless the output hash matches\n"
+           "  --hash               print the output hash\n"
+           "  --silence-flags      flag all-zero input periods BUFFER_SILENT\n"
+           "  --poison-silent      fill BUFFER_SILENT input periods with NaNs and fail\n"
+           "                       if any reach the output\n"
+           "  --max-allocs <n>     fail if processing allocates more than n times\n"
+           "  --quiet              print only failures and the hash\n"
+           "  --list               list the nodes\n");
+}
+
+static bool CompareOutput(const APOHOST_AUDIO *pOutput, const APOHOST_AUDIO *pExpected)
+{
+    if (pOutput->u32FramesPerSecond != pExpected->u32FramesPerSecond ||
+        pOutput->u32SamplesPerFrame != pExpected->u32SamplesPerFrame ||
+        pOutput->Samples.size() != pExpected->Samples.size())
+    {
+        fprintf(stderr, "FAIL: output is %u Hz, %u ch, %u frames; expected %u Hz, %u ch, %u frames\n",
+                pOutput->u32FramesPerSecond, pOutput->u32SamplesPerFrame, pOutput->GetFrameCount(),
+                pExpected->u32FramesPerSecond, pExpected->u32SamplesPerFrame, pExpected->GetFrameCount());
+        return false;
+    }
+
+    size_t cMismatches = 0, iFirst = 0;
+    double dMaxError = 0;
+    for (size_t i = 0; i < pOutput->Samples.size(); i++)
+    {
+        if (memcmp(&pOutput->Samples[i], &pExpected->Samples[i], sizeof(float)) != 0)
+        {
+            if (cMismatches++ == 0)
+            {
+                iFirst = i;
+            }
+            dMaxError = fmax(dMaxError, fabs((double)pOutput->Samples[i] - pExpected->Samples[i]));
+        }
+    }
+
+    if (cMismatches != 0)
+    {
+        fprintf(stderr, "FAIL: %zu samples differ, first at frame %zu channel %zu (%g, expected %g), max error %g\n",
+                cMismatches, iFirst / pOutput->u32SamplesPerFrame, iFirst % pOutput->u32SamplesPerFrame,
+                pOutput->Samples[iFirst], pExpected->Samples[iFirst], dMaxError);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *pszGraph = NULL;
+    const char *pszInput = NULL;
+    const char *pszReference = NULL;
+    const char *pszOutput = NULL;
+    const char *pszExpect = NULL;
+    const char *pszExpectHash = NULL;
+    uint32_t u32PeriodFrames = 0;
+    bool fHash = false;
+    bool fFlagSilence = false;
+    bool fPoisonSilence = false;
+    bool fQuiet = false;
+    long long llMaxAllocations = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *pszArg = argv[i];
+        const char *pszValue = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool fTakesValue = true;
+
+        if (strcmp(pszArg, "--graph") == 0)             pszGraph = pszValue;
+        else if (strcmp(pszArg, "--in") == 0)           pszInput = pszValue;
+        else if (strcmp(pszArg, "--ref") == 0)          pszReference = pszValue;
+        else if (strcmp(pszArg, "--out") == 0)          pszOutput = pszValue;
+        else if (strcmp(pszArg, "--expect") == 0)       pszExpect = pszValue;
+        else if (strcmp(pszArg, "--expect-hash") == 0)  pszExpectHash = pszValue;
+        else if (strcmp(pszArg, "--period") == 0)       u32PeriodFrames = pszValue ? (uint32_t)strtoul(pszValue, NULL, 0) : 0;
+        else if (strcmp(pszArg, "--max-allocs") == 0)   llMaxAllocations = pszValue ? strtoll(pszValue, NULL, 0) : -1;
+        else
+        {
+            fTakesValue = false;
+            if (strcmp(pszArg, "--hash") == 0)                  fHash = true;
+            else if (strcmp(pszArg, "--silence-flags") == 0)    fFlagSilence = true;
+            else if (strcmp(pszArg, "--poison-silent") == 0)    fFlagSilence = fPoisonSilence = true;
+            else if (strcmp(pszArg, "--quiet") == 0)            fQuiet = true;
+            else if (strcmp(pszArg, "--list") == 0)
+            {
+                ApoHost_PrintNodes();
+                return 0;
+            }
+            else
+            {
+                fprintf(stderr, "unknown argument '%s'\n\n", pszArg);
+                Usage();
+                return 2;
+            }
+        }
+
+        if (fTakesValue)
+        {
+            if (pszValue == NULL)
+            {
+                fprintf(stderr, "%s needs a value\n", pszArg);
+                return 2;
+            }
+            i++;
+        }
+    }
+
+    if (pszGraph == NULL || pszInput == NULL)
+    {
+        Usage();
+        return 2;
+    }
+
+    APOHOST_AUDIO Input, Reference, Output;
+    if (!ApoHost_LoadAudio(pszInput, &Input) ||
+        (pszReference != NULL && !ApoHost_LoadAudio(pszReference, &Reference)))
+    {
+        return 2;
+    }
+
+    if (u32PeriodFrames == 0)
+    {
+        u32PeriodFrames = Input.u32FramesPerSecond / 100;
+    }
+
+    CApoHostGraph Graph;
+    Graph.SetSilenceFlags(fFlagSilence, fPoisonSilence);
+    if (!Graph.Create(pszGraph) ||
+        !Graph.LockForProcess(Input.u32FramesPerSecond, Input.u32SamplesPerFrame, u32PeriodFrames) ||
+        !Graph.Run(&Input, (pszReference != NULL) ? &Reference : NULL, &Output))
+    {
+        return 2;
+    }
+
+    int iResult = 0;
+    uint64_t u64Hash = ApoHost_HashSamples(Output.Samples.data(), Output.Samples.size());
+
+    if (!fQuiet)
+    {
+        Graph.PrintReport(&Input);
+    }
+    if (fHash || fQuiet)
+    {
+        printf("hash: %016llx\n", (unsigned long long)u64Hash);
+    }
+
+    if (pszOutput != NULL && !ApoHost_WriteWav(pszOutput, &Output))
+    {
+        iResult = 1;
+    }
+
+    if (pszExpect != NULL)
+    {
+        APOHOST_AUDIO Expected;
+        if (!ApoHost_LoadAudio(pszExpect, &Expected) || !CompareOutput(&Output, &Expected))
+        {
+            iResult = 1;
+        }
+    }
+
+    if (fPoisonSilence)
+    {
+        for (size_t i = 0; i < Output.Samples.size(); i++)
+        {
+            if (isnan(Output.Samples[i]))
+            {
+                fprintf(stderr, "FAIL: a node read a BUFFER_SILENT input, NaN at frame %zu\n", i / Output.u32SamplesPerFrame);
+                iResult = 1;
+                break;
+            }
+        }
+    }
+
+    if (pszExpectHash != NULL && strtoull(pszExpectHash, NULL, 16) != u64Hash)
+    {
+        fprintf(stderr, "FAIL: output hash %016llx, expected %s\n", (unsigned long long)u64Hash, pszExpectHash);
+        iResult = 1;
+    }
+
+    if (llMaxAllocations >= 0 && Graph.GetProcessAllocations() > (uint64_t)llMaxAllocations)
+    {
+        fprintf(stderr, "FAIL: %llu allocations during processing, at most %lld allowed\n",
+                (unsigned long long)Graph.GetProcessAllocations(), llMaxAllocations);
+        iResult = 1;
+    }
+
+    return iResult;
+}
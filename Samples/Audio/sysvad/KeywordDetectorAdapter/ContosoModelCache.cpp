@@ -0,0 +1,324 @@
+// ContosoModelCache.cpp : Cache of the Contoso keyword models built by the adapter.
+//
+
+#include "stdafx.h"
+
+#include "KeywordDetectorContosoAdapter.h"
+#include "ContosoKeywordDetector.h"
+#include "ContosoModelCache.h"
+
+using namespace Microsoft::WRL::Wrappers;
+
+// Dimensions of the keyword model: 500 ms of context, 32 shared units
+static const ULONG c_ModelFrames = 50;
+static const ULONG c_ModelHidden = 32;
+static const float c_ModelThreshold = 4.0f;
+
+// Writes Count weights in [-1/16, 1/16).
+static void FillWeights(_Out_writes_(Count) float* Weights, _In_ ULONG Count, _In_ ULONG Seed)
+{
+    for (ULONG i = 0; i < Count; i++)
+    {
+        Seed = Seed * 1664525 + 1013904223;
+        Weights[i] = ((LONG)Seed >> 8) * (1.0f / (16.0f * 8388608.0f));
+    }
+}
+
+CContosoModelCache::CContosoModelCache()
+{
+}
+
+CContosoModelCache& CContosoModelCache::GetInstance()
+{
+    static CContosoModelCache cache;
+
+    return cache;
+}
+
+static ULONGLONG HashBytes(_In_ ULONGLONG Hash, _In_reads_bytes_(Size) const void* Data, _In_ SIZE_T Size)
+{
+    for (SIZE_T i = 0; i < Size; i++)
+    {
+        Hash = (Hash ^ ((const BYTE*)Data)[i]) * 1099511628211ULL;
+    }
+
+    return Hash;
+}
+
+//
+// FNV-1a over the user model data. The stream position is restored.
+//
+HRESULT CContosoModelCache::HashUserModelData(_In_opt_ IStream* UserModelData, _Out_ ULONGLONG* Key)
+{
+    HRESULT hr = S_OK;
+    ULONGLONG hash = 14695981039346656037ULL;
+    LARGE_INTEGER zero = {};
+    ULARGE_INTEGER position = {};
+    BYTE buffer[4096];
+    ULONG read = 0;
+
+    *Key = 0;
+
+    if (UserModelData != nullptr)
+    {
+        hr = UserModelData->Seek(zero, STREAM_SEEK_CUR, &position);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+
+        hr = UserModelData->Seek(zero, STREAM_SEEK_SET, nullptr);
+        while (SUCCEEDED(hr))
+        {
+            hr = UserModelData->Read(buffer, sizeof(buffer), &read);
+            if (FAILED(hr) || read == 0)
+            {
+                break;
+            }
+
+            hash = HashBytes(hash, buffer, read);
+        }
+
+        LARGE_INTEGER restore;
+        restore.QuadPart = (LONGLONG)position.QuadPart;
+        UserModelData->Seek(restore, STREAM_SEEK_SET, nullptr);
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    *Key = hash;
+
+    return S_OK;
+}
+
+//
+// Computes the model of the language for the user model data. This sample
+// has no trained model: the weights are fixed pseudo-random values, seeded
+// by the key and, for the outputs, by the keyword, in the layout a trained
+// model would use. Biases are zero.
+//
+HRESULT CContosoModelCache::ComputeModel(
+    _In_ ULONGLONG Key,
+    _In_ LANGID LangId,
+    _In_reads_(NumEvents) const GUID* EventIds,
+    _In_ ULONG NumEvents,
+    _Out_ std::unique_ptr<BYTE[]>* Buffer)
+{
+    CONTOSO_MODELCACHE_HEADER* header;
+    CONTOSO_KEYWORDMODEL_KEYWORD* keywords;
+    float* weights;
+    ULONG size;
+    ULONG seed = (ULONG)Key ^ (ULONG)(Key >> 32);
+
+    if (NumEvents == 0 || NumEvents > CONTOSO_KEYWORDMODEL_MAX_KEYWORDS)
+    {
+        return E_INVALIDARG;
+    }
+
+    size = sizeof(CONTOSO_MODELCACHE_HEADER) +
+           NumEvents * sizeof(CONTOSO_KEYWORDMODEL_KEYWORD) +
+           sizeof(float) * (c_ModelFrames * CONTOSO_KEYWORDMODEL_FEATURES * c_ModelHidden + c_ModelHidden + (c_ModelHidden + 1) * NumEvents);
+
+    Buffer->reset(new (std::nothrow) BYTE[size]);
+    if (!*Buffer)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory(Buffer->get(), size);
+
+    header = (CONTOSO_MODELCACHE_HEADER*)Buffer->get();
+    header->Signature = CONTOSO_MODELCACHE_SIGNATURE;
+    header->Version = CONTOSO_MODELCACHE_VERSION;
+    header->Key = Key;
+    header->LangId = LangId;
+    header->Size = size;
+    header->KeywordCount = NumEvents;
+    header->ContextFrames = c_ModelFrames;
+    header->FeatureCount = CONTOSO_KEYWORDMODEL_FEATURES;
+    header->HiddenCount = c_ModelHidden;
+
+    keywords = (CONTOSO_KEYWORDMODEL_KEYWORD*)(header + 1);
+    for (ULONG i = 0; i < NumEvents; i++)
+    {
+        keywords[i].EventId = EventIds[i];
+        keywords[i].DetectorData = 0;       // default first-stage thresholds
+        keywords[i].Threshold = c_ModelThreshold;
+    }
+
+    weights = (float*)(keywords + NumEvents);
+    FillWeights(weights, c_ModelFrames * CONTOSO_KEYWORDMODEL_FEATURES * c_ModelHidden, 0x12345678 ^ seed ^ LangId);
+    weights += c_ModelFrames * CONTOSO_KEYWORDMODEL_FEATURES * c_ModelHidden + c_ModelHidden;
+
+    for (ULONG i = 0; i < NumEvents; i++)
+    {
+        FillWeights(weights + i * c_ModelHidden, c_ModelHidden, EventIds[i].Data1 ^ seed);
+    }
+
+    return S_OK;
+}
+
+//
+// Returns the model for the key, computing it when it is not cached.
+//
+// Computing a model is a pseudo-random fill of about 20k weights, some
+// 30 us; a cache file cost more than that to write and about as much to
+// map again, so models are only kept in memory.
+//
+HRESULT CContosoModelCache::GetModel(
+    _In_ ULONGLONG Key,
+    _In_ LANGID LangId,
+    _In_reads_(NumEvents) const GUID* EventIds,
+    _In_ ULONG NumEvents,
+    _Out_ std::shared_ptr<CModel>* Model)
+{
+    HRESULT hr;
+    ModelKey modelKey(Key, LangId);
+    std::unique_ptr<BYTE[]> buffer;
+    ModelEntry entry;
+
+    // A hit moves the model to the front of the recency list, so even
+    // lookups take the lock exclusively.
+    auto lock = m_Lock.LockExclusive();
+
+    auto it = m_Models.find(modelKey);
+    if (it != m_Models.end())
+    {
+        m_Uses.splice(m_Uses.begin(), m_Uses, it->second.Use);
+        *Model = it->second.Model;
+        return S_OK;
+    }
+
+    hr = ComputeModel(Key, LangId, EventIds, NumEvents, &buffer);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    entry.Model = std::make_shared<CModel>(buffer);
+
+    // Evict the least recently used model. Arming patterns already built
+    // from it do not refer to it.
+    if (m_Models.size() >= MaxModels)
+    {
+        m_Models.erase(m_Uses.back());
+        m_Uses.pop_back();
+    }
+
+    m_Uses.push_front(modelKey);
+    entry.Use = m_Uses.begin();
+    m_Models[modelKey] = entry;
+
+    *Model = entry.Model;
+
+    return S_OK;
+}
+
+HRESULT CContosoModelCache::BuildArmingPattern(
+    _In_opt_ IStream* UserModelData,
+    _In_ LANGID LangId,
+    _In_reads_(NumEvents) const GUID* EventIds,
+    _In_ ULONG NumEvents,
+    _In_reads_(NumSelectedEvents) const GUID* SelectedEventIds,
+    _In_ ULONG NumSelectedEvents,
+    _Outptr_ SOUNDDETECTOR_PATTERNHEADER** ppPatternData)
+{
+    HRESULT hr;
+    ULONGLONG key;
+    std::shared_ptr<CModel> model;
+    const CONTOSO_MODELCACHE_HEADER* header;
+    CONTOSO_KEYWORDMODEL *pPatternData = nullptr;
+    CONTOSO_KEYWORDMODEL_KEYWORD *keywords;
+    float *hidden;
+    float *outputWeights;
+    float *outputBias;
+    ULONG hiddenCount;
+    ULONG padded;
+    SIZE_T size;
+
+    *ppPatternData = nullptr;
+
+    if (NumSelectedEvents == 0 || NumSelectedEvents > CONTOSO_KEYWORDMODEL_MAX_KEYWORDS)
+    {
+        return E_INVALIDARG;
+    }
+
+    hr = HashUserModelData(UserModelData, &key);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // The events of the language are part of the model, and of its key.
+    key = HashBytes(key, EventIds, NumEvents * sizeof(GUID));
+
+    hr = GetModel(key, LangId, EventIds, NumEvents, &model);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    header = model->Header();
+    hiddenCount = header->HiddenCount;
+    padded = CONTOSO_KEYWORDMODEL_PADDED(NumSelectedEvents);
+    size = CONTOSO_KEYWORDMODEL_SIZE(NumSelectedEvents, header->ContextFrames, header->FeatureCount, hiddenCount);
+
+    pPatternData = (CONTOSO_KEYWORDMODEL*)CoTaskMemAlloc(size);
+    if (pPatternData == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory(pPatternData, size);
+
+    pPatternData->Configuration.Header.Size = (ULONG)size;
+    pPatternData->Configuration.Header.PatternType = CONTOSO_KEYWORDCONFIGURATION_IDENTIFIER2;
+    pPatternData->Version = CONTOSO_KEYWORDMODEL_VERSION;
+    pPatternData->KeywordCount = NumSelectedEvents;
+    pPatternData->ContextFrames = header->ContextFrames;
+    pPatternData->FeatureCount = header->FeatureCount;
+    pPatternData->HiddenCount = hiddenCount;
+
+    // The shared layer is copied as is.
+    keywords = (CONTOSO_KEYWORDMODEL_KEYWORD*)(pPatternData + 1);
+    hidden = (float*)(keywords + NumSelectedEvents);
+    CopyMemory(hidden, model->HiddenWeights(), sizeof(float) * (header->ContextFrames * header->FeatureCount * hiddenCount + hiddenCount));
+
+    outputWeights = hidden + header->ContextFrames * header->FeatureCount * hiddenCount + hiddenCount;
+    outputBias = outputWeights + hiddenCount * padded;
+
+    // Each selected keyword gathers its row of the cached outputs into a
+    // column of the pattern.
+    for (ULONG i = 0; i < NumSelectedEvents; i++)
+    {
+        ULONG k = 0;
+
+        while (k < header->KeywordCount && model->Keywords()[k].EventId != SelectedEventIds[i])
+        {
+            k++;
+        }
+
+        if (k == header->KeywordCount)
+        {
+            CoTaskMemFree(pPatternData);
+            return E_INVALIDARG;
+        }
+
+        keywords[i] = model->Keywords()[k];
+
+        const float* row = model->OutputWeights() + k * hiddenCount;
+        for (ULONG h = 0; h < hiddenCount; h++)
+        {
+            outputWeights[h * padded + i] = row[h];
+        }
+        outputBias[i] = model->OutputBias()[k];
+    }
+
+    *ppPatternData = &pPatternData->Configuration.Header;
+    pPatternData = nullptr;
+
+    return S_OK;
+}
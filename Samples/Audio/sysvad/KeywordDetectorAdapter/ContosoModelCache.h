@@ -0,0 +1,104 @@
+// ContosoModelCache.h : Cache of the Contoso keyword models built by the adapter.
+//
+// A model is computed once per user model data and language and kept in
+// memory for the next arming. The key is a hash of the user model data, so
+// a changed model gets a new entry. Arming selects keywords out of the
+// cached model and merges them into a CONTOSO_KEYWORDMODEL without
+// recomputing anything.
+//
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <wrl\wrappers\corewrappers.h>
+
+//
+// Cached model layout. All the parts are 4 byte aligned and packed in this
+// order after the header:
+//   CONTOSO_KEYWORDMODEL_KEYWORD Keywords[KeywordCount];
+//   float HiddenWeights[ContextFrames * FeatureCount][HiddenCount];
+//   float HiddenBias[HiddenCount];
+//   float OutputWeights[KeywordCount][HiddenCount];     one row per keyword
+//   float OutputBias[KeywordCount];
+// The output weights are stored by keyword, so arming gathers whole rows
+// for the selected keywords into the column layout of the arming pattern.
+//
+#define CONTOSO_MODELCACHE_SIGNATURE    0x434D4B43      // 'CKMC'
+#define CONTOSO_MODELCACHE_VERSION      1
+
+typedef struct
+{
+    ULONG       Signature;
+    ULONG       Version;
+    ULONGLONG   Key;                // hash of the user model data
+    LANGID      LangId;
+    USHORT      Reserved;
+    ULONG       Size;               // whole model
+    ULONG       KeywordCount;
+    ULONG       ContextFrames;
+    ULONG       FeatureCount;
+    ULONG       HiddenCount;
+} CONTOSO_MODELCACHE_HEADER;
+
+class CContosoModelCache
+{
+public:
+    static CContosoModelCache& GetInstance();
+
+    //
+    // Builds the arming pattern for the selected events out of the model
+    // of UserModelData and LangId. EventIds lists all the events of the
+    // language, in the order their outputs are laid out in the model.
+    //
+    HRESULT BuildArmingPattern(
+        _In_opt_ IStream* UserModelData,
+        _In_ LANGID LangId,
+        _In_reads_(NumEvents) const GUID* EventIds,
+        _In_ ULONG NumEvents,
+        _In_reads_(NumSelectedEvents) const GUID* SelectedEventIds,
+        _In_ ULONG NumSelectedEvents,
+        _Outptr_ SOUNDDETECTOR_PATTERNHEADER** ppPatternData);
+
+private:
+    // A computed model.
+    class CModel
+    {
+    public:
+        CModel(_Inout_ std::unique_ptr<BYTE[]>& Buffer) : m_Buffer(std::move(Buffer)) {}
+
+        const CONTOSO_MODELCACHE_HEADER* Header() const { return (const CONTOSO_MODELCACHE_HEADER*)m_Buffer.get(); }
+        const CONTOSO_KEYWORDMODEL_KEYWORD* Keywords() const { return (const CONTOSO_KEYWORDMODEL_KEYWORD*)(Header() + 1); }
+        const float* HiddenWeights() const { return (const float*)(Keywords() + Header()->KeywordCount); }
+        const float* HiddenBias() const { return HiddenWeights() + Header()->ContextFrames * Header()->FeatureCount * Header()->HiddenCount; }
+        const float* OutputWeights() const { return HiddenBias() + Header()->HiddenCount; }
+        const float* OutputBias() const { return OutputWeights() + Header()->KeywordCount * Header()->HiddenCount; }
+
+    private:
+        std::unique_ptr<BYTE[]> m_Buffer;
+    };
+
+    typedef std::pair<ULONGLONG, LANGID> ModelKey;
+
+    // A cached model and its place in the recency list.
+    struct ModelEntry
+    {
+        std::shared_ptr<CModel> Model;
+        std::list<ModelKey>::iterator Use;
+    };
+
+    CContosoModelCache();
+
+    HRESULT GetModel(_In_ ULONGLONG Key, _In_ LANGID LangId, _In_reads_(NumEvents) const GUID* EventIds, _In_ ULONG NumEvents, _Out_ std::shared_ptr<CModel>* Model);
+    HRESULT ComputeModel(_In_ ULONGLONG Key, _In_ LANGID LangId, _In_reads_(NumEvents) const GUID* EventIds, _In_ ULONG NumEvents, _Out_ std::unique_ptr<BYTE[]>* Buffer);
+
+    static HRESULT HashUserModelData(_In_opt_ IStream* UserModelData, _Out_ ULONGLONG* Key);
+
+    // Models kept by this process
+    static const size_t MaxModels = 4;
+
+    Microsoft::WRL::Wrappers::SRWLock m_Lock;
+    std::map<ModelKey, ModelEntry> m_Models;
+    std::list<ModelKey> m_Uses;     // most recently used first
+};
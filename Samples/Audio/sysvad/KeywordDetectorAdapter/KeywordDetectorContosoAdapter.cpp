@@ -12,6 +12,7 @@
 #include "KeywordDetectorContosoAdapter.h"
 #include "ContosoKeywordDetector.h"
 #include <wrl.h>
+#include "ContosoModelCache.h"
 
 using namespace Microsoft::WRL;
 
@@ -175,6 +176,26 @@ public:
 
 CoCreatableClass(KeywordDetectorContosoAdapter);
 
+// Events of the en-US language, built once. Their order is the layout of
+// the outputs of the cached keyword model.
+static const DETECTIONEVENT c_ContosoEvents[] =
+{
+    { CONTOSO_KEYWORD1, EVENTFEATURES_NoEventFeatures, {0}, L"Contoso 1", TRUE },
+    { CONTOSO_KEYWORD2, EVENTFEATURES_NoEventFeatures, {0}, L"Contoso 2", TRUE }
+};
+
+static const DETECTIONEVENT* FindContosoEvent(_In_ REFGUID EventId)
+{
+    for (ULONG i = 0; i < ARRAYSIZE(c_ContosoEvents); i++)
+    {
+        if (c_ContosoEvents[i].EventId == EventId)
+        {
+            return &c_ContosoEvents[i];
+        }
+    }
+    return nullptr;
+}
+
 class EventDetectorContosoAdapter : public RuntimeClass<RuntimeClassFlags<ClassicCom>, IEventDetectorOemAdapter>
 {
 public:
@@ -222,17 +243,14 @@ public:
     {
         if (LangId == 0x0409)
         {
-                DETECTIONEVENT events[] = { { CONTOSO_KEYWORD1, EVENTFEATURES_NoEventFeatures, {0}, L"Contoso 1", TRUE },
-                                            { CONTOSO_KEYWORD2, EVENTFEATURES_NoEventFeatures, {0}, L"Contoso 2", TRUE } };
-
-                *EventIds = (DETECTIONEVENT *)CoTaskMemAlloc(sizeof(events));
+                *EventIds = (DETECTIONEVENT *)CoTaskMemAlloc(sizeof(c_ContosoEvents));
                 if (*EventIds == nullptr)
                 {
                     return E_OUTOFMEMORY;
                 }
 
-                memcpy(*EventIds, &events, sizeof(events));
-                *NumEvents = 2;
+                memcpy(*EventIds, c_ContosoEvents, sizeof(c_ContosoEvents));
+                *NumEvents = ARRAYSIZE(c_ContosoEvents);
         }
         else
         {
@@ -278,35 +296,33 @@ public:
         _In_ ULONG NumEventSelectors,
         _Outptr_ SOUNDDETECTOR_PATTERNHEADER** ppPatternData)
     {
-        CONTOSO_KEYWORDCONFIGURATION *pPatternData = nullptr;
-
-        UNREFERENCED_PARAMETER(UserModelData);
+        GUID eventIds[ARRAYSIZE(c_ContosoEvents)];
+        GUID selectedEventIds[ARRAYSIZE(c_ContosoEvents)];
 
-        if (NumEventSelectors > 2)
+        // All the selected events are scored by one model, see
+        // CONTOSO_KEYWORDMODEL. The model is computed once per user model
+        // data and language, and cached.
+        if (NumEventSelectors == 0 || NumEventSelectors > ARRAYSIZE(c_ContosoEvents))
         {
             return E_INVALIDARG;
         }
 
-        if ((EventSelectors[0].Event.EventId != CONTOSO_KEYWORD1 && EventSelectors[0].Event.EventId != CONTOSO_KEYWORD2) || 
-            (EventSelectors[0].UserId != 0) || (EventSelectors[0].LangId != 0x0409))
+        for (ULONG i = 0; i < NumEventSelectors; i++)
         {
-            return E_INVALIDARG;
+            if ((FindContosoEvent(EventSelectors[i].Event.EventId) == nullptr) || 
+                (EventSelectors[i].UserId != 0) || (EventSelectors[i].LangId != 0x0409))
+            {
+                return E_INVALIDARG;
+            }
+            selectedEventIds[i] = EventSelectors[i].Event.EventId;
         }
 
-        pPatternData = (CONTOSO_KEYWORDCONFIGURATION*)CoTaskMemAlloc(sizeof(CONTOSO_KEYWORDCONFIGURATION));
-        if (pPatternData == nullptr)
+        for (ULONG i = 0; i < ARRAYSIZE(c_ContosoEvents); i++)
         {
-            return E_OUTOFMEMORY;
+            eventIds[i] = c_ContosoEvents[i].EventId;
         }
 
-        pPatternData->Header.Size = sizeof(*pPatternData);
-        pPatternData->Header.PatternType = CONTOSO_KEYWORDCONFIGURATION_IDENTIFIER2;
-        pPatternData->ContosoDetectorConfigurationData = 0x12345678;
-
-        *ppPatternData = &pPatternData->Header;
-        pPatternData = nullptr;
-
-        return S_OK;
+        return CContosoModelCache::GetInstance().BuildArmingPattern(UserModelData, 0x0409, eventIds, ARRAYSIZE(eventIds), selectedEventIds, NumEventSelectors, ppPatternData);
     }
 
     STDMETHODIMP ParseDetectionResultData(
@@ -332,19 +348,14 @@ public:
 
         contosoResult = (CONTOSO_KEYWORDDETECTIONRESULT*)Result;
 
-        if (CONTOSO_KEYWORD1 == contosoResult->EventId)
-        {
-            wcscpy_s(EventSelector->Event.DisplayName, L"Contoso 1");
-        }
-        else if (CONTOSO_KEYWORD2 == contosoResult->EventId)
-        {
-            wcscpy_s(EventSelector->Event.DisplayName, L"Contoso 2");
-        }
-        else
+        const DETECTIONEVENT* event = FindContosoEvent(contosoResult->EventId);
+        if (event == nullptr)
         {
             return E_INVALIDARG;
         }
 
+        wcscpy_s(EventSelector->Event.DisplayName, event->DisplayName);
+
         // Fill in event action information for the actual detection, based on what has been armed.
         EventSelector->Event.EventId = contosoResult->EventId;
         EventSelector->Armed = TRUE;
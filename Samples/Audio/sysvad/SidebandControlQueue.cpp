@@ -0,0 +1,359 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    SidebandControlQueue.cpp
+
+Abstract:
+
+    Implementation of the SidebandControlQueue class.
+
+--*/
+
+#pragma warning (disable : 4127)
+
+#include <sysvad.h>
+
+#if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND) || defined(SYSVAD_A2DP_SIDEBAND)
+#include "SidebandControlQueue.h"
+
+//=============================================================================
+#pragma code_seg("PAGE")
+SidebandControlQueue::SidebandControlQueue()
+:   m_WorkItem(NULL),
+    m_Send(NULL),
+    m_SendContext(NULL),
+    m_WorkItemQueued(FALSE),
+    m_Stopping(FALSE),
+    m_NextSlot(0)
+{
+    PAGED_CODE();
+
+    KeInitializeSpinLock(&m_Lock);
+    RtlZeroMemory(m_Slots, sizeof(m_Slots));
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+SidebandControlQueue::~SidebandControlQueue()
+{
+    PAGED_CODE();
+
+    Cleanup();
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+SidebandControlQueue::Init
+(
+    _In_ WDFOBJECT              ParentObject,
+    _In_ PFNSIDEBANDCONTROLSEND Send,
+    _In_ PVOID                  SendContext
+)
+{
+    PAGED_CODE();
+    DPF_ENTER(("[SidebandControlQueue::Init]"));
+
+    NTSTATUS                                ntStatus    = STATUS_SUCCESS;
+    SidebandControlQueueWorkItemContext   * wiCtx       = NULL;
+    WDF_OBJECT_ATTRIBUTES                   attributes;
+    WDF_WORKITEM_CONFIG                     wiConfig;
+
+    ASSERT(m_WorkItem == NULL);
+
+    m_Send = Send;
+    m_SendContext = SendContext;
+
+    WDF_WORKITEM_CONFIG_INIT(&wiConfig, EvtSidebandControlQueueWorkItem);
+    wiConfig.AutomaticSerialization = FALSE;
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, SidebandControlQueueWorkItemContext);
+    attributes.ParentObject = ParentObject;
+    ntStatus = WdfWorkItemCreate(&wiConfig,
+                                 &attributes,
+                                 &m_WorkItem);
+    IF_FAILED_ACTION_JUMP(
+        ntStatus,
+        DPF(D_ERROR, ("SidebandControlQueue::Init: WdfWorkItemCreate failed: 0x%x", ntStatus)),
+        Done);
+
+    wiCtx = GetSidebandControlQueueWorkItemContext(m_WorkItem);
+    wiCtx->Queue = this; // weak ref.
+
+Done:
+    return ntStatus;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+SidebandControlQueue::Cleanup()
+{
+    PAGED_CODE();
+    DPF_ENTER(("[SidebandControlQueue::Cleanup]"));
+
+    if (m_WorkItem != NULL)
+    {
+        Stop();
+
+        WdfObjectDelete(m_WorkItem);
+        m_WorkItem = NULL;
+    }
+}
+
+//=============================================================================
+#pragma code_seg()
+VOID
+SidebandControlQueue::Stop()
+/*++
+
+Routine Description:
+
+Sends what is still queued, then fails further posts. After returning from
+this function, no value is being sent.
+
+--*/
+{
+    DPF_ENTER(("[SidebandControlQueue::Stop]"));
+
+    KIRQL   oldIrql;
+
+    KeAcquireSpinLock(&m_Lock, &oldIrql);
+    m_Stopping = TRUE;
+    KeReleaseSpinLock(&m_Lock, oldIrql);
+
+    if (m_WorkItem != NULL)
+    {
+        WdfWorkItemFlush(m_WorkItem);
+    }
+}
+
+//=============================================================================
+#pragma code_seg()
+SidebandControlSlot *
+SidebandControlQueue::FindSlot
+(
+    _In_ ULONG  Control,
+    _In_ LONG   Channel
+)
+// Caller holds m_Lock.
+{
+    for (ULONG i = 0; i < SIDEBAND_CONTROL_QUEUE_MAX_SLOTS; ++i)
+    {
+        if (m_Slots[i].InUse &&
+            m_Slots[i].Control == Control &&
+            m_Slots[i].Channel == Channel)
+        {
+            return &m_Slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+//=============================================================================
+#pragma code_seg()
+NTSTATUS
+SidebandControlQueue::Post
+(
+    _In_ ULONG  Control,
+    _In_ LONG   Channel,
+    _In_ LONG   Value
+)
+/*++
+
+Routine Description:
+
+Queues Value to be sent and returns without waiting for the device. A value
+of the same (Control, Channel) that is not sent yet is dropped.
+
+--*/
+{
+    DPF_ENTER(("[SidebandControlQueue::Post]"));
+
+    NTSTATUS                ntStatus    = STATUS_SUCCESS;
+    SidebandControlSlot   * slot        = NULL;
+    BOOL                    enqueue     = FALSE;
+    KIRQL                   oldIrql;
+
+    KeAcquireSpinLock(&m_Lock, &oldIrql);
+
+    if (m_Stopping || m_WorkItem == NULL)
+    {
+        ntStatus = STATUS_INVALID_DEVICE_STATE;
+        goto Done;
+    }
+
+    slot = FindSlot(Control, Channel);
+    if (slot == NULL)
+    {
+        for (ULONG i = 0; i < SIDEBAND_CONTROL_QUEUE_MAX_SLOTS; ++i)
+        {
+            if (!m_Slots[i].InUse)
+            {
+                slot = &m_Slots[i];
+                slot->InUse = TRUE;
+                slot->Control = Control;
+                slot->Channel = Channel;
+                break;
+            }
+        }
+    }
+
+    if (slot == NULL)
+    {
+        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        goto Done;
+    }
+
+    slot->Value = Value;
+    slot->Pending = TRUE;
+
+    if (!m_WorkItemQueued)
+    {
+        m_WorkItemQueued = TRUE;
+        enqueue = TRUE;
+    }
+
+Done:
+    KeReleaseSpinLock(&m_Lock, oldIrql);
+
+    if (enqueue)
+    {
+        WdfWorkItemEnqueue(m_WorkItem);
+    }
+
+    return ntStatus;
+}
+
+//=============================================================================
+#pragma code_seg()
+BOOL
+SidebandControlQueue::GetOutstandingValue
+(
+    _In_  ULONG     Control,
+    _In_  LONG      Channel,
+    _Out_ LONG    * Value
+)
+/*++
+
+Routine Description:
+
+Returns TRUE and the latest posted value if a value of (Control, Channel) is
+waiting or being sent, i.e., if the device may not reflect it yet.
+
+--*/
+{
+    DPF_ENTER(("[SidebandControlQueue::GetOutstandingValue]"));
+
+    SidebandControlSlot   * slot        = NULL;
+    BOOL                    outstanding = FALSE;
+    KIRQL                   oldIrql;
+
+    *Value = 0;
+
+    KeAcquireSpinLock(&m_Lock, &oldIrql);
+
+    slot = FindSlot(Control, Channel);
+    if (slot != NULL && (slot->Pending || slot->InFlight))
+    {
+        *Value = slot->Value;
+        outstanding = TRUE;
+    }
+
+    KeReleaseSpinLock(&m_Lock, oldIrql);
+
+    return outstanding;
+}
+
+//=============================================================================
+#pragma code_seg()
+VOID
+SidebandControlQueue::EvtSidebandControlQueueWorkItem
+(
+    _In_    WDFWORKITEM WorkItem
+)
+/*++
+
+Routine Description:
+
+Sends the queued values until none is left.
+
+Arguments:
+
+WorkItem    - WDF work-item object.
+
+--*/
+{
+    DPF_ENTER(("[SidebandControlQueue::EvtSidebandControlQueueWorkItem]"));
+
+    SidebandControlQueue  * This;
+    KIRQL                   oldIrql;
+
+    if (WorkItem == NULL)
+    {
+        return;
+    }
+
+    This = GetSidebandControlQueueWorkItemContext(WorkItem)->Queue;
+    ASSERT(This != NULL);
+
+    for (;;)
+    {
+        SidebandControlSlot   * slot    = NULL;
+        ULONG                   control;
+        LONG                    channel;
+        LONG                    value;
+        NTSTATUS                ntStatus;
+
+        //
+        // Take the next pending value, round robin across the slots so that
+        // a busy control does not hold back the others.
+        //
+        KeAcquireSpinLock(&This->m_Lock, &oldIrql);
+
+        for (ULONG i = 0; i < SIDEBAND_CONTROL_QUEUE_MAX_SLOTS; ++i)
+        {
+            ULONG iSlot = (This->m_NextSlot + i) % SIDEBAND_CONTROL_QUEUE_MAX_SLOTS;
+
+            if (This->m_Slots[iSlot].Pending)
+            {
+                slot = &This->m_Slots[iSlot];
+                This->m_NextSlot = iSlot + 1;
+                break;
+            }
+        }
+
+        if (slot == NULL)
+        {
+            This->m_WorkItemQueued = FALSE;
+            KeReleaseSpinLock(&This->m_Lock, oldIrql);
+            break;
+        }
+
+        control = slot->Control;
+        channel = slot->Channel;
+        value = slot->Value;
+        slot->Pending = FALSE;
+        slot->InFlight = TRUE;
+
+        KeReleaseSpinLock(&This->m_Lock, oldIrql);
+
+        ntStatus = This->m_Send(This->m_SendContext, control, channel, value);
+        if (!NT_SUCCESS(ntStatus))
+        {
+            // The next status update or get reads the device's value.
+            DPF(D_ERROR, ("EvtSidebandControlQueueWorkItem: send of control %u, channel %d failed, 0x%x",
+                control, channel, ntStatus));
+        }
+
+        KeAcquireSpinLock(&This->m_Lock, &oldIrql);
+        slot->InFlight = FALSE;
+        KeReleaseSpinLock(&This->m_Lock, oldIrql);
+    }
+}
+
+#endif // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND) || defined(SYSVAD_A2DP_SIDEBAND)
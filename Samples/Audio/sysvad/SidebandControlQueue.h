@@ -0,0 +1,123 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    SidebandControlQueue.h
+
+Abstract:
+
+    Declaration of the SidebandControlQueue class. The queue sends control
+    values (volume, mute, ...) to a sideband device from a work-item, so
+    that the caller of a set does not wait on the round trip.
+
+--*/
+
+#ifndef _SYSVAD_SIDEBANDCONTROLQUEUE_H_
+#define _SYSVAD_SIDEBANDCONTROLQUEUE_H_
+
+#if defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND) || defined(SYSVAD_A2DP_SIDEBAND)
+
+class SidebandControlQueue;
+
+// Max # of (control, channel) pairs a queue tracks.
+#define SIDEBAND_CONTROL_QUEUE_MAX_SLOTS    8
+
+//
+// Sends one control value to the device, synchronously, at passive level.
+// Control and Channel are defined by the owner of the queue.
+//
+typedef
+NTSTATUS
+(*PFNSIDEBANDCONTROLSEND)
+(
+    _In_ PVOID  Context,
+    _In_ ULONG  Control,
+    _In_ LONG   Channel,
+    _In_ LONG   Value
+);
+
+// Control queue's work-item context.
+struct SidebandControlQueueWorkItemContext
+{
+    SidebandControlQueue *  Queue;
+};
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME
+(
+    SidebandControlQueueWorkItemContext,
+    GetSidebandControlQueueWorkItemContext
+)
+
+struct SidebandControlSlot
+{
+    ULONG       Control;
+    LONG        Channel;
+    LONG        Value;
+    BOOLEAN     InUse;
+    BOOLEAN     Pending;    // Value is not sent yet.
+    BOOLEAN     InFlight;   // a value of this control is being sent.
+};
+
+//
+// Only the latest value posted for a (control, channel) pair is kept; a
+// value that is still waiting is replaced by a newer one. Values of
+// different pairs are sent in turn. The device's own status updates for a
+// pair are stale while the pair is outstanding (pending or in flight), the
+// owner uses GetOutstandingValue to tell.
+//
+class SidebandControlQueue
+{
+private:
+    KSPIN_LOCK              m_Lock;
+    WDFWORKITEM             m_WorkItem;
+    PFNSIDEBANDCONTROLSEND  m_Send;
+    PVOID                   m_SendContext;
+    BOOLEAN                 m_WorkItemQueued;
+    BOOLEAN                 m_Stopping;
+    ULONG                   m_NextSlot;
+    SidebandControlSlot     m_Slots[SIDEBAND_CONTROL_QUEUE_MAX_SLOTS];
+
+public:
+    SidebandControlQueue();
+    ~SidebandControlQueue();
+
+    NTSTATUS Init
+    (
+        _In_ WDFOBJECT              ParentObject,
+        _In_ PFNSIDEBANDCONTROLSEND Send,
+        _In_ PVOID                  SendContext
+    );
+
+    VOID Cleanup();
+
+    NTSTATUS Post
+    (
+        _In_ ULONG  Control,
+        _In_ LONG   Channel,
+        _In_ LONG   Value
+    );
+
+    BOOL GetOutstandingValue
+    (
+        _In_  ULONG     Control,
+        _In_  LONG      Channel,
+        _Out_ LONG    * Value
+    );
+
+    VOID Stop();
+
+private:
+    SidebandControlSlot * FindSlot
+    (
+        _In_ ULONG  Control,
+        _In_ LONG   Channel
+    );
+
+    static EVT_WDF_WORKITEM EvtSidebandControlQueueWorkItem;
+};
+
+#endif // defined(SYSVAD_BTH_BYPASS) || defined(SYSVAD_USB_SIDEBAND) || defined(SYSVAD_A2DP_SIDEBAND)
+
+#endif // _SYSVAD_SIDEBANDCONTROLQUEUE_H_
@@ -24,7 +24,99 @@ DEFINE_GUIDSTRUCT("D849C827-B24B-4C3D-A26E-338F4FF07ED5", KSPROPSETID_SysVAD);
 
 
 typedef enum{
-    KSPROPERTY_SYSVAD_DEFAULTSTREAMEFFECTS
+    KSPROPERTY_SYSVAD_DEFAULTSTREAMEFFECTS,
+    KSPROPERTY_SYSVAD_KEYWORDBURSTREAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_SYSVAD_MUTEVECTOR
 } KSPROPERTY_SYSVAD;
 
+//
+// KSPROPERTY_SYSVAD_VOLUMEVECTOR, KSPROPERTY_SYSVAD_MUTEVECTOR
+//
+// Node properties of the volume and mute nodes, get and set, with a
+// KSNODEPROPERTY instance. The value is one LONG per channel of the node
+// (volume in 1/65536 dB, mute as BOOL), read or written as a whole. These
+// do not change the meaning of ALL_CHANNELS_ID for KSPROPERTY_AUDIO_VOLUMELEVEL
+// and KSPROPERTY_AUDIO_MUTE, which still sets every channel to one value.
+//
+
+//
+// KSPROPERTY_SYSVAD_KEYWORDBURSTREAD
+//
+// Filter property, get only, with a KSP_PIN instance naming the keyword
+// detector pin. Returns, in order, as many of the buffered keyword packets
+// as fit in the value and moves the read position of the keyword stream
+// past them, so that the following GetReadPacket calls continue with the
+// next packet. The packets returned are consecutive, starting at
+// FirstPacketNumber.
+//
+#define SYSVAD_KEYWORD_SAMPLES_PER_PACKET   160     // 10 ms of 16 kHz, 16-bit mono
+
+typedef struct _SYSVAD_KEYWORD_PACKET
+{
+    ULONGLONG   PerformanceCounter;     // QPC time of the first sample
+    SHORT       Samples[SYSVAD_KEYWORD_SAMPLES_PER_PACKET];
+} SYSVAD_KEYWORD_PACKET, *PSYSVAD_KEYWORD_PACKET;
+
+typedef struct _SYSVAD_KEYWORD_BURST
+{
+    ULONG       FirstPacketNumber;
+    ULONG       PacketCount;
+    BOOL        MoreData;               // packets are still buffered after this burst
+    ULONG       Reserved;
+    SYSVAD_KEYWORD_PACKET Packets[1];   // PacketCount entries
+} SYSVAD_KEYWORD_BURST, *PSYSVAD_KEYWORD_BURST;
+
+// Value size needed for a burst of up to n packets
+#define SYSVAD_KEYWORD_BURST_SIZE(n) \
+    (FIELD_OFFSET(SYSVAD_KEYWORD_BURST, Packets) + (n) * sizeof(SYSVAD_KEYWORD_PACKET))
+
+//
+// Batched audio module commands.
+//
+// A KSPROPERTY_AUDIOMODULE_COMMAND request whose KSAUDIOMODULE_PROPERTY
+// ClassId is SYSVAD_AUDIOMODULE_BATCH_CLASSID (InstanceId is ignored)
+// carries a list of module commands after the KSAUDIOMODULE_PROPERTY:
+//   SYSVAD_AUDIOMODULE_BATCH_HEADER
+//   SYSVAD_AUDIOMODULE_BATCH_COMMAND, followed by CommandSize bytes of
+//   module command, Count times, each entry starting 8 byte aligned.
+// For each command, in the same order, the value receives
+//   SYSVAD_AUDIOMODULE_BATCH_RESULT, followed by the ValueSize bytes the
+//   command asked for, each entry starting 8 byte aligned.
+//
+// The commands of a batch run in order, with no other command to the same
+// module list in between. If one fails, the module state changed by the
+// commands before it is restored and the request fails with its status.
+//
+// {6F1C0F4A-3B2E-4D8B-9C51-0E7A2B4D9F36}
+#define STATIC_SYSVAD_AUDIOMODULE_BATCH_CLASSID\
+    0x6f1c0f4a, 0x3b2e, 0x4d8b, 0x9c, 0x51, 0x0e, 0x7a, 0x2b, 0x4d, 0x9f, 0x36
+DEFINE_GUIDSTRUCT("6F1C0F4A-3B2E-4D8B-9C51-0E7A2B4D9F36", SYSVAD_AUDIOMODULE_BATCH_CLASSID);
+#define SYSVAD_AUDIOMODULE_BATCH_CLASSID DEFINE_GUIDNAMED(SYSVAD_AUDIOMODULE_BATCH_CLASSID)
+
+#define SYSVAD_AUDIOMODULE_BATCH_MAX_COMMANDS   256
+
+#define SYSVAD_AUDIOMODULE_BATCH_ALIGN(cb)      (((cb) + 7) & ~7)
+
+typedef struct _SYSVAD_AUDIOMODULE_BATCH_HEADER
+{
+    ULONG       Count;                  // commands in the batch
+    ULONG       Reserved;
+} SYSVAD_AUDIOMODULE_BATCH_HEADER, *PSYSVAD_AUDIOMODULE_BATCH_HEADER;
+
+typedef struct _SYSVAD_AUDIOMODULE_BATCH_COMMAND
+{
+    GUID        ClassId;
+    ULONG       InstanceId;
+    ULONG       CommandSize;            // module command bytes that follow
+    ULONG       ValueSize;              // bytes reserved for what the module returns
+    ULONG       Reserved;
+} SYSVAD_AUDIOMODULE_BATCH_COMMAND, *PSYSVAD_AUDIOMODULE_BATCH_COMMAND;
+
+typedef struct _SYSVAD_AUDIOMODULE_BATCH_RESULT
+{
+    LONG        Status;                 // NTSTATUS of the command
+    ULONG       ValueSize;              // bytes returned by the module
+} SYSVAD_AUDIOMODULE_BATCH_RESULT, *PSYSVAD_AUDIOMODULE_BATCH_RESULT;
+
 #endif
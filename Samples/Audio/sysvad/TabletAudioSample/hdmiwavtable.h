@@ -18,6 +18,9 @@ Abstract:
 #ifndef _SYSVAD_HDMIWAVTABLE_H_
 #define _SYSVAD_HDMIWAVTABLE_H_
 
+#include "SysVadShared.h"
+#include "WaveFormatTable.h"
+
 
 //=============================================================================
 // Defines
@@ -76,436 +79,87 @@ Abstract:
 
 
 //=============================================================================
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE HdmiHostPinSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_LAYOUT HdmiStereoLayout[] =
 {
-    { // 0
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 4
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_5POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL)
-        }
-    },
-    { // 5
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_5POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL)
-        }
-    },
-    { // 6
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MLP),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MLP)
-        }
-    },
-    { // 7
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MLP),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MLP)
-        }
-    },
-    { // 8
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_MPEGH_LEVEL1_LC),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_MPEGH_LEVEL1_LC)
-        }
-    },
-    { // 9
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_MPEGH_LEVEL1_LC),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_MPEGH_LEVEL1_LC)
-        }
-    },
-    { // 10
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_5POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS)
-        }
-    },
-    { // 11
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS_HD),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS_HD)
-        }
-    },
-    { // 12
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E1),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E1)
-        }
-    },
-    { // 13
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E2),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E2)
-        }
-    },
-    { // 14
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT20),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT20)
-        }
-    },
-    { // 15
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21)
-        }
-    },
-    { // 16
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21_PROFILE4),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                8,
-                192000,
-                3072000,
-                16,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_7POINT1,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21_PROFILE4)
-        }
-    }
+    { 2, KSAUDIO_SPEAKER_STEREO }
 };
 
+//
+// IEC 61937 carries compressed 5.1 streams in a stereo PCM frame, and the
+// high bit rate formats in an eight channel frame.
+//
+static constexpr
+WAVEFORMAT_LAYOUT HdmiCompressedSurroundLayout[] =
+{
+    { 2, KSAUDIO_SPEAKER_5POINT1_SURROUND }
+};
+
+static constexpr
+WAVEFORMAT_LAYOUT HdmiHbrLayout[] =
+{
+    { 8, KSAUDIO_SPEAKER_7POINT1 }
+};
+
+static constexpr
+WAVEFORMAT_LAYOUT HdmiHbrMlpLayouts[] =
+{
+    { 8, KSAUDIO_SPEAKER_7POINT1 },
+    { 8, KSAUDIO_SPEAKER_7POINT1_SURROUND }
+};
+
+static constexpr
+WAVEFORMAT_DEPTH HdmiDepth16[] =
+{
+    { 16, 16 }
+};
+
+static constexpr
+DWORD HdmiPcmRates[] =
+{
+    44100,
+    48000,
+    88200,
+    96000
+};
+
+static constexpr
+DWORD HdmiDolbyDigitalRates[] =
+{
+    44100,
+    48000
+};
+
+static constexpr
+DWORD HdmiDtsRates[] =
+{
+    48000
+};
+
+static constexpr
+DWORD HdmiHbrRates[] =
+{
+    192000
+};
+
+static constexpr
+WAVEFORMAT_GROUP HdmiHostPinFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),                             WAVEFORMAT_LIST(HdmiStereoLayout),             WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiPcmRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),          WAVEFORMAT_LIST(HdmiCompressedSurroundLayout), WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiDolbyDigitalRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MLP),              WAVEFORMAT_LIST(HdmiHbrMlpLayouts),            WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_MPEGH_LEVEL1_LC),        WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS),                    WAVEFORMAT_LIST(HdmiCompressedSurroundLayout), WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiDtsRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTS_HD),                 WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E1),                WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DTSX_E2),                WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT20),            WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21),            WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_MAT21_PROFILE4),   WAVEFORMAT_LIST(HdmiHbrLayout),                WAVEFORMAT_LIST(HdmiDepth16), WAVEFORMAT_LIST(HdmiHbrRates) }
+};
+
+DECLARE_WAVEFORMAT_TABLE(HdmiHostPinSupportedDeviceFormats, HdmiHostPinFormatGroups);
+
 //
 // Supported modes (only on streaming pins).
 // Note: This pin does not support KSPROPERTY_PIN_PROPOSEDATAFORMAT2 
@@ -529,15 +183,15 @@ PIN_DEVICE_FORMATS_AND_MODES HdmiPinDeviceFormatsAndModes[] =
 {
     {
         SystemRenderPin,
-        HdmiHostPinSupportedDeviceFormats,
-        SIZEOF_ARRAY(HdmiHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(HdmiHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(HdmiHostPinSupportedDeviceFormats),
         HdmiHostPinSupportedDeviceModes,
         SIZEOF_ARRAY(HdmiHostPinSupportedDeviceModes)
     },
     {
         RenderLoopbackPin,
-        HdmiHostPinSupportedDeviceFormats,   // Must support all the formats supported by host pin
-        SIZEOF_ARRAY(HdmiHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(HdmiHostPinSupportedDeviceFormats),   // Must support all the formats supported by host pin
+        WAVEFORMAT_TABLE_COUNT(HdmiHostPinSupportedDeviceFormats),
         NULL,   // loopback doesn't support modes.
         0
     },
@@ -978,6 +632,12 @@ PCPROPERTY_ITEM HdmiPropertiesVolume[] =
     KSPROPERTY_AUDIO_VOLUMELEVEL,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_WaveFilter
+    },
+    {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_WaveFilter
     }
 };
 
@@ -992,6 +652,12 @@ PCPROPERTY_ITEM HdmiPropertiesMute[] =
     KSPROPERTY_AUDIO_MUTE,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_WaveFilter
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_MUTEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_WaveFilter
   }
 };
 
@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_MICARRAY2TOPTABLE_H_
 #define _SYSVAD_MICARRAY2TOPTABLE_H_
 
+#include "SysVadShared.h"
+
 //
 // {3fe0e3e1-ad16-4772-8382-4129169018ce}
 DEFINE_GUID(MICARRAY2_CUSTOM_NAME, 
@@ -98,6 +100,12 @@ PCPROPERTY_ITEM MicArray2PropertiesVolume[] =
     KSPROPERTY_AUDIO_VOLUMELEVEL,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+    },
+    {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
     }
 };
 
@@ -112,6 +120,12 @@ PCPROPERTY_ITEM MicArray2PropertiesMute[] =
     KSPROPERTY_AUDIO_MUTE,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_MUTEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
   }
 };
 
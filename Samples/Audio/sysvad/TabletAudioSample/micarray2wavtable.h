@@ -14,6 +14,9 @@ Abstract:
 #ifndef _SYSVAD_MICARRAY2WAVTABLE_H_
 #define _SYSVAD_MICARRAY2WAVTABLE_H_
 
+#include "SysVadShared.h"
+#include "WaveFormatTable.h"
+
 //
 // Mic array range.
 //
@@ -32,254 +35,61 @@ Abstract:
 #define MICARRAY2_MAX_INPUT_STREAMS              4
 
 //=============================================================================
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE MicArray2PinSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_LAYOUT MicArray2ProcessedLayout[] =
 {
-    // 0 - Note the ENDPOINT_MINIPAIR structures for the mic arrays use this first element as the proposed DEFAULT format
-    // 48 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                48000,
-                96000,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 1
-    // 8 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                8000,
-                16000,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 2
-    // 11.025 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                11025,
-                22050,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 3 - Note the ENDPOINT_MINIPAIR structures for the mic arrays use this element as the proposed SPEECH format
-    // 16 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,      // One channel
-                16000,  // 16KHz
-                32000,  // average bytes per second
-                2,      // 2 bytes per frame
-                16,     // 16 bits per sample container
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,         // valid bits per sample
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 4
-    // 22.05 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                22050,
-                44100,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 5 - Note the ENDPOINT_MINIPAIR structures for the mic arrays use this element as the proposed COMMUNICATIONS format
-    // 24 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                24000,
-                48000,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 6
-    // 32 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                32000,
-                64000,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 7
-    // 44.1 KHz 16-bit mono
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                1,
-                44100,
-                88200,
-                2,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_MONO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    // 8 - Note the ENDPOINT_MINIPAIR structures for the mic arrays use this last element as the proposed RAW format
-    // 48 KHz 32-bit 2 channels
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                384000,
-                8,
-                32,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            32,
-            0,                                      // No channel configuration for unprocessed mic array
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
+    { MICARRAY2_PROCESSED_CHANNELS, KSAUDIO_SPEAKER_MONO }
+};
+
+static constexpr
+WAVEFORMAT_LAYOUT MicArray2RawLayout[] =
+{
+    { MICARRAY2_RAW_CHANNELS, 0 }       // No channel configuration for unprocessed mic array
+};
+
+static constexpr
+WAVEFORMAT_DEPTH MicArray2ProcessedDepth[] =
+{
+    { MICARRAY2_16_BITS_PER_SAMPLE_PCM, MICARRAY2_16_BITS_PER_SAMPLE_PCM }
+};
+
+static constexpr
+WAVEFORMAT_DEPTH MicArray2RawDepth[] =
+{
+    { MICARRAY2_32_BITS_PER_SAMPLE_PCM, MICARRAY2_32_BITS_PER_SAMPLE_PCM }
+};
+
+static constexpr
+DWORD MicArray2ProcessedRates[] =
+{
+    48000,      // 0 - Note the ENDPOINT_MINIPAIR structures for the mic arrays use this first element as the proposed DEFAULT format
+    8000,
+    11025,
+    16000,
+    22050,
+    24000,
+    32000,
+    44100
+};
+
+static constexpr
+DWORD MicArray2RawRates[] =
+{
+    MICARRAY2_RAW_SAMPLE_RATE
 };
 
+//
+// The raw format must remain the last entry, see MicArray2PinSupportedDeviceModes.
+//
+static constexpr
+WAVEFORMAT_GROUP MicArray2PinFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(MicArray2ProcessedLayout), WAVEFORMAT_LIST(MicArray2ProcessedDepth), WAVEFORMAT_LIST(MicArray2ProcessedRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(MicArray2RawLayout),       WAVEFORMAT_LIST(MicArray2RawDepth),       WAVEFORMAT_LIST(MicArray2RawRates) }
+};
+
+DECLARE_WAVEFORMAT_TABLE(MicArray2PinSupportedDeviceFormats, MicArray2PinFormatGroups);
+
 //
 // Supported modes (only on streaming pins).
 //
@@ -288,19 +98,19 @@ MODE_AND_DEFAULT_FORMAT MicArray2PinSupportedDeviceModes[] =
 {
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_RAW,
-        &MicArray2PinSupportedDeviceFormats[SIZEOF_ARRAY(MicArray2PinSupportedDeviceFormats)-1].DataFormat
+        WAVEFORMAT_TABLE_FORMAT(MicArray2PinSupportedDeviceFormats, WAVEFORMAT_TABLE_COUNT(MicArray2PinSupportedDeviceFormats)-1)
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_DEFAULT,
-        &MicArray2PinSupportedDeviceFormats[0].DataFormat
+        WAVEFORMAT_TABLE_FORMAT(MicArray2PinSupportedDeviceFormats, 0)
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_SPEECH,
-        &MicArray2PinSupportedDeviceFormats[3].DataFormat
+        WAVEFORMAT_TABLE_FORMAT(MicArray2PinSupportedDeviceFormats, 3)
     },
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_COMMUNICATIONS,
-        &MicArray2PinSupportedDeviceFormats[5].DataFormat
+        WAVEFORMAT_TABLE_FORMAT(MicArray2PinSupportedDeviceFormats, 5)
     }
 };
 
@@ -318,43 +128,39 @@ INTERLEAVED_AUDIO_FORMAT_INFORMATION InterleavedFormatInformation =
 };
 
 //=============================================================================
-static
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE KeywordPin2SupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_LAYOUT KeywordPin2Layout[] =
 {
-    {
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                6,       // six channels, make sure this matches InterleavedFormatInformation, if interleaving loopback audio
-                16000,   // 16KHz
-                192000,  // average bytes per second
-                12,      // 8 bytes per frame
-                16,      // 16 bits per sample container
-                sizeof(WAVEFORMATEXTENSIBLE)-sizeof(WAVEFORMATEX)
-            },
-            16,         // valid bits per sample
-            0, // No channel configuration for unprocessed mic array
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
+    { 6, 0 }    // six channels, make sure this matches InterleavedFormatInformation, if interleaving loopback audio
 };
 
+static constexpr
+WAVEFORMAT_DEPTH KeywordPin2Depth[] =
+{
+    { 16, 16 }
+};
+
+static constexpr
+DWORD KeywordPin2Rates[] =
+{
+    16000
+};
+
+static constexpr
+WAVEFORMAT_GROUP KeywordPin2FormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM), WAVEFORMAT_LIST(KeywordPin2Layout), WAVEFORMAT_LIST(KeywordPin2Depth), WAVEFORMAT_LIST(KeywordPin2Rates) }
+};
+
+DECLARE_WAVEFORMAT_TABLE(KeywordPin2SupportedDeviceFormats, KeywordPin2FormatGroups);
+
 static
 MODE_AND_DEFAULT_FORMAT KeywordPin2SupportedDeviceModes[] =
 {
     {
         STATIC_AUDIO_SIGNALPROCESSINGMODE_RAW,
         // STATIC_AUDIO_SIGNALPROCESSINGMODE_SPEECH,
-        &KeywordPin2SupportedDeviceFormats[SIZEOF_ARRAY(KeywordPin2SupportedDeviceFormats) - 1].DataFormat
+        WAVEFORMAT_TABLE_FORMAT(KeywordPin2SupportedDeviceFormats, WAVEFORMAT_TABLE_COUNT(KeywordPin2SupportedDeviceFormats) - 1)
     },
 };
 
@@ -374,15 +180,15 @@ PIN_DEVICE_FORMATS_AND_MODES MicArray2PinDeviceFormatsAndModes[] =
     },
     {
         SystemCapturePin,
-        MicArray2PinSupportedDeviceFormats,
-        SIZEOF_ARRAY(MicArray2PinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(MicArray2PinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(MicArray2PinSupportedDeviceFormats),
         MicArray2PinSupportedDeviceModes,
         SIZEOF_ARRAY(MicArray2PinSupportedDeviceModes)
     },
     {
         KeywordCapturePin,
-        KeywordPin2SupportedDeviceFormats,
-        SIZEOF_ARRAY(KeywordPin2SupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(KeywordPin2SupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(KeywordPin2SupportedDeviceFormats),
         KeywordPin2SupportedDeviceModes,
         SIZEOF_ARRAY(KeywordPin2SupportedDeviceModes)
     }
@@ -729,6 +535,7 @@ DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Set_SoundDetectorArmed2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Set_SoundDetectorReset2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_SoundDetectorStreamingSupport2);
 DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_InterleavedFormatInformation);
+DECLARE_CLASSPROPERTYHANDLER(CMiniportWaveRT, Get_KeywordBurstRead);
 
 
 static
@@ -944,6 +751,21 @@ SYSVADPROPERTY_ITEM PropertiesMicArray2WaveFilter[] =
         &InterleavedFormatInformation, // format interleaving information for this endpoint
         sizeof(InterleavedFormatInformation)
     },
+    {
+        {
+            &KSPROPSETID_SysVAD,
+            KSPROPERTY_SYSVAD_KEYWORDBURSTREAD,
+            KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_BASICSUPPORT,
+            SysvadPropertyDispatch,
+        },
+        sizeof(KSP_PIN) - sizeof(KSPROPERTY),
+        SYSVAD_KEYWORD_BURST_SIZE(1),
+        CMiniportWaveRT_Get_KeywordBurstRead,
+        NULL,
+        NULL,
+        NULL,
+        0
+    },
 };
 
 NTSTATUS CMiniportWaveRT_EventHandler_SoundDetectorMatchDetected(
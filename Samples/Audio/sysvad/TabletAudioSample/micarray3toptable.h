@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_MICARRAY3TOPTABLE_H_
 #define _SYSVAD_MICARRAY3TOPTABLE_H_
 
+#include "SysVadShared.h"
+
 //
 // {c04bdb7c-2138-48da-9dd4-2af9ff2e58c2}
 DEFINE_GUID(MICARRAY3_CUSTOM_NAME, 
@@ -98,6 +100,12 @@ PCPROPERTY_ITEM MicArray3PropertiesVolume[] =
     KSPROPERTY_AUDIO_VOLUMELEVEL,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+    },
+    {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
     }
 };
 
@@ -112,6 +120,12 @@ PCPROPERTY_ITEM MicArray3PropertiesMute[] =
     KSPROPERTY_AUDIO_MUTE,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_MicArrayTopology
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_MUTEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_MicArrayTopology
   }
 };
 
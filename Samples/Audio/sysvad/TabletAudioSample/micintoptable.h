@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_MICINTOPTABLE_H_
 #define _SYSVAD_MICINTOPTABLE_H_
 
+#include "SysVadShared.h"
+
 // Function declarations.
 NTSTATUS
 PropertyHandler_MicInTopoFilter( 
@@ -126,6 +128,12 @@ PCPROPERTY_ITEM MicInPropertiesVolume[] =
     KSPROPERTY_AUDIO_VOLUMELEVEL,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_Topology
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_VOLUMEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_Topology
   }
 };
 
@@ -140,6 +148,12 @@ PCPROPERTY_ITEM MicInPropertiesMute[] =
     KSPROPERTY_AUDIO_MUTE,
     KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
     PropertyHandler_Topology
+  },
+  {
+    &KSPROPSETID_SysVAD,
+    KSPROPERTY_SYSVAD_MUTEVECTOR,
+    KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+    PropertyHandler_Topology
   }
 };
 
@@ -15,6 +15,8 @@ Abstract:
 #ifndef _SYSVAD_SPDIFWAVTABLE_H_
 #define _SYSVAD_SPDIFWAVTABLE_H_
 
+#include "WaveFormatTable.h"
+
 
 //=============================================================================
 // Defines
@@ -56,371 +58,60 @@ Abstract:
 
 
 //=============================================================================
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpdifAudioEngineSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_LAYOUT SpdifStereoLayout[] =
 {
-    { // 0 : First entry in this table is the default format for the audio engine
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    }
+    { 2, KSAUDIO_SPEAKER_STEREO }
 };
 
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpdifHostPinSupportedDeviceFormats[] =
+//
+// IEC 61937 carries the compressed 5.1 stream in a stereo PCM frame.
+//
+static constexpr
+WAVEFORMAT_LAYOUT SpdifCompressedSurroundLayout[] =
 {
-    { // 0
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 4
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_5POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL)
-        }
-    },
-    { // 5
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_5POINT1_SURROUND,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL)
-        }
-    }
+    { 2, KSAUDIO_SPEAKER_5POINT1_SURROUND }
 };
 
-static 
-KSDATAFORMAT_WAVEFORMATEXTENSIBLE SpdifOffloadPinSupportedDeviceFormats[] =
+static constexpr
+WAVEFORMAT_DEPTH SpdifDepth16[] =
 {
-    { // 0
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                44100,
-                176400,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 1
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                48000,
-                192000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 2
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                88200,
-                352800,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    },
-    { // 3
-        {
-            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
-            0,
-            0,
-            0,
-            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),
-            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
-        },
-        {
-            {
-                WAVE_FORMAT_EXTENSIBLE,
-                2,
-                96000,
-                384000,
-                4,
-                16,
-                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
-            },
-            16,
-            KSAUDIO_SPEAKER_STEREO,
-            STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM)
-        }
-    }
+    { 16, 16 }
+};
+
+static constexpr
+DWORD SpdifPcmRates[] =
+{
+    44100,      // First entry in this table is the default format for the audio engine
+    48000,
+    88200,
+    96000
 };
 
+static constexpr
+DWORD SpdifDolbyDigitalRates[] =
+{
+    44100,
+    48000
+};
+
+static constexpr
+WAVEFORMAT_GROUP SpdifPcmFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),                     WAVEFORMAT_LIST(SpdifStereoLayout),             WAVEFORMAT_LIST(SpdifDepth16), WAVEFORMAT_LIST(SpdifPcmRates) }
+};
+
+static constexpr
+WAVEFORMAT_GROUP SpdifHostPinFormatGroups[] =
+{
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_PCM),                     WAVEFORMAT_LIST(SpdifStereoLayout),             WAVEFORMAT_LIST(SpdifDepth16), WAVEFORMAT_LIST(SpdifPcmRates) },
+    { STATICGUIDOF(KSDATAFORMAT_SUBTYPE_IEC61937_DOLBY_DIGITAL),  WAVEFORMAT_LIST(SpdifCompressedSurroundLayout), WAVEFORMAT_LIST(SpdifDepth16), WAVEFORMAT_LIST(SpdifDolbyDigitalRates) }
+};
+
+DECLARE_WAVEFORMAT_TABLE(SpdifAudioEngineSupportedDeviceFormats, SpdifPcmFormatGroups);
+DECLARE_WAVEFORMAT_TABLE(SpdifHostPinSupportedDeviceFormats, SpdifHostPinFormatGroups);
+DECLARE_WAVEFORMAT_TABLE(SpdifOffloadPinSupportedDeviceFormats, SpdifPcmFormatGroups);
+
 //
 // Supported modes (only on streaming pins).
 // Note: This pin does not support KSPROPERTY_PIN_PROPOSEDATAFORMAT2 
@@ -457,22 +148,22 @@ PIN_DEVICE_FORMATS_AND_MODES SpdifPinDeviceFormatsAndModes[] =
 {
     {
         SystemRenderPin,
-        SpdifHostPinSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpdifHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpdifHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpdifHostPinSupportedDeviceFormats),
         SpdifHostPinSupportedDeviceModes,
         SIZEOF_ARRAY(SpdifHostPinSupportedDeviceModes)
     },
     {
         OffloadRenderPin,
-        SpdifOffloadPinSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpdifOffloadPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpdifOffloadPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpdifOffloadPinSupportedDeviceFormats),
         SpdifOffloadPinSupportedDeviceModes,
         SIZEOF_ARRAY(SpdifOffloadPinSupportedDeviceModes),
     },
     {
         RenderLoopbackPin,
-        SpdifHostPinSupportedDeviceFormats,   // Must support all the formats supported by host pin
-        SIZEOF_ARRAY(SpdifHostPinSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpdifHostPinSupportedDeviceFormats),   // Must support all the formats supported by host pin
+        WAVEFORMAT_TABLE_COUNT(SpdifHostPinSupportedDeviceFormats),
         NULL,   // loopback doesn't support modes.
         0
     },
@@ -485,8 +176,8 @@ PIN_DEVICE_FORMATS_AND_MODES SpdifPinDeviceFormatsAndModes[] =
     },
     {
         NoPin,      // For convenience, offload engine device formats appended here
-        SpdifAudioEngineSupportedDeviceFormats,
-        SIZEOF_ARRAY(SpdifAudioEngineSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_FORMATS(SpdifAudioEngineSupportedDeviceFormats),
+        WAVEFORMAT_TABLE_COUNT(SpdifAudioEngineSupportedDeviceFormats),
         NULL,       // no modes for this entry.
         0
     }
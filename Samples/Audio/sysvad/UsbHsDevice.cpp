@@ -164,6 +164,8 @@ UsbHsDevice::Init
     //
     m_State                         = eUsbHsStateInitializing;
     m_Adapter                       = Adapter;
+    m_ArrivalQpc                    = KeQueryPerformanceCounter(NULL);
+    m_FirstStreamTraced             = FALSE;
 
     // Static config.
     m_WdfIoTarget                   = NULL;
@@ -206,6 +208,10 @@ UsbHsDevice::Init
     m_pSpeakerSupportedFormatsIntersection  = NULL;
     m_pMicSupportedFormatsIntersection      = NULL;
 
+    RtlZeroMemory(&m_CacheContainerId, sizeof(m_CacheContainerId));
+    m_CacheHash                     = 0;
+    m_CacheDiscovery                = FALSE;
+
     KeInitializeEvent(&m_SpeakerStreamStatusEvent, NotificationEvent, TRUE);
     KeInitializeEvent(&m_MicStreamStatusEvent, NotificationEvent, TRUE);
 
@@ -620,6 +626,12 @@ Return Value:
         RtlZeroMemory(&m_SymbolicLinkName, sizeof(m_SymbolicLinkName));
     }
 
+    //
+    // Hand the discovery results over to the adapter's cache, if they are
+    // complete; whatever the cache takes is NULL on return.
+    //
+    StoreCachedDiscovery();
+
     DeleteCustomEndpointMinipair(m_SpeakerMiniports);
     m_SpeakerMiniports = NULL;
 
@@ -1393,16 +1405,23 @@ UsbHsDevice::StreamStart(_In_ eDeviceType deviceType)
     PAGED_CODE();
     DPF_ENTER(("[%!FUNC!]"));
 
+    NTSTATUS ntStatus = STATUS_INVALID_PARAMETER;
+
     if (deviceType == eUsbHsSpeakerDevice)
     {
-        return SpeakerStreamStart();
+        ntStatus = SpeakerStreamStart();
     }
     else if (deviceType == eUsbHsMicDevice)
     {
-        return MicStreamStart();
+        ntStatus = MicStreamStart();
     }
 
-    return STATUS_INVALID_PARAMETER;
+    if (NT_SUCCESS(ntStatus) && !InterlockedExchange(&m_FirstStreamTraced, TRUE))
+    {
+        DPF(D_VERBOSE, ("%!FUNC!: %wZ first stream started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+    }
+
+    return ntStatus;
 }
 
 //=============================================================================
@@ -1721,6 +1740,80 @@ UsbHsDevice::GetNRECDisableStatus()
     return FALSE;
 }
 
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOL
+UsbHsDevice::IsEncodingOffloaded(_In_ eDeviceType deviceType)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    DPF_ENTER(("[%!FUNC!]"));
+
+    // USB audio is PCM; there is nothing to encode.
+    return TRUE;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+UsbHsDevice::SendPacket
+(
+    _In_        eDeviceType             deviceType,
+    _In_reads_bytes_(Length) const BYTE *Packet,
+    _In_        ULONG                   Length
+)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(Packet);
+    UNREFERENCED_PARAMETER(Length);
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+//=============================================================================
+#pragma code_seg()
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+UsbHsDevice::ReceivePacket
+(
+    _In_        eDeviceType             deviceType,
+    _Out_writes_bytes_(Length) BYTE     *Packet,
+    _In_        ULONG                   Length
+)
+{
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(Packet);
+    UNREFERENCED_PARAMETER(Length);
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+UsbHsDevice::StartPacketTransport
+(
+    _In_        eDeviceType             deviceType,
+    _In_        A2DP_SBC_STAGE          *Stage
+)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(deviceType);
+    UNREFERENCED_PARAMETER(Stage);
+
+    return STATUS_NOT_SUPPORTED;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+UsbHsDevice::StopPacketTransport(_In_ eDeviceType deviceType)
+{
+    PAGED_CODE();
+    UNREFERENCED_PARAMETER(deviceType);
+}
+
 //
 // Helper functions.
 //
@@ -4354,6 +4447,16 @@ Routine Description:
         DPF(D_ERROR, ("%!FUNC!: Number of endpoints on USB device not supported, 0x%x", ntStatus)),
         Done);
 
+    //
+    // A headset seen before (e.g. re-enumerated on dock/undock) gets its
+    // supported formats and custom minipairs from the adapter's cache.
+    //
+    ComputeCacheKey();
+    if (TakeCachedDiscovery())
+    {
+        DPF(D_VERBOSE, ("%!FUNC!: using cached discovery results, hash 0x%x", m_CacheHash));
+    }
+
     //
     // Get volume settings.
     //
@@ -4416,37 +4519,43 @@ Routine Description:
         }
 
         // Speaker Formats
-        PKSDATAFORMAT speakerFormatsArray[SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats)];
-        for (ULONG i = 0; i < SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats); i++)
-        {
-            speakerFormatsArray[i] = (PKSDATAFORMAT)(&UsbHsSpeakerSupportedDeviceFormats[i]);
-        }
-        SIDEBANDAUDIO_SUPPORTED_FORMATS speakerDeviceFormats =
+        if (m_pSpeakerSupportedFormatsIntersection == NULL)
         {
-            sizeof(SIDEBANDAUDIO_SUPPORTED_FORMATS),
-            m_SpeakerEpIndex,
-            SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats),
-            speakerFormatsArray
-        };
+            PKSDATAFORMAT speakerFormatsArray[SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats)];
+            for (ULONG i = 0; i < SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats); i++)
+            {
+                speakerFormatsArray[i] = (PKSDATAFORMAT)(&UsbHsSpeakerSupportedDeviceFormats[i]);
+            }
+            SIDEBANDAUDIO_SUPPORTED_FORMATS speakerDeviceFormats =
+            {
+                sizeof(SIDEBANDAUDIO_SUPPORTED_FORMATS),
+                m_SpeakerEpIndex,
+                SIZEOF_ARRAY(UsbHsSpeakerSupportedDeviceFormats),
+                speakerFormatsArray
+            };
 
-        ntStatus = GetUsbHsEndpointFormatsIntersection(&speakerDeviceFormats, &m_pSpeakerSupportedFormatsIntersection);
-        IF_FAILED_ACTION_JUMP(
-            ntStatus,
-            DPF(D_ERROR, ("%!FUNC!: GetUsbHsEndpointFormats: failed for speaker, 0x%x", ntStatus)),
-            Done);
+            ntStatus = GetUsbHsEndpointFormatsIntersection(&speakerDeviceFormats, &m_pSpeakerSupportedFormatsIntersection);
+            IF_FAILED_ACTION_JUMP(
+                ntStatus,
+                DPF(D_ERROR, ("%!FUNC!: GetUsbHsEndpointFormats: failed for speaker, 0x%x", ntStatus)),
+                Done);
+        }
 
         //
         // Customize the topology/wave descriptors for this instance
         //
-        ntStatus = CreateCustomEndpointMinipair(
-            g_UsbHsRenderEndpoints[0],
-            &m_pSpeakerDescriptor->FriendlyName,
-            &m_pSpeakerDescriptor->Category,
-            &m_SpeakerMiniports);
-        IF_FAILED_ACTION_JUMP(
-            ntStatus,
-            DPF(D_ERROR, ("%!FUNC!: CreateCustomEndpointMinipair for Render: failed, 0x%x", ntStatus)),
-            Done);
+        if (m_SpeakerMiniports == NULL)
+        {
+            ntStatus = CreateCustomEndpointMinipair(
+                g_UsbHsRenderEndpoints[0],
+                &m_pSpeakerDescriptor->FriendlyName,
+                &m_pSpeakerDescriptor->Category,
+                &m_SpeakerMiniports);
+            IF_FAILED_ACTION_JUMP(
+                ntStatus,
+                DPF(D_ERROR, ("%!FUNC!: CreateCustomEndpointMinipair for Render: failed, 0x%x", ntStatus)),
+                Done);
+        }
         m_SpeakerMiniports->TopoName = m_SpeakerTopologyNameBuffer;
         m_SpeakerMiniports->WaveName = m_SpeakerWaveNameBuffer;
 
@@ -4554,34 +4663,40 @@ Routine Description:
         }
 
         // Mic Formats
-        PKSDATAFORMAT micFormatsArray[SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats)];
-        for (ULONG i = 0; i < SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats); i++)
-        {
-            micFormatsArray[i] = (PKSDATAFORMAT)(&UsbHsMicSupportedDeviceFormats[i]);
-        }
-        SIDEBANDAUDIO_SUPPORTED_FORMATS micDeviceFormats =
+        if (m_pMicSupportedFormatsIntersection == NULL)
         {
-            sizeof(SIDEBANDAUDIO_SUPPORTED_FORMATS),
-            m_MicEpIndex,
-            SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats),
-            micFormatsArray
-        };
+            PKSDATAFORMAT micFormatsArray[SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats)];
+            for (ULONG i = 0; i < SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats); i++)
+            {
+                micFormatsArray[i] = (PKSDATAFORMAT)(&UsbHsMicSupportedDeviceFormats[i]);
+            }
+            SIDEBANDAUDIO_SUPPORTED_FORMATS micDeviceFormats =
+            {
+                sizeof(SIDEBANDAUDIO_SUPPORTED_FORMATS),
+                m_MicEpIndex,
+                SIZEOF_ARRAY(UsbHsMicSupportedDeviceFormats),
+                micFormatsArray
+            };
 
-        ntStatus = GetUsbHsEndpointFormatsIntersection(&micDeviceFormats, &m_pMicSupportedFormatsIntersection);
-        IF_FAILED_ACTION_JUMP(
-            ntStatus,
-            DPF(D_ERROR, ("%!FUNC!: GetUsbHsEndpointFormats: failed for mic, 0x%x", ntStatus)),
-            Done);
+            ntStatus = GetUsbHsEndpointFormatsIntersection(&micDeviceFormats, &m_pMicSupportedFormatsIntersection);
+            IF_FAILED_ACTION_JUMP(
+                ntStatus,
+                DPF(D_ERROR, ("%!FUNC!: GetUsbHsEndpointFormats: failed for mic, 0x%x", ntStatus)),
+                Done);
+        }
 
-        ntStatus = CreateCustomEndpointMinipair(
-            g_UsbHsCaptureEndpoints[0],
-            &m_pMicDescriptor->FriendlyName,
-            &m_pMicDescriptor->Category,
-            &m_MicMiniports);
-        IF_FAILED_ACTION_JUMP(
-            ntStatus,
-            DPF(D_ERROR, ("%!FUNC!: CreateCustomEndpointMinipair for Capture: failed, 0x%x", ntStatus)),
-            Done);
+        if (m_MicMiniports == NULL)
+        {
+            ntStatus = CreateCustomEndpointMinipair(
+                g_UsbHsCaptureEndpoints[0],
+                &m_pMicDescriptor->FriendlyName,
+                &m_pMicDescriptor->Category,
+                &m_MicMiniports);
+            IF_FAILED_ACTION_JUMP(
+                ntStatus,
+                DPF(D_ERROR, ("%!FUNC!: CreateCustomEndpointMinipair for Capture: failed, 0x%x", ntStatus)),
+                Done);
+        }
         m_MicMiniports->TopoName = m_MicTopologyNameBuffer;
         m_MicMiniports->WaveName = m_MicWaveNameBuffer;
 
@@ -4651,6 +4766,13 @@ Routine Description:
         DPF(D_ERROR, ("%!FUNC!: SetSidebandClaimed TRUE: failed, 0x%x", ntStatus)),
         Done);
 
+    //
+    // The discovery results are known good, keep them when the device goes away.
+    //
+    m_CacheDiscovery = TRUE;
+
+    DPF(D_VERBOSE, ("%!FUNC!: %wZ started %I64d us after arrival", &m_SymbolicLinkName, SidebandElapsedUs(m_ArrivalQpc)));
+
     //
     // All done.
     //
@@ -4851,6 +4973,243 @@ UsbHsDevice::DeleteCustomEndpointMinipair
     }
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+UsbHsDevice::DeleteCacheEntry
+(
+    _In_        PUSBHS_CACHE_ENTRY Entry
+)
+{
+    PAGED_CODE();
+
+    DeleteCustomEndpointMinipair(Entry->SpeakerMiniports);
+    DeleteCustomEndpointMinipair(Entry->MicMiniports);
+
+    SAFE_DELETE_PTR_WITH_TAG(Entry->SpeakerSupportedFormatsIntersection, USBSIDEBANDTEST_POOLTAG03);
+    SAFE_DELETE_PTR_WITH_TAG(Entry->MicSupportedFormatsIntersection, USBSIDEBANDTEST_POOLTAG03);
+
+    SAFE_DELETE_PTR_WITH_TAG(Entry->SpeakerDescriptor, MINADAPTER_POOLTAG);
+    SAFE_DELETE_PTR_WITH_TAG(Entry->MicDescriptor, MINADAPTER_POOLTAG);
+
+    ExFreePoolWithTag(Entry, USBSIDEBANDTEST_POOLTAG017);
+}
+
+//
+// FNV-1a, folded over the descriptor fields that identify a headset.
+//
+#define USBHS_CACHE_HASH_SEED   2166136261UL
+#define USBHS_CACHE_HASH_PRIME  16777619UL
+
+#pragma code_seg("PAGE")
+static
+ULONG
+UsbHsCacheHash
+(
+    _In_                    ULONG       Hash,
+    _In_reads_bytes_(Size)  const VOID  *Data,
+    _In_                    ULONG       Size
+)
+{
+    PAGED_CODE();
+
+    const BYTE * bytes = (const BYTE *)Data;
+
+    for (ULONG i = 0; i < Size; i++)
+    {
+        Hash ^= bytes[i];
+        Hash *= USBHS_CACHE_HASH_PRIME;
+    }
+
+    return Hash;
+}
+
+#pragma code_seg("PAGE")
+static
+ULONG
+UsbHsCacheHashEndpoint
+(
+    _In_        ULONG                               Hash,
+    _In_        ULONG                               EpIndex,
+    _In_opt_    PSIDEBANDAUDIO_ENDPOINT_DESCRIPTOR2 Descriptor
+)
+{
+    PAGED_CODE();
+
+    if (Descriptor == NULL)
+    {
+        return UsbHsCacheHash(Hash, &Descriptor, sizeof(Descriptor));
+    }
+
+    //
+    // Only the fields by value: the friendly name buffer is hashed by content
+    // since its address differs from one arrival to the next.
+    //
+    Hash = UsbHsCacheHash(Hash, &EpIndex, sizeof(EpIndex));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->Direction, sizeof(Descriptor->Direction));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->Category, sizeof(Descriptor->Category));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->ContainerId, sizeof(Descriptor->ContainerId));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->Capabilities, sizeof(Descriptor->Capabilities));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->VolumePropertyValuesSize, sizeof(Descriptor->VolumePropertyValuesSize));
+    Hash = UsbHsCacheHash(Hash, &Descriptor->MutePropertyValuesSize, sizeof(Descriptor->MutePropertyValuesSize));
+    Hash = UsbHsCacheHash(Hash, Descriptor->FriendlyName.Buffer, Descriptor->FriendlyName.Length);
+
+    return Hash;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+UsbHsDevice::ComputeCacheKey()
+/*++
+
+Routine Description:
+
+  Computes the discovery cache key from the device and endpoint descriptors
+  retrieved by Start.
+
+--*/
+{
+    PAGED_CODE();
+
+    ULONG hash = USBHS_CACHE_HASH_SEED;
+
+    ASSERT(m_Descriptor != NULL);
+
+    hash = UsbHsCacheHash(hash, &m_Descriptor->NumberOfEndpoints, sizeof(m_Descriptor->NumberOfEndpoints));
+    hash = UsbHsCacheHashEndpoint(hash, m_SpeakerEpIndex, m_pSpeakerDescriptor);
+    hash = UsbHsCacheHashEndpoint(hash, m_MicEpIndex, m_pMicDescriptor);
+
+    if (m_pSpeakerDescriptor != NULL)
+    {
+        m_CacheContainerId = m_pSpeakerDescriptor->ContainerId;
+    }
+    else if (m_pMicDescriptor != NULL)
+    {
+        m_CacheContainerId = m_pMicDescriptor->ContainerId;
+    }
+
+    m_CacheHash = hash;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+BOOL
+UsbHsDevice::TakeCachedDiscovery()
+/*++
+
+Routine Description:
+
+  Adopts the adapter's cached discovery results for this headset, if any.
+  The cached endpoint descriptors replace the ones just retrieved since the
+  cached minipairs point into them.
+
+Return Value:
+
+  TRUE if the cached results were adopted.
+
+--*/
+{
+    PAGED_CODE();
+
+    PUSBHS_CACHE_ENTRY entry = NULL;
+
+    entry = m_Adapter->UsbSidebandCacheTake(&m_CacheContainerId, m_CacheHash);
+    if (entry == NULL)
+    {
+        return FALSE;
+    }
+
+    //
+    // The endpoint layout is part of the hash; this only guards a collision.
+    //
+    if ((entry->SpeakerDescriptor == NULL) != (m_pSpeakerDescriptor == NULL) ||
+        (entry->MicDescriptor == NULL) != (m_pMicDescriptor == NULL))
+    {
+        DPF(D_ERROR, ("%!FUNC!: cached entry does not match the device endpoints, discarding it"));
+        DeleteCacheEntry(entry);
+        return FALSE;
+    }
+
+    ASSERT(m_pSpeakerSupportedFormatsIntersection == NULL && m_SpeakerMiniports == NULL);
+    ASSERT(m_pMicSupportedFormatsIntersection == NULL && m_MicMiniports == NULL);
+
+    if (m_pSpeakerDescriptor != NULL)
+    {
+        ExFreePoolWithTag(m_pSpeakerDescriptor, MINADAPTER_POOLTAG);
+        m_pSpeakerDescriptor = entry->SpeakerDescriptor;
+        m_pSpeakerSupportedFormatsIntersection = entry->SpeakerSupportedFormatsIntersection;
+        m_SpeakerMiniports = entry->SpeakerMiniports;
+    }
+
+    if (m_pMicDescriptor != NULL)
+    {
+        ExFreePoolWithTag(m_pMicDescriptor, MINADAPTER_POOLTAG);
+        m_pMicDescriptor = entry->MicDescriptor;
+        m_pMicSupportedFormatsIntersection = entry->MicSupportedFormatsIntersection;
+        m_MicMiniports = entry->MicMiniports;
+    }
+
+    ExFreePoolWithTag(entry, USBSIDEBANDTEST_POOLTAG017);
+
+    return TRUE;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+UsbHsDevice::StoreCachedDiscovery()
+/*++
+
+Routine Description:
+
+  Hands the discovery results of a device that started successfully over to
+  the adapter's cache. On success the cached members are set to NULL.
+
+--*/
+{
+    PAGED_CODE();
+
+    PUSBHS_CACHE_ENTRY  entry = NULL;
+    NTSTATUS            ntStatus = STATUS_SUCCESS;
+
+    if (!m_CacheDiscovery)
+    {
+        return;
+    }
+
+    entry = (PUSBHS_CACHE_ENTRY)ExAllocatePool2(POOL_FLAG_NON_PAGED, sizeof(USBHS_CACHE_ENTRY), USBSIDEBANDTEST_POOLTAG017);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    InitializeListHead(&entry->ListEntry);
+    entry->ContainerId                          = m_CacheContainerId;
+    entry->Hash                                 = m_CacheHash;
+    entry->SpeakerDescriptor                    = m_pSpeakerDescriptor;
+    entry->SpeakerSupportedFormatsIntersection  = m_pSpeakerSupportedFormatsIntersection;
+    entry->SpeakerMiniports                     = m_SpeakerMiniports;
+    entry->MicDescriptor                        = m_pMicDescriptor;
+    entry->MicSupportedFormatsIntersection      = m_pMicSupportedFormatsIntersection;
+    entry->MicMiniports                         = m_MicMiniports;
+
+    ntStatus = m_Adapter->UsbSidebandCacheStore(entry);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        ExFreePoolWithTag(entry, USBSIDEBANDTEST_POOLTAG017);
+        return;
+    }
+
+    m_pSpeakerDescriptor                    = NULL;
+    m_pSpeakerSupportedFormatsIntersection  = NULL;
+    m_SpeakerMiniports                      = NULL;
+    m_pMicDescriptor                        = NULL;
+    m_pMicSupportedFormatsIntersection      = NULL;
+    m_MicMiniports                          = NULL;
+    m_CacheDiscovery                        = FALSE;
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 VOID 
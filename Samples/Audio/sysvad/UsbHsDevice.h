@@ -108,6 +108,28 @@ typedef struct _USBHSDEVICE_EP_TRANSPORT_RESOURCES
     PUSB_ENDPOINT_DESCRIPTOR                        pSyncUsbEndpointDescriptor;
 }USBHSDEVICE_EP_TRANSPORT_RESOURCES, *PUSBHSDEVICE_EP_TRANSPORT_RESOURCES;
 
+//
+// Discovery results of a departed USB Sideband device. The adapter keeps a
+// few of these so that the re-arrival of the same headset (same container id
+// and descriptor hash) skips the supported formats IOCTLs and the build of
+// its custom minipairs. The minipairs point into the endpoint descriptors
+// (friendly name, category), so the descriptors are cached along with them.
+//
+#define USBHS_CACHE_MAX_ENTRIES     4
+
+typedef struct _USBHS_CACHE_ENTRY
+{
+    LIST_ENTRY                              ListEntry;
+    GUID                                    ContainerId;
+    ULONG                                   Hash;
+    PSIDEBANDAUDIO_ENDPOINT_DESCRIPTOR2     SpeakerDescriptor;
+    PSIDEBANDAUDIO_SUPPORTED_FORMATS        SpeakerSupportedFormatsIntersection;
+    PENDPOINT_MINIPAIR                      SpeakerMiniports;
+    PSIDEBANDAUDIO_ENDPOINT_DESCRIPTOR2     MicDescriptor;
+    PSIDEBANDAUDIO_SUPPORTED_FORMATS        MicSupportedFormatsIntersection;
+    PENDPOINT_MINIPAIR                      MicMiniports;
+} USBHS_CACHE_ENTRY, *PUSBHS_CACHE_ENTRY;
+
 #endif // SYSVAD_USB_SIDEBAND
 class UsbHsDevice : 
     ISidebandDeviceCommon,
@@ -118,6 +140,9 @@ class UsbHsDevice :
             
         IAdapterCommon        * m_Adapter;
         WDFIOTARGET             m_WdfIoTarget;
+
+        LARGE_INTEGER           m_ArrivalQpc;       // When the interface arrived.
+        LONG                    m_FirstStreamTraced;
         
         LIST_ENTRY              m_ListEntry;
         UNICODE_STRING          m_SymbolicLinkName;
@@ -192,6 +217,14 @@ class UsbHsDevice :
         PSIDEBANDAUDIO_SUPPORTED_FORMATS        m_pMicSupportedFormatsIntersection;
         ULONG                                   m_MicSelectedFormat;
 
+        //
+        // Key of the discovery cache, and whether the discovery results are
+        // complete enough to be handed to the adapter's cache on teardown.
+        //
+        GUID                                    m_CacheContainerId;
+        ULONG                                   m_CacheHash;
+        BOOL                                    m_CacheDiscovery;
+
         USBHSDEVICE_EP_TRANSPORT_RESOURCES      m_SpeakerTransportResources;
         USBHSDEVICE_EP_TRANSPORT_RESOURCES      m_MicTransportResources;
 
@@ -379,6 +412,33 @@ class UsbHsDevice :
         
         STDMETHODIMP_(BOOL)                 GetNRECDisableStatus();
 
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(BOOL)                 IsEncodingOffloaded(_In_ eDeviceType deviceType);
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(NTSTATUS)             SendPacket
+        (
+            _In_        eDeviceType             deviceType,
+            _In_reads_bytes_(Length) const BYTE *Packet,
+            _In_        ULONG                   Length
+        );
+
+        _IRQL_requires_max_(DISPATCH_LEVEL)
+        STDMETHODIMP_(NTSTATUS)             ReceivePacket
+        (
+            _In_        eDeviceType             deviceType,
+            _Out_writes_bytes_(Length) BYTE     *Packet,
+            _In_        ULONG                   Length
+        );
+
+        STDMETHODIMP_(NTSTATUS)             StartPacketTransport
+        (
+            _In_        eDeviceType             deviceType,
+            _In_        A2DP_SBC_STAGE          *Stage
+        );
+
+        STDMETHODIMP_(VOID)                 StopPacketTransport(_In_ eDeviceType deviceType);
+
     private:
         //=====================================================================
         //
@@ -564,6 +624,18 @@ class UsbHsDevice :
             _In_        PENDPOINT_MINIPAIR CustomMinipair
         );
 
+        static
+        VOID        DeleteCacheEntry
+        (
+            _In_        PUSBHS_CACHE_ENTRY  Entry
+        );
+
+        VOID        ComputeCacheKey();
+
+        BOOL        TakeCachedDiscovery();
+
+        VOID        StoreCachedDiscovery();
+
         NTSTATUS    SetSidebandClaimed(_In_ BOOL bClaimed);
         
         NTSTATUS    SpeakerStreamOpen();
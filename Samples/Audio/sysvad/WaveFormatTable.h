@@ -0,0 +1,206 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    WaveFormatTable.h
+
+Abstract:
+
+    Compact declaration of the device format tables of the wave miniports.
+
+    A table is declared as a list of groups. A group names one subformat
+    and the channel layouts, sample depths and sample rates it supports;
+    it stands for every combination of them. The table is expanded at
+    compile time into the KSDATAFORMAT_WAVEFORMATEXTENSIBLE array that
+    PIN_DEVICE_FORMATS_AND_MODES points to, with the block alignment and
+    byte rate of each entry derived from its layout, depth and rate.
+
+--*/
+
+#ifndef _SYSVAD_WAVEFORMATTABLE_H_
+#define _SYSVAD_WAVEFORMATTABLE_H_
+
+typedef struct _WAVEFORMAT_LAYOUT
+{
+    WORD        Channels;
+    DWORD       ChannelMask;
+} WAVEFORMAT_LAYOUT;
+
+typedef struct _WAVEFORMAT_DEPTH
+{
+    WORD        BitsPerSample;          // container size
+    WORD        ValidBitsPerSample;
+} WAVEFORMAT_DEPTH;
+
+//
+// A group expands to LayoutCount * DepthCount * RateCount formats, layouts
+// outermost and rates innermost, each list in the order it is written.
+//
+typedef struct _WAVEFORMAT_GROUP
+{
+    GUID                        SubFormat;
+    const WAVEFORMAT_LAYOUT *   Layouts;
+    ULONG                       LayoutCount;
+    const WAVEFORMAT_DEPTH *    Depths;
+    ULONG                       DepthCount;
+    const DWORD *               Rates;
+    ULONG                       RateCount;
+} WAVEFORMAT_GROUP;
+
+#define WAVEFORMAT_LIST(List)   List, SIZEOF_ARRAY(List)
+
+template <ULONG Count>
+struct WAVEFORMAT_TABLE
+{
+    KSDATAFORMAT_WAVEFORMATEXTENSIBLE   Formats[Count];
+};
+
+//
+// Accessors for the fields of PIN_DEVICE_FORMATS_AND_MODES and
+// MODE_AND_DEFAULT_FORMAT, which predate the tables being read-only.
+//
+#define WAVEFORMAT_TABLE_FORMATS(Table) \
+    const_cast<PKSDATAFORMAT_WAVEFORMATEXTENSIBLE>((Table).Formats)
+
+#define WAVEFORMAT_TABLE_COUNT(Table) \
+    SIZEOF_ARRAY((Table).Formats)
+
+#define WAVEFORMAT_TABLE_FORMAT(Table, Index) \
+    const_cast<PKSDATAFORMAT>(&(Table).Formats[Index].DataFormat)
+
+constexpr
+ULONG
+WaveFormatGroupCount
+(
+    _In_ const WAVEFORMAT_GROUP & Group
+)
+{
+    return Group.LayoutCount * Group.DepthCount * Group.RateCount;
+}
+
+constexpr
+ULONG
+WaveFormatTableCount
+(
+    _In_reads_(GroupCount) const WAVEFORMAT_GROUP * Groups,
+    _In_ ULONG GroupCount
+)
+{
+    ULONG count = 0;
+
+    for (ULONG i = 0; i < GroupCount; i++)
+    {
+        count += WaveFormatGroupCount(Groups[i]);
+    }
+
+    return count;
+}
+
+constexpr
+KSDATAFORMAT_WAVEFORMATEXTENSIBLE
+WaveFormatFromGroup
+(
+    _In_ const WAVEFORMAT_GROUP & Group,
+    _In_ ULONG Index
+)
+{
+    const WAVEFORMAT_LAYOUT & layout = Group.Layouts[Index / (Group.DepthCount * Group.RateCount)];
+    const WAVEFORMAT_DEPTH &  depth  = Group.Depths[(Index / Group.RateCount) % Group.DepthCount];
+    const DWORD               rate   = Group.Rates[Index % Group.RateCount];
+    const WORD                blockAlign = (WORD)(layout.Channels * depth.BitsPerSample / 8);
+
+    return
+    {
+        {
+            sizeof(KSDATAFORMAT_WAVEFORMATEXTENSIBLE),
+            0,
+            0,
+            0,
+            STATICGUIDOF(KSDATAFORMAT_TYPE_AUDIO),
+            Group.SubFormat,
+            STATICGUIDOF(KSDATAFORMAT_SPECIFIER_WAVEFORMATEX)
+        },
+        {
+            {
+                WAVE_FORMAT_EXTENSIBLE,
+                layout.Channels,
+                rate,
+                rate * blockAlign,
+                blockAlign,
+                depth.BitsPerSample,
+                sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX)
+            },
+            depth.ValidBitsPerSample,
+            layout.ChannelMask,
+            Group.SubFormat
+        }
+    };
+}
+
+constexpr
+KSDATAFORMAT_WAVEFORMATEXTENSIBLE
+WaveFormatFromGroups
+(
+    _In_ const WAVEFORMAT_GROUP * Groups,
+    _In_ ULONG Index
+)
+{
+    ULONG group = 0;
+
+    while (Index >= WaveFormatGroupCount(Groups[group]))
+    {
+        Index -= WaveFormatGroupCount(Groups[group]);
+        group++;
+    }
+
+    return WaveFormatFromGroup(Groups[group], Index);
+}
+
+//
+// Compile-time sequence 0 .. Count-1 to expand a table entry by entry.
+//
+template <ULONG... Index>
+struct WAVEFORMAT_INDICES
+{
+};
+
+template <ULONG Count, ULONG... Index>
+struct WAVEFORMAT_MAKE_INDICES : WAVEFORMAT_MAKE_INDICES<Count - 1, Count - 1, Index...>
+{
+};
+
+template <ULONG... Index>
+struct WAVEFORMAT_MAKE_INDICES<0, Index...>
+{
+    typedef WAVEFORMAT_INDICES<Index...> Type;
+};
+
+template <ULONG Count, ULONG... Index>
+constexpr
+WAVEFORMAT_TABLE<Count>
+WaveFormatExpandTable
+(
+    _In_ const WAVEFORMAT_GROUP * Groups,
+    _In_ WAVEFORMAT_INDICES<Index...>
+)
+{
+    return { { WaveFormatFromGroups(Groups, Index)... } };
+}
+
+//
+// Declares Name as the expansion of the static constexpr WAVEFORMAT_GROUP
+// array Groups. Being constexpr, the table is built by the compiler and
+// lands in read-only data; nothing is left to run at driver load.
+//
+#define WAVEFORMAT_TABLE_COUNT_OF_GROUPS(Groups) \
+    WaveFormatTableCount(Groups, SIZEOF_ARRAY(Groups))
+
+#define DECLARE_WAVEFORMAT_TABLE(Name, Groups)                                          \
+    static constexpr WAVEFORMAT_TABLE<WAVEFORMAT_TABLE_COUNT_OF_GROUPS(Groups)> Name =  \
+        WaveFormatExpandTable<WAVEFORMAT_TABLE_COUNT_OF_GROUPS(Groups)>(                \
+            Groups,                                                                     \
+            WAVEFORMAT_MAKE_INDICES<WAVEFORMAT_TABLE_COUNT_OF_GROUPS(Groups)>::Type())
+
+#endif // _SYSVAD_WAVEFORMATTABLE_H_
@@ -251,6 +251,20 @@ DRIVER_DISPATCH PnpHandler;
 //
 DWORD g_DoNotCreateDataFiles = 1;  // default is off.
 DWORD g_DisableToneGenerator = 0;  // default is to generate tones.
+
+//
+// Keyword pre-roll kept by the keyword detector, in milliseconds. Use the
+// registry value KeywordHistoryMs (DWORD) to override; it is clamped to
+// [1000, 10000].
+//
+DWORD g_KeywordHistoryMs = 1000;
+
+//
+// Minimum time between two bursts of audio module change notifications, in
+// milliseconds. Use the registry value AudioModuleNotificationIntervalMs
+// (DWORD) to override; 0 sends every change as it happens.
+//
+DWORD g_AudioModuleNotificationIntervalMs = 50;
 UNICODE_STRING g_RegistryPath;      // This is used to store the registry settings path for the driver
 
 
@@ -261,6 +275,14 @@ UNICODE_STRING g_RegistryPath;      // This is used to store the registry settin
 // this default.
 //
 DWORD g_DisableBthScoBypass = 0;   // default is SCO bypass enabled.
+
+//
+// Platforms without SCO bypass encode HFP audio in the driver. With
+// DisableBthScoBypass set, use the registry value BthHfpSoftwareCodec
+// (DWORD) > 0 to keep the HFP endpoints and run their streams through the
+// in-driver CVSD/mSBC codec stage.
+//
+DWORD g_BthHfpSoftwareCodec = 0;   // default is no software codec.
 #endif // SYSVAD_BTH_BYPASS
 
 #ifdef SYSVAD_USB_SIDEBAND
@@ -279,6 +301,20 @@ DWORD g_DisableUsbSideband = 0;   // default is USB bypass enabled.
 // this default.
 //
 DWORD g_DisableA2dpSideband = 0; // default is A2DP bypass enabled.
+
+//
+// Links without a sideband controller encoding A2DP need the SBC encoder
+// in the driver. Use the registry value A2dpSoftwareEncoder (DWORD) > 0 to
+// encode the A2DP speaker stream in the driver.
+//
+DWORD g_A2dpSoftwareEncoder = 0; // default is no software encoder.
+
+//
+// With A2dpSoftwareEncoder set, the registry value A2dpLinkRate (DWORD) is
+// the rate in kbps the sample's stand-in link takes the encoded packets at;
+// a lower rate makes the encoder's bitpool back off.
+//
+DWORD g_A2dpLinkRate = 0; // default is no limit.
 #endif
 
 //-----------------------------------------------------------------------------
@@ -431,12 +467,19 @@ Returns:
     // QueryRoutine     Flags                                               Name                     EntryContext             DefaultType                                                    DefaultData              DefaultLength
         { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"DoNotCreateDataFiles", &g_DoNotCreateDataFiles, (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_DoNotCreateDataFiles, sizeof(ULONG)},
         { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"DisableToneGenerator", &g_DisableToneGenerator, (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_DisableToneGenerator, sizeof(ULONG)},
+        { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"KeywordHistoryMs",     &g_KeywordHistoryMs,     (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_KeywordHistoryMs,     sizeof(ULONG)},
+        { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"AudioModuleNotificationIntervalMs", &g_AudioModuleNotificationIntervalMs, (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_AudioModuleNotificationIntervalMs, sizeof(ULONG)},
 #ifdef SYSVAD_BTH_BYPASS
         { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"DisableBthScoBypass",  &g_DisableBthScoBypass,  (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_DisableBthScoBypass,  sizeof(ULONG)},
+        { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"BthHfpSoftwareCodec",  &g_BthHfpSoftwareCodec,  (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_BthHfpSoftwareCodec,  sizeof(ULONG)},
 #endif // SYSVAD_BTH_BYPASS
 #ifdef SYSVAD_USB_SIDEBAND
         { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"DisableUsbSideband",  &g_DisableUsbSideband,  (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_DisableUsbSideband,  sizeof(ULONG)},
 #endif // SYSVAD_USB_SIDEBAND
+#ifdef SYSVAD_A2DP_SIDEBAND
+        { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"A2dpSoftwareEncoder",  &g_A2dpSoftwareEncoder,  (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_A2dpSoftwareEncoder,  sizeof(ULONG)},
+        { NULL,   RTL_QUERY_REGISTRY_DIRECT | RTL_QUERY_REGISTRY_TYPECHECK, L"A2dpLinkRate",  &g_A2dpLinkRate,  (REG_DWORD << RTL_QUERY_REGISTRY_TYPECHECK_SHIFT) | REG_DWORD, &g_A2dpLinkRate,  sizeof(ULONG)},
+#endif // SYSVAD_A2DP_SIDEBAND
         { NULL,   0,                                                        NULL,                    NULL,                    0,                                                             NULL,                    0}
     };
 
@@ -477,12 +520,19 @@ Returns:
     //
     DPF(D_VERBOSE, ("DoNotCreateDataFiles: %u", g_DoNotCreateDataFiles));
     DPF(D_VERBOSE, ("DisableToneGenerator: %u", g_DisableToneGenerator));
+    DPF(D_VERBOSE, ("KeywordHistoryMs: %u", g_KeywordHistoryMs));
+    DPF(D_VERBOSE, ("AudioModuleNotificationIntervalMs: %u", g_AudioModuleNotificationIntervalMs));
 #ifdef SYSVAD_BTH_BYPASS
     DPF(D_VERBOSE, ("DisableBthScoBypass: %u", g_DisableBthScoBypass));
+    DPF(D_VERBOSE, ("BthHfpSoftwareCodec: %u", g_BthHfpSoftwareCodec));
 #endif // SYSVAD_BTH_BYPASS
 #ifdef SYSVAD_USB_SIDEBAND
     DPF(D_VERBOSE, ("DisableUsbSideband: %u", g_DisableUsbSideband));
 #endif // SYSVAD_USB_SIDEBAND
+#ifdef SYSVAD_A2DP_SIDEBAND
+    DPF(D_VERBOSE, ("A2dpSoftwareEncoder: %u", g_A2dpSoftwareEncoder));
+    DPF(D_VERBOSE, ("A2dpLinkRate: %u", g_A2dpLinkRate));
+#endif // SYSVAD_A2DP_SIDEBAND
 
     if (DriverKey)
     {
@@ -920,6 +970,45 @@ Exit:
     return ntStatus;
 }
 
+#pragma code_seg("PAGE")
+NTSTATUS 
+PrepareAllFilters(
+    _In_ PIRP           _pIrp, 
+    _In_ PADAPTERCOMMON _pAdapterCommon
+    )
+/*++
+
+Routine Description:
+
+  Prepares the subdevices of all the render and capture endpoints. Their
+  ports and miniports are created concurrently, then registered one at a
+  time. InstallAllRenderFilters and InstallAllCaptureFilters then find
+  them in the subdevice cache and connect them one endpoint at a time.
+
+--*/
+{
+    NTSTATUS            ntStatus;
+    PENDPOINT_MINIPAIR* ppAeMiniports   = NULL;
+    ULONG               cAeMiniports    = (ULONG)(g_cRenderEndpoints + g_cCaptureEndpoints);
+    
+    PAGED_CODE();
+
+    ppAeMiniports = (PENDPOINT_MINIPAIR*)ExAllocatePool2(POOL_FLAG_PAGED, cAeMiniports * sizeof(PENDPOINT_MINIPAIR), MINADAPTER_POOLTAG);
+    if (ppAeMiniports == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlCopyMemory(ppAeMiniports, g_RenderEndpoints, g_cRenderEndpoints * sizeof(PENDPOINT_MINIPAIR));
+    RtlCopyMemory(ppAeMiniports + g_cRenderEndpoints, g_CaptureEndpoints, g_cCaptureEndpoints * sizeof(PENDPOINT_MINIPAIR));
+
+    ntStatus = _pAdapterCommon->PrepareEndpointFilters(_pIrp, cAeMiniports, ppAeMiniports);
+
+    ExFreePoolWithTag(ppAeMiniports, MINADAPTER_POOLTAG);
+
+    return ntStatus;
+}
+
 #ifdef _USE_SingleComponentMultiFxStates
 //=============================================================================
 #pragma code_seg("PAGE")
@@ -1077,6 +1166,17 @@ Return Value:
     ntStatus = PcRegisterAdapterPowerManagement( PUNKNOWN(pAdapterCommon), DeviceObject);
     IF_FAILED_JUMP(ntStatus, Exit);
 
+    //
+    // Create the wave and topology subdevices of all the endpoints in
+    // parallel. This is only an optimization, the install loops below
+    // create anything that failed here and report the error.
+    //
+    ntStatus = PrepareAllFilters(Irp, pAdapterCommon);
+    if (!NT_SUCCESS(ntStatus))
+    {
+        DPF(D_TERSE, ("PrepareAllFilters failed, 0x%x", ntStatus));
+    }
+
     //
     // Install wave+topology filters for render devices
     //
@@ -1090,10 +1190,12 @@ Return Value:
     IF_FAILED_JUMP(ntStatus, Exit);
 
 #ifdef SYSVAD_BTH_BYPASS
-    if (!g_DisableBthScoBypass)
+    if (!g_DisableBthScoBypass || g_BthHfpSoftwareCodec)
     {
         //
-        // Init infrastructure for Bluetooth HFP - SCO Bypass devices.
+        // Init infrastructure for Bluetooth HFP - SCO Bypass devices. Without
+        // bypass the interface still carries the call control, and the
+        // driver encodes the audio.
         //
         ntStatus = pAdapterCommon->InitBthScoBypass();
         IF_FAILED_JUMP(ntStatus, Exit);
@@ -18,6 +18,7 @@ Abstract:
 
 #include <sysvad.h>
 #include "basetopo.h"
+#include "SysVadShared.h"
 
 //=============================================================================
 #pragma code_seg("PAGE")
@@ -273,6 +274,33 @@ Return Value:
 
     NTSTATUS                    ntStatus = STATUS_INVALID_DEVICE_REQUEST;
 
+    if (IsEqualGUIDAligned(*PropertyRequest->PropertyItem->Set, KSPROPSETID_SysVAD))
+    {
+        switch (PropertyRequest->PropertyItem->Id)
+        {
+            case KSPROPERTY_SYSVAD_VOLUMEVECTOR:
+                ntStatus = PropertyHandler_MixerVector(
+                                    m_AdapterCommon,
+                                    PropertyRequest,
+                                    m_DeviceMaxChannels,
+                                    eMixerVolume);
+                break;
+
+            case KSPROPERTY_SYSVAD_MUTEVECTOR:
+                ntStatus = PropertyHandler_MixerVector(
+                                    m_AdapterCommon,
+                                    PropertyRequest,
+                                    m_DeviceMaxChannels,
+                                    eMixerMute);
+                break;
+
+            default:
+                DPF(D_TERSE, ("[PropertyHandlerGeneric: Invalid Device Request]"));
+        }
+
+        return ntStatus;
+    }
+
     switch (PropertyRequest->PropertyItem->Id)
     {
         case KSPROPERTY_AUDIO_VOLUMELEVEL:
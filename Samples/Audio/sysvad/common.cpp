@@ -54,6 +54,36 @@ PDEVICE_OBJECT          CSaveData::m_pDeviceObject = NULL;
 //=============================================================================
 // Classes
 //=============================================================================
+class CAdapterCommon;   // Forward declaration.
+
+//
+// One subdevice prepared by PrepareEndpointFilters. The port and miniport
+// are created on a work-item; the port is initialized and registered on
+// the start thread.
+//
+typedef struct _SUBDEVICE_INSTALL_JOB
+{
+    CAdapterCommon *        Adapter;
+    PENDPOINT_MINIPAIR      MiniportPair;
+    BOOL                    Wave;               // wave subdevice, else topology
+    WDFWORKITEM             WorkItem;
+    PPORT                   Port;
+    PUNKNOWN                Miniport;
+    NTSTATUS                Status;
+    LONGLONG                Elapsed;            // performance counter ticks
+} SUBDEVICE_INSTALL_JOB;
+
+struct SubdeviceInstallWorkItemContext
+{
+    SUBDEVICE_INSTALL_JOB * Job;
+};
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME
+(
+    SubdeviceInstallWorkItemContext,
+    GetSubdeviceInstallWorkItemContext
+)
+
 #ifdef SYSVAD_BTH_BYPASS
 class BthHfpDevice;     // Forward declaration.
 #endif // SYSVAD_BTH_BYPASS
@@ -188,6 +218,32 @@ class CAdapterCommon :
             _In_  ULONG           Channel
         );
 
+        STDMETHODIMP_(VOID)     MixerRegistersRead
+        (
+            _In_  MIXER_REGISTER_BANK Bank,
+            _In_  ULONG           Index,
+            _In_  ULONG           FirstChannel,
+            _In_  ULONG           ChannelCount,
+            _Out_writes_(ChannelCount) PLONG Values
+        );
+
+        STDMETHODIMP_(BOOL)     MixerRegistersWrite
+        (
+            _In_  MIXER_REGISTER_BANK Bank,
+            _In_  ULONG           Index,
+            _In_  ULONG           FirstChannel,
+            _In_  ULONG           ChannelCount,
+            _In_reads_(ChannelCount) const LONG * Values
+        );
+
+        STDMETHODIMP_(BOOL)     MixerRegistersFill
+        (
+            _In_  MIXER_REGISTER_BANK Bank,
+            _In_  ULONG           Index,
+            _In_  ULONG           ChannelCount,
+            _In_  LONG            Value
+        );
+
         STDMETHODIMP_(NTSTATUS) WriteEtwEvent 
         ( 
             _In_ EPcMiniportEngineEvent    miniportEventType,
@@ -252,6 +308,13 @@ class CAdapterCommon :
             _Out_opt_   PUNKNOWN *          UnknownMiniportTopology,
             _Out_opt_   PUNKNOWN *          UnknownMiniportWave
         );
+
+        STDMETHODIMP_(NTSTATUS) PrepareEndpointFilters
+        (
+            _In_opt_    PIRP                Irp,
+            _In_        ULONG               MiniportPairCount,
+            _In_reads_(MiniportPairCount) PENDPOINT_MINIPAIR * MiniportPairs
+        );
         
         STDMETHODIMP_(NTSTATUS) RemoveEndpointFilters
         (
@@ -305,6 +368,17 @@ class CAdapterCommon :
         (
             _In_ PDEVICE_OBJECT     pdo
         );
+
+        STDMETHODIMP_(PUSBHS_CACHE_ENTRY) UsbSidebandCacheTake
+        (
+            _In_ const GUID *       ContainerId,
+            _In_ ULONG              Hash
+        );
+
+        STDMETHODIMP_(NTSTATUS) UsbSidebandCacheStore
+        (
+            _In_ PUSBHS_CACHE_ENTRY Entry
+        );
 #endif // SYSVAD_USB_SIDEBAND
 
 #ifdef SYSVAD_A2DP_SIDEBAND
@@ -380,6 +454,10 @@ class CAdapterCommon :
         NPAGED_LOOKASIDE_LIST   m_UsbSidebandWorkTaskPool;           // LookasideList
         size_t                  m_UsbSidebandWorkTaskPoolElementSize;
         BOOL                    m_UsbSidebandEnableCleanup;          // Do cleanup if true.
+        FAST_MUTEX              m_UsbSidebandCacheFastMutex;         // Serializes the discovery cache.
+        LIST_ENTRY              m_UsbSidebandCache;                  // Departed devices, most recent first.
+        ULONG                   m_UsbSidebandCacheCount;
+        BOOL                    m_UsbSidebandCacheEnabled;           // Accept new entries if true.
 
     private:
         static
@@ -446,7 +524,31 @@ class CAdapterCommon :
 
     private:
 
+    //
+    // Cached subdevices are kept in m_SubdeviceCache in creation order, for
+    // the walks that visit every subdevice, and in a hash table over their
+    // names for GetCachedSubdevice and RemoveCachedSubdevice.
+    //
+    static const ULONG SubdeviceHashBuckets = 64;   // power of 2
+
     LIST_ENTRY m_SubdeviceCache;
+    LIST_ENTRY m_SubdeviceHash[SubdeviceHashBuckets];
+
+    static ULONG HashSubdeviceName
+    (
+        _In_reads_(NameLength) PCWSTR Name,
+        _In_ size_t NameLength
+    );
+
+    struct _MINIPAIR_UNKNOWN * FindCachedSubdevice
+    (
+        _In_ PCWSTR Name
+    );
+
+    VOID FreeCachedSubdevice
+    (
+        _In_ struct _MINIPAIR_UNKNOWN * Record
+    );
 
     NTSTATUS GetCachedSubdevice
     (
@@ -469,6 +571,39 @@ class CAdapterCommon :
 
     VOID EmptySubdeviceCache();
 
+    static
+    EVT_WDF_WORKITEM EvtInstallSubdeviceWorkItem;
+
+    static
+    VOID RunSubdeviceInstallJob
+    (
+        _Inout_ SUBDEVICE_INSTALL_JOB * Job
+    );
+
+    NTSTATUS CreateSubdevice
+    (
+        _In_            PWSTR                                   Name,
+        _In_opt_        PWSTR                                   TemplateName,
+        _In_            REFGUID                                 PortClassId,
+        _In_            REFGUID                                 MiniportClassId,
+        _In_opt_        PFNCREATEMINIPORT                       MiniportCreate,
+        _In_            ULONG                                   cPropertyCount,
+        _In_reads_opt_(cPropertyCount) const SYSVAD_DEVPROPERTY * pProperties,
+        _In_opt_        PVOID                                   DeviceContext,
+        _In_            PENDPOINT_MINIPAIR                      MiniportPair,
+        _Out_           PPORT                                 * OutPort,
+        _Out_           PUNKNOWN                              * OutMiniport
+    );
+
+    NTSTATUS RegisterSubdevice
+    (
+        _In_opt_        PIRP                                    Irp,
+        _In_            PWSTR                                   Name,
+        _In_opt_        PRESOURCELIST                           ResourceList,
+        _In_            PPORT                                   Port,
+        _In_            PUNKNOWN                                Miniport
+    );
+
     NTSTATUS CreateAudioInterfaceWithProperties
     (
         _In_ PCWSTR                                                 ReferenceString,
@@ -488,7 +623,10 @@ class CAdapterCommon :
 typedef struct _MINIPAIR_UNKNOWN
 {
     LIST_ENTRY              ListEntry;
-    WCHAR                   Name[MAX_PATH];
+    LIST_ENTRY              HashEntry;
+    ULONG                   NameHash;
+    ULONG                   NameLength;     // characters, without the terminator
+    PWSTR                   Name;           // allocated with the record
     PUNKNOWN                PortInterface;
     PUNKNOWN                MiniportInterface;
     PADAPTERPOWERMANAGEMENT PowerInterface;
@@ -791,6 +929,11 @@ Return Value:
 
     InitializeListHead(&m_SubdeviceCache);
 
+    for (ULONG i = 0; i < SubdeviceHashBuckets; ++i)
+    {
+        InitializeListHead(&m_SubdeviceHash[i]);
+    }
+
 #ifdef SYSVAD_USB_SIDEBAND
     InitializeListHead(&m_PowerRelations);
     ExInitializeFastMutex(&m_PowerRelationsLock);
@@ -1460,7 +1603,135 @@ Return Value:
     }
 
     return 0;
-} // MixerVolumeRead
+} // MixerPeakMeterRead
+
+//=============================================================================
+#pragma code_seg()
+STDMETHODIMP_(VOID)
+CAdapterCommon::MixerRegistersRead
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   Index,
+    _In_  ULONG                   FirstChannel,
+    _In_  ULONG                   ChannelCount,
+    _Out_writes_(ChannelCount) PLONG Values
+)
+/*++
+
+Routine Description:
+
+  Return the values of consecutive channels of a node in one operation.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  Index - node id
+
+  FirstChannel - first channel
+
+  ChannelCount - number of channels
+
+  Values - receives one value per channel
+
+Return Value:
+
+    void
+
+--*/
+{
+    if (m_pHW)
+    {
+        m_pHW->ReadMixerRegisters(Bank, Index, FirstChannel, ChannelCount, Values);
+    }
+    else
+    {
+        RtlZeroMemory(Values, ChannelCount * sizeof(LONG));
+    }
+} // MixerRegistersRead
+
+//=============================================================================
+#pragma code_seg()
+STDMETHODIMP_(BOOL)
+CAdapterCommon::MixerRegistersWrite
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   Index,
+    _In_  ULONG                   FirstChannel,
+    _In_  ULONG                   ChannelCount,
+    _In_reads_(ChannelCount) const LONG * Values
+)
+/*++
+
+Routine Description:
+
+  Store the values of consecutive channels of a node in one operation.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  Index - node id
+
+  FirstChannel - first channel
+
+  ChannelCount - number of channels
+
+  Values - one value per channel
+
+Return Value:
+
+  TRUE if any value changed.
+
+--*/
+{
+    if (m_pHW)
+    {
+        return m_pHW->WriteMixerRegisters(Bank, Index, FirstChannel, ChannelCount, Values);
+    }
+
+    return FALSE;
+} // MixerRegistersWrite
+
+//=============================================================================
+#pragma code_seg()
+STDMETHODIMP_(BOOL)
+CAdapterCommon::MixerRegistersFill
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   Index,
+    _In_  ULONG                   ChannelCount,
+    _In_  LONG                    Value
+)
+/*++
+
+Routine Description:
+
+  Store the same value in the first ChannelCount channels of a node.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  Index - node id
+
+  ChannelCount - number of channels
+
+  Value - new value
+
+Return Value:
+
+  TRUE if any value changed.
+
+--*/
+{
+    if (m_pHW)
+    {
+        return m_pHW->FillMixerRegisters(Bank, Index, ChannelCount, Value);
+    }
+
+    return FALSE;
+} // MixerRegistersFill
 
 //=============================================================================
 #pragma code_seg()
@@ -1786,12 +2057,145 @@ Return Value:
     ASSERT(Name != NULL);
     ASSERT(m_pDeviceObject != NULL);
 
+    NTSTATUS                    ntStatus;
+    PPORT                       port            = NULL;
+    PUNKNOWN                    miniport        = NULL;
+
+    ntStatus = CreateSubdevice(Name,
+                               TemplateName,
+                               PortClassId,
+                               MiniportClassId,
+                               MiniportCreate,
+                               cPropertyCount,
+                               pProperties,
+                               DeviceContext,
+                               MiniportPair,
+                               &port,
+                               &miniport);
+
+    // Init the port driver and miniport in one go, and register them.
+    //
+    if (NT_SUCCESS(ntStatus))
+    {
+        ntStatus = RegisterSubdevice(Irp, Name, ResourceList, port, miniport);
+    }
+
+    // Deposit the port interfaces if it's needed.
+    //
+    if (NT_SUCCESS(ntStatus))
+    {
+        if (OutPortUnknown)
+        {
+            ntStatus = 
+                port->QueryInterface
+                ( 
+                    IID_IUnknown,
+                    (PVOID *)OutPortUnknown 
+                );
+        }
+
+        if (OutPortInterface)
+        {
+            ntStatus = 
+                port->QueryInterface
+                ( 
+                    PortInterfaceId,
+                    (PVOID *) OutPortInterface 
+                );
+        }
+
+        if (OutMiniportUnknown)
+        {
+            ntStatus = 
+                miniport->QueryInterface
+                ( 
+                    IID_IUnknown,
+                    (PVOID *)OutMiniportUnknown 
+                );
+        }
+
+    }
+
+    if (port)
+    {
+        port->Release();
+    }
+
+    if (miniport)
+    {
+        miniport->Release();
+    }
+
+    return ntStatus;
+} // InstallSubDevice
+
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+CAdapterCommon::CreateSubdevice
+( 
+    _In_            PWSTR                                   Name,
+    _In_opt_        PWSTR                                   TemplateName,
+    _In_            REFGUID                                 PortClassId,
+    _In_            REFGUID                                 MiniportClassId,
+    _In_opt_        PFNCREATEMINIPORT                       MiniportCreate,
+    _In_            ULONG                                   cPropertyCount,
+    _In_reads_opt_(cPropertyCount) const SYSVAD_DEVPROPERTY * pProperties,
+    _In_opt_        PVOID                                   DeviceContext,
+    _In_            PENDPOINT_MINIPAIR                      MiniportPair,
+    _Out_           PPORT                                 * OutPort,
+    _Out_           PUNKNOWN                              * OutMiniport
+)
+/*++
+
+Routine Description:
+
+    Creates the audio interface, the port driver and the miniport of a
+    subdevice. Nothing is registered with portcls yet, so subdevices can
+    be created concurrently.
+
+Arguments:
+
+    Name - name of the miniport, the reference string of the interface.
+
+    TemplateName - reference string of the interface to copy parameters from.
+
+    PortClassId - port class id. Passed to PcNewPort.
+
+    MiniportClassId - miniport class id. Passed to PcNewMiniport.
+
+    MiniportCreate - pointer to a miniport creation function. If NULL, 
+                     PcNewMiniport is used.
+
+    cPropertyCount - number of interface properties.
+
+    pProperties - interface properties.
+
+    DeviceContext - context passed to the miniport creation function.
+
+    MiniportPair - endpoint configuration.
+
+    OutPort - receives the port driver.
+
+    OutMiniport - receives the miniport.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
     NTSTATUS                    ntStatus;
     PPORT                       port            = NULL;
     PUNKNOWN                    miniport        = NULL;
     PADAPTERCOMMON              adapterCommon   = NULL;
     UNICODE_STRING              symbolicLink    = { 0 };
 
+    *OutPort = NULL;
+    *OutMiniport = NULL;
+
     adapterCommon = PADAPTERCOMMON(this);
 
     ntStatus = CreateAudioInterfaceWithProperties(Name, TemplateName, cPropertyCount, pProperties, &symbolicLink);
@@ -1834,89 +2238,93 @@ Return Value:
         }
     }
 
-    // Init the port driver and miniport in one go.
-    //
     if (NT_SUCCESS(ntStatus))
     {
-#pragma warning(push)
-        // IPort::Init's annotation on ResourceList requires it to be non-NULL.  However,
-        // for dynamic devices, we may no longer have the resource list and this should
-        // still succeed.
-        //
-#pragma warning(disable:6387)
-        ntStatus = 
-            port->Init
-            ( 
-                m_pDeviceObject,
-                Irp,
-                miniport,
-                adapterCommon,
-                ResourceList 
-            );
-#pragma warning (pop)
-
-        if (NT_SUCCESS(ntStatus))
-        {
-            // Register the subdevice (port/miniport combination).
-            //
-            ntStatus = 
-                PcRegisterSubdevice
-                ( 
-                    m_pDeviceObject,
-                    Name,
-                    port 
-                );
-        }
+        *OutPort = port;
+        *OutMiniport = miniport;
     }
-
-    // Deposit the port interfaces if it's needed.
-    //
-    if (NT_SUCCESS(ntStatus))
+    else
     {
-        if (OutPortUnknown)
-        {
-            ntStatus = 
-                port->QueryInterface
-                ( 
-                    IID_IUnknown,
-                    (PVOID *)OutPortUnknown 
-                );
-        }
+        SAFE_RELEASE(port);
+        SAFE_RELEASE(miniport);
+    }
 
-        if (OutPortInterface)
-        {
-            ntStatus = 
-                port->QueryInterface
-                ( 
-                    PortInterfaceId,
-                    (PVOID *) OutPortInterface 
-                );
-        }
+    return ntStatus;
+} // CreateSubdevice
 
-        if (OutMiniportUnknown)
-        {
-            ntStatus = 
-                miniport->QueryInterface
-                ( 
-                    IID_IUnknown,
-                    (PVOID *)OutMiniportUnknown 
-                );
-        }
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+CAdapterCommon::RegisterSubdevice
+( 
+    _In_opt_        PIRP                                    Irp,
+    _In_            PWSTR                                   Name,
+    _In_opt_        PRESOURCELIST                           ResourceList,
+    _In_            PPORT                                   Port,
+    _In_            PUNKNOWN                                Miniport
+)
+/*++
 
-    }
+Routine Description:
 
-    if (port)
-    {
-        port->Release();
-    }
+    Initializes the port driver with its miniport and registers the
+    subdevice. Port initialization and registration add to the device's
+    create items, so calls must not overlap.
 
-    if (miniport)
+Arguments:
+
+    Irp - pointer to the irp object.
+
+    Name - name of the miniport. Passes to PcRegisterSubDevice
+
+    ResourceList - resources passed to the port driver.
+
+    Port - the port driver, from CreateSubdevice.
+
+    Miniport - the miniport, from CreateSubdevice.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    NTSTATUS                    ntStatus;
+
+#pragma warning(push)
+    // IPort::Init's annotation on ResourceList requires it to be non-NULL.  However,
+    // for dynamic devices, we may no longer have the resource list and this should
+    // still succeed.
+    //
+#pragma warning(disable:6387)
+    ntStatus = 
+        Port->Init
+        ( 
+            m_pDeviceObject,
+            Irp,
+            Miniport,
+            PADAPTERCOMMON(this),
+            ResourceList 
+        );
+#pragma warning (pop)
+
+    if (NT_SUCCESS(ntStatus))
     {
-        miniport->Release();
+        // Register the subdevice (port/miniport combination).
+        //
+        ntStatus = 
+            PcRegisterSubdevice
+            ( 
+                m_pDeviceObject,
+                Name,
+                Port 
+            );
     }
 
     return ntStatus;
-} // InstallSubDevice
+} // RegisterSubdevice
 
 //=============================================================================
 #pragma code_seg("PAGE")
@@ -2159,6 +2567,93 @@ Return Value:
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+ULONG
+CAdapterCommon::HashSubdeviceName
+(
+    _In_reads_(NameLength) PCWSTR Name,
+    _In_ size_t NameLength
+)
+/*++
+
+Routine Description:
+
+  FNV-1a hash of a subdevice name, used to pick its hash bucket and to
+  skip the string compare for most of the other names of the bucket.
+
+--*/
+{
+    PAGED_CODE();
+
+    ULONG hash = 2166136261;
+
+    for (size_t i = 0; i < NameLength; ++i)
+    {
+        hash = (hash ^ Name[i]) * 16777619;
+    }
+
+    return hash;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+MINIPAIR_UNKNOWN *
+CAdapterCommon::FindCachedSubdevice
+(
+    _In_ PCWSTR Name
+)
+{
+    PAGED_CODE();
+
+    size_t  cchName = 0;
+    ULONG   hash;
+    PLIST_ENTRY bucket;
+
+    if (!NT_SUCCESS(RtlStringCchLengthW(Name, MAX_PATH, &cchName)))
+    {
+        return NULL;
+    }
+
+    hash = HashSubdeviceName(Name, cchName);
+    bucket = &m_SubdeviceHash[hash & (SubdeviceHashBuckets - 1)];
+
+    for (PLIST_ENTRY le = bucket->Flink; le != bucket; le = le->Flink)
+    {
+        MINIPAIR_UNKNOWN *pRecord = CONTAINING_RECORD(le, MINIPAIR_UNKNOWN, HashEntry);
+
+        if (pRecord->NameHash == hash &&
+            pRecord->NameLength == cchName &&
+            0 == wcscmp(Name, pRecord->Name))
+        {
+            return pRecord;
+        }
+    }
+
+    return NULL;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CAdapterCommon::FreeCachedSubdevice
+(
+    _In_ MINIPAIR_UNKNOWN * Record
+)
+{
+    PAGED_CODE();
+
+    RemoveEntryList(&Record->ListEntry);
+    RemoveEntryList(&Record->HashEntry);
+
+    SAFE_RELEASE(Record->PortInterface);
+    SAFE_RELEASE(Record->MiniportInterface);
+    SAFE_RELEASE(Record->PowerInterface);
+    SAFE_RELEASE(Record->MiniportChange);
+
+    ExFreePoolWithTag(Record, MINADAPTER_POOLTAG);
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
@@ -2172,33 +2667,27 @@ CAdapterCommon::GetCachedSubdevice
     PAGED_CODE();
     DPF_ENTER(("[CAdapterCommon::GetCachedSubdevice]"));
 
-    // search list, return interface to device if found, fail if not found
-    PLIST_ENTRY le = NULL;
-    BOOL bFound = FALSE;
+    // look the name up, return interface to device if found, fail if not found
+    MINIPAIR_UNKNOWN *pRecord = FindCachedSubdevice(Name);
 
-    for (le = m_SubdeviceCache.Flink; le != &m_SubdeviceCache && !bFound; le = le->Flink)
+    if (!pRecord)
     {
-        MINIPAIR_UNKNOWN *pRecord = CONTAINING_RECORD(le, MINIPAIR_UNKNOWN, ListEntry);
-
-        if (0 == wcscmp(Name, pRecord->Name))
-        {
-            if (OutUnknownPort)
-            {
-                *OutUnknownPort = pRecord->PortInterface;
-                (*OutUnknownPort)->AddRef();
-            }
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
 
-            if (OutUnknownMiniport)
-            {
-                *OutUnknownMiniport = pRecord->MiniportInterface;
-                (*OutUnknownMiniport)->AddRef();
-            }
+    if (OutUnknownPort)
+    {
+        *OutUnknownPort = pRecord->PortInterface;
+        (*OutUnknownPort)->AddRef();
+    }
 
-            bFound = TRUE;
-        }
+    if (OutUnknownMiniport)
+    {
+        *OutUnknownMiniport = pRecord->MiniportInterface;
+        (*OutUnknownMiniport)->AddRef();
     }
 
-    return bFound?STATUS_SUCCESS:STATUS_OBJECT_NAME_NOT_FOUND;
+    return STATUS_SUCCESS;
 }
 
 
@@ -2216,27 +2705,36 @@ CAdapterCommon::CacheSubdevice
     PAGED_CODE();
     DPF_ENTER(("[CAdapterCommon::CacheSubdevice]"));
 
-    // add the item with this name/interface to the list
+    // add the item with this name/interface to the list and the hash table
     NTSTATUS         ntStatus       = STATUS_SUCCESS;
     MINIPAIR_UNKNOWN *pNewSubdevice = NULL;
+    size_t           cchName        = 0;
 
-    pNewSubdevice = new(POOL_FLAG_NON_PAGED, MINADAPTER_POOLTAG) MINIPAIR_UNKNOWN;
-
-    if (!pNewSubdevice)
-    {
-        DPF(D_TERSE, ("Insufficient memory to cache subdevice"));
-        ntStatus = STATUS_INSUFFICIENT_RESOURCES;
-    }
+    // the name is kept in the same allocation as the record
+    ntStatus = RtlStringCchLengthW(Name, MAX_PATH, &cchName);
 
     if (NT_SUCCESS(ntStatus))
     {
-        memset(pNewSubdevice, 0, sizeof(MINIPAIR_UNKNOWN));
+        pNewSubdevice = (MINIPAIR_UNKNOWN *)ExAllocatePool2(
+            POOL_FLAG_NON_PAGED,
+            sizeof(MINIPAIR_UNKNOWN) + (cchName + 1) * sizeof(WCHAR),
+            MINADAPTER_POOLTAG);
 
-        ntStatus = RtlStringCchCopyW(pNewSubdevice->Name, SIZEOF_ARRAY(pNewSubdevice->Name), Name);
+        if (!pNewSubdevice)
+        {
+            DPF(D_TERSE, ("Insufficient memory to cache subdevice"));
+            ntStatus = STATUS_INSUFFICIENT_RESOURCES;
+        }
     }
 
     if (NT_SUCCESS(ntStatus))
     {
+        pNewSubdevice->Name = (PWSTR)(pNewSubdevice + 1);
+        pNewSubdevice->NameLength = (ULONG)cchName;
+        RtlCopyMemory(pNewSubdevice->Name, Name, cchName * sizeof(WCHAR));
+        pNewSubdevice->Name[cchName] = UNICODE_NULL;
+        pNewSubdevice->NameHash = HashSubdeviceName(Name, cchName);
+
         pNewSubdevice->PortInterface = UnknownPort;
         pNewSubdevice->PortInterface->AddRef();
 
@@ -2250,14 +2748,7 @@ CAdapterCommon::CacheSubdevice
         UnknownMiniport->QueryInterface(IID_IMiniportChange, (PVOID *)&(pNewSubdevice->MiniportChange));
 
         InsertTailList(&m_SubdeviceCache, &pNewSubdevice->ListEntry);
-    }
-
-    if (!NT_SUCCESS(ntStatus))
-    {
-        if (pNewSubdevice)
-        {
-            delete pNewSubdevice;
-        }
+        InsertTailList(&m_SubdeviceHash[pNewSubdevice->NameHash & (SubdeviceHashBuckets - 1)], &pNewSubdevice->HashEntry);
     }
 
     return ntStatus;
@@ -2274,30 +2765,17 @@ CAdapterCommon::RemoveCachedSubdevice
     PAGED_CODE();
     DPF_ENTER(("[CAdapterCommon::RemoveCachedSubdevice]"));
 
-    // search list, remove the entry from the list
-
-    PLIST_ENTRY le = NULL;
-    BOOL bRemoved = FALSE;
+    // look the name up, remove the entry from the list and the hash table
+    MINIPAIR_UNKNOWN *pRecord = FindCachedSubdevice(Name);
 
-    for (le = m_SubdeviceCache.Flink; le != &m_SubdeviceCache && !bRemoved; le = le->Flink)
+    if (!pRecord)
     {
-        MINIPAIR_UNKNOWN *pRecord = CONTAINING_RECORD(le, MINIPAIR_UNKNOWN, ListEntry);
-
-        if (0 == wcscmp(Name, pRecord->Name))
-        {
-            SAFE_RELEASE(pRecord->PortInterface);
-            SAFE_RELEASE(pRecord->MiniportInterface);
-            SAFE_RELEASE(pRecord->PowerInterface);
-            SAFE_RELEASE(pRecord->MiniportChange);
-            memset(pRecord->Name, 0, sizeof(pRecord->Name));
-            RemoveEntryList(le);
-            bRemoved = TRUE;
-            delete pRecord;
-            break;
-        }
+        return STATUS_OBJECT_NAME_NOT_FOUND;
     }
 
-    return bRemoved?STATUS_SUCCESS:STATUS_OBJECT_NAME_NOT_FOUND;
+    FreeCachedSubdevice(pRecord);
+
+    return STATUS_SUCCESS;
 }
 
 #pragma code_seg("PAGE")
@@ -2309,16 +2787,9 @@ CAdapterCommon::EmptySubdeviceCache()
 
     while (!IsListEmpty(&m_SubdeviceCache))
     {
-        PLIST_ENTRY le = RemoveHeadList(&m_SubdeviceCache);
-        MINIPAIR_UNKNOWN *pRecord = CONTAINING_RECORD(le, MINIPAIR_UNKNOWN, ListEntry);
+        MINIPAIR_UNKNOWN *pRecord = CONTAINING_RECORD(m_SubdeviceCache.Flink, MINIPAIR_UNKNOWN, ListEntry);
 
-        SAFE_RELEASE(pRecord->PortInterface);
-        SAFE_RELEASE(pRecord->MiniportInterface);
-        SAFE_RELEASE(pRecord->MiniportChange);
-        SAFE_RELEASE(pRecord->PowerInterface);
-        memset(pRecord->Name, 0, sizeof(pRecord->Name));
-
-        delete pRecord;
+        FreeCachedSubdevice(pRecord);
     }
 }
 
@@ -2657,6 +3128,276 @@ CAdapterCommon::InstallEndpointFilters
     return ntStatus;
 }
 
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CAdapterCommon::RunSubdeviceInstallJob
+(
+    _Inout_ SUBDEVICE_INSTALL_JOB * Job
+)
+/*++
+
+Routine Description:
+
+  Creates the port and miniport of the topology or wave subdevice of a job,
+  and times it. Registration is left to the start thread.
+
+Arguments:
+
+    Job - the subdevice to create; receives the port and miniport.
+
+--*/
+{
+    PAGED_CODE();
+
+    PENDPOINT_MINIPAIR  pair    = Job->MiniportPair;
+    LARGE_INTEGER       start   = KeQueryPerformanceCounter(NULL);
+
+    if (Job->Wave)
+    {
+        Job->Status = Job->Adapter->CreateSubdevice(pair->WaveName,
+                                                    pair->TemplateWaveName,
+                                                    CLSID_PortWaveRT,
+                                                    CLSID_PortWaveRT,
+                                                    pair->WaveCreateCallback,
+                                                    pair->WaveInterfacePropertyCount,
+                                                    pair->WaveInterfaceProperties,
+                                                    NULL,
+                                                    pair,
+                                                    &Job->Port,
+                                                    &Job->Miniport);
+    }
+    else
+    {
+        Job->Status = Job->Adapter->CreateSubdevice(pair->TopoName,
+                                                    pair->TemplateTopoName,
+                                                    CLSID_PortTopology,
+                                                    CLSID_PortTopology,
+                                                    pair->TopoCreateCallback,
+                                                    pair->TopoInterfacePropertyCount,
+                                                    pair->TopoInterfaceProperties,
+                                                    NULL,
+                                                    pair,
+                                                    &Job->Port,
+                                                    &Job->Miniport);
+    }
+
+    Job->Elapsed = KeQueryPerformanceCounter(NULL).QuadPart - start.QuadPart;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+VOID
+CAdapterCommon::EvtInstallSubdeviceWorkItem
+(
+    _In_    WDFWORKITEM WorkItem
+)
+/*++
+
+Routine Description:
+
+  Work-item of PrepareEndpointFilters, creates the port and miniport of
+  one subdevice.
+
+Arguments:
+
+    WorkItem    - WDF work-item object.
+    
+--*/
+{
+    PAGED_CODE();
+
+    RunSubdeviceInstallJob(GetSubdeviceInstallWorkItemContext(WorkItem)->Job);
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+STDMETHODIMP_(NTSTATUS)
+CAdapterCommon::PrepareEndpointFilters
+(
+    _In_opt_    PIRP                Irp,
+    _In_        ULONG               MiniportPairCount,
+    _In_reads_(MiniportPairCount) PENDPOINT_MINIPAIR * MiniportPairs
+)
+/*++
+
+Routine Description:
+
+  Prepares the topology and wave subdevices of a set of endpoints and
+  caches them. The audio interfaces, ports and miniports are created
+  concurrently, one work-item per subdevice. Port initialization and
+  PcRegisterSubdevice update the device's create items, which is not safe
+  to do concurrently, so they run on this thread, one subdevice at a time.
+  The connections are left to InstallEndpointFilters, which then finds the
+  subdevices in the cache and only connects them. A subdevice that fails
+  here is created again by InstallEndpointFilters, which reports the error.
+
+Arguments:
+
+    Irp - pointer to the irp object.
+
+    MiniportPairCount - number of endpoints.
+
+    MiniportPairs - endpoint configurations.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    PAGED_CODE();
+    DPF_ENTER(("[CAdapterCommon::PrepareEndpointFilters]"));
+
+    NTSTATUS                ntStatus    = STATUS_SUCCESS;
+    SUBDEVICE_INSTALL_JOB * jobs        = NULL;
+    ULONG                   jobCount    = 0;
+    LARGE_INTEGER           frequency;
+    LARGE_INTEGER           start;
+    LONGLONG                sum         = 0;
+
+    if (MiniportPairCount == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (MiniportPairCount > MAXULONG / (2 * sizeof(SUBDEVICE_INSTALL_JOB)))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    jobs = (SUBDEVICE_INSTALL_JOB *)ExAllocatePool2(POOL_FLAG_PAGED,
+                                                    2 * MiniportPairCount * sizeof(SUBDEVICE_INSTALL_JOB),
+                                                    MINADAPTER_POOLTAG);
+    if (jobs == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    start = KeQueryPerformanceCounter(&frequency);
+
+    //
+    // One job per subdevice name that is not already cached; endpoints may
+    // share a subdevice.
+    //
+    for (ULONG i = 0; i < 2 * MiniportPairCount; ++i)
+    {
+        PENDPOINT_MINIPAIR  pair    = MiniportPairs[i / 2];
+        BOOL                wave    = (i & 1) != 0;
+        PWSTR               name    = wave ? pair->WaveName : pair->TopoName;
+        BOOL                found   = FindCachedSubdevice(name) != NULL;
+
+        for (ULONG j = 0; j < jobCount && !found; ++j)
+        {
+            PWSTR jobName = jobs[j].Wave ? jobs[j].MiniportPair->WaveName : jobs[j].MiniportPair->TopoName;
+
+            found = 0 == wcscmp(name, jobName);
+        }
+
+        if (!found)
+        {
+            jobs[jobCount].Adapter = this;
+            jobs[jobCount].MiniportPair = pair;
+            jobs[jobCount].Wave = wave;
+            jobCount++;
+        }
+    }
+
+    //
+    // Start the work-items. A job without a work-item runs on this thread.
+    //
+    for (ULONG i = 0; i < jobCount; ++i)
+    {
+        WDF_WORKITEM_CONFIG     wiConfig;
+        WDF_OBJECT_ATTRIBUTES   attributes;
+
+        WDF_WORKITEM_CONFIG_INIT(&wiConfig, EvtInstallSubdeviceWorkItem);
+        wiConfig.AutomaticSerialization = FALSE;
+
+        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, SubdeviceInstallWorkItemContext);
+        attributes.ParentObject = GetWdfDevice();
+
+        if (NT_SUCCESS(WdfWorkItemCreate(&wiConfig, &attributes, &jobs[i].WorkItem)))
+        {
+            GetSubdeviceInstallWorkItemContext(jobs[i].WorkItem)->Job = &jobs[i];
+            WdfWorkItemEnqueue(jobs[i].WorkItem);
+        }
+        else
+        {
+            jobs[i].WorkItem = NULL;
+            RunSubdeviceInstallJob(&jobs[i]);
+        }
+    }
+
+    //
+    // Wait for all of them, then register and cache the subdevices in
+    // endpoint order.
+    //
+    for (ULONG i = 0; i < jobCount; ++i)
+    {
+        if (jobs[i].WorkItem)
+        {
+            WdfWorkItemFlush(jobs[i].WorkItem);
+            WdfObjectDelete(jobs[i].WorkItem);
+            jobs[i].WorkItem = NULL;
+        }
+    }
+
+    for (ULONG i = 0; i < jobCount; ++i)
+    {
+        SUBDEVICE_INSTALL_JOB * job     = &jobs[i];
+        PWSTR                   name    = job->Wave ? job->MiniportPair->WaveName : job->MiniportPair->TopoName;
+        NTSTATUS                status  = job->Status;
+        PUNKNOWN                unknownPort     = NULL;
+        PUNKNOWN                unknownMiniport = NULL;
+        LARGE_INTEGER           registerStart   = KeQueryPerformanceCounter(NULL);
+
+        if (NT_SUCCESS(status))
+        {
+            status = RegisterSubdevice(Irp, name, NULL, job->Port, job->Miniport);
+        }
+
+        if (NT_SUCCESS(status))
+        {
+            status = job->Port->QueryInterface(IID_IUnknown, (PVOID *)&unknownPort);
+        }
+
+        if (NT_SUCCESS(status))
+        {
+            status = job->Miniport->QueryInterface(IID_IUnknown, (PVOID *)&unknownMiniport);
+        }
+
+        if (NT_SUCCESS(status))
+        {
+            status = CacheSubdevice(name, unknownPort, unknownMiniport);
+            if (!NT_SUCCESS(status))
+            {
+                UnregisterSubdevice(unknownPort);
+            }
+        }
+
+        job->Elapsed += KeQueryPerformanceCounter(NULL).QuadPart - registerStart.QuadPart;
+        sum += job->Elapsed;
+
+        DPF(D_VERBOSE, ("PrepareEndpointFilters: %S created in %I64d us, 0x%x", 
+            name, job->Elapsed * 1000000 / frequency.QuadPart, status));
+
+        SAFE_RELEASE(unknownMiniport);
+        SAFE_RELEASE(unknownPort);
+        SAFE_RELEASE(job->Miniport);
+        SAFE_RELEASE(job->Port);
+    }
+
+    DPF(D_VERBOSE, ("PrepareEndpointFilters: %u subdevices created in %I64d us, %I64d us one at a time", 
+        jobCount,
+        (KeQueryPerformanceCounter(NULL).QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart,
+        sum * 1000000 / frequency.QuadPart));
+
+    ExFreePoolWithTag(jobs, MINADAPTER_POOLTAG);
+
+    return ntStatus;
+}
+
 //=============================================================================
 #pragma code_seg("PAGE")
 STDMETHODIMP_(NTSTATUS)
@@ -3914,6 +4655,10 @@ NT status code.
     ExInitializeFastMutex(&m_UsbSidebandFastMutex);
     InitializeListHead(&m_UsbSidebandWorkTasks);
     InitializeListHead(&m_UsbSidebandDevices);
+    ExInitializeFastMutex(&m_UsbSidebandCacheFastMutex);
+    InitializeListHead(&m_UsbSidebandCache);
+    m_UsbSidebandCacheCount = 0;
+    m_UsbSidebandCacheEnabled = TRUE;
     m_UsbSidebandWorkTaskPoolElementSize = sizeof(UsbHsWorkTask);
     ExInitializeNPagedLookasideList(&m_UsbSidebandWorkTaskPool,
         NULL,
@@ -4110,11 +4855,144 @@ Cleanup the USB Sideband environment.
 
     ASSERT(IsListEmpty(&m_UsbSidebandDevices));
 
+    //
+    // The devices above handed their discovery results to the cache as they
+    // were deleted. Stop accepting entries and free them all.
+    //
+    ExAcquireFastMutex(&m_UsbSidebandCacheFastMutex);
+    m_UsbSidebandCacheEnabled = FALSE;
+    ExReleaseFastMutex(&m_UsbSidebandCacheFastMutex);
+
+    while (!IsListEmpty(&m_UsbSidebandCache))
+    {
+        PLIST_ENTRY le = RemoveHeadList(&m_UsbSidebandCache);
+
+        UsbHsDevice::DeleteCacheEntry(CONTAINING_RECORD(le, USBHS_CACHE_ENTRY, ListEntry));
+    }
+    m_UsbSidebandCacheCount = 0;
+
     //
     // General cleanup.
     //
     ExDeleteNPagedLookasideList(&m_UsbSidebandWorkTaskPool);
 }
+
+//=============================================================================
+#pragma code_seg("PAGE")
+STDMETHODIMP_(PUSBHS_CACHE_ENTRY)
+CAdapterCommon::UsbSidebandCacheTake
+(
+    _In_ const GUID *       ContainerId,
+    _In_ ULONG              Hash
+)
+/*++
+
+Routine Description:
+
+Removes and returns the discovery results cached for a USB Sideband device
+with the given container id and descriptor hash. The caller owns the entry.
+
+Arguments:
+
+ContainerId - container id of the arriving device.
+
+Hash - hash of the arriving device's descriptors.
+
+Return Value:
+
+The cache entry, or NULL if the device is not in the cache.
+
+--*/
+{
+    PAGED_CODE();
+    DPF_ENTER(("[CAdapterCommon::UsbSidebandCacheTake]"));
+
+    PUSBHS_CACHE_ENTRY  entry = NULL;
+    PLIST_ENTRY         le = NULL;
+
+    ExAcquireFastMutex(&m_UsbSidebandCacheFastMutex);
+
+    for (le = m_UsbSidebandCache.Flink; le != &m_UsbSidebandCache; le = le->Flink)
+    {
+        PUSBHS_CACHE_ENTRY candidate = CONTAINING_RECORD(le, USBHS_CACHE_ENTRY, ListEntry);
+
+        if (candidate->Hash == Hash &&
+            IsEqualGUID(candidate->ContainerId, *ContainerId))
+        {
+            RemoveEntryList(le);
+            InitializeListHead(le);
+            m_UsbSidebandCacheCount--;
+            entry = candidate;
+            break;
+        }
+    }
+
+    ExReleaseFastMutex(&m_UsbSidebandCacheFastMutex);
+
+    return entry;
+}
+
+//=============================================================================
+#pragma code_seg("PAGE")
+STDMETHODIMP_(NTSTATUS)
+CAdapterCommon::UsbSidebandCacheStore
+(
+    _In_ PUSBHS_CACHE_ENTRY Entry
+)
+/*++
+
+Routine Description:
+
+Adds the discovery results of a departing USB Sideband device to the cache,
+evicting the least recently stored entry when the cache is full. On success
+the cache owns the entry.
+
+Arguments:
+
+Entry - discovery results to cache.
+
+Return Value:
+
+NT status code. STATUS_DEVICE_NOT_READY if the cache is being torn down, in
+which case the caller still owns the entry.
+
+--*/
+{
+    PAGED_CODE();
+    DPF_ENTER(("[CAdapterCommon::UsbSidebandCacheStore]"));
+
+    PUSBHS_CACHE_ENTRY  evicted = NULL;
+    NTSTATUS            ntStatus = STATUS_SUCCESS;
+
+    ExAcquireFastMutex(&m_UsbSidebandCacheFastMutex);
+
+    if (!m_UsbSidebandCacheEnabled)
+    {
+        ntStatus = STATUS_DEVICE_NOT_READY;
+    }
+    else
+    {
+        InsertHeadList(&m_UsbSidebandCache, &Entry->ListEntry);
+        m_UsbSidebandCacheCount++;
+
+        if (m_UsbSidebandCacheCount > USBHS_CACHE_MAX_ENTRIES)
+        {
+            PLIST_ENTRY le = RemoveTailList(&m_UsbSidebandCache);
+
+            evicted = CONTAINING_RECORD(le, USBHS_CACHE_ENTRY, ListEntry);
+            m_UsbSidebandCacheCount--;
+        }
+    }
+
+    ExReleaseFastMutex(&m_UsbSidebandCacheFastMutex);
+
+    if (evicted != NULL)
+    {
+        UsbHsDevice::DeleteCacheEntry(evicted);
+    }
+
+    return ntStatus;
+}
 #endif  // SYSVAD_USB_SIDEBAND
 
 #ifdef SYSVAD_A2DP_SIDEBAND
@@ -136,6 +136,7 @@ Abstract:
 #define USBSIDEBANDTEST_POOLTAG014  'eAyS'
 #define USBSIDEBANDTEST_POOLTAG015  'fAyS'
 #define USBSIDEBANDTEST_POOLTAG016  'gAyS'
+#define USBSIDEBANDTEST_POOLTAG017  'pAyS'
 #define A2DPSIDEBANDTEST_POOLTAG01  'hAyS'
 #define A2DPSIDEBANDTEST_POOLTAG02  'iAyS'
 #define A2DPSIDEBANDTEST_POOLTAG03  'jAyS'
@@ -143,6 +144,7 @@ Abstract:
 #define A2DPSIDEBANDTEST_POOLTAG05  'lAyS'
 #define A2DPSIDEBANDTEST_POOLTAG06  'mAyS'
 #define A2DPSIDEBANDTEST_POOLTAG07  'nAyS'
+#define AUDIOMODULE_POOLTAG         'oAyS'
 
 typedef enum
 {
@@ -169,6 +171,18 @@ typedef enum
     
 } eDeviceType;
 
+//
+// Register banks of the virtual mixer, one register per topology node and
+// channel. Mute registers hold 0 or 1.
+//
+typedef enum
+{
+    eMixerVolume = 0,
+    eMixerMute,
+    eMixerPeakMeter,
+    eMixerRegisterBankCount
+} MIXER_REGISTER_BANK;
+
 //
 // Signal processing modes and default formats structs.
 //
@@ -246,6 +260,39 @@ typedef struct _AUDIOMODULE_PARAMETER_INFO
 
 #define AUDIOMODULE_PARAMETER_FLAG_CHANGE_NOTIFICATION  0x00000001
 
+//
+// Coalesces the change notifications of one audio module. A change to a
+// parameter that still has a notification pending replaces it, and at most
+// one burst of notifications is delivered per Interval; changes made in
+// between are delivered when the interval ends or when the owning stream
+// changes state.
+//
+#define AUDIOMODULE_NOTIFIER_MAX_PENDING                4
+#define AUDIOMODULE_NOTIFIER_MAX_NOTIFICATION_CB        64
+
+typedef struct _AUDIOMODULE_PENDING_NOTIFICATION
+{
+    ULONG       ParameterId;
+    USHORT      BufferCb;
+    BYTE        Buffer[AUDIOMODULE_NOTIFIER_MAX_NOTIFICATION_CB];
+} AUDIOMODULE_PENDING_NOTIFICATION, *PAUDIOMODULE_PENDING_NOTIFICATION;
+
+typedef struct _AUDIOMODULE_NOTIFIER
+{
+    KSPIN_LOCK                          Lock;
+    PPORTCLSNOTIFICATIONS               PortNotifications;
+    PEX_TIMER                           Timer;
+    PIO_WORKITEM                        WorkItem;
+    KEVENT                              WorkItemIdle;
+    ULONGLONG                           Interval;           // hns
+    ULONGLONG                           LastSendTime;       // interrupt time, hns
+    BOOLEAN                             TimerArmed;
+    BOOLEAN                             WorkItemQueued;
+    BOOLEAN                             Deleting;
+    ULONG                               PendingCount;
+    AUDIOMODULE_PENDING_NOTIFICATION    Pending[AUDIOMODULE_NOTIFIER_MAX_PENDING];
+} AUDIOMODULE_NOTIFIER, *PAUDIOMODULE_NOTIFIER;
+
 //
 // Module callbacks.
 //
@@ -257,7 +304,7 @@ NTSTATUS
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
     _In_        KSAUDIOMODULE_NOTIFICATION * NotificationHeader,
-    _In_opt_    PPORTCLSNOTIFICATIONS PortNotifications
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
 );
 
 typedef
@@ -268,7 +315,8 @@ NTSTATUS
     _In_opt_    PVOID           TemplateContext,
     _Inout_opt_ PVOID           Context,
     _In_        size_t          Size,
-    _In_        ULONG           InstanceId
+    _In_        ULONG           InstanceId,
+    _In_opt_    PAUDIOMODULE_NOTIFIER Notifier
 );
 
 typedef
@@ -338,6 +386,22 @@ struct AUDIOMODULE
     ULONG                           InstanceId;
     ULONG                           NextCfgInstanceId;  // used by filter modules
     BOOL                            Enabled;
+    PAUDIOMODULE_NOTIFIER           Notifier;           // NULL if the module list has no port notifications
+};
+
+//
+// Lookup of a module list by (ClassId, InstanceId). Built once the list is
+// complete, the list does not change afterwards. Lock serializes the
+// commands sent to the modules of the list, so that a batch of commands
+// runs as a unit. It is a KMUTEX rather than a FAST_MUTEX because the
+// module handlers queue port notifications, which must stay at
+// PASSIVE_LEVEL.
+//
+struct AUDIOMODULE_INDEX
+{
+    KMUTEX                          Lock;
+    ULONG                           SlotMask;
+    PUSHORT                         Slots;              // module index + 1, 0 for an empty slot
 };
 
 // forward declaration.
@@ -444,6 +508,10 @@ DECLARE_INTERFACE_(IMiniportChange, IUnknown)
     ) PURE;
 };
 
+#ifdef SYSVAD_USB_SIDEBAND
+typedef struct _USBHS_CACHE_ENTRY *PUSBHS_CACHE_ENTRY;
+#endif // SYSVAD_USB_SIDEBAND
+
 ///////////////////////////////////////////////////////////////////////////////
 // IAdapterCommon
 //
@@ -557,6 +625,35 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown)
         _In_  ULONG               Channel
     ) PURE;
 
+    STDMETHOD_(VOID,            MixerRegistersRead)
+    (
+        THIS_
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               Index,
+        _In_  ULONG               FirstChannel,
+        _In_  ULONG               ChannelCount,
+        _Out_writes_(ChannelCount) PLONG Values
+    ) PURE;
+
+    STDMETHOD_(BOOL,            MixerRegistersWrite)
+    (
+        THIS_
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               Index,
+        _In_  ULONG               FirstChannel,
+        _In_  ULONG               ChannelCount,
+        _In_reads_(ChannelCount) const LONG * Values
+    ) PURE;
+
+    STDMETHOD_(BOOL,            MixerRegistersFill)
+    (
+        THIS_
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               Index,
+        _In_  ULONG               ChannelCount,
+        _In_  LONG                Value
+    ) PURE;
+
     STDMETHOD_(VOID,            MixerReset) 
     ( 
         THIS 
@@ -633,6 +730,14 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown)
         _Out_opt_   PUNKNOWN *          UnknownMiniportWave
     );
 
+    STDMETHOD_(NTSTATUS,        PrepareEndpointFilters)
+    (
+        THIS_
+        _In_opt_    PIRP                Irp,
+        _In_        ULONG               MiniportPairCount,
+        _In_reads_(MiniportPairCount) PENDPOINT_MINIPAIR * MiniportPairs
+    );
+
     STDMETHOD_(NTSTATUS,        RemoveEndpointFilters)
     (
         THIS_
@@ -676,6 +781,17 @@ DECLARE_INTERFACE_(IAdapterCommon, IUnknown)
         _In_ PDEVICE_OBJECT pdo
     );
 
+    STDMETHOD_(PUSBHS_CACHE_ENTRY, UsbSidebandCacheTake)
+    (
+        _In_ const GUID *       ContainerId,
+        _In_ ULONG              Hash
+    );
+
+    STDMETHOD_(NTSTATUS,        UsbSidebandCacheStore)
+    (
+        _In_ PUSBHS_CACHE_ENTRY Entry
+    );
+
 #endif // SYSVAD_USB_SIDEBAND
 
 #ifdef SYSVAD_A2DP_SIDEBAND
@@ -724,6 +840,33 @@ typedef VOID (*PFNEVENTNOTIFICATION)(
     _In_opt_    PVOID   Context
 );
 
+// SBC encoder stage of an A2DP stream, see A2dpSbcEncoder.h.
+typedef struct _A2DP_SBC_STAGE A2DP_SBC_STAGE;
+
+//
+// Microseconds elapsed since a KeQueryPerformanceCounter timestamp. The
+// sideband devices trace their arrival-to-started and arrival-to-first-stream
+// latencies with it.
+//
+inline
+LONGLONG
+SidebandElapsedUs
+(
+    _In_ LARGE_INTEGER  Since
+)
+{
+    LARGE_INTEGER   frequency;
+    LARGE_INTEGER   elapsed = KeQueryPerformanceCounter(&frequency);
+
+    //
+    // Scaling the raw delta to microseconds before dividing overflows after
+    // days of uptime; KSCONVERT_PERFORMANCE_TIME divides first.
+    //
+    elapsed.QuadPart -= Since.QuadPart;
+
+    return KSCONVERT_PERFORMANCE_TIME(frequency.QuadPart, elapsed) / 10;
+}
+
 DEFINE_GUID(IID_IBthHfpDeviceCommon,
     0x576b824a, 0x5248, 0x47b1, 0x82, 0xc5, 0xe4, 0x7b, 0xa7, 0xe2, 0xaf, 0x2b);
 
@@ -900,6 +1043,53 @@ DECLARE_INTERFACE_(ISidebandDeviceCommon, IUnknown)
     (
         THIS_
     ) PURE;
+
+    //
+    // When the stack does not encode the audio (no SCO bypass, no sideband
+    // encoder), the stream encodes it and moves it one packet at a time.
+    //
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHOD_(BOOL,                IsEncodingOffloaded)
+    (
+        THIS_
+        _In_        eDeviceType             deviceType
+    ) PURE;
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHOD_(NTSTATUS,            SendPacket)
+    (
+        THIS_
+        _In_        eDeviceType             deviceType,
+        _In_reads_bytes_(Length) const BYTE *Packet,
+        _In_        ULONG                   Length
+    ) PURE;
+
+    _IRQL_requires_max_(DISPATCH_LEVEL)
+    STDMETHOD_(NTSTATUS,            ReceivePacket)
+    (
+        THIS_
+        _In_        eDeviceType             deviceType,
+        _Out_writes_bytes_(Length) BYTE     *Packet,
+        _In_        ULONG                   Length
+    ) PURE;
+
+    //
+    // A2DP without a sideband encoder: the device's transport drains the
+    // stage's packet ring on its own schedule and feeds the link quality
+    // back to it, until StopPacketTransport returns.
+    //
+    STDMETHOD_(NTSTATUS,            StartPacketTransport)
+    (
+        THIS_
+        _In_        eDeviceType             deviceType,
+        _In_        A2DP_SBC_STAGE          *Stage
+    ) PURE;
+
+    STDMETHOD_(VOID,                StopPacketTransport)
+    (
+        THIS_
+        _In_        eDeviceType             deviceType
+    ) PURE;
 };
 typedef ISidebandDeviceCommon *PSIDEBANDDEVICECOMMON;
 
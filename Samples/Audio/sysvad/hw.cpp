@@ -44,6 +44,8 @@ Return Value:
 {
     PAGED_CODE();
     
+    KeInitializeSpinLock(&m_RegisterLock);
+
     MixerReset();
 } // CSYSVADHW
 #pragma code_seg()
@@ -216,14 +218,7 @@ Return Value:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(ulChannel);
-    
-    if (ulNode < MAX_TOPOLOGY_NODES)
-    {
-        return m_MuteControls[ulNode];
-    }
-
-    return 0;
+    return ReadMixerRegister(eMixerMute, ulNode, ulChannel);
 } // GetMixerMute
 
 //=============================================================================
@@ -271,14 +266,7 @@ Return Value:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(ulChannel);
-
-    if (ulNode < MAX_TOPOLOGY_NODES)
-    {
-        return m_VolumeControls[ulNode];
-    }
-
-    return 0;
+    return ReadMixerRegister(eMixerVolume, ulNode, ulChannel);
 } // GetMixerVolume
 
 //=============================================================================
@@ -306,25 +294,18 @@ Return Value:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(ulChannel);
-
-    if (ulNode < MAX_TOPOLOGY_NODES)
-    {
-        return m_PeakMeterControls[ulNode];
-    }
-
-    return 0;
-} // GetMixerVolume
+    return ReadMixerRegister(eMixerPeakMeter, ulNode, ulChannel);
+} // GetMixerPeakMeter
 
 //=============================================================================
-#pragma code_seg("PAGE")
 void 
 CSYSVADHW::MixerReset()
 /*++
 
 Routine Description:
 
-  Resets the mixer registers.
+  Resets the mixer registers. Not paged, the registers are reset under
+  the register lock.
 
 Arguments:
 
@@ -334,21 +315,27 @@ Return Value:
 
 --*/
 {
-    PAGED_CODE();
-    
-    RtlFillMemory(m_VolumeControls, sizeof(LONG) * MAX_TOPOLOGY_NODES, 0xFF);
+    KIRQL oldIrql;
+
+    KeAcquireSpinLock(&m_RegisterLock, &oldIrql);
+
+    RtlFillMemory(m_Registers[eMixerVolume], sizeof(m_Registers[eMixerVolume]), 0xFF);
     // Endpoints are not muted by default.
-    RtlZeroMemory(m_MuteControls, sizeof(BOOL) * MAX_TOPOLOGY_NODES);
+    RtlZeroMemory(m_Registers[eMixerMute], sizeof(m_Registers[eMixerMute]));
 
     for (ULONG i=0; i<MAX_TOPOLOGY_NODES; ++i)
     {
-        m_PeakMeterControls[i] = PEAKMETER_SIGNED_MAXIMUM/2;
+        for (ULONG j=0; j<MAX_TOPOLOGY_CHANNELS; ++j)
+        {
+            m_Registers[eMixerPeakMeter][i][j] = PEAKMETER_SIGNED_MAXIMUM/2;
+        }
     }
+
+    KeReleaseSpinLock(&m_RegisterLock, oldIrql);
     
     // BUGBUG change this depending on the topology
     m_ulMux = 2;
 } // MixerReset
-#pragma code_seg()
 
 //=============================================================================
 void
@@ -378,12 +365,7 @@ Return Value:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(ulChannel);
-
-    if (ulNode < MAX_TOPOLOGY_NODES)
-    {
-        m_MuteControls[ulNode] = fMute;
-    }
+    WriteMixerRegister(eMixerMute, ulNode, ulChannel, fMute ? TRUE : FALSE);
 } // SetMixerMute
 
 //=============================================================================
@@ -439,11 +421,261 @@ Return Value:
 
 --*/
 {
-    UNREFERENCED_PARAMETER(ulChannel);
+    WriteMixerRegister(eMixerVolume, ulNode, ulChannel, lVolume);
+} // SetMixerVolume
+
+
+//=============================================================================
+LONG
+CSYSVADHW::ReadMixerRegister
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   ulNode,
+    _In_  ULONG                   ulChannel
+)
+/*++
+
+Routine Description:
+
+  Reads one register without taking the register lock.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  ulNode - topology node id
+
+  ulChannel - which channel are we reading?
+
+Return Value:
 
-    if (ulNode < MAX_TOPOLOGY_NODES)
+  LONG - register value, 0 for a register that does not exist
+
+--*/
+{
+    if (Bank < eMixerRegisterBankCount &&
+        ulNode < MAX_TOPOLOGY_NODES &&
+        ulChannel < MAX_TOPOLOGY_CHANNELS)
     {
-        m_VolumeControls[ulNode] = lVolume;
+        return ReadNoFence(&m_Registers[Bank][ulNode][ulChannel]);
     }
-} // SetMixerVolume
+
+    return 0;
+} // ReadMixerRegister
+
+//=============================================================================
+void
+CSYSVADHW::WriteMixerRegister
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   ulNode,
+    _In_  ULONG                   ulChannel,
+    _In_  LONG                    lValue
+)
+/*++
+
+Routine Description:
+
+  Writes one register.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  ulNode - topology node id
+
+  ulChannel - which channel are we setting?
+
+  lValue - new register value
+
+Return Value:
+
+    void
+
+--*/
+{
+    WriteMixerRegisters(Bank, ulNode, ulChannel, 1, &lValue);
+} // WriteMixerRegister
+
+//=============================================================================
+void
+CSYSVADHW::ReadMixerRegisters
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   ulNode,
+    _In_  ULONG                   ulFirstChannel,
+    _In_  ULONG                   ulChannelCount,
+    _Out_writes_(ulChannelCount) PLONG plValues
+)
+/*++
+
+Routine Description:
+
+  Reads the registers of consecutive channels of a node as one snapshot.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  ulNode - topology node id
+
+  ulFirstChannel - first channel to read
+
+  ulChannelCount - number of channels to read
+
+  plValues - receives one value per channel, 0 for the channels that
+             do not exist
+
+Return Value:
+
+    void
+
+--*/
+{
+    KIRQL oldIrql;
+
+    RtlZeroMemory(plValues, ulChannelCount * sizeof(LONG));
+
+    if (Bank >= eMixerRegisterBankCount ||
+        ulNode >= MAX_TOPOLOGY_NODES ||
+        ulFirstChannel >= MAX_TOPOLOGY_CHANNELS)
+    {
+        return;
+    }
+
+    ulChannelCount = min(ulChannelCount, MAX_TOPOLOGY_CHANNELS - ulFirstChannel);
+
+    KeAcquireSpinLock(&m_RegisterLock, &oldIrql);
+
+    RtlCopyMemory(plValues, &m_Registers[Bank][ulNode][ulFirstChannel], ulChannelCount * sizeof(LONG));
+
+    KeReleaseSpinLock(&m_RegisterLock, oldIrql);
+} // ReadMixerRegisters
+
+//=============================================================================
+BOOL
+CSYSVADHW::WriteMixerRegisters
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   ulNode,
+    _In_  ULONG                   ulFirstChannel,
+    _In_  ULONG                   ulChannelCount,
+    _In_reads_(ulChannelCount) const LONG * plValues
+)
+/*++
+
+Routine Description:
+
+  Writes the registers of consecutive channels of a node in one operation.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  ulNode - topology node id
+
+  ulFirstChannel - first channel to write
+
+  ulChannelCount - number of channels to write
+
+  plValues - one value per channel; the channels that do not exist are
+             ignored
+
+Return Value:
+
+  TRUE if any register changed, so the caller reports one change for the
+  whole vector.
+
+--*/
+{
+    KIRQL   oldIrql;
+    BOOL    changed = FALSE;
+
+    if (Bank >= eMixerRegisterBankCount ||
+        ulNode >= MAX_TOPOLOGY_NODES ||
+        ulFirstChannel >= MAX_TOPOLOGY_CHANNELS)
+    {
+        return FALSE;
+    }
+
+    ulChannelCount = min(ulChannelCount, MAX_TOPOLOGY_CHANNELS - ulFirstChannel);
+
+    KeAcquireSpinLock(&m_RegisterLock, &oldIrql);
+
+    for (ULONG i = 0; i < ulChannelCount; ++i)
+    {
+        PLONG plRegister = &m_Registers[Bank][ulNode][ulFirstChannel + i];
+
+        if (*plRegister != plValues[i])
+        {
+            WriteNoFence(plRegister, plValues[i]);
+            changed = TRUE;
+        }
+    }
+
+    KeReleaseSpinLock(&m_RegisterLock, oldIrql);
+
+    return changed;
+} // WriteMixerRegisters
+
+//=============================================================================
+BOOL
+CSYSVADHW::FillMixerRegisters
+(
+    _In_  MIXER_REGISTER_BANK     Bank,
+    _In_  ULONG                   ulNode,
+    _In_  ULONG                   ulChannelCount,
+    _In_  LONG                    lValue
+)
+/*++
+
+Routine Description:
+
+  Sets the first ulChannelCount channels of a node to the same value in one
+  operation, as for a write to all the channels.
+
+Arguments:
+
+  Bank - volume, mute or peak meter
+
+  ulNode - topology node id
+
+  ulChannelCount - number of channels to write
+
+  lValue - new register value
+
+Return Value:
+
+  TRUE if any register changed.
+
+--*/
+{
+    KIRQL   oldIrql;
+    BOOL    changed = FALSE;
+
+    if (Bank >= eMixerRegisterBankCount ||
+        ulNode >= MAX_TOPOLOGY_NODES)
+    {
+        return FALSE;
+    }
+
+    ulChannelCount = min(ulChannelCount, MAX_TOPOLOGY_CHANNELS);
+
+    KeAcquireSpinLock(&m_RegisterLock, &oldIrql);
+
+    for (ULONG i = 0; i < ulChannelCount; ++i)
+    {
+        PLONG plRegister = &m_Registers[Bank][ulNode][i];
+
+        if (*plRegister != lValue)
+        {
+            WriteNoFence(plRegister, lValue);
+            changed = TRUE;
+        }
+    }
+
+    KeReleaseSpinLock(&m_RegisterLock, oldIrql);
+
+    return changed;
+} // FillMixerRegisters
 
@@ -22,22 +22,24 @@ Abstract:
 //=============================================================================
 // BUGBUG we should dynamically allocate this...
 #define MAX_TOPOLOGY_NODES      20
+#define MAX_TOPOLOGY_CHANNELS   8
 
 //=============================================================================
 // Classes
 //=============================================================================
 ///////////////////////////////////////////////////////////////////////////////
 // CSYSVADHW
-// This class represents virtual SYSVAD HW. An array representing volume
-// registers and mute registers.
+// This class represents virtual SYSVAD HW. A register file holding one
+// volume, mute and peak meter register per topology node and channel.
+// Single registers are read without the lock; writes and channel vector
+// reads take it, so a vector is always read or written as a whole.
 
 class CSYSVADHW
 {
 public:
 protected:
-    BOOL                        m_MuteControls[MAX_TOPOLOGY_NODES];
-    LONG                        m_VolumeControls[MAX_TOPOLOGY_NODES];
-    LONG                        m_PeakMeterControls[MAX_TOPOLOGY_NODES];
+    KSPIN_LOCK                  m_RegisterLock;
+    LONG                        m_Registers[eMixerRegisterBankCount][MAX_TOPOLOGY_NODES][MAX_TOPOLOGY_CHANNELS];
     ULONG                       m_ulMux;            // Mux selection
     BOOL                        m_bDevSpecific;
     INT                         m_iDevSpecific;
@@ -98,8 +100,44 @@ public:
         _In_  ULONG               ulChannel
     );
 
-protected:
+    void                        ReadMixerRegisters
+    (
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               ulNode,
+        _In_  ULONG               ulFirstChannel,
+        _In_  ULONG               ulChannelCount,
+        _Out_writes_(ulChannelCount) PLONG plValues
+    );
+    BOOL                        WriteMixerRegisters
+    (
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               ulNode,
+        _In_  ULONG               ulFirstChannel,
+        _In_  ULONG               ulChannelCount,
+        _In_reads_(ulChannelCount) const LONG * plValues
+    );
+    BOOL                        FillMixerRegisters
+    (
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               ulNode,
+        _In_  ULONG               ulChannelCount,
+        _In_  LONG                lValue
+    );
+
 private:
+    LONG                        ReadMixerRegister
+    (
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               ulNode,
+        _In_  ULONG               ulChannel
+    );
+    void                        WriteMixerRegister
+    (
+        _In_  MIXER_REGISTER_BANK Bank,
+        _In_  ULONG               ulNode,
+        _In_  ULONG               ulChannel,
+        _In_  LONG                lValue
+    );
 };
 typedef CSYSVADHW                *PCSYSVADHW;
 
@@ -734,15 +734,13 @@ Return Value:
             {
                 if (ALL_CHANNELS_ID == ulChannel)
                 {
-                    for (ULONG i=0; i<ulChannel; ++i)
-                    {
-                        AdapterCommon->MixerVolumeWrite
-                        (
-                            PropertyRequest->Node, 
-                            i, 
-                            VOLUME_NORMALIZE_IN_RANGE(*plVolume)
-                        );
-                    }
+                    AdapterCommon->MixerRegistersFill
+                    (
+                        eMixerVolume,
+                        PropertyRequest->Node, 
+                        MaxChannels, 
+                        VOLUME_NORMALIZE_IN_RANGE(*plVolume)
+                    );
                 }
                 else 
                 {
@@ -841,15 +839,13 @@ Return Value:
             {
                 if (ALL_CHANNELS_ID == ulChannel)
                 {
-                    for (ULONG i=0; i<ulChannel; ++i)
-                    {
-                        AdapterCommon->MixerMuteWrite
-                        (
-                            PropertyRequest->Node,
-                            i,
-                            (*pfMute) ? TRUE : FALSE
-                        );
-                    }
+                    AdapterCommon->MixerRegistersFill
+                    (
+                        eMixerMute,
+                        PropertyRequest->Node,
+                        MaxChannels,
+                        (*pfMute) ? TRUE : FALSE
+                    );
                 }
                 else
                 {
@@ -872,6 +868,118 @@ Return Value:
     return ntStatus;
 } // PropertyHandlerMute
 
+//=============================================================================
+#pragma code_seg("PAGE")
+NTSTATUS
+PropertyHandler_MixerVector
+(
+    _In_  PADAPTERCOMMON        AdapterCommon,
+    _In_  PPCPROPERTY_REQUEST   PropertyRequest,
+    _In_  ULONG                 MaxChannels,
+    _In_  MIXER_REGISTER_BANK   Bank
+)
+/*++
+
+Routine Description:
+
+  Property handler for KSPROPERTY_SYSVAD_VOLUMEVECTOR and
+  KSPROPERTY_SYSVAD_MUTEVECTOR. Gets or sets the first MaxChannels volume or
+  mute registers of the node in one register file operation.
+
+Arguments:
+
+  AdapterCommon - interface to the common adapter object.
+  
+  PropertyRequest - property request structure.
+
+  MaxChannels - # of supported channels.
+
+  Bank - eMixerVolume or eMixerMute.
+
+Return Value:
+
+  NT status code.
+
+--*/
+{
+    PAGED_CODE();
+
+    DPF_ENTER(("[%s]",__FUNCTION__));
+
+    NTSTATUS ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    PLONG    plValues;
+
+    C_ASSERT(sizeof(BOOL) == sizeof(LONG));
+    ASSERT(eMixerVolume == Bank || eMixerMute == Bank);
+
+    if (PropertyRequest->Verb & KSPROPERTY_TYPE_BASICSUPPORT)
+    {
+        ntStatus = 
+            PropertyHandler_BasicSupport
+            ( 
+                PropertyRequest, 
+                KSPROPERTY_TYPE_GET | KSPROPERTY_TYPE_SET | KSPROPERTY_TYPE_BASICSUPPORT,
+                VT_ILLEGAL
+            );
+    }
+    else if (0 == MaxChannels)
+    {
+        ntStatus = STATUS_INVALID_DEVICE_REQUEST;
+    }
+    else
+    {
+        ntStatus = 
+            ValidatePropertyParams
+            (
+                PropertyRequest, 
+                MaxChannels * sizeof(LONG)  // one value per channel
+            );
+        if (NT_SUCCESS(ntStatus))
+        {
+            plValues = PLONG (PropertyRequest->Value);
+
+            if (PropertyRequest->Verb & KSPROPERTY_TYPE_GET)
+            {
+                AdapterCommon->MixerRegistersRead
+                (
+                    Bank,
+                    PropertyRequest->Node,
+                    0,
+                    MaxChannels,
+                    plValues
+                );
+                PropertyRequest->ValueSize = MaxChannels * sizeof(LONG);
+            }
+            else if (PropertyRequest->Verb & KSPROPERTY_TYPE_SET)
+            {
+                // The value is a buffered copy, normalize it in place.
+                for (ULONG i=0; i<MaxChannels; ++i)
+                {
+                    plValues[i] = (eMixerVolume == Bank) ? 
+                                    VOLUME_NORMALIZE_IN_RANGE(plValues[i]) :
+                                    (plValues[i] ? TRUE : FALSE);
+                }
+
+                AdapterCommon->MixerRegistersWrite
+                (
+                    Bank,
+                    PropertyRequest->Node,
+                    0,
+                    MaxChannels,
+                    plValues
+                );
+            }
+        }
+
+        if (!NT_SUCCESS(ntStatus))
+        {
+            DPF(D_TERSE, ("[%s - ntStatus=0x%08x]",__FUNCTION__,ntStatus));
+        }
+    }
+
+    return ntStatus;
+} // PropertyHandler_MixerVector
+
 //=============================================================================
 #pragma code_seg("PAGE")
 NTSTATUS
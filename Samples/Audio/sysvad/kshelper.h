@@ -82,6 +82,15 @@ PropertyHandler_Mute
     _In_  ULONG                 MaxChannels
 );
 
+NTSTATUS
+PropertyHandler_MixerVector
+(
+    _In_  PADAPTERCOMMON        AdapterCommon,
+    _In_  PPCPROPERTY_REQUEST   PropertyRequest,
+    _In_  ULONG                 MaxChannels,
+    _In_  MIXER_REGISTER_BANK   Bank
+);
+
 NTSTATUS
 PropertyHandler_PeakMeter2
 (
@@ -179,6 +179,11 @@ typedef struct _PortClassDeviceContext              // 32       64      Byte off
 //
 extern DWORD g_DoNotCreateDataFiles;
 extern DWORD g_DisableBthScoBypass;
+extern DWORD g_BthHfpSoftwareCodec;
+extern DWORD g_A2dpSoftwareEncoder;
+extern DWORD g_A2dpLinkRate;
+extern DWORD g_KeywordHistoryMs;
+extern DWORD g_AudioModuleNotificationIntervalMs;
 extern UNICODE_STRING g_RegistryPath;
 
 //=============================================================================